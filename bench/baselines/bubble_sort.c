@@ -0,0 +1,46 @@
+// bubble_sort.c - C baseline for tests/bubble_sort.lx
+#include <stdio.h>
+#include <stdlib.h>
+
+static void swap(long *a, long *b) {
+  long tmp = *a;
+  *a = *b;
+  *b = tmp;
+}
+
+static void bubble_sort(long n, long *arr) {
+  for (long i = 0; i < n - 1; i++) {
+    int swapped = 0;
+    for (long j = 0; j < n - i - 1; j++) {
+      if (arr[j] > arr[j + 1]) {
+        swap(&arr[j], &arr[j + 1]);
+        swapped = 1;
+      }
+    }
+    if (!swapped)
+      break;
+  }
+}
+
+static void print_arr(long n, const long *arr) {
+  for (long i = 0; i < n; i++)
+    printf("%ld ", arr[i]);
+  printf("\n");
+}
+
+int main(void) {
+  long n = 7;
+  long *arr = malloc(n * sizeof(long));
+  long values[] = {64, 34, 25, 12, 22, 11, 90};
+  for (long i = 0; i < n; i++)
+    arr[i] = values[i];
+
+  printf("Unsorted Array: ");
+  print_arr(n, arr);
+  bubble_sort(n, arr);
+  printf("Sorted Array: ");
+  print_arr(n, arr);
+
+  free(arr);
+  return 0;
+}
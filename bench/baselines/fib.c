@@ -0,0 +1,45 @@
+// fib.c - C baseline for tests/test_fib.lx
+//
+// Two fib(40) calls in sequence, then two in parallel threads.
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+static long fib_rec(long n) {
+  if (n <= 1)
+    return n;
+  return fib_rec(n - 1) + fib_rec(n - 2);
+}
+
+static void *fib_thread(void *arg) {
+  return (void *)(intptr_t)fib_rec((long)(intptr_t)arg);
+}
+
+static long now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int main(void) {
+  long start = now_ms();
+  long a = fib_rec(40);
+  long b = fib_rec(40);
+  long seq_ms = now_ms() - start;
+  printf("sequential: %ld, %ld (%ldms)\n", a, b, seq_ms);
+
+  start = now_ms();
+  pthread_t t1, t2;
+  pthread_create(&t1, NULL, fib_thread, (void *)(intptr_t)40);
+  pthread_create(&t2, NULL, fib_thread, (void *)(intptr_t)40);
+  void *ret1, *ret2;
+  pthread_join(t1, &ret1);
+  pthread_join(t2, &ret2);
+  long par_ms = now_ms() - start;
+
+  printf("parallel:   %ld, %ld (%ldms)\n", (long)(intptr_t)ret1,
+         (long)(intptr_t)ret2, par_ms);
+  return 0;
+}
@@ -0,0 +1,208 @@
+#!/usr/bin/env python3
+"""How each compiler phase scales with project size.
+
+Generates synthetic projects with gen_project.py, sweeping one size knob at
+a time (module count, functions per module, nesting depth, identifiers per
+function) while the others keep their defaults, and builds each with
+luma --time-trace. Per-phase times come from the trace: Lex + Parse,
+Typecheck (typecheck_program_multipass and the passes it runs), IR
+generation, Optimize, Emit object and Link. Lexing on its own is timed with
+lexer_bench when --lexer-bench is given, since the parser pulls tokens
+from the lexer as it goes and the trace cannot separate the two.
+
+    python3 bench/compile_scaling.py --luma build/luma \\
+        --lexer-bench build/lexer_bench --json scaling.json --plot scaling.png
+
+For each sweep it prints lines/sec per phase and the exponent k in
+time ~ lines^k between the smallest and largest project. A phase with k
+well above 1 has a lookup or pass that is worse than linear in that knob.
+"""
+
+import argparse
+import json
+import math
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from gen_project import DEFAULTS, generate  # noqa: E402
+
+SWEEPS = {
+    "modules": [4, 8, 16, 32],
+    "functions": [8, 16, 32, 64],
+    "depth": [1, 2, 4, 8],
+    "identifiers": [4, 8, 16, 32],
+}
+
+# Trace span name -> phase; spans with the same phase are summed
+PHASES = [
+    ("Lex + Parse", "parse"),
+    ("Typecheck", "typecheck"),
+    ("IR generation", "ir"),
+    ("Optimize", "optimize"),
+    ("Emit object", "emit"),
+    ("Link", "link"),
+]
+
+# k above this is reported as superlinear
+SUPERLINEAR = 1.3
+
+
+def phase_times(trace_path):
+    with open(trace_path) as f:
+        events = json.load(f)["traceEvents"]
+    times = {phase: 0.0 for _, phase in PHASES}
+    names = dict(PHASES)
+    for event in events:
+        if event.get("ph") == "X" and event["name"] in names:
+            times[names[event["name"]]] += event["dur"] / 1e6
+    return times
+
+
+def lex_time(lexer_bench, files, total_bytes):
+    out = subprocess.run([lexer_bench, "-n", "20"] + files, check=True,
+                         stdout=subprocess.PIPE, text=True).stdout
+    match = re.search(r"total: [\d.]+ Mtokens/s, ([\d.]+) MB/s", out)
+    if not match or float(match.group(1)) <= 0:
+        raise RuntimeError("unexpected lexer_bench output:\n" + out)
+    return total_bytes / (float(match.group(1)) * 1e6)
+
+
+def measure(args, knobs, work):
+    project = os.path.join(work, "project")
+    shutil.rmtree(project, ignore_errors=True)
+    files, lines = generate(project, **knobs)
+    total_bytes = sum(os.path.getsize(f) for f in files)
+
+    best = None
+    for _ in range(args.repeat):
+        # A fresh directory each time, so no object is reused from obj/
+        build = os.path.join(work, "build")
+        shutil.rmtree(build, ignore_errors=True)
+        os.makedirs(build)
+        trace = os.path.join(build, "trace.json")
+        cmd = [args.luma, files[0], "-name", "p", "-O%s" % args.opt,
+               "--time-trace=%s" % trace, "-l"] + files[1:]
+        proc = subprocess.run(cmd, cwd=build, stdout=subprocess.PIPE,
+                              stderr=subprocess.STDOUT)
+        if proc.returncode != 0:
+            raise RuntimeError("luma failed on %s:\n%s" %
+                               (knobs, proc.stdout.decode(errors="replace")))
+        times = phase_times(trace)
+        best = times if best is None else {
+            phase: min(best[phase], times[phase]) for phase in best}
+
+    if args.lexer_bench:
+        best["lex"] = lex_time(args.lexer_bench, files, total_bytes)
+    return {"knobs": dict(knobs), "lines": lines, "bytes": total_bytes,
+            "seconds": best}
+
+
+def exponent(first, last, phase):
+    t0, t1 = first["seconds"][phase], last["seconds"][phase]
+    if t0 <= 0 or t1 <= 0 or last["lines"] == first["lines"]:
+        return None
+    return math.log(t1 / t0) / math.log(last["lines"] / first["lines"])
+
+
+def report(axis, points):
+    phases = [p for p in ["lex"] + [p for _, p in PHASES]
+              if p in points[0]["seconds"]]
+    print("\n%s, lines/sec per phase (others at %s)" % (axis, ", ".join(
+        "%s=%d" % kv for kv in DEFAULTS.items() if kv[0] != axis)))
+    print("%12s %9s" % (axis, "lines") +
+          "".join("%12s" % p for p in phases))
+    for point in points:
+        row = "%12d %9d" % (point["knobs"][axis], point["lines"])
+        for phase in phases:
+            seconds = point["seconds"][phase]
+            row += "%12s" % ("%.0f" % (point["lines"] / seconds)
+                             if seconds > 0 else "-")
+        print(row)
+
+    exponents = {p: exponent(points[0], points[-1], p) for p in phases}
+    row = "%22s" % "k"
+    for phase in phases:
+        k = exponents[phase]
+        row += "%12s" % ("-" if k is None else
+                         "%.2f%s" % (k, "!" if k > SUPERLINEAR else ""))
+    print(row)
+    return exponents
+
+
+def plot(path, sweeps):
+    try:
+        import matplotlib
+        matplotlib.use("Agg")
+        import matplotlib.pyplot as plt
+    except ImportError:
+        print("matplotlib is not installed, skipping --plot", file=sys.stderr)
+        return
+    fig, axes = plt.subplots(1, len(sweeps), figsize=(5 * len(sweeps), 4),
+                             squeeze=False)
+    for ax, (axis, data) in zip(axes[0], sweeps.items()):
+        points = data["points"]
+        for phase in points[0]["seconds"]:
+            xs = [p["knobs"][axis] for p in points]
+            ys = [p["lines"] / p["seconds"][phase]
+                  if p["seconds"][phase] > 0 else float("nan")
+                  for p in points]
+            ax.plot(xs, ys, marker="o", label=phase)
+        ax.set_xscale("log", base=2)
+        ax.set_yscale("log")
+        ax.set_xlabel(axis)
+        ax.set_ylabel("lines/sec")
+        ax.legend(fontsize="small")
+    fig.tight_layout()
+    fig.savefig(path)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--luma", required=True, help="luma binary")
+    parser.add_argument("--lexer-bench", help="lexer_bench binary")
+    parser.add_argument("-O", dest="opt", default="2",
+                        choices=["0", "1", "2", "3"])
+    parser.add_argument("--repeat", type=int, default=3,
+                        help="builds per point; the fastest counts")
+    parser.add_argument("--sweep", action="append", choices=list(SWEEPS),
+                        help="run just this sweep (repeatable)")
+    parser.add_argument("--json", help="write results here")
+    parser.add_argument("--plot", help="write a lines/sec chart (PNG)")
+    args = parser.parse_args()
+    args.luma = os.path.abspath(args.luma)
+    if args.lexer_bench:
+        args.lexer_bench = os.path.abspath(args.lexer_bench)
+
+    sweeps = {}
+    work = tempfile.mkdtemp(prefix="luma-scaling-")
+    try:
+        for axis in args.sweep or list(SWEEPS):
+            points = []
+            for value in SWEEPS[axis]:
+                knobs = dict(DEFAULTS)
+                knobs[axis] = value
+                points.append(measure(args, knobs, work))
+            sweeps[axis] = {"points": points,
+                            "exponents": report(axis, points)}
+    except RuntimeError as err:
+        print("FAIL %s" % err, file=sys.stderr)
+        return 1
+    finally:
+        shutil.rmtree(work, ignore_errors=True)
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"opt": "O" + args.opt, "sweeps": sweeps}, f, indent=2)
+            f.write("\n")
+    if args.plot:
+        plot(args.plot, sweeps)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
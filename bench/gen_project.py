@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+"""Generate a synthetic Luma project for compiler-throughput measurements.
+
+The project is a chain of modules, mod_0 .. mod_<n-1>, and a main.lx that
+uses the last one. Each module uses the one before it, declares a struct,
+and defines a number of functions, named m<module>_f<n> because function
+symbols are not qualified by module at link time. Every function body
+declares its own locals, nests if/loop blocks to a given depth, and calls
+the previous function in the module and one in the previous module. Every
+phase therefore has work proportional to the size knobs: symbol tables fill
+with identifiers, scopes nest, and qualified calls go through @use
+resolution.
+
+    python3 bench/gen_project.py out/ --modules 20 --functions 50 \\
+        --depth 4 --identifiers 16
+
+It prints the files to compile, main.lx first, so that
+
+    luma $(python3 bench/gen_project.py out/ | sed '1s/$/ -name p -l/')
+
+builds the project. compile_scaling.py imports generate() directly.
+"""
+
+import argparse
+import os
+import sys
+
+DEFAULTS = {"modules": 8, "functions": 32, "depth": 3, "identifiers": 8}
+
+
+def emit_body(lines, depth, identifiers, indent):
+    pad = "    " * indent
+    if depth == 0:
+        for k in range(identifiers):
+            lines.append("%sacc = acc + v_%d * %d;" % (pad, k, k + 1))
+        return
+    # Alternate loops and ifs so both kinds of scope nest
+    if depth % 2 == 0:
+        var = "i_%d" % depth
+        lines.append("%sloop [%s: int = 0](%s < a) : (++%s) {" %
+                     (pad, var, var, var))
+        lines.append("%s    let w_%d: int = %s + acc;" % (pad, depth, var))
+    else:
+        lines.append("%sif (acc %% %d == 0 || b > %d) {" %
+                     (pad, depth + 2, depth))
+        lines.append("%s    let w_%d: int = acc - b;" % (pad, depth))
+    emit_body(lines, depth - 1, identifiers, indent + 1)
+    lines.append("%s    acc = acc + w_%d;" % (pad, depth))
+    lines.append("%s}" % pad)
+
+
+def module_source(index, functions, depth, identifiers):
+    lines = ['@module "mod_%d"' % index, ""]
+    if index > 0:
+        lines += ['@use "mod_%d" as prev' % (index - 1), ""]
+
+    lines.append("const Record_%d -> struct {" % index)
+    for k in range(identifiers):
+        lines.append("    field_%d: int%s" %
+                     (k, "," if k + 1 < identifiers else ""))
+    lines += ["};", ""]
+
+    for f in range(functions):
+        lines.append("pub const m%d_f%d -> fn (a: int, b: int) int {" %
+                     (index, f))
+        lines.append("    let acc: int = 0;")
+        lines.append("    let r: Record_%d;" % index)
+        for k in range(identifiers):
+            lines.append("    let v_%d: int = a * %d + b;" % (k, k + 1))
+            lines.append("    r.field_%d = v_%d;" % (k, k))
+        emit_body(lines, depth, identifiers, 1)
+        if f > 0:
+            lines.append("    acc = acc + m%d_f%d(b, a);" % (index, f - 1))
+        if index > 0:
+            lines.append("    acc = acc + prev::m%d_f%d(a, b);" %
+                         (index - 1, f))
+        lines.append("    return acc + r.field_0;")
+        lines += ["}", ""]
+    return "\n".join(lines)
+
+
+def generate(out_dir, modules, functions, depth, identifiers):
+    """Writes the project and returns (files, line count); main.lx first."""
+    os.makedirs(out_dir, exist_ok=True)
+    files, total_lines = [], 0
+
+    main = os.path.join(out_dir, "main.lx")
+    last = modules - 1
+    source = "\n".join([
+        '@module "main"', "",
+        '@use "mod_%d" as top' % last, "",
+        "pub const main -> fn () int {",
+        "    return top::m%d_f%d(3, 4) %% 256;" % (last, functions - 1),
+        "}", "",
+    ])
+    with open(main, "w") as f:
+        f.write(source)
+    files.append(main)
+    total_lines += source.count("\n")
+
+    for index in range(modules):
+        path = os.path.join(out_dir, "mod_%d.lx" % index)
+        source = module_source(index, functions, depth, identifiers)
+        with open(path, "w") as f:
+            f.write(source)
+        files.append(path)
+        total_lines += source.count("\n")
+    return files, total_lines
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("out_dir")
+    for knob, value in DEFAULTS.items():
+        parser.add_argument("--" + knob, type=int, default=value)
+    args = parser.parse_args()
+    if min(args.modules, args.functions, args.identifiers) < 1:
+        parser.error("--modules, --functions and --identifiers must be >= 1")
+
+    files, _ = generate(args.out_dir, args.modules, args.functions,
+                        args.depth, args.identifiers)
+    print("\n".join(files))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,104 @@
+// lexer_bench.c - Lexer throughput micro-benchmark
+//
+// Tokenizes the given files repeatedly and reports tokens per second and the
+// cost per token. Lexing only: no parsing, no error reporting beyond what the
+// lexer itself records.
+//
+//   lexer_bench [-n iterations] <file.lx>...
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/c_libs/memory/memory.h"
+#include "../src/lexer/lexer.h"
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static char *read_source(const char *path, size_t *size) {
+  FILE *file = fopen(path, "rb");
+  if (!file)
+    return NULL;
+  fseek(file, 0, SEEK_END);
+  long length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  if (length < 0) {
+    fclose(file);
+    return NULL;
+  }
+
+  char *buffer = xmalloc((size_t)length + 1);
+  size_t read = fread(buffer, 1, (size_t)length, file);
+  buffer[read] = '\0';
+  fclose(file);
+  *size = read;
+  return buffer;
+}
+
+static size_t lex_all(const char *source, ArenaAllocator *arena) {
+  Lexer lexer;
+  init_lexer(&lexer, source, arena);
+  size_t count = 0;
+  for (;;) {
+    Token token = next_token(&lexer);
+    count++;
+    if (token.type_ == TOK_EOF)
+      return count;
+  }
+}
+
+int main(int argc, char **argv) {
+  int iterations = 200;
+  int first_file = 1;
+  if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+    iterations = atoi(argv[2]);
+    first_file = 3;
+  }
+  if (first_file >= argc || iterations <= 0) {
+    fprintf(stderr, "usage: %s [-n iterations] <file.lx>...\n", argv[0]);
+    return 1;
+  }
+
+  ArenaAllocator arena;
+  arena_allocator_init(&arena, 1024 * 1024);
+
+  size_t total_bytes = 0, total_tokens = 0;
+  double total_time = 0.0;
+
+  for (int i = first_file; i < argc; i++) {
+    size_t size = 0;
+    char *source = read_source(argv[i], &size);
+    if (!source) {
+      fprintf(stderr, "cannot read %s\n", argv[i]);
+      return 1;
+    }
+
+    size_t tokens = lex_all(source, &arena); // Warm-up
+    double start = now_seconds();
+    for (int n = 0; n < iterations; n++) {
+      arena_reset(&arena);
+      lex_all(source, &arena);
+    }
+    double elapsed = now_seconds() - start;
+
+    printf("%-40s %8zu tokens %8.1f ns/token\n", argv[i], tokens,
+           elapsed * 1e9 / ((double)tokens * iterations));
+    total_bytes += size * (size_t)iterations;
+    total_tokens += tokens * (size_t)iterations;
+    total_time += elapsed;
+    free(source);
+  }
+
+  printf("total: %.2f Mtokens/s, %.1f MB/s, %.1f ns/token\n",
+         (double)total_tokens / total_time / 1e6,
+         (double)total_bytes / total_time / 1e6,
+         total_time * 1e9 / (double)total_tokens);
+
+  arena_destroy(&arena);
+  return 0;
+}
@@ -0,0 +1,345 @@
+#!/usr/bin/env python3
+"""Request latency of luma -lsp over a replayed session.
+
+Feeds a session's client messages to luma -lsp with their original spacing
+and times each reply: request to response for hover, completion,
+definition, semantic tokens and the other requests, and didOpen or
+didChange to the next publishDiagnostics of that document (which includes
+the server's debounce). Prints p50/p95/p99 per method and the server's
+peak RSS.
+
+A session is recorded from a real editor by starting the server with
+LUMA_LSP_RECORD set to a file, which gets one entry per message: a line
+"<microseconds since start> <in|out> <bytes>", the message and a newline.
+Without --session a synthetic one is generated over programs in tests/:
+opening them, hovering, going to definitions and completing identifiers,
+and typing edits between semantic token requests.
+
+    LUMA_LSP_RECORD=session.rec luma -lsp        # from the editor
+    python3 bench/lsp_replay.py --luma build/luma --session session.rec \\
+        --json lsp.json
+    python3 bench/lsp_replay.py --luma build/luma --json new.json \\
+        --compare lsp.json
+
+With --compare, a method whose p95 grew by more than --threshold (default
+25%) and by at least a millisecond is reported and the script exits with 1.
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import threading
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+SYNTHETIC_FILES = ["tests/sort_test.lx", "tests/str_test.lx"]
+
+# After an edit or opening a file, long enough for the debounced analysis
+SETTLE_S = 1.0
+KEYSTROKE_S = 0.05
+
+
+def read_session(path):
+    """The client's messages of a recording, as (seconds, message) pairs."""
+    messages = []
+    with open(path, "rb") as f:
+        while True:
+            header = f.readline()
+            if not header:
+                break
+            if not header.strip():
+                continue
+            us, direction, length = header.split()
+            body = f.read(int(length))
+            f.read(1)
+            if direction == b"in":
+                messages.append((int(us) / 1e6, json.loads(body)))
+    return messages
+
+
+def synthetic_session():
+    """Messages a short editing session over SYNTHETIC_FILES sends."""
+    root_uri = "file://" + os.path.join(ROOT, "tests")
+    messages = []
+    clock = [0.0]
+
+    def send(message, gap=0.02):
+        clock[0] += gap
+        messages.append((clock[0], message))
+
+    next_id = [1]
+
+    def request(method, params, gap=0.02):
+        send({"jsonrpc": "2.0", "id": next_id[0], "method": method,
+              "params": params}, gap)
+        next_id[0] += 1
+
+    request("initialize", {"processId": None, "rootUri": root_uri,
+                           "capabilities": {}})
+    send({"jsonrpc": "2.0", "method": "initialized", "params": {}})
+
+    for name in SYNTHETIC_FILES:
+        path = os.path.join(ROOT, name)
+        uri = "file://" + path
+        with open(path) as f:
+            text = f.read()
+        lines = text.split("\n")
+        doc = {"uri": uri}
+
+        send({"jsonrpc": "2.0", "method": "textDocument/didOpen", "params": {
+            "textDocument": {"uri": uri, "languageId": "luma", "version": 1,
+                             "text": text}}})
+        request("textDocument/semanticTokens/full", {"textDocument": doc},
+                SETTLE_S)
+        request("textDocument/documentSymbol", {"textDocument": doc})
+
+        # Every few identifiers, up to 60 of them
+        spots = []
+        for number, line in enumerate(lines):
+            if line.lstrip().startswith("//"):
+                continue
+            for match in re.finditer(r"[A-Za-z_][A-Za-z0-9_]{2,}", line):
+                spots.append((number, match.start(), match.end()))
+        for number, start, end in spots[::max(1, len(spots) // 60)]:
+            position = {"line": number, "character": start + 1}
+            request("textDocument/hover",
+                    {"textDocument": doc, "position": position})
+            request("textDocument/definition",
+                    {"textDocument": doc, "position": position})
+            request("textDocument/completion", {
+                "textDocument": doc,
+                "position": {"line": number,
+                             "character": min(end, start + 2)}})
+
+        # Type a comment into a few lines, asking for completions and the
+        # changed tokens as an editor would
+        version = 1
+        step = max(1, len(lines) // 4)
+        for number in range(step, len(lines), step):
+            for i, char in enumerate("// edited"):
+                version += 1
+                at = {"line": number, "character": i}
+                send({"jsonrpc": "2.0", "method": "textDocument/didChange",
+                      "params": {"textDocument": {"uri": uri,
+                                                  "version": version},
+                                 "contentChanges": [{
+                                     "range": {"start": at, "end": at},
+                                     "text": char}]}}, KEYSTROKE_S)
+            request("textDocument/completion", {
+                "textDocument": doc,
+                "position": {"line": number + 1, "character": 0}})
+            request("textDocument/semanticTokens/full/delta",
+                    {"textDocument": doc, "previousResultId": ""},
+                    SETTLE_S)
+
+    request("shutdown", None, 0.1)
+    send({"jsonrpc": "2.0", "method": "exit", "params": None})
+    return messages
+
+
+def percentile(samples, p):
+    ordered = sorted(samples)
+    rank = max(0, min(len(ordered) - 1,
+                      int(round(p / 100.0 * len(ordered) + 0.5)) - 1))
+    return ordered[rank]
+
+
+class Replay:
+    def __init__(self, luma, log):
+        self.proc = subprocess.Popen(
+            [luma, "-lsp"], stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+            stderr=log or subprocess.DEVNULL, cwd=ROOT)
+        self.lock = threading.Lock()
+        self.done = threading.Condition(self.lock)
+        self.pending = {}       # request id -> (method, sent at, uri)
+        self.changed = {}       # uri -> (event, sent at)
+        self.result_ids = {}    # uri -> semantic tokens result id
+        self.samples = {}
+        self.reader = threading.Thread(target=self.read, daemon=True)
+        self.reader.start()
+
+    def record(self, method, seconds):
+        self.samples.setdefault(method, []).append(seconds * 1000.0)
+
+    def read(self):
+        out = self.proc.stdout
+        while True:
+            header = b""
+            while not header.endswith(b"\r\n\r\n"):
+                byte = out.read(1)
+                if not byte:
+                    with self.lock:
+                        self.done.notify_all()
+                    return
+                header += byte
+            length = int(re.search(rb"Content-Length: *(\d+)", header,
+                                   re.I).group(1))
+            message = json.loads(out.read(length))
+            now = time.monotonic()
+            with self.lock:
+                self.handle(message, now)
+                self.done.notify_all()
+
+    def handle(self, message, now):
+        if "id" in message and "method" not in message:
+            sent = self.pending.pop(message["id"], None)
+            if sent:
+                self.record(sent[0], now - sent[1])
+                result = message.get("result")
+                if isinstance(result, dict) and "resultId" in result:
+                    self.result_ids[sent[2]] = result["resultId"]
+        elif message.get("method") == "textDocument/publishDiagnostics":
+            change = self.changed.pop(message["params"]["uri"], None)
+            if change:
+                self.record(change[0], now - change[1])
+
+    def send(self, message):
+        params = message.get("params") or {}
+        uri = (params.get("textDocument") or {}).get("uri")
+        with self.lock:
+            # Result ids are the server's; the recorded ones were another's
+            if "previousResultId" in params:
+                params["previousResultId"] = self.result_ids.get(uri, "")
+            method = message.get("method")
+            if method and "id" in message:
+                self.pending[message["id"]] = (method, time.monotonic(), uri)
+            elif method in ("textDocument/didOpen",
+                            "textDocument/didChange"):
+                # Diagnostics answer the last edit, however many came first
+                event = method.split("/")[1] + "->diagnostics"
+                self.changed[uri] = (event, time.monotonic())
+        body = json.dumps(message).encode()
+        try:
+            self.proc.stdin.write(b"Content-Length: %d\r\n\r\n" % len(body) +
+                                  body)
+            self.proc.stdin.flush()
+        except BrokenPipeError:
+            pass
+
+    def finish(self, timeout):
+        deadline = time.monotonic() + timeout
+        with self.lock:
+            while self.pending and self.proc.poll() is None:
+                left = deadline - time.monotonic()
+                if left <= 0:
+                    break
+                self.done.wait(left)
+            lost = sorted(set(m for m, *_ in self.pending.values()))
+        try:
+            self.proc.stdin.close()
+        except BrokenPipeError:
+            pass
+        try:
+            _, status, usage = os.wait4(self.proc.pid, 0)
+        except ChildProcessError:
+            usage, status = None, 0
+        self.proc.returncode = os.waitstatus_to_exitcode(status)
+        # KiB on Linux, bytes on macOS
+        rss = usage.ru_maxrss if usage else 0
+        if sys.platform == "darwin":
+            rss //= 1024
+        return lost, rss
+
+
+def run(messages, args):
+    log = open(args.log, "w") if args.log else None
+    replay = Replay(args.luma, log)
+    began = start = time.monotonic()
+    first = messages[0][0] if messages else 0.0
+    for at, message in messages:
+        wait = (at - first) / args.speed - (time.monotonic() - start)
+        if wait > 0:
+            time.sleep(min(wait, args.max_gap))
+            # A capped gap moves the rest of the session up with it
+            start -= max(0.0, wait - args.max_gap)
+        replay.send(message)
+    lost, rss = replay.finish(args.timeout)
+    if log:
+        log.close()
+    return replay.samples, lost, rss, time.monotonic() - began
+
+
+def compare(results, old, threshold):
+    regressed = []
+    before_methods = old.get("methods", {})
+    for method, now in results["methods"].items():
+        before = before_methods.get(method)
+        if not before or before["p95_ms"] <= 0:
+            continue
+        change = now["p95_ms"] / before["p95_ms"]
+        now["change"] = change
+        if change > 1.0 + threshold and now["p95_ms"] - before["p95_ms"] >= 1:
+            regressed.append("%s: p95 %.2fms -> %.2fms (+%.0f%%)" %
+                             (method, before["p95_ms"], now["p95_ms"],
+                              (change - 1.0) * 100))
+    return regressed
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--luma", required=True, help="luma binary")
+    parser.add_argument("--session", help="recorded with LUMA_LSP_RECORD "
+                        "(default: a synthetic session over tests/)")
+    parser.add_argument("--speed", type=float, default=1.0,
+                        help="replay this many times faster")
+    parser.add_argument("--max-gap", type=float, default=2.0,
+                        help="longest pause between messages, in seconds")
+    parser.add_argument("--repeat", type=int, default=1,
+                        help="replay the session this many times")
+    parser.add_argument("--timeout", type=float, default=60.0,
+                        help="wait this long for the last replies")
+    parser.add_argument("--log", help="write the server's stderr here")
+    parser.add_argument("--json", help="write results here")
+    parser.add_argument("--compare", help="earlier --json output")
+    parser.add_argument("--threshold", type=float, default=0.25)
+    args = parser.parse_args()
+    args.luma = os.path.abspath(args.luma)
+
+    messages = read_session(args.session) if args.session \
+        else synthetic_session()
+    samples, failures, peak_rss, wall = {}, [], 0, 0.0
+    for _ in range(args.repeat):
+        run_samples, lost, rss, seconds = run(messages, args)
+        for method, times in run_samples.items():
+            samples.setdefault(method, []).extend(times)
+        failures += ["no reply to " + method for method in lost]
+        peak_rss = max(peak_rss, rss)
+        wall += seconds
+
+    results = {"session": args.session or "synthetic", "wall_s": wall,
+               "peak_rss_kb": peak_rss, "methods": {}}
+    print("%-40s %6s %9s %9s %9s %9s" %
+          ("method", "count", "p50 ms", "p95 ms", "p99 ms", "max ms"))
+    for method in sorted(samples):
+        times = samples[method]
+        stats = {"count": len(times),
+                 "p50_ms": percentile(times, 50),
+                 "p95_ms": percentile(times, 95),
+                 "p99_ms": percentile(times, 99),
+                 "max_ms": max(times)}
+        results["methods"][method] = stats
+        print("%-40s %6d %9.2f %9.2f %9.2f %9.2f" %
+              (method, stats["count"], stats["p50_ms"], stats["p95_ms"],
+               stats["p99_ms"], stats["max_ms"]))
+    print("peak RSS %.1f MiB, %.1fs" % (peak_rss / 1024.0, wall))
+
+    if args.compare:
+        with open(args.compare) as f:
+            failures += ["regressed " + r for r in
+                         compare(results, json.load(f), args.threshold)]
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(results, f, indent=2)
+            f.write("\n")
+
+    for failure in failures:
+        print("FAIL " + failure, file=sys.stderr)
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
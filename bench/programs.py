@@ -0,0 +1,231 @@
+#!/usr/bin/env python3
+"""Runtime benchmarks over the example programs in tests/.
+
+Builds each program with luma at the given optimization level, runs it
+headless with a fixed input, and times it against an equivalent C baseline
+built with the same -O level where one exists in bench/baselines/. Results
+go to a JSON file so two runs can be compared:
+
+    python3 bench/programs.py --luma build/luma -O 2 --json O2.json
+    python3 bench/programs.py --luma build/luma -O 2 --json new.json \\
+        --compare O2.json
+
+With --compare, a program whose best run time grew by more than
+--threshold (default 10%) is reported and the script exits with 1. A
+program whose output differs from the -O0 build is always a failure, since
+that is a miscompile rather than a slowdown.
+
+tests/tetris and tests/rotating_cube redraw the terminal until a key is
+pressed, so they have no headless mode and are not part of the suite.
+"""
+
+import argparse
+import hashlib
+import json
+import os
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+PROGRAMS = [
+    {
+        "name": "fib",
+        "main": "tests/test_fib.lx",
+        "libs": ["std/thread.lx", "std/libc.lx", "std/time.lx"],
+        "baseline": "bench/baselines/fib.c",
+        "repeat": 3,
+        # Prints its own timings, so the output changes from run to run
+        "deterministic": False,
+    },
+    {
+        "name": "bubble_sort",
+        "main": "tests/bubble_sort.lx",
+        "libs": [],
+        "baseline": "bench/baselines/bubble_sort.c",
+        "repeat": 50,
+    },
+    {
+        "name": "vm",
+        "main": "tests/VM/src/vm.lx",
+        "libs": [
+            "tests/VM/src/common.lx", "tests/VM/src/debug.lx",
+            "tests/VM/src/lexer.lx", "tests/VM/src/main.lx",
+            "tests/VM/src/parser.lx", "tests/VM/src/symbols.lx",
+            "std/io.lx", "std/memory.lx", "std/sys.lx", "std/termfx.lx",
+            "std/vector.lx", "std/cstring.lx",
+        ],
+        # The instruction vector is a module global freed from another
+        # function, which the static analyzer cannot follow
+        "flags": ["--no-sanitize"],
+        "data": ["tests/VM/text.txt"],
+        "repeat": 50,
+    },
+    {
+        "name": "chess",
+        "main": "tests/chess_engine/main.lx",
+        "libs": [
+            "tests/chess_engine/board.lx", "tests/chess_engine/piece.lx",
+            "std/cstring.lx", "std/terminal.lx", "std/termfx.lx",
+            "std/memory.lx",
+        ],
+        # One line per move; the board reads four characters, then the
+        # newline is taken by the "press enter" prompt
+        "stdin": "e2e4\ne7e5\ng1f3\nb8c6\nf1c4\ng8f6\nd2d3\nf8c5\nexit\n",
+        "repeat": 50,
+    },
+]
+
+
+def run(cmd, cwd, stdin=None):
+    start = time.perf_counter()
+    proc = subprocess.run(cmd, cwd=cwd, input=stdin, stdout=subprocess.PIPE,
+                          stderr=subprocess.STDOUT, timeout=600)
+    return time.perf_counter() - start, proc.returncode, proc.stdout
+
+
+def time_runs(cmd, cwd, stdin, repeat):
+    times, output = [], None
+    for _ in range(repeat):
+        elapsed, code, out = run(cmd, cwd, stdin)
+        if code != 0:
+            raise RuntimeError("%s exited with %d:\n%s" %
+                               (cmd[0], code, out.decode(errors="replace")))
+        times.append(elapsed)
+        output = out
+    return min(times), statistics.median(times), output
+
+
+def bench_program(prog, args, work):
+    cwd = os.path.join(work, prog["name"])
+    os.makedirs(cwd)
+    for data in prog.get("data", []):
+        shutil.copy(os.path.join(ROOT, data), cwd)
+
+    cmd = [args.luma, os.path.join(ROOT, prog["main"]), "-name", "prog",
+           "-O%s" % args.opt] + prog.get("flags", [])
+    if prog["libs"]:
+        cmd += ["-l"] + [os.path.join(ROOT, lib) for lib in prog["libs"]]
+    compile_s, code, out = run(cmd, cwd)
+    if code != 0 or not os.path.exists(os.path.join(cwd, "prog")):
+        raise RuntimeError("luma failed on %s:\n%s" %
+                           (prog["main"], out.decode(errors="replace")))
+
+    stdin = prog.get("stdin", "").encode()
+    repeat = args.repeat or prog["repeat"]
+    best, median, output = time_runs([os.path.join(cwd, "prog")], cwd, stdin,
+                                     repeat)
+    result = {
+        "name": prog["name"],
+        "compile_s": compile_s,
+        "run_s_min": best,
+        "run_s_median": median,
+        "runs": repeat,
+    }
+    if prog.get("deterministic", True):
+        result["output_md5"] = hashlib.md5(output).hexdigest()
+
+    baseline = prog.get("baseline")
+    if baseline and args.cc:
+        exe = os.path.join(cwd, "baseline")
+        _, code, out = run([args.cc, "-O%s" % args.opt,
+                            os.path.join(ROOT, baseline), "-o", exe,
+                            "-lpthread"], cwd)
+        if code != 0:
+            raise RuntimeError("%s failed on %s:\n%s" %
+                               (args.cc, baseline, out.decode()))
+        c_best, c_median, _ = time_runs([exe], cwd, stdin, repeat)
+        result["c_run_s_min"] = c_best
+        result["c_run_s_median"] = c_median
+        result["ratio_to_c"] = best / c_best if c_best > 0 else None
+    return result
+
+
+def compare(results, previous, threshold):
+    old = {p["name"]: p for p in previous["programs"]}
+    regressed = []
+    for prog in results["programs"]:
+        before = old.get(prog["name"])
+        if not before or before["run_s_min"] <= 0:
+            continue
+        change = prog["run_s_min"] / before["run_s_min"]
+        prog["change"] = change
+        if change > 1.0 + threshold:
+            regressed.append("%s: %.4fs -> %.4fs (+%.0f%%)" %
+                             (prog["name"], before["run_s_min"],
+                              prog["run_s_min"], (change - 1.0) * 100))
+    return regressed
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--luma", required=True, help="luma binary")
+    parser.add_argument("--cc", default=os.environ.get("CC", "cc"),
+                        help="C compiler for the baselines ('' to skip)")
+    parser.add_argument("-O", dest="opt", default="2",
+                        choices=["0", "1", "2", "3"])
+    parser.add_argument("--json", help="write results here")
+    parser.add_argument("--compare", help="earlier --json output")
+    parser.add_argument("--threshold", type=float, default=0.10)
+    parser.add_argument("--repeat", type=int, default=0,
+                        help="override each program's run count")
+    parser.add_argument("--only", action="append",
+                        help="run just this program (repeatable)")
+    args = parser.parse_args()
+    args.luma = os.path.abspath(args.luma)
+
+    programs = [p for p in PROGRAMS if not args.only or p["name"] in args.only]
+    results = {"opt": "O" + args.opt, "programs": []}
+    failures = []
+    work = tempfile.mkdtemp(prefix="luma-bench-")
+    try:
+        for prog in programs:
+            try:
+                result = bench_program(prog, args, work)
+            except (RuntimeError, subprocess.TimeoutExpired) as err:
+                failures.append("%s: %s" % (prog["name"], err))
+                continue
+            results["programs"].append(result)
+            line = "%-12s compile %7.3fs  run %8.4fs" % (
+                result["name"], result["compile_s"], result["run_s_min"])
+            if "ratio_to_c" in result:
+                line += "  C %8.4fs  x%.2f" % (result["c_run_s_min"],
+                                               result["ratio_to_c"])
+            print(line)
+
+        # Optimized builds must print what the -O0 build prints
+        if args.opt != "0":
+            reference = argparse.Namespace(**vars(args))
+            reference.opt, reference.repeat, reference.cc = "0", 1, ""
+            for result in results["programs"]:
+                if "output_md5" not in result:
+                    continue
+                prog = next(p for p in programs if p["name"] == result["name"])
+                shutil.rmtree(os.path.join(work, prog["name"]))
+                expected = bench_program(prog, reference, work)
+                if expected["output_md5"] != result["output_md5"]:
+                    failures.append("%s: output differs from the -O0 build" %
+                                    result["name"])
+    finally:
+        shutil.rmtree(work, ignore_errors=True)
+
+    if args.compare:
+        with open(args.compare) as f:
+            failures += ["regressed " + r for r in
+                         compare(results, json.load(f), args.threshold)]
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(results, f, indent=2)
+            f.write("\n")
+
+    for failure in failures:
+        print("FAIL " + failure, file=sys.stderr)
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""Generate src/lexer/lexer_hash.h, the perfect hashes of the lexer tables.
+
+Each table in src/lexer/lexer.c (symbols[], keywords[],
+preprocessor_directives[], builtins[], function_attributes[]) gets a hash of the form
+
+    (len * A + first_char * B + last_char * C) & (SIZE - 1)
+
+(first_char skips a sigil every entry shares, like '@', and moves further in
+when that is not enough, as for @clz and @ctz), with A, B, C and SIZE chosen
+so no two entries share a slot. A slot holds the
+entry's index + 1 (0 = empty), so classifying a token is one hash and one
+string compare. Rerun after adding, removing or reordering entries:
+
+    python3 scripts/gen_lexer_hash.py
+"""
+
+import os
+import re
+import sys
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+LEXER_C = os.path.join(ROOT, "src", "lexer", "lexer.c")
+OUTPUT = os.path.join(ROOT, "src", "lexer", "lexer_hash.h")
+
+# C array name -> macro prefix in the generated header
+TABLES = [
+    ("symbols", "SYMBOL"),
+    ("keywords", "KEYWORD"),
+    ("preprocessor_directives", "DIRECTIVE"),
+    ("builtins", "BUILTIN"),
+    ("function_attributes", "ATTRIBUTE"),
+]
+
+
+def read_table(source, name):
+    match = re.search(r"\b%s\[\]\s*=\s*\{(.*?)\n\};" % name, source, re.S)
+    if not match:
+        sys.exit("gen_lexer_hash: table %s[] not found in lexer.c" % name)
+    # C string literals in the tables never contain escapes besides \\ and \"
+    entries = re.findall(r'\{\s*"((?:[^"\\]|\\.)*)"\s*,', match.group(1))
+    return [bytes(e, "ascii").decode("unicode_escape") for e in entries]
+
+
+def slot(text, a, b, c, size, first):
+    return (len(text) * a + ord(text[first]) * b + ord(text[-1]) * c) & (size - 1)
+
+
+def find_hash(entries, first):
+    size = 1
+    while size < len(entries):
+        size *= 2
+    while size <= 1024:
+        for a in range(32):
+            for b in range(32):
+                for c in range(32):
+                    slots = {slot(e, a, b, c, size, first) for e in entries}
+                    if len(slots) == len(entries):
+                        return a, b, c, size
+        size *= 2
+    return None
+
+
+def main():
+    with open(LEXER_C) as f:
+        source = f.read()
+
+    out = [
+        "// lexer_hash.h - Perfect hashes for the lexer's lookup tables",
+        "//",
+        "// Generated by scripts/gen_lexer_hash.py from the tables in lexer.c.",
+        "// Do not edit; rerun the script when a table changes.",
+        "#pragma once",
+        "",
+    ]
+
+    for name, prefix in TABLES:
+        entries = read_table(source, name)
+        # "@..." and "#..." tables: the shared sigil carries no information
+        first = 1 if len({e[0] for e in entries}) == 1 else 0
+        found = None
+        while not found and first < min(len(e) for e in entries):
+            found = find_hash(entries, first)
+            if not found:
+                first += 1
+        if not found:
+            sys.exit("gen_lexer_hash: no perfect hash found for %s[]" % name)
+        a, b, c, size = found
+        slots = sorted((slot(e, a, b, c, size, first), i, e)
+                       for i, e in enumerate(entries))
+
+        out.append("#define %s_COUNT %d" % (prefix, len(entries)))
+        out.append("#define %s_HASH_SIZE %d" % (prefix, size))
+        out.append("#define %s_HASH(str, len) \\" % prefix)
+        out.append("  (((unsigned)(len) * %du + (unsigned char)(str)[%d] * %du + \\"
+                   % (a, first, b))
+        out.append("    (unsigned char)(str)[(len) - 1] * %du) & \\" % c)
+        out.append("   (%s_HASH_SIZE - 1))" % prefix)
+        out.append("")
+        out.append("static const unsigned char %s_slots[%s_HASH_SIZE] = {" %
+                   (name, prefix))
+        for s, i, e in slots:
+            out.append("    [%d] = %d, // %s" % (s, i + 1, e))
+        out.append("};")
+        out.append("")
+
+    with open(OUTPUT, "w") as f:
+        f.write("\n".join(out))
+    print("wrote %s" % os.path.relpath(OUTPUT, ROOT))
+
+
+if __name__ == "__main__":
+    main()
@@ -1,9 +1,141 @@
 #include "ast.h"
 
+// Bytes a node needs when only `member` of the payload union is live,
+// rounded up so the next node in the arena stays aligned
+#define NODE_SIZE(member)                                                      \
+  ((offsetof(AstNode, member) + sizeof(((AstNode *)0)->member) +               \
+    alignof(AstNode) - 1) &                                                    \
+   ~(alignof(AstNode) - 1))
+#define MAX_SIZE(a, b) ((a) > (b) ? (a) : (b))
+
+size_t ast_node_size(NodeType type) {
+  switch (type) {
+  case AST_PREPROCESSOR_MODULE:
+    return NODE_SIZE(preprocessor.module);
+  case AST_PREPROCESSOR_USE:
+    return NODE_SIZE(preprocessor.use);
+  case AST_PREPROCESSOR_OS:
+    return NODE_SIZE(preprocessor.os);
+  case AST_PREPROCESSOR_LINK:
+    return NODE_SIZE(preprocessor.link);
+
+  case AST_EXPR_LITERAL:
+    return NODE_SIZE(expr.literal);
+  // Generic substitution turns `T` into `module.Type` in place (and back),
+  // so both kinds get room for either payload
+  case AST_EXPR_IDENTIFIER:
+  case AST_EXPR_MEMBER:
+    return MAX_SIZE(NODE_SIZE(expr.identifier), NODE_SIZE(expr.member));
+  case AST_EXPR_BINARY:
+    return NODE_SIZE(expr.binary);
+  case AST_EXPR_UNARY:
+    return NODE_SIZE(expr.unary);
+  case AST_EXPR_CALL:
+    return NODE_SIZE(expr.call);
+  case AST_EXPR_ASSIGNMENT:
+    return NODE_SIZE(expr.assignment);
+  case AST_EXPR_TERNARY:
+    return NODE_SIZE(expr.ternary);
+  case AST_EXPR_INDEX:
+    return NODE_SIZE(expr.index);
+  case AST_EXPR_GROUPING:
+    return NODE_SIZE(expr.grouping);
+  case AST_EXPR_ARRAY:
+    return NODE_SIZE(expr.array);
+  case AST_EXPR_DEREF:
+    return NODE_SIZE(expr.deref);
+  case AST_EXPR_ADDR:
+    return NODE_SIZE(expr.addr);
+  case AST_EXPR_ALLOC:
+    return NODE_SIZE(expr.alloc);
+  case AST_EXPR_MEMCPY:
+    return NODE_SIZE(expr.memcpy);
+  case AST_EXPR_FREE:
+    return NODE_SIZE(expr.free);
+  case AST_EXPR_CAST:
+    return NODE_SIZE(expr.cast);
+  case AST_EXPR_INPUT:
+    return NODE_SIZE(expr.input);
+  case AST_EXPR_SIZEOF:
+    return NODE_SIZE(expr.size_of);
+  case AST_EXPR_SYSTEM:
+    return NODE_SIZE(expr._system);
+  case AST_EXPR_SYSCALL:
+    return NODE_SIZE(expr.syscall);
+  case AST_EXPR_STRUCT:
+    return NODE_SIZE(expr.struct_expr);
+  case AST_EXPR_SPREAD:
+    return NODE_SIZE(expr.spread);
+  case AST_EXPR_BUILTIN:
+    return NODE_SIZE(expr.builtin);
+
+  case AST_PROGRAM:
+    return NODE_SIZE(stmt.program);
+  case AST_STMT_EXPRESSION:
+    return NODE_SIZE(stmt.expr_stmt);
+  case AST_STMT_VAR_DECL:
+    return NODE_SIZE(stmt.var_decl);
+  case AST_STMT_FUNCTION:
+    return NODE_SIZE(stmt.func_decl);
+  case AST_STMT_IF:
+    return NODE_SIZE(stmt.if_stmt);
+  case AST_STMT_LOOP:
+    return NODE_SIZE(stmt.loop_stmt);
+  case AST_STMT_BREAK_CONTINUE:
+    return NODE_SIZE(stmt.break_continue);
+  case AST_STMT_RETURN:
+    return NODE_SIZE(stmt.return_stmt);
+  case AST_STMT_BLOCK:
+    return NODE_SIZE(stmt.block);
+  case AST_STMT_PRINT:
+    return NODE_SIZE(stmt.print_stmt);
+  case AST_STMT_ENUM:
+    return NODE_SIZE(stmt.enum_decl);
+  case AST_STMT_STRUCT:
+    return NODE_SIZE(stmt.struct_decl);
+  case AST_STMT_FIELD_DECL:
+    return NODE_SIZE(stmt.field_decl);
+  case AST_STMT_SPREAD_DECL:
+    return NODE_SIZE(stmt.spread_decl);
+  case AST_STMT_DEFER:
+    return NODE_SIZE(stmt.defer_stmt);
+  case AST_STMT_SWITCH:
+    return NODE_SIZE(stmt.switch_stmt);
+  case AST_STMT_IMPL:
+    return NODE_SIZE(stmt.impl_stmt);
+  case AST_STMT_CASE:
+    return NODE_SIZE(stmt.case_clause);
+  case AST_STMT_DEFAULT:
+    return NODE_SIZE(stmt.default_clause);
+
+  // Same in-place rewrite as identifiers: `T` <-> `module::Type`
+  case AST_TYPE_BASIC:
+  case AST_TYPE_RESOLUTION:
+    return MAX_SIZE(NODE_SIZE(type_data.basic),
+                    NODE_SIZE(type_data.resolution));
+  case AST_TYPE_POINTER:
+    return NODE_SIZE(type_data.pointer);
+  case AST_TYPE_ARRAY:
+    return NODE_SIZE(type_data.array);
+  case AST_TYPE_VECTOR:
+    return NODE_SIZE(type_data.vector);
+  case AST_TYPE_FUNCTION:
+    return NODE_SIZE(type_data.function);
+  case AST_TYPE_STRUCT:
+    return NODE_SIZE(type_data.struct_type);
+
+  default:
+    return sizeof(AstNode);
+  }
+}
+
+#undef NODE_SIZE
+#undef MAX_SIZE
+
 AstNode *create_preprocessor_node(ArenaAllocator *arena, NodeType type,
                                   NodeCategory category, size_t line,
                                   size_t column) {
-  AstNode *node = arena_alloc(arena, sizeof(AstNode), alignof(AstNode));
+  AstNode *node = arena_alloc(arena, ast_node_size(type), alignof(AstNode));
   if (!node)
     return NULL;
 
@@ -17,7 +149,7 @@ AstNode *create_preprocessor_node(ArenaAllocator *arena, NodeType type,
 
 AstNode *create_ast_node(ArenaAllocator *arena, NodeType type,
                          NodeCategory category, size_t line, size_t column) {
-  AstNode *node = arena_alloc(arena, sizeof(AstNode), alignof(AstNode));
+  AstNode *node = arena_alloc(arena, ast_node_size(type), alignof(AstNode));
   if (!node)
     return NULL;
 
@@ -31,19 +163,20 @@ AstNode *create_ast_node(ArenaAllocator *arena, NodeType type,
 
 AstNode *create_expr_node(ArenaAllocator *arena, NodeType type, size_t line,
                           size_t column) {
-  AstNode *node = arena_alloc(arena, sizeof(AstNode), alignof(AstNode));
+  AstNode *node = arena_alloc(arena, ast_node_size(type), alignof(AstNode));
   if (!node)
     return NULL;
   node->type = type;
   node->line = line;
   node->column = column;
   node->category = Node_Category_EXPR;
+  node->expr.checked_type = NULL;
   return node;
 }
 
 AstNode *create_stmt_node(ArenaAllocator *arena, NodeType type, size_t line,
                           size_t column) {
-  AstNode *node = arena_alloc(arena, sizeof(AstNode), alignof(AstNode));
+  AstNode *node = arena_alloc(arena, ast_node_size(type), alignof(AstNode));
   if (!node)
     return NULL;
   node->type = type;
@@ -55,12 +188,13 @@ AstNode *create_stmt_node(ArenaAllocator *arena, NodeType type, size_t line,
 
 AstNode *create_type_node(ArenaAllocator *arena, NodeType type, size_t line,
                           size_t column) {
-  AstNode *node = arena_alloc(arena, sizeof(AstNode), alignof(AstNode));
+  AstNode *node = arena_alloc(arena, ast_node_size(type), alignof(AstNode));
   if (!node)
     return NULL;
   node->type = type;
   node->line = line;
   node->column = column;
   node->category = Node_Category_TYPE;
+  node->type_data.canonical = NULL;
   return node;
 }
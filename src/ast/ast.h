@@ -7,6 +7,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include "../c_libs/memory/memory.h"
 #include "../lexer/lexer.h"
@@ -47,6 +48,7 @@ typedef enum {
   AST_EXPR_SYSCALL,
   AST_EXPR_STRUCT,
   AST_EXPR_SPREAD,
+  AST_EXPR_BUILTIN, // @clz(x), @expect(x, v), ... (@memcpy is AST_EXPR_MEMCPY)
 
   // Statement nodes
   AST_PROGRAM,             // Program root node
@@ -79,6 +81,7 @@ typedef enum {
   AST_TYPE_FUNCTION,   // Function types
   AST_TYPE_STRUCT,     // Struct types
   AST_TYPE_ENUM,       // Enum types
+  AST_TYPE_VECTOR,     // SIMD vector types (vec<T, N>)
 } NodeType;
 
 // Literal types
@@ -131,6 +134,66 @@ typedef enum {
   UNOP_ADDR,     // &x
 } UnaryOp;
 
+// Compiler builtins, each lowered to an LLVM intrinsic or instruction
+typedef enum {
+  BUILTIN_MEMMOVE,      // @memmove(dest, src, n)
+  BUILTIN_MEMSET,       // @memset(dest, value, n)
+  BUILTIN_CLZ,          // @clz(x)
+  BUILTIN_CTZ,          // @ctz(x)
+  BUILTIN_POPCOUNT,     // @popcount(x)
+  BUILTIN_BSWAP,        // @bswap(x)
+  BUILTIN_EXPECT,       // @expect(x, expected)
+  BUILTIN_LIKELY,       // @likely(cond)
+  BUILTIN_UNLIKELY,     // @unlikely(cond)
+  BUILTIN_PREFETCH,     // @prefetch(ptr) or @prefetch(ptr, rw, locality)
+  BUILTIN_ASSUME,       // @assume(cond)
+  BUILTIN_RDTSC,        // @rdtsc()
+  BUILTIN_BLACK_BOX,    // @black_box(x)
+  BUILTIN_WRAPPING_ADD, // @wrapping_add(a, b)
+  BUILTIN_WRAPPING_SUB, // @wrapping_sub(a, b)
+  BUILTIN_WRAPPING_MUL, // @wrapping_mul(a, b)
+  BUILTIN_ATOMIC_LOAD,  // @atomic_load(ptr) or @atomic_load(ptr, order)
+  BUILTIN_ATOMIC_STORE, // @atomic_store(ptr, value[, order])
+  BUILTIN_ATOMIC_RMW,   // @atomic_rmw(ptr, op, value[, order])
+  BUILTIN_ATOMIC_CAS,   // @atomic_cas(ptr, expected, desired[, order[, fail]])
+  BUILTIN_FENCE,        // @fence() or @fence(order)
+} BuiltinKind;
+
+// Memory orderings of the atomic builtins, written by name:
+// @atomic_load(&x, acquire)
+typedef enum {
+  ATOMIC_RELAXED, // relaxed
+  ATOMIC_ACQUIRE, // acquire
+  ATOMIC_RELEASE, // release
+  ATOMIC_ACQ_REL, // acq_rel
+  ATOMIC_SEQ_CST, // seq_cst, the default
+} AtomicOrder;
+
+// Read-modify-write operations of @atomic_rmw, written by name:
+// @atomic_rmw(&x, add, 1)
+typedef enum {
+  ATOMIC_RMW_XCHG, // xchg
+  ATOMIC_RMW_ADD,  // add
+  ATOMIC_RMW_SUB,  // sub
+  ATOMIC_RMW_AND,  // and
+  ATOMIC_RMW_OR,   // or
+  ATOMIC_RMW_XOR,  // xor
+  ATOMIC_RMW_NAND, // nand
+  ATOMIC_RMW_MIN,  // min
+  ATOMIC_RMW_MAX,  // max
+} AtomicRmwOp;
+
+// Optimization attributes of a function, as bit flags
+typedef enum {
+  FN_ATTR_INLINE = 1 << 0,   // #inline: always inlined
+  FN_ATTR_NOINLINE = 1 << 1, // #noinline
+  FN_ATTR_HOT = 1 << 2,      // #hot
+  FN_ATTR_COLD = 1 << 3,     // #cold: rarely called, paths to it are cold
+  FN_ATTR_PURE = 1 << 4,     // #pure: only reads memory
+  FN_ATTR_CONST = 1 << 5,    // #const: touches no memory
+  FN_ATTR_FLATTEN = 1 << 6,  // #flatten: calls in the body are inlined
+} FunctionAttribute;
+
 typedef enum {
   Node_Category_EXPR,
   Node_Category_STMT,
@@ -156,9 +219,21 @@ struct AstNode {
           AstNode **body;
           size_t body_count;
           const char *file_path;
-          Token *tokens;
-          size_t token_count;
+          const LineTable *lines;
+          // Digests of the module's tokens (TokenStream), without and with
+          // their positions; the object cache keys on them
+          uint64_t token_digest;
+          uint64_t token_position_digest;
           void *scope;
+          // Standard library modules only: key of the cached interface, and
+          // the cached object when it is current (the bodies are then neither
+          // re-checked nor re-generated)
+          uint64_t interface_key;
+          const char *prebuilt_object;
+          // The keys and @use's a newly written interface is stamped with,
+          // and whether this module was parsed from its interface
+          const char *interface_stamp;
+          bool from_interface;
         } module;
 
         // @use "module_name" as module;
@@ -183,6 +258,11 @@ struct AstNode {
     } preprocessor;
 
     struct {
+      // Recorded by the typechecker: the type it checked the expression
+      // as. Kept ahead of the payload union so a node's size can stop at
+      // its kind.
+      AstNode *checked_type;
+
       // Expression-specific data
       union {
         // Literal expression
@@ -200,6 +280,10 @@ struct AstNode {
         // Identifier expression
         struct {
           char *name;
+          // Name<int, *char>: the type arguments of a generic's name, until
+          // instantiate_generics() names the instance instead
+          AstNode **type_args;
+          size_t type_arg_count;
         } identifier;
 
         // Binary expression
@@ -220,6 +304,9 @@ struct AstNode {
           AstNode *callee;
           AstNode **args;
           size_t arg_count;
+          // A method call whose object the typechecker has put in front of
+          // the arguments; checking the tree again leaves them as they are
+          bool self_added;
         } call;
 
         // Assignment expression
@@ -240,6 +327,8 @@ struct AstNode {
           bool is_compiletime;
           AstNode *object;
           char *member;
+          AstNode **type_args; // module::Name<T>, as on identifiers
+          size_t type_arg_count;
         } member;
 
         // Index expression
@@ -273,6 +362,10 @@ struct AstNode {
         // alloc expression
         struct {
           AstNode *size;
+          // Set by mark_stack_allocations() when the pointer never leaves
+          // the function; on_stack once codegen has given it a stack slot
+          bool no_escape;
+          bool on_stack;
         } alloc;
 
         // memcpy expression
@@ -285,6 +378,7 @@ struct AstNode {
         // free expression
         struct {
           AstNode *ptr;
+          AstNode *stack_alloc; // The no_escape alloc this frees, or NULL
         } free;
 
         // cast expression
@@ -321,12 +415,24 @@ struct AstNode {
           char **field_names;    // Array of field names
           AstNode **field_value; // Array of field values (expressions)
           size_t field_count;    // Number of fields
+          // Name<T> { ... }: type arguments and, for module::Name<T>, the
+          // module alias in front of the name
+          AstNode **type_args;
+          size_t type_arg_count;
+          const char *qualifier;
         } struct_expr;
 
         // Spread expression (...expr in struct literals)
         struct {
           AstNode *expr; // The expression being spread
         } spread;
+
+        // Builtin call
+        struct {
+          BuiltinKind kind;
+          AstNode **args;
+          size_t arg_count;
+        } builtin;
       };
     } expr;
 
@@ -337,6 +443,8 @@ struct AstNode {
         struct {
           AstNode **modules;
           size_t module_count;
+          // Built on first use by module_graph_get()
+          struct ModuleGraph *module_graph;
         } program;
 
         // Expression statement
@@ -363,6 +471,16 @@ struct AstNode {
           AstNode **private_members;
           size_t private_count;
           bool is_public;
+          bool is_packed;      // #packed: no padding between fields
+          bool reorder_fields; // #reorder: fields sorted to minimize padding
+          size_t alignment;    // #align(N), or 0 for the natural alignment
+          // struct<T, U>: a template, only checked and generated through
+          // its instances
+          char **type_params;
+          size_t type_param_count;
+          bool is_instance; // Copy of a template made for its type arguments
+          AstNode *template_module; // Where an instance's template is, if
+                                    // another module
         } struct_decl;
 
         struct {
@@ -372,6 +490,8 @@ struct AstNode {
           AstNode *function;
           bool is_public;
           bool is_static;
+          bool is_packed;   // #packed on the field: alignment 1
+          size_t alignment; // #align(N), or 0 for the natural alignment
         } field_decl;
 
         struct {
@@ -403,7 +523,14 @@ struct AstNode {
           bool returns_ownership;
           bool takes_ownership;
           bool forward_declared;
+          unsigned attributes; // FunctionAttribute flags
+          char **type_params;  // fn<T, U>: a template, as on struct_decl
+          size_t type_param_count;
+          AstNode *template_module; // As on struct_decl
           void *scope;
+          // Every token of the declaration, lines relative to its first;
+          // unchanged text means an unchanged digest (see fn_stmt)
+          uint64_t body_digest;
 
           // DLL import link
           bool is_dll_import;   // This is true when #dll_import(...) is present
@@ -436,11 +563,20 @@ struct AstNode {
           AstNode **initializer;
           size_t init_count;
           void *scope;
+
+          // Optimizer hints, passed on as llvm.loop metadata
+          bool unroll;            // #unroll, or #unroll(N) with a count
+          size_t unroll_count;    // 0 leaves the count to LLVM
+          bool vectorize;         // #vectorize, or #vectorize(W)
+          size_t vectorize_width; // 0 leaves the width to LLVM
+          bool no_vectorize;      // #no_vectorize
+          bool independent; // #independent: no memory deps across iterations
         } loop_stmt;
 
         // Return statement
         struct {
           AstNode *value;
+          bool musttail; // #musttail: the returned call reuses this frame
         } return_stmt;
 
         struct {
@@ -496,11 +632,16 @@ struct AstNode {
     } stmt;
 
     struct {
+      // Set by type_canonical() (see type_table.h); NULL until then
+      struct CanonicalType *canonical;
+
       // Type-specific data
       union {
         // Basic type
         struct {
           const char *name;
+          AstNode **type_args; // Name<T>, see expr.identifier
+          size_t type_arg_count;
         } basic;
 
         // Pointer type
@@ -514,6 +655,12 @@ struct AstNode {
           AstNode *size;
         } array;
 
+        // Vector type: lane_count lanes of a scalar element type
+        struct {
+          AstNode *element_type;
+          size_t lane_count;
+        } vector;
+
         // Function type
         struct {
           AstNode **param_types;
@@ -524,6 +671,8 @@ struct AstNode {
         struct {
           char **parts;
           size_t part_count;
+          AstNode **type_args;
+          size_t type_arg_count;
         } resolution;
 
         struct {
@@ -553,6 +702,10 @@ AstNode *create_stmt_node(ArenaAllocator *arena, NodeType type, size_t line,
 AstNode *create_type_node(ArenaAllocator *arena, NodeType type, size_t line,
                           size_t column);
 
+// Bytes allocated for a node of this kind: the header plus its own payload,
+// not the widest member of the union. Copies must use this, not sizeof.
+size_t ast_node_size(NodeType type);
+
 // Helper macros for creating nodes
 #define create_preprocessor(arena, type, line, column)                         \
   create_preprocessor_node(arena, type, Node_Category_PREPROCESSOR, line,      \
@@ -633,6 +786,9 @@ Expr *create_struct_expr(ArenaAllocator *arena, char *name, char **field_names,
                          int col);
 Expr *create_spread_expr(ArenaAllocator *arena, Expr *expr, size_t line,
                          size_t col);
+AstNode *create_builtin_expr(ArenaAllocator *arena, BuiltinKind kind,
+                             Expr **args, size_t arg_count, size_t line,
+                             size_t col);
 
 // Statement creation functions (UPDATED with doc_comment parameters)
 AstNode *create_program_node(ArenaAllocator *arena, AstNode **statements,
@@ -712,6 +868,8 @@ AstNode *create_pointer_type(ArenaAllocator *arena, AstNode *pointee_type,
                              size_t line, size_t column);
 AstNode *create_array_type(ArenaAllocator *arena, AstNode *element_type,
                            Expr *size, size_t line, size_t column);
+AstNode *create_vector_type(ArenaAllocator *arena, AstNode *element_type,
+                            size_t lane_count, size_t line, size_t column);
 AstNode *create_function_type(ArenaAllocator *arena, AstNode **param_types,
                               size_t param_count, AstNode *return_type,
                               size_t line, size_t column);
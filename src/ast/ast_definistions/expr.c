@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "../../c_libs/intern/intern.h"
 #include "../ast.h"
 
 AstNode *create_literal_expr(ArenaAllocator *arena, LiteralType lit_type,
@@ -36,7 +37,7 @@ AstNode *create_literal_expr(ArenaAllocator *arena, LiteralType lit_type,
   case LITERAL_NULL:
     break;
   case LITERAL_IDENT:
-    node->expr.literal.value.string_val = arena_strdup(arena, (char *)value);
+    node->expr.literal.value.string_val = (char *)intern((const char *)value);
     break;
   default:
     fprintf(stderr,
@@ -52,7 +53,7 @@ AstNode *create_literal_expr(ArenaAllocator *arena, LiteralType lit_type,
 AstNode *create_identifier_expr(ArenaAllocator *arena, const char *name,
                                 size_t line, size_t column) {
   AstNode *node = create_expr(arena, AST_EXPR_IDENTIFIER, line, column);
-  node->expr.identifier.name = arena_strdup(arena, name);
+  node->expr.identifier.name = (char *)intern(name);
   return node;
 }
 
@@ -80,6 +81,7 @@ AstNode *create_call_expr(ArenaAllocator *arena, AstNode *callee,
   node->expr.call.callee = callee;
   node->expr.call.args = args;
   node->expr.call.arg_count = arg_count;
+  node->expr.call.self_added = false;
   return node;
 }
 
@@ -107,7 +109,7 @@ AstNode *create_member_expr(ArenaAllocator *arena, AstNode *object,
   AstNode *node = create_expr(arena, AST_EXPR_MEMBER, line, column);
   node->expr.member.is_compiletime = is_compiletime;
   node->expr.member.object = object;
-  node->expr.member.member = arena_strdup(arena, member);
+  node->expr.member.member = (char *)intern(member);
   return node;
 }
 
@@ -153,6 +155,8 @@ AstNode *create_alloc_expr(ArenaAllocator *arena, Expr *size, size_t line,
                            size_t col) {
   AstNode *node = create_expr(arena, AST_EXPR_ALLOC, line, col);
   node->expr.alloc.size = size;
+  node->expr.alloc.no_escape = false;
+  node->expr.alloc.on_stack = false;
   return node;
 }
 
@@ -169,6 +173,7 @@ AstNode *create_free_expr(ArenaAllocator *arena, Expr *ptr, size_t line,
                           size_t col) {
   AstNode *node = create_expr(arena, AST_EXPR_FREE, line, col);
   node->expr.free.ptr = ptr;
+  node->expr.free.stack_alloc = NULL;
   return node;
 }
 
@@ -228,3 +233,13 @@ Expr *create_spread_expr(ArenaAllocator *arena, Expr *expr, size_t line,
   node->expr.spread.expr = expr;
   return node;
 }
+
+AstNode *create_builtin_expr(ArenaAllocator *arena, BuiltinKind kind,
+                             Expr **args, size_t arg_count, size_t line,
+                             size_t col) {
+  AstNode *node = create_expr(arena, AST_EXPR_BUILTIN, line, col);
+  node->expr.builtin.kind = kind;
+  node->expr.builtin.args = args;
+  node->expr.builtin.arg_count = arg_count;
+  return node;
+}
@@ -14,9 +14,14 @@ AstNode *create_module_node(ArenaAllocator *arena, const char *name,
   node->preprocessor.module.body = body;
   node->preprocessor.module.body_count = body_count;
   node->preprocessor.module.file_path = NULL;
-  node->preprocessor.module.tokens = NULL;
-  node->preprocessor.module.token_count = 0;
+  node->preprocessor.module.lines = NULL;
+  node->preprocessor.module.token_digest = 0;
+  node->preprocessor.module.token_position_digest = 0;
   node->preprocessor.module.scope = NULL;
+  node->preprocessor.module.interface_key = 0;
+  node->preprocessor.module.prebuilt_object = NULL;
+  node->preprocessor.module.interface_stamp = NULL;
+  node->preprocessor.module.from_interface = false;
   return node;
 }
 
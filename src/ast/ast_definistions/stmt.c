@@ -7,6 +7,7 @@ AstNode *create_program_node(ArenaAllocator *arena, AstNode **statements,
   AstNode *node = create_stmt_node(arena, AST_PROGRAM, line, column);
   node->stmt.program.modules = statements;
   node->stmt.program.module_count = stmt_count;
+  node->stmt.program.module_graph = NULL;
   return node;
 }
 
@@ -50,7 +51,9 @@ AstNode *create_func_decl_stmt(ArenaAllocator *arena, const char *name,
   node->stmt.func_decl.returns_ownership = returns_ownership;
   node->stmt.func_decl.takes_ownership = takes_ownership;
   node->stmt.func_decl.forward_declared = forward_declared;
+  node->stmt.func_decl.attributes = 0;
   node->stmt.func_decl.body = body;
+  node->stmt.func_decl.body_digest = 0;
   return node;
 }
 
@@ -68,6 +71,9 @@ AstNode *create_struct_decl_stmt(ArenaAllocator *arena, const char *name,
   node->stmt.struct_decl.private_members = private_members;
   node->stmt.struct_decl.private_count = private_count;
   node->stmt.struct_decl.is_public = is_public;
+  node->stmt.struct_decl.is_packed = false;
+  node->stmt.struct_decl.reorder_fields = false;
+  node->stmt.struct_decl.alignment = 0;
   return node;
 }
 
@@ -82,6 +88,8 @@ AstNode *create_field_decl_stmt(ArenaAllocator *arena, const char *name,
   node->stmt.field_decl.function = function;
   node->stmt.field_decl.is_public = is_public;
   node->stmt.field_decl.is_static = is_static;
+  node->stmt.field_decl.is_packed = false;
+  node->stmt.field_decl.alignment = 0;
   return node;
 }
 
@@ -129,6 +137,12 @@ AstNode *create_infinite_loop_stmt(ArenaAllocator *arena, AstNode *body,
   node->stmt.loop_stmt.initializer = NULL;
   node->stmt.loop_stmt.init_count = 0;
   node->stmt.loop_stmt.body = body;
+  node->stmt.loop_stmt.unroll = false;
+  node->stmt.loop_stmt.unroll_count = 0;
+  node->stmt.loop_stmt.vectorize = false;
+  node->stmt.loop_stmt.vectorize_width = 0;
+  node->stmt.loop_stmt.no_vectorize = false;
+  node->stmt.loop_stmt.independent = false;
   return node;
 }
 
@@ -142,6 +156,12 @@ AstNode *create_for_loop_stmt(ArenaAllocator *arena, AstNode **initializers,
   node->stmt.loop_stmt.body = body;
   node->stmt.loop_stmt.initializer = initializers;
   node->stmt.loop_stmt.init_count = init_count;
+  node->stmt.loop_stmt.unroll = false;
+  node->stmt.loop_stmt.unroll_count = 0;
+  node->stmt.loop_stmt.vectorize = false;
+  node->stmt.loop_stmt.vectorize_width = 0;
+  node->stmt.loop_stmt.no_vectorize = false;
+  node->stmt.loop_stmt.independent = false;
   return node;
 }
 
@@ -154,6 +174,12 @@ AstNode *create_loop_stmt(ArenaAllocator *arena, Expr *condition,
   node->stmt.loop_stmt.initializer = NULL;
   node->stmt.loop_stmt.init_count = 0;
   node->stmt.loop_stmt.body = body;
+  node->stmt.loop_stmt.unroll = false;
+  node->stmt.loop_stmt.unroll_count = 0;
+  node->stmt.loop_stmt.vectorize = false;
+  node->stmt.loop_stmt.vectorize_width = 0;
+  node->stmt.loop_stmt.no_vectorize = false;
+  node->stmt.loop_stmt.independent = false;
   return node;
 }
 
@@ -21,6 +21,13 @@ AstNode *create_array_type(ArenaAllocator *arena, AstNode *element_type, Expr *s
   return node;
 }
 
+AstNode *create_vector_type(ArenaAllocator *arena, AstNode *element_type, size_t lane_count, size_t line, size_t column) {
+  AstNode *node = create_type_node(arena, AST_TYPE_VECTOR, line, column);
+  node->type_data.vector.element_type = element_type;
+  node->type_data.vector.lane_count = lane_count;
+  return node;
+}
+
 AstNode *create_function_type(ArenaAllocator *arena, AstNode **param_types, size_t param_count, AstNode *return_type, size_t line, size_t column) {
   AstNode *node = create_type_node(arena, AST_TYPE_FUNCTION, line, column);
   node->type_data.function.param_types = param_types;
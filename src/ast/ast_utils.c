@@ -52,6 +52,8 @@ const char *node_type_to_string(NodeType type) {
     return "ALLOC";
   case AST_EXPR_FREE:
     return "FREE";
+  case AST_EXPR_BUILTIN:
+    return "BUILTIN";
   case AST_STMT_EXPRESSION:
     return "ExprStmt";
   case AST_STMT_VAR_DECL:
@@ -100,6 +102,8 @@ const char *node_type_to_string(NodeType type) {
     return "TypeStruct";
   case AST_TYPE_ENUM:
     return "TypeEnum";
+  case AST_TYPE_VECTOR:
+    return "TypeVector";
   default:
     return "Unknown";
   }
@@ -198,6 +202,91 @@ const char *literal_type_to_string(LiteralType type) {
   }
 }
 
+const char *builtin_to_string(BuiltinKind kind) {
+  switch (kind) {
+  case BUILTIN_MEMMOVE:
+    return "@memmove";
+  case BUILTIN_MEMSET:
+    return "@memset";
+  case BUILTIN_CLZ:
+    return "@clz";
+  case BUILTIN_CTZ:
+    return "@ctz";
+  case BUILTIN_POPCOUNT:
+    return "@popcount";
+  case BUILTIN_BSWAP:
+    return "@bswap";
+  case BUILTIN_EXPECT:
+    return "@expect";
+  case BUILTIN_LIKELY:
+    return "@likely";
+  case BUILTIN_UNLIKELY:
+    return "@unlikely";
+  case BUILTIN_PREFETCH:
+    return "@prefetch";
+  case BUILTIN_ASSUME:
+    return "@assume";
+  case BUILTIN_RDTSC:
+    return "@rdtsc";
+  case BUILTIN_BLACK_BOX:
+    return "@black_box";
+  case BUILTIN_WRAPPING_ADD:
+    return "@wrapping_add";
+  case BUILTIN_WRAPPING_SUB:
+    return "@wrapping_sub";
+  case BUILTIN_WRAPPING_MUL:
+    return "@wrapping_mul";
+  case BUILTIN_ATOMIC_LOAD:
+    return "@atomic_load";
+  case BUILTIN_ATOMIC_STORE:
+    return "@atomic_store";
+  case BUILTIN_ATOMIC_RMW:
+    return "@atomic_rmw";
+  case BUILTIN_ATOMIC_CAS:
+    return "@atomic_cas";
+  case BUILTIN_FENCE:
+    return "@fence";
+  default:
+    return "@unknown";
+  }
+}
+
+// Orderings and @atomic_rmw operations are written as bare names, so the
+// typechecker and codegen read them off the identifier
+static const char *const atomic_order_names[] = {
+    [ATOMIC_RELAXED] = "relaxed", [ATOMIC_ACQUIRE] = "acquire",
+    [ATOMIC_RELEASE] = "release", [ATOMIC_ACQ_REL] = "acq_rel",
+    [ATOMIC_SEQ_CST] = "seq_cst",
+};
+
+static const char *const atomic_rmw_op_names[] = {
+    [ATOMIC_RMW_XCHG] = "xchg", [ATOMIC_RMW_ADD] = "add",
+    [ATOMIC_RMW_SUB] = "sub",   [ATOMIC_RMW_AND] = "and",
+    [ATOMIC_RMW_OR] = "or",     [ATOMIC_RMW_XOR] = "xor",
+    [ATOMIC_RMW_NAND] = "nand", [ATOMIC_RMW_MIN] = "min",
+    [ATOMIC_RMW_MAX] = "max",
+};
+
+bool atomic_order_from_string(const char *name, AtomicOrder *order) {
+  for (int i = ATOMIC_RELAXED; i <= ATOMIC_SEQ_CST; i++) {
+    if (strcmp(name, atomic_order_names[i]) == 0) {
+      *order = (AtomicOrder)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool atomic_rmw_op_from_string(const char *name, AtomicRmwOp *op) {
+  for (int i = ATOMIC_RMW_XCHG; i <= ATOMIC_RMW_MAX; i++) {
+    if (strcmp(name, atomic_rmw_op_names[i]) == 0) {
+      *op = (AtomicRmwOp)i;
+      return true;
+    }
+  }
+  return false;
+}
+
 void print_prefix(const char *prefix, bool is_last) {
 #ifdef _WIN32
   // Use ASCII characters on Windows for better compatibility
@@ -299,6 +388,8 @@ void print_ast(const AstNode *node, const char *prefix, bool is_last,
     } else {
       printf(YELLOW("<unnamed>\n"));
     }
+    for (size_t i = 0; i < node->type_data.basic.type_arg_count; ++i)
+      print_ast(node->type_data.basic.type_args[i], next_prefix, true, false);
     break;
 
   case AST_TYPE_POINTER:
@@ -326,6 +417,13 @@ void print_ast(const AstNode *node, const char *prefix, bool is_last,
     }
     break;
 
+  case AST_TYPE_VECTOR:
+    print_prefix(next_prefix, true);
+    printf(BOLD_CYAN("Vector Type: %zu lanes\n"),
+           node->type_data.vector.lane_count);
+    print_ast(node->type_data.vector.element_type, next_prefix, true, false);
+    break;
+
   case AST_TYPE_FUNCTION:
     print_prefix(next_prefix, true);
     printf(BOLD_CYAN("Function Type: \n"));
@@ -588,6 +686,16 @@ void print_ast(const AstNode *node, const char *prefix, bool is_last,
     }
     break;
 
+  case AST_EXPR_BUILTIN:
+    print_prefix(next_prefix, false);
+    printf(BOLD_CYAN("Builtin: %s\n"),
+           builtin_to_string(node->expr.builtin.kind));
+    for (size_t i = 0; i < node->expr.builtin.arg_count; i++) {
+      print_ast(node->expr.builtin.args[i], next_prefix,
+                i == node->expr.builtin.arg_count - 1, false);
+    }
+    break;
+
   case AST_EXPR_FREE:
     print_prefix(next_prefix, false);
     printf(BOLD_CYAN("Free Expression: \n"));
@@ -674,6 +782,13 @@ void print_ast(const AstNode *node, const char *prefix, bool is_last,
     print_prefix(next_prefix, true);
     printf(GRAY("Is Public: %s\n"),
            node->stmt.func_decl.is_public ? "true" : "false");
+    if (node->stmt.func_decl.type_param_count > 0) {
+      print_prefix(next_prefix, true);
+      printf(BOLD_CYAN("Type Parameters:"));
+      for (size_t i = 0; i < node->stmt.func_decl.type_param_count; ++i)
+        printf(YELLOW(" %s"), node->stmt.func_decl.type_params[i]);
+      printf("\n");
+    }
     print_prefix(next_prefix, true);
     printf(BOLD_CYAN("Takes Ownership: %s\n"),
            node->stmt.func_decl.takes_ownership ? "true" : "false");
@@ -741,6 +856,13 @@ void print_ast(const AstNode *node, const char *prefix, bool is_last,
     print_prefix(next_prefix, true);
     printf(GRAY("Is Public: %s\n"),
            node->stmt.struct_decl.is_public ? "true" : "false");
+    if (node->stmt.struct_decl.type_param_count > 0) {
+      print_prefix(next_prefix, true);
+      printf(BOLD_CYAN("Type Parameters:"));
+      for (size_t i = 0; i < node->stmt.struct_decl.type_param_count; ++i)
+        printf(YELLOW(" %s"), node->stmt.struct_decl.type_params[i]);
+      printf("\n");
+    }
 
     if (node->stmt.struct_decl.public_count > 0) {
       print_prefix(next_prefix, true);
@@ -970,3 +1092,211 @@ void print_ast(const AstNode *node, const char *prefix, bool is_last,
     break;
   }
 }
+
+static void shift_list(AstNode **list, size_t count, long delta) {
+  for (size_t i = 0; list && i < count; i++)
+    ast_shift_lines(list[i], delta);
+}
+
+void ast_shift_lines(AstNode *node, long delta) {
+  if (!node)
+    return;
+  node->line = (size_t)((long)node->line + delta);
+
+#define SHIFT(field) ast_shift_lines(node->field, delta)
+#define SHIFT_LIST(field, count) shift_list(node->field, node->count, delta)
+
+  switch (node->type) {
+  // Preprocessor
+  case AST_PREPROCESSOR_MODULE:
+    SHIFT_LIST(preprocessor.module.body, preprocessor.module.body_count);
+    break;
+  case AST_PREPROCESSOR_OS:
+    SHIFT_LIST(preprocessor.os.bodies, preprocessor.os.arm_count);
+    SHIFT(preprocessor.os.default_body);
+    break;
+
+  // Expressions
+  case AST_EXPR_IDENTIFIER:
+    SHIFT_LIST(expr.identifier.type_args, expr.identifier.type_arg_count);
+    break;
+  case AST_EXPR_BINARY:
+    SHIFT(expr.binary.left);
+    SHIFT(expr.binary.right);
+    break;
+  case AST_EXPR_UNARY:
+    SHIFT(expr.unary.operand);
+    break;
+  case AST_EXPR_CALL:
+    SHIFT(expr.call.callee);
+    SHIFT_LIST(expr.call.args, expr.call.arg_count);
+    break;
+  case AST_EXPR_ASSIGNMENT:
+    SHIFT(expr.assignment.target);
+    SHIFT(expr.assignment.value);
+    break;
+  case AST_EXPR_TERNARY:
+    SHIFT(expr.ternary.condition);
+    SHIFT(expr.ternary.then_expr);
+    SHIFT(expr.ternary.else_expr);
+    break;
+  case AST_EXPR_MEMBER:
+    SHIFT(expr.member.object);
+    SHIFT_LIST(expr.member.type_args, expr.member.type_arg_count);
+    break;
+  case AST_EXPR_INDEX:
+    SHIFT(expr.index.object);
+    SHIFT(expr.index.index);
+    break;
+  case AST_EXPR_GROUPING:
+    SHIFT(expr.grouping.expr);
+    break;
+  case AST_EXPR_ARRAY:
+    SHIFT_LIST(expr.array.elements, expr.array.element_count);
+    break;
+  case AST_EXPR_DEREF:
+    SHIFT(expr.deref.object);
+    break;
+  case AST_EXPR_ADDR:
+    SHIFT(expr.addr.object);
+    break;
+  case AST_EXPR_ALLOC:
+    SHIFT(expr.alloc.size);
+    break;
+  case AST_EXPR_MEMCPY:
+    SHIFT(expr.memcpy.to);
+    SHIFT(expr.memcpy.from);
+    SHIFT(expr.memcpy.size);
+    break;
+  case AST_EXPR_FREE:
+    SHIFT(expr.free.ptr);
+    break;
+  case AST_EXPR_CAST:
+    SHIFT(expr.cast.type);
+    SHIFT(expr.cast.castee);
+    break;
+  case AST_EXPR_INPUT:
+    SHIFT(expr.input.type);
+    SHIFT(expr.input.msg);
+    break;
+  case AST_EXPR_SIZEOF:
+    SHIFT(expr.size_of.object);
+    break;
+  case AST_EXPR_SYSTEM:
+    SHIFT(expr._system.command);
+    break;
+  case AST_EXPR_SYSCALL:
+    SHIFT_LIST(expr.syscall.args, expr.syscall.count);
+    break;
+  case AST_EXPR_STRUCT:
+    SHIFT_LIST(expr.struct_expr.field_value, expr.struct_expr.field_count);
+    SHIFT_LIST(expr.struct_expr.type_args, expr.struct_expr.type_arg_count);
+    break;
+  case AST_EXPR_SPREAD:
+    SHIFT(expr.spread.expr);
+    break;
+  case AST_EXPR_BUILTIN:
+    SHIFT_LIST(expr.builtin.args, expr.builtin.arg_count);
+    break;
+
+  // Statements
+  case AST_STMT_EXPRESSION:
+    SHIFT(stmt.expr_stmt.expression);
+    break;
+  case AST_STMT_VAR_DECL:
+    SHIFT(stmt.var_decl.var_type);
+    SHIFT(stmt.var_decl.initializer);
+    break;
+  case AST_STMT_FUNCTION:
+    SHIFT_LIST(stmt.func_decl.param_types, stmt.func_decl.param_count);
+    SHIFT(stmt.func_decl.return_type);
+    SHIFT(stmt.func_decl.body);
+    break;
+  case AST_STMT_IF:
+    SHIFT(stmt.if_stmt.condition);
+    SHIFT(stmt.if_stmt.then_stmt);
+    SHIFT_LIST(stmt.if_stmt.elif_stmts, stmt.if_stmt.elif_count);
+    SHIFT(stmt.if_stmt.else_stmt);
+    break;
+  case AST_STMT_LOOP:
+    SHIFT(stmt.loop_stmt.condition);
+    SHIFT(stmt.loop_stmt.optional);
+    SHIFT(stmt.loop_stmt.body);
+    SHIFT_LIST(stmt.loop_stmt.initializer, stmt.loop_stmt.init_count);
+    break;
+  case AST_STMT_RETURN:
+    SHIFT(stmt.return_stmt.value);
+    break;
+  case AST_STMT_BLOCK:
+    SHIFT_LIST(stmt.block.statements, stmt.block.stmt_count);
+    break;
+  case AST_STMT_PRINT:
+    SHIFT_LIST(stmt.print_stmt.expressions, stmt.print_stmt.expr_count);
+    break;
+  case AST_STMT_DEFER:
+    SHIFT(stmt.defer_stmt.statement);
+    break;
+  case AST_STMT_SWITCH:
+    SHIFT(stmt.switch_stmt.condition);
+    SHIFT_LIST(stmt.switch_stmt.cases, stmt.switch_stmt.case_count);
+    SHIFT(stmt.switch_stmt.default_case);
+    break;
+  case AST_STMT_CASE:
+    SHIFT_LIST(stmt.case_clause.values, stmt.case_clause.value_count);
+    SHIFT(stmt.case_clause.body);
+    break;
+  case AST_STMT_DEFAULT:
+    SHIFT(stmt.default_clause.body);
+    break;
+  case AST_STMT_STRUCT:
+    SHIFT_LIST(stmt.struct_decl.public_members, stmt.struct_decl.public_count);
+    SHIFT_LIST(stmt.struct_decl.private_members,
+               stmt.struct_decl.private_count);
+    break;
+  case AST_STMT_FIELD_DECL:
+    SHIFT(stmt.field_decl.type);
+    SHIFT(stmt.field_decl.function);
+    break;
+  case AST_STMT_SPREAD_DECL:
+    SHIFT(stmt.spread_decl.type);
+    break;
+  case AST_STMT_IMPL:
+    SHIFT_LIST(stmt.impl_stmt.function_type_list,
+               stmt.impl_stmt.function_name_count);
+    SHIFT(stmt.impl_stmt.body);
+    break;
+
+  // Types
+  case AST_TYPE_BASIC:
+    SHIFT_LIST(type_data.basic.type_args, type_data.basic.type_arg_count);
+    break;
+  case AST_TYPE_RESOLUTION:
+    SHIFT_LIST(type_data.resolution.type_args,
+               type_data.resolution.type_arg_count);
+    break;
+  case AST_TYPE_POINTER:
+    SHIFT(type_data.pointer.pointee_type);
+    break;
+  case AST_TYPE_ARRAY:
+    SHIFT(type_data.array.element_type);
+    SHIFT(type_data.array.size);
+    break;
+  case AST_TYPE_VECTOR:
+    SHIFT(type_data.vector.element_type);
+    break;
+  case AST_TYPE_FUNCTION:
+    SHIFT_LIST(type_data.function.param_types,
+               type_data.function.param_count);
+    SHIFT(type_data.function.return_type);
+    break;
+  case AST_TYPE_STRUCT:
+    SHIFT_LIST(type_data.struct_type.member_types,
+               type_data.struct_type.member_count);
+    break;
+  default:
+    break;
+  }
+
+#undef SHIFT
+#undef SHIFT_LIST
+}
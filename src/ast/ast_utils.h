@@ -5,7 +5,7 @@
 
 #define IS_EXPR(node) ((node)->type >= AST_EXPR_LITERAL && (node)->type <= AST_EXPR_GROUPING)
 #define IS_STMT(node) ((node)->type >= AST_STMT_EXPRESSION && (node)->type <= AST_STMT_STRUCT)
-#define IS_TYPE(node) ((node)->type >= AST_TYPE_BASIC && (node)->type <= AST_TYPE_ENUM)
+#define IS_TYPE(node) ((node)->type >= AST_TYPE_BASIC && (node)->type <= AST_TYPE_VECTOR)
 
 #define IS_PROGRAM(node) ((node)->type == AST_PROGRAM)
 #define IS_EXPR_STMT(node) ((node)->type == AST_STMT_EXPRESSION)
@@ -25,6 +25,13 @@ const char *node_type_to_string(NodeType type);
 const char *binop_to_string(BinaryOp op);
 const char *unop_to_string(UnaryOp op);
 const char *literal_type_to_string(LiteralType type);
+const char *builtin_to_string(BuiltinKind kind);
+bool atomic_order_from_string(const char *name, AtomicOrder *order);
+bool atomic_rmw_op_from_string(const char *name, AtomicRmwOp *op);
 
 void print_prefix(const char *prefix, bool is_last);
 void print_ast(const AstNode *node, const char *prefix, bool is_last, bool root);
+
+// Moves a subtree down by delta lines (up when negative), as when text
+// above it gained or lost lines; columns stay as they are
+void ast_shift_lines(AstNode *node, long delta);
@@ -0,0 +1,225 @@
+/**
+ * @file module_graph.c
+ * @brief Builds the @use graph of a program and orders it with Kahn's
+ * algorithm.
+ *
+ * Module names are resolved to indices once, through an open-addressed
+ * table of name atoms, so neither building nor ordering compares strings.
+ * Each level is the set of modules whose last dependency was placed on the
+ * level before; levels are sorted by module index so the order follows the
+ * program's module order wherever the dependencies allow it.
+ */
+
+#include <stdalign.h>
+#include <string.h>
+
+#include "../c_libs/intern/intern.h"
+#include "module_graph.h"
+
+static bool is_module(AstNode *node) {
+  return node && node->type == AST_PREPROCESSOR_MODULE;
+}
+
+// Name atom -> first module with that name
+typedef struct {
+  Atom *names;
+  size_t *indices;
+  size_t mask;
+} ModuleNameTable;
+
+static void name_table_init(ModuleNameTable *table, AstNode **modules,
+                            size_t module_count, ArenaAllocator *arena) {
+  size_t capacity = 16;
+  while (capacity < module_count * 2)
+    capacity *= 2;
+
+  table->names = arena_alloc(arena, capacity * sizeof(Atom), alignof(Atom));
+  table->indices =
+      arena_alloc(arena, capacity * sizeof(size_t), alignof(size_t));
+  memset(table->names, 0, capacity * sizeof(Atom));
+  table->mask = capacity - 1;
+
+  for (size_t i = 0; i < module_count; i++) {
+    if (!is_module(modules[i]))
+      continue;
+    Atom name = intern(modules[i]->preprocessor.module.name);
+    size_t slot = atom_hash(name) & table->mask;
+    while (table->names[slot] && table->names[slot] != name)
+      slot = (slot + 1) & table->mask;
+    if (!table->names[slot]) {
+      table->names[slot] = name;
+      table->indices[slot] = i;
+    }
+  }
+}
+
+static int name_table_find(const ModuleNameTable *table, const char *name) {
+  Atom key = name ? atom_find(name) : NULL;
+  if (!key)
+    return -1;
+  size_t slot = atom_hash(key) & table->mask;
+  while (table->names[slot]) {
+    if (table->names[slot] == key)
+      return (int)table->indices[slot];
+    slot = (slot + 1) & table->mask;
+  }
+  return -1;
+}
+
+static void resolve_dependencies(ModuleGraph *graph, AstNode **modules,
+                                 ArenaAllocator *arena) {
+  ModuleNameTable table;
+  name_table_init(&table, modules, graph->module_count, arena);
+
+  for (size_t i = 0; i < graph->module_count; i++) {
+    graph->uses[i] = NULL;
+    graph->use_counts[i] = 0;
+    if (!is_module(modules[i]))
+      continue;
+
+    AstNode **body = modules[i]->preprocessor.module.body;
+    int body_count = modules[i]->preprocessor.module.body_count;
+
+    size_t use_count = 0;
+    for (int j = 0; j < body_count; j++) {
+      if (body[j] && body[j]->type == AST_PREPROCESSOR_USE)
+        use_count++;
+    }
+    if (use_count == 0)
+      continue;
+
+    graph->uses[i] = arena_alloc(arena, use_count * sizeof(ModuleUse),
+                                 alignof(ModuleUse));
+    for (int j = 0; j < body_count; j++) {
+      if (!body[j] || body[j]->type != AST_PREPROCESSOR_USE)
+        continue;
+      ModuleUse *use = &graph->uses[i][graph->use_counts[i]++];
+      use->name = body[j]->preprocessor.use.module_name;
+      use->module = name_table_find(&table, use->name);
+    }
+  }
+}
+
+// Counts the edges Kahn's algorithm waits on. Unresolved names and a module
+// importing itself never hold a module back.
+static bool is_edge(const ModuleGraph *graph, size_t module, size_t k) {
+  int dep = graph->uses[module][k].module;
+  return dep >= 0 && (size_t)dep != module;
+}
+
+static void sort_indices(size_t *items, size_t count) {
+  for (size_t i = 1; i < count; i++) {
+    size_t item = items[i];
+    size_t j = i;
+    while (j > 0 && items[j - 1] > item) {
+      items[j] = items[j - 1];
+      j--;
+    }
+    items[j] = item;
+  }
+}
+
+static void order_modules(ModuleGraph *graph, AstNode **modules,
+                          ArenaAllocator *arena) {
+  size_t count = graph->module_count;
+  size_t *pending = arena_alloc(arena, (count ? count : 1) * sizeof(size_t),
+                                alignof(size_t));
+
+  // Dependents in compressed form: module m's are
+  // dependents[dependent_starts[m]] up to dependents[dependent_starts[m + 1]]
+  size_t *dependent_starts =
+      arena_alloc(arena, (count + 1) * sizeof(size_t), alignof(size_t));
+  memset(dependent_starts, 0, (count + 1) * sizeof(size_t));
+
+  size_t edge_count = 0;
+  for (size_t i = 0; i < count; i++) {
+    pending[i] = 0;
+    for (size_t k = 0; k < graph->use_counts[i]; k++) {
+      if (is_edge(graph, i, k)) {
+        pending[i]++;
+        dependent_starts[graph->uses[i][k].module + 1]++;
+        edge_count++;
+      }
+    }
+  }
+  for (size_t i = 0; i < count; i++)
+    dependent_starts[i + 1] += dependent_starts[i];
+
+  size_t *dependents = arena_alloc(
+      arena, (edge_count ? edge_count : 1) * sizeof(size_t), alignof(size_t));
+  size_t *fill = arena_alloc(arena, (count ? count : 1) * sizeof(size_t),
+                             alignof(size_t));
+  memcpy(fill, dependent_starts, count * sizeof(size_t));
+  for (size_t i = 0; i < count; i++) {
+    for (size_t k = 0; k < graph->use_counts[i]; k++) {
+      if (is_edge(graph, i, k))
+        dependents[fill[graph->uses[i][k].module]++] = i;
+    }
+  }
+
+  for (size_t i = 0; i < count; i++)
+    graph->levels[i] = -1;
+
+  // The first level is every module without dependencies
+  size_t module_nodes = 0;
+  graph->order_count = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (!is_module(modules[i]))
+      continue;
+    module_nodes++;
+    if (pending[i] == 0)
+      graph->order[graph->order_count++] = i;
+  }
+
+  graph->level_count = 0;
+  size_t level_start = 0;
+  while (level_start < graph->order_count) {
+    size_t level_end = graph->order_count;
+    graph->level_starts[graph->level_count] = level_start;
+
+    for (size_t n = level_start; n < level_end; n++) {
+      size_t module = graph->order[n];
+      graph->levels[module] = (int)graph->level_count;
+      for (size_t d = dependent_starts[module];
+           d < dependent_starts[module + 1]; d++) {
+        if (--pending[dependents[d]] == 0)
+          graph->order[graph->order_count++] = dependents[d];
+      }
+    }
+
+    sort_indices(graph->order + level_end, graph->order_count - level_end);
+    graph->level_count++;
+    level_start = level_end;
+  }
+  graph->level_starts[graph->level_count] = graph->order_count;
+  graph->cyclic_count = module_nodes - graph->order_count;
+}
+
+ModuleGraph *module_graph_get(AstNode *program, ArenaAllocator *arena) {
+  if (!program || program->type != AST_PROGRAM)
+    return NULL;
+  if (program->stmt.program.module_graph)
+    return program->stmt.program.module_graph;
+
+  AstNode **modules = program->stmt.program.modules;
+  size_t count = program->stmt.program.module_count;
+  size_t slots = count ? count : 1;
+
+  ModuleGraph *graph =
+      arena_alloc(arena, sizeof(ModuleGraph), alignof(ModuleGraph));
+  graph->module_count = count;
+  graph->uses =
+      arena_alloc(arena, slots * sizeof(ModuleUse *), alignof(ModuleUse *));
+  graph->use_counts =
+      arena_alloc(arena, slots * sizeof(size_t), alignof(size_t));
+  graph->order = arena_alloc(arena, slots * sizeof(size_t), alignof(size_t));
+  graph->level_starts =
+      arena_alloc(arena, (count + 1) * sizeof(size_t), alignof(size_t));
+  graph->levels = arena_alloc(arena, slots * sizeof(int), alignof(int));
+
+  resolve_dependencies(graph, modules, arena);
+  order_modules(graph, modules, arena);
+
+  program->stmt.program.module_graph = graph;
+  return graph;
+}
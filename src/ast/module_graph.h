@@ -0,0 +1,56 @@
+/**
+ * @file module_graph.h
+ * @brief The @use dependency graph of a program and its topological order.
+ *
+ * Modules are referred to by their index in the program's module array.
+ * The order is computed once per program with Kahn's algorithm and shared
+ * by the typechecker, the object cache keys and code generation. Modules
+ * are grouped into levels: a module's dependencies all sit on earlier
+ * levels, so the modules of one level don't depend on each other.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ast.h"
+
+typedef struct {
+  const char *name; // As written in the directive
+  int module;       // Index of the module it names, or -1 if there is none
+} ModuleUse;
+
+struct ModuleGraph {
+  size_t module_count; // Length of the program's module array
+
+  // Per module: its @use directives in the order they appear
+  ModuleUse **uses;
+  size_t *use_counts;
+
+  // Module indices, dependencies first. Modules on or behind a @use cycle
+  // are left out.
+  size_t *order;
+  size_t order_count;
+
+  // Level l is order[level_starts[l]] up to order[level_starts[l + 1]]
+  size_t *level_starts; // level_count + 1 entries
+  size_t level_count;
+
+  int *levels; // Per module, or -1 when it's not in the order
+
+  // Modules that could not be ordered because of a @use cycle
+  size_t cyclic_count;
+};
+
+typedef struct ModuleGraph ModuleGraph;
+
+/**
+ * @brief Returns the graph of @p program, building it on first use.
+ *
+ * The graph is kept on the program node, so @p arena has to stay alive for
+ * as long as the node is used.
+ *
+ * @return The graph, or NULL if @p program isn't a program node
+ */
+ModuleGraph *module_graph_get(AstNode *program, ArenaAllocator *arena);
@@ -0,0 +1,335 @@
+/**
+ * @file type_table.c
+ * @brief Implementation of the canonical type table.
+ *
+ * Entries are keyed by their kind, their name atom (basic and struct types),
+ * the canonical entries of their component types and, for arrays, the
+ * literal size (the lane count for vectors). Component types are canonicalized first, so comparing keys
+ * never walks more than one level. Entries live in chunks that are only
+ * freed by type_table_release_all(); the slots are open-addressed behind a
+ * single lock, which is taken once per type node since the result is
+ * remembered on the node.
+ */
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../c_libs/intern/intern.h"
+#include "type_table.h"
+
+#define TYPE_TABLE_INITIAL_SLOTS 256
+#define TYPE_TABLE_CHUNK_SIZE (32 * 1024)
+#define TYPE_KEY_INLINE_CHILDREN 16
+
+struct CanonicalType {
+  NodeType kind;
+  uint32_t hash;
+  bool builtin;
+  bool sized;   // Arrays: whether the size is known
+  int64_t size; // Arrays: the literal size. Vectors: the lane count
+  Atom name;    // Basic and struct types
+  size_t child_count;
+  // Pointer: the pointee. Array and vector: the element. Function: the parameters,
+  // then the return type.
+  CanonicalType **children;
+
+  const char *spelling;
+  uint32_t backend_owner;
+  void *backend;
+};
+
+typedef struct TypeChunk {
+  struct TypeChunk *next;
+  size_t used;
+  size_t size;
+  alignas(CanonicalType) char data[];
+} TypeChunk;
+
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+static CanonicalType **slots; // NULL or an entry; capacity is a power of two
+static size_t slot_count;
+static size_t slot_capacity;
+static TypeChunk *chunks; // Newest first
+static uint32_t next_owner;
+
+static inline uint32_t mix(uint32_t hash, uint64_t value) {
+  for (int i = 0; i < 8; i++) {
+    hash ^= (uint32_t)(value & 0xff);
+    hash *= 16777619u;
+    value >>= 8;
+  }
+  return hash;
+}
+
+static bool is_builtin_name(const char *name) {
+  return strcmp(name, "int") == 0 || strcmp(name, "float") == 0 ||
+         strcmp(name, "double") == 0 || strcmp(name, "bool") == 0 ||
+         strcmp(name, "void") == 0 || strcmp(name, "str") == 0 ||
+         strcmp(name, "string") == 0 || strcmp(name, "char") == 0;
+}
+
+static bool keys_equal(const CanonicalType *entry, const CanonicalType *key) {
+  if (entry->hash != key->hash || entry->kind != key->kind ||
+      entry->name != key->name || entry->sized != key->sized ||
+      entry->size != key->size || entry->child_count != key->child_count)
+    return false;
+  for (size_t i = 0; i < key->child_count; i++) {
+    if (entry->children[i] != key->children[i])
+      return false;
+  }
+  return true;
+}
+
+// Finds the slot holding @p key, or the empty slot where it belongs
+static CanonicalType **find_slot(CanonicalType **table, size_t capacity,
+                                 const CanonicalType *key) {
+  size_t mask = capacity - 1;
+  for (size_t i = key->hash & mask;; i = (i + 1) & mask) {
+    if (!table[i] || keys_equal(table[i], key))
+      return &table[i];
+  }
+}
+
+static bool grow_slots(void) {
+  size_t capacity =
+      slot_capacity ? slot_capacity * 2 : TYPE_TABLE_INITIAL_SLOTS;
+  CanonicalType **table = calloc(capacity, sizeof(CanonicalType *));
+  if (!table)
+    return false;
+
+  for (size_t i = 0; i < slot_capacity; i++) {
+    if (slots[i])
+      *find_slot(table, capacity, slots[i]) = slots[i];
+  }
+
+  free(slots);
+  slots = table;
+  slot_capacity = capacity;
+  return true;
+}
+
+static void *chunk_alloc(size_t size) {
+  size = (size + alignof(CanonicalType) - 1) & ~(alignof(CanonicalType) - 1);
+
+  TypeChunk *chunk = chunks;
+  if (!chunk || chunk->size - chunk->used < size) {
+    size_t chunk_size =
+        size > TYPE_TABLE_CHUNK_SIZE ? size : TYPE_TABLE_CHUNK_SIZE;
+    chunk = malloc(sizeof(TypeChunk) + chunk_size);
+    if (!chunk)
+      return NULL;
+    chunk->used = 0;
+    chunk->size = chunk_size;
+    chunk->next = chunks;
+    chunks = chunk;
+  }
+
+  void *memory = chunk->data + chunk->used;
+  chunk->used += size;
+  return memory;
+}
+
+// Returns the entry matching @p key, storing a copy of it if there is none
+static CanonicalType *intern_key(const CanonicalType *key) {
+  pthread_mutex_lock(&table_lock);
+  // Keep the load factor at or below one half
+  if ((slot_count + 1) * 2 > slot_capacity && !grow_slots()) {
+    pthread_mutex_unlock(&table_lock);
+    perror("Failed to allocate memory");
+    return NULL;
+  }
+
+  CanonicalType **slot = find_slot(slots, slot_capacity, key);
+  if (!*slot) {
+    CanonicalType *entry = chunk_alloc(
+        sizeof(CanonicalType) + key->child_count * sizeof(CanonicalType *));
+    if (!entry) {
+      pthread_mutex_unlock(&table_lock);
+      perror("Failed to allocate memory");
+      return NULL;
+    }
+    *entry = *key;
+    entry->children = (CanonicalType **)(entry + 1);
+    if (key->child_count)
+      memcpy(entry->children, key->children,
+             key->child_count * sizeof(CanonicalType *));
+    *slot = entry;
+    slot_count++;
+  }
+
+  CanonicalType *entry = *slot;
+  pthread_mutex_unlock(&table_lock);
+  return entry;
+}
+
+// Fills in the parts of @p key that come from the node itself
+static bool build_leaf_key(AstNode *type, CanonicalType *key) {
+  const char *name = type->type == AST_TYPE_BASIC
+                         ? type->type_data.basic.name
+                         : type->type_data.struct_type.name;
+  if (!name)
+    return false;
+  key->name = intern(name);
+  key->builtin = type->type == AST_TYPE_BASIC && is_builtin_name(name);
+  key->hash = mix(key->hash, atom_hash(key->name));
+  return key->name != NULL;
+}
+
+static bool array_size_key(AstNode *type, CanonicalType *key) {
+  AstNode *size = type->type_data.array.size;
+  if (!size)
+    return true;
+  if (size->type != AST_EXPR_LITERAL ||
+      size->expr.literal.lit_type != LITERAL_INT)
+    return false;
+  key->sized = true;
+  key->size = size->expr.literal.value.int_val;
+  key->hash = mix(key->hash, (uint64_t)key->size);
+  return true;
+}
+
+static CanonicalType *canonicalize(AstNode *type) {
+  CanonicalType key = {0};
+  key.kind = type->type;
+  key.hash = mix(2166136261u, (uint64_t)type->type);
+
+  CanonicalType *inline_children[TYPE_KEY_INLINE_CHILDREN];
+  CanonicalType **children = inline_children;
+  AstNode *component = NULL;
+
+  switch (type->type) {
+  case AST_TYPE_BASIC:
+  case AST_TYPE_STRUCT:
+    if (!build_leaf_key(type, &key))
+      return NULL;
+    return intern_key(&key);
+
+  case AST_TYPE_POINTER:
+    component = type->type_data.pointer.pointee_type;
+    break;
+
+  case AST_TYPE_ARRAY:
+    component = type->type_data.array.element_type;
+    if (!array_size_key(type, &key))
+      return NULL;
+    break;
+
+  case AST_TYPE_VECTOR:
+    component = type->type_data.vector.element_type;
+    key.sized = true;
+    key.size = (int64_t)type->type_data.vector.lane_count;
+    key.hash = mix(key.hash, (uint64_t)key.size);
+    break;
+
+  case AST_TYPE_FUNCTION: {
+    size_t param_count = type->type_data.function.param_count;
+    key.child_count = param_count + 1;
+    if (key.child_count > TYPE_KEY_INLINE_CHILDREN) {
+      children = malloc(key.child_count * sizeof(CanonicalType *));
+      if (!children)
+        return NULL;
+    }
+
+    bool builtin = true;
+    for (size_t i = 0; i < key.child_count; i++) {
+      AstNode *part = i < param_count
+                          ? type->type_data.function.param_types[i]
+                          : type->type_data.function.return_type;
+      children[i] = type_canonical(part);
+      if (!children[i]) {
+        if (children != inline_children)
+          free(children);
+        return NULL;
+      }
+      builtin = builtin && children[i]->builtin;
+      key.hash = mix(key.hash, children[i]->hash);
+    }
+
+    key.builtin = builtin;
+    key.children = children;
+    CanonicalType *entry = intern_key(&key);
+    if (children != inline_children)
+      free(children);
+    return entry;
+  }
+
+  default:
+    return NULL;
+  }
+
+  CanonicalType *child = type_canonical(component);
+  if (!child)
+    return NULL;
+  children[0] = child;
+  key.child_count = 1;
+  key.children = children;
+  key.builtin = child->builtin;
+  key.hash = mix(key.hash, child->hash);
+  return intern_key(&key);
+}
+
+CanonicalType *type_canonical(AstNode *type) {
+  if (!type || type->category != Node_Category_TYPE)
+    return NULL;
+
+  CanonicalType *cached =
+      __atomic_load_n(&type->type_data.canonical, __ATOMIC_ACQUIRE);
+  if (cached)
+    return cached;
+
+  // Two threads may canonicalize the same node; both get the same entry
+  CanonicalType *entry = canonicalize(type);
+  if (entry)
+    __atomic_store_n(&type->type_data.canonical, entry, __ATOMIC_RELEASE);
+  return entry;
+}
+
+const char *canonical_type_spelling(CanonicalType *canonical) {
+  return __atomic_load_n(&canonical->spelling, __ATOMIC_ACQUIRE);
+}
+
+void canonical_type_set_spelling(CanonicalType *canonical, const char *text) {
+  __atomic_store_n(&canonical->spelling, text, __ATOMIC_RELEASE);
+}
+
+bool canonical_type_is_builtin(const CanonicalType *canonical) {
+  return canonical->builtin;
+}
+
+void *canonical_type_backend(CanonicalType *canonical, uint32_t owner) {
+  pthread_mutex_lock(&table_lock);
+  void *value = canonical->backend_owner == owner ? canonical->backend : NULL;
+  pthread_mutex_unlock(&table_lock);
+  return value;
+}
+
+void canonical_type_set_backend(CanonicalType *canonical, uint32_t owner,
+                                void *value) {
+  pthread_mutex_lock(&table_lock);
+  canonical->backend_owner = owner;
+  canonical->backend = value;
+  pthread_mutex_unlock(&table_lock);
+}
+
+uint32_t type_table_new_owner(void) {
+  // Zero is what a fresh entry holds, so it's never handed out
+  return __atomic_add_fetch(&next_owner, 1, __ATOMIC_RELAXED);
+}
+
+void type_table_release_all(void) {
+  pthread_mutex_lock(&table_lock);
+  for (TypeChunk *chunk = chunks; chunk;) {
+    TypeChunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  free(slots);
+  slots = NULL;
+  slot_count = 0;
+  slot_capacity = 0;
+  chunks = NULL;
+  pthread_mutex_unlock(&table_lock);
+}
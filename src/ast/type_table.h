@@ -0,0 +1,65 @@
+/**
+ * @file type_table.h
+ * @brief Process-lifetime table of canonical (hash-consed) types.
+ *
+ * Every type node can be mapped to the one canonical entry describing the
+ * same type, so two type nodes spell exactly the same type when their
+ * canonical entries are the same pointer. The entry is remembered on the
+ * node after the first lookup. Entries also carry per-type caches: the
+ * spelling used in diagnostics and the backend's lowered type.
+ *
+ * Types whose identity depends on more than their spelling (array sizes
+ * that aren't integer literals, unresolved `a::b` types) have no canonical
+ * entry and are compared structurally as before.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ast.h"
+
+typedef struct CanonicalType CanonicalType;
+
+/**
+ * @brief Returns the canonical entry for a type node, creating it on first
+ * use and caching it on the node.
+ *
+ * Safe to call from several threads.
+ *
+ * @return The entry, or NULL if @p type can't be canonicalized
+ */
+CanonicalType *type_canonical(AstNode *type);
+
+/**
+ * @brief The spelling type_to_string() gives the type, or NULL if it hasn't
+ * been stored yet. Stored spellings are atoms.
+ */
+const char *canonical_type_spelling(CanonicalType *canonical);
+void canonical_type_set_spelling(CanonicalType *canonical, const char *text);
+
+/**
+ * @brief Whether the type is built from builtin types only, so lowering it
+ * doesn't depend on which structs or enums are in scope.
+ */
+bool canonical_type_is_builtin(const CanonicalType *canonical);
+
+/**
+ * @brief Returns a backend value cached on the entry by @p owner, or NULL.
+ *
+ * Owners come from type_table_new_owner(), one per code generation context,
+ * so a value made for one context is never handed to another.
+ */
+void *canonical_type_backend(CanonicalType *canonical, uint32_t owner);
+void canonical_type_set_backend(CanonicalType *canonical, uint32_t owner,
+                                void *value);
+
+/** @brief Returns an owner tag no other caller has received. */
+uint32_t type_table_new_owner(void);
+
+/**
+ * @brief Frees every entry. Type nodes still alive keep dangling canonical
+ * pointers, so this goes last, next to intern_release_all().
+ */
+void type_table_release_all(void);
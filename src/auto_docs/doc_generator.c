@@ -1,5 +1,10 @@
 #include "doc_generator.h"
+#include "../helper/help.h"
 #include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 
@@ -8,6 +13,48 @@
 #define mkdir(path, mode) _mkdir(path)
 #endif
 
+#define DOC_MANIFEST_NAME ".luma-docs"
+#define DOC_MANIFEST_FORMAT "luma-docs 1"
+
+// A page being generated, kept in memory and written with one call
+typedef struct {
+  char *data;
+  size_t length;
+  size_t capacity;
+} DocBuffer;
+
+static void doc_reserve(DocBuffer *b, size_t extra) {
+  if (b->length + extra < b->capacity)
+    return;
+  size_t capacity = b->capacity ? b->capacity * 2 : 4096;
+  while (b->length + extra >= capacity)
+    capacity *= 2;
+  char *data = realloc(b->data, capacity);
+  if (!data)
+    die("Out of memory while generating documentation");
+  b->data = data;
+  b->capacity = capacity;
+}
+
+static void doc_printf(DocBuffer *b, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(b->data ? b->data + b->length : NULL,
+                         b->capacity - b->length, format, args);
+  va_end(args);
+  if (length < 0)
+    return;
+
+  // It didn't fit: grow and print again
+  if (b->length + (size_t)length >= b->capacity) {
+    doc_reserve(b, (size_t)length + 1);
+    va_start(args, format);
+    vsnprintf(b->data + b->length, b->capacity - b->length, format, args);
+    va_end(args);
+  }
+  b->length += (size_t)length;
+}
+
 // Helper to create directory
 static bool ensure_directory(const char *path) {
   struct stat st = {0};
@@ -21,7 +68,7 @@ static bool ensure_directory(const char *path) {
 }
 
 // Write formatted doc comment (handles markdown syntax in comments)
-static void write_doc_comment(FILE *f, const char *doc, int indent_level) {
+static void write_doc_comment(DocBuffer *f, const char *doc, int indent_level) {
   if (!doc || !*doc)
     return;
 
@@ -34,11 +81,11 @@ static void write_doc_comment(FILE *f, const char *doc, int indent_level) {
 
     // Write indentation
     for (int i = 0; i < indent_level; i++) {
-      fprintf(f, "  ");
+      doc_printf(f, "  ");
     }
 
     // Write line content (preserve markdown in doc comments)
-    fprintf(f, "%.*s\n", (int)(end - line), line);
+    doc_printf(f, "%.*s\n", (int)(end - line), line);
 
     // Move to next line
     if (*end == '\n') {
@@ -49,67 +96,102 @@ static void write_doc_comment(FILE *f, const char *doc, int indent_level) {
   }
 }
 
+static void print_type(DocBuffer *f, AstNode *type);
+
+// <int, *T> after a generic's name
+static void print_type_args(DocBuffer *f, AstNode **args, size_t count) {
+  if (count == 0)
+    return;
+  doc_printf(f, "<");
+  for (size_t i = 0; i < count; i++) {
+    if (i > 0)
+      doc_printf(f, ", ");
+    print_type(f, args[i]);
+  }
+  doc_printf(f, ">");
+}
+
+// <T, U> after fn or struct
+static void print_type_params(DocBuffer *f, char **params, size_t count) {
+  if (count == 0)
+    return;
+  doc_printf(f, "<");
+  for (size_t i = 0; i < count; i++)
+    doc_printf(f, i > 0 ? ", %s" : "%s", params[i]);
+  doc_printf(f, ">");
+}
+
 // Helper function to print type information
-static void print_type(FILE *f, AstNode *type) {
+static void print_type(DocBuffer *f, AstNode *type) {
   if (!type) {
-    fprintf(f, "?");
+    doc_printf(f, "?");
     return;
   }
 
   switch (type->type) {
   case AST_TYPE_BASIC:
-    fprintf(f, "%s", type->type_data.basic.name);
+    doc_printf(f, "%s", type->type_data.basic.name);
+    print_type_args(f, type->type_data.basic.type_args,
+                    type->type_data.basic.type_arg_count);
     break;
 
   case AST_TYPE_POINTER:
-    fprintf(f, "*");
+    doc_printf(f, "*");
     print_type(f, type->type_data.pointer.pointee_type);
     break;
 
   case AST_TYPE_ARRAY:
-    fprintf(f, "[");
+    doc_printf(f, "[");
     print_type(f, type->type_data.array.element_type);
-    fprintf(f, "; ");
+    doc_printf(f, "; ");
     if (type->type_data.array.size) {
       // Try to print array size if it's a literal
       if (type->type_data.array.size->type == AST_EXPR_LITERAL &&
           type->type_data.array.size->expr.literal.lit_type == LITERAL_INT) {
-        fprintf(f, "%lld",
+        doc_printf(f, "%lld",
                 type->type_data.array.size->expr.literal.value.int_val);
       } else {
-        fprintf(f, "N");
+        doc_printf(f, "N");
       }
     }
-    fprintf(f, "]");
+    doc_printf(f, "]");
+    break;
+
+  case AST_TYPE_VECTOR:
+    doc_printf(f, "vec<");
+    print_type(f, type->type_data.vector.element_type);
+    doc_printf(f, ", %zu>", type->type_data.vector.lane_count);
     break;
 
   case AST_TYPE_FUNCTION:
-    fprintf(f, "fn(");
+    doc_printf(f, "fn(");
     for (size_t i = 0; i < type->type_data.function.param_count; i++) {
       if (i > 0)
-        fprintf(f, ", ");
+        doc_printf(f, ", ");
       print_type(f, type->type_data.function.param_types[i]);
     }
-    fprintf(f, ") ");
+    doc_printf(f, ") ");
     print_type(f, type->type_data.function.return_type);
     break;
 
   case AST_TYPE_RESOLUTION:
     for (size_t i = 0; i < type->type_data.resolution.part_count; i++) {
       if (i > 0)
-        fprintf(f, "::");
-      fprintf(f, "%s", type->type_data.resolution.parts[i]);
+        doc_printf(f, "::");
+      doc_printf(f, "%s", type->type_data.resolution.parts[i]);
     }
+    print_type_args(f, type->type_data.resolution.type_args,
+                    type->type_data.resolution.type_arg_count);
     break;
 
   default:
-    fprintf(f, "UnknownType");
+    doc_printf(f, "UnknownType");
     break;
   }
 }
 
 // Helper to write doc comment, stopping at certain markers
-static void write_doc_comment_until_marker(FILE *f, const char *doc, const char *stop_marker) {
+static void write_doc_comment_until_marker(DocBuffer *f, const char *doc, const char *stop_marker) {
   if (!doc || !*doc) return;
   
   const char *marker_pos = stop_marker ? strstr(doc, stop_marker) : NULL;
@@ -127,7 +209,7 @@ static void write_doc_comment_until_marker(FILE *f, const char *doc, const char
       break;
     }
     
-    fprintf(f, "%.*s\n", (int)(line_end - line), line);
+    doc_printf(f, "%.*s\n", (int)(line_end - line), line);
     
     if (*line_end == '\n') {
       line = line_end + 1;
@@ -138,7 +220,7 @@ static void write_doc_comment_until_marker(FILE *f, const char *doc, const char
 }
 
 // Generate documentation for a function
-static void generate_function_docs(FILE *f, AstNode *func, DocGenConfig config) {
+static void generate_function_docs(DocBuffer *f, AstNode *func, DocGenConfig config) {
   const char *name = func->stmt.func_decl.name;
   const char *doc = func->stmt.func_decl.doc_comment;
   bool is_public = func->stmt.func_decl.is_public;
@@ -156,55 +238,58 @@ static void generate_function_docs(FILE *f, AstNode *func, DocGenConfig config)
   }
 
   // Function header
-  fprintf(f, "### `%s`\n\n", name);
+  doc_printf(f, "### `%s`\n\n", name);
 
   // Documentation comment (stop before first marker)
   if (doc && *doc) {
     write_doc_comment_until_marker(f, doc, first_marker);
-    fprintf(f, "\n");
+    doc_printf(f, "\n");
   }
 
   // Modifiers line
-  fprintf(f, "```luma\n");
+  doc_printf(f, "```luma\n");
   if (func->stmt.func_decl.is_dll_import) {
-    fprintf(f, "#dll_import(\"%s\"", func->stmt.func_decl.dll_name ? func->stmt.func_decl.dll_name : "");
+    doc_printf(f, "#dll_import(\"%s\"", func->stmt.func_decl.dll_name ? func->stmt.func_decl.dll_name : "");
     if (func->stmt.func_decl.dll_callconv) {
-      fprintf(f, ", callconv: \"%s\"", func->stmt.func_decl.dll_callconv);
+      doc_printf(f, ", callconv: \"%s\"", func->stmt.func_decl.dll_callconv);
     }
-    fprintf(f, ")\n");
+    doc_printf(f, ")\n");
   }
   if (func->stmt.func_decl.is_lib_import) {
-    fprintf(f, "#lib_import(\"%s\")\n", func->stmt.func_decl.lib_name ? func->stmt.func_decl.lib_name : "");
+    doc_printf(f, "#lib_import(\"%s\")\n", func->stmt.func_decl.lib_name ? func->stmt.func_decl.lib_name : "");
   }
   if (func->stmt.func_decl.returns_ownership) {
-    fprintf(f, "#returns_ownership\n");
+    doc_printf(f, "#returns_ownership\n");
   }
   if (func->stmt.func_decl.takes_ownership) {
-    fprintf(f, "#takes_ownership\n");
+    doc_printf(f, "#takes_ownership\n");
   }
-  fprintf(f, "%s %s -> fn(\n", is_public ? "pub" : "     ", name);
+  doc_printf(f, "%s %s -> fn", is_public ? "pub" : "     ", name);
+  print_type_params(f, func->stmt.func_decl.type_params,
+                    func->stmt.func_decl.type_param_count);
+  doc_printf(f, "(\n");
 
   // Parameters (one per line)
   for (size_t i = 0; i < func->stmt.func_decl.param_count; i++) {
-    fprintf(f, "    ");
-    fprintf(f, "%s: ", func->stmt.func_decl.param_names[i]);
+    doc_printf(f, "    ");
+    doc_printf(f, "%s: ", func->stmt.func_decl.param_names[i]);
     if (func->stmt.func_decl.param_types && func->stmt.func_decl.param_types[i]) {
       print_type(f, func->stmt.func_decl.param_types[i]);
     } else {
-      fprintf(f, "?");
+      doc_printf(f, "?");
     }
     if (i < func->stmt.func_decl.param_count - 1)
-      fprintf(f, ",");
-    fprintf(f, "\n");
+      doc_printf(f, ",");
+    doc_printf(f, "\n");
   }
 
-  fprintf(f, ") ");
+  doc_printf(f, ") ");
   if (func->stmt.func_decl.return_type) {
     print_type(f, func->stmt.func_decl.return_type);
   } else {
-    fprintf(f, "void");
+    doc_printf(f, "void");
   }
-  fprintf(f, "\n```\n\n");
+  doc_printf(f, "\n```\n\n");
 
   // Extract and print Parameters/Returns/Example sections
   if (doc) for (int m = 0; markers[m]; m++) {
@@ -218,25 +303,25 @@ static void generate_function_docs(FILE *f, AstNode *func, DocGenConfig config)
     }
     if (!section_end) section_end = section_start + strlen(section_start);
 
-    fprintf(f, "**%s:**\n", markers[m] + 2);
+    doc_printf(f, "**%s:**\n", markers[m] + 2);
     const char *line = section_start;
     while (line < section_end) {
       const char *line_end = strchr(line, '\n');
       if (!line_end || line_end >= section_end) line_end = section_end;
 
       if (strncmp(line, markers[m], strlen(markers[m])) != 0) {
-        fprintf(f, "%.*s\n", (int)(line_end - line), line);
+        doc_printf(f, "%.*s\n", (int)(line_end - line), line);
       }
 
       if (*line_end == '\n') line = line_end + 1;
       else break;
     }
-    fprintf(f, "\n");
+    doc_printf(f, "\n");
   }
 }
 
 // Generate documentation for a struct
-static void generate_struct_docs(FILE *f, AstNode *strct, DocGenConfig config) {
+static void generate_struct_docs(DocBuffer *f, AstNode *strct, DocGenConfig config) {
   const char *name = strct->stmt.struct_decl.name;
   const char *doc = strct->stmt.struct_decl.doc_comment;
   bool is_public = strct->stmt.struct_decl.is_public;
@@ -246,7 +331,10 @@ static void generate_struct_docs(FILE *f, AstNode *strct, DocGenConfig config) {
   }
 
   // Struct header
-  fprintf(f, "### `%s`\n\n", name);
+  doc_printf(f, "### `%s", name);
+  print_type_params(f, strct->stmt.struct_decl.type_params,
+                    strct->stmt.struct_decl.type_param_count);
+  doc_printf(f, "`\n\n");
 
   // Main struct documentation (stop before # Fields marker)
   if (doc && *doc) {
@@ -256,13 +344,13 @@ static void generate_struct_docs(FILE *f, AstNode *strct, DocGenConfig config) {
       while (line < fields_marker) {
         const char *line_end = strchr(line, '\n');
         if (!line_end || line_end >= fields_marker) break;
-        fprintf(f, "%.*s\n", (int)(line_end - line), line);
+        doc_printf(f, "%.*s\n", (int)(line_end - line), line);
         line = line_end + 1;
       }
     } else {
       write_doc_comment(f, doc, 0);
     }
-    fprintf(f, "\n");
+    doc_printf(f, "\n");
   }
 
   // Public data fields (non-method members)
@@ -276,8 +364,8 @@ static void generate_struct_docs(FILE *f, AstNode *strct, DocGenConfig config) {
   }
 
   if (has_public_fields) {
-    fprintf(f, "| Field | Type | Description |\n");
-    fprintf(f, "|-------|------|-------------|\n");
+    doc_printf(f, "| Field | Type | Description |\n");
+    doc_printf(f, "|-------|------|-------------|\n");
     for (size_t i = 0; i < strct->stmt.struct_decl.public_count; i++) {
       AstNode *field = strct->stmt.struct_decl.public_members[i];
       if (field->type == AST_STMT_FIELD_DECL && !field->stmt.field_decl.function) {
@@ -285,19 +373,19 @@ static void generate_struct_docs(FILE *f, AstNode *strct, DocGenConfig config) {
         const char *field_doc = field->stmt.field_decl.doc_comment;
         AstNode *field_type = field->stmt.field_decl.type;
 
-        fprintf(f, "| `%s` | ", field_name);
+        doc_printf(f, "| `%s` | ", field_name);
         if (field_type) print_type(f, field_type);
-        else fprintf(f, "?");
-        fprintf(f, " | ");
+        else doc_printf(f, "?");
+        doc_printf(f, " | ");
         if (field_doc && *field_doc) {
           const char *end = strchr(field_doc, '\n');
-          if (end) fprintf(f, "%.*s", (int)(end - field_doc), field_doc);
-          else fprintf(f, "%s", field_doc);
+          if (end) doc_printf(f, "%.*s", (int)(end - field_doc), field_doc);
+          else doc_printf(f, "%s", field_doc);
         }
-        fprintf(f, " |\n");
+        doc_printf(f, " |\n");
       }
     }
-    fprintf(f, "\n");
+    doc_printf(f, "\n");
   }
 
   // Public methods
@@ -311,7 +399,7 @@ static void generate_struct_docs(FILE *f, AstNode *strct, DocGenConfig config) {
   }
 
   if (has_public_methods) {
-    fprintf(f, "**Methods:**\n\n");
+    doc_printf(f, "**Methods:**\n\n");
     for (size_t i = 0; i < strct->stmt.struct_decl.public_count; i++) {
       AstNode *field = strct->stmt.struct_decl.public_members[i];
       if (field->type == AST_STMT_FIELD_DECL && field->stmt.field_decl.function) {
@@ -328,51 +416,51 @@ static void generate_struct_docs(FILE *f, AstNode *strct, DocGenConfig config) {
         }
 
         // Method name as subheading
-        fprintf(f, "#### `%s()`\n\n", method_name);
+        doc_printf(f, "#### `%s()`\n\n", method_name);
 
         // Main description (stop before first marker)
         if (method_doc && *method_doc) {
           write_doc_comment_until_marker(f, method_doc, method_first);
-          fprintf(f, "\n");
+          doc_printf(f, "\n");
         }
 
         // Method signature
         if (method_func && method_func->type == AST_STMT_FUNCTION) {
-          fprintf(f, "```luma\n");
+          doc_printf(f, "```luma\n");
           if (method_func->stmt.func_decl.is_dll_import) {
-            fprintf(f, "#dll_import(\"%s\"", method_func->stmt.func_decl.dll_name ? method_func->stmt.func_decl.dll_name : "");
+            doc_printf(f, "#dll_import(\"%s\"", method_func->stmt.func_decl.dll_name ? method_func->stmt.func_decl.dll_name : "");
             if (method_func->stmt.func_decl.dll_callconv) {
-              fprintf(f, ", callconv: \"%s\"", method_func->stmt.func_decl.dll_callconv);
+              doc_printf(f, ", callconv: \"%s\"", method_func->stmt.func_decl.dll_callconv);
             }
-            fprintf(f, ")\n");
+            doc_printf(f, ")\n");
           }
           if (method_func->stmt.func_decl.is_lib_import) {
-            fprintf(f, "#lib_import(\"%s\")\n", method_func->stmt.func_decl.lib_name ? method_func->stmt.func_decl.lib_name : "");
+            doc_printf(f, "#lib_import(\"%s\")\n", method_func->stmt.func_decl.lib_name ? method_func->stmt.func_decl.lib_name : "");
           }
           if (method_func->stmt.func_decl.returns_ownership) {
-            fprintf(f, "#returns_ownership\n");
+            doc_printf(f, "#returns_ownership\n");
           }
           if (method_func->stmt.func_decl.takes_ownership) {
-            fprintf(f, "#takes_ownership\n");
+            doc_printf(f, "#takes_ownership\n");
           }
-          fprintf(f, "%s -> fn(\n", method_name);
+          doc_printf(f, "%s -> fn(\n", method_name);
           for (size_t j = 0; j < method_func->stmt.func_decl.param_count; j++) {
-            fprintf(f, "    %s: ", method_func->stmt.func_decl.param_names[j]);
+            doc_printf(f, "    %s: ", method_func->stmt.func_decl.param_names[j]);
             if (method_func->stmt.func_decl.param_types[j]) {
               print_type(f, method_func->stmt.func_decl.param_types[j]);
             } else {
-              fprintf(f, "?");
+              doc_printf(f, "?");
             }
-            if (j < method_func->stmt.func_decl.param_count - 1) fprintf(f, ",");
-            fprintf(f, "\n");
+            if (j < method_func->stmt.func_decl.param_count - 1) doc_printf(f, ",");
+            doc_printf(f, "\n");
           }
-          fprintf(f, ") ");
+          doc_printf(f, ") ");
           if (method_func->stmt.func_decl.return_type) {
             print_type(f, method_func->stmt.func_decl.return_type);
           } else {
-            fprintf(f, "void");
+            doc_printf(f, "void");
           }
-          fprintf(f, "\n```\n\n");
+          doc_printf(f, "\n```\n\n");
         }
 
         // Extract and print Parameters/Returns/Example sections
@@ -387,20 +475,20 @@ static void generate_struct_docs(FILE *f, AstNode *strct, DocGenConfig config) {
           }
           if (!sec_end) sec_end = sec_start + strlen(sec_start);
 
-          fprintf(f, "**%s:**\n", method_markers[m] + 2);
+          doc_printf(f, "**%s:**\n", method_markers[m] + 2);
           const char *line = sec_start;
           while (line < sec_end) {
             const char *line_end = strchr(line, '\n');
             if (!line_end || line_end >= sec_end) line_end = sec_end;
 
             if (strncmp(line, method_markers[m], strlen(method_markers[m])) != 0) {
-              fprintf(f, "%.*s\n", (int)(line_end - line), line);
+              doc_printf(f, "%.*s\n", (int)(line_end - line), line);
             }
 
             if (*line_end == '\n') line = line_end + 1;
             else break;
           }
-          fprintf(f, "\n");
+          doc_printf(f, "\n");
         }
       }
     }
@@ -409,7 +497,7 @@ static void generate_struct_docs(FILE *f, AstNode *strct, DocGenConfig config) {
   // Private members omitted for brevity - add similar formatting if needed
 }
 
-static void generate_enum_docs(FILE *f, AstNode *enm, DocGenConfig config) {
+static void generate_enum_docs(DocBuffer *f, AstNode *enm, DocGenConfig config) {
   const char *name = enm->stmt.enum_decl.name;
   const char *doc = enm->stmt.enum_decl.doc_comment;
   bool is_public = enm->stmt.enum_decl.is_public;
@@ -418,48 +506,48 @@ static void generate_enum_docs(FILE *f, AstNode *enm, DocGenConfig config) {
     return;
   }
 
-  fprintf(f, "### %s `%s`\n\n", is_public ? "pub" : "priv", name);
+  doc_printf(f, "### %s `%s`\n\n", is_public ? "pub" : "priv", name);
 
   if (doc && *doc) {
     write_doc_comment(f, doc, 0);
-    fprintf(f, "\n");
+    doc_printf(f, "\n");
   }
 
-  fprintf(f, "**Values:**\n\n");
+  doc_printf(f, "**Values:**\n\n");
   for (size_t i = 0; i < enm->stmt.enum_decl.member_count; i++) {
-    fprintf(f, "- `%s`\n", enm->stmt.enum_decl.members[i]);
+    doc_printf(f, "- `%s`\n", enm->stmt.enum_decl.members[i]);
   }
-  fprintf(f, "\n");
+  doc_printf(f, "\n");
 }
 
-static void generate_var_docs(FILE *f, AstNode *var, DocGenConfig config) {
+static void generate_var_docs(DocBuffer *f, AstNode *var, DocGenConfig config) {
   (void)config;
   const char *name = var->stmt.var_decl.name;
   const char *doc = var->stmt.var_decl.doc_comment;
   bool is_mutable = var->stmt.var_decl.is_mutable;
 
-  fprintf(f, "- **`%s`** : ", name);
+  doc_printf(f, "- **`%s`** : ", name);
   if (var->stmt.var_decl.var_type) {
     print_type(f, var->stmt.var_decl.var_type);
   } else {
-    fprintf(f, "inferred");
+    doc_printf(f, "inferred");
   }
-  fprintf(f, " *(%s)*", is_mutable ? "mutable" : "constant");
+  doc_printf(f, " *(%s)*", is_mutable ? "mutable" : "constant");
   if (doc && *doc) {
     const char *end = strchr(doc, '\n');
-    fprintf(f, " — ");
-    if (end) fprintf(f, "%.*s", (int)(end - doc), doc);
-    else fprintf(f, "%s", doc);
+    doc_printf(f, " — ");
+    if (end) doc_printf(f, "%.*s", (int)(end - doc), doc);
+    else doc_printf(f, "%s", doc);
   }
-  fprintf(f, "\n");
+  doc_printf(f, "\n");
 }
 
 // Forward declarations
-static void generate_os_docs(FILE *f, AstNode *os_node, DocGenConfig config);
-static void generate_link_docs(FILE *f, AstNode *link_node);
+static void generate_os_docs(DocBuffer *f, AstNode *os_node, DocGenConfig config);
+static void generate_link_docs(DocBuffer *f, AstNode *link_node);
 
 // Generate documentation for declarations inside a block
-static void generate_block_decls(FILE *f, AstNode *block, DocGenConfig config) {
+static void generate_block_decls(DocBuffer *f, AstNode *block, DocGenConfig config) {
   if (!block || block->type != AST_STMT_BLOCK)
     return;
 
@@ -494,31 +582,32 @@ static void generate_block_decls(FILE *f, AstNode *block, DocGenConfig config) {
 }
 
 // Generate documentation for an @os block
-static void generate_os_docs(FILE *f, AstNode *os_node, DocGenConfig config) {
+static void generate_os_docs(DocBuffer *f, AstNode *os_node, DocGenConfig config) {
   for (size_t i = 0; i < os_node->preprocessor.os.arm_count; i++) {
     const char *platform = os_node->preprocessor.os.platforms[i];
-    fprintf(f, "### `\"%s\"`\n\n", platform);
+    doc_printf(f, "### `\"%s\"`\n\n", platform);
     generate_block_decls(f, os_node->preprocessor.os.bodies[i], config);
-    fprintf(f, "\n");
+    doc_printf(f, "\n");
   }
 
   if (os_node->preprocessor.os.has_default &&
       os_node->preprocessor.os.default_body) {
-    fprintf(f, "### Default `_`\n\n");
+    doc_printf(f, "### Default `_`\n\n");
     generate_block_decls(f, os_node->preprocessor.os.default_body, config);
-    fprintf(f, "\n");
+    doc_printf(f, "\n");
   }
 }
 
 // Generate documentation for @link directives
-static void generate_link_docs(FILE *f, AstNode *link_node) {
-  fprintf(f, "> **FFI library:** `%s`\n>\n",
+static void generate_link_docs(DocBuffer *f, AstNode *link_node) {
+  doc_printf(f, "> **FFI library:** `%s`\n>\n",
           link_node->preprocessor.link.lib_name
               ? link_node->preprocessor.link.lib_name
               : "unknown");
 }
 
-bool generate_module_docs(AstNode *module, DocGenConfig config, FILE *f) {
+static bool render_module_docs(DocBuffer *f, AstNode *module,
+                               DocGenConfig config) {
   if (!module || module->type != AST_PREPROCESSOR_MODULE) {
     return false;
   }
@@ -526,18 +615,18 @@ bool generate_module_docs(AstNode *module, DocGenConfig config, FILE *f) {
   const char *module_name = module->preprocessor.module.name;
   const char *module_doc = module->preprocessor.module.doc_comment;
 
-  fprintf(f, "# Module: %s\n\n", module_name ? module_name : "unnamed");
+  doc_printf(f, "# Module: %s\n\n", module_name ? module_name : "unnamed");
 
   if (module_doc && *module_doc) {
     write_doc_comment(f, module_doc, 0);
-    fprintf(f, "\n");
+    doc_printf(f, "\n");
   }
 
-  fprintf(f, "## Table of Contents\n\n");
-  fprintf(f, "- [Structures](#structures)\n");
-  fprintf(f, "- [Enumerations](#enumerations)\n");
-  fprintf(f, "- [Functions](#functions)\n");
-  fprintf(f, "- [Variables](#variables)\n");
+  doc_printf(f, "## Table of Contents\n\n");
+  doc_printf(f, "- [Structures](#structures)\n");
+  doc_printf(f, "- [Enumerations](#enumerations)\n");
+  doc_printf(f, "- [Functions](#functions)\n");
+  doc_printf(f, "- [Variables](#variables)\n");
 
   bool has_os = false;
   bool has_links = false;
@@ -547,9 +636,9 @@ bool generate_module_docs(AstNode *module, DocGenConfig config, FILE *f) {
     if (node->type == AST_PREPROCESSOR_OS) has_os = true;
     if (node->type == AST_PREPROCESSOR_LINK) has_links = true;
   }
-  if (has_os) fprintf(f, "- [OS-Specific](#os-specific)\n");
-  if (has_links) fprintf(f, "- [Linked Libraries](#linked-libraries)\n");
-  fprintf(f, "\n");
+  if (has_os) doc_printf(f, "- [OS-Specific](#os-specific)\n");
+  if (has_links) doc_printf(f, "- [Linked Libraries](#linked-libraries)\n");
+  doc_printf(f, "\n");
 
   if (module->preprocessor.module.body) {
     bool has_structs = false;
@@ -584,7 +673,7 @@ bool generate_module_docs(AstNode *module, DocGenConfig config, FILE *f) {
     }
 
     if (has_structs) {
-      fprintf(f, "---\n\n## Structures\n\n");
+      doc_printf(f, "---\n\n## Structures\n\n");
       for (size_t i = 0; i < module->preprocessor.module.body_count; i++) {
         AstNode *node = module->preprocessor.module.body[i];
         if (node && node->type == AST_STMT_STRUCT) {
@@ -594,7 +683,7 @@ bool generate_module_docs(AstNode *module, DocGenConfig config, FILE *f) {
     }
 
     if (has_enums) {
-      fprintf(f, "\n## Enumerations\n\n");
+      doc_printf(f, "\n## Enumerations\n\n");
       for (size_t i = 0; i < module->preprocessor.module.body_count; i++) {
         AstNode *node = module->preprocessor.module.body[i];
         if (node && node->type == AST_STMT_ENUM) {
@@ -604,7 +693,7 @@ bool generate_module_docs(AstNode *module, DocGenConfig config, FILE *f) {
     }
 
     if (has_functions) {
-      fprintf(f, "\n## Functions\n\n");
+      doc_printf(f, "\n## Functions\n\n");
       for (size_t i = 0; i < module->preprocessor.module.body_count; i++) {
         AstNode *node = module->preprocessor.module.body[i];
         if (node && node->type == AST_STMT_FUNCTION) {
@@ -614,7 +703,7 @@ bool generate_module_docs(AstNode *module, DocGenConfig config, FILE *f) {
     }
 
     if (has_vars) {
-      fprintf(f, "\n## Variables\n\n");
+      doc_printf(f, "\n## Variables\n\n");
       for (size_t i = 0; i < module->preprocessor.module.body_count; i++) {
         AstNode *node = module->preprocessor.module.body[i];
         if (node && node->type == AST_STMT_VAR_DECL) {
@@ -624,7 +713,7 @@ bool generate_module_docs(AstNode *module, DocGenConfig config, FILE *f) {
     }
 
     if (has_os) {
-      fprintf(f, "\n## OS-Specific\n\n");
+      doc_printf(f, "\n## OS-Specific\n\n");
       for (size_t i = 0; i < module->preprocessor.module.body_count; i++) {
         AstNode *node = module->preprocessor.module.body[i];
         if (node && node->type == AST_PREPROCESSOR_OS) {
@@ -634,83 +723,346 @@ bool generate_module_docs(AstNode *module, DocGenConfig config, FILE *f) {
     }
 
     if (has_links) {
-      fprintf(f, "\n## Linked Libraries\n\n");
-      fprintf(f, "External native libraries linked by this module.\n\n");
+      doc_printf(f, "\n## Linked Libraries\n\n");
+      doc_printf(f, "External native libraries linked by this module.\n\n");
       for (size_t i = 0; i < module->preprocessor.module.body_count; i++) {
         AstNode *node = module->preprocessor.module.body[i];
         if (node && node->type == AST_PREPROCESSOR_LINK) {
           generate_link_docs(f, node);
         }
       }
-      fprintf(f, "\n");
+      doc_printf(f, "\n");
     }
   }
 
   return true;
 }
 
-bool generate_documentation(AstNode *program, DocGenConfig config) {
-  if (!program || program->type != AST_PROGRAM) {
-    fprintf(stderr, "Invalid program node for documentation generation\n");
-    return false;
+bool generate_module_docs(AstNode *module, DocGenConfig config, FILE *f) {
+  DocBuffer page = {0};
+  bool ok = render_module_docs(&page, module, config);
+  if (ok && page.length > 0)
+    ok = fwrite(page.data, 1, page.length, f) == page.length;
+  free(page.data);
+  return ok;
+}
+
+// ============================================================================
+// MANIFEST
+// ============================================================================
+
+typedef struct {
+  char *path;
+  char *module_name;
+  uint64_t source_hash;
+} DocManifestEntry;
+
+// The source hash and module of every page the last run generated, sorted
+// by source path
+struct DocManifest {
+  DocManifestEntry *entries;
+  size_t count;
+  const char *output_dir;
+};
+
+// What else shapes a page besides its module's source
+static uint64_t doc_settings_hash(DocGenConfig config) {
+  uint64_t hash = cache_hash_string(14695981039346656037ull,
+                                    Luma_Compiler_version);
+  hash = cache_hash_string(hash, config.format);
+  hash = cache_hash_u64(hash, config.include_private);
+  return cache_hash_u64(hash, config.include_source_links);
+}
+
+static int compare_entries(const void *a, const void *b) {
+  return strcmp(((const DocManifestEntry *)a)->path,
+                ((const DocManifestEntry *)b)->path);
+}
+
+// Splits the next tab-separated field off `*line`
+static char *next_field(char **line) {
+  char *field = *line;
+  if (!field)
+    return NULL;
+  char *tab = strchr(field, '\t');
+  if (tab) {
+    *tab = '\0';
+    *line = tab + 1;
+  } else {
+    *line = NULL;
   }
+  return field;
+}
 
-  if (!ensure_directory(config.output_dir)) {
-    return false;
+DocManifest *doc_manifest_load(DocGenConfig config) {
+  DocManifest *manifest = xcalloc(1, sizeof(DocManifest));
+  manifest->output_dir = config.output_dir;
+
+  char path[512];
+  snprintf(path, sizeof(path), "%s/" DOC_MANIFEST_NAME, config.output_dir);
+  FILE *file = fopen(path, "r");
+  if (!file)
+    return manifest;
+
+  char line[1024];
+  unsigned long long settings = 0;
+  bool current = fgets(line, sizeof(line), file) &&
+                 strcmp(line, DOC_MANIFEST_FORMAT "\n") == 0 &&
+                 fscanf(file, "settings %16llx\n", &settings) == 1 &&
+                 settings == doc_settings_hash(config);
+
+  size_t capacity = 0;
+  while (current && fgets(line, sizeof(line), file)) {
+    line[strcspn(line, "\n")] = '\0';
+    char *rest = line;
+    char *hash = next_field(&rest);
+    char *module_name = next_field(&rest);
+    char *source = next_field(&rest);
+    if (!hash || !module_name || !source || !*source)
+      continue;
+
+    if (manifest->count == capacity) {
+      capacity = capacity ? capacity * 2 : 64;
+      manifest->entries =
+          realloc(manifest->entries, capacity * sizeof(DocManifestEntry));
+      if (!manifest->entries)
+        die("Out of memory while reading %s", path);
+    }
+    manifest->entries[manifest->count++] = (DocManifestEntry){
+        strdup(source), strdup(module_name), strtoull(hash, NULL, 16)};
   }
+  fclose(file);
 
-  printf("Generating documentation in %s/...\n", config.output_dir);
+  if (manifest->count > 1)
+    qsort(manifest->entries, manifest->count, sizeof(DocManifestEntry),
+          compare_entries);
+  return manifest;
+}
 
-  char index_path[512];
-  snprintf(index_path, sizeof(index_path), "%s/README.md", config.output_dir);
+// The module whose page the last run generated from `path` when its text
+// hashed to `source_hash` and the page is still there, so it can be kept
+// without parsing the file; NULL otherwise
+const char *doc_manifest_lookup(const DocManifest *manifest, const char *path,
+                                uint64_t source_hash) {
+  if (!manifest || !path || manifest->count == 0)
+    return NULL;
+
+  DocManifestEntry key = {(char *)path, NULL, 0};
+  const DocManifestEntry *entry =
+      bsearch(&key, manifest->entries, manifest->count,
+              sizeof(DocManifestEntry), compare_entries);
+  if (!entry || entry->source_hash != source_hash)
+    return NULL;
+
+  char page[512];
+  snprintf(page, sizeof(page), "%s/%s.md", manifest->output_dir,
+           entry->module_name);
+  return PathExist(page) ? entry->module_name : NULL;
+}
 
-  FILE *index_file = fopen(index_path, "w");
-  if (!index_file) {
-    fprintf(stderr, "Failed to create index file: %s\n", index_path);
-    return false;
+void doc_manifest_free(DocManifest *manifest) {
+  if (!manifest)
+    return;
+  for (size_t i = 0; i < manifest->count; i++) {
+    free(manifest->entries[i].path);
+    free(manifest->entries[i].module_name);
   }
+  free(manifest->entries);
+  free(manifest);
+}
 
-  fprintf(index_file, "# API Documentation\n\n");
-  fprintf(index_file, "Generated documentation for the project.\n\n");
-  fprintf(index_file, "## Modules\n\n");
+// Written beside its path and renamed over it, like the other caches
+static void save_manifest(const DocModule *modules, const bool *failed,
+                          size_t count, DocGenConfig config) {
+  char path[512];
+  char temp_path[600];
+  snprintf(path, sizeof(path), "%s/" DOC_MANIFEST_NAME, config.output_dir);
+  snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
 
-  bool success = true;
-  for (size_t i = 0; i < program->stmt.program.module_count; i++) {
-    AstNode *module = program->stmt.program.modules[i];
+  FILE *file = fopen(temp_path, "w");
+  if (!file)
+    return;
 
-    if (!module || module->type != AST_PREPROCESSOR_MODULE) {
+  fprintf(file, DOC_MANIFEST_FORMAT "\nsettings %016llx\n",
+          (unsigned long long)doc_settings_hash(config));
+  for (size_t i = 0; i < count; i++) {
+    const DocModule *m = &modules[i];
+    if (failed[i] || !m->path || strpbrk(m->path, "\t\n") ||
+        strpbrk(m->module_name, "\t\n"))
       continue;
-    }
+    fprintf(file, "%016llx\t%s\t%s\n", (unsigned long long)m->source_hash,
+            m->module_name, m->path);
+  }
 
-    const char *module_name = module->preprocessor.module.name;
-    if (!module_name) {
-      module_name = "unnamed";
+  bool ok = !ferror(file);
+  ok = fclose(file) == 0 && ok;
+#ifdef _WIN32
+  if (ok)
+    remove(path);
+#endif
+  if (!ok || rename(temp_path, path) != 0)
+    remove(temp_path);
+}
+
+// ============================================================================
+// PAGES
+// ============================================================================
+
+// Writes `page` to `path` unless the file already holds exactly that, so
+// an unchanged page keeps its mtime. False if writing failed.
+static bool write_page(const char *path, const DocBuffer *page,
+                       bool *written) {
+  *written = false;
+  FILE *existing = fopen(path, "rb");
+  if (existing) {
+    bool same = false;
+    if (fseek(existing, 0, SEEK_END) == 0 &&
+        ftell(existing) == (long)page->length) {
+      rewind(existing);
+      char *data = malloc(page->length + 1);
+      same = data &&
+             fread(data, 1, page->length, existing) == page->length &&
+             (page->length == 0 || memcmp(data, page->data, page->length) == 0);
+      free(data);
     }
+    fclose(existing);
+    if (same)
+      return true;
+  }
+
+  FILE *file = fopen(path, "wb");
+  if (!file)
+    return false;
+  bool ok = page->length == 0 ||
+            fwrite(page->data, 1, page->length, file) == page->length;
+  ok = fclose(file) == 0 && ok;
+  *written = ok;
+  return ok;
+}
 
-    fprintf(index_file, "- [%s](%s.md)\n", module_name, module_name);
+typedef struct {
+  DocModule *modules;
+  size_t count;
+  atomic_size_t next;
+  DocGenConfig config;
+  bool *failed;
+  bool *written;
+} DocQueue;
+
+static void *doc_worker(void *arg) {
+  DocQueue *queue = (DocQueue *)arg;
+  DocBuffer page = {0};
+
+  for (;;) {
+    size_t index = atomic_fetch_add(&queue->next, 1);
+    if (index >= queue->count)
+      break;
+
+    DocModule *m = &queue->modules[index];
+    if (!m->module)
+      continue; // Its page is current
 
     char doc_path[512];
-    snprintf(doc_path, sizeof(doc_path), "%s/%s.md", config.output_dir,
-             module_name);
+    snprintf(doc_path, sizeof(doc_path), "%s/%s.md", queue->config.output_dir,
+             m->module_name);
 
-    FILE *doc_file = fopen(doc_path, "w");
-    if (!doc_file) {
-      fprintf(stderr, "Failed to create documentation file: %s\n", doc_path);
-      success = false;
-      continue;
+    page.length = 0;
+    queue->failed[index] =
+        !render_module_docs(&page, m->module, queue->config) ||
+        !write_page(doc_path, &page, &queue->written[index]);
+  }
+
+  free(page.data);
+  return NULL;
+}
+
+static void *doc_thread(void *arg) {
+  trace_set_thread_name("doc worker");
+  return doc_worker(arg);
+}
+
+bool generate_module_pages(DocModule *modules, size_t count,
+                           DocGenConfig config) {
+  if (!ensure_directory(config.output_dir)) {
+    return false;
+  }
+
+  printf("Generating documentation in %s/...\n", config.output_dir);
+
+  DocQueue queue = {.modules = modules,
+                    .count = count,
+                    .config = config,
+                    .failed = xcalloc(count ? count : 1, sizeof(bool)),
+                    .written = xcalloc(count ? count : 1, sizeof(bool))};
+  atomic_init(&queue.next, 0);
+
+  // Pages name their module
+  size_t stale = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (modules[i].module) {
+      const char *name = modules[i].module->preprocessor.module.name;
+      modules[i].module_name = name ? name : "unnamed";
+      stale++;
+    }
+  }
+
+  size_t thread_count = get_compile_thread_count();
+  if (thread_count > stale)
+    thread_count = stale;
+
+  // The calling thread works the queue too
+  pthread_t *threads = NULL;
+  size_t started = 0;
+  if (thread_count > 1) {
+    threads = xmalloc(sizeof(pthread_t) * (thread_count - 1));
+    for (size_t i = 0; i < thread_count - 1; i++) {
+      if (pthread_create(&threads[started], NULL, doc_thread, &queue) != 0)
+        break;
+      started++;
     }
+  }
+  doc_worker(&queue);
+  for (size_t i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+
+  DocBuffer index = {0};
+  doc_printf(&index, "# API Documentation\n\n");
+  doc_printf(&index, "Generated documentation for the project.\n\n");
+  doc_printf(&index, "## Modules\n\n");
+
+  bool success = true;
+  for (size_t i = 0; i < count; i++) {
+    const char *module_name = modules[i].module_name;
+    doc_printf(&index, "- [%s](%s.md)\n", module_name, module_name);
 
-    if (!generate_module_docs(module, config, doc_file)) {
+    char doc_path[512];
+    snprintf(doc_path, sizeof(doc_path), "%s/%s.md", config.output_dir,
+             module_name);
+    if (queue.failed[i]) {
       fprintf(stderr, "Failed to generate documentation for module: %s\n",
               module_name);
       success = false;
+    } else if (queue.written[i]) {
+      printf("  Generated: %s\n", doc_path);
     }
+  }
+  if (stale < count)
+    printf("  %zu of %zu modules up to date\n", count - stale, count);
 
-    fclose(doc_file);
-    printf("  Generated: %s\n", doc_path);
+  char index_path[512];
+  snprintf(index_path, sizeof(index_path), "%s/README.md", config.output_dir);
+  bool index_written;
+  if (!write_page(index_path, &index, &index_written)) {
+    fprintf(stderr, "Failed to create index file: %s\n", index_path);
+    success = false;
   }
+  free(index.data);
 
-  fclose(index_file);
+  save_manifest(modules, queue.failed, count, config);
+  free(queue.failed);
+  free(queue.written);
 
   if (success) {
     printf("✓ Documentation generated successfully in %s/\n",
@@ -720,6 +1072,26 @@ bool generate_documentation(AstNode *program, DocGenConfig config) {
   return success;
 }
 
+bool generate_documentation(AstNode *program, DocGenConfig config) {
+  if (!program || program->type != AST_PROGRAM) {
+    fprintf(stderr, "Invalid program node for documentation generation\n");
+    return false;
+  }
+
+  size_t count = 0;
+  DocModule *modules =
+      xcalloc(program->stmt.program.module_count + 1, sizeof(DocModule));
+  for (size_t i = 0; i < program->stmt.program.module_count; i++) {
+    AstNode *module = program->stmt.program.modules[i];
+    if (module && module->type == AST_PREPROCESSOR_MODULE)
+      modules[count++].module = module;
+  }
+
+  bool success = generate_module_pages(modules, count, config);
+  free(modules);
+  return success;
+}
+
 DocGenConfig create_doc_config(ArenaAllocator *arena, const char *output_dir) {
   DocGenConfig config = {
       .output_dir = output_dir ? output_dir : "docs",
@@ -8,6 +8,7 @@
 #include "../ast/ast.h"
 #include "../c_libs/memory/memory.h"
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
 /**
@@ -35,6 +36,51 @@ DocGenConfig create_doc_config(ArenaAllocator *arena, const char *output_dir);
  */
 bool generate_documentation(AstNode *program, DocGenConfig config);
 
+/**
+ * @brief One module to document
+ *
+ * A module whose page is still current (see doc_manifest_lookup()) is given
+ * by name alone, so its file doesn't have to be parsed.
+ */
+typedef struct {
+  const char *path;        // Source file, as given to the build; may be NULL
+  uint64_t source_hash;    // Of the file's text
+  AstNode *module;         // NULL when its page is current
+  const char *module_name; // The page's module when `module` is NULL
+} DocModule;
+
+/**
+ * @brief The pages a previous run generated, read from .luma-docs in the
+ * output directory
+ */
+typedef struct DocManifest DocManifest;
+
+DocManifest *doc_manifest_load(DocGenConfig config);
+
+/**
+ * @brief The module whose page is current for a file whose text hashes to
+ * @p source_hash, or NULL if the page has to be generated again
+ *
+ * A page only depends on its own module's declarations (types are printed
+ * as written), so the hash of the module's source and the generator's
+ * settings decide whether it is current.
+ */
+const char *doc_manifest_lookup(const DocManifest *manifest, const char *path,
+                                uint64_t source_hash);
+void doc_manifest_free(DocManifest *manifest);
+
+/**
+ * @brief Generate the pages of @p modules that aren't current, on up to
+ * get_compile_thread_count() threads, plus the index
+ *
+ * Pages are rendered in memory and only written when their text changed;
+ * the manifest is updated for the next run.
+ *
+ * @return true if generation succeeded, false otherwise
+ */
+bool generate_module_pages(DocModule *modules, size_t count,
+                           DocGenConfig config);
+
 /**
  * @brief Generate documentation for a single module
  *
@@ -7,6 +7,7 @@
  * with color highlighting.
  */
 
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -20,45 +21,30 @@
 #define MAX_ERRORS 256
 static ErrorInformation error_list[MAX_ERRORS];
 static int error_count = 0;
+static pthread_mutex_t error_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Set while the current thread is staging its diagnostics (see
+// error_begin_capture); NULL means errors go straight to error_list.
+static _Thread_local ErrorBuffer *active_capture = NULL;
 
 /**
  * @brief Generates the full source line text for a given line number.
  */
-const char *generate_line(ArenaAllocator *arena, Token *tokens, int token_count,
+const char *generate_line(ArenaAllocator *arena, const LineTable *lines,
                           int target_line) {
-  if (target_line < 0 || !tokens)
+  if (target_line < 1 || !lines)
     return "";
 
-  // Calculate total length needed
-  size_t total_len = 1; // For null terminator
-  for (int i = 0; i < token_count; i++) {
-    if (tokens[i].line == target_line) {
-      total_len += tokens[i].whitespace_len + tokens[i].length;
-    }
-  }
+  size_t length;
+  const char *line = line_table_text(lines, target_line, &length);
 
-  // Allocate result buffer
-  char *result = arena_alloc(arena, total_len + 1, alignof(char));
+  char *result = arena_alloc(arena, length + 1, alignof(char));
   if (!result)
     return "";
 
-  char *pos = result;
-
-  // Build the line
-  for (int i = 0; i < token_count; i++) {
-    if (tokens[i].line != target_line)
-      continue;
-
-    // Add whitespace
-    memset(pos, ' ', tokens[i].whitespace_len);
-    pos += tokens[i].whitespace_len;
-
-    // Add token text
-    memcpy(pos, tokens[i].value, tokens[i].length);
-    pos += tokens[i].length;
-  }
-
-  *pos = '\0';
+  for (size_t i = 0; i < length; i++)
+    result[i] = line[i] == '\t' ? ' ' : line[i];
+  result[length] = '\0';
 
   return result;
 }
@@ -67,15 +53,78 @@ const char *generate_line(ArenaAllocator *arena, Token *tokens, int token_count,
  * @brief Adds an error to the internal error list.
  */
 void error_add(ErrorInformation err) {
+  ErrorBuffer *buffer = active_capture;
+  if (buffer) {
+    if (buffer->count >= MAX_ERRORS)
+      return;
+    if (buffer->count == buffer->capacity) {
+      int new_capacity = buffer->capacity ? buffer->capacity * 2 : 8;
+      ErrorInformation *items =
+          realloc(buffer->items, sizeof(ErrorInformation) * new_capacity);
+      if (!items)
+        return;
+      buffer->items = items;
+      buffer->capacity = new_capacity;
+    }
+    buffer->items[buffer->count++] = err;
+    return;
+  }
+
+  pthread_mutex_lock(&error_lock);
   if (error_count < MAX_ERRORS) {
     error_list[error_count++] = err;
   }
+  pthread_mutex_unlock(&error_lock);
 }
 
 /**
  * @brief Clears all accumulated errors from the error list.
  */
-void error_clear(void) { error_count = 0; }
+void error_clear(void) {
+  if (active_capture) {
+    active_capture->count = 0;
+    return;
+  }
+  pthread_mutex_lock(&error_lock);
+  error_count = 0;
+  pthread_mutex_unlock(&error_lock);
+}
+
+/**
+ * @brief Starts staging errors from the calling thread into a buffer.
+ */
+void error_begin_capture(ErrorBuffer *buffer) { active_capture = buffer; }
+
+/**
+ * @brief Stops staging errors on the calling thread.
+ */
+void error_end_capture(void) { active_capture = NULL; }
+
+ErrorBuffer *error_get_capture(void) { return active_capture; }
+
+/**
+ * @brief Moves staged errors into the shared list, preserving their order.
+ */
+void error_flush_buffer(ErrorBuffer *buffer) {
+  if (!buffer)
+    return;
+
+  if (active_capture && active_capture != buffer) {
+    for (int i = 0; i < buffer->count; i++)
+      error_add(buffer->items[i]);
+  } else if (!active_capture) {
+    pthread_mutex_lock(&error_lock);
+    for (int i = 0; i < buffer->count && error_count < MAX_ERRORS; i++) {
+      error_list[error_count++] = buffer->items[i];
+    }
+    pthread_mutex_unlock(&error_lock);
+  }
+
+  free(buffer->items);
+  buffer->items = NULL;
+  buffer->count = 0;
+  buffer->capacity = 0;
+}
 
 /**
  * @brief Calculates the number of digits in a line number.
@@ -248,6 +297,10 @@ static void print_indicator(int col, int length, int line,
  * @brief Reports all accumulated errors with formatting.
  */
 bool error_report(void) {
+  // Staged errors are printed by whoever flushes the buffer
+  if (active_capture)
+    return active_capture->count > 0;
+
   if (error_count == 0)
     return false;
 
@@ -330,17 +383,24 @@ bool error_report(void) {
 /**
  * @brief Gets the current error count.
  */
-int error_get_count(void) { return error_count; }
+int error_get_count(void) {
+  return active_capture ? active_capture->count : error_count;
+}
 
 /**
  * @brief Checks if there are any errors.
  */
-bool error_has_errors(void) { return error_count > 0; }
+bool error_has_errors(void) { return error_get_count() > 0; }
 
 /**
  * @brief Gets the error at the specified index.
  */
 ErrorInformation *error_get_at_index(int index) {
+  if (active_capture) {
+    if (index < 0 || index >= active_capture->count)
+      return NULL;
+    return &active_capture->items[index];
+  }
   if (index < 0 || index >= error_count) {
     return NULL;
   }
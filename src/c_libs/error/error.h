@@ -46,20 +46,34 @@ typedef struct {
   const char *help;  // optional
 } ErrorInformation;
 
+/**
+ * @struct ErrorBuffer
+ * @brief Per-thread staging area for diagnostics.
+ *
+ * While a buffer is being captured on a thread, errors added on that thread
+ * are kept here instead of the shared list, so files lexed and parsed in
+ * parallel can be reported afterwards in a fixed order.
+ */
+typedef struct {
+  ErrorInformation *items;
+  int count;
+  int capacity;
+} ErrorBuffer;
+
 /**
  * @brief Generates the source code line text for a given line number.
  *
- * Uses the provided tokens and copies the line text into memory
- * allocated from the given arena.
+ * Copies the line out of the source, through its line table, into memory
+ * allocated from the given arena. Tabs become single spaces so the
+ * error indicator lines up byte for byte.
  *
  * @param arena Arena allocator used for string allocation.
- * @param tokens Array of tokens representing the source.
- * @param token_count Number of tokens in the array.
- * @param target_line The line number for which to generate the line text.
+ * @param lines Line table of the source file.
+ * @param target_line The 1-based line number to generate the line text for.
  * @return Pointer to a null-terminated string containing the line text,
- *         allocated in the arena. Returns NULL if the line is not found.
+ *         allocated in the arena. Returns "" if the line is not found.
  */
-const char *generate_line(ArenaAllocator *arena, Token *tokens, int token_count,
+const char *generate_line(ArenaAllocator *arena, const LineTable *lines,
                           int target_line);
 
 /**
@@ -106,3 +120,35 @@ bool error_report(void);
  * Frees any internal storage and resets the error list.
  */
 void error_clear(void);
+
+/**
+ * @brief Routes errors added on the calling thread into @p buffer.
+ *
+ * Until error_end_capture() is called, error_add() appends to the buffer,
+ * error_report() only tells whether the buffer holds errors (nothing is
+ * printed) and error_get_count()/error_has_errors() look at the buffer.
+ *
+ * @param buffer Zero-initialized buffer owned by the caller.
+ */
+void error_begin_capture(ErrorBuffer *buffer);
+
+/**
+ * @brief Stops capturing on the calling thread; errors go to the shared list
+ * again.
+ */
+void error_end_capture(void);
+
+/**
+ * @brief Returns the buffer errors on the calling thread are captured into,
+ * or NULL, so a nested capture can restore it afterwards.
+ */
+ErrorBuffer *error_get_capture(void);
+
+/**
+ * @brief Appends the captured errors to wherever errors on the calling thread
+ * currently go (the shared list, or an enclosing capture) and frees the
+ * buffer.
+ *
+ * @param buffer Buffer previously filled through error_begin_capture().
+ */
+void error_flush_buffer(ErrorBuffer *buffer);
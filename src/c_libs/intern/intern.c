@@ -0,0 +1,215 @@
+/**
+ * @file intern.c
+ * @brief Implementation of the string interner.
+ *
+ * The table is split into shards picked by the top bits of the hash, each
+ * with its own lock, open-addressed slots and text storage, so threads
+ * parsing different files rarely wait on each other. An atom's text is
+ * preceded by a small header holding its hash and length.
+ */
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "intern.h"
+
+#define INTERN_SHARD_BITS 4
+#define INTERN_SHARDS (1u << INTERN_SHARD_BITS)
+#define INTERN_INITIAL_SLOTS 256
+#define INTERN_CHUNK_SIZE (32 * 1024)
+
+typedef struct {
+  uint32_t hash;
+  uint32_t length;
+} AtomHeader;
+
+typedef struct InternChunk {
+  struct InternChunk *next;
+  size_t used;
+  size_t size;
+  alignas(AtomHeader) char data[];
+} InternChunk;
+
+typedef struct {
+  pthread_mutex_t lock;
+  Atom *slots; // NULL or an atom; capacity is a power of two
+  size_t count;
+  size_t capacity;
+  InternChunk *chunks; // Newest first; atoms are carved from the head
+} InternShard;
+
+static InternShard shards[INTERN_SHARDS];
+static pthread_once_t shards_once = PTHREAD_ONCE_INIT;
+
+static void init_shards(void) {
+  for (size_t i = 0; i < INTERN_SHARDS; i++)
+    pthread_mutex_init(&shards[i].lock, NULL);
+}
+
+static inline const AtomHeader *header_of(Atom atom) {
+  return (const AtomHeader *)atom - 1;
+}
+
+// FNV-1a, like the other string hashes in the compiler
+static uint32_t hash_text(const char *text, size_t length) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (unsigned char)text[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static inline InternShard *shard_for(uint32_t hash) {
+  return &shards[hash >> (32 - INTERN_SHARD_BITS)];
+}
+
+// Finds the slot holding @p text, or the empty slot where it belongs
+static Atom *find_slot(Atom *slots, size_t capacity, const char *text,
+                       size_t length, uint32_t hash) {
+  size_t mask = capacity - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    Atom atom = slots[i];
+    if (!atom)
+      return &slots[i];
+    const AtomHeader *header = header_of(atom);
+    if (header->hash == hash && header->length == length &&
+        memcmp(atom, text, length) == 0)
+      return &slots[i];
+  }
+}
+
+static bool grow_slots(InternShard *shard) {
+  size_t capacity = shard->capacity ? shard->capacity * 2 : INTERN_INITIAL_SLOTS;
+  Atom *slots = calloc(capacity, sizeof(Atom));
+  if (!slots)
+    return false;
+
+  for (size_t i = 0; i < shard->capacity; i++) {
+    Atom atom = shard->slots[i];
+    if (atom) {
+      const AtomHeader *header = header_of(atom);
+      *find_slot(slots, capacity, atom, header->length, header->hash) = atom;
+    }
+  }
+
+  free(shard->slots);
+  shard->slots = slots;
+  shard->capacity = capacity;
+  return true;
+}
+
+static Atom store_text(InternShard *shard, const char *text, size_t length,
+                       uint32_t hash) {
+  size_t needed = sizeof(AtomHeader) + length + 1;
+  needed = (needed + alignof(AtomHeader) - 1) & ~(alignof(AtomHeader) - 1);
+
+  InternChunk *chunk = shard->chunks;
+  if (!chunk || chunk->size - chunk->used < needed) {
+    size_t size = needed > INTERN_CHUNK_SIZE ? needed : INTERN_CHUNK_SIZE;
+    chunk = malloc(sizeof(InternChunk) + size);
+    if (!chunk)
+      return NULL;
+    chunk->used = 0;
+    chunk->size = size;
+    // An oversized atom gets its own chunk behind the current one, so the
+    // current chunk's free space isn't abandoned
+    if (size > INTERN_CHUNK_SIZE && shard->chunks) {
+      chunk->next = shard->chunks->next;
+      shard->chunks->next = chunk;
+    } else {
+      chunk->next = shard->chunks;
+      shard->chunks = chunk;
+    }
+  }
+
+  AtomHeader *header = (AtomHeader *)(chunk->data + chunk->used);
+  chunk->used += needed;
+  header->hash = hash;
+  header->length = (uint32_t)length;
+
+  char *atom = (char *)(header + 1);
+  memcpy(atom, text, length);
+  atom[length] = '\0';
+  return atom;
+}
+
+Atom intern_n(const char *text, size_t length) {
+  if (!text)
+    return NULL;
+  pthread_once(&shards_once, init_shards);
+
+  uint32_t hash = hash_text(text, length);
+  InternShard *shard = shard_for(hash);
+
+  pthread_mutex_lock(&shard->lock);
+  // Keep the load factor at or below one half
+  if ((shard->count + 1) * 2 > shard->capacity && !grow_slots(shard)) {
+    pthread_mutex_unlock(&shard->lock);
+    perror("Failed to allocate memory");
+    return NULL;
+  }
+
+  Atom *slot = find_slot(shard->slots, shard->capacity, text, length, hash);
+  if (!*slot) {
+    Atom atom = store_text(shard, text, length, hash);
+    if (!atom) {
+      pthread_mutex_unlock(&shard->lock);
+      perror("Failed to allocate memory");
+      return NULL;
+    }
+    *slot = atom;
+    shard->count++;
+  }
+  Atom atom = *slot;
+  pthread_mutex_unlock(&shard->lock);
+  return atom;
+}
+
+Atom intern(const char *text) {
+  return text ? intern_n(text, strlen(text)) : NULL;
+}
+
+Atom atom_find(const char *text) {
+  if (!text)
+    return NULL;
+  pthread_once(&shards_once, init_shards);
+
+  size_t length = strlen(text);
+  uint32_t hash = hash_text(text, length);
+  InternShard *shard = shard_for(hash);
+
+  pthread_mutex_lock(&shard->lock);
+  Atom atom = NULL;
+  if (shard->capacity)
+    atom = *find_slot(shard->slots, shard->capacity, text, length, hash);
+  pthread_mutex_unlock(&shard->lock);
+  return atom;
+}
+
+uint32_t atom_hash(Atom atom) { return header_of(atom)->hash; }
+
+size_t atom_length(Atom atom) { return header_of(atom)->length; }
+
+void intern_release_all(void) {
+  pthread_once(&shards_once, init_shards);
+  for (size_t i = 0; i < INTERN_SHARDS; i++) {
+    InternShard *shard = &shards[i];
+    pthread_mutex_lock(&shard->lock);
+    for (InternChunk *chunk = shard->chunks; chunk;) {
+      InternChunk *next = chunk->next;
+      free(chunk);
+      chunk = next;
+    }
+    free(shard->slots);
+    shard->slots = NULL;
+    shard->count = 0;
+    shard->capacity = 0;
+    shard->chunks = NULL;
+    pthread_mutex_unlock(&shard->lock);
+  }
+}
@@ -0,0 +1,58 @@
+/**
+ * @file intern.h
+ * @brief Process-lifetime string interner for identifiers and module names.
+ *
+ * Interning a string returns the one canonical copy of its text, so two
+ * atoms are equal exactly when their pointers are, and each atom carries its
+ * hash. Atoms are ordinary NUL-terminated strings and can be read wherever a
+ * const char * is expected; they stay valid until intern_release_all().
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** An interned string; compare with ==, never free */
+typedef const char *Atom;
+
+/**
+ * @brief Returns the atom for @p text, creating it on first use.
+ *
+ * Safe to call from several threads.
+ *
+ * @param text NUL-terminated text; need not outlive the call
+ * @return The atom, or NULL if @p text is NULL
+ */
+Atom intern(const char *text);
+
+/**
+ * @brief Returns the atom for the first @p length bytes of @p text.
+ */
+Atom intern_n(const char *text, size_t length);
+
+/**
+ * @brief Returns the atom for @p text if one exists, without creating it.
+ *
+ * Lookups use this to turn a name into an atom once: a name that was never
+ * interned can't match any interned key.
+ *
+ * @return The atom, or NULL if @p text was never interned (or is NULL)
+ */
+Atom atom_find(const char *text);
+
+/**
+ * @brief Hash of an atom's text, computed once when it was interned.
+ */
+uint32_t atom_hash(Atom atom);
+
+/**
+ * @brief Length of an atom's text.
+ */
+size_t atom_length(Atom atom);
+
+/**
+ * @brief Frees every atom. Invalidates all atoms, including the names held
+ * by any AST or symbol table still alive.
+ */
+void intern_release_all(void);
@@ -426,6 +426,42 @@ void arena_reset(ArenaAllocator *arena) {
   DEBUG_PRINT("arena_reset: reset to first buffer %p\n", (void *)arena->head);
 }
 
+/**
+ * @brief Splices another arena's buffers into this one.
+ *
+ * The adopted buffers go in front of the active buffer: buffers after it
+ * are treated as free space by arena_alloc, and these are full of live data.
+ *
+ * @param arena Pointer to the ArenaAllocator taking the buffers.
+ * @param other Pointer to the ArenaAllocator giving them up.
+ */
+void arena_adopt(ArenaAllocator *arena, ArenaAllocator *other) {
+  if (!arena || !other || !other->head || !arena->head)
+    return;
+
+  Buffer *last = other->head;
+  while (last->next)
+    last = last->next;
+
+  if (arena->buffer == arena->head) {
+    last->next = arena->head;
+    arena->head = other->head;
+  } else {
+    Buffer *before = arena->head;
+    while (before->next != arena->buffer)
+      before = before->next;
+    before->next = other->head;
+    last->next = arena->buffer;
+  }
+  arena->total_allocated += other->total_allocated;
+
+  other->head = NULL;
+  other->buffer = NULL;
+  other->offset = 0;
+  other->next_buffer_size = 0;
+  other->total_allocated = 0;
+}
+
 /**
  * @brief Frees all buffers and resets the arena allocator.
  *
@@ -517,6 +553,22 @@ char *arena_strdup(ArenaAllocator *arena, const char *src) {
   return dst;
 }
 
+/**
+ * @brief Alignment for an array of items of the given size.
+ *
+ * The largest power of two dividing the size, which every element's own
+ * alignment divides, capped at alignof(max_align_t). A 12-byte item gets 4.
+ *
+ * @param item_size Size in bytes of each element.
+ * @return The alignment, a power of two.
+ */
+static size_t item_alignment(size_t item_size) {
+  size_t alignment = item_size & (~item_size + 1); // Lowest set bit
+  if (alignment == 0 || alignment > alignof(max_align_t))
+    alignment = alignof(max_align_t);
+  return alignment;
+}
+
 /**
  * @brief Initializes a GrowableArray backed by an arena allocator.
  *
@@ -533,10 +585,7 @@ bool growable_array_init(GrowableArray *arr, ArenaAllocator *arena,
   if (initial_capacity == 0)
     initial_capacity = 4;
 
-  size_t alignment = (item_size == sizeof(void *)) ? alignof(void *)
-                     : (item_size >= alignof(max_align_t))
-                         ? alignof(max_align_t)
-                         : item_size;
+  size_t alignment = item_alignment(item_size);
 
   arr->data = arena_alloc(arena, initial_capacity * item_size, alignment);
   if (!arr->data) {
@@ -571,10 +620,7 @@ bool growable_array_init(GrowableArray *arr, ArenaAllocator *arena,
 void *growable_array_push(GrowableArray *arr) {
   if (arr->count >= arr->capacity) {
     size_t new_capacity = arr->capacity * 2;
-    size_t alignment = (arr->item_size == sizeof(void *)) ? alignof(void *)
-                       : (arr->item_size >= alignof(max_align_t))
-                           ? alignof(max_align_t)
-                           : arr->item_size;
+    size_t alignment = item_alignment(arr->item_size);
 
     void *new_block =
         arena_alloc(arr->arena, new_capacity * arr->item_size, alignment);
@@ -603,3 +649,75 @@ void *growable_array_push(GrowableArray *arr) {
 
   return slot;
 }
+
+/**
+ * @brief Initializes a chunked array without allocating.
+ *
+ * Scopes and lists that stay empty cost no arena memory this way.
+ *
+ * @param arr Pointer to the ChunkedArray.
+ * @param arena Arena the chunks come from.
+ * @param first_capacity Items in the first chunk, rounded up to a power of 2.
+ * @param item_size Size of each element in bytes.
+ */
+void chunked_array_init(ChunkedArray *arr, ArenaAllocator *arena,
+                        size_t first_capacity, size_t item_size) {
+  memset(arr, 0, sizeof(*arr));
+  while (((size_t)1 << arr->first_shift) < first_capacity)
+    arr->first_shift++;
+  arr->item_size = item_size;
+  arr->alignment = item_alignment(item_size);
+  arr->arena = arena;
+}
+
+/**
+ * @brief Pushes an element, adding a chunk twice the size of the last one
+ * when the chunks are full.
+ *
+ * @param arr Pointer to the ChunkedArray.
+ * @return Pointer to the new element's memory slot, or NULL on failure.
+ */
+void *chunked_array_push(ChunkedArray *arr) {
+  // Chunks 0..k-1 hold (2^k - 1) << first_shift items together
+  size_t filled = (((size_t)1 << arr->chunk_count) - 1) << arr->first_shift;
+  if (arr->count == filled) {
+    if (arr->chunk_count == CHUNKED_ARRAY_MAX_CHUNKS)
+      return NULL;
+    size_t capacity = (size_t)1 << (arr->first_shift + arr->chunk_count);
+    char *chunk =
+        arena_alloc(arr->arena, capacity * arr->item_size, arr->alignment);
+    if (!chunk) {
+      DEBUG_PRINT("chunked_array_push: FAILED to add chunk of %zu items\n",
+                  capacity);
+      return NULL;
+    }
+    arr->chunks[arr->chunk_count++] = chunk;
+  }
+
+  return chunked_array_get(arr, arr->count++);
+}
+
+/**
+ * @brief Copies the elements of a chunked array into one contiguous block.
+ *
+ * @param arr Pointer to the ChunkedArray.
+ * @param arena Arena the block is allocated from.
+ * @return The block, or NULL if the array is empty or memory ran out.
+ */
+void *chunked_array_flatten(const ChunkedArray *arr, ArenaAllocator *arena) {
+  if (arr->count == 0)
+    return NULL;
+
+  char *flat = arena_alloc(arena, arr->count * arr->item_size, arr->alignment);
+  if (!flat)
+    return NULL;
+
+  size_t copied = 0;
+  for (size_t k = 0; k < arr->chunk_count && copied < arr->count; k++) {
+    size_t capacity = (size_t)1 << (arr->first_shift + k);
+    size_t n = arr->count - copied < capacity ? arr->count - copied : capacity;
+    memcpy(flat + copied * arr->item_size, arr->chunks[k], n * arr->item_size);
+    copied += n;
+  }
+  return flat;
+}
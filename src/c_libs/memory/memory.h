@@ -12,6 +12,8 @@
  * - **ArenaAllocator**: Allocates memory from contiguous blocks (buffers).
  * - **GrowableArray**: A dynamic array that stores items in arena-allocated
  * memory.
+ * - **ChunkedArray**: An append-only array of arena chunks whose items never
+ * move.
  *
  * ## Features
  * - Minimal malloc/free calls.
@@ -43,8 +45,13 @@
 #include <stdalign.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdnoreturn.h>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -117,6 +124,27 @@ typedef struct {
   ArenaAllocator *arena; /**< Arena allocator used for storage. */
 } GrowableArray;
 
+/** @brief Most chunks a ChunkedArray can have. */
+#define CHUNKED_ARRAY_MAX_CHUNKS 32
+
+/**
+ * @brief Append-only array stored in arena chunks that are never moved.
+ *
+ * Chunk k holds `first_capacity << k` items, so a push never copies and the
+ * address of an item stays valid for the life of the arena, and indexing is
+ * still constant time. Growing a GrowableArray in an arena leaves every
+ * outgrown copy behind; here the chunks add up to less than twice the items.
+ */
+typedef struct {
+  char *chunks[CHUNKED_ARRAY_MAX_CHUNKS]; /**< Allocated as they fill. */
+  size_t chunk_count;                     /**< Chunks allocated so far. */
+  size_t count;                           /**< Items pushed. */
+  unsigned first_shift;  /**< log2 of the first chunk's capacity. */
+  size_t item_size;      /**< Size of each element in bytes. */
+  size_t alignment;      /**< Alignment of each chunk. */
+  ArenaAllocator *arena; /**< Arena the chunks come from. */
+} ChunkedArray;
+
 /* =========================================================================
    Buffer Management
    ========================================================================= */
@@ -181,6 +209,18 @@ void arena_reset(ArenaAllocator *arena);
  */
 void arena_destroy(ArenaAllocator *arena);
 
+/**
+ * @brief Moves every buffer of @p other into @p arena, leaving @p other empty.
+ *
+ * Memory handed out by @p other stays valid and is freed with @p arena.
+ * Lets worker threads allocate from private arenas whose results must live
+ * as long as the shared one.
+ *
+ * @param arena Arena that takes ownership of the buffers.
+ * @param other Arena to empty; may be reinitialized afterwards.
+ */
+void arena_adopt(ArenaAllocator *arena, ArenaAllocator *other);
+
 /**
  * @brief Duplicates a string into arena-managed memory.
  * @param arena Pointer to the arena.
@@ -224,6 +264,53 @@ bool growable_array_init(GrowableArray *arr, ArenaAllocator *arena,
  */
 void *growable_array_push(GrowableArray *arr);
 
+/* =========================================================================
+   Chunked Array Functions
+   ========================================================================= */
+
+/**
+ * @brief Initializes an empty chunked array; nothing is allocated until the
+ * first push.
+ * @param arr Pointer to the ChunkedArray to initialize.
+ * @param arena Arena allocator the chunks come from.
+ * @param first_capacity Items in the first chunk, rounded up to a power of 2.
+ * @param item_size Size of each array element in bytes.
+ */
+void chunked_array_init(ChunkedArray *arr, ArenaAllocator *arena,
+                        size_t first_capacity, size_t item_size);
+
+/**
+ * @brief Appends an uninitialized element, never moving the existing ones.
+ * @param arr Pointer to the ChunkedArray.
+ * @return Pointer to the new element's memory slot, or NULL on failure.
+ */
+void *chunked_array_push(ChunkedArray *arr);
+
+/**
+ * @brief Returns the element at @p index, which must be below arr->count.
+ */
+static inline void *chunked_array_get(const ChunkedArray *arr, size_t index) {
+  // Chunk k starts at item (2^k - 1) << first_shift
+  uint64_t slot = (uint64_t)(index >> arr->first_shift) + 1;
+#ifdef _MSC_VER
+  unsigned long chunk;
+  _BitScanReverse64(&chunk, slot);
+#else
+  unsigned chunk = 63 - (unsigned)__builtin_clzll(slot);
+#endif
+  size_t offset = index - ((((size_t)1 << chunk) - 1) << arr->first_shift);
+  return arr->chunks[chunk] + offset * arr->item_size;
+}
+
+/**
+ * @brief Copies every element into one contiguous block, for consumers that
+ * need a plain array.
+ * @param arr Pointer to the ChunkedArray.
+ * @param arena Arena the block is allocated from.
+ * @return The block (arr->count elements), or NULL if empty or out of memory.
+ */
+void *chunked_array_flatten(const ChunkedArray *arr, ArenaAllocator *arena);
+
 /**
  * @brief Prints a fatal error message and exits the program.
  * @param fmt Format string for the error message.
@@ -0,0 +1,223 @@
+/**
+ * @file source.c
+ * @brief Implementation of the source file manager.
+ *
+ * Files are identified by device and inode, so a module reached through two
+ * different paths (a std/ import and its absolute path, say) is loaded once.
+ * Mapping a file costs a few syscalls and a page-table walk, which is more
+ * than reading a small file outright, so only files of at least
+ * SOURCE_MMAP_THRESHOLD bytes are mapped.
+ */
+
+// MAP_ANONYMOUS, fileno and strdup are outside strict C11
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "source.h"
+
+#define SOURCE_MMAP_THRESHOLD (16 * 1024)
+
+typedef struct {
+  char *path; // Path of the first open, used when inodes are unavailable
+  dev_t device;
+  ino_t inode;
+  off_t size;
+  time_t modified;
+  char *data;
+  size_t length;
+  size_t mapped_size; // 0 when data is a heap buffer
+} SourceFile;
+
+static pthread_mutex_t source_lock = PTHREAD_MUTEX_INITIALIZER;
+static SourceFile *files = NULL;
+static size_t file_count = 0;
+static size_t file_capacity = 0;
+
+// A file rewritten since it was loaded (the language server keeps running
+// across edits) no longer matches; the stale copy stays loaded because
+// earlier tokens still point into it.
+static SourceFile *find_loaded(const char *path, const struct stat *st) {
+  for (size_t i = 0; i < file_count; i++) {
+    SourceFile *file = &files[i];
+    bool same = st->st_ino != 0
+                    ? file->device == st->st_dev && file->inode == st->st_ino
+                    : strcmp(file->path, path) == 0;
+    if (same && file->size == st->st_size && file->modified == st->st_mtime)
+      return file;
+  }
+  return NULL;
+}
+
+static char *read_into_buffer(FILE *stream, size_t size, size_t *length) {
+  char *buffer = malloc(size + 1);
+  if (!buffer) {
+    perror("Failed to allocate memory");
+    return NULL;
+  }
+  size_t bytes_read = fread(buffer, 1, size, stream);
+  buffer[bytes_read] = '\0';
+  *length = bytes_read;
+  return buffer;
+}
+
+#ifndef _WIN32
+/*
+ * Maps @p size bytes of @p fd followed by at least one zero byte. The tail
+ * of the file's last page is zero-filled by the kernel; when the file ends
+ * exactly on a page boundary, the anonymous page reserved behind it supplies
+ * the terminator instead.
+ */
+static char *map_with_terminator(int fd, size_t size, size_t *mapped_size) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t total = (size + 1 + page - 1) & ~(page - 1);
+
+  void *region = mmap(NULL, total, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1, 0);
+  if (region == MAP_FAILED)
+    return NULL;
+
+  void *text = mmap(region, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+  if (text == MAP_FAILED) {
+    munmap(region, total);
+    return NULL;
+  }
+
+#ifdef MADV_SEQUENTIAL
+  madvise(region, size, MADV_SEQUENTIAL);
+#endif
+  *mapped_size = total;
+  return region;
+}
+#endif
+
+// Loads a file that isn't in the table yet. Called without the lock held so
+// threads load different files concurrently.
+static bool load_file(const char *path, SourceFile *file) {
+  FILE *stream = fopen(path, "rb");
+  if (!stream) {
+    perror("Failed to open file");
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fileno(stream), &st) != 0) {
+    perror("Failed to stat file");
+    fclose(stream);
+    return false;
+  }
+
+  file->device = st.st_dev;
+  file->inode = st.st_ino;
+  file->size = st.st_size;
+  file->modified = st.st_mtime;
+  file->mapped_size = 0;
+  file->data = NULL;
+
+#ifndef _WIN32
+  if (S_ISREG(st.st_mode) && (size_t)st.st_size >= SOURCE_MMAP_THRESHOLD) {
+    file->data = map_with_terminator(fileno(stream), (size_t)st.st_size,
+                                     &file->mapped_size);
+    file->length = (size_t)st.st_size;
+  }
+#endif
+
+  // Small files, and anything mmap refuses (pipes, some network filesystems)
+  if (!file->data)
+    file->data = read_into_buffer(stream, (size_t)st.st_size, &file->length);
+
+  fclose(stream);
+  if (!file->data)
+    return false;
+
+  file->path = strdup(path);
+  return true;
+}
+
+static void unload_file(SourceFile *file) {
+#ifndef _WIN32
+  if (file->mapped_size) {
+    munmap(file->data, file->mapped_size);
+    file->data = NULL;
+  }
+#endif
+  free(file->data);
+  free(file->path);
+}
+
+const char *source_open(const char *path, size_t *length) {
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    fprintf(stderr, "Failed to open file: %s: %s\n", path, strerror(errno));
+    return NULL;
+  }
+
+  pthread_mutex_lock(&source_lock);
+  SourceFile *loaded = find_loaded(path, &st);
+  if (loaded) {
+    const char *data = loaded->data;
+    if (length)
+      *length = loaded->length;
+    pthread_mutex_unlock(&source_lock);
+    return data;
+  }
+  pthread_mutex_unlock(&source_lock);
+
+  SourceFile file;
+  if (!load_file(path, &file))
+    return NULL;
+
+  pthread_mutex_lock(&source_lock);
+  // Another thread may have loaded the same file in the meantime
+  loaded = find_loaded(path, &st);
+  if (loaded) {
+    unload_file(&file);
+  } else {
+    if (file_count == file_capacity) {
+      size_t capacity = file_capacity ? file_capacity * 2 : 16;
+      SourceFile *grown = realloc(files, capacity * sizeof(SourceFile));
+      if (!grown) {
+        pthread_mutex_unlock(&source_lock);
+        perror("Failed to allocate memory");
+        unload_file(&file);
+        return NULL;
+      }
+      files = grown;
+      file_capacity = capacity;
+    }
+    files[file_count] = file;
+    loaded = &files[file_count++];
+  }
+
+  const char *data = loaded->data;
+  if (length)
+    *length = loaded->length;
+  pthread_mutex_unlock(&source_lock);
+  return data;
+}
+
+void source_release_all(void) {
+  pthread_mutex_lock(&source_lock);
+  for (size_t i = 0; i < file_count; i++)
+    unload_file(&files[i]);
+  free(files);
+  files = NULL;
+  file_count = 0;
+  file_capacity = 0;
+  pthread_mutex_unlock(&source_lock);
+}
@@ -0,0 +1,36 @@
+/**
+ * @file source.h
+ * @brief Build-lifetime source file manager.
+ *
+ * Source files are loaded once and stay loaded until source_release_all(),
+ * so token value pointers into them remain valid for the whole build without
+ * copying the text. Large files are memory-mapped read-only; small ones are
+ * read into a heap buffer. Either way, the text is followed by a '\0'.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Returns the NUL-terminated contents of @p path.
+ *
+ * Opening a file that is already loaded (by any path naming it) returns the
+ * same view. Safe to call from several threads.
+ *
+ * @param path File to load.
+ * @param length Receives the length of the text, excluding the '\0'; may be
+ *               NULL.
+ * @return The file contents, or NULL (after printing why) on failure. Owned
+ *         by the source manager; do not free.
+ */
+const char *source_open(const char *path, size_t *length);
+
+/**
+ * @brief Unmaps and frees every loaded file.
+ *
+ * Invalidates all views returned by source_open(), and with them every token
+ * that points into one.
+ */
+void source_release_all(void);
@@ -0,0 +1,229 @@
+/**
+ * @file trace.c
+ * @brief Implementation of the Chrome trace event recorder.
+ *
+ * Events are appended to a single mutex-protected array; timestamps are
+ * relative to trace_init() so the timeline starts at zero.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "../memory/memory.h"
+#include "trace.h"
+
+typedef struct {
+  char *name;
+  char *category;
+  char *detail;
+  uint64_t start_us;
+  uint64_t duration_us;
+  int tid;
+} TraceEvent;
+
+typedef struct {
+  char *name;
+  int tid;
+} TraceThread;
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_bool tracing = false;
+static char *trace_path = NULL;
+static uint64_t trace_origin_us = 0;
+
+static TraceEvent *events = NULL;
+static size_t event_count = 0;
+static size_t event_capacity = 0;
+
+static TraceThread *threads = NULL;
+static size_t thread_count = 0;
+
+static atomic_int next_tid = 1;
+static _Thread_local int current_tid = 0;
+
+uint64_t trace_now_us(void) {
+#ifdef _WIN32
+  static LARGE_INTEGER frequency;
+  if (frequency.QuadPart == 0)
+    QueryPerformanceFrequency(&frequency);
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return (uint64_t)(counter.QuadPart * 1000000 / frequency.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+#endif
+}
+
+static int thread_id(void) {
+  if (current_tid == 0)
+    current_tid = atomic_fetch_add(&next_tid, 1);
+  return current_tid;
+}
+
+bool trace_init(const char *output_path) {
+  if (!output_path || output_path[0] == '\0')
+    return false;
+
+  pthread_mutex_lock(&trace_lock);
+  free(trace_path);
+  trace_path = xstrdup(output_path);
+  trace_origin_us = trace_now_us();
+  pthread_mutex_unlock(&trace_lock);
+
+  atomic_store(&tracing, true);
+  trace_set_thread_name("main");
+  return true;
+}
+
+bool trace_enabled(void) { return atomic_load(&tracing); }
+
+void trace_complete(const char *name, const char *category,
+                    const char *detail, uint64_t start_us) {
+  if (!atomic_load(&tracing))
+    return;
+
+  uint64_t end_us = trace_now_us();
+  int tid = thread_id();
+
+  pthread_mutex_lock(&trace_lock);
+  if (event_count == event_capacity) {
+    size_t new_capacity = event_capacity ? event_capacity * 2 : 256;
+    TraceEvent *grown = realloc(events, sizeof(TraceEvent) * new_capacity);
+    if (!grown) {
+      pthread_mutex_unlock(&trace_lock);
+      return;
+    }
+    events = grown;
+    event_capacity = new_capacity;
+  }
+
+  TraceEvent *event = &events[event_count++];
+  event->name = xstrdup(name);
+  event->category = xstrdup(category ? category : "build");
+  event->detail = detail ? xstrdup(detail) : NULL;
+  event->start_us = start_us > trace_origin_us ? start_us - trace_origin_us : 0;
+  event->duration_us = end_us > start_us ? end_us - start_us : 0;
+  event->tid = tid;
+  pthread_mutex_unlock(&trace_lock);
+}
+
+void trace_set_thread_name(const char *name) {
+  if (!atomic_load(&tracing))
+    return;
+
+  int tid = thread_id();
+
+  pthread_mutex_lock(&trace_lock);
+  TraceThread *grown = realloc(threads, sizeof(TraceThread) * (thread_count + 1));
+  if (grown) {
+    threads = grown;
+    threads[thread_count].name = xstrdup(name);
+    threads[thread_count].tid = tid;
+    thread_count++;
+  }
+  pthread_mutex_unlock(&trace_lock);
+}
+
+static void write_json_string(FILE *out, const char *str) {
+  fputc('"', out);
+  for (const unsigned char *p = (const unsigned char *)str; *p; p++) {
+    switch (*p) {
+    case '"':
+      fputs("\\\"", out);
+      break;
+    case '\\':
+      fputs("\\\\", out);
+      break;
+    case '\n':
+      fputs("\\n", out);
+      break;
+    case '\t':
+      fputs("\\t", out);
+      break;
+    default:
+      if (*p < 0x20)
+        fprintf(out, "\\u%04x", *p);
+      else
+        fputc(*p, out);
+    }
+  }
+  fputc('"', out);
+}
+
+bool trace_write(void) {
+  if (!atomic_exchange(&tracing, false))
+    return true;
+
+  pthread_mutex_lock(&trace_lock);
+
+  bool success = false;
+  FILE *out = fopen(trace_path, "w");
+  if (!out) {
+    fprintf(stderr, "Failed to open trace file: %s\n", trace_path);
+  } else {
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", out);
+
+    bool first = true;
+    for (size_t i = 0; i < thread_count; i++) {
+      fprintf(out, "%s{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":"
+                   "\"thread_name\",\"args\":{\"name\":",
+              first ? "" : ",\n", threads[i].tid);
+      write_json_string(out, threads[i].name);
+      fputs("}}", out);
+      first = false;
+    }
+
+    for (size_t i = 0; i < event_count; i++) {
+      TraceEvent *e = &events[i];
+      fprintf(out, "%s{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%llu,"
+                   "\"dur\":%llu,\"name\":",
+              first ? "" : ",\n", e->tid, (unsigned long long)e->start_us,
+              (unsigned long long)e->duration_us);
+      write_json_string(out, e->name);
+      fputs(",\"cat\":", out);
+      write_json_string(out, e->category);
+      if (e->detail) {
+        fputs(",\"args\":{\"detail\":", out);
+        write_json_string(out, e->detail);
+        fputc('}', out);
+      }
+      fputc('}', out);
+      first = false;
+    }
+
+    fputs("\n]}\n", out);
+    success = fclose(out) == 0;
+  }
+
+  for (size_t i = 0; i < event_count; i++) {
+    free(events[i].name);
+    free(events[i].category);
+    free(events[i].detail);
+  }
+  free(events);
+  events = NULL;
+  event_count = event_capacity = 0;
+
+  for (size_t i = 0; i < thread_count; i++) {
+    free(threads[i].name);
+  }
+  free(threads);
+  threads = NULL;
+  thread_count = 0;
+
+  free(trace_path);
+  trace_path = NULL;
+
+  pthread_mutex_unlock(&trace_lock);
+  return success;
+}
@@ -0,0 +1,60 @@
+/**
+ * @file trace.h
+ * @brief Wall-clock build tracing in the Chrome trace event format.
+ *
+ * When enabled with trace_init(), spans recorded from any thread are kept in
+ * memory and written by trace_write() as a JSON file that loads in Perfetto
+ * or chrome://tracing. When tracing is off, recording a span is a single
+ * branch.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Current time of the monotonic wall clock in microseconds.
+ *
+ * Unlike clock(), this measures elapsed time rather than process CPU time,
+ * so it stays meaningful while worker threads run.
+ */
+uint64_t trace_now_us(void);
+
+/**
+ * @brief Enables tracing; spans are written to @p output_path later.
+ *
+ * @param output_path Destination of the JSON trace (copied).
+ * @return true on success.
+ */
+bool trace_init(const char *output_path);
+
+/**
+ * @brief Checks whether trace_init() has been called.
+ */
+bool trace_enabled(void);
+
+/**
+ * @brief Records a span from @p start_us until now on the calling thread.
+ *
+ * @param name Event name shown on the timeline (copied).
+ * @param category Event category, e.g. "frontend" or "codegen" (copied).
+ * @param detail Optional file or module name, NULL for none (copied).
+ * @param start_us Start of the span, from trace_now_us().
+ */
+void trace_complete(const char *name, const char *category,
+                    const char *detail, uint64_t start_us);
+
+/**
+ * @brief Names the calling thread in the trace (e.g. "compile worker").
+ *
+ * @param name Thread name (copied).
+ */
+void trace_set_thread_name(const char *name);
+
+/**
+ * @brief Writes all recorded spans and disables tracing.
+ *
+ * @return true if the file was written (or tracing was never enabled).
+ */
+bool trace_write(void);
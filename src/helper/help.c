@@ -89,10 +89,12 @@ int print_help() {
          "windows)\n");
   printf("                          Default: auto-detected host system\n");
   printf("  -save                   Save intermediate files\n");
-  printf("  -clean                  Clean build artifacts\n");
+  printf("  -clean                  Rebuild all modules, ignoring cached objects\n");
   printf("  -debug                  Enable debug mode\n");
   printf("  --no-sanitize           Disable memory sanitization\n");
   printf("  -l, -link <files...>    Link additional files\n");
+  printf("  --lld                   Link in-process with the embedded lld\n");
+  printf("                          (falls back to the system linker)\n");
   printf(
       "  -doc                    Generates Documantation based on comments\n");
   printf("\nOptimization:\n");
@@ -101,10 +103,37 @@ int print_help() {
   printf("  -O2                     Moderate optimization (default)\n");
   printf(
       "  -O3                     Aggressive optimization (best performance)\n");
+  printf("  --passes=<pipeline>     Run an explicit LLVM pass pipeline\n");
+  printf("                          (e.g. \"default<O2>\", \"instcombine,gvn\")\n");
+  printf("  --time-trace=<file>     Write a Chrome trace of the build phases\n");
+  printf("  --mem-stats             Report peak and live memory per phase\n");
+  printf("  -flto                   Optimize all modules together as one\n");
+  printf("  -flto=thin              Emit bitcode and optimize at link time\n");
+  printf("                          (needs clang and lld)\n");
+  printf("  -fprofile-generate[=<dir>]\n");
+  printf("                          Instrument; running the program writes\n");
+  printf("                          default_<id>.profraw (merge them with\n");
+  printf("                          llvm-profdata merge -o out.profdata)\n");
+  printf("  -fprofile-use=<file>    Optimize using a merged .profdata profile\n");
+  printf("  -fbounds-check          Trap when an array index is out of range\n");
+  printf("  -fprofile-counters      Count calls, cycles and loop iterations,\n");
+  printf("                          written to luma-profile.json at exit\n");
+  printf("                          (or $LUMA_PROFILE) and on SIGUSR1\n");
+  printf("\nTarget CPU:\n");
+  printf("  -march=<level>          Lowest CPU the program must run on, e.g.\n");
+  printf("                          x86-64-v3, or native for this machine\n");
+  printf("                          Default: x86-64-v2 (generic elsewhere)\n");
+  printf("  -mcpu=<cpu>             Exact LLVM processor name, e.g. znver3\n");
+  printf("  -mattr=<features>       Extra features, e.g. +avx2,-fma\n");
+  printf("\nRunning:\n");
+  printf("  run <source_file>       Compile and run in-process with the JIT,\n");
+  printf("                          functions are compiled when first called\n");
+  printf("  --jit-eager             Compile everything before running main\n");
+  printf("  -- <args...>            Arguments passed to the program's main\n");
   printf("\nFormatting:\n");
-  printf("  fmt, format             Format source code\n");
+  printf("  fmt, format <paths...>  Format files, directories and globs\n");
   printf("  -fc, --format-check     Check formatting without modifying\n");
-  printf("  -fi, --format-in-place  Format file in-place\n");
+  printf("  -fi, --format-in-place  Format files in-place\n");
   printf("\nLSP Mode:\n");
   printf("  When running with -lsp, the compiler acts as a language server.\n");
   printf("  This mode is used by editors/IDEs for:\n");
@@ -112,6 +141,7 @@ int print_help() {
   printf("    - Hover information\n");
   printf("    - Real-time diagnostics\n");
   printf("    - Document symbols\n");
+  printf("  LUMA_LSP_RECORD=<file> records the session for bench/lsp_replay.py\n");
 
   return 0;
 }
@@ -163,54 +193,36 @@ bool PathIsDir(const char *p) {
 };
 #endif
 
-bool run_formatter(BuildConfig config, ArenaAllocator *allocator) {
-  if (!config.filepath) {
-    fprintf(stderr, "Error: No source file specified for formatting\n");
+// Every path after `fmt` is formatted, not just the last one
+static bool add_format_path(BuildConfig *config, const char *path) {
+  const char **slot =
+      (const char **)growable_array_push(&config->format_paths);
+  if (!slot) {
+    fprintf(stderr, "Failed to add file to array\n");
     return false;
   }
+  *slot = path;
+  return true;
+}
 
-  // Set up formatter config with reasonable defaults
-  FormatterConfig fmt_config = {
-      .indent_size = 2,
-      .use_tabs = false,
-      .max_line_length = 100,
-      .space_around_operator = true,
-      .space_after_comma = true,
-      .compact_blocks = false,
-      .check_only = config.format_check,
-      .write_in_place = config.format_in_place,
-      .output_file = NULL,
-  };
-
-  if (config.format_check) {
-    // Check if file needs formatting
-    bool needs_formatting =
-        check_formatting(config.filepath, fmt_config, allocator);
-    if (needs_formatting) {
-      printf("File needs formatting: %s\n", config.filepath);
-      return false; // Return false to indicate file needs formatting (exit code
-                    // 1)
-    } else {
-      printf("File is already formatted: %s\n", config.filepath);
-      return true;
-    }
-  }
-
-  // Format the file
-  const char *output_path = config.format_in_place ? config.filepath : NULL;
-  bool success =
-      format_luma_code(config.filepath, output_path, fmt_config, allocator);
+bool run_formatter(BuildConfig config, ArenaAllocator *allocator) {
+  (void)allocator; // Every formatting thread has its own arena
 
-  if (!success) {
-    fprintf(stderr, "Error: Failed to format file: %s\n", config.filepath);
+  // A file named before `fmt`/-fc/-fi
+  if (config.format_paths.count == 0 && config.filepath)
+    add_format_path(&config, config.filepath);
+  if (config.format_paths.count == 0) {
+    fprintf(stderr, "Error: No source file specified for formatting\n");
     return false;
   }
 
-  if (config.format_in_place) {
-    printf("Formatted file in place: %s\n", config.filepath);
-  }
+  FormatterConfig fmt_config = default_config;
+  fmt_config.check_only = config.format_check;
+  fmt_config.write_in_place = config.format_in_place;
 
-  return true;
+  // Returns false when a file needs formatting (exit code 1) or failed
+  return format_files((const char *const *)config.format_paths.data,
+                      config.format_paths.count, fmt_config);
 }
 
 const char *detect_target_os(void) {
@@ -268,7 +280,8 @@ const char *detect_target_os(void) {
 bool parse_args(int argc, char *argv[], BuildConfig *config,
                 ArenaAllocator *arena) {
   // Initialize files array
-  if (!growable_array_init(&config->files, arena, 4, sizeof(char *))) {
+  if (!growable_array_init(&config->files, arena, 4, sizeof(char *)) ||
+      !growable_array_init(&config->format_paths, arena, 4, sizeof(char *))) {
     fprintf(stderr, "Failed to initialize files array\n");
     return false;
   }
@@ -329,12 +342,23 @@ bool parse_args(int argc, char *argv[], BuildConfig *config,
         config->is_debug = true;
       } else if (strcmp(arg, "fmt") == 0 || strcmp(arg, "format") == 0) {
         config->format = true;
+      } else if (strcmp(arg, "run") == 0) {
+        config->jit_run = true;
+      } else if (strcmp(arg, "--jit-eager") == 0) {
+        config->jit_eager = true;
+      } else if (strcmp(arg, "--") == 0) {
+        // Everything after "--" belongs to the program run by `luma run`
+        config->run_argc = argc - (i + 1);
+        config->run_argv = &argv[i + 1];
+        break;
       } else if (strcmp(arg, "-fc") == 0 ||
                  strcmp(arg, "--format-check") == 0) {
         config->format_check = true;
+        config->format = true;
       } else if (strcmp(arg, "-fi") == 0 ||
                  strcmp(arg, "--format-in-place") == 0) {
         config->format_in_place = true;
+        config->format = true;
       } else if (strcmp(arg, "-l") == 0 || strcmp(arg, "-link") == 0) {
         // Collect linked files
         int start = i + 1;
@@ -360,7 +384,39 @@ bool parse_args(int argc, char *argv[], BuildConfig *config,
         config->opt_level = 2;
       else if (strcmp(arg, "-O3") == 0)
         config->opt_level = 3;
-      else {
+      else if (strncmp(arg, "--passes=", 9) == 0)
+        config->passes = arg + 9;
+      else if (strcmp(arg, "--lld") == 0)
+        config->use_lld = true;
+      else if (strcmp(arg, "-flto") == 0 || strcmp(arg, "-flto=full") == 0)
+        config->lto_mode = LTO_FULL;
+      else if (strcmp(arg, "-flto=thin") == 0)
+        config->lto_mode = LTO_THIN;
+      else if (strcmp(arg, "-fprofile-generate") == 0)
+        config->profile = (ProfileOptions){PGO_GENERATE, NULL};
+      else if (strncmp(arg, "-fprofile-generate=", 19) == 0)
+        config->profile = (ProfileOptions){PGO_GENERATE, arg + 19};
+      else if (strncmp(arg, "-fprofile-use=", 14) == 0 && arg[14])
+        config->profile = (ProfileOptions){PGO_USE, arg + 14};
+      else if (strcmp(arg, "-fbounds-check") == 0)
+        config->bounds_check = true;
+      else if (strcmp(arg, "-fprofile-counters") == 0)
+        config->profile_counters = true;
+      else if (strncmp(arg, "-march=", 7) == 0)
+        config->march = arg + 7;
+      else if (strncmp(arg, "-mcpu=", 6) == 0)
+        config->mcpu = arg + 6;
+      else if (strncmp(arg, "-mattr=", 7) == 0)
+        config->mattr = arg + 7;
+      else if (strncmp(arg, "--time-trace=", 13) == 0)
+        config->time_trace = arg + 13;
+      else if (strcmp(arg, "--mem-stats") == 0)
+        config->mem_stats = true;
+      else if (config->format && arg[0] != '-' && strpbrk(arg, "*?[")) {
+        // A glob pattern the shell left alone, expanded by the formatter
+        if (!add_format_path(config, arg))
+          return false;
+      } else {
         if (arg[0] == '-') {
           fprintf(stderr, "Unknown build option: %s\n", arg);
         } else {
@@ -368,11 +424,14 @@ bool parse_args(int argc, char *argv[], BuildConfig *config,
         }
         return false;
       }
-    } else if (PathIsDir(arg)) {
+    } else if (PathIsDir(arg) && !config->format) {
       fprintf(stderr, "%s: Is a directory\n", arg);
       return false;
     } else {
-      config->filepath = arg;
+      if (!PathIsDir(arg))
+        config->filepath = arg;
+      if (config->format && !add_format_path(config, arg))
+        return false;
     }
   }
 
@@ -739,7 +798,15 @@ bool link_with_ld_simple(const char *obj_filename, const char *exe_filename) {
 }
 #endif
 
+static bool progress_enabled = true;
+
+// `luma run` shares the terminal with the program, so it builds silently
+void set_progress_enabled(bool enabled) { progress_enabled = enabled; }
+
 void print_progress(int step, int total, const char *stage) {
+  if (!progress_enabled)
+    return;
+
   float ratio = (float)step / total;
   int filled = (int)(ratio * BAR_WIDTH);
 
@@ -769,21 +836,24 @@ void ensure_clean_line() {
   fflush(stdout);
 }
 
-void timer_start(CompileTimer *timer) { timer->start_time = clock(); }
+// Timers use the wall clock; clock() counts CPU time of every thread and
+// overstates build time once compile workers run in parallel.
+void timer_start(CompileTimer *timer) { timer->start_time = trace_now_us(); }
 
 void timer_stop(CompileTimer *timer) {
-  timer->end_time = clock();
-  timer->elapsed_ms =
-      ((double)(timer->end_time - timer->start_time) / CLOCKS_PER_SEC) * 1000.0;
+  timer->end_time = trace_now_us();
+  timer->elapsed_ms = (double)(timer->end_time - timer->start_time) / 1000.0;
 }
 
 double timer_get_elapsed_ms(CompileTimer *timer) {
-  clock_t current = clock();
-  return ((double)(current - timer->start_time) / CLOCKS_PER_SEC) * 1000.0;
+  return (double)(trace_now_us() - timer->start_time) / 1000.0;
 }
 
 void print_progress_with_time(int step, int total, const char *stage,
                               CompileTimer *timer) {
+  if (!progress_enabled)
+    return;
+
   float ratio = (float)step / total;
   int filled = (int)(ratio * BAR_WIDTH);
 
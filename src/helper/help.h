@@ -10,12 +10,14 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 
 #include "../ast/ast.h"
 #include "../c_libs/memory/memory.h"
+#include "../c_libs/trace/trace.h"
 #include "../lexer/lexer.h"
 #include "../llvm/llvm.h"
 
@@ -55,20 +57,35 @@ typedef struct {
   bool format;          // Add format flag
   bool format_check;    // Add format check flag
   bool format_in_place; // Add in-place formatting flag
+  GrowableArray format_paths; // `luma fmt`: files, directories, glob patterns
   bool lsp_mode;        // Run as Language Server
   bool is_document;     // generate the docs
   bool is_debug;
   GrowableArray files;  // Change from char** to GrowableArray
   size_t file_count;    // Keep for convenience, or remove and use files.count
   int opt_level;        // 0, 1, 2, or
-
-  GrowableArray tokens;
-  size_t token_count;
+  const char *passes;   // Explicit LLVM pass pipeline (--passes=)
+  bool use_lld;         // Link in-process with the embedded lld (--lld)
+  LTOMode lto_mode;     // -flto / -flto=thin
+  const char *march;    // -march=: ISA level or "native"
+  const char *mcpu;     // -mcpu=: exact processor, overrides -march
+  const char *mattr;    // -mattr=: extra "+feature,-feature" list
+  ProfileOptions profile; // -fprofile-generate[=dir] / -fprofile-use=
+  bool bounds_check;       // -fbounds-check: trap on out-of-range indices
+  bool profile_counters;   // -fprofile-counters: count calls, cycles, loops
+  const char *time_trace; // Chrome trace output path (--time-trace=)
+  bool mem_stats;          // --mem-stats: report arena memory per phase
+  bool jit_run;           // `luma run`: execute with the JIT, no executable
+  bool jit_eager;         // --jit-eager: compile all functions up front
+  int run_argc;           // Program arguments after "--"
+  char **run_argv;
+  int *exit_status;       // Receives main's return value under `luma run`
+  struct BodyCache *body_cache; // Function bodies kept across checks (LSP)
 } BuildConfig;
 
 typedef struct {
-  clock_t start_time;
-  clock_t end_time;
+  uint64_t start_time; // Wall clock, microseconds (trace_now_us)
+  uint64_t end_time;
   double elapsed_ms;
 } CompileTimer;
 
@@ -95,6 +112,7 @@ bool run_formatter(BuildConfig config,
 void print_token(const Token *t);
 
 void print_progress(int step, int total, const char *stage);
+void set_progress_enabled(bool enabled);
 void ensure_clean_line();
 
 void timer_start(CompileTimer *timer);
@@ -108,6 +126,12 @@ bool get_gcc_file_path(const char *filename, char *buffer, size_t buffer_size);
 bool get_lib_paths(char *buffer, size_t buffer_size);
 bool link_with_ld_simple(const char *obj_filename, const char *exe_filename);
 bool link_object_files(const char *output_dir, const char *executable_name,
-                       int opt_level, bool is_debug, CodeGenContext *ctx);
+                       int opt_level, bool is_debug, bool use_lld,
+                       CodeGenContext *ctx);
+
+#ifdef LUMA_EMBEDDED_LLD
+// Runs the lld ELF driver in-process (lld_link.cpp); argv[0] names the flavor
+bool lld_link_elf(int argc, const char **argv);
+#endif
 bool validate_module_system(CodeGenContext *ctx);
 void save_module_output_files(CodeGenContext *ctx, const char *output_dir);
@@ -0,0 +1,16 @@
+// lld_link.cpp - In-process linking through the embedded lld ELF driver
+//
+// Only compiled when meson finds the lld libraries (-Dlld=enabled/auto).
+// link_object_files calls this for --lld builds instead of spawning a shell,
+// a compiler driver and a linker process.
+#include "lld/Common/Driver.h"
+#include "llvm/Support/raw_ostream.h"
+
+LLD_HAS_DRIVER(elf)
+
+extern "C" bool lld_link_elf(int argc, const char **argv) {
+  llvm::ArrayRef<const char *> args(argv, static_cast<size_t>(argc));
+  lld::Result result = lld::lldMain(args, llvm::outs(), llvm::errs(),
+                                    {{lld::Gnu, &lld::elf::link}});
+  return result.retCode == 0;
+}
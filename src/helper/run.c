@@ -1,6 +1,7 @@
 #include "../ast/ast_utils.h"
 #include "../auto_docs/doc_generator.h"
 #include "../c_libs/error/error.h"
+#include "../c_libs/source/source.h"
 #include "../llvm/llvm.h"
 #include "../parser/parser.h"
 #include "../typechecker/type.h"
@@ -8,7 +9,9 @@
 #include "std_path.h"
 
 #include <errno.h>
+#include <pthread.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <sys/stat.h>
@@ -21,6 +24,7 @@
 #define MKDIR(path) _mkdir(path)
 #define create_directory(path) (mkdir((path)) == 0 || errno == EEXIST)
 #else
+#include <sys/resource.h>
 #include <unistd.h>
 #define MKDIR(path) mkdir(path, 0755)
 #define create_directory(path) (mkdir((path), 0755) == 0 || errno == EEXIST)
@@ -39,6 +43,7 @@ void handle_illegal_instruction(int sig) {
   fprintf(stderr, "This suggests LLVM generated invalid machine code.\n");
   fprintf(stderr,
           "Check your target architecture and LLVM version compatibility.\n");
+  fprintf(stderr, "If this is an older CPU, try a lower -march= level.\n");
   exit(1);
 }
 
@@ -98,12 +103,73 @@ const char *resolve_import_path(const char *path, ArenaAllocator *allocator) {
   return path;
 }
 
+static CodeGenContext *create_build_codegen_context(BuildConfig *config,
+                                                   ArenaAllocator *allocator) {
+  CodeGenContext *ctx = init_codegen_context(allocator);
+  if (!ctx) {
+    return NULL;
+  }
+  ctx->target_os = config->target_os;
+  ctx->is_debug = config->is_debug;
+  ctx->opt_level = config->opt_level;
+  ctx->pass_pipeline = config->passes;
+  ctx->lto_mode = config->lto_mode;
+  ctx->cpu_options =
+      (TargetCPUOptions){config->march, config->mcpu, config->mattr};
+  ctx->profile = config->profile;
+  ctx->bounds_check = config->bounds_check;
+  ctx->profile_counters = config->profile_counters;
+  // Without LTO, the other way small functions get inlined across modules.
+  // A copied body would count into counters private to its own module.
+  ctx->inline_imports = config->opt_level >= 2 &&
+                        config->lto_mode == LTO_NONE && !config->is_debug &&
+                        !config->profile_counters;
+  ctx->use_object_cache = !config->clean;
+  ctx->compiler_version = Luma_Compiler_version;
+  return ctx;
+}
+
+// `luma run`: generate IR for every module and execute main() in-process
+// instead of emitting objects and linking an executable.
+bool run_llvm_code_jit(AstNode *root, BuildConfig config,
+                       ArenaAllocator *allocator) {
+  CodeGenContext *ctx = create_build_codegen_context(&config, allocator);
+  if (!ctx) {
+    return false;
+  }
+  // Every module lands in one JIT session, which resolves calls directly
+  ctx->inline_imports = false;
+
+  // No crash handlers: past codegen, a fault belongs to the running program
+  uint64_t codegen_start = trace_now_us();
+  codegen_stmt_program_multi_module(ctx, root);
+  trace_complete("Codegen", "backend", NULL, codegen_start);
+
+  // main sees the source file as argv[0], like an executable sees its path
+  int argc = config.run_argc + 1;
+  char **argv = arena_alloc(allocator, sizeof(char *) * (size_t)(argc + 1),
+                            alignof(char *));
+  argv[0] = (char *)config.filepath;
+  for (int i = 0; i < config.run_argc; i++) {
+    argv[i + 1] = config.run_argv[i];
+  }
+  argv[argc] = NULL;
+
+  int exit_status = 0;
+  bool success =
+      jit_run_program(ctx, !config.jit_eager, argc, argv, &exit_status);
+  if (config.exit_status) {
+    *config.exit_status = exit_status;
+  }
+
+  cleanup_codegen_context(ctx);
+  return success;
+}
+
 bool generate_llvm_code_modules(AstNode *root, BuildConfig config,
                                 ArenaAllocator *allocator, int *step,
                                 CompileTimer *timer) {
-  CodeGenContext *ctx = init_codegen_context(allocator);
-  ctx->target_os = config.target_os;
-  ctx->is_debug = config.is_debug;
+  CodeGenContext *ctx = create_build_codegen_context(&config, allocator);
   if (!ctx) {
     return false;
   }
@@ -120,7 +186,9 @@ bool generate_llvm_code_modules(AstNode *root, BuildConfig config,
   signal(SIGSEGV, handle_segfault);
   signal(SIGILL, handle_illegal_instruction);
 
+  uint64_t codegen_start = trace_now_us();
   bool success = generate_program_modules(ctx, root, output_dir);
+  trace_complete("Codegen", "backend", NULL, codegen_start);
 
   if (!success) {
     fprintf(stderr, "Failed to generate LLVM modules\n");
@@ -128,8 +196,6 @@ bool generate_llvm_code_modules(AstNode *root, BuildConfig config,
     return false;
   }
 
-  preprocess_all_modules(ctx);
-
   print_progress_with_time(++(*step), 9, "LLVM IR Generation", timer);
 
   if (config.save) {
@@ -140,15 +206,17 @@ bool generate_llvm_code_modules(AstNode *root, BuildConfig config,
   char exe_file[256];
   snprintf(exe_file, sizeof(exe_file), "%s", base_name);
 
-  if (!link_object_files(output_dir, exe_file, config.opt_level, config.is_debug, ctx)) {
+  uint64_t link_start = trace_now_us();
+  bool linked = link_object_files(output_dir, exe_file, config.opt_level,
+                                  config.is_debug, config.use_lld, ctx);
+  trace_complete("Link", "backend", exe_file, link_start);
+  if (!linked) {
     cleanup_codegen_context(ctx);
     return false;
   }
 
   print_progress_with_time(++(*step), 9, "Linking", timer);
 
-  cleanup_module_caches();
-
   cleanup_codegen_context(ctx);
   return true;
 }
@@ -235,9 +303,22 @@ void collect_link_flags(CodeGenContext *ctx, char *lib_flags,
 
       seen[seen_count++] = lib;
 
+      // The parser anchors names like "libc.so.6" at the source directory;
+      // when nothing is bundled there, let the linker search for it
+      bool is_library = strstr(lib, ".so") || strstr(lib, ".dylib");
+      struct stat st;
+      if (is_library && stat(lib, &st) != 0) {
+        const char *base = strrchr(lib, '/');
+        const char *base_bs = strrchr(lib, '\\');
+        if (base_bs > base)
+          base = base_bs;
+        if (base)
+          lib = base + 1;
+      }
+
       char flag[256];
       if (strchr(lib, '/') || strchr(lib, '\\') ||
-          strstr(lib, ".o") || strstr(lib, ".bin")) {
+          (!is_library && (strstr(lib, ".o") || strstr(lib, ".bin")))) {
         snprintf(flag, sizeof(flag), " %s", lib);
         strncat(object_files, flag, object_files_size - strlen(object_files) - 1);
       } else if (strstr(lib, ".so") || strstr(lib, ".dylib") || strstr(lib, ".a")) {
@@ -251,8 +332,197 @@ void collect_link_flags(CodeGenContext *ctx, char *lib_flags,
   }
 }
 
+#if defined(LUMA_EMBEDDED_LLD) && defined(__linux__)
+#include <dirent.h>
+
+// Arguments link_in_process passes besides the split flag strings
+#define LLD_FIXED_ARGS 32
+
+#if defined(__x86_64__)
+#define LLD_EMULATION "elf_x86_64"
+#define LLD_DYNAMIC_LINKER "/lib64/ld-linux-x86-64.so.2"
+static const char *const gnu_triples[] = {"x86_64-linux-gnu",
+                                          "x86_64-pc-linux-gnu",
+                                          "x86_64-redhat-linux", NULL};
+#elif defined(__aarch64__)
+#define LLD_EMULATION "aarch64linux"
+#define LLD_DYNAMIC_LINKER "/lib/ld-linux-aarch64.so.1"
+static const char *const gnu_triples[] = {"aarch64-linux-gnu",
+                                          "aarch64-redhat-linux", NULL};
+#else
+static const char *const gnu_triples[] = {NULL};
+#endif
+
+// Startup objects and search paths the compiler driver would have passed to
+// the linker for a PIE executable.
+typedef struct {
+  char crt_dir[512];
+  char gcc_dir[512];
+  char scrt1[600];
+  char crti[600];
+  char crtn[600];
+  char crtbegin[600];
+  char crtend[600];
+} ElfLinkPaths;
+
+static bool file_exists_at(char *buffer, size_t size, const char *dir,
+                           const char *name) {
+  snprintf(buffer, size, "%s/%s", dir, name);
+  return access(buffer, F_OK) == 0;
+}
+
+// Picks the newest /usr/lib/gcc/<triple>/<version> that has crtbeginS.o
+static bool find_gcc_dir(char *buffer, size_t size) {
+  int best_major = -1;
+  for (size_t t = 0; gnu_triples[t]; t++) {
+    char triple_dir[256];
+    snprintf(triple_dir, sizeof(triple_dir), "/usr/lib/gcc/%s",
+             gnu_triples[t]);
+
+    DIR *dir = opendir(triple_dir);
+    if (!dir)
+      continue;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+      int major = atoi(entry->d_name);
+      if (major <= best_major)
+        continue;
+
+      char candidate[512], probe[600];
+      snprintf(candidate, sizeof(candidate), "%s/%s", triple_dir,
+               entry->d_name);
+      if (file_exists_at(probe, sizeof(probe), candidate, "crtbeginS.o")) {
+        snprintf(buffer, size, "%s", candidate);
+        best_major = major;
+      }
+    }
+    closedir(dir);
+  }
+  return best_major >= 0;
+}
+
+static bool find_elf_link_paths(ElfLinkPaths *paths) {
+  bool found_crt = false;
+  for (size_t t = 0; gnu_triples[t] && !found_crt; t++) {
+    snprintf(paths->crt_dir, sizeof(paths->crt_dir), "/usr/lib/%s",
+             gnu_triples[t]);
+    found_crt = file_exists_at(paths->scrt1, sizeof(paths->scrt1),
+                               paths->crt_dir, "Scrt1.o");
+  }
+
+  const char *fallback_dirs[] = {"/usr/lib64", "/usr/lib", NULL};
+  for (size_t i = 0; fallback_dirs[i] && !found_crt; i++) {
+    snprintf(paths->crt_dir, sizeof(paths->crt_dir), "%s", fallback_dirs[i]);
+    found_crt = file_exists_at(paths->scrt1, sizeof(paths->scrt1),
+                               paths->crt_dir, "Scrt1.o");
+  }
+
+  return found_crt &&
+         file_exists_at(paths->crti, sizeof(paths->crti), paths->crt_dir,
+                        "crti.o") &&
+         file_exists_at(paths->crtn, sizeof(paths->crtn), paths->crt_dir,
+                        "crtn.o") &&
+         find_gcc_dir(paths->gcc_dir, sizeof(paths->gcc_dir)) &&
+         file_exists_at(paths->crtbegin, sizeof(paths->crtbegin),
+                        paths->gcc_dir, "crtbeginS.o") &&
+         file_exists_at(paths->crtend, sizeof(paths->crtend), paths->gcc_dir,
+                        "crtendS.o");
+}
+
+// The number of argv entries append_split_args makes of a flag string
+static size_t count_split_args(const char *flags) {
+  size_t count = 0;
+  for (const char *c = flags; *c; c++)
+    count += *c != ' ' && (c == flags || c[-1] == ' ');
+  return count;
+}
+
+// Splits a flag string from collect_link_flags into argv entries. The
+// string is modified in place and must outlive the argument vector.
+static void append_split_args(const char **args, int *count, char *flags) {
+  for (char *tok = strtok(flags, " "); tok; tok = strtok(NULL, " "))
+    args[(*count)++] = tok;
+}
+
+// Links the module objects with the embedded lld, avoiding the shell,
+// compiler driver and linker processes. Returns false when the startup files
+// can't be located or lld fails, so the caller can use the system linker.
+static bool link_in_process(const char *executable_name, int opt_level,
+                            LTOMode lto_mode, char *module_objects,
+                            char *lib_flags, char *object_files) {
+#ifndef LLD_EMULATION
+  (void)executable_name;
+  (void)opt_level;
+  (void)lto_mode;
+  (void)module_objects;
+  (void)lib_flags;
+  (void)object_files;
+  return false;
+#else
+  ElfLinkPaths paths = {0};
+  if (!find_elf_link_paths(&paths))
+    return false;
+
+  char gcc_search[600], crt_search[600];
+  snprintf(gcc_search, sizeof(gcc_search), "-L%s", paths.gcc_dir);
+  snprintf(crt_search, sizeof(crt_search), "-L%s", paths.crt_dir);
+
+  size_t capacity = LLD_FIXED_ARGS + count_split_args(module_objects) +
+                    count_split_args(object_files) +
+                    count_split_args(lib_flags);
+  const char **args = malloc(sizeof(*args) * capacity);
+  if (!args)
+    return false;
+  int count = 0;
+  args[count++] = "ld.lld";
+  args[count++] = "-pie";
+  args[count++] = "--hash-style=gnu";
+  args[count++] = "--eh-frame-hdr";
+  args[count++] = "-m";
+  args[count++] = LLD_EMULATION;
+  args[count++] = "-dynamic-linker";
+  args[count++] = LLD_DYNAMIC_LINKER;
+  args[count++] = "-o";
+  args[count++] = executable_name;
+  args[count++] = paths.scrt1;
+  args[count++] = paths.crti;
+  args[count++] = paths.crtbegin;
+  args[count++] = gcc_search;
+  args[count++] = crt_search;
+  args[count++] = "-L/usr/lib";
+  args[count++] = "-L/lib";
+
+  // ThinLTO backends run inside lld, alongside the final link
+  char lto_level[32];
+  if (lto_mode == LTO_THIN) {
+    snprintf(lto_level, sizeof(lto_level), "--lto-O%d",
+             opt_level > 3 ? 3 : opt_level);
+    args[count++] = lto_level;
+  }
+
+  append_split_args(args, &count, module_objects);
+  append_split_args(args, &count, object_files);
+  append_split_args(args, &count, lib_flags);
+
+  const char *tail[] = {"-lgcc",         "--as-needed", "-lgcc_s",
+                        "--no-as-needed", "-lc",         "-lgcc",
+                        "--as-needed",   "-lgcc_s",     "--no-as-needed",
+                        paths.crtend,    paths.crtn};
+  for (size_t i = 0; i < sizeof(tail) / sizeof(*tail); i++)
+    args[count++] = tail[i];
+  args[count] = NULL;
+
+  bool linked = lld_link_elf(count, args);
+  free(args);
+  return linked;
+#endif
+}
+#endif
+
 bool link_object_files(const char *output_dir, const char *executable_name,
-                       int opt_level, bool is_debug, CodeGenContext *ctx) {
+                       int opt_level, bool is_debug, bool use_lld,
+                       CodeGenContext *ctx) {
   if (!ensure_directory_exists(output_dir)) {
     fprintf(stderr, "Failed to create object directory: %s\n", output_dir);
     return false;
@@ -269,35 +539,110 @@ bool link_object_files(const char *output_dir, const char *executable_name,
   collect_link_flags(ctx, lib_flags, sizeof(lib_flags),
                      object_files, sizeof(object_files));
 
+  // Link exactly the objects of this build. The output directory doubles as
+  // the object cache, so it can hold objects of modules that are gone.
+  LTOMode lto_mode = ctx ? ctx->lto_mode : LTO_NONE;
+  size_t objects_size = strlen(output_dir) + sizeof(LTO_OBJECT_NAME) + 8;
+  for (ModuleCompilationUnit *unit = ctx ? ctx->modules : NULL; unit;
+       unit = unit->next)
+    objects_size += strlen(output_dir) + strlen(unit->module_name) + 8;
+  char *module_objects = malloc(objects_size);
+  if (!module_objects) {
+    fprintf(stderr, "Out of memory listing the objects to link\n");
+    return false;
+  }
+  module_objects[0] = '\0';
+  if (lto_mode == LTO_FULL) {
+    snprintf(module_objects, objects_size, " %s/%s.o", output_dir,
+             LTO_OBJECT_NAME);
+  } else {
+    size_t used = 0;
+    for (ModuleCompilationUnit *unit = ctx ? ctx->modules : NULL; unit;
+         unit = unit->next)
+      used += (size_t)snprintf(module_objects + used, objects_size - used,
+                               " %s/%s%s", output_dir, unit->module_name,
+                               lto_mode == LTO_THIN ? ".bc" : ".o");
+  }
+
+  // The profile runtime of instrumented builds comes with clang's driver
+  bool profile_generate = ctx && ctx->profile.mode == PGO_GENERATE;
+  if (use_lld && profile_generate) {
+    fprintf(stderr,
+            "-fprofile-generate links through clang, using the system linker\n");
+  } else if (use_lld) {
+#if defined(LUMA_EMBEDDED_LLD) && defined(__linux__)
+    // lld consumes the flag strings, so hand it copies for the fallback
+    char *lld_module_objects = malloc(objects_size);
+    char lld_lib_flags[sizeof(lib_flags)], lld_object_files[sizeof(object_files)];
+    memcpy(lld_lib_flags, lib_flags, sizeof(lib_flags));
+    memcpy(lld_object_files, object_files, sizeof(object_files));
+    bool linked = false;
+    if (lld_module_objects) {
+      memcpy(lld_module_objects, module_objects, objects_size);
+      linked = link_in_process(executable_name, opt_level, lto_mode,
+                               lld_module_objects, lld_lib_flags,
+                               lld_object_files);
+      free(lld_module_objects);
+    }
+    if (linked) {
+      free(module_objects);
+      return true;
+    }
+    fprintf(stderr, "In-process link failed, retrying with the system linker\n");
+#else
+    fprintf(stderr, "Built without embedded lld, using the system linker\n");
+#endif
+  }
+
   // Resolve linker: $CC > clang > cc
   const char *linker = getenv("CC");
   if (!linker || linker[0] == '\0') {
     linker = (system("clang --version > /dev/null 2>&1") == 0) ? "clang" : "cc";
   }
 
-  char command[4096];
-  const char *debug_flags = is_debug ? " -g" : "";
+  // Bitcode inputs need an LTO-capable driver; lld runs the ThinLTO backends
+  if ((lto_mode == LTO_THIN || profile_generate) && !getenv("CC")) {
+    linker = "clang";
+  }
+
+  char driver_flags[96];
+  snprintf(driver_flags, sizeof(driver_flags), "%s%s%s", is_debug ? " -g" : "",
+           lto_mode == LTO_THIN ? " -flto=thin -fuse-ld=lld" : "",
+           profile_generate ? " -fprofile-generate" : "");
+
+  // Room for the pieces below plus the fixed flags between them
+  size_t command_size = strlen(linker) + strlen(driver_flags) +
+                        strlen(module_objects) + strlen(object_files) +
+                        strlen(executable_name) + strlen(lib_flags) + 64;
+  char *command = malloc(command_size);
+  if (!command) {
+    fprintf(stderr, "Out of memory building the link command\n");
+    free(module_objects);
+    return false;
+  }
 
 #if defined(__APPLE__)
   if (opt_level > 0) {
-    snprintf(command, sizeof(command), "%s%s -O%d %s/*.o%s -o %s -lSystem%s",
-             linker, debug_flags, opt_level, output_dir, object_files, executable_name, lib_flags);
+    snprintf(command, command_size, "%s%s -O%d%s%s -o %s -lSystem%s",
+             linker, driver_flags, opt_level, module_objects, object_files, executable_name, lib_flags);
   } else {
-    snprintf(command, sizeof(command), "%s%s %s/*.o%s -o %s -lSystem%s",
-             linker, debug_flags, output_dir, object_files, executable_name, lib_flags);
+    snprintf(command, command_size, "%s%s%s%s -o %s -lSystem%s",
+             linker, driver_flags, module_objects, object_files, executable_name, lib_flags);
   }
 
 #else
   if (opt_level > 0) {
-    snprintf(command, sizeof(command), "%s%s -O%d -pie %s/*.o%s -o %s%s",
-             linker, debug_flags, opt_level, output_dir, object_files, executable_name, lib_flags);
+    snprintf(command, command_size, "%s%s -O%d -pie%s%s -o %s%s",
+             linker, driver_flags, opt_level, module_objects, object_files, executable_name, lib_flags);
   } else {
-    snprintf(command, sizeof(command), "%s%s -pie %s/*.o%s -o %s%s",
-             linker, debug_flags, output_dir, object_files, executable_name, lib_flags);
+    snprintf(command, command_size, "%s%s -pie%s%s -o %s%s",
+             linker, driver_flags, module_objects, object_files, executable_name, lib_flags);
   }
 #endif
 
   int result = system(command);
+  free(command);
+  free(module_objects);
 
   if (result != 0) {
     fprintf(stderr, "Primary linking failed with exit code %d\n", result);
@@ -310,62 +655,61 @@ bool link_object_files(const char *output_dir, const char *executable_name,
   return true;
 }
 
+// The absolute form of path in allocator, or path itself when it can't be
+// resolved
+static const char *absolute_path(const char *path,
+                                 ArenaAllocator *allocator) {
+  char abs_path[4096];
+#ifndef _WIN32
+  if (realpath(path, abs_path))
+    return arena_strdup(allocator, abs_path);
+#else
+  if (_fullpath(abs_path, path, sizeof(abs_path)))
+    return arena_strdup(allocator, abs_path);
+#endif
+  return path;
+}
+
+// Lexer output (token text, lexer diagnostics and the stream itself) goes in
+// token_arena, which the caller frees once the file's diagnostics have been
+// reported; the AST and everything it points to go in allocator.
 Stmt *parse_file_to_module(const char *path, size_t position,
-                           ArenaAllocator *allocator, BuildConfig *config) {
+                           ArenaAllocator *allocator,
+                           ArenaAllocator *token_arena, BuildConfig *config) {
   // Resolve the path if it's a std/ import
   const char *resolved_path = resolve_import_path(path, allocator);
   if (!resolved_path) {
     return NULL;
   }
 
-  const char *source = read_file(resolved_path);
+  // The source manager keeps the text loaded for the whole build, so token
+  // value pointers stay valid for error reporting, static analysis, etc.
+  const char *source = source_open(resolved_path, NULL);
   if (!source) {
     fprintf(stderr, "Failed to read source file: %s\n", resolved_path);
     return NULL;
   }
 
-  // Copy source into arena so token value pointers remain valid for the
-  // lifetime of the module (error reporting, static analysis, etc.)
-  {
-    const char *tmp = source;
-    source = arena_strdup(allocator, source);
-    free((void *)tmp);
-  }
-
-  Lexer lexer;
-  init_lexer(&lexer, source, allocator);
+  // The parser pulls tokens from the lexer as it goes; only the line table
+  // outlives parsing, for diagnostics in later passes
+  uint64_t parse_start = trace_now_us();
 
-  GrowableArray tokens;
-  if (!growable_array_init(&tokens, allocator, MAX_TOKENS, sizeof(Token))) {
-    fprintf(stderr, "Failed to initialize token array for %s.\n",
-            resolved_path);
+  TokenStream *stream = arena_alloc(token_arena, sizeof(TokenStream),
+                                    alignof(TokenStream));
+  if (!stream || !token_stream_init(stream, source, token_arena)) {
+    fprintf(stderr, "Failed to lex %s.\n", resolved_path);
     return NULL;
   }
 
-  Token tk;
-  while ((tk = next_token(&lexer)).type_ != TOK_EOF) {
-    Token *slot = (Token *)growable_array_push(&tokens);
-    if (!slot) {
-      fprintf(stderr, "Out of memory while growing token array\n");
-      return NULL;
-    }
-    *slot = tk;
-  }
-
-  if (error_report()) {
-    return NULL;
+  AstNode *program_root = parse_stream(stream, allocator, config);
+  if (program_root) {
+    token_stream_finish(stream);
   }
+  trace_complete("Lex + Parse", "frontend", resolved_path, parse_start);
 
-  // Temporarily update config for parsing
-  GrowableArray old_tokens = config->tokens;
-  size_t old_count = config->token_count;
-
-  config->tokens = tokens;
-  config->token_count = tokens.count;
-
-  AstNode *program_root = parse(&tokens, allocator, config);
-
-  if (!program_root) {
+  // parse_stream() reports the errors that stop it; lexer errors it got past
+  // are reported here
+  if (!program_root || error_report()) {
     return NULL;
   }
 
@@ -375,35 +719,23 @@ Stmt *parse_file_to_module(const char *path, size_t position,
     Stmt *module = (Stmt *)program_root->stmt.program.modules[0];
 
     if (module && module->type == AST_PREPROCESSOR_MODULE) {
+      // The line table outlives the token arena, for diagnostics in later
+      // passes
+      LineTable *lines = line_table_copy(&stream->lines, allocator);
+      if (!lines)
+        return NULL;
       module->preprocessor.module.potions = position;
-      module->preprocessor.module.tokens = (Token *)tokens.data;
-      module->preprocessor.module.token_count = tokens.count;
+      module->preprocessor.module.lines = lines;
+      module->preprocessor.module.token_digest = stream->digest;
+      module->preprocessor.module.token_position_digest =
+          stream->position_digest;
     }
 
-    char abs_path[4096];
-    const char *file_path_to_store = resolved_path;
-
-#ifndef _WIN32
-    if (realpath(resolved_path, abs_path)) {
-      file_path_to_store = arena_strdup(allocator, abs_path);
-    }
-#else
-    if (_fullpath(abs_path, resolved_path, sizeof(abs_path))) {
-      file_path_to_store = arena_strdup(allocator, abs_path);
-    }
-#endif
-
-    module->preprocessor.module.file_path = file_path_to_store;
-
-    // Restore config
-    config->tokens = old_tokens;
-    config->token_count = old_count;
-
+    module->preprocessor.module.file_path =
+        absolute_path(resolved_path, allocator);
     return module;
   }
 
-  config->tokens = old_tokens;
-  config->token_count = old_count;
   return NULL;
 }
 
@@ -415,54 +747,285 @@ AstNode *lex_and_parse_file(const char *path, ArenaAllocator *allocator,
     return NULL;
   }
 
-  const char *source = read_file(resolved_path);
+  const char *source = source_open(resolved_path, NULL);
   if (!source) {
     fprintf(stderr, "Failed to read source file: %s\n", resolved_path);
     return NULL;
   }
 
-  Lexer lexer;
-  init_lexer(&lexer, source, allocator);
-
-  GrowableArray tokens;
-  if (!growable_array_init(&tokens, allocator, MAX_TOKENS, sizeof(Token))) {
-    fprintf(stderr, "Failed to initialize token array for %s.\n",
-            resolved_path);
-    free((void *)source);
+  TokenBuffer tokens;
+  if (!token_buffer_lex(&tokens, source, allocator)) {
+    fprintf(stderr, "Failed to lex %s.\n", resolved_path);
     return NULL;
   }
 
-  Token tk;
-  while ((tk = next_token(&lexer)).type_ != TOK_EOF) {
-    Token *slot = (Token *)growable_array_push(&tokens);
-    if (!slot) {
-      fprintf(stderr, "Out of memory while growing token array\n");
-      free((void *)source);
-      return NULL;
-    }
-    *slot = tk;
-  }
-
   if (error_report()) {
-    free((void *)source);
     return NULL;
   }
 
   AstNode *root = parse(&tokens, allocator, config);
   print_ast(root, "", false, false);
 
-  free((void *)source);
   return root;
 }
 
+// One input file of the build. Each file is read, lexed and parsed into its
+// own arenas with its own copy of the config (parse_file_to_module swaps the
+// token array in it), so files can be handled on separate threads.
+typedef struct {
+  const char *path;
+  size_t position;
+  ArenaAllocator arena;       // The module's AST, kept for the whole build
+  ArenaAllocator token_arena; // Lexer output, freed after parsing
+  BuildConfig config;
+  ErrorBuffer errors;
+  Stmt *module;
+  bool skip; // -doc: its page is current, so it isn't parsed
+  StdInterfaceChoice interface; // A std file's current interface, if any
+} ParseTask;
+
+typedef struct {
+  ParseTask *tasks;
+  size_t task_count;
+  atomic_size_t next_task;
+} ParseQueue;
+
+static void *parse_worker(void *arg) {
+  ParseQueue *queue = (ParseQueue *)arg;
+
+  for (;;) {
+    size_t index = atomic_fetch_add(&queue->next_task, 1);
+    if (index >= queue->task_count)
+      break;
+
+    ParseTask *task = &queue->tasks[index];
+    if (task->skip)
+      continue;
+    error_begin_capture(&task->errors);
+    const char *interface_path = task->interface.interface_path;
+    task->module = parse_file_to_module(
+        interface_path ? interface_path : task->path, task->position,
+        &task->arena, &task->token_arena, &task->config);
+    if (task->module && interface_path)
+      adopt_std_interface(task->module, &task->interface);
+    error_end_capture();
+  }
+
+  return NULL;
+}
+
+static void *parse_thread(void *arg) {
+  trace_set_thread_name("parse worker");
+  return parse_worker(arg);
+}
+
+// Lexes and parses every task, using up to get_compile_thread_count()
+// threads. Diagnostics stay staged in each task until the caller flushes them.
+static void parse_files_parallel(ParseTask *tasks, size_t task_count) {
+  ParseQueue queue = {.tasks = tasks, .task_count = task_count};
+  atomic_init(&queue.next_task, 0);
+
+  size_t thread_count = get_compile_thread_count();
+  if (thread_count > task_count)
+    thread_count = task_count;
+
+  // The calling thread works the queue too
+  pthread_t *threads = NULL;
+  size_t started = 0;
+  if (thread_count > 1) {
+    threads = xmalloc(sizeof(pthread_t) * (thread_count - 1));
+    for (size_t i = 0; i < thread_count - 1; i++) {
+      if (pthread_create(&threads[started], NULL, parse_thread, &queue) != 0)
+        break;
+      started++;
+    }
+  }
+
+  parse_worker(&queue);
+
+  for (size_t i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+}
+
+// --mem-stats: bytes the build's arenas have reserved, phase by phase. A
+// phase's peak counts every arena alive at its end, scratch included; its
+// live count is what remains once the scratch arenas are freed, which is
+// what the next phase starts from.
+#define MEM_STATS_MAX_PHASES 4
+
+typedef struct {
+  const char *phase;
+  size_t peak;
+  size_t live;
+} PhaseMemory;
+
+typedef struct {
+  PhaseMemory phases[MEM_STATS_MAX_PHASES];
+  size_t count;
+} MemStats;
+
+// Bytes reserved by the shared arena and every file's AST arena, plus the
+// token arenas if they haven't been freed yet
+static size_t build_arena_bytes(ArenaAllocator *allocator, ParseTask *tasks,
+                                size_t task_count) {
+  size_t total = arena_get_total_allocated(allocator);
+  for (size_t i = 0; i < task_count; i++) {
+    total += arena_get_total_allocated(&tasks[i].arena);
+    total += arena_get_total_allocated(&tasks[i].token_arena);
+  }
+  return total;
+}
+
+static void mem_stats_record(MemStats *stats, const char *phase, size_t peak,
+                             size_t live) {
+  if (stats->count < MEM_STATS_MAX_PHASES)
+    stats->phases[stats->count++] = (PhaseMemory){phase, peak, live};
+}
+
+static void mem_stats_print(const MemStats *stats) {
+  printf("Memory by phase (arena bytes reserved):\n");
+  for (size_t i = 0; i < stats->count; i++) {
+    const PhaseMemory *p = &stats->phases[i];
+    printf("  %-12s peak %9.2f MB   live %9.2f MB\n", p->phase,
+            (double)p->peak / (1024 * 1024), (double)p->live / (1024 * 1024));
+  }
+#ifndef _WIN32
+  // Includes what LLVM allocates, which the arenas don't see
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+    double peak_rss = (double)usage.ru_maxrss; // bytes
+#else
+    double peak_rss = (double)usage.ru_maxrss * 1024; // kilobytes
+#endif
+    printf("  Peak RSS     %14.2f MB\n", peak_rss / (1024 * 1024));
+  }
+#endif
+}
+
+// `-doc`: a page per module, skipping the files whose page is current
+// (see doc_manifest_lookup) without parsing them. Nothing is typechecked;
+// a page only shows declarations as written.
+static bool run_documentation(BuildConfig config, ArenaAllocator *allocator,
+                              CompileTimer *timer) {
+  int total_stages = 4;
+  int step = 0;
+  bool success = false;
+
+  DocGenConfig doc_config = create_doc_config(allocator, "docs");
+  doc_config.include_private = false; // Only document public APIs
+  DocManifest *manifest = doc_manifest_load(doc_config);
+
+  // Stage 1: Lexing
+  print_progress_with_time(++step, total_stages, "Lexing", timer);
+
+  // Imported files first, the main file last, matching module positions
+  size_t task_count = config.file_count + 1;
+  ParseTask *tasks = xcalloc(task_count, sizeof(ParseTask));
+  DocModule *modules = xcalloc(task_count, sizeof(DocModule));
+  char **files_array = (char **)config.files.data;
+  for (size_t i = 0; i < task_count; i++) {
+    ParseTask *task = &tasks[i];
+    task->path = i < config.file_count ? files_array[i] : config.filepath;
+    task->position = i;
+    task->config = config;
+
+    // Parsing reads the file through the same source manager, so hashing
+    // it first costs no extra read
+    const char *resolved = resolve_import_path(task->path, allocator);
+    size_t length = 0;
+    const char *source = resolved ? source_open(resolved, &length) : NULL;
+    modules[i].path = task->path;
+    if (source) {
+      modules[i].source_hash =
+          cache_hash_bytes(14695981039346656037ull, source, length);
+      modules[i].module_name = doc_manifest_lookup(
+          manifest, task->path, modules[i].source_hash);
+    }
+    task->skip = modules[i].module_name != NULL;
+    if (!task->skip) {
+      arena_allocator_init(&task->arena, 256 * 1024);
+      arena_allocator_init(&task->token_arena, 64 * 1024);
+    }
+  }
+
+  uint64_t frontend_start = trace_now_us();
+  parse_files_parallel(tasks, task_count);
+  trace_complete("Lex and parse", "frontend", NULL, frontend_start);
+
+  // Stage 2: Parsing
+  print_progress_with_time(++step, total_stages, "Parsing", timer);
+
+  for (size_t i = 0; i < task_count; i++) {
+    ParseTask *task = &tasks[i];
+    if (task->skip)
+      continue;
+    error_flush_buffer(&task->errors);
+    if (error_report() || !task->module)
+      goto cleanup;
+    modules[i].module = (AstNode *)task->module;
+  }
+
+  print_progress_with_time(++step, total_stages, "Generating Documentation",
+                           timer);
+  success = generate_module_pages(modules, task_count, doc_config);
+
+  if (success) {
+    print_progress_with_time(++step, total_stages, "Completed", timer);
+    timer_stop(timer);
+
+    if (timer->elapsed_ms < 1000.0) {
+      printf("Documentation generated successfully! (%.0fms)\n",
+             timer->elapsed_ms);
+    } else {
+      printf("Documentation generated successfully! (%.2fs)\n",
+             timer->elapsed_ms / 1000.0);
+    }
+  } else {
+    fprintf(stderr, "Failed to generate documentation\n");
+  }
+
+cleanup:
+  for (size_t i = 0; i < task_count; i++) {
+    free(tasks[i].errors.items);
+    arena_destroy(&tasks[i].token_arena);
+    arena_destroy(&tasks[i].arena);
+  }
+  free(tasks);
+  free(modules);
+  doc_manifest_free(manifest);
+  return success;
+}
+
 bool run_build(BuildConfig config, ArenaAllocator *allocator) {
   bool success = false;
-  int total_stages =
-      config.is_document ? 4 : 10; // Fewer stages for doc generation
+  int total_stages = 10;
   int step = 0;
 
   CompileTimer timer;
   timer_start(&timer);
+  set_progress_enabled(!config.jit_run);
+
+  if (config.time_trace && !trace_init(config.time_trace)) {
+    fprintf(stderr, "Invalid --time-trace output path\n");
+    return false;
+  }
+  uint64_t build_start = trace_now_us();
+
+  ParseTask *parse_tasks = NULL;
+  size_t parse_task_count = 0;
+  MemStats mem = {0};
+
+  // Scopes, symbol tables and memory analyzer state: nothing after the
+  // typechecker reads them, so they are freed before codegen
+  ArenaAllocator scope_arena = {0};
+
+  if (config.is_document) {
+    success = run_documentation(config, allocator, &timer);
+    goto cleanup;
+  }
 
   GrowableArray modules;
   if (!growable_array_init(&modules, allocator, 16, sizeof(AstNode *))) {
@@ -472,31 +1035,69 @@ bool run_build(BuildConfig config, ArenaAllocator *allocator) {
   // Stage 1: Lexing
   print_progress_with_time(++step, total_stages, "Lexing", &timer);
 
-  for (size_t i = 0; i < config.file_count; i++) {
-    char **files_array = (char **)config.files.data;
+  // Imported files first, the main file last, matching module positions
+  parse_task_count = config.file_count + 1;
+  parse_tasks = xcalloc(parse_task_count, sizeof(ParseTask));
+  char **files_array = (char **)config.files.data;
+  for (size_t i = 0; i < parse_task_count; i++) {
+    ParseTask *task = &parse_tasks[i];
+    task->path = i < config.file_count ? files_array[i] : config.filepath;
+    task->position = i;
+    task->config = config;
+    arena_allocator_init(&task->arena, 256 * 1024);
+    arena_allocator_init(&task->token_arena, 64 * 1024);
+  }
+
+  // Std files that haven't changed since their interface was written are
+  // parsed from it, which skips lexing and parsing their bodies. A std/ path
+  // that doesn't resolve is left for the parse to report.
+  const char **paths = xcalloc(parse_task_count, sizeof(char *));
+  StdInterfaceChoice *interfaces =
+      xcalloc(parse_task_count, sizeof(StdInterfaceChoice));
+  for (size_t i = 0; i < parse_task_count; i++) {
+    const char *path = parse_tasks[i].path;
+    char resolved[1024];
+    if (strncmp(path, "std/", 4) == 0 || strncmp(path, "std\\", 4) == 0)
+      path = resolve_std_path(path, resolved, sizeof(resolved)) ? resolved
+                                                                 : NULL;
+    paths[i] = path ? absolute_path(path, allocator) : NULL;
+  }
+  choose_std_interfaces(paths, parse_task_count, &config, interfaces,
+                        allocator);
+  for (size_t i = 0; i < parse_task_count; i++)
+    parse_tasks[i].interface = interfaces[i];
+  free(interfaces);
+  free(paths);
+
+  uint64_t frontend_start = trace_now_us();
+  parse_files_parallel(parse_tasks, parse_task_count);
+  trace_complete("Lex and parse", "frontend", NULL, frontend_start);
 
-    Stmt *module = parse_file_to_module(files_array[i], i, allocator, &config);
-    if (!module || error_report())
+  // Stage 2: Parsing
+  print_progress_with_time(++step, total_stages, "Parsing", &timer);
+
+  // Report in file order so diagnostics don't depend on thread scheduling;
+  // like a sequential build, stop at the first file that failed.
+  for (size_t i = 0; i < parse_task_count; i++) {
+    ParseTask *task = &parse_tasks[i];
+    error_flush_buffer(&task->errors);
+    if (error_report() || !task->module)
       goto cleanup;
 
     AstNode **slot = (AstNode **)growable_array_push(&modules);
     if (!slot)
       goto cleanup;
-    *slot = (AstNode *)module;
+    *slot = (AstNode *)task->module;
   }
 
-  // Stage 2: Parsing
-  print_progress_with_time(++step, total_stages, "Parsing", &timer);
-
-  Stmt *main_module = parse_file_to_module(config.filepath, config.file_count,
-                                           allocator, &config);
-  if (!main_module || error_report())
-    goto cleanup;
-
-  AstNode **main_slot = (AstNode **)growable_array_push(&modules);
-  if (!main_slot)
-    goto cleanup;
-  *main_slot = (AstNode *)main_module;
+  // Every diagnostic pointing into lexer output has been reported, and the
+  // AST holds copies of what it needs
+  size_t parse_peak =
+      build_arena_bytes(allocator, parse_tasks, parse_task_count);
+  for (size_t i = 0; i < parse_task_count; i++)
+    arena_destroy(&parse_tasks[i].token_arena);
+  mem_stats_record(&mem, "Lex + Parse", parse_peak,
+                   build_arena_bytes(allocator, parse_tasks, parse_task_count));
 
   // Stage 3: Combining modules
   print_progress_with_time(++step, total_stages, "Module Combination", &timer);
@@ -506,48 +1107,31 @@ bool run_build(BuildConfig config, ArenaAllocator *allocator) {
   if (!combined_program)
     goto cleanup;
 
-  // CHECK FOR DOCUMENTATION MODE
-  if (config.is_document) {
-    print_progress_with_time(++step, total_stages, "Generating Documentation",
-                             &timer);
-
-    // Create documentation configuration
-    DocGenConfig doc_config = create_doc_config(allocator, "docs");
-    doc_config.include_private = false; // Only document public APIs
-
-    // Generate documentation
-    success = generate_documentation(combined_program, doc_config);
-
-    if (success) {
-      print_progress_with_time(++step, total_stages, "Completed", &timer);
-      timer_stop(&timer);
-
-      if (timer.elapsed_ms < 1000.0) {
-        printf("Documentation generated successfully! (%.0fms)\n",
-               timer.elapsed_ms);
-      } else {
-        printf("Documentation generated successfully! (%.2fs)\n",
-               timer.elapsed_ms / 1000.0);
-      }
-    } else {
-      fprintf(stderr, "Failed to generate documentation\n");
-    }
-
-    goto cleanup;
-  }
-
   // Stage 4: Typechecking
   print_progress_with_time(++step, total_stages, "Typechecking", &timer);
 
   Scope root_scope;
-  init_scope(&root_scope, NULL, "global", allocator);
-  bool tc = typecheck(combined_program, &root_scope, allocator, &config);
+  arena_allocator_init(&scope_arena, 256 * 1024);
+  init_scope(&root_scope, NULL, "global", &scope_arena);
+  uint64_t typecheck_start = trace_now_us();
+  bool tc = instantiate_generics(combined_program, allocator);
+  tc = resolve_prebuilt_std_modules(combined_program, &config, allocator) &&
+       tc && typecheck(combined_program, &root_scope, allocator, &config);
+  trace_complete("Typecheck", "frontend", NULL, typecheck_start);
   if (error_report()) {
     goto cleanup;
   } else {
     ++step;
   }
 
+  // The AST keeps the types the typechecker recorded; its scopes go now
+  size_t typecheck_live =
+      build_arena_bytes(allocator, parse_tasks, parse_task_count);
+  mem_stats_record(&mem, "Typecheck",
+                   typecheck_live + arena_get_total_allocated(&scope_arena),
+                   typecheck_live);
+  arena_destroy(&scope_arena);
+
   if (tc) {
     // Stage 6: LLVM IR
     print_progress_with_time(++step, total_stages, "LLVM IR", &timer);
@@ -555,8 +1139,17 @@ bool run_build(BuildConfig config, ArenaAllocator *allocator) {
       fprintf(stderr, "ERROR: Invalid program node before codegen\n");
       goto cleanup;
     }
-    success = generate_llvm_code_modules(combined_program, config, allocator,
-                                         &step, &timer);
+    if (config.jit_run) {
+      success = run_llvm_code_jit(combined_program, config, allocator);
+    } else {
+      success = generate_llvm_code_modules(combined_program, config, allocator,
+                                           &step, &timer);
+    }
+    size_t codegen_bytes =
+        build_arena_bytes(allocator, parse_tasks, parse_task_count);
+    mem_stats_record(&mem, "Codegen", codegen_bytes, codegen_bytes);
+    if (config.jit_run)
+      goto cleanup;
   }
 
   // Stage 7: Finalizing
@@ -576,5 +1169,21 @@ bool run_build(BuildConfig config, ArenaAllocator *allocator) {
   }
 
 cleanup:
+  if (trace_enabled()) {
+    trace_complete("Build", "build", config.filepath, build_start);
+    trace_write();
+  }
+
+  if (config.mem_stats)
+    mem_stats_print(&mem);
+
+  // Module ASTs live in the per-file arenas, so they go away last
+  arena_destroy(&scope_arena);
+  for (size_t i = 0; i < parse_task_count; i++) {
+    free(parse_tasks[i].errors.items);
+    arena_destroy(&parse_tasks[i].token_arena);
+    arena_destroy(&parse_tasks[i].arena);
+  }
+  free(parse_tasks);
   return success;
 }
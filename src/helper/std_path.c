@@ -142,4 +142,68 @@ void print_std_search_paths(void) {
   }
 
   fprintf(stderr, "  3. Local:  ./std/\n");
-}
\ No newline at end of file
+}
+// Module file paths are stored absolute (realpath), so roots are compared in
+// the same form; a root that doesn't exist can't contain the file anyway.
+static bool path_is_under_root(const char *path, const char *root) {
+  char canonical[4096];
+#if defined(__MINGW32__) || defined(_WIN32)
+  if (!_fullpath(canonical, root, sizeof(canonical)))
+    return false;
+#else
+  if (!realpath(root, canonical))
+    return false;
+#endif
+
+  size_t len = strlen(canonical);
+  return strncmp(path, canonical, len) == 0 &&
+         (path[len] == '/' || path[len] == '\\');
+}
+
+bool is_std_library_file(const char *path) {
+  if (!path)
+    return false;
+
+  char root[1024];
+  if (get_system_std_path(root, sizeof(root)) && path_is_under_root(path, root))
+    return true;
+  if (get_user_std_path(root, sizeof(root)) && path_is_under_root(path, root))
+    return true;
+
+  snprintf(root, sizeof(root), ".%cstd", PATH_SEPARATOR);
+  return path_is_under_root(path, root);
+}
+
+static bool make_directory(const char *path) {
+#if defined(__MINGW32__) || defined(_WIN32)
+  return CreateDirectoryA(path, NULL) ||
+         GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+  return mkdir(path, 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+bool get_std_cache_path(char *buffer, size_t buffer_size) {
+  const char *override = getenv("LUMA_CACHE_DIR");
+  if (override && override[0] != '\0') {
+    snprintf(buffer, buffer_size, "%s", override);
+    return make_directory(buffer);
+  }
+
+  // Lives beside the user-local std/ so it is always writable:
+  // ~/.luma/cache or %USERPROFILE%\.luma\cache
+  char std_root[1024];
+  if (!get_user_std_path(std_root, sizeof(std_root)))
+    return false;
+
+  char *last = strrchr(std_root, PATH_SEPARATOR);
+  if (!last)
+    return false;
+  *last = '\0';
+
+  if (!make_directory(std_root))
+    return false;
+
+  snprintf(buffer, buffer_size, "%s%ccache", std_root, PATH_SEPARATOR);
+  return make_directory(buffer);
+}
@@ -21,7 +21,9 @@
 #define PATH_SEPARATOR '\\'
 #define PATH_SEPARATOR_STR "\\"
 #else
+#include <errno.h>
 #include <pwd.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #define PATH_SEPARATOR '/'
 #define PATH_SEPARATOR_STR "/"
@@ -71,4 +73,24 @@ bool file_exists(const char *path);
  * @return Pointer to the normalized path (within the input string)
  */
 const char *normalize_std_import(const char *path);
-void print_std_search_paths(void);
\ No newline at end of file
+void print_std_search_paths(void);
+
+/**
+ * @brief Check whether a resolved file path lies inside a std search path
+ *
+ * @param path Absolute path of a module source file
+ * @return true if the file belongs to the standard library
+ */
+bool is_std_library_file(const char *path);
+
+/**
+ * @brief Get (and create) the directory holding precompiled std interfaces
+ *
+ * Defaults to ~/.luma/cache, or %USERPROFILE%\.luma\cache on Windows. The
+ * LUMA_CACHE_DIR environment variable overrides it.
+ *
+ * @param buffer Buffer to store the path
+ * @param buffer_size Size of the buffer
+ * @return true if the directory exists or was created, false otherwise
+ */
+bool get_std_cache_path(char *buffer, size_t buffer_size);
\ No newline at end of file
@@ -14,14 +14,13 @@
 #include "../c_libs/error/error.h"
 #include "../c_libs/memory/memory.h"
 #include "lexer.h"
+#include "lexer_hash.h"
+#include "scan.h"
 
 /** @internal Macro to compare string to a key of known length */
 #define STR_EQUALS_LEN(str, key, len)                                          \
   (strncmp(str, key, len) == 0 && key[len] == '\0')
 
-/** @internal Macro to check if next two chars match given pair */
-#define MATCH_NEXT(lx, a, b) (peek(lx, 0) == (a) && peek(lx, 1) == (b))
-
 /** @internal Macro to construct a token */
 #define MAKE_TOKEN(type, start, lx, length, whitespace_len)                    \
   make_token(type, start, lx->line, lx->col - 1, length, whitespace_len)
@@ -95,13 +94,86 @@ static const KeywordEntry preprocessor_directives[] = {
     {"@link", TOK_LINK},
 };
 
+static const KeywordEntry builtins[] = {
+    {"@memcpy", TOK_BUILTIN},   {"@memmove", TOK_BUILTIN},
+    {"@memset", TOK_BUILTIN},   {"@clz", TOK_BUILTIN},
+    {"@ctz", TOK_BUILTIN},      {"@popcount", TOK_BUILTIN},
+    {"@bswap", TOK_BUILTIN},    {"@expect", TOK_BUILTIN},
+    {"@likely", TOK_BUILTIN},   {"@unlikely", TOK_BUILTIN},
+    {"@prefetch", TOK_BUILTIN}, {"@assume", TOK_BUILTIN},
+    {"@rdtsc", TOK_BUILTIN},    {"@black_box", TOK_BUILTIN},
+    {"@wrapping_add", TOK_BUILTIN}, {"@wrapping_sub", TOK_BUILTIN},
+    {"@wrapping_mul", TOK_BUILTIN},
+    {"@atomic_load", TOK_BUILTIN}, {"@atomic_store", TOK_BUILTIN},
+    {"@atomic_rmw", TOK_BUILTIN},  {"@atomic_cas", TOK_BUILTIN},
+    {"@fence", TOK_BUILTIN},
+};
+
 static const KeywordEntry function_attributes[] = {
     {"#returns_ownership", TOK_RETURNES_OWNERSHIP},
     {"#takes_ownership", TOK_TAKES_OWNERSHIP},
     {"#dll_import", TOK_DLL_IMPORT},
     {"#lib_import", TOK_LIB_IMPORT},
+    {"#packed", TOK_PACKED},
+    {"#align", TOK_ALIGN},
+    {"#reorder", TOK_REORDER},
+    {"#unroll", TOK_UNROLL},
+    {"#vectorize", TOK_VECTORIZE},
+    {"#no_vectorize", TOK_NO_VECTORIZE},
+    {"#independent", TOK_INDEPENDENT},
+    {"#inline", TOK_INLINE},
+    {"#noinline", TOK_NOINLINE},
+    {"#hot", TOK_HOT},
+    {"#cold", TOK_COLD},
+    {"#pure", TOK_PURE},
+    {"#const", TOK_CONST_ATTR},
+    {"#flatten", TOK_FLATTEN},
+    {"#musttail", TOK_MUSTTAIL},
 };
 
+/** @internal The slot tables in lexer_hash.h index into the tables above */
+#define TABLE_COUNT(table) (sizeof(table) / sizeof(*(table)))
+_Static_assert(TABLE_COUNT(symbols) == SYMBOL_COUNT &&
+                   TABLE_COUNT(keywords) == KEYWORD_COUNT &&
+                   TABLE_COUNT(preprocessor_directives) == DIRECTIVE_COUNT &&
+                   TABLE_COUNT(function_attributes) == ATTRIBUTE_COUNT,
+               "lexer tables changed: run scripts/gen_lexer_hash.py");
+
+/** @internal Resolves a perfect-hash slot: its entry is the only candidate */
+#define SLOT_LOOKUP(table, slot, str, length, not_found)                       \
+  ((slot) && STR_EQUALS_LEN(str, (table)[(slot) - 1].text, length)             \
+       ? (table)[(slot) - 1].type                                              \
+       : (not_found))
+
+/**
+ * @internal
+ * @brief Copies the line the lexer is on, without its newline.
+ *
+ * Only the current line is looked at, so reporting is independent of how
+ * far into the file the lexer is.
+ */
+static const char *current_line_text(Lexer *lx) {
+  const char *end = lx->current;
+  // advance() steps over the terminator too
+  if (end > lx->src && end[-1] == '\0')
+    end--;
+
+  const char *start = end;
+  while (start > lx->src && start[-1] != '\n')
+    start--;
+  end = scan_line_end(start);
+  if (end > start && end[-1] == '\r')
+    end--;
+
+  size_t length = (size_t)(end - start);
+  char *text = arena_alloc(lx->arena, length + 1, alignof(char));
+  if (!text)
+    return "";
+  memcpy(text, start, length);
+  text[length] = '\0';
+  return text;
+}
+
 /**
  * @brief Adds a lexer error to the global error list.
  *
@@ -109,21 +181,19 @@ static const KeywordEntry function_attributes[] = {
  * @param error_type Description of the error type
  * @param file Source file path
  * @param msg Error message
- * @param line_text Source code line text where error occurred
- * @param line Line number of the error
+ * @param line Line number of the error (the lexer's current line)
  * @param col Column number of the error
  * @param tk_length Length of the token causing the error
  */
 void report_lexer_error(Lexer *lx, const char *error_type, const char *file,
-                        const char *msg, const char *line_text, int line,
-                        int col, int tk_length) {
+                        const char *msg, int line, int col, int tk_length) {
   ErrorInformation err = {
       .error_type = error_type,
       .file_path = file,
-      .message = msg,
+      .message = arena_strdup(lx->arena, msg),
       .line = line,
       .col = col,
-      .line_text = arena_strdup(lx->arena, line_text),
+      .line_text = current_line_text(lx),
       .token_length = tk_length,
       .label = "Undefined Token",
       .note = NULL,
@@ -132,73 +202,60 @@ void report_lexer_error(Lexer *lx, const char *error_type, const char *file,
   error_add(err);
 }
 
-/**
- * @brief Retrieves the text of a specific line from the full source.
- *
- * @param source Full source code string
- * @param target_line Line number to extract (1-based)
- * @return Pointer to static buffer containing the line text
- */
-const char *get_line_text_from_source(const char *source, int target_line) {
-  static char line_buffer[1024];
-  const char *start = source;
-  int current_line = 1;
-
-  while (current_line < target_line && *start != '\0') {
-    if (*start == '\n') {
-      current_line++;
-    }
-    start++;
-  }
-
-  if (current_line != target_line) {
-    line_buffer[0] = '\0';
-    return line_buffer;
-  }
-
-  int i = 0;
-  while (*start != '\0' && *start != '\n' && i < (int)sizeof(line_buffer) - 1) {
-    line_buffer[i++] = *start++;
-  }
-  line_buffer[i] = '\0';
-
-  return line_buffer;
-}
-
 /**
  * @internal
  * @brief Looks up if a string matches a keyword token.
  *
  * @param str Pointer to string to match
- * @param length Length of the string
+ * @param length Length of the string (at least 1)
  * @return LumaTokenType keyword token if found, else TOK_IDENTIFIER
  */
 static LumaTokenType lookup_keyword(const char *str, int length) {
-  for (int i = 0; i < (int)(sizeof(keywords) / sizeof(*keywords)); ++i) {
-    if (STR_EQUALS_LEN(str, keywords[i].text, length)) {
-      return keywords[i].type;
-    }
-  }
-  return TOK_IDENTIFIER;
+  unsigned char slot = keywords_slots[KEYWORD_HASH(str, length)];
+  return SLOT_LOOKUP(keywords, slot, str, length, TOK_IDENTIFIER);
 }
 
 /**
  * @internal
  * @brief Looks up if a string matches a preprocessor directive.
  *
- * @param str Pointer to string to match
- * @param length Length of the string
+ * @param str Pointer to string to match, starting with '@'
+ * @param length Length of the string (at least 2)
  * @return LumaTokenType preprocessor token if found, else TOK_SYMBOL
  */
 static LumaTokenType lookup_preprocessor(const char *str, int length) {
-  for (int i = 0; i < (int)(sizeof(preprocessor_directives) /
-                            sizeof(*preprocessor_directives));
-       ++i) {
-    if (STR_EQUALS_LEN(str, preprocessor_directives[i].text, length)) {
-      return preprocessor_directives[i].type;
-    }
-  }
-  return TOK_SYMBOL;
+  unsigned char slot =
+      preprocessor_directives_slots[DIRECTIVE_HASH(str, length)];
+  return SLOT_LOOKUP(preprocessor_directives, slot, str, length, TOK_SYMBOL);
+}
+
+/**
+ * @internal
+ * @brief Looks up if a string matches a compiler builtin.
+ *
+ * @param str Pointer to string to match, starting with '@'
+ * @param length Length of the string (at least 2)
+ * @return TOK_BUILTIN if found, else TOK_SYMBOL
+ */
+static LumaTokenType lookup_builtin(const char *str, int length) {
+  // The hash reads str[2]; no builtin is shorter than "@clz"
+  if (length < 4)
+    return TOK_SYMBOL;
+  unsigned char slot = builtins_slots[BUILTIN_HASH(str, length)];
+  return SLOT_LOOKUP(builtins, slot, str, length, TOK_SYMBOL);
+}
+
+/**
+ * @internal
+ * @brief Looks up if a string matches a function attribute.
+ *
+ * @param str Pointer to string to match, starting with '#'
+ * @param length Length of the string (at least 2)
+ * @return LumaTokenType attribute token if found, else TOK_SYMBOL
+ */
+static LumaTokenType lookup_attribute(const char *str, int length) {
+  unsigned char slot = function_attributes_slots[ATTRIBUTE_HASH(str, length)];
+  return SLOT_LOOKUP(function_attributes, slot, str, length, TOK_SYMBOL);
 }
 
 /**
@@ -206,16 +263,12 @@ static LumaTokenType lookup_preprocessor(const char *str, int length) {
  * @brief Looks up if a string matches a symbol token.
  *
  * @param str Pointer to string to match
- * @param length Length of the string
+ * @param length Length of the string (at least 1)
  * @return LumaTokenType symbol token if found, else TOK_SYMBOL
  */
 static LumaTokenType lookup_symbol(const char *str, int length) {
-  for (int i = 0; i < (int)(sizeof(symbols) / sizeof(*symbols)); ++i) {
-    if (STR_EQUALS_LEN(str, symbols[i].text, length)) {
-      return symbols[i].type;
-    }
-  }
-  return TOK_SYMBOL;
+  unsigned char slot = symbols_slots[SYMBOL_HASH(str, length)];
+  return SLOT_LOOKUP(symbols, slot, str, length, TOK_SYMBOL);
 }
 
 /**
@@ -271,6 +324,41 @@ char advance(Lexer *lx) {
   return c;
 }
 
+/**
+ * @internal
+ * @brief Advances to end, which must lie on the current line.
+ *
+ * @param lx Pointer to Lexer
+ * @param end Position to continue from
+ */
+static inline void advance_to(Lexer *lx, const char *end) {
+  lx->col += (int)(end - lx->current);
+  lx->current = end;
+}
+
+/**
+ * @internal
+ * @brief Advances to end across any number of lines, keeping line and column
+ * in step with what calling advance() for every character would give.
+ *
+ * @param lx Pointer to Lexer
+ * @param end Position to continue from
+ */
+static void advance_span(Lexer *lx, const char *end) {
+  int newlines = scan_count_newlines(lx->current, end);
+  if (newlines == 0) {
+    advance_to(lx, end);
+    return;
+  }
+
+  const char *line_start = end;
+  while (line_start[-1] != '\n')
+    line_start--;
+  lx->line += newlines;
+  lx->col = (int)(end - line_start);
+  lx->current = end;
+}
+
 /**
  * @brief Constructs a Token object.
  *
@@ -295,14 +383,17 @@ Token make_token(LumaTokenType type, const char *start, int line, int col,
  * @return Number of characters skipped
  */
 int skip_multiline_comment(Lexer *lx) {
-  int count = 0;
+  const char *start = lx->current;
   advance(lx); // skip '/'
   advance(lx); // skip '*'
-  count += 2;
-  while (!is_at_end(lx) && !MATCH_NEXT(lx, '*', '/')) {
-    advance(lx);
-    count++;
-  }
+
+  // Jump from '*' to '*'; only "*/" or the end of input stops
+  const char *end = scan_star(lx->current);
+  while (*end == '*' && end[1] != '/')
+    end = scan_star(end + 1);
+  advance_span(lx, end);
+
+  int count = (int)(lx->current - start);
   if (!is_at_end(lx)) {
     advance(lx); // skip '*'
     advance(lx); // skip '/'
@@ -325,8 +416,9 @@ int skip_whitespace(Lexer *lx) {
 
     if (c == ' ' || c == '\t') {
       // Count spaces and tabs as whitespace
-      advance(lx);
-      whitespace_count++;
+      const char *end = scan_blanks(lx->current);
+      whitespace_count += (int)(end - lx->current);
+      advance_to(lx, end);
     } else if (c == '\n' || c == '\r') {
       // Newline resets whitespace count - we only want leading whitespace
       // on the current line
@@ -339,9 +431,7 @@ int skip_whitespace(Lexer *lx) {
         break;
       }
       // Skip single-line comment
-      while (!is_at_end(lx) && peek(lx, 0) != '\n') {
-        advance(lx);
-      }
+      advance_to(lx, scan_line_end(lx->current));
       // Don't count comment characters as whitespace
     } else if (c == '/' && peek(lx, 1) == '*') {
       // Skip multiline comment
@@ -381,9 +471,7 @@ Token next_token(Lexer *lx) {
 
     // Collect the rest of the line
     const char *content_start = lx->current;
-    while (!is_at_end(lx) && peek(lx, 0) != '\n') {
-      advance(lx);
-    }
+    advance_to(lx, scan_line_end(lx->current));
 
     int content_len = (int)(lx->current - content_start);
     return MAKE_TOKEN(TOK_DOC_COMMENT, content_start, lx, content_len,
@@ -403,9 +491,7 @@ Token next_token(Lexer *lx) {
 
     // Collect the rest of the line
     const char *content_start = lx->current;
-    while (!is_at_end(lx) && peek(lx, 0) != '\n') {
-      advance(lx);
-    }
+    advance_to(lx, scan_line_end(lx->current));
 
     int content_len = (int)(lx->current - content_start);
     return MAKE_TOKEN(TOK_MODULE_DOC, content_start, lx, content_len, wh_count);
@@ -418,21 +504,20 @@ Token next_token(Lexer *lx) {
   if (c == '@') {
     if (isalpha(peek(lx, 0))) {
       // Read the rest of the directive
-      while (isalnum(peek(lx, 0)) || peek(lx, 0) == '_') {
-        advance(lx);
-      }
+      advance_to(lx, scan_identifier(lx->current));
       int len = (int)(lx->current - start);
       LumaTokenType type = lookup_preprocessor(start, len);
+      if (type == TOK_SYMBOL)
+        type = lookup_builtin(start, len);
       if (type != TOK_SYMBOL) {
         return MAKE_TOKEN(type, start, lx, len, wh_count);
       }
-      // If not a known preprocessor directive, treat as error or symbol
-      static char error_msg[64];
+      // If not a known directive or builtin, treat as error or symbol
+      char error_msg[64];
       snprintf(error_msg, sizeof(error_msg),
                "Unknown preprocessor directive: '%.*s'", len, start);
       report_lexer_error(lx, "LexerError", "unknown_file", error_msg,
-                         get_line_text_from_source(lx->src, lx->line), lx->line,
-                         lx->col - len, len);
+                         lx->line, lx->col - len, len);
       return MAKE_TOKEN(TOK_ERROR, start, lx, len, wh_count);
     }
     // Just @ by itself - treat as symbol
@@ -443,25 +528,18 @@ Token next_token(Lexer *lx) {
   if (c == '#') {
     if (isalpha(peek(lx, 0))) {
       // Read the rest of the attribute
-      while (isalnum(peek(lx, 0)) || peek(lx, 0) == '_') {
-        advance(lx);
-      }
+      advance_to(lx, scan_identifier(lx->current));
       int len = (int)(lx->current - start);
-      for (int i = 0; i < (int)(sizeof(function_attributes) /
-                                sizeof(*function_attributes));
-           ++i) {
-        if (STR_EQUALS_LEN(start, function_attributes[i].text, len)) {
-          return MAKE_TOKEN(function_attributes[i].type, start, lx, len,
-                            wh_count);
-        }
+      LumaTokenType type = lookup_attribute(start, len);
+      if (type != TOK_SYMBOL) {
+        return MAKE_TOKEN(type, start, lx, len, wh_count);
       }
       // If not a known function attribute, treat as error
-      static char error_msg[64];
+      char error_msg[64];
       snprintf(error_msg, sizeof(error_msg),
                "Unknown function attribute: '%.*s'", len, start);
       report_lexer_error(lx, "LexerError", "unknown_file", error_msg,
-                         get_line_text_from_source(lx->src, lx->line), lx->line,
-                         lx->col - len, len);
+                         lx->line, lx->col - len, len);
       return MAKE_TOKEN(TOK_ERROR, start, lx, len, wh_count);
     }
     // Just # by itself - treat as symbol
@@ -471,9 +549,7 @@ Token next_token(Lexer *lx) {
 
   // Identifiers and keywords
   if (isalpha(c) || c == '_') {
-    while (isalnum(peek(lx, 0)) || peek(lx, 0) == '_') {
-      advance(lx);
-    }
+    advance_to(lx, scan_identifier(lx->current));
     int len = (int)(lx->current - start);
     LumaTokenType type = lookup_keyword(start, len);
     return MAKE_TOKEN(type, start, lx, len, wh_count);
@@ -490,18 +566,14 @@ Token next_token(Lexer *lx) {
       return MAKE_TOKEN(TOK_NUMBER, start, lx, len, wh_count);
     }
     // Read the integer part
-    while (isdigit(peek(lx, 0))) {
-      advance(lx);
-    }
+    advance_to(lx, scan_digits(lx->current));
 
     // Check for decimal point
     if (peek(lx, 0) == '.' && isdigit(peek(lx, 1))) {
       advance(lx); // consume the '.'
 
       // Read the fractional part
-      while (isdigit(peek(lx, 0))) {
-        advance(lx);
-      }
+      advance_to(lx, scan_digits(lx->current));
 
       int len = (int)(lx->current - start);
       return MAKE_TOKEN(TOK_NUM_FLOAT, start, lx, len,
@@ -521,8 +593,7 @@ Token next_token(Lexer *lx) {
       // Unclosed character literal
       report_lexer_error(lx, "LexerError", "unknown_file",
                          "Unclosed character literal",
-                         get_line_text_from_source(lx->src, lx->line), lx->line,
-                         lx->col - 1, 1);
+                         lx->line, lx->col - 1, 1);
       return MAKE_TOKEN(TOK_ERROR, start, lx, 1, wh_count);
     }
 
@@ -536,7 +607,6 @@ Token next_token(Lexer *lx) {
       if (is_at_end(lx)) {
         report_lexer_error(lx, "LexerError", "unknown_file",
                            "Incomplete escape sequence in character literal",
-                           get_line_text_from_source(lx->src, lx->line),
                            lx->line, lx->col - 2, 2);
         return MAKE_TOKEN(TOK_ERROR, start, lx, 2, wh_count);
       }
@@ -567,12 +637,11 @@ Token next_token(Lexer *lx) {
         actual_char = '\0';
         break;
       default: {
-        static char error_msg[64];
+        char error_msg[64];
         snprintf(error_msg, sizeof(error_msg),
                  "Invalid escape sequence '\\%c' in character literal",
                  escaped);
         report_lexer_error(lx, "LexerError", "unknown_file", error_msg,
-                           get_line_text_from_source(lx->src, lx->line),
                            lx->line, lx->col - 2, 3);
         return MAKE_TOKEN(TOK_ERROR, start, lx, 3, wh_count);
       }
@@ -585,8 +654,7 @@ Token next_token(Lexer *lx) {
       // Empty character literal
       report_lexer_error(lx, "LexerError", "unknown_file",
                          "Empty character literal",
-                         get_line_text_from_source(lx->src, lx->line), lx->line,
-                         lx->col - 1, 2);
+                         lx->line, lx->col - 1, 2);
       advance(lx); // consume closing quote
       return MAKE_TOKEN(TOK_ERROR, start, lx, 2, wh_count);
 
@@ -594,8 +662,7 @@ Token next_token(Lexer *lx) {
       // Newline in character literal
       report_lexer_error(lx, "LexerError", "unknown_file",
                          "Newline in character literal",
-                         get_line_text_from_source(lx->src, lx->line), lx->line,
-                         lx->col - 1, 1);
+                         lx->line, lx->col - 1, 1);
       return MAKE_TOKEN(TOK_ERROR, start, lx, 1, wh_count);
 
     } else {
@@ -609,8 +676,7 @@ Token next_token(Lexer *lx) {
     if (is_at_end(lx) || peek(lx, 0) != '\'') {
       report_lexer_error(lx, "LexerError", "unknown_file",
                          "Unclosed character literal",
-                         get_line_text_from_source(lx->src, lx->line), lx->line,
-                         lx->col - 1, (int)(lx->current - start));
+                         lx->line, lx->col - 1, (int)(lx->current - start));
       return MAKE_TOKEN(TOK_ERROR, start, lx, (int)(lx->current - start),
                         wh_count);
     }
@@ -624,25 +690,27 @@ Token next_token(Lexer *lx) {
     char_storage[0] = actual_char;
     char_storage[1] = '\0';
 
-    return make_token(TOK_CHAR_LITERAL, char_storage, lx->line,
-                      lx->col - total_len, 1,
+    return make_token(TOK_CHAR_LITERAL, char_storage, lx->line, lx->col - total_len, 1,
                       wh_count); // length = 1 (single char)
   }
 
   // Strings
   if (c == '"') {
-    while (!is_at_end(lx) && peek(lx, 0) != '"') {
-      if (peek(lx, 0) == '\\' && !is_at_end(lx)) {
-        advance(lx); // skip backslash
+    // Plain runs are skipped whole; only escapes need a closer look
+    advance_span(lx, scan_string_special(lx->current));
+    while (peek(lx, 0) == '\\') {
+      advance(lx); // skip backslash
+      if (!is_at_end(lx))
         advance(lx); // skip escaped character (could be '"', 'n', etc.)
-      } else {
-        advance(lx);
-      }
+      advance_span(lx, scan_string_special(lx->current));
     }
+    // An unterminated string runs to the end of the source
+    int quotes = 1;
     if (!is_at_end(lx)) {
       advance(lx); // skip closing quote
+      quotes = 2;
     }
-    int len = (int)(lx->current - start - 2);
+    int len = (int)(lx->current - start - quotes);
     return MAKE_TOKEN(TOK_STRING, start + 1, lx, len, wh_count);
   }
 
@@ -673,10 +741,9 @@ Token next_token(Lexer *lx) {
     return MAKE_TOKEN(single_type, start, lx, 1, wh_count);
 
   // Error token if none matched
-  static char error_msg[64];
+  char error_msg[64];
   snprintf(error_msg, sizeof(error_msg), "Token not found: '%c'", c);
   report_lexer_error(lx, "LexerError", "unknown_file", error_msg,
-                     get_line_text_from_source(lx->src, lx->line), lx->line,
-                     lx->col, 1);
+                     lx->line, lx->col, 1);
   return MAKE_TOKEN(TOK_ERROR, start, lx, 1, wh_count);
 }
@@ -10,6 +10,7 @@
 #pragma once
 
 #include "../c_libs/memory/memory.h"
+#include <stdbool.h>
 #include <stdint.h>
 
 /**
@@ -77,12 +78,38 @@ typedef enum {
   TOK_OS,     /**< @os */
   TOK_LINK,   /**< @link */
 
+  // compiler builtins
+  TOK_BUILTIN, /**< @memcpy, @clz, @expect, ... */
+
   // function attibutes
   TOK_RETURNES_OWNERSHIP, /** #returns_ownership */
   TOK_TAKES_OWNERSHIP,    /** #takes_ownership */
   TOK_DLL_IMPORT,         /** #dll_import */
   TOK_LIB_IMPORT,         /** #lib_import */
 
+  // struct layout attributes
+  TOK_PACKED,  /** #packed */
+  TOK_ALIGN,   /** #align */
+  TOK_REORDER, /** #reorder */
+
+  // loop hints
+  TOK_UNROLL,       /** #unroll */
+  TOK_VECTORIZE,    /** #vectorize */
+  TOK_NO_VECTORIZE, /** #no_vectorize */
+  TOK_INDEPENDENT,  /** #independent */
+
+  // function optimization attributes
+  TOK_INLINE,     /** #inline */
+  TOK_NOINLINE,   /** #noinline */
+  TOK_HOT,        /** #hot */
+  TOK_COLD,       /** #cold */
+  TOK_PURE,       /** #pure */
+  TOK_CONST_ATTR, /** #const */
+  TOK_FLATTEN,    /** #flatten */
+
+  // return attributes
+  TOK_MUSTTAIL, /** #musttail */
+
   // Symbols
   TOK_SYMBOL,      /**< Fallback symbol */
   TOK_LPAREN,      /**< ( */
@@ -157,6 +184,79 @@ typedef struct {
   int whitespace_len;  /**< Leading whitespace length before token */
 } Token;
 
+/**
+ * @struct LineTable
+ * @brief Offset of the first byte of every line of a source file.
+ *
+ * Enough to turn an offset into a line and column, and to find the text of a
+ * line for diagnostics, without keeping any tokens.
+ */
+typedef struct {
+  const char *source;
+  size_t length;    /**< Length of source */
+  uint32_t *starts; /**< starts[i] is where 1-based line i + 1 begins */
+  size_t count;
+} LineTable;
+
+/** Stored length of tokens too long for 16 bits; see TokenBuffer */
+#define TOKEN_LENGTH_LONG UINT16_MAX
+
+/** Real length of a token whose stored length is TOKEN_LENGTH_LONG */
+typedef struct {
+  uint32_t index;
+  uint32_t length;
+} TokenLongLength;
+
+/**
+ * @struct TokenBuffer
+ * @brief Structure-of-arrays token storage for one source file.
+ *
+ * A token takes 7 bytes: a 32-bit offset into the source, a 16-bit length
+ * and an 8-bit kind. Line and column aren't stored; token_buffer_get()
+ * derives them from the line table when a Token is needed. Neither
+ * the EOF token nor whitespace_len is kept (materialized tokens report 0;
+ * line text comes from line_table_text() instead).
+ */
+typedef struct {
+  const char *source;
+  uint32_t *offsets; /**< Start of each token's text in source */
+  uint16_t *lengths; /**< Text length (the value of a char literal) */
+  uint8_t *kinds;    /**< LumaTokenType of each token */
+  size_t count;
+  size_t capacity;
+
+  LineTable lines;
+
+  TokenLongLength *long_lengths; /**< Sorted by index */
+  size_t long_count;
+  size_t long_capacity;
+
+  ArenaAllocator *arena;
+} TokenBuffer;
+
+/** Tokens a TokenStream keeps behind its newest one */
+#define TOKEN_STREAM_WINDOW 16
+
+/**
+ * @struct TokenStream
+ * @brief Lexes on demand, keeping only the last TOKEN_STREAM_WINDOW tokens.
+ *
+ * The parser never goes back and looks fewer than TOKEN_STREAM_WINDOW tokens
+ * ahead (type_args_ahead() looks furthest), so it can consume tokens as the
+ * lexer produces them instead of from a buffer holding the whole file. The stream folds every token into digests as it goes, which
+ * stand in for the token list wherever the whole list used to be hashed.
+ */
+typedef struct {
+  Lexer lexer;
+  LineTable lines;
+  Token window[TOKEN_STREAM_WINDOW]; /**< Token i is at i % WINDOW */
+  size_t lexed;                      /**< Tokens produced so far */
+  bool at_end;
+  bool failed; /**< The lexer reported an error; the stream ended there */
+  uint64_t digest;          /**< Kind and text of every token */
+  uint64_t position_digest; /**< Line and column of every token */
+} TokenStream;
+
 /**
  * @struct SymbolEntry
  * @brief Maps symbol text to token type for quick lookup.
@@ -178,27 +278,18 @@ typedef struct {
 /**
  * @brief Reports a lexer error by adding an error to the global error list.
  *
+ * The line text is taken from the lexer's current line.
+ *
  * @param lx Pointer to Lexer
  * @param error_type String describing the type of error
  * @param file File path of the source file
  * @param msg Error message string
- * @param line_text Source code line text where error occurred
  * @param line Line number of error
  * @param col Column number of error
  * @param tk_length Length of the erroneous token
  */
 void report_lexer_error(Lexer *lx, const char *error_type, const char *file,
-                        const char *msg, const char *line_text, int line,
-                        int col, int tk_length);
-
-/**
- * @brief Retrieves the text of a specific line from the source code.
- *
- * @param source Full source code string
- * @param target_line The 1-based line number to extract
- * @return Pointer to static buffer containing the line text
- */
-const char *get_line_text_from_source(const char *source, int target_line);
+                        const char *msg, int line, int col, int tk_length);
 
 /**
  * @brief Initializes the lexer with source code and memory arena.
@@ -216,3 +307,135 @@ void init_lexer(Lexer *lexer, const char *source, ArenaAllocator *arena);
  * @return The next Token found in the input stream
  */
 Token next_token(Lexer *lexer);
+
+/**
+ * @brief Lexes all of @p source into @p buf.
+ *
+ * @param buf Buffer to fill; its arrays are allocated from @p arena
+ * @param source NUL-terminated source text, which must outlive the buffer
+ * @param arena Arena for the token arrays and the lexer
+ * @return false if memory ran out or the source is too large
+ */
+bool token_buffer_lex(TokenBuffer *buf, const char *source,
+                      ArenaAllocator *arena);
+
+/**
+ * @struct TokenRelex
+ * @brief What token_buffer_relex() lexed again.
+ *
+ * Tokens before @c first are the old buffer's, tokens from @c end on are
+ * the old buffer's from @c old_end on with their offsets moved, and the ones
+ * in between are new.
+ */
+typedef struct {
+  size_t first;
+  size_t end;
+  size_t old_end;
+} TokenRelex;
+
+/**
+ * @brief Lexes @p source into @p buf where it differs from the source @p old
+ * was lexed from, copying the tokens on either side of the edit.
+ *
+ * The lexer keeps no state between tokens, so it restarts at the end of an
+ * old token before @p start and stops at the first token that lines up with
+ * an old one past the edit: from there on it would produce the old tokens
+ * again. @p old must have been lexed without errors, since errors are only
+ * reported for what is lexed again.
+ *
+ * @param buf Buffer to fill; its arrays are allocated from @p arena
+ * @param old Tokens of the previous source; only its arrays are read
+ * @param source NUL-terminated new source, which must outlive the buffer
+ * @param start First byte that differs
+ * @param old_end End of the differing bytes in the old source
+ * @param new_end End of the differing bytes in @p source
+ * @param arena Arena for the token arrays and the lexer
+ * @param relexed Receives which tokens are new
+ * @return false if memory ran out or the source is too large
+ */
+bool token_buffer_relex(TokenBuffer *buf, const TokenBuffer *old,
+                        const char *source, size_t start, size_t old_end,
+                        size_t new_end, ArenaAllocator *arena,
+                        TokenRelex *relexed);
+
+/**
+ * @brief Materializes token @p index with its line and column.
+ *
+ * @param buf Lexed token buffer
+ * @param index Token index, below buf->count
+ * @param line_hint Optional 0-based line of the previous lookup; tokens read
+ *                  in order then cost O(1) instead of a binary search
+ * @return The token as next_token() returned it
+ */
+Token token_buffer_get(const TokenBuffer *buf, size_t index,
+                       size_t *line_hint);
+
+/**
+ * @brief Materializes every token of @p buf into one Token array, for
+ * consumers that index tokens with their positions at random (the LSP).
+ *
+ * @return Array of buf->count tokens allocated from @p arena, or NULL
+ */
+Token *token_buffer_expand(const TokenBuffer *buf, ArenaAllocator *arena);
+
+/**
+ * @brief Length of the text of token @p index.
+ */
+int token_buffer_length(const TokenBuffer *buf, size_t index);
+
+/**
+ * @brief Prepares @p stream to lex @p source; no token is lexed yet.
+ *
+ * @param stream Stream to initialize
+ * @param source NUL-terminated source text, which must outlive the stream
+ * @param arena Arena for the lexer and the line table
+ * @return false if memory ran out or the source is too large
+ */
+bool token_stream_init(TokenStream *stream, const char *source,
+                       ArenaAllocator *arena);
+
+/**
+ * @brief Returns token @p index, lexing up to it if needed.
+ *
+ * @param stream Initialized stream
+ * @param index Token index; must not be more than TOKEN_STREAM_WINDOW behind
+ *              the newest token lexed
+ * @return The token, or an EOF token at or past the end of the source
+ */
+Token token_stream_get(TokenStream *stream, size_t index);
+
+/**
+ * @brief Lexes whatever the parser didn't consume, so the digests cover the
+ * whole file.
+ */
+void token_stream_finish(TokenStream *stream);
+
+/**
+ * @brief Builds the line table of @p source.
+ *
+ * @param lines Table to fill; its array is allocated from @p arena
+ * @param source NUL-terminated source text, which must outlive the table
+ * @param length Length of @p source
+ * @param arena Arena for the table
+ * @return false if memory ran out
+ */
+bool line_table_build(LineTable *lines, const char *source, size_t length,
+                      ArenaAllocator *arena);
+
+/**
+ * @brief Copies a line table into @p arena, so it outlives the arena it was
+ * built in.
+ * @return The copy, or NULL if memory ran out
+ */
+LineTable *line_table_copy(const LineTable *lines, ArenaAllocator *arena);
+
+/**
+ * @brief Returns the text of a 1-based source line, without its newline.
+ *
+ * @param lines Line table of the source
+ * @param line 1-based line number
+ * @param length Receives the length of the line
+ * @return Pointer into the source (not NUL-terminated at the line end), or ""
+ *         for a line out of range
+ */
+const char *line_table_text(const LineTable *lines, int line, size_t *length);
@@ -0,0 +1,179 @@
+// lexer_hash.h - Perfect hashes for the lexer's lookup tables
+//
+// Generated by scripts/gen_lexer_hash.py from the tables in lexer.c.
+// Do not edit; rerun the script when a table changes.
+#pragma once
+
+#define SYMBOL_COUNT 41
+#define SYMBOL_HASH_SIZE 128
+#define SYMBOL_HASH(str, len) \
+  (((unsigned)(len) * 1u + (unsigned char)(str)[0] * 2u + \
+    (unsigned char)(str)[(len) - 1] * 11u) & \
+   (SYMBOL_HASH_SIZE - 1))
+
+static const unsigned char symbols_slots[SYMBOL_HASH_SIZE] = {
+    [0] = 8, // ;
+    [6] = 10, // ->
+    [9] = 2, // (
+    [13] = 23, // <
+    [14] = 36, // <<
+    [22] = 3, // )
+    [25] = 14, // <=
+    [26] = 18, // =
+    [27] = 12, // ==
+    [29] = 15, // >=
+    [32] = 6, // [
+    [35] = 21, // *
+    [39] = 24, // >
+    [40] = 37, // >>
+    [46] = 29, // !
+    [48] = 19, // +
+    [49] = 34, // ++
+    [52] = 30, // ?
+    [58] = 7, // ]
+    [61] = 9, // ,
+    [64] = 4, // {
+    [65] = 38, // @
+    [71] = 27, // ^
+    [74] = 20, // -
+    [75] = 35, // --
+    [77] = 26, // |
+    [78] = 17, // ||
+    [84] = 33, // _
+    [87] = 41, // .
+    [88] = 40, // ..
+    [89] = 39, // ...
+    [90] = 5, // }
+    [98] = 1, // %
+    [99] = 13, // !=
+    [100] = 22, // /
+    [103] = 28, // ~
+    [105] = 11, // <-
+    [111] = 25, // &
+    [112] = 16, // &&
+    [115] = 32, // :
+    [116] = 31, // ::
+};
+
+#define KEYWORD_COUNT 38
+#define KEYWORD_HASH_SIZE 128
+#define KEYWORD_HASH(str, len) \
+  (((unsigned)(len) * 1u + (unsigned char)(str)[0] * 22u + \
+    (unsigned char)(str)[(len) - 1] * 19u) & \
+   (KEYWORD_HASH_SIZE - 1))
+
+static const unsigned char keywords_slots[KEYWORD_HASH_SIZE] = {
+    [4] = 8, // struct
+    [9] = 7, // continue
+    [14] = 28, // impl
+    [19] = 25, // defer
+    [20] = 32, // void
+    [26] = 1, // if
+    [28] = 4, // loop
+    [29] = 36, // double
+    [32] = 27, // switch
+    [34] = 22, // cast
+    [35] = 19, // const
+    [37] = 34, // int
+    [39] = 29, // input
+    [40] = 10, // import
+    [44] = 17, // output
+    [49] = 2, // else
+    [50] = 26, // in
+    [52] = 20, // alloc
+    [60] = 18, // outputln
+    [65] = 31, // static
+    [66] = 38, // __syscall__
+    [68] = 3, // elif
+    [71] = 21, // free
+    [72] = 12, // false
+    [73] = 9, // enum
+    [97] = 24, // as
+    [98] = 6, // break
+    [101] = 35, // float
+    [102] = 14, // priv
+    [103] = 15, // let
+    [105] = 13, // pub
+    [111] = 33, // byte
+    [112] = 16, // fn
+    [116] = 37, // bool
+    [122] = 23, // sizeof
+    [123] = 11, // true
+    [124] = 5, // return
+    [127] = 30, // system
+};
+
+#define DIRECTIVE_COUNT 4
+#define DIRECTIVE_HASH_SIZE 4
+#define DIRECTIVE_HASH(str, len) \
+  (((unsigned)(len) * 1u + (unsigned char)(str)[1] * 3u + \
+    (unsigned char)(str)[(len) - 1] * 0u) & \
+   (DIRECTIVE_HASH_SIZE - 1))
+
+static const unsigned char preprocessor_directives_slots[DIRECTIVE_HASH_SIZE] = {
+    [0] = 3, // @os
+    [1] = 4, // @link
+    [2] = 1, // @module
+    [3] = 2, // @use
+};
+
+#define BUILTIN_COUNT 22
+#define BUILTIN_HASH_SIZE 64
+#define BUILTIN_HASH(str, len) \
+  (((unsigned)(len) * 1u + (unsigned char)(str)[2] * 1u + \
+    (unsigned char)(str)[(len) - 1] * 14u) & \
+   (BUILTIN_HASH_SIZE - 1))
+
+static const unsigned char builtins_slots[BUILTIN_HASH_SIZE] = {
+    [0] = 12, // @assume
+    [1] = 20, // @atomic_rmw
+    [4] = 3, // @memset
+    [6] = 14, // @black_box
+    [7] = 19, // @atomic_store
+    [9] = 21, // @atomic_cas
+    [10] = 1, // @memcpy
+    [14] = 9, // @likely
+    [16] = 6, // @popcount
+    [20] = 13, // @rdtsc
+    [21] = 10, // @unlikely
+    [23] = 8, // @expect
+    [25] = 7, // @bswap
+    [27] = 16, // @wrapping_sub
+    [28] = 4, // @clz
+    [36] = 5, // @ctz
+    [39] = 17, // @wrapping_mul
+    [43] = 11, // @prefetch
+    [49] = 22, // @fence
+    [51] = 2, // @memmove
+    [55] = 15, // @wrapping_add
+    [56] = 18, // @atomic_load
+};
+
+#define ATTRIBUTE_COUNT 19
+#define ATTRIBUTE_HASH_SIZE 32
+#define ATTRIBUTE_HASH(str, len) \
+  (((unsigned)(len) * 1u + (unsigned char)(str)[1] * 23u + \
+    (unsigned char)(str)[(len) - 1] * 26u) & \
+   (ATTRIBUTE_HASH_SIZE - 1))
+
+static const unsigned char function_attributes_slots[ATTRIBUTE_HASH_SIZE] = {
+    [2] = 8, // #unroll
+    [3] = 11, // #independent
+    [4] = 14, // #hot
+    [6] = 9, // #vectorize
+    [7] = 4, // #lib_import
+    [9] = 6, // #align
+    [12] = 19, // #musttail
+    [13] = 13, // #noinline
+    [15] = 3, // #dll_import
+    [16] = 1, // #returns_ownership
+    [17] = 10, // #no_vectorize
+    [18] = 15, // #cold
+    [19] = 17, // #const
+    [23] = 16, // #pure
+    [24] = 12, // #inline
+    [26] = 7, // #reorder
+    [28] = 2, // #takes_ownership
+    [30] = 18, // #flatten
+    [31] = 5, // #packed
+};
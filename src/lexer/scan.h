@@ -0,0 +1,220 @@
+/**
+ * @file scan.h
+ * @brief Block-at-a-time scanning of character runs for the lexer.
+ *
+ * Each scan_* function returns the first byte at or after its argument that
+ * ends the run (for identifiers, a non-identifier byte; for line comments, a
+ * newline). The NUL terminator always ends a run. With SSE2 or NEON, 16 bytes
+ * are classified per step; otherwise a scalar loop does the same.
+ *
+ * Vector loads are 16-byte aligned, and a block is only loaded while the
+ * terminator hasn't been seen. An aligned block that holds a valid byte never
+ * crosses a page, so the bytes read past the terminator are never a fault,
+ * even though they are outside the string.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                  \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LUMA_SCAN_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define LUMA_SCAN_NEON 1
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+static inline int scan_ctz(uint64_t x) {
+  unsigned long index;
+  _BitScanForward64(&index, x);
+  return (int)index;
+}
+static inline int scan_popcount(uint64_t x) { return (int)__popcnt64(x); }
+#else
+static inline int scan_ctz(uint64_t x) { return __builtin_ctzll(x); }
+static inline int scan_popcount(uint64_t x) { return __builtin_popcountll(x); }
+#endif
+
+/** @internal Scalar byte classes, also used for the vector-less fallback */
+static inline int scan_is_ident(unsigned char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+static inline int scan_is_blank(unsigned char c) {
+  return c == ' ' || c == '\t';
+}
+static inline int scan_is_digit(unsigned char c) {
+  return c >= '0' && c <= '9';
+}
+
+#if defined(LUMA_SCAN_SSE2) || defined(LUMA_SCAN_NEON)
+
+#define SCAN_BLOCK 16
+
+// Masks have one bit (SSE2) or one nibble (NEON) per byte of a block
+#if defined(LUMA_SCAN_SSE2)
+typedef __m128i scan_vec;
+#define SCAN_BITS_PER_BYTE 1
+
+static inline scan_vec scan_load(const char *p) {
+  return _mm_load_si128((const __m128i *)p);
+}
+static inline scan_vec scan_set(char c) { return _mm_set1_epi8(c); }
+static inline scan_vec scan_eq(scan_vec v, char c) {
+  return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+}
+// Bytes compare signed, so anything >= 0x80 is below every ASCII bound
+static inline scan_vec scan_range(scan_vec v, char lo, char hi) {
+  return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8((char)(lo - 1))),
+                       _mm_cmpgt_epi8(_mm_set1_epi8((char)(hi + 1)), v));
+}
+static inline scan_vec scan_or(scan_vec a, scan_vec b) {
+  return _mm_or_si128(a, b);
+}
+static inline uint64_t scan_mask(scan_vec v) {
+  return (uint64_t)(unsigned)_mm_movemask_epi8(v);
+}
+static inline uint64_t scan_mask_not(scan_vec v) {
+  return scan_mask(v) ^ 0xFFFFu;
+}
+#else
+typedef uint8x16_t scan_vec;
+#define SCAN_BITS_PER_BYTE 4
+
+static inline scan_vec scan_load(const char *p) {
+  return vld1q_u8((const uint8_t *)p);
+}
+static inline scan_vec scan_set(char c) { return vdupq_n_u8((uint8_t)c); }
+static inline scan_vec scan_eq(scan_vec v, char c) {
+  return vceqq_u8(v, vdupq_n_u8((uint8_t)c));
+}
+static inline scan_vec scan_range(scan_vec v, char lo, char hi) {
+  return vandq_u8(vcgeq_u8(v, vdupq_n_u8((uint8_t)lo)),
+                  vcleq_u8(v, vdupq_n_u8((uint8_t)hi)));
+}
+static inline scan_vec scan_or(scan_vec a, scan_vec b) {
+  return vorrq_u8(a, b);
+}
+// NEON has no movemask: narrowing every 16-bit lane by 4 leaves a nibble
+// per byte in a single 64-bit word
+static inline uint64_t scan_mask(scan_vec v) {
+  uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(v), 4);
+  return vget_lane_u64(vreinterpret_u64_u8(narrowed), 0);
+}
+static inline uint64_t scan_mask_not(scan_vec v) {
+  return scan_mask(vmvnq_u8(v));
+}
+#endif
+
+// Stop masks: set for every byte that ends the run
+static inline uint64_t scan_stop_ident(scan_vec v) {
+  scan_vec lower = scan_or(v, scan_set(0x20)); // 'A'-'Z' -> 'a'-'z'
+  scan_vec in = scan_or(scan_or(scan_range(lower, 'a', 'z'),
+                                scan_range(v, '0', '9')),
+                        scan_eq(v, '_'));
+  return scan_mask_not(in);
+}
+static inline uint64_t scan_stop_blank(scan_vec v) {
+  return scan_mask_not(scan_or(scan_eq(v, ' '), scan_eq(v, '\t')));
+}
+static inline uint64_t scan_stop_digit(scan_vec v) {
+  return scan_mask_not(scan_range(v, '0', '9'));
+}
+static inline uint64_t scan_stop_line_end(scan_vec v) {
+  return scan_mask(scan_or(scan_eq(v, '\n'), scan_eq(v, '\0')));
+}
+static inline uint64_t scan_stop_star(scan_vec v) {
+  return scan_mask(scan_or(scan_eq(v, '*'), scan_eq(v, '\0')));
+}
+static inline uint64_t scan_stop_string(scan_vec v) {
+  return scan_mask(
+      scan_or(scan_or(scan_eq(v, '"'), scan_eq(v, '\\')), scan_eq(v, '\0')));
+}
+
+static inline const char *scan_align_down(const char *p) {
+  return (const char *)((uintptr_t)p & ~(uintptr_t)(SCAN_BLOCK - 1));
+}
+
+// Mask of the first n bytes of a block
+static inline uint64_t scan_bytes_below(size_t n) {
+  size_t bits = n * SCAN_BITS_PER_BYTE;
+  return bits >= 64 ? ~0ull : (1ull << bits) - 1;
+}
+
+#define SCAN_DEFINE(name, stop)                                                \
+  static inline const char *name(const char *p) {                             \
+    const char *block = scan_align_down(p);                                    \
+    uint64_t mask = stop(scan_load(block)) &                                   \
+                    ~scan_bytes_below((size_t)(p - block));                    \
+    while (!mask) {                                                            \
+      block += SCAN_BLOCK;                                                     \
+      mask = stop(scan_load(block));                                           \
+    }                                                                          \
+    return block + scan_ctz(mask) / SCAN_BITS_PER_BYTE;                        \
+  }
+
+/**
+ * @brief Counts the newlines in [from, to), a block at a time.
+ */
+static inline int scan_count_newlines(const char *from, const char *to) {
+  int count = 0;
+  for (const char *block = scan_align_down(from); block < to;
+       block += SCAN_BLOCK) {
+    uint64_t mask = scan_mask(scan_eq(scan_load(block), '\n'));
+    if (block < from)
+      mask &= ~scan_bytes_below((size_t)(from - block));
+    if (to - block < SCAN_BLOCK)
+      mask &= scan_bytes_below((size_t)(to - block));
+    count += scan_popcount(mask) / SCAN_BITS_PER_BYTE;
+  }
+  return count;
+}
+
+#else // Scalar fallback
+
+#define SCAN_DEFINE(name, stop)                                                \
+  static inline const char *name(const char *p) {                             \
+    while (!stop((unsigned char)*p))                                           \
+      p++;                                                                     \
+    return p;                                                                  \
+  }
+
+static inline int scan_stop_ident(unsigned char c) { return !scan_is_ident(c); }
+static inline int scan_stop_blank(unsigned char c) { return !scan_is_blank(c); }
+static inline int scan_stop_digit(unsigned char c) { return !scan_is_digit(c); }
+static inline int scan_stop_line_end(unsigned char c) {
+  return c == '\n' || c == '\0';
+}
+static inline int scan_stop_star(unsigned char c) {
+  return c == '*' || c == '\0';
+}
+static inline int scan_stop_string(unsigned char c) {
+  return c == '"' || c == '\\' || c == '\0';
+}
+
+static inline int scan_count_newlines(const char *from, const char *to) {
+  int count = 0;
+  for (; from < to; from++)
+    count += *from == '\n';
+  return count;
+}
+
+#endif
+
+/** End of a run of [A-Za-z0-9_] */
+SCAN_DEFINE(scan_identifier, scan_stop_ident)
+/** End of a run of spaces and tabs */
+SCAN_DEFINE(scan_blanks, scan_stop_blank)
+/** End of a run of decimal digits */
+SCAN_DEFINE(scan_digits, scan_stop_digit)
+/** Next '\n' (or the terminator) */
+SCAN_DEFINE(scan_line_end, scan_stop_line_end)
+/** Next '*', a candidate end of a block comment */
+SCAN_DEFINE(scan_star, scan_stop_star)
+/** Next '"' or '\\' inside a string literal */
+SCAN_DEFINE(scan_string_special, scan_stop_string)
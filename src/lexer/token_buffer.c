@@ -0,0 +1,422 @@
+/**
+ * @file token_buffer.c
+ * @brief Compact structure-of-arrays token storage with lazy positions.
+ *
+ * A stored token is its source offset, its length and its kind; line and
+ * column are recovered from the file's line-start table only when a Token
+ * is materialized. The positions reproduce exactly what next_token()
+ * reports: most tokens sit on the column of their last consumed byte, char
+ * literals on their opening quote.
+ */
+
+#include <stdalign.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lexer.h"
+#include "scan.h"
+
+// Resolved char literal values: the text of a TOK_CHAR_LITERAL is its one
+// decoded byte (see next_token), which the buffer keeps instead of a length
+#define CHAR_TEXT4(n)                                                          \
+  {(char)(n), 0}, {(char)((n) + 1), 0}, {(char)((n) + 2), 0},                  \
+      {(char)((n) + 3), 0}
+#define CHAR_TEXT16(n)                                                         \
+  CHAR_TEXT4(n), CHAR_TEXT4((n) + 4), CHAR_TEXT4((n) + 8), CHAR_TEXT4((n) + 12)
+#define CHAR_TEXT64(n)                                                         \
+  CHAR_TEXT16(n), CHAR_TEXT16((n) + 16), CHAR_TEXT16((n) + 32),                \
+      CHAR_TEXT16((n) + 48)
+static const char char_literal_text[256][2] = {
+    CHAR_TEXT64(0), CHAR_TEXT64(64), CHAR_TEXT64(128), CHAR_TEXT64(192)};
+
+bool line_table_build(LineTable *lines, const char *source, size_t length,
+                      ArenaAllocator *arena) {
+  const char *end = source + length;
+  size_t count = (size_t)scan_count_newlines(source, end) + 1;
+
+  lines->source = source;
+  lines->length = length;
+  lines->starts = arena_alloc(arena, count * sizeof(uint32_t), alignof(uint32_t));
+  if (!lines->starts)
+    return false;
+
+  size_t line = 0;
+  lines->starts[line++] = 0;
+  for (const char *p = source; (p = memchr(p, '\n', (size_t)(end - p))) != NULL;)
+    lines->starts[line++] = (uint32_t)(++p - source);
+
+  lines->count = count;
+  return true;
+}
+
+LineTable *line_table_copy(const LineTable *lines, ArenaAllocator *arena) {
+  LineTable *copy = arena_alloc(arena, sizeof(LineTable), alignof(LineTable));
+  if (!copy)
+    return NULL;
+  *copy = *lines;
+  copy->starts =
+      arena_alloc(arena, lines->count * sizeof(uint32_t), alignof(uint32_t));
+  if (!copy->starts)
+    return NULL;
+  memcpy(copy->starts, lines->starts, lines->count * sizeof(uint32_t));
+  return copy;
+}
+
+/**
+ * @internal
+ * @brief Doubles the token arrays. The old arrays stay in the arena, so the
+ * initial capacity is sized from the source to make this rare.
+ */
+static bool grow_tokens(TokenBuffer *buf) {
+  size_t capacity = buf->capacity * 2;
+  uint32_t *offsets =
+      arena_alloc(buf->arena, capacity * sizeof(uint32_t), alignof(uint32_t));
+  uint16_t *lengths =
+      arena_alloc(buf->arena, capacity * sizeof(uint16_t), alignof(uint16_t));
+  uint8_t *kinds = arena_alloc(buf->arena, capacity, 1);
+  if (!offsets || !lengths || !kinds)
+    return false;
+
+  memcpy(offsets, buf->offsets, buf->count * sizeof(uint32_t));
+  memcpy(lengths, buf->lengths, buf->count * sizeof(uint16_t));
+  memcpy(kinds, buf->kinds, buf->count);
+  buf->offsets = offsets;
+  buf->lengths = lengths;
+  buf->kinds = kinds;
+  buf->capacity = capacity;
+  return true;
+}
+
+static bool push_long_length(TokenBuffer *buf, size_t index, int length) {
+  if (buf->long_count == buf->long_capacity) {
+    size_t capacity = buf->long_capacity ? buf->long_capacity * 2 : 8;
+    TokenLongLength *grown = arena_alloc(
+        buf->arena, capacity * sizeof(TokenLongLength), alignof(TokenLongLength));
+    if (!grown)
+      return false;
+    if (buf->long_count)
+      memcpy(grown, buf->long_lengths,
+             buf->long_count * sizeof(TokenLongLength));
+    buf->long_lengths = grown;
+    buf->long_capacity = capacity;
+  }
+  buf->long_lengths[buf->long_count++] =
+      (TokenLongLength){(uint32_t)index, (uint32_t)length};
+  return true;
+}
+
+static bool push_token(TokenBuffer *buf, const Token *tk) {
+  if (buf->count == buf->capacity && !grow_tokens(buf))
+    return false;
+
+  size_t index = buf->count++;
+  buf->kinds[index] = (uint8_t)tk->type_;
+
+  if (tk->type_ == TOK_CHAR_LITERAL) {
+    // The value lives in the lexer's arena, but the quote is at the reported
+    // column of the reported line
+    buf->offsets[index] = buf->lines.starts[tk->line - 1] + (uint32_t)tk->col;
+    buf->lengths[index] = (unsigned char)tk->value[0];
+    return true;
+  }
+
+  buf->offsets[index] = (uint32_t)(tk->value - buf->source);
+  if (tk->length < TOKEN_LENGTH_LONG) {
+    buf->lengths[index] = (uint16_t)tk->length;
+    return true;
+  }
+  buf->lengths[index] = TOKEN_LENGTH_LONG;
+  return push_long_length(buf, index, tk->length);
+}
+
+/**
+ * @internal
+ * @brief Sets @p buf up for @p source: the line table, and token arrays
+ * with room for @p capacity tokens.
+ */
+static bool buffer_begin(TokenBuffer *buf, const char *source,
+                         size_t source_length, size_t capacity,
+                         ArenaAllocator *arena) {
+  *buf = (TokenBuffer){.source = source, .arena = arena};
+
+  if (source_length >= UINT32_MAX) {
+    fprintf(stderr, "Source file is too large (4 GiB or more)\n");
+    return false;
+  }
+  if (!line_table_build(&buf->lines, source, source_length, arena))
+    return false;
+
+  buf->capacity = capacity;
+  buf->offsets = arena_alloc(arena, buf->capacity * sizeof(uint32_t),
+                             alignof(uint32_t));
+  buf->lengths = arena_alloc(arena, buf->capacity * sizeof(uint16_t),
+                             alignof(uint16_t));
+  buf->kinds = arena_alloc(arena, buf->capacity, 1);
+  return buf->offsets && buf->lengths && buf->kinds;
+}
+
+bool token_buffer_lex(TokenBuffer *buf, const char *source,
+                      ArenaAllocator *arena) {
+  size_t source_length = strlen(source);
+
+  // About one token per five bytes of typical source
+  if (!buffer_begin(buf, source, source_length, source_length / 5 + 64,
+                    arena))
+    return false;
+
+  Lexer lexer;
+  init_lexer(&lexer, source, arena);
+
+  Token tk;
+  while ((tk = next_token(&lexer)).type_ != TOK_EOF) {
+    if (!push_token(buf, &tk)) {
+      fprintf(stderr, "Out of memory while growing token buffer\n");
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @internal
+ * @brief Finds the 0-based line holding @p offset, trying the hinted line and
+ * the one after it before a binary search. Parsing walks tokens in order, so
+ * the hint almost always hits.
+ */
+static size_t line_index(const LineTable *lines, uint32_t offset,
+                         size_t *hint) {
+  const uint32_t *starts = lines->starts;
+  size_t last = lines->count - 1;
+  size_t h = hint ? *hint : 0;
+
+  if (h <= last && starts[h] <= offset) {
+    if (h == last || offset < starts[h + 1])
+      return h;
+    if (h + 1 == last || offset < starts[h + 2]) {
+      if (hint)
+        *hint = h + 1;
+      return h + 1;
+    }
+  }
+
+  size_t lo = 0, hi = last;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo + 1) / 2;
+    if (starts[mid] <= offset)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  if (hint)
+    *hint = lo;
+  return lo;
+}
+
+int token_buffer_length(const TokenBuffer *buf, size_t index) {
+  if (buf->kinds[index] == TOK_CHAR_LITERAL)
+    return 1;
+  if (buf->lengths[index] != TOKEN_LENGTH_LONG)
+    return buf->lengths[index];
+
+  size_t lo = 0, hi = buf->long_count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (buf->long_lengths[mid].index < index)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return (int)buf->long_lengths[lo].length;
+}
+
+/**
+ * @internal
+ * @brief Bytes past the end of a token the lexer may look at to decide where
+ * the token ends (a number before "..", a symbol before a longer one)
+ */
+#define RELEX_LOOKAHEAD 4
+
+/**
+ * @internal
+ * @brief Where the lexer stands once it has produced token @p index: past
+ * the closing quote of a string. A char literal keeps its value rather than
+ * its length, so its end isn't known.
+ */
+static bool token_end(const TokenBuffer *buf, size_t index, size_t *end) {
+  LumaTokenType type = (LumaTokenType)buf->kinds[index];
+  if (type == TOK_CHAR_LITERAL)
+    return false;
+  *end = buf->offsets[index] + (size_t)token_buffer_length(buf, index) +
+         (type == TOK_STRING ? 1 : 0);
+  return true;
+}
+
+/**
+ * @internal
+ * @brief Appends tokens [from, old->count) of @p old, moved by @p shift
+ * bytes.
+ */
+static bool copy_tail(TokenBuffer *buf, const TokenBuffer *old, size_t from,
+                      ptrdiff_t shift) {
+  size_t count = old->count - from;
+  while (buf->count + count > buf->capacity) {
+    if (!grow_tokens(buf))
+      return false;
+  }
+
+  size_t base = buf->count;
+  for (size_t i = 0; i < count; i++)
+    buf->offsets[base + i] =
+        (uint32_t)((ptrdiff_t)old->offsets[from + i] + shift);
+  memcpy(buf->lengths + base, old->lengths + from, count * sizeof(uint16_t));
+  memcpy(buf->kinds + base, old->kinds + from, count);
+  buf->count += count;
+
+  for (size_t i = 0; i < old->long_count; i++) {
+    const TokenLongLength *entry = &old->long_lengths[i];
+    if (entry->index >= from &&
+        !push_long_length(buf, base + (entry->index - from),
+                         (int)entry->length))
+      return false;
+  }
+  return true;
+}
+
+bool token_buffer_relex(TokenBuffer *buf, const TokenBuffer *old,
+                        const char *source, size_t start, size_t old_end,
+                        size_t new_end, ArenaAllocator *arena,
+                        TokenRelex *relexed) {
+  size_t source_length = strlen(source);
+  size_t capacity = old->count + 64;
+  if (new_end > old_end)
+    capacity += (new_end - old_end) / 5;
+  if (!buffer_begin(buf, source, source_length, capacity, arena))
+    return false;
+
+  // Keep the old tokens that end far enough before the edit that none of
+  // the bytes the lexer looked at past them has changed
+  size_t lo = 0, hi = old->count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (old->offsets[mid] < start)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  size_t kept = lo, resume = 0;
+  while (kept > 0) {
+    size_t end;
+    if (token_end(old, kept - 1, &end) && end + RELEX_LOOKAHEAD <= start) {
+      resume = end;
+      break;
+    }
+    kept--;
+  }
+
+  if (kept) {
+    memcpy(buf->offsets, old->offsets, kept * sizeof(uint32_t));
+    memcpy(buf->lengths, old->lengths, kept * sizeof(uint16_t));
+    memcpy(buf->kinds, old->kinds, kept);
+    buf->count = kept;
+    for (size_t i = 0; i < old->long_count && old->long_lengths[i].index < kept;
+         i++) {
+      if (!push_long_length(buf, old->long_lengths[i].index,
+                            (int)old->long_lengths[i].length))
+        return false;
+    }
+  }
+  *relexed = (TokenRelex){kept, 0, 0};
+
+  Lexer lexer;
+  init_lexer(&lexer, source, arena);
+  size_t line = line_index(&buf->lines, (uint32_t)resume, NULL);
+  lexer.current = source + resume;
+  lexer.line = (int)line + 1;
+  lexer.col = (int)(resume - buf->lines.starts[line]);
+
+  // A token past the edit at the same place, of the same kind and length as
+  // an old one, leaves the lexer where it was after that old token
+  ptrdiff_t shift = (ptrdiff_t)new_end - (ptrdiff_t)old_end;
+  size_t match = hi;
+  Token tk;
+  while ((tk = next_token(&lexer)).type_ != TOK_EOF) {
+    if (!push_token(buf, &tk)) {
+      fprintf(stderr, "Out of memory while growing token buffer\n");
+      return false;
+    }
+
+    size_t index = buf->count - 1;
+    if (buf->offsets[index] < new_end)
+      continue;
+    size_t target = (size_t)((ptrdiff_t)buf->offsets[index] - shift);
+    while (match < old->count && old->offsets[match] < target)
+      match++;
+    if (match < old->count && old->offsets[match] == target &&
+        old->kinds[match] == buf->kinds[index] &&
+        old->lengths[match] == buf->lengths[index] &&
+        token_buffer_length(old, match) == token_buffer_length(buf, index)) {
+      relexed->end = index;
+      relexed->old_end = match;
+      return copy_tail(buf, old, match + 1, shift);
+    }
+  }
+
+  relexed->end = buf->count;
+  relexed->old_end = old->count;
+  return true;
+}
+
+Token token_buffer_get(const TokenBuffer *buf, size_t index,
+                       size_t *line_hint) {
+  LumaTokenType type = (LumaTokenType)buf->kinds[index];
+  uint32_t offset = buf->offsets[index];
+  Token tk = {.type_ = type};
+
+  if (type == TOK_CHAR_LITERAL) {
+    size_t line = line_index(&buf->lines, offset, line_hint);
+    tk.value = char_literal_text[buf->lengths[index]];
+    tk.length = 1;
+    tk.line = (int)line + 1;
+    tk.col = (int)(offset - buf->lines.starts[line]);
+    return tk;
+  }
+
+  tk.value = buf->source + offset;
+  tk.length = token_buffer_length(buf, index);
+
+  // The lexer reports the line and column of the last byte it consumed;
+  // string values exclude the closing quote, which is consumed too
+  uint32_t end = offset + (uint32_t)tk.length + (type == TOK_STRING ? 1 : 0);
+  size_t line = line_index(&buf->lines, end, line_hint);
+  tk.line = (int)line + 1;
+  tk.col = (int)(end - buf->lines.starts[line]) - 1;
+  return tk;
+}
+
+const char *line_table_text(const LineTable *lines, int line, size_t *length) {
+  if (line < 1 || (size_t)line > lines->count) {
+    *length = 0;
+    return "";
+  }
+
+  const char *start = lines->source + lines->starts[line - 1];
+  const char *end = (size_t)line < lines->count
+                        ? lines->source + lines->starts[line] - 1
+                        : lines->source + lines->length;
+  if (end > start && end[-1] == '\r')
+    end--;
+  *length = (size_t)(end - start);
+  return start;
+}
+
+Token *token_buffer_expand(const TokenBuffer *buf, ArenaAllocator *arena) {
+  Token *tokens =
+      arena_alloc(arena, (buf->count + 1) * sizeof(Token), alignof(Token));
+  if (!tokens)
+    return NULL;
+
+  size_t hint = 0;
+  for (size_t i = 0; i < buf->count; i++)
+    tokens[i] = token_buffer_get(buf, i, &hint);
+  return tokens;
+}
@@ -0,0 +1,93 @@
+/**
+ * @file token_stream.c
+ * @brief On-demand lexing for the parser with a small window of lookahead.
+ *
+ * Tokens are produced as the parser asks for them and overwritten once they
+ * fall TOKEN_STREAM_WINDOW behind, so memory for tokens stays constant no
+ * matter how large the file is and the lexer's output is consumed while it
+ * is still in cache.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "lexer.h"
+
+#define STREAM_FNV_OFFSET 0xcbf29ce484222325ULL
+#define STREAM_FNV_PRIME 0x100000001b3ULL
+
+static uint64_t stream_hash_bytes(uint64_t hash, const void *data,
+                                  size_t length) {
+  const unsigned char *bytes = data;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= bytes[i];
+    hash *= STREAM_FNV_PRIME;
+  }
+  return hash;
+}
+
+static uint64_t stream_hash_u64(uint64_t hash, uint64_t value) {
+  return stream_hash_bytes(hash, &value, sizeof(value));
+}
+
+bool token_stream_init(TokenStream *stream, const char *source,
+                       ArenaAllocator *arena) {
+  size_t source_length = strlen(source);
+  memset(stream, 0, sizeof(*stream));
+  stream->digest = STREAM_FNV_OFFSET;
+  stream->position_digest = STREAM_FNV_OFFSET;
+
+  if (source_length >= UINT32_MAX) {
+    fprintf(stderr, "Source file is too large (4 GiB or more)\n");
+    return false;
+  }
+  if (!line_table_build(&stream->lines, source, source_length, arena))
+    return false;
+
+  init_lexer(&stream->lexer, source, arena);
+  return true;
+}
+
+/**
+ * @internal
+ * @brief Lexes one more token into the window, or marks the end.
+ *
+ * A file with lexer errors is never parsed when it is lexed up front. To
+ * report the same errors, the first error token lexes the rest of the file
+ * (so every lexer error is reported) and ends the stream there.
+ */
+static void stream_lex_one(TokenStream *stream) {
+  Token tk = next_token(&stream->lexer);
+  if (tk.type_ == TOK_ERROR) {
+    stream->failed = true;
+    while (next_token(&stream->lexer).type_ != TOK_EOF)
+      ;
+  }
+  if (tk.type_ == TOK_EOF || tk.type_ == TOK_ERROR) {
+    stream->at_end = true;
+    return;
+  }
+
+  stream->digest = stream_hash_u64(stream->digest, (uint64_t)tk.type_);
+  stream->digest = stream_hash_u64(stream->digest, (uint64_t)tk.length);
+  stream->digest = stream_hash_bytes(stream->digest, tk.value, (size_t)tk.length);
+  stream->position_digest = stream_hash_u64(
+      stream->position_digest, ((uint64_t)tk.line << 32) | (uint32_t)tk.col);
+
+  stream->window[stream->lexed % TOKEN_STREAM_WINDOW] = tk;
+  stream->lexed++;
+}
+
+Token token_stream_get(TokenStream *stream, size_t index) {
+  while (index >= stream->lexed && !stream->at_end)
+    stream_lex_one(stream);
+
+  if (index >= stream->lexed || index + TOKEN_STREAM_WINDOW < stream->lexed)
+    return (Token){.type_ = TOK_EOF};
+  return stream->window[index % TOKEN_STREAM_WINDOW];
+}
+
+void token_stream_finish(TokenStream *stream) {
+  while (!stream->at_end)
+    stream_lex_one(stream);
+}
@@ -0,0 +1,163 @@
+// jit.cpp - `luma run`: execute a program in-process with ORC
+//
+// The modules are handed to an LLLazyJIT, which splits them so each function
+// is only optimized and compiled the first time it is called; a short run
+// pays for the code it executes and nothing else. Symbols that no module
+// defines are resolved from the @link libraries and then from the compiler
+// process itself (libc). The C API has no lazy JIT, hence this shim.
+#include "llvm-c/Core.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/TargetSelect.h"
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+static bool jit_check(llvm::Error err, const char *what) {
+  if (!err)
+    return true;
+  fprintf(stderr, "JIT: %s: %s\n", what,
+          llvm::toString(std::move(err)).c_str());
+  return false;
+}
+
+// Same default<On> pipeline as ahead-of-time builds, run per partition as
+// it is materialized
+static void optimize_partition(llvm::Module &module, int opt_level) {
+  llvm::OptimizationLevel level = opt_level == 1   ? llvm::OptimizationLevel::O1
+                                  : opt_level == 2 ? llvm::OptimizationLevel::O2
+                                                   : llvm::OptimizationLevel::O3;
+
+  llvm::LoopAnalysisManager lam;
+  llvm::FunctionAnalysisManager fam;
+  llvm::CGSCCAnalysisManager cgam;
+  llvm::ModuleAnalysisManager mam;
+
+  llvm::PassBuilder builder;
+  builder.registerModuleAnalyses(mam);
+  builder.registerCGSCCAnalyses(cgam);
+  builder.registerFunctionAnalyses(fam);
+  builder.registerLoopAnalyses(lam);
+  builder.crossRegisterProxies(lam, fam, cgam, mam);
+
+  builder.buildPerModuleDefaultPipeline(level).run(module, mam);
+}
+
+static std::unique_ptr<llvm::orc::LLJIT> create_jit(bool lazy,
+                                                    llvm::orc::LLLazyJIT **lazy_jit) {
+  *lazy_jit = nullptr;
+  if (lazy) {
+    auto jit = llvm::orc::LLLazyJITBuilder().create();
+    if (jit) {
+      *lazy_jit = jit->get();
+      return std::move(*jit);
+    }
+    // No lazy call-through support for this target: compile eagerly
+    llvm::consumeError(jit.takeError());
+  }
+
+  auto jit = llvm::orc::LLJITBuilder().create();
+  if (!jit) {
+    jit_check(jit.takeError(), "failed to create JIT");
+    return nullptr;
+  }
+  return std::move(*jit);
+}
+
+extern "C" bool jit_run_modules(LLVMContextRef context, LLVMModuleRef *modules,
+                                size_t module_count, const char **objects,
+                                size_t object_count, const char **libraries,
+                                size_t library_count, int opt_level, bool lazy,
+                                int argc, char **argv, int *exit_code) {
+  // Take ownership first so everything is released on every return path
+  llvm::orc::ThreadSafeContext tsc(
+      std::unique_ptr<llvm::LLVMContext>(llvm::unwrap(context)));
+  std::vector<std::unique_ptr<llvm::Module>> owned;
+  for (size_t i = 0; i < module_count; i++)
+    owned.emplace_back(llvm::unwrap(modules[i]));
+
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+
+  llvm::orc::LLLazyJIT *lazy_jit = nullptr;
+  std::unique_ptr<llvm::orc::LLJIT> jit = create_jit(lazy, &lazy_jit);
+  if (!jit)
+    return false;
+
+  if (opt_level > 0) {
+    jit->getIRTransformLayer().setTransform(
+        [opt_level](llvm::orc::ThreadSafeModule tsm,
+                    const llvm::orc::MaterializationResponsibility &)
+            -> llvm::Expected<llvm::orc::ThreadSafeModule> {
+          tsm.withModuleDo(
+              [opt_level](llvm::Module &m) { optimize_partition(m, opt_level); });
+          return std::move(tsm);
+        });
+  }
+
+  llvm::orc::JITDylib &dylib = jit->getMainJITDylib();
+  char prefix = jit->getDataLayout().getGlobalPrefix();
+
+  // @link libraries come before the process so they win, like at link time.
+  // One that can't be opened (e.g. a linker script) may still be covered by
+  // what the process already has loaded, so it only warns.
+  for (size_t i = 0; i < library_count; i++) {
+    auto generator =
+        llvm::orc::DynamicLibrarySearchGenerator::Load(libraries[i], prefix);
+    if (!generator) {
+      fprintf(stderr, "JIT: warning: cannot load %s: %s\n", libraries[i],
+              llvm::toString(generator.takeError()).c_str());
+      continue;
+    }
+    dylib.addGenerator(std::move(*generator));
+  }
+
+  auto process =
+      llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(prefix);
+  if (!process) {
+    jit_check(process.takeError(), "failed to expose process symbols");
+    return false;
+  }
+  dylib.addGenerator(std::move(*process));
+
+  for (size_t i = 0; i < object_count; i++) {
+    auto buffer = llvm::MemoryBuffer::getFile(objects[i]);
+    if (!buffer) {
+      fprintf(stderr, "JIT: cannot read %s: %s\n", objects[i],
+              buffer.getError().message().c_str());
+      return false;
+    }
+    if (!jit_check(jit->addObjectFile(dylib, std::move(*buffer)), objects[i]))
+      return false;
+  }
+
+  for (std::unique_ptr<llvm::Module> &module : owned) {
+    std::string name = module->getName().str();
+    llvm::orc::ThreadSafeModule tsm(std::move(module), tsc);
+    llvm::Error err = lazy_jit ? lazy_jit->addLazyIRModule(std::move(tsm))
+                               : jit->addIRModule(std::move(tsm));
+    if (!jit_check(std::move(err), name.c_str()))
+      return false;
+  }
+
+  if (!jit_check(jit->initialize(dylib), "static initialization failed"))
+    return false;
+
+  auto main_symbol = jit->lookup("main");
+  if (!main_symbol) {
+    jit_check(main_symbol.takeError(), "no 'main' function");
+    return false;
+  }
+
+  auto *main_fn = main_symbol->toPtr<int (*)(int, char **)>();
+  *exit_code = main_fn(argc, argv);
+  fflush(stdout);
+
+  return jit_check(jit->deinitialize(dylib), "static destruction failed");
+}
@@ -1,8 +1,12 @@
 // Enhanced llvm.c - Module system implementation
 #include "../llvm.h"
+#include "../../c_libs/trace/trace.h"
+#include <llvm-c/BitReader.h>
 #include <llvm-c/Linker.h>
 #include <llvm-c/TargetMachine.h>
+#include <llvm-c/Transforms/PassBuilder.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <sys/stat.h>
 
@@ -24,6 +28,16 @@ typedef struct {
   ModuleCompilationUnit *module;
   const char *output_dir;
   bool is_debug;
+  int opt_level;
+  const char *pass_pipeline;
+  LTOMode lto_mode;         // LTO_THIN writes bitcode instead of an object
+  const ProfileOptions *profile;
+  uint64_t cache_key;       // 0 when the object cache is disabled
+  // The module's IR moved out of the shared context as bitcode, so the
+  // worker can optimize it in a context of its own. NULL emits the module in
+  // place, which only a build without workers does.
+  LLVMMemoryBufferRef bitcode;
+  bool load_failed; // The bitcode didn't load; emit in place after the build
   bool success;
   double compile_time;
 } ModuleCompileTask;
@@ -49,7 +63,7 @@ static size_t detect_cpu_count(void) {
   return 0; // Detection failed
 }
 
-static size_t get_compile_thread_count(void) {
+size_t get_compile_thread_count(void) {
   // Check environment variable first
   const char *env_threads = getenv("LUMA_COMPILE_THREADS");
   if (env_threads) {
@@ -81,72 +95,154 @@ static bool create_output_directory(const char *path) {
   return true; // Already exists
 }
 
-static LLVMTargetMachineRef create_target_machine(bool is_debug) {
-  (void)is_debug; // Reserved for future LLVM C API debug info support
-  char *target_triple = LLVMGetDefaultTargetTriple();
+static LLVMCodeGenOptLevel codegen_level_for(int opt_level) {
+  switch (opt_level) {
+  case 0:
+    return LLVMCodeGenLevelNone;
+  case 1:
+    return LLVMCodeGenLevelLess;
+  case 3:
+    return LLVMCodeGenLevelAggressive;
+  default:
+    return LLVMCodeGenLevelDefault;
+  }
+}
+
+// Target description shared by every module of a build. Resolving the triple
+// and querying the host CPU is comparatively expensive, so it happens once per
+// build and each worker creates its TargetMachine from this.
+typedef struct {
+  char *triple;
+  char *cpu;
+  char *features;
+  char *data_layout;
   LLVMTargetRef target;
-  char *error = NULL;
+  LLVMCodeModel code_model;
+} TargetSpec;
+
+static LLVMTargetMachineRef create_target_machine(const TargetSpec *spec,
+                                                  int opt_level) {
+  return LLVMCreateTargetMachine(spec->target, spec->triple, spec->cpu,
+                                 spec->features, codegen_level_for(opt_level),
+                                 LLVMRelocPIC, spec->code_model);
+}
+
+static void target_spec_dispose(TargetSpec *spec) {
+  if (spec->triple)
+    LLVMDisposeMessage(spec->triple);
+  if (spec->cpu)
+    LLVMDisposeMessage(spec->cpu);
+  if (spec->features)
+    LLVMDisposeMessage(spec->features);
+  if (spec->data_layout)
+    LLVMDisposeMessage(spec->data_layout);
+  memset(spec, 0, sizeof(*spec));
+}
 
-  if (LLVMGetTargetFromTriple(target_triple, &target, &error)) {
+// Without -march/-mcpu, code has to run on any machine of the target
+// architecture, not just the one that built it: x86-64-v2 (SSE4.2, POPCNT)
+// covers every x86-64 server CPU still in service.
+static const char *default_target_cpu(const char *triple) {
+  if (strncmp(triple, "x86_64", 6) == 0)
+    return "x86-64-v2";
+  return "generic";
+}
+
+static char *join_target_features(const char *base, const char *extra) {
+  if (!extra || !*extra)
+    return LLVMCreateMessage(base ? base : "");
+  if (!base || !*base)
+    return LLVMCreateMessage(extra);
+
+  size_t length = strlen(base) + strlen(extra) + 2;
+  char *joined = xmalloc(length);
+  snprintf(joined, length, "%s,%s", base, extra);
+  char *message = LLVMCreateMessage(joined);
+  free(joined);
+  return message;
+}
+
+static bool target_spec_init(TargetSpec *spec,
+                             const TargetCPUOptions *options) {
+  memset(spec, 0, sizeof(*spec));
+  spec->triple = LLVMGetDefaultTargetTriple();
+
+  char *error = NULL;
+  if (LLVMGetTargetFromTriple(spec->triple, &spec->target, &error)) {
     fprintf(stderr, "Failed to get target: %s\n", error);
     LLVMDisposeMessage(error);
-    LLVMDisposeMessage(target_triple);
-    return NULL;
+    target_spec_dispose(spec);
+    return false;
   }
 
-  const char *cpu_name = "generic";
-  const char *cpu_features = "";
-
-#if !defined(__APPLE__)
-  char *host_cpu = LLVMGetHostCPUName();
-  char *host_features = LLVMGetHostCPUFeatures();
-  if (host_cpu && strlen(host_cpu) > 0) {
-    cpu_name = host_cpu;
-  }
-  if (host_features && strlen(host_features) > 0) {
-    cpu_features = host_features;
+  const char *cpu = options && options->cpu ? options->cpu
+                    : options && options->arch ? options->arch
+                                               : NULL;
+  const char *extra_features = options ? options->features : NULL;
+
+  if (cpu && strcmp(cpu, "native") == 0) {
+    // Tuned for the build machine; may not run anywhere else
+    spec->cpu = LLVMGetHostCPUName();
+    char *host_features = LLVMGetHostCPUFeatures();
+    spec->features = join_target_features(host_features, extra_features);
+    LLVMDisposeMessage(host_features);
+    if (!spec->cpu || strlen(spec->cpu) == 0) {
+      LLVMDisposeMessage(spec->cpu);
+      spec->cpu = LLVMCreateMessage("generic");
+    }
+  } else {
+    spec->cpu = LLVMCreateMessage(cpu ? cpu : default_target_cpu(spec->triple));
+    spec->features = join_target_features(NULL, extra_features);
   }
-#else
-  cpu_name = "generic";
-  cpu_features = "";
-#endif
-
-#if defined(__APPLE__)
-  LLVMCodeModel code_model = LLVMCodeModelDefault;
-#else
-  LLVMCodeModel code_model = LLVMCodeModelSmall;
-#endif
-
-  LLVMTargetMachineRef machine = LLVMCreateTargetMachine(
-      target, target_triple, cpu_name, cpu_features,
-      LLVMCodeGenLevelNone, // Fast compilation, no optimization
-      LLVMRelocPIC, code_model);
 
 #if !defined(__APPLE__)
-  LLVMDisposeMessage(host_cpu);
-  LLVMDisposeMessage(host_features);
+  spec->code_model = LLVMCodeModelSmall;
+#else
+  spec->code_model = LLVMCodeModelDefault;
 #endif
-  LLVMDisposeMessage(target_triple);
-
-  return machine;
-}
-
-static bool set_module_target(LLVMModuleRef module,
-                              LLVMTargetMachineRef machine) {
-  char *target_triple = LLVMGetDefaultTargetTriple();
-  LLVMSetTarget(module, target_triple);
 
+  // The data layout only depends on the target, so one throwaway machine is
+  // enough to compute it for the whole build.
+  LLVMTargetMachineRef machine = create_target_machine(spec, 0);
+  if (!machine) {
+    fprintf(stderr, "Failed to create target machine for %s\n", spec->triple);
+    target_spec_dispose(spec);
+    return false;
+  }
   LLVMTargetDataRef target_data = LLVMCreateTargetDataLayout(machine);
-  char *data_layout = LLVMCopyStringRepOfTargetData(target_data);
-  LLVMSetDataLayout(module, data_layout);
-
+  spec->data_layout = LLVMCopyStringRepOfTargetData(target_data);
   LLVMDisposeTargetData(target_data);
-  LLVMDisposeMessage(data_layout);
-  LLVMDisposeMessage(target_triple);
+  LLVMDisposeTargetMachine(machine);
 
   return true;
 }
 
+// The processor is also recorded on every definition, like clang does, so
+// backends that only see the bitcode (ThinLTO in lld, the JIT) agree with it
+static void set_module_target(LLVMModuleRef module, const TargetSpec *spec) {
+  LLVMSetTarget(module, spec->triple);
+  LLVMSetDataLayout(module, spec->data_layout);
+
+  LLVMContextRef context = LLVMGetModuleContext(module);
+  LLVMAttributeRef cpu = LLVMCreateStringAttribute(
+      context, "target-cpu", 10, spec->cpu, (unsigned)strlen(spec->cpu));
+  LLVMAttributeRef features = NULL;
+  if (*spec->features) {
+    features = LLVMCreateStringAttribute(context, "target-features", 15,
+                                         spec->features,
+                                         (unsigned)strlen(spec->features));
+  }
+
+  for (LLVMValueRef func = LLVMGetFirstFunction(module); func;
+       func = LLVMGetNextFunction(func)) {
+    if (LLVMIsDeclaration(func))
+      continue;
+    LLVMAddAttributeAtIndex(func, LLVMAttributeFunctionIndex, cpu);
+    if (features)
+      LLVMAddAttributeAtIndex(func, LLVMAttributeFunctionIndex, features);
+  }
+}
+
 #ifdef DEBUG_BUILD
 static bool verify_module(LLVMModuleRef module, const char *module_name) {
   char *error = NULL;
@@ -163,33 +259,102 @@ static bool verify_module(LLVMModuleRef module, const char *module_name) {
 }
 #endif
 
-bool generate_module_object_file(ModuleCompilationUnit *module,
-                                 const char *output_path, bool is_debug) {
-  // Create target machine
-  LLVMTargetMachineRef target_machine = create_target_machine(is_debug);
-  if (!target_machine) {
-    fprintf(stderr, "Failed to create target machine for module %s\n",
-            module->module_name);
-    return false;
+/**
+ * Runs the new pass manager pipeline over a module. An explicit pipeline
+ * string (from --passes=) wins over the <kind><On> pipeline picked from the
+ * optimization level, where kind is "default", "lto" or "thinlto-pre-link".
+ * At -O0 with no explicit pipeline nothing is run.
+ */
+static bool optimize_module(ModuleCompilationUnit *module,
+                            LLVMTargetMachineRef target_machine,
+                            int opt_level, const char *pass_pipeline,
+                            const ProfileOptions *profile,
+                            const char *pipeline_kind) {
+  PGOMode pgo_mode = profile ? profile->mode : PGO_NONE;
+  char default_pipeline[64];
+  const char *pipeline = pass_pipeline;
+
+  if (!pipeline || pipeline[0] == '\0') {
+    // Instrumentation is still inserted when nothing is optimized
+    if (opt_level <= 0 && pgo_mode != PGO_GENERATE)
+      return true;
+    int level = opt_level < 0 ? 0 : opt_level > 3 ? 3 : opt_level;
+    if (pgo_mode != PGO_NONE && strcmp(pipeline_kind, "lto") == 0) {
+      // Instrumenting and reading profiles are pre-link work, which the
+      // merged module of a full LTO build hasn't had yet
+      snprintf(default_pipeline, sizeof(default_pipeline),
+               "lto-pre-link<O%d>,lto<O%d>", level, level);
+    } else {
+      snprintf(default_pipeline, sizeof(default_pipeline), "%s<O%d>",
+               pipeline_kind, level);
+    }
+    pipeline = default_pipeline;
   }
 
-  // Set target and data layout
-  if (!set_module_target(module->module, target_machine)) {
-    LLVMDisposeTargetMachine(target_machine);
+  if (pgo_mode != PGO_NONE) {
+    char *msg = NULL;
+    uint64_t start = trace_now_us();
+    bool ok = run_profile_passes(module->module, target_machine, pipeline,
+                                 opt_level, pgo_mode == PGO_GENERATE,
+                                 profile->path, &msg);
+    trace_complete("Optimize", "backend", module->module_name, start);
+
+    if (!ok) {
+      fprintf(stderr, "Failed to run pass pipeline '%s' on module %s: %s\n",
+              pipeline, module->module_name, msg ? msg : "unknown error");
+      if (msg)
+        LLVMDisposeMessage(msg);
+      return false;
+    }
+    return true;
+  }
+
+  LLVMPassBuilderOptionsRef options = LLVMCreatePassBuilderOptions();
+  LLVMPassBuilderOptionsSetLoopVectorization(options, opt_level >= 2);
+  LLVMPassBuilderOptionsSetSLPVectorization(options, opt_level >= 2);
+  LLVMPassBuilderOptionsSetLoopUnrolling(options, opt_level >= 2);
+  LLVMPassBuilderOptionsSetMergeFunctions(options, opt_level >= 3);
+
+  uint64_t start = trace_now_us();
+  LLVMErrorRef err =
+      LLVMRunPasses(module->module, pipeline, target_machine, options);
+  trace_complete("Optimize", "backend", module->module_name, start);
+
+  LLVMDisposePassBuilderOptions(options);
+
+  if (err) {
+    char *msg = LLVMGetErrorMessage(err);
+    fprintf(stderr, "Failed to run pass pipeline '%s' on module %s: %s\n",
+            pipeline, module->module_name, msg);
+    LLVMDisposeErrorMessage(msg);
     return false;
   }
 
+  return true;
+}
+
+// Optimizes and emits one module with a caller-provided TargetMachine. The
+// module must already carry the build's triple and data layout.
+static bool emit_module_object_file(ModuleCompilationUnit *module,
+                                    LLVMTargetMachineRef target_machine,
+                                    const char *output_path, int opt_level,
+                                    const char *pass_pipeline,
+                                    const ProfileOptions *profile) {
 #ifdef DEBUG_BUILD
   // Verify module only in debug builds
   if (!verify_module(module->module, module->module_name)) {
-    LLVMDisposeTargetMachine(target_machine);
     return false;
   }
 #endif
 
+  if (!optimize_module(module, target_machine, opt_level, pass_pipeline,
+                       profile, "default")) {
+    return false;
+  }
+
   // Generate object file
   char *error = NULL;
-  bool success = true;
+  uint64_t start = trace_now_us();
 
   if (LLVMTargetMachineEmitToFile(target_machine, module->module,
                                   (char *)output_path, LLVMObjectFile,
@@ -197,109 +362,656 @@ bool generate_module_object_file(ModuleCompilationUnit *module,
     fprintf(stderr, "Failed to emit object file for module %s: %s\n",
             module->module_name, error);
     LLVMDisposeMessage(error);
-    success = false;
+    return false;
+  }
+
+  trace_complete("Emit object", "backend", module->module_name, start);
+  return true;
+}
+
+// ThinLTO compile step: runs the pre-link pipeline and writes bitcode with a
+// module summary. Optimization and code generation happen when linking.
+static bool emit_module_thin_bitcode(ModuleCompilationUnit *module,
+                                     LLVMTargetMachineRef target_machine,
+                                     const char *output_path, int opt_level,
+                                     const char *pass_pipeline,
+                                     const ProfileOptions *profile) {
+  if (!optimize_module(module, target_machine, opt_level, pass_pipeline,
+                       profile, "thinlto-pre-link")) {
+    return false;
   }
 
+  uint64_t start = trace_now_us();
+  bool written = write_thin_bitcode_file(module->module, output_path);
+  trace_complete("Write bitcode", "backend", module->module_name, start);
+
+  if (!written) {
+    fprintf(stderr, "Failed to write bitcode for module %s to %s\n",
+            module->module_name, output_path);
+  }
+  return written;
+}
+
+bool generate_module_object_file(ModuleCompilationUnit *module,
+                                 const char *output_path, bool is_debug,
+                                 int opt_level, const char *pass_pipeline,
+                                 const TargetCPUOptions *cpu_options,
+                                 const ProfileOptions *profile) {
+  (void)is_debug; // Reserved for future LLVM C API debug info support
+  TargetSpec spec;
+  if (!target_spec_init(&spec, cpu_options)) {
+    return false;
+  }
+
+  LLVMTargetMachineRef target_machine = create_target_machine(&spec, opt_level);
+  if (!target_machine) {
+    fprintf(stderr, "Failed to create target machine for module %s\n",
+            module->module_name);
+    target_spec_dispose(&spec);
+    return false;
+  }
+
+  set_module_target(module->module, &spec);
+  bool success = emit_module_object_file(module, target_machine, output_path,
+                                         opt_level, pass_pipeline, profile);
+
   LLVMDisposeTargetMachine(target_machine);
+  target_spec_dispose(&spec);
   return success;
 }
 
-static void *compile_module_worker(void *arg) {
-  ModuleCompileTask *task = (ModuleCompileTask *)arg;
-  clock_t start = clock();
+// Work queue for object emission. Tasks are appended in the order modules
+// finish IR generation (pipelined builds) or all at once, largest first;
+// workers take them in order and wait for more until the queue is closed.
+struct ModuleCompileQueue {
+  ModuleCompileTask *tasks;
+  size_t task_capacity;
+  size_t task_count;
+  size_t next_task;
+  bool closed;
+  pthread_mutex_t lock;
+  pthread_cond_t task_ready;
+
+  TargetSpec spec;
+  int opt_level;
+  uint64_t fingerprint; // Build part of the cache keys, 0 without the cache
+  const char *output_dir;
+  // With workers, each module is moved into an LLVMContext of its own, so
+  // none of them touches the context IR generation still uses
+  bool private_contexts;
+
+  pthread_t *threads;
+  size_t thread_count; // Workers started besides the calling thread
+};
+
+static size_t count_module_instructions(LLVMModuleRef module) {
+  size_t count = 0;
+  for (LLVMValueRef func = LLVMGetFirstFunction(module); func;
+       func = LLVMGetNextFunction(func)) {
+    for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(func); bb;
+         bb = LLVMGetNextBasicBlock(bb)) {
+      for (LLVMValueRef inst = LLVMGetFirstInstruction(bb); inst;
+           inst = LLVMGetNextInstruction(inst)) {
+        count++;
+      }
+    }
+  }
+  return count;
+}
+
+static uint64_t build_fingerprint(const char *compiler_version, int opt_level,
+                                  const char *pass_pipeline, bool is_debug,
+                                  LTOMode lto_mode, const char *target_os,
+                                  const TargetSpec *spec,
+                                  const ProfileOptions *profile,
+                                  bool bounds_check, bool profile_counters) {
+  uint64_t key = cache_hash_string(14695981039346656037ull, compiler_version);
+  key = cache_hash_u64(key, (uint64_t)opt_level);
+  key = cache_hash_string(key, pass_pipeline);
+  key = cache_hash_u64(key, (uint64_t)is_debug);
+  key = cache_hash_u64(key, (uint64_t)lto_mode);
+  key = cache_hash_string(key, target_os);
+  key = cache_hash_string(key, spec->triple);
+  key = cache_hash_string(key, spec->cpu);
+  key = cache_hash_string(key, spec->features);
+  key = cache_hash_u64(key, (uint64_t)bounds_check);
+  key = cache_hash_u64(key, (uint64_t)profile_counters);
+
+  PGOMode pgo_mode = profile ? profile->mode : PGO_NONE;
+  key = cache_hash_u64(key, (uint64_t)pgo_mode);
+  if (pgo_mode == PGO_GENERATE)
+    key = cache_hash_string(key, profile->path);
+  else if (pgo_mode == PGO_USE)
+    key = cache_hash_file(key, profile->path); // New counts, new code
+  return key;
+}
+
+uint64_t codegen_build_fingerprint(const char *compiler_version, int opt_level,
+                                   const char *pass_pipeline, bool is_debug,
+                                   LTOMode lto_mode, const char *target_os,
+                                   const TargetCPUOptions *cpu_options,
+                                   const ProfileOptions *profile,
+                                   bool bounds_check, bool profile_counters) {
+  LLVMInitializeAllTargetInfos();
+  LLVMInitializeAllTargets();
+  LLVMInitializeAllTargetMCs();
+
+  TargetSpec spec;
+  if (!target_spec_init(&spec, cpu_options))
+    return 0;
+
+  uint64_t key = build_fingerprint(compiler_version, opt_level, pass_pipeline,
+                                   is_debug, lto_mode, target_os, &spec,
+                                   profile, bounds_check, profile_counters);
+  target_spec_dispose(&spec);
+  return key;
+}
+
+// Every build setting that changes the machine code emitted for a module.
+// Computed once per build: with -fprofile-use it reads the whole profile.
+static uint64_t context_fingerprint(CodeGenContext *ctx,
+                                    const TargetSpec *spec) {
+  return build_fingerprint(ctx->compiler_version, ctx->opt_level,
+                           ctx->pass_pipeline, ctx->is_debug, ctx->lto_mode,
+                           ctx->target_os, spec, &ctx->profile,
+                           ctx->bounds_check, ctx->profile_counters);
+}
+
+typedef struct {
+  ModuleCompilationUnit *unit;
+  size_t instruction_count; // Scheduling weight, largest modules go first
+} PendingModule;
+
+static int compare_pending_largest_first(const void *a, const void *b) {
+  const PendingModule *pa = (const PendingModule *)a;
+  const PendingModule *pb = (const PendingModule *)b;
+  if (pa->instruction_count != pb->instruction_count)
+    return pa->instruction_count < pb->instruction_count ? 1 : -1;
+  return strcmp(pa->unit->module_name, pb->unit->module_name);
+}
+
+static void task_output_path(const ModuleCompileTask *task, char *buffer,
+                             size_t size) {
+  snprintf(buffer, size, "%s/%s%s", task->output_dir, task->module->module_name,
+           task->lto_mode == LTO_THIN ? ".bc" : ".o");
+}
+
+// Whether the task has to run the optimizer and emit: prebuilt std modules
+// and modules with an up-to-date cached object are only copied or reused
+static bool task_needs_emission(const ModuleCompileTask *task) {
+  if (task->module->prebuilt_object)
+    return false;
+  if (!task->cache_key)
+    return true;
 
   char output_path[MAX_PATH_LENGTH];
-  snprintf(output_path, sizeof(output_path), "%s/%s.o", task->output_dir,
-           task->module->module_name);
+  task_output_path(task, output_path, sizeof(output_path));
+  return !object_cache_is_fresh(task->output_dir, output_path,
+                                task->module->module_name, task->cache_key);
+}
+
+static void release_task_bitcode(ModuleCompileTask *task) {
+  if (task->bitcode) {
+    LLVMDisposeMemoryBuffer(task->bitcode);
+    task->bitcode = NULL;
+  }
+}
+
+// Load errors are returned by LLVMParseBitcodeInContext2; without a handler
+// the context would report them and exit
+static void ignore_load_diagnostic(LLVMDiagnosticInfoRef info, void *data) {
+  (void)info;
+  (void)data;
+}
+
+// Optimizes and emits the task's module, first loading it into a context of
+// its own when it was handed over as bitcode
+static bool emit_task_module(ModuleCompileTask *task,
+                             LLVMTargetMachineRef target_machine,
+                             const char *output_path) {
+  ModuleCompilationUnit *unit = task->module;
+  ModuleCompilationUnit private_unit = {0};
+  LLVMContextRef context = NULL;
+
+  if (task->bitcode) {
+    uint64_t start = trace_now_us();
+    context = LLVMContextCreate();
+    LLVMContextSetDiagnosticHandler(context, ignore_load_diagnostic, NULL);
+    private_unit.module_name = task->module->module_name;
+    bool failed = LLVMParseBitcodeInContext2(context, task->bitcode,
+                                             &private_unit.module);
+    release_task_bitcode(task);
+    trace_complete("Load bitcode", "backend", task->module->module_name,
+                   start);
+    if (failed) {
+      LLVMContextDispose(context);
+      task->load_failed = true;
+      return false;
+    }
+    unit = &private_unit;
+  }
+
+  bool success;
+  if (task->lto_mode == LTO_THIN) {
+    success = emit_module_thin_bitcode(unit, target_machine, output_path,
+                                       task->opt_level, task->pass_pipeline,
+                                       task->profile);
+  } else {
+    success = emit_module_object_file(unit, target_machine, output_path,
+                                      task->opt_level, task->pass_pipeline,
+                                      task->profile);
+  }
+
+  if (context) {
+    LLVMDisposeModule(private_unit.module);
+    LLVMContextDispose(context);
+  }
+  return success;
+}
+
+static void compile_module_task(ModuleCompileTask *task,
+                                LLVMTargetMachineRef target_machine) {
+  uint64_t start = trace_now_us();
+
+  char output_path[MAX_PATH_LENGTH];
+  task_output_path(task, output_path, sizeof(output_path));
+
+  if (task->cache_key &&
+      object_cache_is_fresh(task->output_dir, output_path,
+                            task->module->module_name, task->cache_key)) {
+    release_task_bitcode(task);
+    task->success = true;
+    task->compile_time = 0.0;
+    trace_complete("Reuse cached object", "backend",
+                   task->module->module_name, start);
+    return;
+  }
+
+  // Only declarations were generated for a prebuilt std module, so the shared
+  // object is the one and only source of its code.
+  if (task->module->prebuilt_object) {
+    release_task_bitcode(task);
+    task->success =
+        object_cache_copy(task->module->prebuilt_object, output_path);
+    if (!task->success) {
+      fprintf(stderr, "Failed to copy prebuilt object %s for module %s\n",
+              task->module->prebuilt_object, task->module->module_name);
+    } else if (task->cache_key) {
+      object_cache_store(task->output_dir, task->module->module_name,
+                         task->cache_key);
+    }
+    task->compile_time = 0.0;
+    trace_complete("Reuse prebuilt std object", "backend",
+                   task->module->module_name, start);
+    return;
+  }
+
+  // Drop the stamp first so an interrupted emission can't leave a stale
+  // object that looks up to date.
+  object_cache_invalidate(task->output_dir, task->module->module_name);
+
+  task->success = emit_task_module(task, target_machine, output_path);
+
+  if (task->success && task->cache_key) {
+    object_cache_store(task->output_dir, task->module->module_name,
+                       task->cache_key);
+
+    // Publish std objects for other projects; failing to is not an error
+    char shared_path[MAX_PATH_LENGTH * 2];
+    if (task->module->is_std_module && task->lto_mode == LTO_NONE &&
+        std_object_cache_path(shared_path, sizeof(shared_path),
+                              task->module->module_name, task->cache_key)) {
+      object_cache_copy(output_path, shared_path);
+    }
+  }
+
+  task->compile_time = (double)(trace_now_us() - start) / 1000000.0;
+  trace_complete("Compile module", "backend", task->module->module_name,
+                 start);
+}
+
+// Blocks until a task is queued, or returns NULL once the queue is closed
+// and drained
+static ModuleCompileTask *next_compile_task(ModuleCompileQueue *queue) {
+  pthread_mutex_lock(&queue->lock);
+  while (queue->next_task == queue->task_count && !queue->closed)
+    pthread_cond_wait(&queue->task_ready, &queue->lock);
+  ModuleCompileTask *task = NULL;
+  if (queue->next_task < queue->task_count)
+    task = &queue->tasks[queue->next_task++];
+  pthread_mutex_unlock(&queue->lock);
+  return task;
+}
 
-  task->success = generate_module_object_file(task->module, output_path,
-                                              task->is_debug);
+static void *compile_module_worker(void *arg) {
+  ModuleCompileQueue *queue = (ModuleCompileQueue *)arg;
+
+  // One TargetMachine per worker, reused for every module it picks up.
+  LLVMTargetMachineRef target_machine =
+      create_target_machine(&queue->spec, queue->opt_level);
+  if (!target_machine) {
+    fprintf(stderr, "Failed to create target machine for compile worker\n");
+    return NULL;
+  }
 
-  clock_t end = clock();
-  task->compile_time = (double)(end - start) / CLOCKS_PER_SEC;
+  for (ModuleCompileTask *task; (task = next_compile_task(queue));)
+    compile_module_task(task, target_machine);
 
+  LLVMDisposeTargetMachine(target_machine);
   return NULL;
 }
 
-bool compile_modules_to_objects(CodeGenContext *ctx, const char *output_dir) {
-  // Create output directory
-  if (!create_output_directory(output_dir)) {
-    fprintf(stderr, "Failed to create output directory: %s\n", output_dir);
-    return false;
+static void *compile_module_thread(void *arg) {
+  trace_set_thread_name("compile worker");
+  return compile_module_worker(arg);
+}
+
+// Full LTO: every module is cloned into one combined module, which is then
+// optimized with the LTO pipeline and emitted as a single object. Imported
+// functions resolve to their definitions, so they can be inlined across
+// module boundaries. The originals stay intact for the rest of the build.
+static bool compile_full_lto(CodeGenContext *ctx, const char *output_dir,
+                             const TargetSpec *spec) {
+  char output_path[MAX_PATH_LENGTH];
+  snprintf(output_path, sizeof(output_path), "%s/%s.o", output_dir,
+           LTO_OBJECT_NAME);
+
+  uint64_t cache_key = 0;
+  if (ctx->use_object_cache) {
+    uint64_t fingerprint = context_fingerprint(ctx, spec);
+    cache_key = cache_hash_string(0, LTO_OBJECT_NAME);
+    for (ModuleCompilationUnit *unit = ctx->modules; unit; unit = unit->next) {
+      cache_key = cache_hash_u64(
+          cache_key, object_cache_key(fingerprint, unit->source_hash));
+    }
+    cache_key = cache_key ? cache_key : 1;
+
+    if (object_cache_is_fresh(output_dir, output_path, LTO_OBJECT_NAME,
+                              cache_key)) {
+      return true;
+    }
   }
+  object_cache_invalidate(output_dir, LTO_OBJECT_NAME);
 
-  // Count modules
-  size_t module_count = 0;
+  ModuleCompilationUnit combined = {0};
+  combined.module_name = intern(LTO_OBJECT_NAME);
+  combined.module =
+      LLVMModuleCreateWithNameInContext(LTO_OBJECT_NAME, ctx->context);
+  set_module_target(combined.module, spec);
+
+  uint64_t merge_start = trace_now_us();
   for (ModuleCompilationUnit *unit = ctx->modules; unit; unit = unit->next) {
-    module_count++;
+    set_module_target(unit->module, spec);
+    // LLVMLinkModules2 consumes the source module, so link a copy
+    if (LLVMLinkModules2(combined.module, LLVMCloneModule(unit->module))) {
+      fprintf(stderr, "Failed to link module %s for LTO\n", unit->module_name);
+      LLVMDisposeModule(combined.module);
+      return false;
+    }
   }
+  trace_complete("Merge modules", "backend", LTO_OBJECT_NAME, merge_start);
 
-  if (module_count == 0) {
-    fprintf(stderr, "No modules to compile\n");
+  LLVMTargetMachineRef target_machine =
+      create_target_machine(spec, ctx->opt_level);
+  if (!target_machine) {
+    fprintf(stderr, "Failed to create target machine for LTO\n");
+    LLVMDisposeModule(combined.module);
     return false;
   }
 
-  // Determine thread count
+  bool success = optimize_module(&combined, target_machine, ctx->opt_level,
+                                 ctx->pass_pipeline, &ctx->profile, "lto");
+  if (success) {
+    char *error = NULL;
+    uint64_t emit_start = trace_now_us();
+    if (LLVMTargetMachineEmitToFile(target_machine, combined.module,
+                                    output_path, LLVMObjectFile, &error)) {
+      fprintf(stderr, "Failed to emit LTO object: %s\n", error);
+      LLVMDisposeMessage(error);
+      success = false;
+    }
+    trace_complete("Emit object", "backend", LTO_OBJECT_NAME, emit_start);
+  }
+
+  if (success && cache_key) {
+    object_cache_store(output_dir, LTO_OBJECT_NAME, cache_key);
+  }
+
+  LLVMDisposeTargetMachine(target_machine);
+  LLVMDisposeModule(combined.module);
+  return success;
+}
+
+static ModuleCompileQueue *compile_queue_begin(CodeGenContext *ctx,
+                                               const char *output_dir,
+                                               size_t capacity,
+                                               size_t thread_count) {
+  ModuleCompileQueue *queue = xcalloc(1, sizeof(ModuleCompileQueue));
+  if (!target_spec_init(&queue->spec, &ctx->cpu_options)) {
+    free(queue);
+    return NULL;
+  }
+
+  queue->tasks = xmalloc(sizeof(ModuleCompileTask) * capacity);
+  queue->task_capacity = capacity;
+  pthread_mutex_init(&queue->lock, NULL);
+  pthread_cond_init(&queue->task_ready, NULL);
+  queue->opt_level = ctx->opt_level;
+  queue->fingerprint =
+      ctx->use_object_cache ? context_fingerprint(ctx, &queue->spec) : 0;
+  queue->output_dir = output_dir;
+  queue->private_contexts = thread_count > 1;
+
+  // The calling thread works the queue too once it closes it, so only
+  // thread_count - 1 extra workers are started. If a thread fails to start,
+  // the remaining workers simply drain more of the queue.
+  queue->threads = xmalloc(sizeof(pthread_t) * (thread_count ? thread_count : 1));
+  for (size_t i = 1; i < thread_count; i++) {
+    if (pthread_create(&queue->threads[queue->thread_count], NULL,
+                       compile_module_thread, queue) != 0) {
+      fprintf(stderr, "Failed to create compile worker thread %zu\n", i);
+      break;
+    }
+    queue->thread_count++;
+  }
+  return queue;
+}
+
+// Hands a module whose IR is complete to the emission workers. Runs on the
+// thread generating IR, which is the only one touching the shared context.
+static void compile_queue_submit(CodeGenContext *ctx, ModuleCompileQueue *queue,
+                                 ModuleCompilationUnit *unit) {
+  if (unit->emission_queued || queue->task_count == queue->task_capacity)
+    return;
+  unit->emission_queued = true;
+
+  // Debug info must be complete before the module changes hands
+  finalize_module_debug_info(unit);
+  set_module_target(unit->module, &queue->spec);
+
+  ModuleCompileTask task = {0};
+  task.module = unit;
+  task.output_dir = queue->output_dir;
+  task.is_debug = ctx->is_debug;
+  task.opt_level = ctx->opt_level;
+  task.pass_pipeline = ctx->pass_pipeline;
+  task.lto_mode = ctx->lto_mode;
+  task.profile = &ctx->profile;
+  task.cache_key = ctx->use_object_cache
+                       ? object_cache_key(queue->fingerprint, unit->source_hash)
+                       : 0;
+  if (queue->private_contexts && task_needs_emission(&task)) {
+    uint64_t start = trace_now_us();
+    task.bitcode = LLVMWriteBitcodeToMemoryBuffer(unit->module);
+    trace_complete("Write bitcode to memory", "backend", unit->module_name,
+                   start);
+  }
+
+  pthread_mutex_lock(&queue->lock);
+  queue->tasks[queue->task_count++] = task;
+  pthread_cond_signal(&queue->task_ready);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+// Closes the queue, helps drain it and waits for the workers
+static bool compile_queue_finish(ModuleCompileQueue *queue) {
+  pthread_mutex_lock(&queue->lock);
+  queue->closed = true;
+  pthread_cond_broadcast(&queue->task_ready);
+  pthread_mutex_unlock(&queue->lock);
+
+  compile_module_worker(queue);
+
+  for (size_t i = 0; i < queue->thread_count; i++) {
+    pthread_join(queue->threads[i], NULL);
+  }
+
+  // IR generation is over, so the shared context is free for modules the
+  // workers couldn't load
+  LLVMTargetMachineRef target_machine = NULL;
+  for (size_t i = 0; i < queue->task_count; i++) {
+    ModuleCompileTask *task = &queue->tasks[i];
+    if (!task->load_failed)
+      continue;
+    if (!target_machine &&
+        !(target_machine =
+              create_target_machine(&queue->spec, queue->opt_level)))
+      break;
+    task->load_failed = false;
+    compile_module_task(task, target_machine);
+  }
+  if (target_machine)
+    LLVMDisposeTargetMachine(target_machine);
+
+  bool overall_success = true;
+  for (size_t i = 0; i < queue->task_count; i++) {
+    ModuleCompileTask *task = &queue->tasks[i];
+    if (!task->success) {
+      fprintf(stderr, "Failed to compile module: %s\n",
+              task->module->module_name);
+      overall_success = false;
+    }
+    release_task_bitcode(task);
+  }
+
+  pthread_mutex_destroy(&queue->lock);
+  pthread_cond_destroy(&queue->task_ready);
+  target_spec_dispose(&queue->spec);
+  free(queue->tasks);
+  free(queue->threads);
+  free(queue);
+  return overall_success;
+}
+
+static size_t count_module_units(CodeGenContext *ctx) {
+  size_t module_count = 0;
+  for (ModuleCompilationUnit *unit = ctx->modules; unit; unit = unit->next) {
+    module_count++;
+  }
+  return module_count;
+}
+
+bool begin_pipelined_emission(CodeGenContext *ctx, const char *output_dir,
+                              size_t module_count) {
+  // Full LTO needs every module in one context; a single thread has nothing
+  // to overlap IR generation with
   size_t thread_count = get_compile_thread_count();
   if (thread_count > module_count) {
     thread_count = module_count;
   }
+  if (ctx->emit_queue || ctx->lto_mode == LTO_FULL || thread_count < 2) {
+    return false;
+  }
 
-  // Allocate resources
-  ModuleCompileTask *tasks = xmalloc(sizeof(ModuleCompileTask) * module_count);
-  pthread_t *threads = xmalloc(sizeof(pthread_t) * module_count);
+  if (!create_output_directory(output_dir)) {
+    return false;
+  }
 
-  // Finalize all debug info before compilation
-  finalize_all_debug_info(ctx);
+  ctx->emit_queue =
+      compile_queue_begin(ctx, output_dir, module_count, thread_count);
+  return ctx->emit_queue != NULL;
+}
 
-  // Initialize tasks
-  size_t i = 0;
-  for (ModuleCompilationUnit *unit = ctx->modules; unit;
-       unit = unit->next, i++) {
-    tasks[i].module = unit;
-    tasks[i].output_dir = output_dir;
-    tasks[i].is_debug = ctx->is_debug;
-    tasks[i].success = false;
-    tasks[i].compile_time = 0.0;
+void submit_module_for_emission(CodeGenContext *ctx,
+                                ModuleCompilationUnit *unit) {
+  if (ctx->emit_queue) {
+    compile_queue_submit(ctx, ctx->emit_queue, unit);
   }
+}
 
-  // Compile in batches
-  bool overall_success = true;
+LLVMTargetDataRef get_target_data(CodeGenContext *ctx) {
+  if (!ctx->target_data) {
+    TargetSpec spec;
+    if (!target_spec_init(&spec, &ctx->cpu_options))
+      return NULL;
+    ctx->target_data = LLVMCreateTargetData(spec.data_layout);
+    target_spec_dispose(&spec);
+  }
+  return ctx->target_data;
+}
+
+bool compile_modules_to_objects(CodeGenContext *ctx, const char *output_dir) {
+  ModuleCompileQueue *queue = ctx->emit_queue;
+  ctx->emit_queue = NULL;
+
+  size_t module_count = count_module_units(ctx);
 
-  for (size_t batch_start = 0; batch_start < module_count;
-       batch_start += thread_count) {
-    size_t batch_end = batch_start + thread_count;
-    if (batch_end > module_count) {
-      batch_end = module_count;
+  if (!queue) {
+    // Create output directory
+    if (!create_output_directory(output_dir)) {
+      fprintf(stderr, "Failed to create output directory: %s\n", output_dir);
+      return false;
     }
 
-    // Launch threads for this batch
-    for (i = batch_start; i < batch_end; i++) {
-      if (pthread_create(&threads[i], NULL, compile_module_worker, &tasks[i]) !=
-          0) {
-        fprintf(stderr, "Failed to create thread for module: %s\n",
-                tasks[i].module->module_name);
-        tasks[i].success = false;
-        overall_success = false;
+    if (module_count == 0) {
+      fprintf(stderr, "No modules to compile\n");
+      return false;
+    }
+
+    if (ctx->lto_mode == LTO_FULL) {
+      TargetSpec spec;
+      if (!target_spec_init(&spec, &ctx->cpu_options)) {
+        return false;
       }
+      finalize_all_debug_info(ctx);
+      bool lto_success = compile_full_lto(ctx, output_dir, &spec);
+      target_spec_dispose(&spec);
+      return lto_success;
     }
 
-    // Wait for batch completion
-    for (i = batch_start; i < batch_end; i++) {
-      pthread_join(threads[i], NULL);
+    // Determine thread count
+    size_t thread_count = get_compile_thread_count();
+    if (thread_count > module_count) {
+      thread_count = module_count;
+    }
 
-      if (!tasks[i].success) {
-        fprintf(stderr, "Failed to compile module: %s\n",
-                tasks[i].module->module_name);
-        overall_success = false;
-      }
+    queue = compile_queue_begin(ctx, output_dir, module_count, thread_count);
+    if (!queue) {
+      return false;
     }
   }
 
-  free(tasks);
-  free(threads);
+  // Whatever IR generation hasn't handed over yet goes now, largest first so
+  // the tail of the build is made of small modules
+  PendingModule *pending =
+      xmalloc(sizeof(PendingModule) * (module_count ? module_count : 1));
+  size_t pending_count = 0;
+  for (ModuleCompilationUnit *unit = ctx->modules; unit; unit = unit->next) {
+    if (unit->emission_queued)
+      continue;
+    pending[pending_count].unit = unit;
+    pending[pending_count].instruction_count =
+        count_module_instructions(unit->module);
+    pending_count++;
+  }
+  qsort(pending, pending_count, sizeof(PendingModule),
+        compare_pending_largest_first);
+  for (size_t i = 0; i < pending_count; i++) {
+    compile_queue_submit(ctx, queue, pending[i].unit);
+  }
+  free(pending);
 
-  return overall_success;
+  return compile_queue_finish(queue);
 }
 
 ModuleCompilationUnit *create_module_unit(CodeGenContext *ctx,
@@ -308,26 +1020,29 @@ ModuleCompilationUnit *create_module_unit(CodeGenContext *ctx,
       ctx->arena, sizeof(ModuleCompilationUnit),
       alignof(ModuleCompilationUnit));
 
-  unit->module_name = arena_strdup(ctx->arena, module_name);
+  unit->module_name = intern(module_name);
   unit->module = LLVMModuleCreateWithNameInContext(module_name, ctx->context);
   unit->symbols = NULL;
+  unit->symbol_index = (PointerMap){0};
+  unit->comptime_values = (PointerMap){0};
   unit->is_main_module = (strcmp(module_name, "main") == 0);
   unit->next = ctx->modules;
 
   ctx->modules = unit;
+  pointer_map_put(&ctx->module_index, unit->module_name, unit);
 
   unit->link_lib_count = 0;
+  unit->source_hash = 0;
+  unit->is_std_module = false;
+  unit->prebuilt_object = NULL;
+  unit->emission_queued = false;
   return unit;
 }
 
 ModuleCompilationUnit *find_module(CodeGenContext *ctx,
                                    const char *module_name) {
-  for (ModuleCompilationUnit *unit = ctx->modules; unit; unit = unit->next) {
-    if (strcmp(unit->module_name, module_name) == 0) {
-      return unit;
-    }
-  }
-  return NULL;
+  Atom key = atom_find(module_name);
+  return key ? pointer_map_get(&ctx->module_index, key) : NULL;
 }
 
 void set_current_module(CodeGenContext *ctx, ModuleCompilationUnit *module) {
@@ -338,22 +1053,24 @@ void add_symbol_to_module(ModuleCompilationUnit *module, const char *name,
                           LLVMValueRef value, LLVMTypeRef type,
                           bool is_function) {
   LLVM_Symbol *sym = (LLVM_Symbol *)xmalloc(sizeof(LLVM_Symbol));
-  sym->name = xstrdup(name);
+  sym->name = intern(name);
   sym->value = value;
   sym->type = type;
   sym->is_function = is_function;
   sym->next = module->symbols;
   module->symbols = sym;
+  pointer_map_put(&module->symbol_index, sym->name, sym);
+}
+
+static LLVM_Symbol *find_atom_in_module(ModuleCompilationUnit *module,
+                                        Atom key) {
+  return pointer_map_get(&module->symbol_index, key);
 }
 
 LLVM_Symbol *find_symbol_in_module(ModuleCompilationUnit *module,
                                    const char *name) {
-  for (LLVM_Symbol *sym = module->symbols; sym; sym = sym->next) {
-    if (strcmp(sym->name, name) == 0) {
-      return sym;
-    }
-  }
-  return NULL;
+  Atom key = atom_find(name);
+  return key ? find_atom_in_module(module, key) : NULL;
 }
 
 LLVM_Symbol *find_symbol_global(CodeGenContext *ctx, const char *name,
@@ -366,9 +1083,14 @@ LLVM_Symbol *find_symbol_global(CodeGenContext *ctx, const char *name,
     return NULL;
   }
 
+  Atom key = atom_find(name);
+  if (!key) {
+    return NULL;
+  }
+
   // Search current module first
   if (ctx->current_module) {
-    LLVM_Symbol *sym = find_symbol_in_module(ctx->current_module, name);
+    LLVM_Symbol *sym = find_atom_in_module(ctx->current_module, key);
     if (sym)
       return sym;
   }
@@ -378,7 +1100,7 @@ LLVM_Symbol *find_symbol_global(CodeGenContext *ctx, const char *name,
     if (unit == ctx->current_module)
       continue;
 
-    LLVM_Symbol *sym = find_symbol_in_module(unit, name);
+    LLVM_Symbol *sym = find_atom_in_module(unit, key);
     if (sym)
       return sym;
   }
@@ -421,6 +1143,7 @@ void generate_external_declarations(CodeGenContext *ctx,
         LLVMValueRef external_func =
             LLVMAddFunction(target_module->module, func_name, func_type);
         LLVMSetLinkage(external_func, LLVMExternalLinkage);
+        copy_function_attributes(external_func, func);
 
         // Copy calling convention for struct returns
         LLVMTypeRef return_type = LLVMGetReturnType(func_type);
@@ -466,18 +1189,36 @@ CodeGenContext *init_codegen_context(ArenaAllocator *arena) {
   // Initialize module and symbol state
   ctx->modules = NULL;
   ctx->current_module = NULL;
+  ctx->current_module_ast = NULL;
   ctx->current_function = NULL;
   ctx->loop_continue_block = NULL;
   ctx->loop_break_block = NULL;
   ctx->struct_types = NULL;
+  ctx->module_index = (PointerMap){0};
+  ctx->struct_index = (PointerMap){0};
+  ctx->struct_type_index = (PointerMap){0};
+  memset(ctx->field_cache, 0, sizeof(ctx->field_cache));
   ctx->arena = arena;
   ctx->module = NULL;
-  ctx->deferred_statements = NULL;
-  ctx->deferred_count = 0;
-
-  // Initialize caches
-  init_symbol_cache();
-  init_struct_cache();
+  ctx->defers = (DeferState){0};
+  ctx->opt_level = 0;
+  ctx->pass_pipeline = NULL;
+  ctx->use_object_cache = false;
+  ctx->compiler_version = NULL;
+  ctx->declarations_only = false;
+  ctx->emit_queue = NULL;
+  ctx->cpu_options = (TargetCPUOptions){NULL, NULL, NULL};
+  ctx->target_data = NULL;
+  memset(&ctx->tbaa, 0, sizeof(ctx->tbaa));
+  ctx->has_packed_structs = false;
+  ctx->profile = (ProfileOptions){PGO_NONE, NULL};
+  ctx->inline_imports = false;
+  ctx->bounds_check = false;
+  ctx->bounds_trap = NULL;
+  ctx->bounds_trap_function = NULL;
+  ctx->bounds_loop = NULL;
+  ctx->profile_counters = false;
+  ctx->profile_sites = NULL;
 
   return ctx;
 }
@@ -498,27 +1239,153 @@ void cleanup_codegen_context(CodeGenContext *ctx) {
     LLVM_Symbol *sym = unit->symbols;
     while (sym) {
       LLVM_Symbol *next_sym = sym->next;
-      free(sym->name);
       free(sym);
       sym = next_sym;
     }
+    pointer_map_free(&unit->symbol_index);
+    pointer_map_free(&unit->comptime_values);
 
-    LLVMDisposeModule(unit->module);
+    // Modules and context are gone already if they were handed to the JIT
+    if (unit->module)
+      LLVMDisposeModule(unit->module);
     unit = next;
   }
 
+  pointer_map_free(&ctx->module_index);
+  pointer_map_free(&ctx->struct_index);
+  pointer_map_free(&ctx->struct_type_index);
+
   // Cleanup LLVM resources
-  LLVMDisposeBuilder(ctx->builder);
-  LLVMContextDispose(ctx->context);
+  if (ctx->target_data)
+    LLVMDisposeTargetData(ctx->target_data);
+  if (ctx->builder)
+    LLVMDisposeBuilder(ctx->builder);
+  if (ctx->context)
+    LLVMContextDispose(ctx->context);
   LLVMShutdown();
 }
 
+#if defined(__APPLE__)
+#define JIT_SHARED_LIBRARY_FORMAT "lib%s.dylib"
+#elif defined(__MINGW32__) || defined(_WIN32)
+#define JIT_SHARED_LIBRARY_FORMAT "%s.dll"
+#else
+#define JIT_SHARED_LIBRARY_FORMAT "lib%s.so"
+#endif
+
+// Sorts the @link entries of every module the way collect_link_flags does:
+// paths and objects are loaded as objects, everything else as a shared
+// library. Duplicates are dropped.
+static void collect_jit_inputs(CodeGenContext *ctx, const char **objects,
+                               size_t *object_count, const char **libraries,
+                               size_t *library_count, size_t capacity) {
+  for (ModuleCompilationUnit *unit = ctx->modules; unit; unit = unit->next) {
+    if (unit->prebuilt_object && *object_count < capacity)
+      objects[(*object_count)++] = unit->prebuilt_object;
+
+    for (size_t i = 0; i < unit->link_lib_count; i++) {
+      const char *lib = unit->link_libs[i];
+      // Checked first: "libpthread.so.0" also contains ".o"
+      bool is_library = strstr(lib, ".so") || strstr(lib, ".dylib") ||
+                        strstr(lib, ".dll");
+      bool is_object = !is_library &&
+                       (strchr(lib, '/') || strchr(lib, '\\') ||
+                        strstr(lib, ".o") || strstr(lib, ".bin"));
+
+      if (strstr(lib, ".a") && !is_object && !is_library) {
+        fprintf(stderr, "JIT: warning: static library %s is not supported\n",
+                lib);
+        continue;
+      }
+
+      const char *entry = lib;
+      struct stat st;
+      if (is_library && stat(lib, &st) != 0) {
+        // The parser anchors names like "libm.so" at the source directory;
+        // when nothing is bundled there, let the loader search for it
+        const char *base = strrchr(lib, '/');
+        const char *base_bs = strrchr(lib, '\\');
+        if (base_bs > base)
+          base = base_bs;
+        if (base)
+          entry = base + 1;
+      } else if (!is_object && !is_library) {
+        char name[256];
+        snprintf(name, sizeof(name), JIT_SHARED_LIBRARY_FORMAT, lib);
+        entry = arena_strdup(ctx->arena, name);
+      }
+
+      const char **list = is_object ? objects : libraries;
+      size_t *count = is_object ? object_count : library_count;
+      bool duplicate = false;
+      for (size_t j = 0; j < *count && !duplicate; j++)
+        duplicate = strcmp(list[j], entry) == 0;
+      if (!duplicate && *count < capacity)
+        list[(*count)++] = entry;
+    }
+  }
+}
+
+bool jit_run_program(CodeGenContext *ctx, bool lazy, int argc, char **argv,
+                     int *exit_code) {
+  size_t module_count = 0;
+  for (ModuleCompilationUnit *unit = ctx->modules; unit; unit = unit->next)
+    module_count++;
+
+  size_t capacity = module_count * (MAX_LINK_LIBS + 1);
+  LLVMModuleRef *modules = xcalloc(module_count ? module_count : 1,
+                                   sizeof(LLVMModuleRef));
+  const char **objects = xcalloc(capacity ? capacity : 1, sizeof(char *));
+  const char **libraries = xcalloc(capacity ? capacity : 1, sizeof(char *));
+  size_t object_count = 0, library_count = 0;
+
+  collect_jit_inputs(ctx, objects, &object_count, libraries, &library_count,
+                     capacity);
+
+  // Debug info must be complete before the modules change hands
+  finalize_all_debug_info(ctx);
+
+  // Prebuilt std modules only hold declarations; their object stands in
+  size_t i = 0;
+  for (ModuleCompilationUnit *unit = ctx->modules; unit; unit = unit->next) {
+    if (unit->prebuilt_object)
+      LLVMDisposeModule(unit->module);
+    else
+      modules[i++] = unit->module;
+    unit->module = NULL;
+  }
+
+  // The JIT owns the context from here on; the builder belongs to it too
+  LLVMDisposeBuilder(ctx->builder);
+  ctx->builder = NULL;
+  LLVMContextRef context = ctx->context;
+  ctx->context = NULL;
+
+  uint64_t start = trace_now_us();
+  bool success = jit_run_modules(context, modules, i, objects, object_count,
+                                 libraries, library_count, ctx->opt_level,
+                                 lazy, argc, argv, exit_code);
+  trace_complete("JIT run", "backend", NULL, start);
+
+  free(modules);
+  free(objects);
+  free(libraries);
+  return success;
+}
+
 bool generate_program_modules(CodeGenContext *ctx, AstNode *ast_root,
                               const char *output_dir) {
   if (!ast_root || ast_root->type != AST_PROGRAM) {
     return false;
   }
 
+  size_t module_count = 0;
+  for (size_t i = 0; i < ast_root->stmt.program.module_count; i++) {
+    if (ast_root->stmt.program.modules[i]->type == AST_PREPROCESSOR_MODULE)
+      module_count++;
+  }
+  begin_pipelined_emission(ctx, output_dir, module_count);
+
   // Generate code for all modules
   codegen_stmt_program_multi_module(ctx, ast_root);
 
@@ -536,23 +1403,33 @@ char *print_llvm_ir(CodeGenContext *ctx) {
 bool generate_object_file(CodeGenContext *ctx, const char *object_filename) {
   if (ctx->current_module) {
     return generate_module_object_file(ctx->current_module, object_filename,
-                                       ctx->is_debug);
+                                       ctx->is_debug, ctx->opt_level,
+                                       ctx->pass_pipeline, &ctx->cpu_options,
+                                       &ctx->profile);
   }
   return false;
 }
 
 bool generate_assembly_file(CodeGenContext *ctx, const char *asm_filename,
                             bool is_debug) {
+  (void)is_debug;
   if (!ctx->current_module)
     return false;
 
-  LLVMTargetMachineRef target_machine = create_target_machine(is_debug);
+  TargetSpec spec;
+  if (!target_spec_init(&spec, &ctx->cpu_options)) {
+    return false;
+  }
+
+  LLVMTargetMachineRef target_machine =
+      create_target_machine(&spec, ctx->opt_level);
   if (!target_machine) {
     fprintf(stderr, "Failed to create target machine\n");
+    target_spec_dispose(&spec);
     return false;
   }
 
-  set_module_target(ctx->current_module->module, target_machine);
+  set_module_target(ctx->current_module->module, &spec);
 
   char *error = NULL;
   bool success = true;
@@ -566,6 +1443,7 @@ bool generate_assembly_file(CodeGenContext *ctx, const char *asm_filename,
   }
 
   LLVMDisposeTargetMachine(target_machine);
+  target_spec_dispose(&spec);
   return success;
 }
 
@@ -41,6 +41,10 @@ LLVMValueRef codegen_expr(CodeGenContext *ctx, AstNode *node) {
     return codegen_expr_alloc(ctx, node);
   case AST_EXPR_FREE:
     return codegen_expr_free(ctx, node);
+  case AST_EXPR_MEMCPY:
+    return codegen_expr_memcpy(ctx, node);
+  case AST_EXPR_BUILTIN:
+    return codegen_expr_builtin(ctx, node);
   case AST_EXPR_DEREF:
     return codegen_expr_deref(ctx, node);
   case AST_EXPR_ADDR:
@@ -48,6 +52,8 @@ LLVMValueRef codegen_expr(CodeGenContext *ctx, AstNode *node) {
   case AST_EXPR_MEMBER:
     if (node->expr.member.is_compiletime)
       return codegen_module_access(ctx, node);
+    else if (is_vector_expr(node->expr.member.object))
+      return codegen_vector_swizzle(ctx, node);
     else
       return codegen_expr_struct_access(ctx, node);
   case AST_EXPR_STRUCT:
@@ -126,17 +132,42 @@ LLVMTypeRef codegen_type(CodeGenContext *ctx, AstNode *node) {
     return NULL;
   }
 
+  // Types made only of builtins lower the same way in every module, so the
+  // result is kept on the canonical type; anything naming a struct or enum
+  // depends on the module being generated and is looked up each time
+  CanonicalType *canonical = type_canonical(node);
+  if (canonical && canonical_type_is_builtin(canonical)) {
+    LLVMTypeRef cached =
+        canonical_type_backend(canonical, ctx->type_cache_owner);
+    if (cached)
+      return cached;
+  } else {
+    canonical = NULL;
+  }
+
+  LLVMTypeRef type;
   switch (node->type) {
   case AST_TYPE_BASIC:
-    return codegen_type_basic(ctx, node);
+    type = codegen_type_basic(ctx, node);
+    break;
   case AST_TYPE_POINTER:
-    return codegen_type_pointer(ctx, node);
+    type = codegen_type_pointer(ctx, node);
+    break;
   case AST_TYPE_ARRAY:
-    return codegen_type_array(ctx, node);
+    type = codegen_type_array(ctx, node);
+    break;
+  case AST_TYPE_VECTOR:
+    type = codegen_type_vector(ctx, node);
+    break;
   case AST_TYPE_FUNCTION:
-    return codegen_type_function(ctx, node);
+    type = codegen_type_function(ctx, node);
+    break;
   default:
     fprintf(stderr, "Error: Unknown type: %d\n", node->type);
     return NULL;
   }
+
+  if (canonical && type)
+    canonical_type_set_backend(canonical, ctx->type_cache_owner, type);
+  return type;
 }
@@ -0,0 +1,237 @@
+// object_cache.c - Content-hashed reuse of per-module object files
+//
+// Every module gets a 64-bit key built from its own tokens and the keys of
+// the modules it @use's, combined with the build settings that influence
+// machine code (opt level, pass pipeline, target, debug info, profile). The
+// key is written next to the object as "<module>.hash". When a later build
+// computes the same key and the object is still present, optimization and
+// emission for that module are skipped and the existing object is linked
+// as-is.
+//
+// Standard library objects are additionally kept in a cache shared by every
+// project (get_std_cache_path), named "<module>-<key>.o", so a std module is
+// compiled once per compiler version and build configuration.
+#include "../llvm.h"
+#include "../../helper/std_path.h"
+#include <stdlib.h>
+
+#define FNV64_OFFSET 14695981039346656037ull
+#define FNV64_PRIME 1099511628211ull
+
+uint64_t cache_hash_bytes(uint64_t hash, const void *data, size_t len) {
+  const unsigned char *bytes = (const unsigned char *)data;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= bytes[i];
+    hash *= FNV64_PRIME;
+  }
+  return hash;
+}
+
+uint64_t cache_hash_string(uint64_t hash, const char *str) {
+  if (!str)
+    str = "";
+  // Include the terminator so "ab"+"c" and "a"+"bc" hash differently
+  return cache_hash_bytes(hash, str, strlen(str) + 1);
+}
+
+uint64_t cache_hash_u64(uint64_t hash, uint64_t value) {
+  return cache_hash_bytes(hash, &value, sizeof(value));
+}
+
+// Hashes a file's contents, e.g. the profile a build optimizes with. A file
+// that can't be read hashes like an empty one.
+uint64_t cache_hash_file(uint64_t hash, const char *path) {
+  FILE *file = path ? fopen(path, "rb") : NULL;
+  if (!file)
+    return cache_hash_u64(hash, 0);
+
+  unsigned char buffer[8192];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    hash = cache_hash_bytes(hash, buffer, read);
+
+  fclose(file);
+  return hash;
+}
+
+// Hashes the token stream of a module, through the digests the token stream
+// computed while it was parsed. Whitespace and comments never reach codegen,
+// so they are ignored; positions only matter when debug info embeds them.
+static uint64_t hash_module_tokens(AstNode *module, bool include_positions) {
+  uint64_t hash = FNV64_OFFSET;
+  hash = cache_hash_string(hash, module->preprocessor.module.name);
+  hash = cache_hash_u64(hash, module->preprocessor.module.token_digest);
+
+  if (include_positions) {
+    hash = cache_hash_u64(hash,
+                          module->preprocessor.module.token_position_digest);
+    hash = cache_hash_string(hash, module->preprocessor.module.file_path);
+  }
+
+  return hash;
+}
+
+static uint64_t compute_key(size_t index, AstNode **modules,
+                            const ModuleGraph *graph, const uint64_t *keys,
+                            const bool *done, bool include_positions) {
+  uint64_t hash = hash_module_tokens(modules[index], include_positions);
+  for (size_t i = 0; i < graph->use_counts[index]; i++) {
+    const ModuleUse *use = &graph->uses[index][i];
+    if (use->module < 0) {
+      hash = cache_hash_string(hash, use->name);
+    } else if (done[use->module]) {
+      hash = cache_hash_u64(hash, keys[use->module]);
+    } else {
+      // Only a module on a @use cycle (or importing itself) gets here; fold
+      // in a constant so its key is still deterministic
+      hash = cache_hash_u64(hash, FNV64_OFFSET);
+    }
+  }
+  return hash;
+}
+
+void compute_module_keys(AstNode **modules, const ModuleGraph *graph,
+                         bool include_positions, uint64_t *keys) {
+  bool *done = xcalloc(graph->module_count ? graph->module_count : 1,
+                       sizeof(bool));
+
+  // Dependencies come first in the order, so their keys are ready
+  for (size_t n = 0; n < graph->order_count; n++) {
+    size_t index = graph->order[n];
+    keys[index] =
+        compute_key(index, modules, graph, keys, done, include_positions);
+    done[index] = true;
+  }
+
+  for (size_t i = 0; i < graph->module_count; i++) {
+    if (!modules[i] || modules[i]->type != AST_PREPROCESSOR_MODULE ||
+        graph->levels[i] >= 0)
+      continue;
+    keys[i] = compute_key(i, modules, graph, keys, done, include_positions);
+    done[i] = true;
+  }
+
+  free(done);
+}
+
+void compute_module_source_hashes(CodeGenContext *ctx, AstNode **modules,
+                                  const ModuleGraph *graph) {
+  size_t module_count = graph->module_count;
+  uint64_t *keys = xcalloc(module_count ? module_count : 1, sizeof(uint64_t));
+  compute_module_keys(modules, graph, ctx->is_debug, keys);
+
+  for (size_t i = 0; i < module_count; i++) {
+    if (!modules[i] || modules[i]->type != AST_PREPROCESSOR_MODULE)
+      continue;
+
+    ModuleCompilationUnit *unit =
+        find_module(ctx, modules[i]->preprocessor.module.name);
+    if (unit) {
+      unit->source_hash = keys[i];
+    }
+  }
+
+  free(keys);
+}
+
+uint64_t object_cache_key(uint64_t build_fingerprint, uint64_t source_hash) {
+  uint64_t key = cache_hash_u64(build_fingerprint, source_hash);
+  // 0 means "no caching", keep real keys away from it
+  return key ? key : 1;
+}
+
+static void cache_stamp_path(char *buffer, size_t size, const char *output_dir,
+                             const char *module_name) {
+  snprintf(buffer, size, "%s/%s.hash", output_dir, module_name);
+}
+
+bool object_cache_is_fresh(const char *output_dir, const char *object_path,
+                           const char *module_name, uint64_t key) {
+  FILE *obj = fopen(object_path, "rb");
+  if (!obj)
+    return false;
+  fclose(obj);
+
+  char stamp_path[512];
+  cache_stamp_path(stamp_path, sizeof(stamp_path), output_dir, module_name);
+
+  FILE *stamp = fopen(stamp_path, "r");
+  if (!stamp)
+    return false;
+
+  unsigned long long stored = 0;
+  bool matched = fscanf(stamp, "%llx", &stored) == 1 && stored == key;
+  fclose(stamp);
+  return matched;
+}
+
+void object_cache_store(const char *output_dir, const char *module_name,
+                        uint64_t key) {
+  char stamp_path[512];
+  cache_stamp_path(stamp_path, sizeof(stamp_path), output_dir, module_name);
+
+  FILE *stamp = fopen(stamp_path, "w");
+  if (!stamp)
+    return;
+  fprintf(stamp, "%016llx\n", (unsigned long long)key);
+  fclose(stamp);
+}
+
+void object_cache_invalidate(const char *output_dir, const char *module_name) {
+  char stamp_path[512];
+  cache_stamp_path(stamp_path, sizeof(stamp_path), output_dir, module_name);
+  remove(stamp_path);
+}
+
+bool std_object_cache_path(char *buffer, size_t size, const char *module_name,
+                           uint64_t key) {
+  char cache_dir[768];
+  if (!get_std_cache_path(cache_dir, sizeof(cache_dir)))
+    return false;
+  snprintf(buffer, size, "%s%c%s-%016llx.o", cache_dir, PATH_SEPARATOR,
+           module_name, (unsigned long long)key);
+  return true;
+}
+
+bool object_cache_copy(const char *from, const char *to) {
+  FILE *in = fopen(from, "rb");
+  if (!in)
+    return false;
+
+  // Write beside the target and rename, so concurrent builds sharing the std
+  // cache never see a half-written object.
+#if defined(__MINGW32__) || defined(_WIN32)
+  long pid = (long)GetCurrentProcessId();
+#else
+  long pid = (long)getpid();
+#endif
+  char temp_path[1024];
+  snprintf(temp_path, sizeof(temp_path), "%s.tmp%ld", to, pid);
+
+  FILE *out = fopen(temp_path, "wb");
+  if (!out) {
+    fclose(in);
+    return false;
+  }
+
+  char buffer[64 * 1024];
+  size_t n;
+  bool ok = true;
+  while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+    if (fwrite(buffer, 1, n, out) != n) {
+      ok = false;
+      break;
+    }
+  }
+  ok = ok && !ferror(in);
+  fclose(in);
+  ok = fclose(out) == 0 && ok;
+
+  if (ok) {
+    remove(to);
+    ok = rename(temp_path, to) == 0;
+  }
+  if (!ok)
+    remove(temp_path);
+  return ok;
+}
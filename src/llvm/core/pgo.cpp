@@ -0,0 +1,76 @@
+// pgo.cpp - Pass pipelines with profile-guided optimization
+//
+// LLVMRunPasses has no way to hand PGOOptions to the PassBuilder, and both
+// the instrumentation (-fprofile-generate) and the profile loader
+// (-fprofile-use=) are driven by them, so instrumented and profile-using
+// builds run their pipeline through this shim instead.
+#include "llvm-c/Core.h"
+#include "llvm-c/TargetMachine.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include <string>
+
+// Instrumented programs write one raw profile per binary (%m) into the
+// requested directory, or the working directory
+static std::string raw_profile_file(const char *directory) {
+  llvm::SmallString<256> path(directory ? directory : "");
+  llvm::sys::path::append(path, "default_%m.profraw");
+  return std::string(path);
+}
+
+extern "C" bool run_profile_passes(LLVMModuleRef module_ref,
+                                   LLVMTargetMachineRef machine_ref,
+                                   const char *pipeline, int opt_level,
+                                   bool instrument, const char *profile_path,
+                                   char **error_message) {
+  llvm::Module *module = llvm::unwrap(module_ref);
+  llvm::TargetMachine *machine =
+      reinterpret_cast<llvm::TargetMachine *>(machine_ref);
+  *error_message = nullptr;
+
+  if (!instrument && !llvm::sys::fs::exists(profile_path)) {
+    *error_message =
+        LLVMCreateMessage(("cannot open profile " + std::string(profile_path))
+                              .c_str());
+    return false;
+  }
+
+  // Same tuning as the LLVMPassBuilderOptions of uninstrumented builds
+  llvm::PipelineTuningOptions tuning;
+  tuning.LoopVectorization = opt_level >= 2;
+  tuning.SLPVectorization = opt_level >= 2;
+  tuning.LoopUnrolling = opt_level >= 2;
+  tuning.MergeFunctions = opt_level >= 3;
+
+  llvm::PGOOptions pgo(
+      instrument ? raw_profile_file(profile_path) : std::string(profile_path),
+      "", "", "", llvm::vfs::getRealFileSystem(),
+      instrument ? llvm::PGOOptions::IRInstr : llvm::PGOOptions::IRUse);
+
+  llvm::LoopAnalysisManager lam;
+  llvm::FunctionAnalysisManager fam;
+  llvm::CGSCCAnalysisManager cgam;
+  llvm::ModuleAnalysisManager mam;
+
+  llvm::PassBuilder builder(machine, tuning, pgo);
+  builder.registerModuleAnalyses(mam);
+  builder.registerCGSCCAnalyses(cgam);
+  builder.registerFunctionAnalyses(fam);
+  builder.registerLoopAnalyses(lam);
+  builder.crossRegisterProxies(lam, fam, cgam, mam);
+
+  llvm::ModulePassManager passes;
+  if (llvm::Error err = builder.parsePassPipeline(passes, pipeline)) {
+    *error_message =
+        LLVMCreateMessage(llvm::toString(std::move(err)).c_str());
+    return false;
+  }
+
+  passes.run(*module, mam);
+  return true;
+}
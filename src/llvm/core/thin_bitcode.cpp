@@ -0,0 +1,32 @@
+// thin_bitcode.cpp - Bitcode output with a ThinLTO module summary
+//
+// The C API can only write plain bitcode. ThinLTO needs the per-module
+// summary index next to the IR so the linker can plan cross-module imports
+// without loading every module, so this small shim calls the C++ writer.
+#include "llvm-c/Core.h"
+#include "llvm/Analysis/ModuleSummaryAnalysis.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/ModuleSummaryIndex.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+extern "C" bool write_thin_bitcode_file(LLVMModuleRef module_ref,
+                                        const char *path) {
+  llvm::Module *module = llvm::unwrap(module_ref);
+
+  std::error_code ec;
+  llvm::raw_fd_ostream out(path, ec, llvm::sys::fs::OF_None);
+  if (ec)
+    return false;
+
+  // No profile data: the summary builder still expects a (empty) PSI
+  llvm::ProfileSummaryInfo psi(*module);
+  llvm::ModuleSummaryIndex index =
+      llvm::buildModuleSummaryIndex(*module, nullptr, &psi);
+  llvm::WriteBitcodeToFile(*module, out, false, &index);
+
+  out.close();
+  return !out.has_error();
+}
@@ -43,25 +43,107 @@ LLVMValueRef convert_value_to_type(CodeGenContext *ctx, LLVMValueRef value,
     return LLVMBuildFPToSI(ctx->builder, value, to_type, "fptosi");
   }
 
+  // Arrays decay to a pointer to their first element. A loaded array
+  // variable decays to the variable itself; anything else, such as a literal
+  // passed straight to a `*T` parameter, is spilled to an entry-block
+  // temporary that lives until the function returns.
+  if (from_kind == LLVMArrayTypeKind && to_kind == LLVMPointerTypeKind) {
+    LLVMValueRef storage;
+    if (LLVMIsALoadInst(value) && !LLVMGetVolatile(value)) {
+      storage = LLVMGetOperand(value, 0);
+    } else {
+      storage = entry_alloca(ctx, from_type, "array_decay");
+      LLVMBuildStore(ctx->builder, value, storage);
+    }
+    LLVMValueRef zero = LLVMConstInt(LLVMInt32TypeInContext(ctx->context), 0,
+                                     false);
+    LLVMValueRef indices[2] = {zero, zero};
+    return LLVMBuildGEP2(ctx->builder, from_type, storage, indices, 2,
+                         "decay");
+  }
+
   // If no conversion available, return NULL to signal error
   return NULL;
 }
 
-// Array bounds checking helper (optional)
-bool check_array_bounds_runtime(CodeGenContext *ctx, LLVMValueRef array_ptr,
-                                LLVMTypeRef array_type, LLVMValueRef index,
-                                const char *var_name) {
-  (void)ctx;
-  (void)array_ptr;
-  if (LLVMGetTypeKind(array_type) != LLVMArrayTypeKind) {
+// Runtime bounds checks (-fbounds-check). Each check is one unsigned
+// compare, so a negative index fails it too, and a branch weighted towards
+// the in-range side. Out-of-range indices go to one llvm.trap block per
+// function, which the backend lays out away from the hot path.
+
+#define BOUNDS_LOOP_SITES 64
+
+// A check in a counted loop's body whose index is the loop counter
+typedef struct {
+  LLVMValueRef branch;
+  unsigned long long length;
+} BoundsSite;
+
+struct BoundsLoop {
+  LLVMValueRef counter;     // The counter's alloca
+  unsigned long long upper; // The counter stays below this in the body
+  LLVMValueRef prior_stores[4]; // Stores to the counter before the loop
+  size_t prior_store_count;
+  BoundsSite sites[BOUNDS_LOOP_SITES];
+  size_t site_count;
+  struct BoundsLoop *outer;
+};
+
+static LLVMBasicBlockRef bounds_trap_block(CodeGenContext *ctx) {
+  if (ctx->bounds_trap && ctx->bounds_trap_function == ctx->current_function)
+    return ctx->bounds_trap;
+
+  LLVMBasicBlockRef saved = LLVMGetInsertBlock(ctx->builder);
+  LLVMBasicBlockRef trap = LLVMAppendBasicBlockInContext(
+      ctx->context, ctx->current_function, "bounds_trap");
+  LLVMPositionBuilderAtEnd(ctx->builder, trap);
+
+  LLVMModuleRef module =
+      ctx->current_module ? ctx->current_module->module : ctx->module;
+  unsigned id = LLVMLookupIntrinsicID("llvm.trap", 9);
+  LLVMValueRef intrinsic = LLVMGetIntrinsicDeclaration(module, id, NULL, 0);
+  LLVMBuildCall2(ctx->builder, LLVMIntrinsicGetType(ctx->context, id, NULL, 0),
+                 intrinsic, NULL, 0, "");
+  LLVMBuildUnreachable(ctx->builder);
+
+  LLVMPositionBuilderAtEnd(ctx->builder, saved);
+  ctx->bounds_trap = trap;
+  ctx->bounds_trap_function = ctx->current_function;
+  return trap;
+}
+
+// !prof branch_weights making the first successor the likely one
+static void set_likely_first(CodeGenContext *ctx, LLVMValueRef branch) {
+  LLVMTypeRef i32 = LLVMInt32TypeInContext(ctx->context);
+  LLVMMetadataRef weights[3] = {
+      LLVMMDStringInContext2(ctx->context, "branch_weights", 14),
+      LLVMValueAsMetadata(LLVMConstInt(i32, 1 << 20, false)),
+      LLVMValueAsMetadata(LLVMConstInt(i32, 1, false)),
+  };
+  LLVMSetMetadata(branch, LLVMGetMDKindIDInContext(ctx->context, "prof", 4),
+                  LLVMMetadataAsValue(
+                      ctx->context, LLVMMDNodeInContext2(ctx->context,
+                                                         weights, 3)));
+}
+
+// The alloca an index was loaded from, looking through integer casts
+static LLVMValueRef index_source(LLVMValueRef index) {
+  while (LLVMIsASExtInst(index) || LLVMIsAZExtInst(index) ||
+         LLVMIsATruncInst(index))
+    index = LLVMGetOperand(index, 0);
+  return LLVMIsALoadInst(index) ? LLVMGetOperand(index, 0) : NULL;
+}
+
+bool check_array_bounds_runtime(CodeGenContext *ctx, LLVMTypeRef array_type,
+                                LLVMValueRef index, const char *var_name) {
+  if (!ctx->bounds_check || LLVMGetTypeKind(array_type) != LLVMArrayTypeKind ||
+      LLVMGetTypeKind(LLVMTypeOf(index)) != LLVMIntegerTypeKind) {
     return true; // Can't check bounds for non-arrays
   }
 
   unsigned array_length = LLVMGetArrayLength(array_type);
 
-  // Only check if index is a constant
-  if (LLVMIsConstant(index) &&
-      LLVMGetTypeKind(LLVMTypeOf(index)) == LLVMIntegerTypeKind) {
+  if (LLVMIsAConstantInt(index)) {
     long long index_val = LLVMConstIntGetSExtValue(index);
 
     if (index_val < 0) {
@@ -77,14 +159,178 @@ bool check_array_bounds_runtime(CodeGenContext *ctx, LLVMValueRef array_ptr,
           index_val, var_name ? var_name : "unknown", array_length);
       return false;
     }
+    return true;
+  }
+
+  if (!ctx->current_function || !LLVMGetInsertBlock(ctx->builder))
+    return true;
+
+  // Compared at the index's own width when the length fits in it, so a
+  // negative signed index reads as a huge unsigned one
+  LLVMTypeRef index_type = LLVMTypeOf(index);
+  unsigned width = LLVMGetIntTypeWidth(index_type);
+  if (width < 64 && (unsigned long long)array_length >> width) {
+    index_type = LLVMInt64TypeInContext(ctx->context);
+    index = LLVMBuildZExt(ctx->builder, index, index_type, "bounds_index");
+  }
+  LLVMValueRef in_range = LLVMBuildICmp(
+      ctx->builder, LLVMIntULT, index,
+      LLVMConstInt(index_type, array_length, false), "in_bounds");
+
+  LLVMBasicBlockRef ok = LLVMAppendBasicBlockInContext(
+      ctx->context, ctx->current_function, "bounds_ok");
+  LLVMValueRef branch =
+      LLVMBuildCondBr(ctx->builder, in_range, ok, bounds_trap_block(ctx));
+  set_likely_first(ctx, branch);
+  LLVMPositionBuilderAtEnd(ctx->builder, ok);
+
+  // Indexed by the counter of an enclosing counted loop: the loop decides
+  // once its body is generated whether the check can go
+  LLVMValueRef source = index_source(index);
+  for (struct BoundsLoop *loop = ctx->bounds_loop; source && loop;
+       loop = loop->outer) {
+    if (loop->counter != source)
+      continue;
+    if (loop->site_count < BOUNDS_LOOP_SITES)
+      loop->sites[loop->site_count++] = (BoundsSite){branch, array_length};
+    break;
+  }
+  return true;
+}
+
+static bool nonnegative_int_literal(AstNode *node, long long *value) {
+  if (!node || node->type != AST_EXPR_LITERAL ||
+      node->expr.literal.lit_type != LITERAL_INT ||
+      node->expr.literal.value.int_val < 0)
+    return false;
+  *value = node->expr.literal.value.int_val;
+  return true;
+}
+
+static bool names(AstNode *node, const char *name) {
+  return node && node->type == AST_EXPR_IDENTIFIER &&
+         strcmp(node->expr.identifier.name, name) == 0;
+}
+
+// ++i, i++ or i = i + 1
+static bool increments_by_one(AstNode *step, const char *name) {
+  long long one;
+  if (!step)
+    return false;
+  if (step->type == AST_EXPR_UNARY)
+    return (step->expr.unary.op == UNOP_PRE_INC ||
+            step->expr.unary.op == UNOP_POST_INC) &&
+           names(step->expr.unary.operand, name);
+  if (step->type != AST_EXPR_ASSIGNMENT ||
+      !names(step->expr.assignment.target, name))
+    return false;
+  AstNode *sum = step->expr.assignment.value;
+  if (!sum || sum->type != AST_EXPR_BINARY || sum->expr.binary.op != BINOP_ADD)
+    return false;
+  return (names(sum->expr.binary.left, name) &&
+          nonnegative_int_literal(sum->expr.binary.right, &one) && one == 1) ||
+         (names(sum->expr.binary.right, name) &&
+          nonnegative_int_literal(sum->expr.binary.left, &one) && one == 1);
+}
+
+// Called after the loop's initializers are generated, before its condition
+struct BoundsLoop *begin_bounds_loop(CodeGenContext *ctx, AstNode *loop) {
+  if (!ctx->bounds_check || loop->stmt.loop_stmt.init_count != 1)
+    return NULL;
+
+  // loop [i: T = start](i < end) : (++i) with constants 0 <= start
+  AstNode *init = loop->stmt.loop_stmt.initializer[0];
+  AstNode *cond = loop->stmt.loop_stmt.condition;
+  long long start, end;
+  if (!init || init->type != AST_STMT_VAR_DECL ||
+      !nonnegative_int_literal(init->stmt.var_decl.initializer, &start) ||
+      !cond || cond->type != AST_EXPR_BINARY ||
+      (cond->expr.binary.op != BINOP_LT && cond->expr.binary.op != BINOP_LE) ||
+      !nonnegative_int_literal(cond->expr.binary.right, &end))
+    return NULL;
+  const char *name = init->stmt.var_decl.name;
+  if (!names(cond->expr.binary.left, name) ||
+      !increments_by_one(loop->stmt.loop_stmt.optional, name))
+    return NULL;
+
+  LLVM_Symbol *sym = find_symbol(ctx, name);
+  if (!sym || sym->is_function || !LLVMIsAAllocaInst(sym->value))
+    return NULL;
+
+  // The step must not wrap the counter negative before the bound is reached
+  unsigned long long upper = (unsigned long long)end +
+                             (cond->expr.binary.op == BINOP_LE ? 1 : 0);
+  LLVMTypeRef counter_type = LLVMGetAllocatedType(sym->value);
+  if (LLVMGetTypeKind(counter_type) != LLVMIntegerTypeKind ||
+      LLVMGetIntTypeWidth(counter_type) > 64 ||
+      upper >= 1ULL << (LLVMGetIntTypeWidth(counter_type) - 1))
+    return NULL;
+
+  // Freed with the codegen arena, so a loop abandoned on an error leaks nothing
+  struct BoundsLoop *bounds = (struct BoundsLoop *)arena_alloc(
+      ctx->arena, sizeof(struct BoundsLoop), alignof(struct BoundsLoop));
+  if (!bounds)
+    return NULL;
+  *bounds = (struct BoundsLoop){.counter = sym->value, .upper = upper};
+
+  for (LLVMUseRef use = LLVMGetFirstUse(sym->value); use;
+       use = LLVMGetNextUse(use)) {
+    LLVMValueRef user = LLVMGetUser(use);
+    if (!LLVMIsAStoreInst(user))
+      continue;
+    if (bounds->prior_store_count == 4)
+      return NULL;
+    bounds->prior_stores[bounds->prior_store_count++] = user;
   }
 
-  // For runtime indices, we could insert runtime bounds checking here
-  // This would involve creating conditional branches and error handling
+  bounds->outer = ctx->bounds_loop;
+  ctx->bounds_loop = bounds;
+  return bounds;
+}
 
+// The counter is only loaded, and stored before the loop and by its step
+static bool counter_is_induction(struct BoundsLoop *loop,
+                                 LLVMBasicBlockRef increment_block) {
+  for (LLVMUseRef use = LLVMGetFirstUse(loop->counter); use;
+       use = LLVMGetNextUse(use)) {
+    LLVMValueRef user = LLVMGetUser(use);
+    if (LLVMIsALoadInst(user))
+      continue;
+    if (!LLVMIsAStoreInst(user) || LLVMGetOperand(user, 1) != loop->counter)
+      return false; // Escapes, e.g. its address is taken
+    if (LLVMGetInstructionParent(user) == increment_block)
+      continue;
+    bool prior = false;
+    for (size_t i = 0; i < loop->prior_store_count; i++)
+      prior |= loop->prior_stores[i] == user;
+    if (!prior)
+      return false;
+  }
   return true;
 }
 
+// Called once the body and step are generated: in the body the counter is
+// in [start, upper), so a check against a length >= upper always passes
+void end_bounds_loop(CodeGenContext *ctx, struct BoundsLoop *loop,
+                     LLVMBasicBlockRef increment_block) {
+  if (!loop)
+    return;
+  ctx->bounds_loop = loop->outer;
+
+  if (counter_is_induction(loop, increment_block)) {
+    LLVMValueRef always = LLVMConstInt(LLVMInt1TypeInContext(ctx->context), 1,
+                                       false);
+    for (size_t i = 0; i < loop->site_count; i++) {
+      if (loop->sites[i].length < loop->upper)
+        continue;
+      LLVMValueRef compare = LLVMGetCondition(loop->sites[i].branch);
+      LLVMSetCondition(loop->sites[i].branch, always);
+      if (!LLVMGetFirstUse(compare))
+        LLVMInstructionEraseFromParent(compare);
+    }
+  }
+}
+
 // Multi-dimensional array support
 LLVMValueRef codegen_multidim_array_access(CodeGenContext *ctx,
                                            AstNode *base_expr,
@@ -106,6 +352,8 @@ LLVMValueRef codegen_multidim_array_access(CodeGenContext *ctx,
 
     if (current_kind == LLVMArrayTypeKind) {
       LLVMTypeRef element_type = LLVMGetElementType(current_type);
+      if (!check_array_bounds_runtime(ctx, current_type, index, NULL))
+        return NULL;
 
       // Store array and get pointer for GEP
       LLVMValueRef array_alloca =
@@ -15,18 +15,42 @@ static LLVMValueRef codegen_bitwise_op(CodeGenContext *ctx, BinaryOp op,
                                        bool is_float);
 static void promote_operands(CodeGenContext *ctx, LLVMValueRef *left, LLVMValueRef *right,
                              LLVMTypeRef *left_type, LLVMTypeRef *right_type);
+static LLVMValueRef codegen_short_circuit(CodeGenContext *ctx, AstNode *node,
+                                          LLVMValueRef left);
 
 // Main entry point - routes to specialized handlers
 LLVMValueRef codegen_expr_binary(CodeGenContext *ctx, AstNode *node) {
     LLVMValueRef left = codegen_expr(ctx, node->expr.binary.left);
+    if (!left) return NULL;
+
+    // `a && b` only evaluates b when a is true, `a || b` only when a is
+    // false, so guards like `i < n && data[i] != 0` never read past the end
+    BinaryOp logical_op = node->expr.binary.op;
+    if ((logical_op == BINOP_AND || logical_op == BINOP_OR) &&
+        LLVMTypeOf(left) == LLVMInt1TypeInContext(ctx->context) &&
+        LLVMGetInsertBlock(ctx->builder)) {
+        return codegen_short_circuit(ctx, node, left);
+    }
+
     LLVMValueRef right = codegen_expr(ctx, node->expr.binary.right);
 
     if (!left || !right) return NULL;
 
     LLVMTypeRef left_type = LLVMTypeOf(left);
     LLVMTypeRef right_type = LLVMTypeOf(right);
-    
-    bool is_float_op = is_float_type(left_type) || is_float_type(right_type);
+
+    // A scalar next to a vector applies to every lane
+    if (LLVMGetTypeKind(left_type) == LLVMVectorTypeKind) {
+        if (right_type != left_type)
+            right = splat_vector(ctx, right, left_type);
+        right_type = left_type;
+    } else if (LLVMGetTypeKind(right_type) == LLVMVectorTypeKind) {
+        left = splat_vector(ctx, left, right_type);
+        left_type = right_type;
+    }
+
+    bool is_float_op = is_float_type(lane_type(left_type)) ||
+                       is_float_type(lane_type(right_type));
 
     // Promote types if needed
     if (is_float_op) {
@@ -79,21 +103,28 @@ static void promote_operands(CodeGenContext *ctx, LLVMValueRef *left, LLVMValueR
 }
 
 // Arithmetic operations: +, -, *, /, %
+// Integers are signed: int overflow is undefined, which lets LLVM widen and
+// vectorize induction variables
 static LLVMValueRef codegen_arithmetic_op(CodeGenContext *ctx, BinaryOp op,
                                           LLVMValueRef left, LLVMValueRef right,
                                           bool is_float) {
+    bool nsw = !is_float && int_overflow_is_undefined(LLVMTypeOf(left));
+
     switch (op) {
     case BINOP_ADD:
-        return is_float ? LLVMBuildFAdd(ctx->builder, left, right, "fadd")
-                        : LLVMBuildAdd(ctx->builder, left, right, "add");
+        if (is_float) return LLVMBuildFAdd(ctx->builder, left, right, "fadd");
+        return nsw ? LLVMBuildNSWAdd(ctx->builder, left, right, "add")
+                   : LLVMBuildAdd(ctx->builder, left, right, "add");
 
     case BINOP_SUB:
-        return is_float ? LLVMBuildFSub(ctx->builder, left, right, "fsub")
-                        : LLVMBuildSub(ctx->builder, left, right, "sub");
+        if (is_float) return LLVMBuildFSub(ctx->builder, left, right, "fsub");
+        return nsw ? LLVMBuildNSWSub(ctx->builder, left, right, "sub")
+                   : LLVMBuildSub(ctx->builder, left, right, "sub");
 
     case BINOP_MUL:
-        return is_float ? LLVMBuildFMul(ctx->builder, left, right, "fmul")
-                        : LLVMBuildMul(ctx->builder, left, right, "mul");
+        if (is_float) return LLVMBuildFMul(ctx->builder, left, right, "fmul");
+        return nsw ? LLVMBuildNSWMul(ctx->builder, left, right, "mul")
+                   : LLVMBuildMul(ctx->builder, left, right, "mul");
 
     case BINOP_DIV:
         return is_float ? LLVMBuildFDiv(ctx->builder, left, right, "fdiv")
@@ -161,6 +192,49 @@ static LLVMValueRef codegen_comparison_op(CodeGenContext *ctx, BinaryOp op,
     }
 }
 
+// Short-circuit && and || on bools: the right operand gets its own block,
+// reached only when the left one doesn't already decide the result
+static LLVMValueRef codegen_short_circuit(CodeGenContext *ctx, AstNode *node,
+                                          LLVMValueRef left) {
+    bool is_and = node->expr.binary.op == BINOP_AND;
+    LLVMTypeRef bool_type = LLVMInt1TypeInContext(ctx->context);
+
+    LLVMBasicBlockRef left_block = LLVMGetInsertBlock(ctx->builder);
+    LLVMValueRef function = LLVMGetBasicBlockParent(left_block);
+    LLVMBasicBlockRef right_block =
+        LLVMAppendBasicBlockInContext(ctx->context, function, is_and ? "and_rhs" : "or_rhs");
+    LLVMBasicBlockRef merge_block =
+        LLVMAppendBasicBlockInContext(ctx->context, function, is_and ? "and_end" : "or_end");
+
+    if (is_and) {
+        LLVMBuildCondBr(ctx->builder, left, right_block, merge_block);
+    } else {
+        LLVMBuildCondBr(ctx->builder, left, merge_block, right_block);
+    }
+
+    LLVMPositionBuilderAtEnd(ctx->builder, right_block);
+    LLVMValueRef right = codegen_expr(ctx, node->expr.binary.right);
+    if (!right) return NULL;
+    if (LLVMTypeOf(right) != bool_type) {
+        if (!is_int_type(LLVMTypeOf(right))) {
+            fprintf(stderr, "Error: Logical operations need bool operands\n");
+            return NULL;
+        }
+        right = LLVMBuildICmp(ctx->builder, LLVMIntNE, right,
+                              LLVMConstNull(LLVMTypeOf(right)), "tobool");
+    }
+    // The right operand may have branched itself (a nested && or ||)
+    LLVMBasicBlockRef right_end = LLVMGetInsertBlock(ctx->builder);
+    LLVMBuildBr(ctx->builder, merge_block);
+
+    LLVMPositionBuilderAtEnd(ctx->builder, merge_block);
+    LLVMValueRef phi = LLVMBuildPhi(ctx->builder, bool_type, is_and ? "and" : "or");
+    LLVMValueRef incoming[2] = {LLVMConstInt(bool_type, is_and ? 0 : 1, false), right};
+    LLVMBasicBlockRef blocks[2] = {left_block, right_end};
+    LLVMAddIncoming(phi, incoming, blocks, 2);
+    return phi;
+}
+
 // Logical operations: &&, ||
 static LLVMValueRef codegen_logical_op(CodeGenContext *ctx, BinaryOp op,
                                        LLVMValueRef left, LLVMValueRef right,
@@ -0,0 +1,321 @@
+#include "../../ast/ast_utils.h"
+#include "../llvm.h"
+
+// Compiler builtins lower straight to LLVM intrinsics, so @memcpy becomes
+// whatever the target copies memory with, @popcount one popcnt, and
+// @expect the branch weights the optimizer lays blocks out by.
+
+static LLVMValueRef call_intrinsic(CodeGenContext *ctx, const char *name,
+                                   LLVMTypeRef *overloads,
+                                   size_t overload_count, LLVMValueRef *args,
+                                   unsigned arg_count, const char *label) {
+  LLVMModuleRef module =
+      ctx->current_module ? ctx->current_module->module : ctx->module;
+  unsigned id = LLVMLookupIntrinsicID(name, strlen(name));
+  LLVMValueRef intrinsic =
+      LLVMGetIntrinsicDeclaration(module, id, overloads, overload_count);
+  LLVMTypeRef type =
+      LLVMIntrinsicGetType(ctx->context, id, overloads, overload_count);
+  return LLVMBuildCall2(ctx->builder, type, intrinsic, args, arg_count, label);
+}
+
+LLVMValueRef codegen_expr_memcpy(CodeGenContext *ctx, AstNode *node) {
+  LLVMValueRef dest = codegen_expr(ctx, node->expr.memcpy.to);
+  LLVMValueRef src = codegen_expr(ctx, node->expr.memcpy.from);
+  LLVMValueRef size = codegen_expr(ctx, node->expr.memcpy.size);
+  if (!dest || !src || !size)
+    return NULL;
+  return LLVMBuildMemCpy(ctx->builder, dest, 1, src, 1, size);
+}
+
+static LLVMAtomicOrdering llvm_ordering(AtomicOrder order) {
+  switch (order) {
+  case ATOMIC_RELAXED:
+    return LLVMAtomicOrderingMonotonic;
+  case ATOMIC_ACQUIRE:
+    return LLVMAtomicOrderingAcquire;
+  case ATOMIC_RELEASE:
+    return LLVMAtomicOrderingRelease;
+  case ATOMIC_ACQ_REL:
+    return LLVMAtomicOrderingAcquireRelease;
+  case ATOMIC_SEQ_CST:
+    break;
+  }
+  return LLVMAtomicOrderingSequentiallyConsistent;
+}
+
+// The ordering at args[index], seq_cst when it was left out. The
+// typechecker has checked the names.
+static AtomicOrder order_arg(AstNode *node, size_t index) {
+  AtomicOrder order = ATOMIC_SEQ_CST;
+  if (index < node->expr.builtin.arg_count)
+    atomic_order_from_string(
+        node->expr.builtin.args[index]->expr.identifier.name, &order);
+  return order;
+}
+
+static LLVMAtomicRMWBinOp llvm_rmw_op(AtomicRmwOp op, bool floating) {
+  switch (op) {
+  case ATOMIC_RMW_XCHG:
+    return LLVMAtomicRMWBinOpXchg;
+  case ATOMIC_RMW_ADD:
+    return floating ? LLVMAtomicRMWBinOpFAdd : LLVMAtomicRMWBinOpAdd;
+  case ATOMIC_RMW_SUB:
+    return floating ? LLVMAtomicRMWBinOpFSub : LLVMAtomicRMWBinOpSub;
+  case ATOMIC_RMW_AND:
+    return LLVMAtomicRMWBinOpAnd;
+  case ATOMIC_RMW_OR:
+    return LLVMAtomicRMWBinOpOr;
+  case ATOMIC_RMW_XOR:
+    return LLVMAtomicRMWBinOpXor;
+  case ATOMIC_RMW_NAND:
+    return LLVMAtomicRMWBinOpNand;
+  case ATOMIC_RMW_MIN:
+    return LLVMAtomicRMWBinOpMin;
+  case ATOMIC_RMW_MAX:
+    break;
+  }
+  return LLVMAtomicRMWBinOpMax;
+}
+
+static bool is_floating(LLVMTypeRef type) {
+  LLVMTypeKind kind = LLVMGetTypeKind(type);
+  return kind == LLVMFloatTypeKind || kind == LLVMDoubleTypeKind;
+}
+
+// An operand of the atomic at arg, converted to the pointee's type
+static LLVMValueRef atomic_operand(CodeGenContext *ctx, AstNode *arg,
+                                   LLVMTypeRef type) {
+  LLVMValueRef value = codegen_expr(ctx, arg);
+  if (!value)
+    return NULL;
+  LLVMTypeRef from = LLVMTypeOf(value);
+  return from == type ? value
+                      : convert_value_to_type(ctx, value, from, type);
+}
+
+// Atomics lower to LLVM's atomic instructions rather than intrinsics. Each
+// is aligned to its own size, which is what makes it a single lock-free
+// instruction instead of a call into libatomic.
+static LLVMValueRef codegen_atomic_builtin(CodeGenContext *ctx,
+                                           AstNode *node) {
+  BuiltinKind kind = node->expr.builtin.kind;
+  AstNode **arg_nodes = node->expr.builtin.args;
+
+  if (kind == BUILTIN_FENCE)
+    return LLVMBuildFence(ctx->builder, llvm_ordering(order_arg(node, 0)),
+                          false, "");
+
+  LLVMValueRef ptr = codegen_expr(ctx, arg_nodes[0]);
+  LLVMTypeRef type = codegen_checked_element_type(ctx, arg_nodes[0]);
+  if (!ptr || !type) {
+    fprintf(stderr, "Error: %s needs a pointer to a known type\n",
+            builtin_to_string(kind));
+    return NULL;
+  }
+  unsigned align = (unsigned)LLVMStoreSizeOfType(get_target_data(ctx), type);
+
+  LLVMValueRef result = NULL;
+  switch (kind) {
+  case BUILTIN_ATOMIC_LOAD:
+    result = LLVMBuildLoad2(ctx->builder, type, ptr, "atomic_load");
+    LLVMSetOrdering(result, llvm_ordering(order_arg(node, 1)));
+    break;
+
+  case BUILTIN_ATOMIC_STORE: {
+    LLVMValueRef value = atomic_operand(ctx, arg_nodes[1], type);
+    if (!value)
+      return NULL;
+    result = LLVMBuildStore(ctx->builder, value, ptr);
+    LLVMSetOrdering(result, llvm_ordering(order_arg(node, 2)));
+    break;
+  }
+
+  case BUILTIN_ATOMIC_RMW: {
+    AtomicRmwOp op = ATOMIC_RMW_XCHG;
+    atomic_rmw_op_from_string(arg_nodes[1]->expr.identifier.name, &op);
+    LLVMValueRef value = atomic_operand(ctx, arg_nodes[2], type);
+    if (!value)
+      return NULL;
+    result = LLVMBuildAtomicRMW(ctx->builder,
+                                llvm_rmw_op(op, is_floating(type)), ptr,
+                                value, llvm_ordering(order_arg(node, 3)),
+                                false);
+    break;
+  }
+
+  case BUILTIN_ATOMIC_CAS: {
+    LLVMValueRef expected = atomic_operand(ctx, arg_nodes[1], type);
+    LLVMValueRef desired = atomic_operand(ctx, arg_nodes[2], type);
+    if (!expected || !desired)
+      return NULL;
+    // Without a failure ordering, the load half of the success one
+    AtomicOrder success = order_arg(node, 3);
+    AtomicOrder failure = success == ATOMIC_ACQ_REL   ? ATOMIC_ACQUIRE
+                          : success == ATOMIC_RELEASE ? ATOMIC_RELAXED
+                                                      : success;
+    if (node->expr.builtin.arg_count == 5)
+      failure = order_arg(node, 4);
+    // cmpxchg compares integers, so floating point values compare by their
+    // bits: -0.0 isn't 0.0, and a NaN matches the same NaN
+    bool floating = is_floating(type);
+    if (floating) {
+      LLVMTypeRef bits = LLVMIntTypeInContext(ctx->context, align * 8);
+      expected = LLVMBuildBitCast(ctx->builder, expected, bits, "");
+      desired = LLVMBuildBitCast(ctx->builder, desired, bits, "");
+    }
+    LLVMValueRef pair = LLVMBuildAtomicCmpXchg(
+        ctx->builder, ptr, expected, desired, llvm_ordering(success),
+        llvm_ordering(failure), false);
+    LLVMSetAlignment(pair, align);
+    // The value found; the exchange happened when it equals expected
+    LLVMValueRef old = LLVMBuildExtractValue(ctx->builder, pair, 0, "cas_old");
+    return floating ? LLVMBuildBitCast(ctx->builder, old, type, "") : old;
+  }
+
+  default:
+    fprintf(stderr, "Error: Unknown builtin %d\n", (int)kind);
+    return NULL;
+  }
+
+  LLVMSetAlignment(result, align);
+  return result;
+}
+
+LLVMValueRef codegen_expr_builtin(CodeGenContext *ctx, AstNode *node) {
+  BuiltinKind kind = node->expr.builtin.kind;
+  AstNode **arg_nodes = node->expr.builtin.args;
+  LLVMValueRef args[3] = {NULL, NULL, NULL};
+
+  if (kind >= BUILTIN_ATOMIC_LOAD)
+    return codegen_atomic_builtin(ctx, node);
+
+  // A cycle count: rdtsc on x86, the virtual counter on ARM
+  if (kind == BUILTIN_RDTSC)
+    return call_intrinsic(ctx, "llvm.readcyclecounter", NULL, 0, NULL, 0,
+                          "cycles");
+
+  // @expect and @prefetch take literals, read from the AST below
+  size_t evaluated = node->expr.builtin.arg_count;
+  if (kind == BUILTIN_EXPECT || kind == BUILTIN_PREFETCH)
+    evaluated = 1;
+  for (size_t i = 0; i < evaluated && i < 3; i++) {
+    args[i] = codegen_expr(ctx, arg_nodes[i]);
+    if (!args[i])
+      return NULL;
+  }
+
+  LLVMTypeRef type = LLVMTypeOf(args[0]);
+  LLVMTypeRef i1 = LLVMInt1TypeInContext(ctx->context);
+  LLVMTypeRef i32 = ctx->common_types.i32;
+
+  switch (kind) {
+  case BUILTIN_MEMMOVE:
+    return LLVMBuildMemMove(ctx->builder, args[0], 1, args[1], 1, args[2]);
+
+  case BUILTIN_MEMSET: {
+    // Only the low byte of the value is stored
+    LLVMTypeRef i8 = LLVMInt8TypeInContext(ctx->context);
+    LLVMValueRef byte = LLVMTypeOf(args[1]) == i8
+                            ? args[1]
+                            : LLVMBuildTrunc(ctx->builder, args[1], i8, "byte");
+    return LLVMBuildMemSet(ctx->builder, args[0], byte, args[2], 1);
+  }
+
+  case BUILTIN_CLZ:
+  case BUILTIN_CTZ: {
+    // Defined for zero too: the bit width
+    LLVMValueRef call_args[2] = {args[0], LLVMConstInt(i1, 0, false)};
+    return call_intrinsic(ctx, kind == BUILTIN_CLZ ? "llvm.ctlz" : "llvm.cttz",
+                          &type, 1, call_args, 2,
+                          kind == BUILTIN_CLZ ? "clz" : "ctz");
+  }
+
+  case BUILTIN_POPCOUNT:
+    return call_intrinsic(ctx, "llvm.ctpop", &type, 1, args, 1, "popcount");
+
+  case BUILTIN_BSWAP:
+    // A single byte is its own byte swap
+    if (LLVMGetIntTypeWidth(type) == 8)
+      return args[0];
+    return call_intrinsic(ctx, "llvm.bswap", &type, 1, args, 1, "bswap");
+
+  case BUILTIN_EXPECT:
+  case BUILTIN_LIKELY:
+  case BUILTIN_UNLIKELY: {
+    unsigned long long expected = kind == BUILTIN_LIKELY;
+    if (kind == BUILTIN_EXPECT) {
+      AstNode *literal = arg_nodes[1];
+      expected = literal->expr.literal.lit_type == LITERAL_BOOL
+                     ? literal->expr.literal.value.bool_val
+                     : (unsigned long long)literal->expr.literal.value.int_val;
+    }
+    LLVMValueRef call_args[2] = {args[0], LLVMConstInt(type, expected, true)};
+    return call_intrinsic(ctx, "llvm.expect", &type, 1, call_args, 2,
+                          "expect");
+  }
+
+  case BUILTIN_ASSUME:
+    return call_intrinsic(ctx, "llvm.assume", NULL, 0, args, 1, "");
+
+  case BUILTIN_BLACK_BOX: {
+    // The value goes through memory that an empty asm statement may have
+    // read and rewritten, so the optimizer can neither see what it is nor
+    // drop the code that computed it
+    LLVMValueRef slot = entry_alloca(ctx, type, "black_box");
+    LLVMBuildStore(ctx->builder, args[0], slot);
+    LLVMTypeRef ptr_type = LLVMTypeOf(slot);
+    LLVMTypeRef asm_type =
+        LLVMFunctionType(LLVMVoidTypeInContext(ctx->context), &ptr_type, 1,
+                         false);
+    const char *constraints = "r,~{memory}";
+    LLVMValueRef barrier = LLVMGetInlineAsm(
+        asm_type, "", 0, (char *)constraints, strlen(constraints), true, false,
+        LLVMInlineAsmDialectATT, false);
+    LLVMBuildCall2(ctx->builder, asm_type, barrier, &slot, 1, "");
+    return LLVMBuildLoad2(ctx->builder, type, slot, "opaque");
+  }
+
+  case BUILTIN_WRAPPING_ADD:
+  case BUILTIN_WRAPPING_SUB:
+  case BUILTIN_WRAPPING_MUL: {
+    // Plain add/sub/mul without nsw: the result wraps modulo 2^bits
+    LLVMValueRef right = args[1];
+    if (LLVMTypeOf(right) != type)
+      right = LLVMBuildIntCast2(ctx->builder, right, type, true, "");
+    if (kind == BUILTIN_WRAPPING_ADD)
+      return LLVMBuildAdd(ctx->builder, args[0], right, "wrapping_add");
+    if (kind == BUILTIN_WRAPPING_SUB)
+      return LLVMBuildSub(ctx->builder, args[0], right, "wrapping_sub");
+    return LLVMBuildMul(ctx->builder, args[0], right, "wrapping_mul");
+  }
+
+  case BUILTIN_PREFETCH: {
+    // Defaults to a read kept in every cache level
+    long long rw = 0;
+    long long locality = 3;
+    if (node->expr.builtin.arg_count == 3) {
+      rw = arg_nodes[1]->expr.literal.value.int_val;
+      locality = arg_nodes[2]->expr.literal.value.int_val;
+    }
+    LLVMValueRef call_args[4] = {
+        args[0], LLVMConstInt(i32, (unsigned long long)rw, false),
+        LLVMConstInt(i32, (unsigned long long)locality, false),
+        LLVMConstInt(i32, 1, false)}; // data, not instruction, cache
+    return call_intrinsic(ctx, "llvm.prefetch", &type, 1, call_args, 4, "");
+  }
+
+  case BUILTIN_RDTSC:
+    break; // lowered above, before the arguments
+
+  case BUILTIN_ATOMIC_LOAD:
+  case BUILTIN_ATOMIC_STORE:
+  case BUILTIN_ATOMIC_RMW:
+  case BUILTIN_ATOMIC_CAS:
+  case BUILTIN_FENCE:
+    break; // codegen_atomic_builtin
+  }
+
+  fprintf(stderr, "Error: Unknown builtin %d\n", (int)kind);
+  return NULL;
+}
@@ -0,0 +1,1004 @@
+#include "../llvm.h"
+#include <math.h>
+#include <stdlib.h>
+
+// Top-level const initializers are run here, over the typed AST, when all
+// they do is compute: arithmetic, casts, arrays, other top-level consts and
+// calls to functions of the same module whose bodies stick to locals, ifs
+// and loops. The result becomes the global's initializer, so a lookup table
+// or a size derived from other constants costs nothing at startup. Anything
+// else (memory, I/O, pointers, strings) is left to codegen_expr.
+
+#define COMPTIME_STEP_LIMIT (1 << 24)
+#define COMPTIME_CALL_DEPTH 256
+
+typedef struct ComptimeValue {
+  LLVMTypeRef type; // An integer (i1 for bool), float, double or array type
+  union {
+    long long i;
+    double f;
+    struct ComptimeValue *elements;
+  };
+} ComptimeValue;
+
+typedef struct {
+  const char *name;
+  ComptimeValue value;
+} ComptimeLocal;
+
+typedef enum {
+  FLOW_NEXT,
+  FLOW_BREAK,
+  FLOW_CONTINUE,
+  FLOW_RETURN,
+  FLOW_FAIL
+} Flow;
+
+typedef struct {
+  CodeGenContext *ctx;
+  ModuleCompilationUnit *unit;
+  AstNode *module;
+  ComptimeLocal *locals;
+  size_t local_count;
+  size_t local_capacity;
+  size_t frame; // First local the running function can see
+  ComptimeValue result;
+  size_t steps;
+  int depth;
+  bool exhausted;
+} Comptime;
+
+static bool eval_expr(Comptime *ct, AstNode *expr, ComptimeValue *out);
+static Flow exec_stmt(Comptime *ct, AstNode *stmt);
+
+static bool step(Comptime *ct) {
+  if (++ct->steps <= COMPTIME_STEP_LIMIT)
+    return true;
+  ct->exhausted = true;
+  return false;
+}
+
+static LLVMTypeKind kind_of(const ComptimeValue *value) {
+  return LLVMGetTypeKind(value->type);
+}
+
+static bool is_int(const ComptimeValue *value) {
+  return kind_of(value) == LLVMIntegerTypeKind;
+}
+
+static bool is_real(const ComptimeValue *value) {
+  return kind_of(value) == LLVMFloatTypeKind ||
+         kind_of(value) == LLVMDoubleTypeKind;
+}
+
+// Integers are kept sign-extended from their width, the way signed compares
+// and arithmetic shifts see them
+static long long wrap_int(unsigned long long value, unsigned bits) {
+  if (bits >= 64)
+    return (long long)value;
+  unsigned shift = 64 - bits;
+  return (long long)(value << shift) >> shift;
+}
+
+static ComptimeValue int_value(LLVMTypeRef type, unsigned long long value) {
+  ComptimeValue result = {.type = type};
+  result.i = wrap_int(value, LLVMGetIntTypeWidth(type));
+  return result;
+}
+
+static ComptimeValue real_value(LLVMTypeRef type, double value) {
+  ComptimeValue result = {.type = type};
+  result.f = LLVMGetTypeKind(type) == LLVMFloatTypeKind ? (float)value : value;
+  return result;
+}
+
+static ComptimeValue *alloc_elements(Comptime *ct, size_t count) {
+  return (ComptimeValue *)arena_alloc(ct->ctx->arena,
+                                      sizeof(ComptimeValue) * (count ? count : 1),
+                                      alignof(ComptimeValue));
+}
+
+// Arrays are values: every binding owns its elements
+static ComptimeValue copy_value(Comptime *ct, ComptimeValue value) {
+  if (kind_of(&value) != LLVMArrayTypeKind)
+    return value;
+  unsigned count = LLVMGetArrayLength(value.type);
+  ComptimeValue *elements = alloc_elements(ct, count);
+  for (unsigned i = 0; i < count; i++)
+    elements[i] = copy_value(ct, value.elements[i]);
+  value.elements = elements;
+  return value;
+}
+
+static bool zero_value(Comptime *ct, LLVMTypeRef type, ComptimeValue *out) {
+  switch (LLVMGetTypeKind(type)) {
+  case LLVMIntegerTypeKind:
+    *out = int_value(type, 0);
+    return true;
+  case LLVMFloatTypeKind:
+  case LLVMDoubleTypeKind:
+    *out = real_value(type, 0.0);
+    return true;
+  case LLVMArrayTypeKind: {
+    unsigned count = LLVMGetArrayLength(type);
+    ComptimeValue *elements = alloc_elements(ct, count);
+    for (unsigned i = 0; i < count; i++)
+      if (!zero_value(ct, LLVMGetElementType(type), &elements[i]))
+        return false;
+    out->type = type;
+    out->elements = elements;
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+// The conversions codegen_expr_cast makes: sext or trunc between integers,
+// fptosi and sitofp, fpext and fptrunc; arrays element by element
+static bool convert(Comptime *ct, ComptimeValue *value, LLVMTypeRef to) {
+  if (value->type == to)
+    return true;
+
+  switch (LLVMGetTypeKind(to)) {
+  case LLVMIntegerTypeKind:
+    if (is_int(value)) {
+      *value = int_value(to, (unsigned long long)value->i);
+      return true;
+    }
+    if (is_real(value)) {
+      // Out of range is poison at run time
+      if (isnan(value->f) || value->f >= 9223372036854775808.0 ||
+          value->f < -9223372036854775808.0)
+        return false;
+      *value = int_value(to, (unsigned long long)(long long)value->f);
+      return true;
+    }
+    return false;
+
+  case LLVMFloatTypeKind:
+  case LLVMDoubleTypeKind:
+    if (is_int(value)) {
+      *value = real_value(to, (double)value->i);
+      return true;
+    }
+    if (is_real(value)) {
+      *value = real_value(to, value->f);
+      return true;
+    }
+    return false;
+
+  case LLVMArrayTypeKind: {
+    // A shorter array literal is padded with zeros, as in [int; 4] = [0]
+    unsigned count = LLVMGetArrayLength(to);
+    if (kind_of(value) != LLVMArrayTypeKind ||
+        LLVMGetArrayLength(value->type) > count)
+      return false;
+    LLVMTypeRef element = LLVMGetElementType(to);
+    unsigned given = LLVMGetArrayLength(value->type);
+    ComptimeValue *elements = alloc_elements(ct, count);
+    for (unsigned i = 0; i < count; i++) {
+      if (i < given) {
+        elements[i] = copy_value(ct, value->elements[i]);
+        if (!convert(ct, &elements[i], element))
+          return false;
+      } else if (!zero_value(ct, element, &elements[i])) {
+        return false;
+      }
+    }
+    value->type = to;
+    value->elements = elements;
+    return true;
+  }
+
+  default:
+    return false;
+  }
+}
+
+static LLVMValueRef to_constant(ComptimeValue *value) {
+  switch (kind_of(value)) {
+  case LLVMIntegerTypeKind:
+    return LLVMConstInt(value->type, (unsigned long long)value->i, true);
+  case LLVMFloatTypeKind:
+  case LLVMDoubleTypeKind:
+    return LLVMConstReal(value->type, value->f);
+  case LLVMArrayTypeKind: {
+    unsigned count = LLVMGetArrayLength(value->type);
+    LLVMValueRef *elements = malloc(sizeof(LLVMValueRef) * (count ? count : 1));
+    for (unsigned i = 0; i < count; i++) {
+      elements[i] = to_constant(&value->elements[i]);
+      if (!elements[i]) {
+        free(elements);
+        return NULL;
+      }
+    }
+    LLVMValueRef array =
+        LLVMConstArray(LLVMGetElementType(value->type), elements, count);
+    free(elements);
+    return array;
+  }
+  default:
+    return NULL;
+  }
+}
+
+static bool truthy(const ComptimeValue *value, bool *out) {
+  if (!is_int(value))
+    return false;
+  *out = value->i != 0;
+  return true;
+}
+
+// ---------------------------------------------------------------------------
+// Names: locals of the running function, then the module's top-level consts
+// ---------------------------------------------------------------------------
+
+static ComptimeValue *find_local(Comptime *ct, const char *name) {
+  for (size_t i = ct->local_count; i > ct->frame; i--)
+    if (strcmp(ct->locals[i - 1].name, name) == 0)
+      return &ct->locals[i - 1].value;
+  return NULL;
+}
+
+static void push_local(Comptime *ct, const char *name, ComptimeValue value) {
+  if (ct->local_count == ct->local_capacity) {
+    ct->local_capacity = ct->local_capacity ? ct->local_capacity * 2 : 16;
+    ComptimeLocal *locals = xmalloc(sizeof(ComptimeLocal) * ct->local_capacity);
+    if (ct->local_count)
+      memcpy(locals, ct->locals, sizeof(ComptimeLocal) * ct->local_count);
+    free(ct->locals);
+    ct->locals = locals;
+  }
+  ct->locals[ct->local_count].name = name;
+  ct->locals[ct->local_count].value = value;
+  ct->local_count++;
+}
+
+static AstNode *find_declaration(Comptime *ct, const char *name,
+                                 NodeType type) {
+  if (!ct->module)
+    return NULL;
+  for (size_t i = 0; i < ct->module->preprocessor.module.body_count; i++) {
+    AstNode *stmt = ct->module->preprocessor.module.body[i];
+    if (stmt->type != type ||
+        (type == AST_STMT_FUNCTION && stmt->stmt.func_decl.type_param_count))
+      continue;
+    const char *decl_name = type == AST_STMT_FUNCTION
+                                ? stmt->stmt.func_decl.name
+                                : stmt->stmt.var_decl.name;
+    if (decl_name && strcmp(decl_name, name) == 0)
+      return stmt;
+  }
+  return NULL;
+}
+
+// Evaluates an initializer in a frame of its own, converted to the
+// declared type
+static bool eval_initializer(Comptime *ct, AstNode *decl, ComptimeValue *out) {
+  if (ct->depth >= COMPTIME_CALL_DEPTH)
+    return false;
+
+  size_t saved_frame = ct->frame;
+  size_t saved_count = ct->local_count;
+  ct->frame = ct->local_count;
+  ct->depth++;
+  bool ok = eval_expr(ct, decl->stmt.var_decl.initializer, out);
+  ct->depth--;
+  ct->frame = saved_frame;
+  ct->local_count = saved_count;
+  if (!ok)
+    return false;
+
+  if (decl->stmt.var_decl.var_type) {
+    LLVMTypeRef type = codegen_type(ct->ctx, decl->stmt.var_decl.var_type);
+    if (!type || !convert(ct, out, type))
+      return false;
+  }
+  return true;
+}
+
+// The value of a top-level const, evaluated on first use. Later uses, the
+// global's own declaration among them, read it back from the module.
+static ComptimeValue *const_ref(Comptime *ct, const char *name) {
+  Atom key = intern(name);
+  if (ct->unit) {
+    ComptimeValue *cached = pointer_map_get(&ct->unit->comptime_values, key);
+    if (cached)
+      return cached;
+  }
+
+  AstNode *decl = find_declaration(ct, name, AST_STMT_VAR_DECL);
+  if (!decl || decl->stmt.var_decl.is_mutable ||
+      !decl->stmt.var_decl.initializer)
+    return NULL;
+
+  ComptimeValue value;
+  if (!eval_initializer(ct, decl, &value))
+    return NULL;
+
+  ComptimeValue *stored = alloc_elements(ct, 1);
+  *stored = value;
+  if (ct->unit)
+    pointer_map_put(&ct->unit->comptime_values, key, stored);
+  return stored;
+}
+
+// Where a variable or an element of one is stored. Only locals can be
+// written.
+static ComptimeValue *eval_place(Comptime *ct, AstNode *expr, bool writable) {
+  switch (expr->type) {
+  case AST_EXPR_IDENTIFIER: {
+    ComptimeValue *local = find_local(ct, expr->expr.identifier.name);
+    if (local || writable)
+      return local;
+    return const_ref(ct, expr->expr.identifier.name);
+  }
+
+  case AST_EXPR_INDEX: {
+    ComptimeValue *array = eval_place(ct, expr->expr.index.object, writable);
+    ComptimeValue index;
+    if (!array || kind_of(array) != LLVMArrayTypeKind ||
+        !eval_expr(ct, expr->expr.index.index, &index) || !is_int(&index))
+      return NULL;
+    // Out of bounds is undefined at run time, so it isn't folded
+    if (index.i < 0 || (unsigned long long)index.i >=
+                           LLVMGetArrayLength(array->type))
+      return NULL;
+    return &array->elements[index.i];
+  }
+
+  case AST_EXPR_GROUPING:
+    return eval_place(ct, expr->expr.grouping.expr, writable);
+
+  default:
+    return NULL;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Expressions
+// ---------------------------------------------------------------------------
+
+static bool eval_literal(Comptime *ct, AstNode *expr, ComptimeValue *out) {
+  CommonTypes *types = &ct->ctx->common_types;
+  switch (expr->expr.literal.lit_type) {
+  case LITERAL_INT:
+    *out = int_value(types->i64,
+                     (unsigned long long)expr->expr.literal.value.int_val);
+    return true;
+  case LITERAL_FLOAT:
+  case LITERAL_DOUBLE:
+    *out = real_value(types->f64, expr->expr.literal.value.float_val);
+    return true;
+  case LITERAL_BOOL:
+    *out = int_value(types->i1, expr->expr.literal.value.bool_val);
+    return true;
+  case LITERAL_CHAR:
+    *out = int_value(types->i8,
+                     (unsigned char)expr->expr.literal.value.char_val);
+    return true;
+  default:
+    return false;
+  }
+}
+
+static bool eval_real_binary(BinaryOp op, double a, double b,
+                             LLVMTypeRef type, LLVMTypeRef i1,
+                             ComptimeValue *out) {
+  switch (op) {
+  case BINOP_ADD: *out = real_value(type, a + b); return true;
+  case BINOP_SUB: *out = real_value(type, a - b); return true;
+  case BINOP_MUL: *out = real_value(type, a * b); return true;
+  case BINOP_DIV: *out = real_value(type, a / b); return true;
+  case BINOP_MOD: *out = real_value(type, a - b * floor(a / b)); return true;
+  // Ordered compares: false when either side is NaN, != included
+  case BINOP_EQ: *out = int_value(i1, a == b); return true;
+  case BINOP_NE: *out = int_value(i1, a < b || a > b); return true;
+  case BINOP_LT: *out = int_value(i1, a < b); return true;
+  case BINOP_LE: *out = int_value(i1, a <= b); return true;
+  case BINOP_GT: *out = int_value(i1, a > b); return true;
+  case BINOP_GE: *out = int_value(i1, a >= b); return true;
+  default: return false;
+  }
+}
+
+static bool eval_int_binary(BinaryOp op, long long a, long long b,
+                            LLVMTypeRef type, LLVMTypeRef i1,
+                            ComptimeValue *out) {
+  unsigned long long ua = (unsigned long long)a;
+  unsigned long long ub = (unsigned long long)b;
+  unsigned bits = LLVMGetIntTypeWidth(type);
+
+  switch (op) {
+  case BINOP_ADD: *out = int_value(type, ua + ub); return true;
+  case BINOP_SUB: *out = int_value(type, ua - ub); return true;
+  case BINOP_MUL: *out = int_value(type, ua * ub); return true;
+  case BINOP_DIV:
+  case BINOP_MOD:
+    // Division by zero and the one overflowing quotient trap at run time
+    if (b == 0 || (b == -1 && wrap_int(1ull << (bits - 1), bits) == a))
+      return false;
+    *out = int_value(type, (unsigned long long)(op == BINOP_DIV ? a / b
+                                                                : a % b));
+    return true;
+  case BINOP_EQ: *out = int_value(i1, a == b); return true;
+  case BINOP_NE: *out = int_value(i1, a != b); return true;
+  case BINOP_LT: *out = int_value(i1, a < b); return true;
+  case BINOP_LE: *out = int_value(i1, a <= b); return true;
+  case BINOP_GT: *out = int_value(i1, a > b); return true;
+  case BINOP_GE: *out = int_value(i1, a >= b); return true;
+  // && and || are emitted as and/or of both sides
+  case BINOP_AND:
+  case BINOP_BIT_AND: *out = int_value(type, ua & ub); return true;
+  case BINOP_OR:
+  case BINOP_BIT_OR: *out = int_value(type, ua | ub); return true;
+  case BINOP_BIT_XOR: *out = int_value(type, ua ^ ub); return true;
+  case BINOP_SHL:
+  case BINOP_SHR:
+    // Shifting by the width or more is poison
+    if (b < 0 || b >= (long long)bits)
+      return false;
+    *out = int_value(type, op == BINOP_SHL ? ua << b
+                                           : (unsigned long long)(a >> b));
+    return true;
+  default:
+    return false;
+  }
+}
+
+static bool eval_binary(Comptime *ct, AstNode *expr, ComptimeValue *out) {
+  ComptimeValue left, right;
+  if (!eval_expr(ct, expr->expr.binary.left, &left) ||
+      !eval_expr(ct, expr->expr.binary.right, &right))
+    return false;
+
+  BinaryOp op = expr->expr.binary.op;
+  LLVMTypeRef i1 = ct->ctx->common_types.i1;
+
+  // An integer meeting a float is converted, and float meeting double
+  // widened, as promote_operands does
+  if (is_real(&left) || is_real(&right)) {
+    if (!(is_real(&left) || is_int(&left)) ||
+        !(is_real(&right) || is_int(&right)))
+      return false;
+    LLVMTypeRef type = !is_real(&left)    ? right.type
+                       : !is_real(&right) ? left.type
+                       : kind_of(&left) == LLVMDoubleTypeKind ? left.type
+                                                              : right.type;
+    if (!convert(ct, &left, type) || !convert(ct, &right, type))
+      return false;
+    return eval_real_binary(op, left.f, right.f, type, i1, out);
+  }
+
+  if (!is_int(&left) || left.type != right.type)
+    return false;
+  return eval_int_binary(op, left.i, right.i, left.type, i1, out);
+}
+
+static bool eval_step(Comptime *ct, AstNode *expr, ComptimeValue *out) {
+  UnaryOp op = expr->expr.unary.op;
+  ComptimeValue *place = eval_place(ct, expr->expr.unary.operand, true);
+  if (!place)
+    return false;
+
+  ComptimeValue before = *place;
+  bool increment = op == UNOP_PRE_INC || op == UNOP_POST_INC;
+  if (is_int(place))
+    *place = int_value(place->type, (unsigned long long)place->i +
+                                        (increment ? 1ull : ~0ull));
+  else if (is_real(place))
+    *place = real_value(place->type, place->f + (increment ? 1.0 : -1.0));
+  else
+    return false;
+
+  *out = op == UNOP_PRE_INC || op == UNOP_PRE_DEC ? *place : before;
+  return true;
+}
+
+static bool eval_unary(Comptime *ct, AstNode *expr, ComptimeValue *out) {
+  UnaryOp op = expr->expr.unary.op;
+  if (op == UNOP_PRE_INC || op == UNOP_PRE_DEC || op == UNOP_POST_INC ||
+      op == UNOP_POST_DEC)
+    return eval_step(ct, expr, out);
+
+  ComptimeValue operand;
+  if (!eval_expr(ct, expr->expr.unary.operand, &operand))
+    return false;
+
+  switch (op) {
+  case UNOP_POS:
+    *out = operand;
+    return is_int(&operand) || is_real(&operand);
+  case UNOP_NEG:
+    if (is_real(&operand)) {
+      *out = real_value(operand.type, -operand.f);
+      return true;
+    }
+    if (!is_int(&operand))
+      return false;
+    *out = int_value(operand.type, 0ull - (unsigned long long)operand.i);
+    return true;
+  case UNOP_NOT:
+  case UNOP_BIT_NOT:
+    // ! is a bitwise not too, which on bool flips it
+    if (!is_int(&operand))
+      return false;
+    *out = int_value(operand.type, ~(unsigned long long)operand.i);
+    return true;
+  default:
+    return false;
+  }
+}
+
+static bool eval_array(Comptime *ct, AstNode *expr, ComptimeValue *out) {
+  size_t count = expr->expr.array.element_count;
+  size_t size = expr->expr.array.target_size > count
+                    ? expr->expr.array.target_size
+                    : count;
+  if (count == 0)
+    return false;
+
+  ComptimeValue *elements = alloc_elements(ct, size);
+  for (size_t i = 0; i < count; i++) {
+    if (!eval_expr(ct, expr->expr.array.elements[i], &elements[i]))
+      return false;
+    // The first element decides the element type
+    if (i > 0 && !convert(ct, &elements[i], elements[0].type))
+      return false;
+  }
+  for (size_t i = count; i < size; i++)
+    if (!zero_value(ct, elements[0].type, &elements[i]))
+      return false;
+
+  out->type = LLVMArrayType(elements[0].type, (unsigned)size);
+  out->elements = elements;
+  return true;
+}
+
+static bool eval_cast(Comptime *ct, AstNode *expr, ComptimeValue *out) {
+  LLVMTypeRef type = codegen_type(ct->ctx, expr->expr.cast.type);
+  if (!type || !eval_expr(ct, expr->expr.cast.castee, out))
+    return false;
+  LLVMTypeKind kind = LLVMGetTypeKind(type);
+  if (kind != LLVMIntegerTypeKind && kind != LLVMFloatTypeKind &&
+      kind != LLVMDoubleTypeKind)
+    return false;
+  return convert(ct, out, type);
+}
+
+static bool eval_sizeof(Comptime *ct, AstNode *expr, ComptimeValue *out) {
+  LLVMTypeRef type;
+  if (expr->expr.size_of.is_type) {
+    type = codegen_type(ct->ctx, expr->expr.size_of.object);
+  } else {
+    ComptimeValue value;
+    if (!eval_expr(ct, expr->expr.size_of.object, &value))
+      return false;
+    type = value.type;
+  }
+  if (!type)
+    return false;
+
+  // The target's own layout, as codegen_expr_sizeof counts it
+  LLVMTargetDataRef target_data = get_target_data(ct->ctx);
+  if (!target_data || !LLVMTypeIsSized(type))
+    return false;
+  *out = int_value(ct->ctx->common_types.i64,
+                   LLVMABISizeOfType(target_data, type));
+  return true;
+}
+
+static bool eval_builtin(Comptime *ct, AstNode *expr, ComptimeValue *out) {
+  BuiltinKind kind = expr->expr.builtin.kind;
+  if (expr->expr.builtin.arg_count == 0 ||
+      !eval_expr(ct, expr->expr.builtin.args[0], out) || !is_int(out))
+    return false;
+
+  unsigned bits = LLVMGetIntTypeWidth(out->type);
+  unsigned long long value = (unsigned long long)out->i;
+  if (bits < 64)
+    value &= (1ull << bits) - 1;
+
+  switch (kind) {
+  // Hints only: the value passes through
+  case BUILTIN_EXPECT:
+  case BUILTIN_LIKELY:
+  case BUILTIN_UNLIKELY:
+    return true;
+
+  case BUILTIN_POPCOUNT: {
+    unsigned count = 0;
+    for (; value; value &= value - 1)
+      count++;
+    *out = int_value(out->type, count);
+    return true;
+  }
+
+  case BUILTIN_CLZ:
+  case BUILTIN_CTZ: {
+    unsigned count = 0;
+    for (unsigned i = 0; i < bits; i++) {
+      unsigned bit = kind == BUILTIN_CLZ ? bits - 1 - i : i;
+      if (value >> bit & 1)
+        break;
+      count++;
+    }
+    *out = int_value(out->type, count);
+    return true;
+  }
+
+  case BUILTIN_BSWAP: {
+    unsigned long long swapped = 0;
+    for (unsigned i = 0; i < bits / 8; i++)
+      swapped = swapped << 8 | (value >> (i * 8) & 0xff);
+    *out = int_value(out->type, swapped);
+    return true;
+  }
+
+  case BUILTIN_WRAPPING_ADD:
+  case BUILTIN_WRAPPING_SUB:
+  case BUILTIN_WRAPPING_MUL: {
+    ComptimeValue right;
+    if (expr->expr.builtin.arg_count != 2 ||
+        !eval_expr(ct, expr->expr.builtin.args[1], &right) || !is_int(&right))
+      return false;
+    unsigned long long other = (unsigned long long)right.i;
+    *out = int_value(out->type, kind == BUILTIN_WRAPPING_ADD   ? value + other
+                                : kind == BUILTIN_WRAPPING_SUB ? value - other
+                                                               : value * other);
+    return true;
+  }
+
+  default:
+    return false;
+  }
+}
+
+static bool eval_call(Comptime *ct, AstNode *expr, ComptimeValue *out) {
+  AstNode *callee = expr->expr.call.callee;
+  if (callee->type != AST_EXPR_IDENTIFIER ||
+      find_local(ct, callee->expr.identifier.name))
+    return false;
+
+  AstNode *fn =
+      find_declaration(ct, callee->expr.identifier.name, AST_STMT_FUNCTION);
+  if (!fn || !fn->stmt.func_decl.body || fn->stmt.func_decl.is_dll_import ||
+      fn->stmt.func_decl.is_lib_import ||
+      fn->stmt.func_decl.param_count != expr->expr.call.arg_count ||
+      ct->depth >= COMPTIME_CALL_DEPTH)
+    return false;
+
+  // Arguments are evaluated in the caller's frame
+  size_t count = expr->expr.call.arg_count;
+  ComptimeValue *args = alloc_elements(ct, count);
+  for (size_t i = 0; i < count; i++) {
+    LLVMTypeRef type = codegen_type(ct->ctx, fn->stmt.func_decl.param_types[i]);
+    if (!type || !eval_expr(ct, expr->expr.call.args[i], &args[i]) ||
+        !convert(ct, &args[i], type))
+      return false;
+  }
+
+  size_t saved_frame = ct->frame;
+  size_t saved_count = ct->local_count;
+  ct->frame = ct->local_count;
+  for (size_t i = 0; i < count; i++)
+    push_local(ct, fn->stmt.func_decl.param_names[i], args[i]);
+
+  ct->result.type = LLVMVoidTypeInContext(ct->ctx->context);
+  ct->depth++;
+  Flow flow = exec_stmt(ct, fn->stmt.func_decl.body);
+  ct->depth--;
+  ct->frame = saved_frame;
+  ct->local_count = saved_count;
+
+  LLVMTypeRef return_type = codegen_type(ct->ctx, fn->stmt.func_decl.return_type);
+  if (!return_type)
+    return false;
+  if (flow == FLOW_NEXT && LLVMGetTypeKind(return_type) == LLVMVoidTypeKind) {
+    out->type = return_type;
+    return true;
+  }
+  if (flow != FLOW_RETURN)
+    return false;
+  *out = ct->result;
+  return convert(ct, out, return_type);
+}
+
+static bool eval_expr(Comptime *ct, AstNode *expr, ComptimeValue *out) {
+  if (!expr || expr->category != Node_Category_EXPR || !step(ct))
+    return false;
+
+  switch (expr->type) {
+  case AST_EXPR_LITERAL:
+    return eval_literal(ct, expr, out);
+
+  case AST_EXPR_IDENTIFIER:
+  case AST_EXPR_INDEX: {
+    ComptimeValue *place = eval_place(ct, expr, false);
+    if (!place)
+      return false;
+    *out = copy_value(ct, *place);
+    return true;
+  }
+
+  case AST_EXPR_GROUPING:
+    return eval_expr(ct, expr->expr.grouping.expr, out);
+
+  case AST_EXPR_BINARY:
+    return eval_binary(ct, expr, out);
+
+  case AST_EXPR_UNARY:
+    return eval_unary(ct, expr, out);
+
+  case AST_EXPR_TERNARY: {
+    ComptimeValue condition;
+    bool taken;
+    if (!eval_expr(ct, expr->expr.ternary.condition, &condition) ||
+        !truthy(&condition, &taken))
+      return false;
+    return eval_expr(ct,
+                     taken ? expr->expr.ternary.then_expr
+                           : expr->expr.ternary.else_expr,
+                     out);
+  }
+
+  case AST_EXPR_ASSIGNMENT: {
+    ComptimeValue *place = eval_place(ct, expr->expr.assignment.target, true);
+    if (!place || !eval_expr(ct, expr->expr.assignment.value, out) ||
+        !convert(ct, out, place->type))
+      return false;
+    *place = copy_value(ct, *out);
+    return true;
+  }
+
+  case AST_EXPR_ARRAY:
+    return eval_array(ct, expr, out);
+
+  case AST_EXPR_CAST:
+    return eval_cast(ct, expr, out);
+
+  case AST_EXPR_SIZEOF:
+    return eval_sizeof(ct, expr, out);
+
+  case AST_EXPR_BUILTIN:
+    return eval_builtin(ct, expr, out);
+
+  case AST_EXPR_CALL:
+    return eval_call(ct, expr, out);
+
+  default:
+    return false;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Statements of a function body
+// ---------------------------------------------------------------------------
+
+static Flow exec_var_decl(Comptime *ct, AstNode *stmt) {
+  LLVMTypeRef type = NULL;
+  if (stmt->stmt.var_decl.var_type) {
+    type = codegen_type(ct->ctx, stmt->stmt.var_decl.var_type);
+    if (!type)
+      return FLOW_FAIL;
+  }
+
+  ComptimeValue value;
+  if (stmt->stmt.var_decl.initializer) {
+    if (!eval_expr(ct, stmt->stmt.var_decl.initializer, &value) ||
+        (type && !convert(ct, &value, type)))
+      return FLOW_FAIL;
+  } else if (!type || !zero_value(ct, type, &value)) {
+    return FLOW_FAIL;
+  }
+
+  push_local(ct, stmt->stmt.var_decl.name, value);
+  return FLOW_NEXT;
+}
+
+static Flow exec_if(Comptime *ct, AstNode *stmt) {
+  ComptimeValue condition;
+  bool taken;
+  if (!eval_expr(ct, stmt->stmt.if_stmt.condition, &condition) ||
+      !truthy(&condition, &taken))
+    return FLOW_FAIL;
+  if (taken)
+    return exec_stmt(ct, stmt->stmt.if_stmt.then_stmt);
+
+  for (int i = 0; i < stmt->stmt.if_stmt.elif_count; i++) {
+    AstNode *elif = stmt->stmt.if_stmt.elif_stmts[i];
+    if (!eval_expr(ct, elif->stmt.if_stmt.condition, &condition) ||
+        !truthy(&condition, &taken))
+      return FLOW_FAIL;
+    if (taken)
+      return exec_stmt(ct, elif->stmt.if_stmt.then_stmt);
+  }
+
+  if (stmt->stmt.if_stmt.else_stmt)
+    return exec_stmt(ct, stmt->stmt.if_stmt.else_stmt);
+  return FLOW_NEXT;
+}
+
+// Runs the loop the way codegen_loop lays it out: in a for loop continue
+// goes through the step expression, in a while loop straight back to the
+// condition
+static Flow exec_loop(Comptime *ct, AstNode *stmt) {
+  size_t mark = ct->local_count;
+  bool is_for = stmt->stmt.loop_stmt.initializer != NULL;
+  bool is_infinite = !is_for && !stmt->stmt.loop_stmt.condition;
+
+  for (size_t i = 0; i < stmt->stmt.loop_stmt.init_count; i++) {
+    if (exec_stmt(ct, stmt->stmt.loop_stmt.initializer[i]) != FLOW_NEXT) {
+      ct->local_count = mark;
+      return FLOW_FAIL;
+    }
+  }
+
+  Flow result = FLOW_NEXT;
+  for (;;) {
+    if (!step(ct)) {
+      result = FLOW_FAIL;
+      break;
+    }
+
+    if (stmt->stmt.loop_stmt.condition) {
+      ComptimeValue condition;
+      bool taken;
+      if (!eval_expr(ct, stmt->stmt.loop_stmt.condition, &condition) ||
+          !truthy(&condition, &taken)) {
+        result = FLOW_FAIL;
+        break;
+      }
+      if (!taken)
+        break;
+    }
+
+    Flow flow = exec_stmt(ct, stmt->stmt.loop_stmt.body);
+    if (flow == FLOW_BREAK)
+      break;
+    if (flow == FLOW_RETURN || flow == FLOW_FAIL) {
+      result = flow;
+      break;
+    }
+
+    if (stmt->stmt.loop_stmt.optional && !is_infinite &&
+        (is_for || flow == FLOW_NEXT)) {
+      ComptimeValue ignored;
+      if (!eval_expr(ct, stmt->stmt.loop_stmt.optional, &ignored)) {
+        result = FLOW_FAIL;
+        break;
+      }
+    }
+  }
+
+  ct->local_count = mark;
+  return result;
+}
+
+static Flow exec_stmt(Comptime *ct, AstNode *stmt) {
+  if (!stmt || !step(ct))
+    return FLOW_FAIL;
+
+  switch (stmt->type) {
+  case AST_STMT_BLOCK: {
+    size_t mark = ct->local_count;
+    Flow flow = FLOW_NEXT;
+    for (size_t i = 0; i < stmt->stmt.block.stmt_count && flow == FLOW_NEXT;
+         i++)
+      flow = exec_stmt(ct, stmt->stmt.block.statements[i]);
+    ct->local_count = mark;
+    return flow;
+  }
+
+  case AST_STMT_VAR_DECL:
+    return exec_var_decl(ct, stmt);
+
+  case AST_STMT_EXPRESSION: {
+    ComptimeValue ignored;
+    return eval_expr(ct, stmt->stmt.expr_stmt.expression, &ignored)
+               ? FLOW_NEXT
+               : FLOW_FAIL;
+  }
+
+  case AST_STMT_RETURN:
+    if (!stmt->stmt.return_stmt.value) {
+      ct->result.type = LLVMVoidTypeInContext(ct->ctx->context);
+      return FLOW_RETURN;
+    }
+    return eval_expr(ct, stmt->stmt.return_stmt.value, &ct->result)
+               ? FLOW_RETURN
+               : FLOW_FAIL;
+
+  case AST_STMT_IF:
+    return exec_if(ct, stmt);
+
+  case AST_STMT_LOOP:
+    return exec_loop(ct, stmt);
+
+  case AST_STMT_BREAK_CONTINUE:
+    return stmt->stmt.break_continue.is_continue ? FLOW_CONTINUE : FLOW_BREAK;
+
+  default:
+    return FLOW_FAIL;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Entry points
+// ---------------------------------------------------------------------------
+
+static Comptime comptime_begin(CodeGenContext *ctx) {
+  Comptime ct = {0};
+  ct.ctx = ctx;
+  ct.unit = ctx->current_module;
+  ct.module = ctx->current_module_ast;
+  return ct;
+}
+
+LLVMValueRef comptime_global_initializer(CodeGenContext *ctx, AstNode *decl,
+                                         LLVMTypeRef type) {
+  if (!decl->stmt.var_decl.initializer)
+    return NULL;
+
+  Comptime ct = comptime_begin(ctx);
+  ComptimeValue value;
+  bool ok;
+  if (!decl->stmt.var_decl.is_mutable) {
+    ComptimeValue *stored = const_ref(&ct, decl->stmt.var_decl.name);
+    ok = stored != NULL;
+    if (ok)
+      value = *stored;
+  } else {
+    // A mutable global only starts out with the value
+    ok = eval_expr(&ct, decl->stmt.var_decl.initializer, &value);
+  }
+  free(ct.locals);
+
+  if (ct.exhausted)
+    fprintf(stderr,
+            "Error: Evaluating the initializer of '%s' took more than %d "
+            "steps\n",
+            decl->stmt.var_decl.name, COMPTIME_STEP_LIMIT);
+  if (!ok || !convert(&ct, &value, type))
+    return NULL;
+  return to_constant(&value);
+}
+
+// Whether the expression can only run inside a function: it calls one
+bool comptime_needs_function(AstNode *node) {
+  if (!node || node->category != Node_Category_EXPR)
+    return false;
+
+  switch (node->type) {
+  case AST_EXPR_CALL:
+  case AST_EXPR_INPUT:
+  case AST_EXPR_SYSTEM:
+  case AST_EXPR_SYSCALL:
+  case AST_EXPR_ALLOC:
+    return true;
+  case AST_EXPR_BINARY:
+    return comptime_needs_function(node->expr.binary.left) ||
+           comptime_needs_function(node->expr.binary.right);
+  case AST_EXPR_UNARY:
+    return comptime_needs_function(node->expr.unary.operand);
+  case AST_EXPR_GROUPING:
+    return comptime_needs_function(node->expr.grouping.expr);
+  case AST_EXPR_TERNARY:
+    return comptime_needs_function(node->expr.ternary.condition) ||
+           comptime_needs_function(node->expr.ternary.then_expr) ||
+           comptime_needs_function(node->expr.ternary.else_expr);
+  case AST_EXPR_CAST:
+    return comptime_needs_function(node->expr.cast.castee);
+  case AST_EXPR_INDEX:
+    return comptime_needs_function(node->expr.index.object) ||
+           comptime_needs_function(node->expr.index.index);
+  case AST_EXPR_ARRAY:
+    for (size_t i = 0; i < node->expr.array.element_count; i++)
+      if (comptime_needs_function(node->expr.array.elements[i]))
+        return true;
+    return false;
+  default:
+    return false;
+  }
+}
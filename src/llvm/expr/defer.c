@@ -1,143 +1,227 @@
 #include "../llvm.h"
 
-void init_defer_stack(CodeGenContext *ctx) {
-  ctx->deferred_statements = NULL;
-  ctx->deferred_count = 0;
-  ctx->deferred_capacity = 0;
-}
+// Defers run when their block is left, newest first. Each block gets one
+// chain of cleanup blocks, a block per deferred statement, emitted when the
+// block ends; returns, breaks, continues and falling off the end all branch
+// into it instead of repeating the deferred code. An exit enters the chain
+// at the newest defer registered when it was taken, and the end of the chain
+// switches on the block's selector to carry on to where the exit was going,
+// through the cleanups of the enclosing blocks it leaves as well.
+
+void init_defer_stack(CodeGenContext *ctx) { ctx->defers = (DeferState){0}; }
 
 void push_defer_statement(CodeGenContext *ctx, AstNode *statement) {
+  DeferScope *scope = ctx->defers.scope;
+  if (!scope) {
+    fprintf(stderr, "Error: 'defer' used outside of a block\n");
+    return;
+  }
+
   DeferredStatement *defer_stmt = (DeferredStatement *)arena_alloc(
       ctx->arena, sizeof(DeferredStatement), alignof(DeferredStatement));
 
   defer_stmt->statement = statement;
   defer_stmt->cleanup_block = NULL;
-  defer_stmt->next = ctx->deferred_statements;
-  ctx->deferred_statements = defer_stmt;
-  ctx->deferred_count++;
+  defer_stmt->next = scope->defers;
+  scope->defers = defer_stmt;
 }
 
-// Execute deferred statements inline (for nested contexts)
-void execute_deferred_statements_inline(CodeGenContext *ctx,
-                                        DeferredStatement *defers) {
-  if (!defers)
-    return;
-
-  // Execute in reverse order (LIFO)
-  DeferredStatement *current = defers;
-  DeferredStatement *reversed_list = NULL;
+void push_defer_scope(CodeGenContext *ctx, DeferScope *scope) {
+  *scope = (DeferScope){0};
+  scope->break_block = ctx->loop_break_block;
+  scope->continue_block = ctx->loop_continue_block;
+  scope->parent = ctx->defers.scope;
+  ctx->defers.scope = scope;
+}
 
-  // Reverse the list to execute in LIFO order
-  while (current) {
-    DeferredStatement *next = current->next;
-    current->next = reversed_list;
-    reversed_list = current;
-    current = next;
+static unsigned add_exit(CodeGenContext *ctx, DeferScope *scope,
+                         LLVMBasicBlockRef dest, DeferScope *stop) {
+  for (size_t i = 0; i < scope->exit_count; i++) {
+    if (scope->exits[i].dest == dest && scope->exits[i].stop == stop)
+      return (unsigned)i;
   }
 
-  // Execute all deferred statements
-  current = reversed_list;
-  while (current) {
-    // Save the current defer context
-    DeferredStatement *saved_defers = ctx->deferred_statements;
-    size_t saved_count = ctx->deferred_count;
-
-    // Create new defer context for this statement
-    ctx->deferred_statements = NULL;
-    ctx->deferred_count = 0;
-
-    // Execute the deferred statement
-    codegen_stmt(ctx, current->statement);
-
-    // Execute any nested deferred statements that were created
-    if (ctx->deferred_statements) {
-      execute_deferred_statements_inline(ctx, ctx->deferred_statements);
-    }
+  if (scope->exit_count == scope->exit_capacity) {
+    size_t capacity = scope->exit_capacity ? scope->exit_capacity * 2 : 4;
+    DeferExit *exits = (DeferExit *)arena_alloc(
+        ctx->arena, capacity * sizeof(DeferExit), alignof(DeferExit));
+    if (scope->exit_count)
+      memcpy(exits, scope->exits, scope->exit_count * sizeof(DeferExit));
+    scope->exits = exits;
+    scope->exit_capacity = capacity;
+  }
+  scope->exits[scope->exit_count] = (DeferExit){dest, stop};
+  return (unsigned)scope->exit_count++;
+}
 
-    // Restore the defer context
-    ctx->deferred_statements = saved_defers;
-    ctx->deferred_count = saved_count;
+static LLVMBasicBlockRef cleanup_block(CodeGenContext *ctx,
+                                       DeferredStatement *defer_stmt) {
+  if (!defer_stmt->cleanup_block)
+    defer_stmt->cleanup_block = LLVMAppendBasicBlockInContext(
+        ctx->context, ctx->current_function, "defer_cleanup");
+  return defer_stmt->cleanup_block;
+}
 
-    current = current->next;
+bool has_pending_defers(CodeGenContext *ctx, DeferScope *stop) {
+  for (DeferScope *scope = ctx->defers.scope; scope && scope != stop;
+       scope = scope->parent) {
+    if (scope->defers)
+      return true;
   }
+  return false;
 }
 
-void generate_cleanup_blocks(CodeGenContext *ctx) {
-  if (!ctx->deferred_statements || !ctx->current_function) {
+void build_scope_exit(CodeGenContext *ctx, LLVMBasicBlockRef dest,
+                      DeferScope *stop) {
+  // Blocks without defers are left with a plain branch
+  DeferScope *scope = ctx->defers.scope;
+  while (scope && scope != stop && !scope->defers)
+    scope = scope->parent;
+  if (!scope || scope == stop) {
+    LLVMBuildBr(ctx->builder, dest);
     return;
   }
 
-  // Create a "normal_return" block that the last cleanup will branch to
-  LLVMBasicBlockRef normal_return = LLVMAppendBasicBlockInContext(
-      ctx->context, ctx->current_function, "normal_return");
+  unsigned exit = add_exit(ctx, scope, dest, stop);
+  if (!scope->selector)
+    scope->selector =
+        entry_alloca(ctx, ctx->common_types.i32, "defer_exit_selector");
+  LLVMBuildStore(ctx->builder,
+                 LLVMConstInt(ctx->common_types.i32, exit, false),
+                 scope->selector);
+  LLVMBuildBr(ctx->builder, cleanup_block(ctx, scope->defers));
+}
 
-  // Create cleanup blocks for each deferred statement (in reverse order)
-  DeferredStatement *current = ctx->deferred_statements;
-  LLVMBasicBlockRef next_cleanup = normal_return; // Start with normal return
+// The scope break or continue leaves the loop into: the first one opened
+// under other loop blocks
+DeferScope *loop_exit_scope(CodeGenContext *ctx, bool is_continue) {
+  LLVMBasicBlockRef target =
+      is_continue ? ctx->loop_continue_block : ctx->loop_break_block;
+  DeferScope *scope = ctx->defers.scope;
+  while (scope &&
+         (is_continue ? scope->continue_block : scope->break_block) == target)
+    scope = scope->parent;
+  return scope;
+}
 
-  while (current) {
-    // Create a cleanup block for this deferred statement
-    char block_name[64];
-    snprintf(block_name, sizeof(block_name), "defer_cleanup_%p",
-             (void *)current);
+void generate_cleanup_blocks(CodeGenContext *ctx, DeferScope *scope) {
+  // The chain starts at the newest defer an exit enters at; defers
+  // registered after the last exit was taken never run
+  DeferredStatement *first = scope->defers;
+  while (first && !first->cleanup_block)
+    first = first->next;
+  if (!first)
+    return;
 
-    current->cleanup_block = LLVMAppendBasicBlockInContext(
-        ctx->context, ctx->current_function, block_name);
+  LLVMBasicBlockRef dispatch = LLVMAppendBasicBlockInContext(
+      ctx->context, ctx->current_function, "defer_dispatch");
 
-    // Set up the block
-    LLVMBasicBlockRef old_block = LLVMGetInsertBlock(ctx->builder);
+  for (DeferredStatement *current = first; current; current = current->next) {
     LLVMPositionBuilderAtEnd(ctx->builder, current->cleanup_block);
 
-    // Save the current defer context before executing
-    DeferredStatement *saved_defers = ctx->deferred_statements;
-    size_t saved_count = ctx->deferred_count;
-
-    // Create new defer context for this cleanup block
-    ctx->deferred_statements = NULL;
-    ctx->deferred_count = 0;
-
-    // Generate the deferred statement
+    // Defers inside the deferred statement get a scope of their own
+    DeferScope inner;
+    push_defer_scope(ctx, &inner);
     codegen_stmt(ctx, current->statement);
+    pop_defer_scope(ctx);
 
-    // Execute any nested deferred statements that were created
-    if (ctx->deferred_statements) {
-      execute_deferred_statements_inline(ctx, ctx->deferred_statements);
+    LLVMBasicBlockRef next =
+        current->next ? cleanup_block(ctx, current->next) : dispatch;
+    if (!LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(ctx->builder))) {
+      LLVMBuildBr(ctx->builder, next);
     }
+  }
 
-    // Restore the defer context
-    ctx->deferred_statements = saved_defers;
-    ctx->deferred_count = saved_count;
+  // Carry on to wherever the exit was going
+  LLVMPositionBuilderAtEnd(ctx->builder, dispatch);
+  if (scope->exit_count == 1) {
+    build_scope_exit(ctx, scope->exits[0].dest, scope->exits[0].stop);
+    return;
+  }
 
-    // Always branch to next cleanup block (or normal return)
-    if (!LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(ctx->builder))) {
-      LLVMBuildBr(ctx->builder, next_cleanup);
-    }
+  LLVMValueRef selected = LLVMBuildLoad2(
+      ctx->builder, ctx->common_types.i32, scope->selector, "defer_exit");
+  LLVMBasicBlockRef *targets = (LLVMBasicBlockRef *)arena_alloc(
+      ctx->arena, scope->exit_count * sizeof(LLVMBasicBlockRef),
+      alignof(LLVMBasicBlockRef));
+  for (size_t i = 0; i < scope->exit_count; i++) {
+    targets[i] = LLVMAppendBasicBlockInContext(
+        ctx->context, ctx->current_function, "defer_exit");
+  }
+
+  LLVMValueRef dispatch_switch =
+      LLVMBuildSwitch(ctx->builder, selected, targets[0],
+                      (unsigned)scope->exit_count - 1);
+  for (size_t i = 1; i < scope->exit_count; i++) {
+    LLVMAddCase(dispatch_switch,
+                LLVMConstInt(ctx->common_types.i32, i, false), targets[i]);
+  }
 
-    // Restore builder position
-    LLVMPositionBuilderAtEnd(ctx->builder, old_block);
+  for (size_t i = 0; i < scope->exit_count; i++) {
+    LLVMPositionBuilderAtEnd(ctx->builder, targets[i]);
+    build_scope_exit(ctx, scope->exits[i].dest, scope->exits[i].stop);
+  }
+}
 
-    next_cleanup = current->cleanup_block;
-    current = current->next;
+void pop_defer_scope(CodeGenContext *ctx) {
+  DeferScope *scope = ctx->defers.scope;
+  if (!scope)
+    return;
+  if (!scope->defers) {
+    ctx->defers.scope = scope->parent;
+    return;
   }
 
-  // Set up the normal return block
-  LLVMPositionBuilderAtEnd(ctx->builder, normal_return);
+  // Falling off the end of the block is one more exit
+  LLVMBasicBlockRef resume = NULL;
+  if (!LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(ctx->builder))) {
+    resume = LLVMAppendBasicBlockInContext(ctx->context, ctx->current_function,
+                                           "defer_end");
+    build_scope_exit(ctx, resume, scope->parent);
+  }
+  LLVMBasicBlockRef exit_block = LLVMGetInsertBlock(ctx->builder);
 
-  // Get the function's return type to determine what to return
-  LLVMTypeRef func_type = LLVMGlobalGetValueType(ctx->current_function);
-  LLVMTypeRef return_type = LLVMGetReturnType(func_type);
+  ctx->defers.scope = scope->parent;
+  generate_cleanup_blocks(ctx, scope);
+
+  // Code after the block goes on from the fall-through exit; without one,
+  // the builder stays on a terminated block so callers see the block ended
+  LLVMPositionBuilderAtEnd(ctx->builder, resume ? resume : exit_block);
+}
+
+LLVMValueRef build_deferred_return(CodeGenContext *ctx, LLVMValueRef value) {
+  DeferState *state = &ctx->defers;
+  if (value) {
+    if (!state->return_slot)
+      state->return_slot =
+          entry_alloca(ctx, LLVMTypeOf(value), "deferred_return_value");
+    LLVMBuildStore(ctx->builder, value, state->return_slot);
+  }
+  if (!state->return_block)
+    state->return_block = LLVMAppendBasicBlockInContext(
+        ctx->context, ctx->current_function, "deferred_return");
+
+  build_scope_exit(ctx, state->return_block, NULL);
+  return LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(ctx->builder));
+}
+
+// Emits the return every return through cleanups ends at
+void finish_function_defers(CodeGenContext *ctx) {
+  DeferState *state = &ctx->defers;
+  if (!state->return_block)
+    return;
+
+  LLVMPositionBuilderAtEnd(ctx->builder, state->return_block);
+  LLVMTypeRef return_type =
+      LLVMGetReturnType(LLVMGlobalGetValueType(ctx->current_function));
 
   if (LLVMGetTypeKind(return_type) == LLVMVoidTypeKind) {
     LLVMBuildRetVoid(ctx->builder);
+  } else if (state->return_slot) {
+    LLVMBuildRet(ctx->builder,
+                 LLVMBuildLoad2(ctx->builder, return_type, state->return_slot,
+                                "deferred_return_value"));
   } else {
-    LLVMValueRef default_val = get_default_value(return_type);
-    if (default_val) {
-      LLVMBuildRet(ctx->builder, default_val);
-    }
+    LLVMBuildRet(ctx->builder, LLVMConstNull(return_type));
   }
 }
-
-void clear_defer_stack(CodeGenContext *ctx) {
-  ctx->deferred_statements = NULL;
-  ctx->deferred_count = 0;
-}
@@ -155,6 +155,9 @@ LLVMValueRef codegen_expr_unary(CodeGenContext *ctx, AstNode *node) {
     return NULL;
 
   LLVMTypeRef operand_type = LLVMTypeOf(operand);
+  // Vectors negate and invert lane by lane
+  if (LLVMGetTypeKind(operand_type) == LLVMVectorTypeKind)
+    operand_type = LLVMGetElementType(operand_type);
   LLVMTypeKind operand_kind = LLVMGetTypeKind(operand_type);
   bool is_float =
       (operand_kind == LLVMFloatTypeKind || operand_kind == LLVMDoubleTypeKind);
@@ -208,7 +211,9 @@ LLVMValueRef codegen_expr_unary(CodeGenContext *ctx, AstNode *node) {
       incremented = LLVMBuildFAdd(ctx->builder, loaded_val, one, "finc");
     } else {
       one = LLVMConstInt(LLVMTypeOf(loaded_val), 1, false);
-      incremented = LLVMBuildAdd(ctx->builder, loaded_val, one, "inc");
+      incremented = int_overflow_is_undefined(LLVMTypeOf(loaded_val))
+                        ? LLVMBuildNSWAdd(ctx->builder, loaded_val, one, "inc")
+                        : LLVMBuildAdd(ctx->builder, loaded_val, one, "inc");
     }
 
     LLVMBuildStore(ctx->builder, incremented, sym->value);
@@ -239,7 +244,9 @@ LLVMValueRef codegen_expr_unary(CodeGenContext *ctx, AstNode *node) {
       decremented = LLVMBuildFSub(ctx->builder, loaded_val, one, "fdec");
     } else {
       one = LLVMConstInt(LLVMTypeOf(loaded_val), 1, false);
-      decremented = LLVMBuildSub(ctx->builder, loaded_val, one, "dec");
+      decremented = int_overflow_is_undefined(LLVMTypeOf(loaded_val))
+                        ? LLVMBuildNSWSub(ctx->builder, loaded_val, one, "dec")
+                        : LLVMBuildSub(ctx->builder, loaded_val, one, "dec");
     }
 
     LLVMBuildStore(ctx->builder, decremented, sym->value);
@@ -262,6 +269,10 @@ LLVMValueRef codegen_expr_call(CodeGenContext *ctx, AstNode *node) {
     const char *member_name = callee->expr.member.member;
     AstNode *object = callee->expr.member.object;
 
+    // v.sum() and the other reductions are built in
+    if (is_vector_expr(object))
+      return codegen_vector_reduce(ctx, node);
+
     // Check if the object is a struct type name (not a runtime value)
     bool object_is_type = false;
     StructInfo *struct_info = NULL;
@@ -284,23 +295,11 @@ LLVMValueRef codegen_expr_call(CodeGenContext *ctx, AstNode *node) {
           if (object->type == AST_EXPR_IDENTIFIER) {
             LLVM_Symbol *sym = find_symbol(ctx, object->expr.identifier.name);
             if (sym && sym->element_type) {
-              for (StructInfo *info = ctx->struct_types; info;
-                   info = info->next) {
-                if (info->llvm_type == sym->element_type) {
-                  struct_info = info;
-                  break;
-                }
-              }
+              struct_info = find_struct_by_llvm_type(ctx, sym->element_type);
             }
           }
         } else if (object_kind == LLVMStructTypeKind) {
-          for (StructInfo *info = ctx->struct_types; info;
-               info = info->next) {
-            if (info->llvm_type == object_type) {
-              struct_info = info;
-              break;
-            }
-          }
+          struct_info = find_struct_by_llvm_type(ctx, object_type);
         }
       }
     }
@@ -332,6 +331,7 @@ LLVMValueRef codegen_expr_call(CodeGenContext *ctx, AstNode *node) {
           method_func = LLVMAddFunction(current_llvm_module,
                                         qualified_method_name, func_type);
           LLVMSetLinkage(method_func, LLVMExternalLinkage);
+          copy_function_attributes(method_func, found_func);
           break;
         }
       }
@@ -360,8 +360,9 @@ LLVMValueRef codegen_expr_call(CodeGenContext *ctx, AstNode *node) {
       if (i == 0 && object_is_type) {
         if (ctx->current_function &&
             LLVMCountParams(ctx->current_function) > 0) {
-          LLVMValueRef self_param = LLVMGetParam(ctx->current_function, 0);
-          LLVMTypeRef func_type = LLVMGlobalGetValueType(method_func);
+          LLVMValueRef self_param = LLVMGetParam(
+              ctx->current_function, first_source_param(ctx->current_function));
+          LLVMTypeRef func_type = source_function_type(ctx, method_func);
           LLVMTypeRef *param_types =
               (LLVMTypeRef *)arena_alloc(
                   ctx->arena,
@@ -412,7 +413,9 @@ LLVMValueRef codegen_expr_call(CodeGenContext *ctx, AstNode *node) {
   LLVMValueRef fn_value = callee_value;
 
   if (LLVMIsAFunction(callee_value)) {
-    func_type = LLVMGlobalGetValueType(callee_value);
+    // Arguments are matched against the signature as written; the call is
+    // lowered again when it's built
+    func_type = source_function_type(ctx, callee_value);
 
   } else if (callee->type == AST_EXPR_IDENTIFIER) {
     LLVM_Symbol *sym = find_symbol(ctx, callee->expr.identifier.name);
@@ -457,8 +460,7 @@ LLVMValueRef codegen_expr_call(CodeGenContext *ctx, AstNode *node) {
 
   if (LLVMGetTypeKind(return_type) == LLVMVoidTypeKind) {
     //Return the call instruction itself
-    return LLVMBuildCall2(ctx->builder, func_type, fn_value, args, arg_count,
-                          "");
+    return build_source_call(ctx, func_type, fn_value, args, arg_count, "");
   }
 
   // Struct return — cross-module fixup only makes sense for direct functions
@@ -473,16 +475,24 @@ LLVMValueRef codegen_expr_call(CodeGenContext *ctx, AstNode *node) {
       LLVMValueRef local_func =
           LLVMGetNamedFunction(current_llvm_module, func_name);
       if (!local_func) {
-        local_func = LLVMAddFunction(current_llvm_module, func_name, func_type);
+        local_func = LLVMAddFunction(current_llvm_module, func_name,
+                                     LLVMGlobalGetValueType(fn_value));
         LLVMSetLinkage(local_func, LLVMExternalLinkage);
+        copy_function_attributes(local_func, fn_value);
       }
       LLVMSetFunctionCallConv(local_func, LLVMGetFunctionCallConv(fn_value));
       fn_value = local_func;
     }
   }
 
-  return LLVMBuildCall2(ctx->builder, func_type, fn_value, args, arg_count,
-                        "call");
+  return build_source_call(ctx, func_type, fn_value, args, arg_count, "call");
+}
+
+// The array a[i] indexes, for bounds check messages
+static const char *indexed_name(AstNode *index) {
+  AstNode *object = index->expr.index.object;
+  return object->type == AST_EXPR_IDENTIFIER ? object->expr.identifier.name
+                                             : NULL;
 }
 
 // Unified assignment handler that supports all assignment types
@@ -539,6 +549,9 @@ LLVMValueRef codegen_expr_assignment(CodeGenContext *ctx, AstNode *node) {
 
   // Handle index assignment: arr[i] = value or ptr[i] = value
   else if (target->type == AST_EXPR_INDEX) {
+    if (is_vector_expr(target->expr.index.object))
+      return codegen_vector_lane_store(ctx, target, value);
+
     LLVMValueRef object = codegen_expr(ctx, target->expr.index.object);
     if (!object) {
       return NULL;
@@ -554,6 +567,9 @@ LLVMValueRef codegen_expr_assignment(CodeGenContext *ctx, AstNode *node) {
 
     if (object_kind == LLVMArrayTypeKind) {
       // Array assignment: arr[i] = value
+      if (!check_array_bounds_runtime(ctx, object_type, index,
+                                      indexed_name(target)))
+        return NULL;
       LLVMValueRef array_ptr;
 
       if (target->expr.index.object->type == AST_EXPR_IDENTIFIER) {
@@ -830,6 +846,15 @@ LLVMValueRef codegen_expr_index(CodeGenContext *ctx, AstNode *node) {
     return NULL;
   }
 
+  // Vector lanes are read straight out of the value
+  if (is_vector_expr(node->expr.index.object)) {
+    LLVMValueRef vector = codegen_expr(ctx, node->expr.index.object);
+    LLVMValueRef index = codegen_expr(ctx, node->expr.index.index);
+    if (!vector || !index)
+      return NULL;
+    return LLVMBuildExtractElement(ctx->builder, vector, index, "lane");
+  }
+
   // **NEW: Special handling for indexing member access (struct.field[index])**
   if (node->expr.index.object->type == AST_EXPR_MEMBER) {
     AstNode *member_expr = node->expr.index.object;
@@ -897,20 +922,11 @@ LLVMValueRef codegen_expr_index(CodeGenContext *ctx, AstNode *node) {
 
         if (sym_kind == LLVMPointerTypeKind && base_sym->element_type) {
           // It's a pointer to struct
-          for (StructInfo *info = ctx->struct_types; info; info = info->next) {
-            if (info->llvm_type == base_sym->element_type) {
-              current_struct = info;
-              break;
-            }
-          }
+          current_struct =
+              find_struct_by_llvm_type(ctx, base_sym->element_type);
         } else if (sym_kind == LLVMStructTypeKind) {
           // Direct struct type
-          for (StructInfo *info = ctx->struct_types; info; info = info->next) {
-            if (info->llvm_type == sym_type) {
-              current_struct = info;
-              break;
-            }
-          }
+          current_struct = find_struct_by_llvm_type(ctx, sym_type);
         }
 
         // Trace through the field chain
@@ -943,30 +959,14 @@ LLVMValueRef codegen_expr_index(CodeGenContext *ctx, AstNode *node) {
 
           if (field_kind == LLVMStructTypeKind) {
             // Field is a struct - find its info
-            StructInfo *next_struct = NULL;
-            for (StructInfo *info = ctx->struct_types; info;
-                 info = info->next) {
-              if (info->llvm_type == field_type) {
-                next_struct = info;
-                break;
-              }
-            }
-            current_struct = next_struct;
+            current_struct = find_struct_by_llvm_type(ctx, field_type);
           } else if (field_kind == LLVMPointerTypeKind) {
             // Field is a pointer - get what it points to
             LLVMTypeRef pointee =
                 current_struct->field_element_types[field_idx];
             if (pointee && LLVMGetTypeKind(pointee) == LLVMStructTypeKind) {
               // Find the struct info for the pointee
-              StructInfo *next_struct = NULL;
-              for (StructInfo *info = ctx->struct_types; info;
-                   info = info->next) {
-                if (info->llvm_type == pointee) {
-                  next_struct = info;
-                  break;
-                }
-              }
-              current_struct = next_struct;
+              current_struct = find_struct_by_llvm_type(ctx, pointee);
             } else {
               // Not a struct pointer, can't continue
               break;
@@ -1016,16 +1016,26 @@ LLVMValueRef codegen_expr_index(CodeGenContext *ctx, AstNode *node) {
   if (object_kind == LLVMArrayTypeKind) {
     // Direct array value indexing (from array literals)
     LLVMTypeRef element_type = LLVMGetElementType(object_type);
+    if (!check_array_bounds_runtime(ctx, object_type, index,
+                                    indexed_name(node)))
+      return NULL;
 
-    // Allocate with proper alignment for the array type
-    LLVMValueRef array_alloca =
-        LLVMBuildAlloca(ctx->builder, object_type, "temp_array");
+    // A loaded array variable is indexed in place. Copying it to a fresh
+    // alloca on every access costs the whole array, and inside a loop the
+    // allocas pile up until the stack overflows. Other array values spill to
+    // one entry-block temporary.
+    LLVMValueRef array_alloca;
+    if (LLVMIsALoadInst(object) && !LLVMGetVolatile(object)) {
+      array_alloca = LLVMGetOperand(object, 0);
+    } else {
+      array_alloca = entry_alloca(ctx, object_type, "temp_array");
 
-    // Store with proper alignment - CRITICAL for i64 arrays!
-    LLVMValueRef store_inst =
-        LLVMBuildStore(ctx->builder, object, array_alloca);
-    // For i64 arrays, we need 8-byte alignment
-    LLVMSetAlignment(store_inst, 8);
+      // Store with proper alignment - CRITICAL for i64 arrays!
+      LLVMValueRef store_inst =
+          LLVMBuildStore(ctx->builder, object, array_alloca);
+      // For i64 arrays, we need 8-byte alignment
+      LLVMSetAlignment(store_inst, 8);
+    }
 
     // Use InBoundsGEP for safety
     LLVMValueRef indices[2];
@@ -1064,6 +1074,8 @@ LLVMValueRef codegen_expr_index(CodeGenContext *ctx, AstNode *node) {
           if (sym_kind == LLVMArrayTypeKind) {
             // This is a direct array stored in the symbol
             LLVMTypeRef element_type = LLVMGetElementType(sym_type);
+            if (!check_array_bounds_runtime(ctx, sym_type, index, var_name))
+              return NULL;
 
             LLVMValueRef indices[2];
             indices[0] =
@@ -1112,6 +1124,8 @@ LLVMValueRef codegen_expr_index(CodeGenContext *ctx, AstNode *node) {
         // This is a nested array access - the first index gave us an array
         // Now index into that array
         LLVMTypeRef inner_element_type = LLVMGetElementType(first_result_type);
+        if (!check_array_bounds_runtime(ctx, first_result_type, index, NULL))
+          return NULL;
 
         // Store the array value so we can GEP into it
         LLVMValueRef temp_alloca = LLVMBuildAlloca(
@@ -1249,6 +1263,10 @@ LLVMValueRef codegen_expr_cast(CodeGenContext *ctx, AstNode *node) {
   if (!target_type || !value)
     return NULL;
 
+  // A function type names a pointer to the function: cast<fn (*void) void>(p)
+  if (LLVMGetTypeKind(target_type) == LLVMFunctionTypeKind)
+    target_type = LLVMPointerType(target_type, 0);
+
   LLVMTypeRef source_type = LLVMTypeOf(value);
   LLVMTypeKind source_kind = LLVMGetTypeKind(source_type);
   LLVMTypeKind target_kind = LLVMGetTypeKind(target_type);
@@ -1257,6 +1275,9 @@ LLVMValueRef codegen_expr_cast(CodeGenContext *ctx, AstNode *node) {
   if (source_type == target_type)
     return value;
 
+  if (source_kind == LLVMVectorTypeKind || target_kind == LLVMVectorTypeKind)
+    return codegen_vector_cast(ctx, value, target_type);
+
   // Float to Integer
   if (source_kind == LLVMFloatTypeKind || source_kind == LLVMDoubleTypeKind) {
     if (target_kind == LLVMIntegerTypeKind) {
@@ -1771,42 +1792,47 @@ LLVMValueRef codegen_expr_syscall(CodeGenContext *ctx, AstNode *node) {
                           "syscall_result");
   }
 #else
+  // The kernel overwrites rcx (return address) and r11 (flags) and may write
+  // any memory passed to it, so neither may be cached across the call
+#define SYSCALL_CLOBBERS ",~{rcx},~{r11},~{memory}"
   const char *asm_template;
   const char *constraints;
 
   switch (arg_count) {
   case 1: // syscall number only
     asm_template = "syscall";
-    constraints = "={rax},{rax}";
+    constraints = "={rax},{rax}" SYSCALL_CLOBBERS;
     break;
   case 2: // syscall + 1 arg
     asm_template = "syscall";
-    constraints = "={rax},{rax},{rdi}";
+    constraints = "={rax},{rax},{rdi}" SYSCALL_CLOBBERS;
     break;
   case 3: // syscall + 2 args
     asm_template = "syscall";
-    constraints = "={rax},{rax},{rdi},{rsi}";
+    constraints = "={rax},{rax},{rdi},{rsi}" SYSCALL_CLOBBERS;
     break;
   case 4: // syscall + 3 args
     asm_template = "syscall";
-    constraints = "={rax},{rax},{rdi},{rsi},{rdx}";
+    constraints = "={rax},{rax},{rdi},{rsi},{rdx}" SYSCALL_CLOBBERS;
     break;
   case 5: // syscall + 4 args
     asm_template = "syscall";
-    constraints = "={rax},{rax},{rdi},{rsi},{rdx},{r10}";
+    constraints = "={rax},{rax},{rdi},{rsi},{rdx},{r10}" SYSCALL_CLOBBERS;
     break;
   case 6: // syscall + 5 args
     asm_template = "syscall";
-    constraints = "={rax},{rax},{rdi},{rsi},{rdx},{r10},{r8}";
+    constraints = "={rax},{rax},{rdi},{rsi},{rdx},{r10},{r8}" SYSCALL_CLOBBERS;
     break;
   case 7: // syscall + 6 args (maximum)
     asm_template = "syscall";
-    constraints = "={rax},{rax},{rdi},{rsi},{rdx},{r10},{r8},{r9}";
+    constraints =
+        "={rax},{rax},{rdi},{rsi},{rdx},{r10},{r8},{r9}" SYSCALL_CLOBBERS;
     break;
   default:
     fprintf(stderr, "Error: Invalid syscall argument count\n");
     return NULL;
   }
+#undef SYSCALL_CLOBBERS
 
   // Create parameter types array (all i64)
   LLVMTypeRef *param_types = (LLVMTypeRef *)arena_alloc(
@@ -1843,11 +1869,18 @@ LLVMValueRef codegen_expr_syscall(CodeGenContext *ctx, AstNode *node) {
   // Mark as volatile to prevent optimization
   LLVMSetVolatile(result, true);
 
+  // Buffers reach the kernel as integers (cast<int>(&buf)), which the tail
+  // call marker's escape check doesn't see; a `tail` call is assumed not to
+  // touch the caller's stack, and stores into locals passed this way would
+  // be dropped
+  LLVMSetTailCallKind(result, LLVMTailCallKindNoTail);
+
   return result;
 #endif
 }
 
-// Helper: recursively compute the size of any LLVM type
+// Helper: recursively compute the size of any LLVM type, for when there is
+// no target data
 static uint64_t compute_type_size(LLVMTypeRef type) {
   LLVMTypeKind kind = LLVMGetTypeKind(type);
 
@@ -1910,16 +1943,40 @@ LLVMValueRef codegen_expr_sizeof(CodeGenContext *ctx, AstNode *node) {
   if (!type)
     return NULL;
 
-  uint64_t size = compute_type_size(type);
+  // The target's own layout, so padding, #packed and #align are counted the
+  // way the struct is actually stored
+  LLVMTargetDataRef target_data = get_target_data(ctx);
+  uint64_t size = target_data && LLVMTypeIsSized(type)
+                      ? LLVMABISizeOfType(target_data, type)
+                      : compute_type_size(type);
   return LLVMConstInt(LLVMInt64TypeInContext(ctx->context), size, false);
 }
 
+// Largest alloc() that escape analysis may move to the stack
+#define STACK_ALLOC_LIMIT 4096
+
 // alloc(expr) - allocates memory on heap using malloc
 LLVMValueRef codegen_expr_alloc(CodeGenContext *ctx, AstNode *node) {
   LLVMValueRef size = codegen_expr(ctx, node->expr.alloc.size);
   if (!size)
     return NULL;
 
+  // An allocation that never leaves the function (see stack_alloc.c) gets an
+  // entry-block slot, which a loop reuses, and its free() is dropped
+  node->expr.alloc.on_stack = false;
+  if (node->expr.alloc.no_escape && LLVMIsAConstantInt(size)) {
+    unsigned long long bytes = LLVMConstIntGetZExtValue(size);
+    if (bytes > 0 && bytes <= STACK_ALLOC_LIMIT) {
+      LLVMTypeRef byte_type = LLVMInt8TypeInContext(ctx->context);
+      LLVMValueRef slot = entry_alloca(
+          ctx, LLVMArrayType(byte_type, (unsigned)bytes), "stack_alloc");
+      LLVMSetAlignment(slot, 16); // What malloc guarantees
+      node->expr.alloc.on_stack = true;
+      return LLVMBuildPointerCast(ctx->builder, slot,
+                                  LLVMPointerType(byte_type, 0), "alloc");
+    }
+  }
+
   // Get or declare malloc function
   LLVMModuleRef current_llvm_module =
       ctx->current_module ? ctx->current_module->module : ctx->module;
@@ -1951,6 +2008,10 @@ LLVMValueRef codegen_expr_free(CodeGenContext *ctx, AstNode *node) {
   if (!ptr)
     return NULL;
 
+  AstNode *stack_alloc = node->expr.free.stack_alloc;
+  if (stack_alloc && stack_alloc->expr.alloc.on_stack)
+    return ptr;
+
   // Get or declare free function
   LLVMModuleRef current_llvm_module =
       ctx->current_module ? ctx->current_module->module : ctx->module;
@@ -1994,12 +2055,15 @@ LLVMValueRef codegen_expr_deref(CodeGenContext *ctx, AstNode *node) {
     return NULL;
   }
 
-  // Try to infer the element type from the variable's symbol information
-  LLVMTypeRef element_type = NULL;
+  // The typechecker already worked out what the load produces
+  LLVMTypeRef element_type = codegen_checked_type(ctx, node);
+  if (element_type && LLVMGetTypeKind(element_type) == LLVMVoidTypeKind)
+    element_type = NULL;
 
-  // If the dereference target is an identifier, try to get type info from
-  // symbol table
-  if (node->expr.deref.object->type == AST_EXPR_IDENTIFIER) {
+  // Otherwise try to infer the element type from the variable's symbol
+  // information, if the dereference target is an identifier
+  if (!element_type &&
+      node->expr.deref.object->type == AST_EXPR_IDENTIFIER) {
     const char *var_name = node->expr.deref.object->expr.identifier.name;
     LLVM_Symbol *sym = find_symbol(ctx, var_name);
 
@@ -2045,6 +2109,10 @@ LLVMValueRef codegen_expr_deref(CodeGenContext *ctx, AstNode *node) {
 
 static LLVMTypeRef resolve_pointer_element_type(CodeGenContext *ctx,
                                                 AstNode *expr) {
+  LLVMTypeRef checked = codegen_checked_element_type(ctx, expr);
+  if (checked && LLVMGetTypeKind(checked) != LLVMVoidTypeKind)
+    return checked;
+
   if (expr->type == AST_EXPR_IDENTIFIER) {
     const char *var_name = expr->expr.identifier.name;
     LLVM_Symbol *sym = find_symbol(ctx, var_name);
@@ -2168,16 +2236,10 @@ LLVMValueRef codegen_expr_addr(CodeGenContext *ctx, AstNode *node) {
       }
 
       LLVMTypeRef sym_type = sym->type;
-      StructInfo *struct_info = NULL;
-
-      for (StructInfo *info = ctx->struct_types; info; info = info->next) {
-        if (info->llvm_type == sym_type ||
-            (LLVMGetTypeKind(sym_type) == LLVMPointerTypeKind &&
-             info->llvm_type == sym->element_type)) {
-          struct_info = info;
-          break;
-        }
-      }
+      StructInfo *struct_info = find_struct_by_llvm_type(
+          ctx, LLVMGetTypeKind(sym_type) == LLVMPointerTypeKind
+                   ? sym->element_type
+                   : sym_type);
 
       if (!struct_info) {
         LLVMTypeRef lookup_type =
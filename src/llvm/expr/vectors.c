@@ -0,0 +1,236 @@
+#include "../llvm.h"
+
+// vec<T, N> lowers to <N x T>, so operators on it are single vector
+// instructions. A scalar meeting a vector is splatted across the lanes;
+// swizzles are shuffles and reductions halve the vector until one lane is
+// left, which the backend turns into its horizontal instructions.
+
+LLVMTypeRef lane_type(LLVMTypeRef type) {
+  return LLVMGetTypeKind(type) == LLVMVectorTypeKind ? LLVMGetElementType(type)
+                                                     : type;
+}
+
+bool is_vector_expr(AstNode *expr) {
+  return expr && expr->category == Node_Category_EXPR &&
+         expr->expr.checked_type &&
+         expr->expr.checked_type->type == AST_TYPE_VECTOR;
+}
+
+static const char swizzle_letters[] = "xyzw";
+
+static LLVMValueRef lane_index(CodeGenContext *ctx, unsigned lane) {
+  return LLVMConstInt(ctx->common_types.i32, lane, false);
+}
+
+LLVMValueRef convert_lanes(CodeGenContext *ctx, LLVMValueRef value,
+                           LLVMTypeRef to_type) {
+  LLVMTypeRef from_type = LLVMTypeOf(value);
+  if (from_type == to_type)
+    return value;
+
+  LLVMTypeRef from = lane_type(from_type);
+  LLVMTypeRef to = lane_type(to_type);
+  bool from_float = is_float_type(from);
+  bool to_float = is_float_type(to);
+
+  LLVMOpcode op;
+  if (!from_float && !to_float) {
+    unsigned from_bits = LLVMGetIntTypeWidth(from);
+    unsigned to_bits = LLVMGetIntTypeWidth(to);
+    if (from_bits == to_bits)
+      return value;
+    // bool lanes are 0 or 1, never -1
+    op = from_bits > to_bits ? LLVMTrunc
+         : from_bits == 1    ? LLVMZExt
+                             : LLVMSExt;
+  } else if (from_float && to_float) {
+    op = LLVMGetTypeKind(from) == LLVMFloatTypeKind ? LLVMFPExt : LLVMFPTrunc;
+  } else if (from_float) {
+    op = LLVMFPToSI;
+  } else {
+    op = LLVMGetIntTypeWidth(from) == 1 ? LLVMUIToFP : LLVMSIToFP;
+  }
+  return LLVMBuildCast(ctx->builder, op, value, to_type, "lane_cast");
+}
+
+LLVMValueRef splat_vector(CodeGenContext *ctx, LLVMValueRef scalar,
+                          LLVMTypeRef vector_type) {
+  scalar = convert_lanes(ctx, scalar, LLVMGetElementType(vector_type));
+  LLVMValueRef single =
+      LLVMBuildInsertElement(ctx->builder, LLVMGetUndef(vector_type), scalar,
+                             lane_index(ctx, 0), "splat");
+  LLVMValueRef mask = LLVMConstNull(
+      LLVMVectorType(ctx->common_types.i32, LLVMGetVectorSize(vector_type)));
+  return LLVMBuildShuffleVector(ctx->builder, single,
+                                LLVMGetUndef(vector_type), mask, "splat");
+}
+
+// The given lanes of vector, in order, as a vector of their own
+static LLVMValueRef shuffle_lanes(CodeGenContext *ctx, LLVMValueRef vector,
+                                  const unsigned *lanes, unsigned count) {
+  LLVMValueRef *mask = (LLVMValueRef *)arena_alloc(
+      ctx->arena, sizeof(LLVMValueRef) * count, alignof(LLVMValueRef));
+  for (unsigned i = 0; i < count; i++)
+    mask[i] = lane_index(ctx, lanes[i]);
+  return LLVMBuildShuffleVector(ctx->builder, vector,
+                                LLVMGetUndef(LLVMTypeOf(vector)),
+                                LLVMConstVector(mask, count), "shuffle");
+}
+
+LLVMValueRef codegen_vector_cast(CodeGenContext *ctx, LLVMValueRef value,
+                                 LLVMTypeRef target_type) {
+  LLVMTypeRef source_type = LLVMTypeOf(value);
+
+  if (LLVMGetTypeKind(target_type) == LLVMArrayTypeKind) {
+    LLVMTypeRef element = LLVMGetElementType(target_type);
+    LLVMValueRef array = LLVMGetUndef(target_type);
+    for (unsigned i = 0; i < LLVMGetArrayLength(target_type); i++) {
+      LLVMValueRef lane = LLVMBuildExtractElement(
+          ctx->builder, value, lane_index(ctx, i), "lane");
+      array = LLVMBuildInsertValue(ctx->builder, array,
+                                   convert_lanes(ctx, lane, element), i,
+                                   "array_lane");
+    }
+    return array;
+  }
+
+  LLVMTypeRef element = LLVMGetElementType(target_type);
+  switch (LLVMGetTypeKind(source_type)) {
+  case LLVMVectorTypeKind:
+    return convert_lanes(ctx, value, target_type);
+
+  case LLVMArrayTypeKind: {
+    LLVMValueRef vector = LLVMGetUndef(target_type);
+    for (unsigned i = 0; i < LLVMGetVectorSize(target_type); i++) {
+      LLVMValueRef lane =
+          LLVMBuildExtractValue(ctx->builder, value, i, "array_lane");
+      vector = LLVMBuildInsertElement(ctx->builder, vector,
+                                      convert_lanes(ctx, lane, element),
+                                      lane_index(ctx, i), "lane");
+    }
+    return vector;
+  }
+
+  case LLVMPointerTypeKind: {
+    // The lanes sit wherever the elements do, so only the element's own
+    // alignment is assumed; *cast<*vec<T, N>>(p) assumes the vector's
+    LLVMValueRef load =
+        LLVMBuildLoad2(ctx->builder, target_type, value, "vector_load");
+    unsigned bits = LLVMGetTypeKind(element) == LLVMIntegerTypeKind
+                        ? LLVMGetIntTypeWidth(element)
+                    : LLVMGetTypeKind(element) == LLVMFloatTypeKind ? 32
+                                                                    : 64;
+    LLVMSetAlignment(load, bits < 8 ? 1 : bits / 8);
+    return load;
+  }
+
+  default:
+    return splat_vector(ctx, value, target_type);
+  }
+}
+
+LLVMValueRef codegen_vector_swizzle(CodeGenContext *ctx, AstNode *node) {
+  LLVMValueRef vector = codegen_expr(ctx, node->expr.member.object);
+  if (!vector)
+    return NULL;
+
+  const char *swizzle = node->expr.member.member;
+  unsigned count = (unsigned)strlen(swizzle);
+  unsigned lanes[16];
+  for (unsigned i = 0; i < count && i < 16; i++)
+    lanes[i] = (unsigned)(strchr(swizzle_letters, swizzle[i]) - swizzle_letters);
+
+  if (count == 1)
+    return LLVMBuildExtractElement(ctx->builder, vector,
+                                   lane_index(ctx, lanes[0]), swizzle);
+  return shuffle_lanes(ctx, vector, lanes, count);
+}
+
+static LLVMValueRef reduce_pair(CodeGenContext *ctx, const char *method,
+                                LLVMValueRef a, LLVMValueRef b) {
+  bool is_float = is_float_type(lane_type(LLVMTypeOf(a)));
+  LLVMBuilderRef builder = ctx->builder;
+
+  if (strcmp(method, "sum") == 0)
+    return is_float ? LLVMBuildFAdd(builder, a, b, "sum")
+                    : LLVMBuildAdd(builder, a, b, "sum");
+  if (strcmp(method, "product") == 0)
+    return is_float ? LLVMBuildFMul(builder, a, b, "product")
+                    : LLVMBuildMul(builder, a, b, "product");
+  if (strcmp(method, "any") == 0)
+    return LLVMBuildOr(builder, a, b, "any");
+  if (strcmp(method, "all") == 0)
+    return LLVMBuildAnd(builder, a, b, "all");
+
+  bool is_min = strcmp(method, "min") == 0;
+  LLVMValueRef a_first =
+      is_float ? LLVMBuildFCmp(builder, is_min ? LLVMRealOLT : LLVMRealOGT, a,
+                               b, method)
+               : LLVMBuildICmp(builder, is_min ? LLVMIntSLT : LLVMIntSGT, a,
+                               b, method);
+  return LLVMBuildSelect(builder, a_first, a, b, method);
+}
+
+// Adds (or multiplies, or compares) the low half of the lanes to the high
+// half until one lane is left, so float sums are pairwise rather than left
+// to right
+LLVMValueRef codegen_vector_reduce(CodeGenContext *ctx, AstNode *node) {
+  AstNode *callee = node->expr.call.callee;
+  LLVMValueRef vector = codegen_expr(ctx, callee->expr.member.object);
+  if (!vector)
+    return NULL;
+
+  const char *method = callee->expr.member.member;
+  unsigned lanes[32];
+  unsigned count = LLVMGetVectorSize(LLVMTypeOf(vector));
+
+  // The bool lanes as the bits of an int, one movemask on x86
+  if (strcmp(method, "mask") == 0) {
+    LLVMValueRef bits = LLVMBuildBitCast(
+        ctx->builder, vector, LLVMIntTypeInContext(ctx->context, count),
+        "mask");
+    return count == 64 ? bits
+                       : LLVMBuildZExt(ctx->builder, bits,
+                                       ctx->common_types.i64, "mask");
+  }
+  while (count > 1) {
+    unsigned half = count / 2;
+    for (unsigned i = 0; i < half; i++)
+      lanes[i] = i;
+    LLVMValueRef low = shuffle_lanes(ctx, vector, lanes, half);
+    for (unsigned i = 0; i < half; i++)
+      lanes[i] = half + i;
+    LLVMValueRef high = shuffle_lanes(ctx, vector, lanes, half);
+    vector = reduce_pair(ctx, method, low, high);
+    count = half;
+  }
+  return LLVMBuildExtractElement(ctx->builder, vector, lane_index(ctx, 0),
+                                 method);
+}
+
+LLVMValueRef codegen_vector_lane_store(CodeGenContext *ctx, AstNode *target,
+                                       LLVMValueRef value) {
+  AstNode *object = target->expr.index.object;
+  LLVM_Symbol *sym = object->type == AST_EXPR_IDENTIFIER
+                         ? find_symbol(ctx, object->expr.identifier.name)
+                         : NULL;
+  if (!sym || sym->is_function) {
+    fprintf(stderr,
+            "Error: Vector lanes can only be assigned through a variable\n");
+    return NULL;
+  }
+
+  LLVMValueRef index = codegen_expr(ctx, target->expr.index.index);
+  if (!index)
+    return NULL;
+
+  LLVMValueRef vector =
+      LLVMBuildLoad2(ctx->builder, sym->type, sym->value, "vector");
+  LLVMValueRef lane =
+      convert_lanes(ctx, value, LLVMGetElementType(sym->type));
+  LLVMBuildStore(ctx->builder,
+                 LLVMBuildInsertElement(ctx->builder, vector, lane, index,
+                                        "set_lane"),
+                 sym->value);
+  return value;
+}
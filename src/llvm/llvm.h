@@ -19,17 +19,65 @@
 
 // Project Headers
 #include "../ast/ast.h"
+#include "../ast/module_graph.h"
+#include "../ast/type_table.h"
+#include "../c_libs/intern/intern.h"
 #include "../c_libs/memory/memory.h"
 
-#define SYMBOL_HASH_SIZE 1024
 #define MAX_LINK_LIBS 64
+#define FIELD_CACHE_BUCKETS 256
+
+// Name of the single object written in full LTO mode
+#define LTO_OBJECT_NAME "__luma_lto"
+
+// Link-time optimization mode (-flto / -flto=thin)
+typedef enum {
+  LTO_NONE = 0,
+  LTO_FULL, // Merge all modules into one before optimizing
+  LTO_THIN, // Emit bitcode with summaries, optimize at link time
+} LTOMode;
+
+// Processor the generated code may assume (-march= / -mcpu= / -mattr=).
+// All NULL selects the portable default for the target.
+typedef struct {
+  const char *arch;     // ISA level such as "x86-64-v3", or "native"
+  const char *cpu;      // Exact LLVM processor name, takes precedence
+  const char *features; // "+feature,-feature" list applied on top
+} TargetCPUOptions;
+
+// Profile-guided optimization (-fprofile-generate / -fprofile-use=)
+typedef enum {
+  PGO_NONE = 0,
+  PGO_GENERATE, // Instrument; the program writes raw profiles when it exits
+  PGO_USE,      // Optimize with the counts of a merged .profdata file
+} PGOMode;
+
+typedef struct {
+  PGOMode mode;
+  const char *path; // Raw profile directory (generate) or .profdata (use)
+} ProfileOptions;
+
+// Open-addressed map keyed by pointer identity (atoms, LLVM handles), kept
+// at most half full. A zero-initialized map is empty.
+typedef struct PointerMap {
+  const void **keys;
+  void **values;
+  size_t count;
+  size_t capacity; // Zero or a power of two
+} PointerMap;
+
+void *pointer_map_get(const PointerMap *map, const void *key);
+// Inserts or replaces the value stored for key
+void pointer_map_put(PointerMap *map, const void *key, void *value);
+void pointer_map_free(PointerMap *map);
 
 typedef struct LLVM_Symbol LLVM_Symbol;
 typedef struct CodeGenContext CodeGenContext;
 typedef struct ModuleCompilationUnit ModuleCompilationUnit;
+typedef struct ModuleCompileQueue ModuleCompileQueue;
 
 struct LLVM_Symbol {
-  char *name;
+  Atom name;
   LLVMValueRef value;
   LLVMTypeRef type;         // The type of the symbol itself
   LLVMTypeRef element_type; // For pointer types, what it points to
@@ -39,9 +87,12 @@ struct LLVM_Symbol {
 
 // Individual module compilation unit
 struct ModuleCompilationUnit {
-  char *module_name;
+  Atom module_name;
   LLVMModuleRef module;
-  LLVM_Symbol *symbols;
+  LLVM_Symbol *symbols;    // Newest first, for walks over every symbol
+  PointerMap symbol_index; // Name atom -> newest symbol with that name
+  // Name atom -> value of a top-level const, once evaluated (comptime.c)
+  PointerMap comptime_values;
   bool is_main_module;
   struct ModuleCompilationUnit *next;
 
@@ -51,29 +102,69 @@ struct ModuleCompilationUnit {
   LLVMDIBuilderRef dibuilder;
   LLVMMetadataRef compile_unit;
   LLVMMetadataRef file_metadata;
-};
 
-typedef struct ModuleDependencyInfo {
-  const char *module_name;
-  char **dependencies; // Array of module names this depends on
-  size_t dep_count;
-  bool processed;
-} ModuleDependencyInfo;
+  // Hash of this module's tokens and (transitively) its @use dependencies,
+  // used as the base of the object cache key
+  uint64_t source_hash;
+
+  // Standard library modules: the object is shared through the std cache, and
+  // when prebuilt_object is set only declarations were generated
+  bool is_std_module;
+  const char *prebuilt_object;
+
+  // Handed to the emission workers; its IR must not change afterwards
+  bool emission_queued;
+};
 
 typedef struct DeferredStatement {
   AstNode *statement;
-  LLVMBasicBlockRef cleanup_block;
-  struct DeferredStatement *next;
+  LLVMBasicBlockRef cleanup_block; // Where exits taken after it enter
+  struct DeferredStatement *next;  // The one deferred before it
 } DeferredStatement;
 
+// Where a scope's cleanup goes once its defers have run: on to dest, after
+// unwinding the scopes up to stop (NULL unwinds all of them)
+typedef struct {
+  LLVMBasicBlockRef dest;
+  struct DeferScope *stop;
+} DeferExit;
+
+// A block and its defers. Every exit from the block branches into one
+// cleanup chain, emitted when the block ends, and a selector tells the end
+// of the chain which exit was taken.
+typedef struct DeferScope {
+  DeferredStatement *defers; // Newest first
+  DeferExit *exits;
+  size_t exit_count;
+  size_t exit_capacity;
+  LLVMValueRef selector; // i32 slot, created by the first exit
+  // The loop blocks the block was opened under; break and continue unwind
+  // every scope that shares them
+  LLVMBasicBlockRef break_block;
+  LLVMBasicBlockRef continue_block;
+  struct DeferScope *parent;
+} DeferScope;
+
+// Defer bookkeeping of the function being generated
+typedef struct {
+  DeferScope *scope;              // Innermost open block
+  LLVMValueRef return_slot;       // What a return through cleanups returns
+  LLVMBasicBlockRef return_block; // Where those returns end up
+} DeferState;
+
 typedef struct StructInfo {
-  char *name;
+  Atom name;
   LLVMTypeRef llvm_type;
-  char **field_names;
+  Atom *field_names;
   LLVMTypeRef *field_types;
   LLVMTypeRef *field_element_types;
   bool *field_is_public;
+  // Per field, set when the layout was computed for #packed or #align.
+  // Padding fields have no name and alignment 1.
+  unsigned *field_alignments;
   size_t field_count;
+  unsigned alignment;    // #align or the largest field alignment, 0 = LLVM's
+  bool is_packed_layout; // Some field sits below its natural alignment
   bool is_public;
   struct StructInfo *next;
 } StructInfo;
@@ -94,6 +185,13 @@ typedef struct CommonTypes {
   LLVMValueRef const_i64_0, const_i64_1;
 } CommonTypes;
 
+// TBAA access tags of field types, created on first use (attributes.c)
+typedef struct TBAATags {
+  unsigned kind; // "tbaa" metadata kind
+  LLVMMetadataRef root, omnipotent_char;
+  LLVMMetadataRef i16, i32, i64, f32, f64, pointer;
+} TBAATags;
+
 // Code generation context
 struct CodeGenContext {
   // LLVM Core Components
@@ -103,54 +201,72 @@ struct CodeGenContext {
   // Module Management (New System)
   ModuleCompilationUnit *modules;
   ModuleCompilationUnit *current_module;
+  PointerMap module_index; // Name atom -> module
 
   // Legacy Support (for backward compatibility)
   LLVMModuleRef module;
 
   // Defer statement tracking
-  struct DeferredStatement *deferred_statements;
-  size_t deferred_count;
-  size_t deferred_capacity;
+  DeferState defers;
 
   // Code Generation State
+  AstNode *current_module_ast; // The @module whose body is being generated
   LLVMValueRef current_function;
+  // Stack buffer print statements format into, and the function it's in
+  LLVMValueRef print_buffer;
+  LLVMValueRef print_buffer_function;
   LLVMBasicBlockRef loop_continue_block;
   LLVMBasicBlockRef loop_break_block;
 
   CommonTypes common_types;
-  StructInfo *struct_types;
+  uint32_t type_cache_owner; // Tags LLVM types cached on canonical types
+  StructInfo *struct_types;     // Newest first
+  PointerMap struct_index;      // Name atom -> struct
+  PointerMap struct_type_index; // LLVMTypeRef -> newest struct lowered to it
+  // Resolved member accesses, by struct and field name (struct_access.c)
+  struct FieldAccessCache *field_cache[FIELD_CACHE_BUCKETS];
 
   const char *target_os;
+  TargetCPUOptions cpu_options;
+  LLVMTargetDataRef target_data; // Of the build target, see get_target_data
+  TBAATags tbaa;
+  bool has_packed_structs; // Field accesses need align_packed_accesses
 
   // Debug Info
   bool is_debug;
   LLVMMetadataRef current_func_di;
 
+  // Optimization
+  int opt_level;             // 0-3, mirrors BuildConfig.opt_level
+  const char *pass_pipeline; // Explicit new-PM pipeline, overrides opt_level
+  LTOMode lto_mode;
+  ProfileOptions profile;
+  bool inline_imports; // Copy small imported bodies in, see module_handles.c
+
+  // Runtime bounds checks (-fbounds-check, arrays.c): the trap block shared
+  // by the checks of bounds_trap_function, and the innermost counted loop
+  // whose range may prove them
+  bool bounds_check;
+  LLVMBasicBlockRef bounds_trap;
+  LLVMValueRef bounds_trap_function;
+  struct BoundsLoop *bounds_loop;
+
+  // Call, cycle and iteration counters (-fprofile-counters,
+  // profile_counters.c): the sites of the module being generated
+  bool profile_counters;
+  struct ProfileSite *profile_sites;
+
+  // Incremental builds
+  bool use_object_cache;        // Reuse up-to-date objects in the output dir
+  const char *compiler_version; // Folded into object cache keys
+  bool declarations_only;       // Emit bodiless declarations (prebuilt std)
+  // Object emission running behind IR generation, NULL when not pipelined
+  ModuleCompileQueue *emit_queue;
+
   // Memory Management
   ArenaAllocator *arena;
 };
 
-typedef struct SymbolHashEntry {
-  const char *key; // "module_name:symbol_name"
-  LLVM_Symbol *symbol;
-  struct SymbolHashEntry *next;
-} SymbolHashEntry;
-
-typedef struct SymbolHashTable {
-  SymbolHashEntry *buckets[SYMBOL_HASH_SIZE];
-} SymbolHashTable;
-
-// Hash table for struct types
-typedef struct StructHashEntry {
-  const char *name;
-  StructInfo *info;
-  struct StructHashEntry *next;
-} StructHashEntry;
-
-typedef struct StructHashTable {
-  StructHashEntry *buckets[SYMBOL_HASH_SIZE];
-} StructHashTable;
-
 // =============================================================================
 // MODULE MANAGEMENT FUNCTIONS
 // =============================================================================
@@ -166,35 +282,95 @@ ModuleCompilationUnit *find_module(CodeGenContext *ctx,
 // Set current module for code generation
 void set_current_module(CodeGenContext *ctx, ModuleCompilationUnit *module);
 
+// Worker count for parallel build stages (LUMA_COMPILE_THREADS or CPU count)
+size_t get_compile_thread_count(void);
+
+// Write bitcode with a ThinLTO module summary (thin_bitcode.cpp)
+bool write_thin_bitcode_file(LLVMModuleRef module, const char *path);
+
+// Distinct metadata for loop hints: an empty access group, and a loop ID
+// listing properties after itself (loop_metadata.cpp)
+LLVMMetadataRef create_access_group(LLVMContextRef context);
+LLVMMetadataRef create_loop_id(LLVMContextRef context,
+                               LLVMMetadataRef *properties, size_t count);
+
+// Run a pass pipeline with PGO instrumentation or profile use (pgo.cpp)
+bool run_profile_passes(LLVMModuleRef module, LLVMTargetMachineRef machine,
+                        const char *pipeline, int opt_level, bool instrument,
+                        const char *profile_path, char **error_message);
+
+// Run main() of the given modules in-process with ORC (jit.cpp). Takes
+// ownership of the context and the modules.
+bool jit_run_modules(LLVMContextRef context, LLVMModuleRef *modules,
+                     size_t module_count, const char **objects,
+                     size_t object_count, const char **libraries,
+                     size_t library_count, int opt_level, bool lazy, int argc,
+                     char **argv, int *exit_code);
+// Hands every generated module of ctx to jit_run_modules. The context can
+// only be cleaned up afterwards, not used for more codegen.
+bool jit_run_program(CodeGenContext *ctx, bool lazy, int argc, char **argv,
+                     int *exit_code);
+
 // Compile all modules to separate object files
 bool compile_modules_to_objects(CodeGenContext *ctx, const char *output_dir);
 
+// Starts the emission workers before IR generation, so each module can be
+// optimized and emitted while the next ones are generated. IR itself is
+// still generated on the calling thread, in the shared context: modules
+// reach each other's functions, globals and types through their LLVM
+// values. Returns false (and leaves emission to compile_modules_to_objects)
+// with a single worker or full LTO.
+bool begin_pipelined_emission(CodeGenContext *ctx, const char *output_dir,
+                              size_t module_count);
+// Queues a module whose IR is complete; a no-op when emission isn't
+// pipelined
+void submit_module_for_emission(CodeGenContext *ctx,
+                                ModuleCompilationUnit *unit);
+
 // Generate external function declarations for cross-module calls
 void generate_external_declarations(CodeGenContext *ctx,
                                     ModuleCompilationUnit *target_module);
-void preprocess_all_modules(CodeGenContext *ctx);
-StructInfo *find_struct_type_fast(CodeGenContext *ctx, const char *name);
-void cleanup_module_caches(void);
 void debug_object_files(const char *output_dir);
 StructInfo *find_concrete_struct_for_base(CodeGenContext *ctx,
                                                   StructInfo *base_info,
                                                   const char *field_name);
 
-unsigned int hash_string(const char *str);
-
-void init_symbol_cache(void);
-void cache_symbol(const char *module_name, const char *symbol_name,
-                  LLVM_Symbol *symbol);
-LLVM_Symbol *lookup_cached_symbol(const char *module_name,
-                                  const char *symbol_name);
-
-void init_struct_cache(void);
-void cache_struct(const char *name, StructInfo *info);
-StructInfo *lookup_cached_struct(const char *name);
-StructInfo *find_struct_type_fast(CodeGenContext *ctx, const char *name);
 LLVMValueRef codegen_expr_struct_assignment(CodeGenContext *ctx,
                                             AstNode *node);
 
+// =============================================================================
+// OBJECT CACHE
+// =============================================================================
+
+uint64_t cache_hash_bytes(uint64_t hash, const void *data, size_t len);
+uint64_t cache_hash_string(uint64_t hash, const char *str);
+uint64_t cache_hash_u64(uint64_t hash, uint64_t value);
+uint64_t cache_hash_file(uint64_t hash, const char *path);
+
+// Fill ModuleCompilationUnit.source_hash for every module of the program
+void compute_module_source_hashes(CodeGenContext *ctx, AstNode **modules,
+                                  const ModuleGraph *graph);
+// Same keys without a context: keys[i] for modules[i]
+void compute_module_keys(AstNode **modules, const ModuleGraph *graph,
+                         bool include_positions, uint64_t *keys);
+// Everything besides the source that decides a module's machine code; the
+// object cache key of a module is object_cache_key(fingerprint, source_hash)
+uint64_t codegen_build_fingerprint(const char *compiler_version, int opt_level,
+                                   const char *pass_pipeline, bool is_debug,
+                                   LTOMode lto_mode, const char *target_os,
+                                   const TargetCPUOptions *cpu_options,
+                                   const ProfileOptions *profile,
+                                   bool bounds_check, bool profile_counters);
+uint64_t object_cache_key(uint64_t build_fingerprint, uint64_t source_hash);
+bool std_object_cache_path(char *buffer, size_t size, const char *module_name,
+                           uint64_t key);
+bool object_cache_copy(const char *from, const char *to);
+bool object_cache_is_fresh(const char *output_dir, const char *object_path,
+                           const char *module_name, uint64_t key);
+void object_cache_store(const char *output_dir, const char *module_name,
+                        uint64_t key);
+void object_cache_invalidate(const char *output_dir, const char *module_name);
+
 // =============================================================================
 // SYMBOL IMPORT AND MODULE INTEROP
 // =============================================================================
@@ -214,6 +390,15 @@ void import_variable_symbol(CodeGenContext *ctx, LLVM_Symbol *source_symbol,
                             ModuleCompilationUnit *source_module,
                             const char *alias);
 
+// Give the declarations of unit whose definitions are small (or #inline)
+// public functions of other modules a copy of the body, so they can be
+// inlined without LTO (ctx->inline_imports)
+void import_small_function_bodies(CodeGenContext *ctx,
+                                  ModuleCompilationUnit *unit);
+// Clone source's body into dest, its declaration in another module, with
+// available_externally linkage (available_externally.cpp)
+bool copy_body_available_externally(LLVMValueRef dest, LLVMValueRef source);
+
 // Enhanced symbol lookup with module support
 LLVM_Symbol *find_symbol_with_module_support(CodeGenContext *ctx,
                                              const char *name);
@@ -262,7 +447,10 @@ bool generate_program_modules(CodeGenContext *ctx, AstNode *ast_root,
 
 // Object File Generation (per module)
 bool generate_module_object_file(ModuleCompilationUnit *module,
-                                 const char *output_path, bool is_debug);
+                                 const char *output_path, bool is_debug,
+                                 int opt_level, const char *pass_pipeline,
+                                 const TargetCPUOptions *cpu_options,
+                                 const ProfileOptions *profile);
 
 // Existing API (preserved for compatibility)
 void add_symbol(CodeGenContext *ctx, const char *name, LLVMValueRef value,
@@ -301,6 +489,91 @@ void branch_if_no_terminator(CodeGenContext *ctx, LLVMBasicBlockRef target);
 LLVMValueRef build_global_string(CodeGenContext *ctx, const char *str,
                                  const char *name);
 
+// Data layout of the build target, created on first use. NULL if the target
+// can't be resolved.
+LLVMTargetDataRef get_target_data(CodeGenContext *ctx);
+
+// Attributes and metadata (attributes.c)
+void add_enum_attribute(CodeGenContext *ctx, LLVMValueRef function,
+                        LLVMAttributeIndex index, const char *name,
+                        uint64_t value);
+// nounwind, noalias on the result of #returns_ownership functions, and
+// what #inline, #cold, #pure and the other function attributes ask for
+void set_function_attributes(CodeGenContext *ctx, LLVMValueRef function,
+                             AstNode *func_decl);
+// Marks every direct call in a #flatten function's body alwaysinline
+void flatten_calls(CodeGenContext *ctx, LLVMValueRef function);
+// noundef nonnull dereferenceable(sizeof struct) on a method's self
+void set_self_attributes(CodeGenContext *ctx, LLVMValueRef function,
+                         LLVMTypeRef struct_type);
+// Whether signed arithmetic on the type is emitted with nsw
+bool int_overflow_is_undefined(LLVMTypeRef type);
+// Copies the attributes of a definition onto its declaration elsewhere
+void copy_function_attributes(LLVMValueRef to, LLVMValueRef from);
+// Buffered output of print statements (print_runtime.c). The buffer
+// belongs to the current function; print_string and print_value append to
+// it and return the new length, print_flush writes it out.
+LLVMValueRef print_buffer(CodeGenContext *ctx);
+LLVMValueRef print_string(CodeGenContext *ctx, LLVMValueRef buffer,
+                          LLVMValueRef length, LLVMValueRef string);
+LLVMValueRef print_value(CodeGenContext *ctx, LLVMValueRef buffer,
+                         LLVMValueRef length, LLVMValueRef value);
+void print_flush(CodeGenContext *ctx, LLVMValueRef buffer,
+                 LLVMValueRef length);
+
+// With -fprofile-counters (profile_counters.c): profile_function_entry
+// counts a call at the top of a function's entry block and
+// profile_function_exits, once its body is done, adds the cycles since to
+// the site before every return; NULL and a no-op without the flag, and for
+// #pure and #const functions.
+// profile_loop_iteration counts an iteration where a loop body starts.
+// emit_profile_table registers the module's sites to be written out at exit.
+struct ProfileSite *profile_function_entry(CodeGenContext *ctx,
+                                           AstNode *func_decl);
+void profile_function_exits(CodeGenContext *ctx, LLVMValueRef function,
+                            struct ProfileSite *site);
+void profile_loop_iteration(CodeGenContext *ctx, AstNode *loop);
+void emit_profile_table(CodeGenContext *ctx, ModuleCompilationUnit *unit);
+
+// Compile-time evaluation of top-level initializers (comptime.c). The
+// initializer of a global as a constant of its type, or NULL when it does
+// more than compute; and whether it calls anything, which only a function
+// can do.
+LLVMValueRef comptime_global_initializer(CodeGenContext *ctx, AstNode *decl,
+                                         LLVMTypeRef type);
+bool comptime_needs_function(AstNode *expr);
+
+// TBAA tag on a struct field load or store
+void tag_field_access(CodeGenContext *ctx, LLVMValueRef access,
+                      LLVMTypeRef field_type);
+
+// Calling convention of large structs (abi.c). Structs bigger than this are
+// returned through an sret pointer and passed byval.
+#define AGGREGATE_REGISTER_BYTES 16
+bool passes_in_memory(CodeGenContext *ctx, LLVMTypeRef type);
+// The LLVM type a function with the source-level type is declared with
+LLVMTypeRef lower_function_type(CodeGenContext *ctx, LLVMTypeRef source_type);
+// sret and byval on a function declared with lower_function_type
+void set_abi_attributes(CodeGenContext *ctx, LLVMValueRef function,
+                        LLVMTypeRef source_type);
+// The source-level type of a declared function, undoing the lowering
+LLVMTypeRef source_function_type(CodeGenContext *ctx, LLVMValueRef function);
+// The struct a function returns through its sret pointer, or NULL
+LLVMTypeRef sret_type(LLVMValueRef function);
+// Index of the parameter that is the source's first one: 1 behind an sret
+unsigned first_source_param(LLVMValueRef function);
+// The struct lowered parameter param (an LLVM index) is a byval copy of
+LLVMTypeRef byval_type(LLVMValueRef function, unsigned param);
+// Calls callee, whose source-level type is source_type, with source-level
+// arguments; the result is the source-level return value
+LLVMValueRef entry_alloca(CodeGenContext *ctx, LLVMTypeRef type,
+                          const char *name);
+LLVMValueRef build_source_call(CodeGenContext *ctx, LLVMTypeRef source_type,
+                               LLVMValueRef callee, LLVMValueRef *args,
+                               unsigned arg_count, const char *name);
+// Rewrites load/store copies of large structs into llvm.memcpy
+void lower_struct_copies(CodeGenContext *ctx, LLVMModuleRef module);
+
 LLVMValueRef codegen_module_access(CodeGenContext *ctx, AstNode *node);
 bool is_module_identifier(CodeGenContext *ctx, const char *name);
 bool validate_module_access(CodeGenContext *ctx, const char *prefix,
@@ -313,8 +586,15 @@ const char *get_module_name_from_access(AstNode *node);
 
 // Core struct management
 StructInfo *find_struct_type(CodeGenContext *ctx, const char *name);
+// The newest struct whose LLVM type is type, or NULL
+StructInfo *find_struct_by_llvm_type(CodeGenContext *ctx, LLVMTypeRef type);
 void add_struct_type(CodeGenContext *ctx, StructInfo *struct_info);
 int get_field_index(StructInfo *struct_info, const char *field_name);
+bool is_padding_field(StructInfo *struct_info, size_t index);
+size_t named_field_count(StructInfo *struct_info);
+// Lowers the alignment of loads and stores into packed structs to what
+// their fields actually have
+void align_packed_accesses(CodeGenContext *ctx, LLVMModuleRef module);
 bool is_field_access_allowed(CodeGenContext *ctx, StructInfo *struct_info,
                              int field_index);
 StructInfo *find_concrete_struct_for_base(
@@ -380,6 +660,16 @@ LLVMValueRef codegen_stmt_link(CodeGenContext *ctx, AstNode *node);
 
 LLVMValueRef convert_value_to_type(CodeGenContext *ctx, LLVMValueRef value,
                                    LLVMTypeRef from_type, LLVMTypeRef to_type);
+// With -fbounds-check: rejects a constant index outside a fixed array and
+// emits a compare-and-trap for any other index
+bool check_array_bounds_runtime(CodeGenContext *ctx, LLVMTypeRef array_type,
+                                LLVMValueRef index, const char *var_name);
+// A for loop counting a fresh variable up by one from a constant >= 0 to a
+// constant bound: checks indexing with the counter are dropped when the
+// bound is within the array (codegen_for_loop)
+struct BoundsLoop *begin_bounds_loop(CodeGenContext *ctx, AstNode *loop);
+void end_bounds_loop(CodeGenContext *ctx, struct BoundsLoop *loop,
+                     LLVMBasicBlockRef increment_block);
 LLVMValueRef codegen_multidim_array_access(CodeGenContext *ctx,
                                            AstNode *base_expr,
                                            AstNode **indices,
@@ -416,6 +706,8 @@ LLVMValueRef codegen_expr_syscall(CodeGenContext *ctx, AstNode *node);
 LLVMValueRef codegen_expr_sizeof(CodeGenContext *ctx, AstNode *node);
 LLVMValueRef codegen_expr_alloc(CodeGenContext *ctx, AstNode *node);
 LLVMValueRef codegen_expr_free(CodeGenContext *ctx, AstNode *node);
+LLVMValueRef codegen_expr_memcpy(CodeGenContext *ctx, AstNode *node);
+LLVMValueRef codegen_expr_builtin(CodeGenContext *ctx, AstNode *node);
 LLVMValueRef codegen_expr_deref(CodeGenContext *ctx, AstNode *node);
 LLVMValueRef codegen_expr_addr(CodeGenContext *ctx, AstNode *node);
 LLVMValueRef codegen_expr_struct_literal(CodeGenContext *ctx, AstNode *node);
@@ -428,6 +720,10 @@ LLVMValueRef codegen_stmt_program(CodeGenContext *ctx, AstNode *node);
 LLVMValueRef codegen_stmt_expression(CodeGenContext *ctx, AstNode *node);
 LLVMValueRef codegen_stmt_var_decl(CodeGenContext *ctx, AstNode *node);
 LLVMValueRef codegen_stmt_function(CodeGenContext *ctx, AstNode *node);
+// Marks the allocs of a function that never escape it, and their frees
+// (stack_alloc.c); codegen_expr_alloc puts the small constant ones on the
+// stack
+void mark_stack_allocations(AstNode *func);
 
 bool is_enum_constant(LLVM_Symbol *sym);
 int64_t get_enum_constant_value(LLVM_Symbol *sym);
@@ -443,6 +739,10 @@ LLVMValueRef codegen_infinite_loop(CodeGenContext *ctx, AstNode *node);
 LLVMValueRef codegen_while_loop(CodeGenContext *ctx, AstNode *node);
 LLVMValueRef codegen_for_loop(CodeGenContext *ctx, AstNode *node);
 LLVMValueRef codegen_loop(CodeGenContext *ctx, AstNode *node);
+// Loop hints of a loop whose blocks start at header (loop_hints.c);
+// entry_branch is the branch into the loop, every other one is a latch
+void apply_loop_hints(CodeGenContext *ctx, AstNode *loop,
+                      LLVMBasicBlockRef header, LLVMValueRef entry_branch);
 
 LLVMValueRef codegen_stmt_break_continue(CodeGenContext *ctx, AstNode *node);
 
@@ -459,10 +759,33 @@ LLVMValueRef codegen_enum_member_case(CodeGenContext *ctx,
 
 void init_defer_stack(CodeGenContext *ctx);
 void push_defer_statement(CodeGenContext *ctx, AstNode *statement);
-void execute_deferred_statements_inline(CodeGenContext *ctx,
-                                        DeferredStatement *defers);
-void generate_cleanup_blocks(CodeGenContext *ctx);
-void clear_defer_stack(CodeGenContext *ctx);
+void push_defer_scope(CodeGenContext *ctx, DeferScope *scope);
+void pop_defer_scope(CodeGenContext *ctx);
+void generate_cleanup_blocks(CodeGenContext *ctx, DeferScope *scope);
+DeferScope *loop_exit_scope(CodeGenContext *ctx, bool is_continue);
+bool has_pending_defers(CodeGenContext *ctx, DeferScope *stop);
+void build_scope_exit(CodeGenContext *ctx, LLVMBasicBlockRef dest,
+                      DeferScope *stop);
+LLVMValueRef build_deferred_return(CodeGenContext *ctx, LLVMValueRef value);
+void finish_function_defers(CodeGenContext *ctx);
+
+// =============================================================================
+// SIMD VECTORS (vectors.c)
+// =============================================================================
+
+// The lane type of a vector, or the type itself for scalars
+LLVMTypeRef lane_type(LLVMTypeRef type);
+bool is_vector_expr(AstNode *expr);
+LLVMValueRef convert_lanes(CodeGenContext *ctx, LLVMValueRef value,
+                           LLVMTypeRef to_type);
+LLVMValueRef splat_vector(CodeGenContext *ctx, LLVMValueRef scalar,
+                          LLVMTypeRef vector_type);
+LLVMValueRef codegen_vector_cast(CodeGenContext *ctx, LLVMValueRef value,
+                                 LLVMTypeRef target_type);
+LLVMValueRef codegen_vector_swizzle(CodeGenContext *ctx, AstNode *node);
+LLVMValueRef codegen_vector_reduce(CodeGenContext *ctx, AstNode *node);
+LLVMValueRef codegen_vector_lane_store(CodeGenContext *ctx, AstNode *target,
+                                       LLVMValueRef value);
 
 // =============================================================================
 // RANGE SUPPORT FUNCTIONS - Add this new section
@@ -493,4 +816,11 @@ LLVMValueRef range_length(CodeGenContext *ctx, LLVMValueRef range_struct);
 LLVMTypeRef codegen_type_basic(CodeGenContext *ctx, AstNode *node);
 LLVMTypeRef codegen_type_pointer(CodeGenContext *ctx, AstNode *node);
 LLVMTypeRef codegen_type_array(CodeGenContext *ctx, AstNode *node);
+LLVMTypeRef codegen_type_vector(CodeGenContext *ctx, AstNode *node);
 LLVMTypeRef codegen_type_function(CodeGenContext *ctx, AstNode *node);
+
+// Types the typechecker recorded on expressions (expr.checked_type). NULL
+// when nothing was recorded or the type doesn't lower cleanly, so callers
+// keep their own fallback; neither reports errors.
+LLVMTypeRef codegen_checked_type(CodeGenContext *ctx, AstNode *expr);
+LLVMTypeRef codegen_checked_element_type(CodeGenContext *ctx, AstNode *expr);
@@ -0,0 +1,152 @@
+// available_externally.cpp - Copy a function body into another module
+//
+// An available_externally definition lets the optimizer of an importing
+// module inline a function whose real definition lives in another object.
+// The C API cannot clone a function across modules, so this shim declares
+// whatever the body refers to in the destination module and clones it there.
+#include "llvm-c/Core.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+using namespace llvm;
+
+// Every global an operand refers to, looking into constant expressions
+static void collect_globals(Value *value,
+                            SmallPtrSetImpl<GlobalValue *> &globals,
+                            SmallPtrSetImpl<Constant *> &seen) {
+  if (auto *global = dyn_cast<GlobalValue>(value)) {
+    globals.insert(global);
+    return;
+  }
+  auto *constant = dyn_cast<Constant>(value);
+  if (!constant || !seen.insert(constant).second)
+    return;
+  for (Value *operand : constant->operands())
+    collect_globals(operand, globals, seen);
+}
+
+// A module-level const is an internal global that nothing stores to; only
+// loads mean its address never leaves the module either
+static bool only_loaded(GlobalVariable *variable) {
+  for (User *user : variable->users()) {
+    if (!isa<LoadInst>(user))
+      return false;
+  }
+  return true;
+}
+
+// The counterpart of a global the body uses, in dest. Null when it has no
+// name outside its module, except for constants that are simply copied.
+static GlobalValue *counterpart(Module &dest, GlobalValue *global) {
+  if (auto *function = dyn_cast<Function>(global)) {
+    if (function->hasLocalLinkage())
+      return nullptr;
+    if (GlobalValue *existing = dest.getNamedValue(function->getName()))
+      return existing->getValueType() == function->getValueType() ? existing
+                                                                  : nullptr;
+    Function *decl =
+        Function::Create(function->getFunctionType(),
+                         GlobalValue::ExternalLinkage, function->getName(),
+                         &dest);
+    decl->copyAttributesFrom(function);
+    decl->setLinkage(GlobalValue::ExternalLinkage);
+    return decl;
+  }
+
+  auto *variable = dyn_cast<GlobalVariable>(global);
+  if (!variable)
+    return nullptr; // Aliases and ifuncs
+
+  if (variable->hasLocalLinkage()) {
+    // String literals and other private constants: a copy is as good
+    Constant *init =
+        variable->hasInitializer() ? variable->getInitializer() : nullptr;
+    if (!init || variable->isThreadLocal() ||
+        !(variable->isConstant() ? variable->hasGlobalUnnamedAddr()
+                                 : only_loaded(variable)))
+      return nullptr;
+    SmallPtrSet<GlobalValue *, 4> refers_to;
+    SmallPtrSet<Constant *, 8> seen;
+    collect_globals(init, refers_to, seen);
+    if (!refers_to.empty())
+      return nullptr;
+    auto *copy = new GlobalVariable(dest, variable->getValueType(), true,
+                                    GlobalValue::PrivateLinkage, init,
+                                    variable->getName());
+    copy->copyAttributesFrom(variable);
+    return copy;
+  }
+
+  if (GlobalValue *existing = dest.getNamedValue(variable->getName()))
+    return existing->getValueType() == variable->getValueType() ? existing
+                                                                : nullptr;
+  auto *decl = new GlobalVariable(dest, variable->getValueType(),
+                                  variable->isConstant(),
+                                  GlobalValue::ExternalLinkage, nullptr,
+                                  variable->getName());
+  decl->setThreadLocalMode(variable->getThreadLocalMode());
+  return decl;
+}
+
+extern "C" bool copy_body_available_externally(LLVMValueRef dest_ref,
+                                               LLVMValueRef source_ref) {
+  Function *dest = unwrap<Function>(dest_ref);
+  Function *source = unwrap<Function>(source_ref);
+  if (!dest->isDeclaration() || source->isDeclaration() ||
+      source->hasPersonalityFn() || source->hasPrefixData() ||
+      source->hasPrologueData())
+    return false;
+
+  SmallPtrSet<GlobalValue *, 16> globals;
+  SmallPtrSet<Constant *, 32> seen;
+  for (Instruction &inst : instructions(source)) {
+    for (Value *operand : inst.operands()) {
+      if (isa<BlockAddress>(operand))
+        return false;
+      collect_globals(operand, globals, seen);
+    }
+  }
+
+  Module &module = *dest->getParent();
+  ValueToValueMapTy map;
+  SmallVector<GlobalValue *, 16> added;
+  for (GlobalValue *global : globals) {
+    if (global == source) {
+      map[global] = dest;
+      continue;
+    }
+    bool existed = module.getNamedValue(global->getName()) != nullptr;
+    GlobalValue *mapped = counterpart(module, global);
+    if (!mapped) {
+      for (GlobalValue *value : added)
+        value->eraseFromParent();
+      return false;
+    }
+    if (!existed || mapped->hasLocalLinkage())
+      added.push_back(mapped);
+    map[global] = mapped;
+  }
+
+  auto dest_arg = dest->arg_begin();
+  for (const Argument &arg : source->args()) {
+    dest_arg->setName(arg.getName());
+    map[&arg] = &*dest_arg++;
+  }
+
+  SmallVector<ReturnInst *, 4> returns;
+  CloneFunctionInto(dest, source, map,
+                    CloneFunctionChangeType::DifferentModule, returns);
+  // The source's debug info belongs to the other module's compile unit
+  stripDebugInfo(*dest);
+  dest->setLinkage(GlobalValue::AvailableExternallyLinkage);
+  return true;
+}
@@ -141,6 +141,7 @@ LLVMValueRef codegen_module_access(CodeGenContext *ctx, AstNode *node) {
 
         LLVMCallConv cc = LLVMGetFunctionCallConv(source_func);
         LLVMSetFunctionCallConv(existing, cc);
+        copy_function_attributes(existing, source_func);
 
         add_symbol_to_module(ctx->current_module, member, existing, func_type,
                              true);
@@ -164,6 +165,7 @@ LLVMValueRef codegen_module_access(CodeGenContext *ctx, AstNode *node) {
 
           LLVMCallConv cc = LLVMGetFunctionCallConv(source_sym->value);
           LLVMSetFunctionCallConv(existing, cc);
+          copy_function_attributes(existing, source_sym->value);
 
           add_symbol_to_module(ctx->current_module, member, existing, func_type,
                                true);
@@ -1,254 +1,10 @@
 #include "../llvm.h"
 #include "../../c_libs/memory/memory.h"
+#include "../../c_libs/trace/trace.h"
 #include <stdlib.h>
 
-static SymbolHashTable *global_symbol_cache = NULL;
-static StructHashTable *global_struct_cache = NULL;
-
-unsigned int hash_string(const char *str) {
-  // FNV-1a hash algorithm - faster and better distribution
-  unsigned int hash = 2166136261u;
-  while (*str) {
-    hash ^= (unsigned char)(*str++);
-    hash *= 16777619u;
-  }
-  return hash % SYMBOL_HASH_SIZE;
-}
-
-// Symbol cache operations
-void init_symbol_cache(void) {
-  if (!global_symbol_cache) {
-    global_symbol_cache = (SymbolHashTable *)xcalloc(1, sizeof(SymbolHashTable));
-  }
-}
-
-void cache_symbol(const char *module_name, const char *symbol_name,
-                  LLVM_Symbol *symbol) {
-  init_symbol_cache();
-
-  char key[512];
-  snprintf(key, sizeof(key), "%s:%s", module_name, symbol_name);
-
-  unsigned int bucket = hash_string(key);
-
-  // Check if already cached
-  for (SymbolHashEntry *entry = global_symbol_cache->buckets[bucket]; entry;
-       entry = entry->next) {
-    if (strcmp(entry->key, key) == 0) {
-      entry->symbol = symbol;
-      return;
-    }
-  }
-
-  // Add new entry
-  SymbolHashEntry *new_entry =
-      (SymbolHashEntry *)xmalloc(sizeof(SymbolHashEntry));
-  new_entry->key = xstrdup(key);
-  new_entry->symbol = symbol;
-  new_entry->next = global_symbol_cache->buckets[bucket];
-  global_symbol_cache->buckets[bucket] = new_entry;
-}
-
-LLVM_Symbol *lookup_cached_symbol(const char *module_name,
-                                  const char *symbol_name) {
-  if (!global_symbol_cache)
-    return NULL;
-
-  char key[512];
-  snprintf(key, sizeof(key), "%s:%s", module_name, symbol_name);
-
-  unsigned int bucket = hash_string(key);
-
-  for (SymbolHashEntry *entry = global_symbol_cache->buckets[bucket]; entry;
-       entry = entry->next) {
-    if (strcmp(entry->key, key) == 0) {
-      return entry->symbol;
-    }
-  }
-
-  return NULL;
-}
-
-// Struct cache operations
-void init_struct_cache(void) {
-  if (!global_struct_cache) {
-    global_struct_cache = (StructHashTable *)xcalloc(1, sizeof(StructHashTable));
-  }
-}
-
-void cache_struct(const char *name, StructInfo *info) {
-  init_struct_cache();
-
-  unsigned int bucket = hash_string(name);
-
-  for (StructHashEntry *entry = global_struct_cache->buckets[bucket]; entry;
-       entry = entry->next) {
-    if (strcmp(entry->name, name) == 0) {
-      entry->info = info;
-      return;
-    }
-  }
-
-  StructHashEntry *new_entry =
-      (StructHashEntry *)xmalloc(sizeof(StructHashEntry));
-  new_entry->name = xstrdup(name);
-  new_entry->info = info;
-  new_entry->next = global_struct_cache->buckets[bucket];
-  global_struct_cache->buckets[bucket] = new_entry;
-}
-
-StructInfo *lookup_cached_struct(const char *name) {
-  if (!global_struct_cache)
-    return NULL;
-
-  unsigned int bucket = hash_string(name);
-
-  for (StructHashEntry *entry = global_struct_cache->buckets[bucket]; entry;
-       entry = entry->next) {
-    if (strcmp(entry->name, name) == 0) {
-      return entry->info;
-    }
-  }
-
-  return NULL;
-}
-
-StructInfo *find_struct_type_fast(CodeGenContext *ctx, const char *name) {
-  (void)ctx; // Not needed with cache
-
-  // Direct cache lookup - O(1) average
-  StructInfo *cached = lookup_cached_struct(name);
-  if (cached) {
-    return cached;
-  }
-
-  return NULL;
-}
-
-void preprocess_all_modules(CodeGenContext *ctx) {
-  // Pre-cache all symbols from all modules
-  for (ModuleCompilationUnit *unit = ctx->modules; unit; unit = unit->next) {
-    for (LLVM_Symbol *sym = unit->symbols; sym; sym = sym->next) {
-      cache_symbol(unit->module_name, sym->name, sym);
-    }
-  }
-
-  // Pre-cache all struct types
-  for (StructInfo *info = ctx->struct_types; info; info = info->next) {
-    cache_struct(info->name, info);
-  }
-}
-
-void cleanup_module_caches(void) {
-  // Clean symbol cache
-  if (global_symbol_cache) {
-    for (int i = 0; i < SYMBOL_HASH_SIZE; i++) {
-      SymbolHashEntry *entry = global_symbol_cache->buckets[i];
-      while (entry) {
-        SymbolHashEntry *next = entry->next;
-        free((void *)entry->key);
-        free(entry);
-        entry = next;
-      }
-    }
-    free(global_symbol_cache);
-    global_symbol_cache = NULL;
-  }
-
-  // Clean struct cache
-  if (global_struct_cache) {
-    for (int i = 0; i < SYMBOL_HASH_SIZE; i++) {
-      StructHashEntry *entry = global_struct_cache->buckets[i];
-      while (entry) {
-        StructHashEntry *next = entry->next;
-        free((void *)entry->name);
-        free(entry);
-        entry = next;
-      }
-    }
-    free(global_struct_cache);
-    global_struct_cache = NULL;
-  }
-
-}
-
-ModuleDependencyInfo *build_codegen_dependency_info(AstNode **modules,
-                                                    size_t module_count,
-                                                    ArenaAllocator *arena) {
-
-  ModuleDependencyInfo *dep_info = (ModuleDependencyInfo *)arena_alloc(
-      arena, sizeof(ModuleDependencyInfo) * module_count,
-      alignof(ModuleDependencyInfo));
-
-  for (size_t i = 0; i < module_count; i++) {
-    AstNode *module = modules[i];
-    if (!module || module->type != AST_PREPROCESSOR_MODULE)
-      continue;
-
-    dep_info[i].module_name = module->preprocessor.module.name;
-    dep_info[i].processed = false;
-    dep_info[i].dep_count = 0;
-
-    AstNode **body = module->preprocessor.module.body;
-    int body_count = module->preprocessor.module.body_count;
-
-    size_t use_count = 0;
-    for (int j = 0; j < body_count; j++) {
-      if (body[j] && body[j]->type == AST_PREPROCESSOR_USE) {
-        use_count++;
-      }
-    }
-
-    dep_info[i].dependencies = (char **)arena_alloc(
-        arena, sizeof(char *) * use_count, alignof(char *));
-
-    size_t dep_idx = 0;
-    for (int j = 0; j < body_count; j++) {
-      if (body[j] && body[j]->type == AST_PREPROCESSOR_USE) {
-        dep_info[i].dependencies[dep_idx++] =
-            (char *)body[j]->preprocessor.use.module_name;
-      }
-    }
-    dep_info[i].dep_count = use_count;
-  }
-
-  return dep_info;
-}
-
-static bool process_module_codegen_recursive(CodeGenContext *ctx,
-                                             const char *module_name,
-                                             AstNode **modules,
-                                             size_t module_count,
-                                             ModuleDependencyInfo *dep_info) {
-
-  ModuleDependencyInfo *current_dep = NULL;
-  size_t current_idx = 0;
-  for (size_t i = 0; i < module_count; i++) {
-    if (strcmp(dep_info[i].module_name, module_name) == 0) {
-      current_dep = &dep_info[i];
-      current_idx = i;
-      break;
-    }
-  }
-
-  if (!current_dep) {
-    fprintf(stderr, "Error: Module '%s' not found in dependency info\n",
-            module_name);
-    return false;
-  }
-
-  if (current_dep->processed) {
-    return true;
-  }
-
-  for (size_t i = 0; i < current_dep->dep_count; i++) {
-    if (!process_module_codegen_recursive(ctx, current_dep->dependencies[i],
-                                          modules, module_count, dep_info)) {
-      return false;
-    }
-  }
-
-  AstNode *module = modules[current_idx];
+static bool codegen_module(CodeGenContext *ctx, AstNode *module) {
+  const char *module_name = module->preprocessor.module.name;
   ModuleCompilationUnit *unit = find_module(ctx, module_name);
   if (!unit) {
     fprintf(stderr, "Error: Module unit not found for '%s'\n", module_name);
@@ -257,6 +13,7 @@ static bool process_module_codegen_recursive(CodeGenContext *ctx,
 
   set_current_module(ctx, unit);
   ctx->module = unit->module;
+  ctx->current_module_ast = module;
 
   setup_module_debug_info(
       ctx, unit,
@@ -265,6 +22,16 @@ static bool process_module_codegen_recursive(CodeGenContext *ctx,
   AstNode **body = module->preprocessor.module.body;
   int body_count = module->preprocessor.module.body_count;
 
+  unit->is_std_module = module->preprocessor.module.interface_key != 0;
+  unit->prebuilt_object = module->preprocessor.module.prebuilt_object;
+
+  // A prebuilt std module's bodies were not typechecked either; importers
+  // only need its declarations.
+  ctx->declarations_only = unit->prebuilt_object != NULL;
+
+  // Dependencies come earlier in the order, so this span covers only this
+  // module
+  uint64_t start = trace_now_us();
   for (int j = 0; j < body_count; j++) {
     if (!body[j])
       continue;
@@ -272,8 +39,20 @@ static bool process_module_codegen_recursive(CodeGenContext *ctx,
       codegen_stmt(ctx, body[j]);
     }
   }
+  trace_complete("IR generation", "codegen", module_name, start);
+  emit_profile_table(ctx, unit);
+
+  if (ctx->has_packed_structs)
+    align_packed_accesses(ctx, unit->module);
+  lower_struct_copies(ctx, unit->module);
+  if (ctx->inline_imports && !ctx->declarations_only)
+    import_small_function_bodies(ctx, unit);
 
-  current_dep->processed = true;
+  ctx->declarations_only = false;
+  ctx->current_module_ast = NULL;
+
+  // Later modules only read this one's declarations
+  submit_module_for_emission(ctx, unit);
   return true;
 }
 
@@ -330,22 +109,19 @@ LLVMValueRef codegen_stmt_program_multi_module(CodeGenContext *ctx,
     }
   }
 
-  preprocess_all_modules(ctx);
-
   // PASS 3: Generate code in dependency order
-  ModuleDependencyInfo *dep_info = build_codegen_dependency_info(
-      node->stmt.program.modules, node->stmt.program.module_count, ctx->arena);
+  ModuleGraph *graph = module_graph_get(node, ctx->arena);
+  if (graph->cyclic_count > 0) {
+    fprintf(stderr, "Error: Modules with circular @use dependencies\n");
+    return NULL;
+  }
 
-  for (size_t i = 0; i < node->stmt.program.module_count; i++) {
-    AstNode *module_node = node->stmt.program.modules[i];
-    if (module_node->type == AST_PREPROCESSOR_MODULE) {
-      const char *module_name = module_node->preprocessor.module.name;
+  compute_module_source_hashes(ctx, node->stmt.program.modules, graph);
 
-      if (!process_module_codegen_recursive(
-              ctx, module_name, node->stmt.program.modules,
-              node->stmt.program.module_count, dep_info)) {
-        return NULL;
-      }
+  // Modules of one level only depend on earlier levels
+  for (size_t i = 0; i < graph->order_count; i++) {
+    if (!codegen_module(ctx, node->stmt.program.modules[graph->order[i]])) {
+      return NULL;
     }
   }
 
@@ -357,6 +133,8 @@ LLVMValueRef codegen_stmt_module(CodeGenContext *ctx, AstNode *node) {
     return NULL;
   }
 
+  AstNode *outer_module = ctx->current_module_ast;
+  ctx->current_module_ast = node;
   for (size_t i = 0; i < node->preprocessor.module.body_count; i++) {
     AstNode *stmt = node->preprocessor.module.body[i];
 
@@ -366,6 +144,7 @@ LLVMValueRef codegen_stmt_module(CodeGenContext *ctx, AstNode *node) {
       codegen_stmt(ctx, stmt);
     }
   }
+  ctx->current_module_ast = outer_module;
 
   return NULL;
 }
@@ -549,6 +328,7 @@ void import_function_symbol(CodeGenContext *ctx, LLVM_Symbol *source_symbol,
   LLVMValueRef external_func = LLVMAddFunction(ctx->current_module->module,
                                                source_symbol->name, func_type);
   LLVMSetLinkage(external_func, LLVMExternalLinkage);
+  copy_function_attributes(external_func, source_symbol->value);
 
   LLVMTypeRef return_type = LLVMGetReturnType(func_type);
   if (LLVMGetTypeKind(return_type) == LLVMStructTypeKind) {
@@ -570,6 +350,59 @@ void import_function_symbol(CodeGenContext *ctx, LLVM_Symbol *source_symbol,
                        func_type, true);
 }
 
+// Largest body, in (unoptimized) instructions, that importers get a copy of
+// without #inline
+#define IMPORT_INLINE_LIMIT 32
+
+// LLVM's inliner decides the rest; a copy only has to be small and not call
+// itself, since a recursive body is never inlined whole
+static bool worth_importing(LLVMValueRef function) {
+  unsigned always = LLVMGetEnumAttributeKindForName("alwaysinline", 12);
+  unsigned never = LLVMGetEnumAttributeKindForName("noinline", 8);
+  if (LLVMGetEnumAttributeAtIndex(function, LLVMAttributeFunctionIndex, never))
+    return false;
+  bool forced =
+      LLVMGetEnumAttributeAtIndex(function, LLVMAttributeFunctionIndex, always);
+
+  size_t count = 0;
+  for (LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(function); block;
+       block = LLVMGetNextBasicBlock(block)) {
+    for (LLVMValueRef inst = LLVMGetFirstInstruction(block); inst;
+         inst = LLVMGetNextInstruction(inst)) {
+      if (++count > IMPORT_INLINE_LIMIT && !forced)
+        return false;
+      if (LLVMIsACallInst(inst) && LLVMGetCalledValue(inst) == function)
+        return false;
+    }
+  }
+  return true;
+}
+
+void import_small_function_bodies(CodeGenContext *ctx,
+                                  ModuleCompilationUnit *unit) {
+  // Bodies copied in declare what they call, which the walk then reaches
+  for (LLVMValueRef decl = LLVMGetFirstFunction(unit->module); decl;
+       decl = LLVMGetNextFunction(decl)) {
+    if (!LLVMIsDeclaration(decl) || LLVMGetIntrinsicID(decl))
+      continue;
+
+    const char *name = LLVMGetValueName(decl);
+    for (ModuleCompilationUnit *other = ctx->modules; other;
+         other = other->next) {
+      if (other == unit || other->prebuilt_object)
+        continue;
+      LLVMValueRef definition = LLVMGetNamedFunction(other->module, name);
+      if (!definition || LLVMIsDeclaration(definition))
+        continue;
+      if (LLVMGetLinkage(definition) == LLVMExternalLinkage &&
+          LLVMGlobalGetValueType(definition) == LLVMGlobalGetValueType(decl) &&
+          worth_importing(definition))
+        copy_body_available_externally(decl, definition);
+      break;
+    }
+  }
+}
+
 void import_variable_symbol(CodeGenContext *ctx, LLVM_Symbol *source_symbol,
                             ModuleCompilationUnit *source_module,
                             const char *alias) {
@@ -27,13 +27,14 @@ void add_symbol_to_module_with_element_type(
     ModuleCompilationUnit *module, const char *name, LLVMValueRef value,
     LLVMTypeRef type, LLVMTypeRef element_type, bool is_function) {
   LLVM_Symbol *sym = (LLVM_Symbol *)malloc(sizeof(LLVM_Symbol));
-  sym->name = strdup(name);
+  sym->name = intern(name);
   sym->value = value;
   sym->type = type;
   sym->element_type = element_type; // Store the element type for pointers
   sym->is_function = is_function;
   sym->next = module->symbols;
   module->symbols = sym;
+  pointer_map_put(&module->symbol_index, sym->name, sym);
 }
 
 LLVMTypeRef extract_element_type_from_ast(CodeGenContext *ctx,
@@ -95,13 +96,47 @@ LLVMValueRef codegen_stmt_var_decl(CodeGenContext *ctx, AstNode *node) {
       LLVMSetLinkage(var_ref, LLVMInternalLinkage);
     }
   } else {
-    var_ref =
-        LLVMBuildAlloca(ctx->builder, alloca_type, node->stmt.var_decl.name);
+    // In the entry block, so a `let` inside a loop reuses one slot and
+    // mem2reg can promote it to a register
+    var_ref = entry_alloca(ctx, alloca_type, node->stmt.var_decl.name);
+  }
+
+  // A struct with #align asks more of its storage than its LLVM type does,
+  // and so does an array of them
+  LLVMTypeRef storage_type = alloca_type;
+  while (LLVMGetTypeKind(storage_type) == LLVMArrayTypeKind)
+    storage_type = LLVMGetElementType(storage_type);
+  if (LLVMGetTypeKind(storage_type) == LLVMStructTypeKind) {
+    StructInfo *layout = find_struct_by_llvm_type(ctx, storage_type);
+    if (layout && layout->alignment > LLVMGetAlignment(var_ref))
+      LLVMSetAlignment(var_ref, layout->alignment);
+  }
+
+  // A global's initializer is computed here when it can be, calls to the
+  // module's functions included, so the global needs no code at startup
+  AstNode *initializer = node->stmt.var_decl.initializer;
+  if (ctx->current_function == NULL && initializer && !is_fn_type) {
+    LLVMValueRef constant = comptime_global_initializer(ctx, node, alloca_type);
+    if (constant) {
+      LLVMSetInitializer(var_ref, constant);
+      if (!node->stmt.var_decl.is_mutable)
+        LLVMSetGlobalConstant(var_ref, true);
+      initializer = NULL;
+    } else if (comptime_needs_function(initializer)) {
+      fprintf(stderr,
+              "Error: Initializer of global '%s' can't be evaluated at "
+              "compile time\n",
+              node->stmt.var_decl.name);
+      LLVMValueRef def = get_default_value(alloca_type);
+      if (def)
+        LLVMSetInitializer(var_ref, def);
+      initializer = NULL;
+    }
   }
 
   // Handle initializer with type checking
-  if (node->stmt.var_decl.initializer) {
-    LLVMValueRef init_val = codegen_expr(ctx, node->stmt.var_decl.initializer);
+  if (initializer) {
+    LLVMValueRef init_val = codegen_expr(ctx, initializer);
     if (init_val) {
       LLVMTypeRef init_type = LLVMTypeOf(init_val);
 
@@ -144,7 +179,7 @@ LLVMValueRef codegen_stmt_var_decl(CodeGenContext *ctx, AstNode *node) {
         LLVMBuildStore(ctx->builder, init_val, var_ref);
       }
     }
-  } else {
+  } else if (!node->stmt.var_decl.initializer) {
     if (ctx->current_function == NULL) {
       LLVMValueRef def = get_default_value(var_type);
       if (def)
@@ -164,6 +199,10 @@ LLVMValueRef codegen_stmt_var_decl(CodeGenContext *ctx, AstNode *node) {
 }
 
 LLVMValueRef codegen_stmt_function(CodeGenContext *ctx, AstNode *node) {
+  // Generic functions are generated through their instances
+  if (node->stmt.func_decl.type_param_count)
+    return NULL;
+
   const char *func_name = node->stmt.func_decl.name;
   bool forward_declared = node->stmt.func_decl.forward_declared;
   bool is_dll_import = node->stmt.func_decl.is_dll_import;
@@ -208,6 +247,8 @@ LLVMValueRef codegen_stmt_function(CodeGenContext *ctx, AstNode *node) {
 
   LLVMTypeRef func_type = LLVMFunctionType(
       return_type, llvm_param_types, node->stmt.func_decl.param_count, false);
+  // What the function is declared with: large structs go through memory
+  LLVMTypeRef lowered_type = lower_function_type(ctx, func_type);
 
   LLVMModuleRef current_llvm_module =
       ctx->current_module ? ctx->current_module->module : ctx->module;
@@ -215,7 +256,8 @@ LLVMValueRef codegen_stmt_function(CodeGenContext *ctx, AstNode *node) {
   if (is_dll_import) {
     LLVMValueRef func = LLVMGetNamedFunction(current_llvm_module, func_name);
     if (!func) {
-      func = LLVMAddFunction(current_llvm_module, func_name, func_type);
+      func = LLVMAddFunction(current_llvm_module, func_name, lowered_type);
+      set_abi_attributes(ctx, func, func_type);
     }
 
     LLVMSetLinkage(func, LLVMExternalLinkage);
@@ -229,7 +271,7 @@ LLVMValueRef codegen_stmt_function(CodeGenContext *ctx, AstNode *node) {
       LLVMSetFunctionCallConv(func, LLVMCCallConv);
     }
 
-    add_symbol(ctx, func_name, func, func_type, true);
+    add_symbol(ctx, func_name, func, lowered_type, true);
 
     return func;
   }
@@ -237,7 +279,8 @@ LLVMValueRef codegen_stmt_function(CodeGenContext *ctx, AstNode *node) {
   if (is_lib_import) {
     LLVMValueRef func = LLVMGetNamedFunction(current_llvm_module, func_name);
     if (!func) {
-      func = LLVMAddFunction(current_llvm_module, func_name, func_type);
+      func = LLVMAddFunction(current_llvm_module, func_name, lowered_type);
+      set_abi_attributes(ctx, func, func_type);
     }
 
     LLVMSetLinkage(func, LLVMExternalLinkage);
@@ -262,7 +305,7 @@ LLVMValueRef codegen_stmt_function(CodeGenContext *ctx, AstNode *node) {
       }
     }
 
-    add_symbol(ctx, func_name, func, func_type, true);
+    add_symbol(ctx, func_name, func, lowered_type, true);
     return func;
   }
 
@@ -272,7 +315,7 @@ LLVMValueRef codegen_stmt_function(CodeGenContext *ctx, AstNode *node) {
 
   if (existing_function) {
     // Function already declared - validate signature matches
-    LLVMTypeRef existing_type = LLVMGlobalGetValueType(existing_function);
+    LLVMTypeRef existing_type = source_function_type(ctx, existing_function);
 
     if (LLVMGetReturnType(existing_type) != return_type) {
       fprintf(stderr,
@@ -305,7 +348,7 @@ LLVMValueRef codegen_stmt_function(CodeGenContext *ctx, AstNode *node) {
       }
     }
 
-    if (forward_declared) {
+    if (forward_declared || ctx->declarations_only) {
       return existing_function;
     }
 
@@ -317,6 +360,9 @@ LLVMValueRef codegen_stmt_function(CodeGenContext *ctx, AstNode *node) {
 
     LLVMValueRef function = existing_function;
 
+    // The definition's attributes count even when the prototype had none
+    set_function_attributes(ctx, function, node);
+
     // CRITICAL: Ensure calling convention is set for struct returns
     set_struct_return_convention(function, return_type);
 
@@ -325,7 +371,7 @@ LLVMValueRef codegen_stmt_function(CodeGenContext *ctx, AstNode *node) {
   } else {
     // First declaration - create new function
     LLVMValueRef function =
-        LLVMAddFunction(current_llvm_module, func_name, func_type);
+        LLVMAddFunction(current_llvm_module, func_name, lowered_type);
 
     if (!function) {
       fprintf(stderr, "Error: Failed to create LLVM function '%s'\n",
@@ -335,16 +381,19 @@ LLVMValueRef codegen_stmt_function(CodeGenContext *ctx, AstNode *node) {
 
     // Set linkage
     LLVMSetLinkage(function, get_function_linkage(node));
+    set_abi_attributes(ctx, function, func_type);
+    set_function_attributes(ctx, function, node);
 
     // CRITICAL: Set calling convention for struct returns
     set_struct_return_convention(function, return_type);
 
     // Add to symbol table
-    add_symbol(ctx, func_name, function, func_type, true);
+    add_symbol(ctx, func_name, function, lowered_type, true);
 
     // Set parameter names
+    unsigned first_param = first_source_param(function);
     for (size_t i = 0; i < node->stmt.func_decl.param_count; i++) {
-      LLVMValueRef param = LLVMGetParam(function, i);
+      LLVMValueRef param = LLVMGetParam(function, i + first_param);
       LLVMSetValueName2(param, node->stmt.func_decl.param_names[i],
                         strlen(node->stmt.func_decl.param_names[i]));
     }
@@ -353,6 +402,12 @@ LLVMValueRef codegen_stmt_function(CodeGenContext *ctx, AstNode *node) {
       return function;
     }
 
+    // The body lives in a prebuilt object; a declaration can't be internal
+    if (ctx->declarations_only) {
+      LLVMSetLinkage(function, LLVMExternalLinkage);
+      return function;
+    }
+
     goto generate_body;
   }
 
@@ -399,24 +454,31 @@ generate_body: {
 
   // Save old function context
   LLVMValueRef old_function = ctx->current_function;
-  DeferredStatement *old_deferred = ctx->deferred_statements;
-  size_t old_defer_count = ctx->deferred_count;
+  DeferState old_defers = ctx->defers;
 
   // Set new function context
   ctx->current_function = function;
   init_defer_stack(ctx);
+  struct ProfileSite *profile = profile_function_entry(ctx, node);
 
+  LLVMTypeRef sret = sret_type(function);
+  unsigned first_param = sret ? 1 : 0;
   for (size_t i = 0; i < node->stmt.func_decl.param_count; i++) {
-    LLVMValueRef param = LLVMGetParam(function, i);
+    unsigned index = (unsigned)i + first_param;
+    LLVMValueRef param = LLVMGetParam(function, index);
     bool is_fn_param = LLVMGetTypeKind(param_types[i]) == LLVMFunctionTypeKind;
 
     // fn-typed params are passed as function pointers — alloca a ptr slot
     LLVMTypeRef alloca_type =
         is_fn_param ? LLVMPointerType(param_types[i], 0) : param_types[i];
 
-    LLVMValueRef alloca = LLVMBuildAlloca(ctx->builder, alloca_type,
-                                          node->stmt.func_decl.param_names[i]);
-    LLVMBuildStore(ctx->builder, param, alloca);
+    // A byval struct already is the function's own copy
+    LLVMValueRef alloca = param;
+    if (!byval_type(function, index)) {
+      alloca = LLVMBuildAlloca(ctx->builder, alloca_type,
+                               node->stmt.func_decl.param_names[i]);
+      LLVMBuildStore(ctx->builder, param, alloca);
+    }
 
     // element_type: for fn params it's the function type itself;
     // for regular params extract from the AST as normal
@@ -430,29 +492,18 @@ generate_body: {
                                  false /* is_function */);
   }
 
-  // Create blocks for normal return and cleanup
+  // Create the block reached by falling off the end
   LLVMBasicBlockRef normal_return =
       LLVMAppendBasicBlockInContext(ctx->context, function, "normal_return");
-  LLVMBasicBlockRef cleanup_entry =
-      LLVMAppendBasicBlockInContext(ctx->context, function, "cleanup_entry");
 
-  // Generate function body
+  if (ctx->opt_level >= 1)
+    mark_stack_allocations(node);
+
+  // Generate function body; its block runs its own defers on the way out
   codegen_stmt(ctx, node->stmt.func_decl.body);
 
-  // If we reach the end without an explicit return, branch to cleanup
+  // If we reach the end without an explicit return, branch to normal return
   if (!LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(ctx->builder))) {
-    LLVMBuildBr(ctx->builder, cleanup_entry);
-  }
-
-  // Generate cleanup blocks for deferred statements
-  generate_cleanup_blocks(ctx);
-
-  // Set up cleanup entry point
-  LLVMPositionBuilderAtEnd(ctx->builder, cleanup_entry);
-
-  if (ctx->deferred_statements) {
-    LLVMBuildBr(ctx->builder, ctx->deferred_statements->cleanup_block);
-  } else {
     LLVMBuildBr(ctx->builder, normal_return);
   }
 
@@ -461,15 +512,23 @@ generate_body: {
 
   if (LLVMGetTypeKind(return_type) == LLVMVoidTypeKind) {
     LLVMBuildRetVoid(ctx->builder);
+  } else if (sret) {
+    LLVMBuildStore(ctx->builder, LLVMConstNull(return_type),
+                   LLVMGetParam(function, 0));
+    LLVMBuildRetVoid(ctx->builder);
   } else {
     LLVMValueRef default_val = LLVMConstNull(return_type);
     LLVMBuildRet(ctx->builder, default_val);
   }
+  finish_function_defers(ctx);
+  profile_function_exits(ctx, function, profile);
+
+  if (node->stmt.func_decl.attributes & FN_ATTR_FLATTEN)
+    flatten_calls(ctx, function);
 
   // Restore old function context
   ctx->current_function = old_function;
-  ctx->deferred_statements = old_deferred;
-  ctx->deferred_count = old_defer_count;
+  ctx->defers = old_defers;
   ctx->current_func_di = old_func_di;
 
   return function;
@@ -546,9 +605,55 @@ LLVMValueRef codegen_stmt_enum(CodeGenContext *ctx, AstNode *node) {
   return NULL;
 }
 
+// #musttail return f(args): the call reuses this frame, so loops written as
+// tail calls run in constant stack. The typechecker has matched the
+// prototypes and ruled out defers and pointers into the frame.
+static LLVMValueRef codegen_musttail_return(CodeGenContext *ctx,
+                                            AstNode *node) {
+  LLVMValueRef value = codegen_expr(ctx, node->stmt.return_stmt.value);
+  if (!value)
+    return NULL;
+
+  // A struct returned in memory comes back as a load of the callee's sret
+  // temporary; the callee writes straight into this function's slot instead
+  LLVMValueRef call = value;
+  bool sret = sret_type(ctx->current_function) != NULL;
+  if (sret) {
+    call = LLVMIsALoadInst(value) ? LLVMGetPreviousInstruction(value) : NULL;
+    if (!call || !LLVMIsACallInst(call) ||
+        LLVMGetOperand(call, 0) != LLVMGetOperand(value, 0)) {
+      fprintf(stderr, "Error: #musttail lost the call it returns\n");
+      return NULL;
+    }
+    LLVMSetOperand(call, 0, LLVMGetParam(ctx->current_function, 0));
+    LLVMInstructionEraseFromParent(value);
+  } else if (!LLVMIsACallInst(call)) {
+    fprintf(stderr, "Error: #musttail lost the call it returns\n");
+    return NULL;
+  }
+
+  LLVMValueRef callee = LLVMGetCalledValue(call);
+  unsigned conv = LLVMGetFunctionCallConv(ctx->current_function);
+  if (LLVMIsAFunction(callee) && LLVMGetFunctionCallConv(callee) != conv) {
+    fprintf(stderr,
+            "Error: #musttail needs the callee to use the caller's calling "
+            "convention\n");
+    return NULL;
+  }
+
+  LLVMSetInstructionCallConv(call, conv);
+  LLVMSetTailCallKind(call, LLVMTailCallKindMustTail);
+  if (sret || LLVMGetTypeKind(LLVMTypeOf(call)) == LLVMVoidTypeKind)
+    return LLVMBuildRetVoid(ctx->builder);
+  return LLVMBuildRet(ctx->builder, call);
+}
+
 LLVMValueRef codegen_stmt_return(CodeGenContext *ctx, AstNode *node) {
   LLVMValueRef ret_val = NULL;
 
+  if (node->stmt.return_stmt.musttail && ctx->current_function)
+    return codegen_musttail_return(ctx, node);
+
   if (node->stmt.return_stmt.value) {
     ret_val = codegen_expr(ctx, node->stmt.return_stmt.value);
     if (!ret_val)
@@ -556,7 +661,7 @@ LLVMValueRef codegen_stmt_return(CodeGenContext *ctx, AstNode *node) {
 
     // CRITICAL: Ensure return value matches function return type
     if (ctx->current_function) {
-      LLVMTypeRef func_type = LLVMGlobalGetValueType(ctx->current_function);
+      LLVMTypeRef func_type = source_function_type(ctx, ctx->current_function);
       LLVMTypeRef expected_return_type = LLVMGetReturnType(func_type);
       LLVMTypeRef actual_return_type = LLVMTypeOf(ret_val);
 
@@ -590,44 +695,30 @@ LLVMValueRef codegen_stmt_return(CodeGenContext *ctx, AstNode *node) {
     }
   }
 
-  // Handle deferred statements as before...
-  if (ctx->deferred_statements) {
-    LLVMValueRef return_val_storage = NULL;
-
-    if (ret_val) {
-      LLVMTypeRef ret_type = LLVMTypeOf(ret_val);
-      return_val_storage =
-          LLVMBuildAlloca(ctx->builder, ret_type, "return_val_storage");
-      LLVMBuildStore(ctx->builder, ret_val, return_val_storage);
-    }
+  // A struct returned in memory goes straight into the caller's slot; the
+  // defers can't reach it, so it can be written before they run
+  if (ret_val && ctx->current_function && sret_type(ctx->current_function)) {
+    LLVMBuildStore(ctx->builder, ret_val,
+                   LLVMGetParam(ctx->current_function, 0));
+    ret_val = NULL;
+  }
 
-    execute_deferred_statements_inline(ctx, ctx->deferred_statements);
+  // Returns from inside blocks with defers go through their cleanups
+  if (has_pending_defers(ctx, NULL)) {
+    return build_deferred_return(ctx, ret_val);
+  }
 
-    if (return_val_storage) {
-      LLVMValueRef final_ret_val =
-          LLVMBuildLoad2(ctx->builder, LLVMTypeOf(ret_val), return_val_storage,
-                         "final_return_val");
-      return LLVMBuildRet(ctx->builder, final_ret_val);
-    } else {
-      return LLVMBuildRetVoid(ctx->builder);
-    }
+  if (ret_val) {
+    return LLVMBuildRet(ctx->builder, ret_val);
   } else {
-    if (ret_val) {
-      return LLVMBuildRet(ctx->builder, ret_val);
-    } else {
-      return LLVMBuildRetVoid(ctx->builder);
-    }
+    return LLVMBuildRetVoid(ctx->builder);
   }
 }
 
 LLVMValueRef codegen_stmt_block(CodeGenContext *ctx, AstNode *node) {
-  // Save the current defer context
-  DeferredStatement *saved_defers = ctx->deferred_statements;
-  size_t saved_count = ctx->deferred_count;
-
   // Create new defer scope for this block
-  ctx->deferred_statements = NULL;
-  ctx->deferred_count = 0;
+  DeferScope scope;
+  push_defer_scope(ctx, &scope);
 
   // Process all statements in the block
   for (size_t i = 0; i < node->stmt.block.stmt_count; i++) {
@@ -647,14 +738,9 @@ LLVMValueRef codegen_stmt_block(CodeGenContext *ctx, AstNode *node) {
     codegen_stmt(ctx, stmt);
   }
 
-  // Execute any deferred statements from this block scope (in reverse order)
-  if (ctx->deferred_statements) {
-    execute_deferred_statements_inline(ctx, ctx->deferred_statements);
-  }
-
-  // Restore the previous defer context
-  ctx->deferred_statements = saved_defers;
-  ctx->deferred_count = saved_count;
+  // Emit this block's deferred statements once, for every way out of it,
+  // and go back to the enclosing scope
+  pop_defer_scope(ctx);
 
   return NULL;
 }
@@ -836,118 +922,53 @@ LLVMValueRef get_range_end_value(CodeGenContext *ctx,
   return LLVMBuildLoad2(ctx->builder, field_types[1], end_ptr, "range_end");
 }
 
-// Enhanced codegen_stmt_print function with better float support
+// Formats every value into the function's print buffer and writes the
+// statement out in one go (print_runtime.c)
 LLVMValueRef codegen_stmt_print(CodeGenContext *ctx, AstNode *node) {
-  LLVMModuleRef current_llvm_module =
-      ctx->current_module ? ctx->current_module->module : ctx->module;
-
-  // Declare printf once
-  LLVMValueRef printf_func =
-      LLVMGetNamedFunction(current_llvm_module, "printf");
-  LLVMTypeRef printf_type = NULL;
-
-  if (!printf_func) {
-    LLVMTypeRef printf_arg_types[] = {
-        LLVMPointerType(LLVMInt8TypeInContext(ctx->context), 0)};
-    printf_type = LLVMFunctionType(LLVMInt32TypeInContext(ctx->context),
-                                   printf_arg_types, 1, true);
-    printf_func = LLVMAddFunction(current_llvm_module, "printf", printf_type);
-    add_symbol(ctx, "printf", printf_func, printf_type, true);
-  } else {
-    printf_type = LLVMGlobalGetValueType(printf_func);
-  }
+  LLVMValueRef buffer = print_buffer(ctx);
+  LLVMValueRef length = ctx->common_types.const_i64_0;
 
   for (size_t i = 0; i < node->stmt.print_stmt.expr_count; i++) {
     AstNode *expr = node->stmt.print_stmt.expressions[i];
 
-    LLVMValueRef value = codegen_expr(ctx, expr);
-    if (!value) {
-      fprintf(stderr, "Error: Failed to generate expression for printing\n");
-      continue; // Skip this expression but continue with others
-    }
-
-    const char *format_str = NULL;
-    LLVMTypeRef value_type = LLVMTypeOf(value);
-    LLVMTypeKind value_kind = LLVMGetTypeKind(value_type);
-
-    // Handle string literals specially
+    // String literals are copied as written, escapes resolved
     if (expr->type == AST_EXPR_LITERAL &&
         expr->expr.literal.lit_type == LITERAL_STRING) {
       char *processed_str =
           process_escape_sequences(expr->expr.literal.value.string_val);
-      value = LLVMBuildGlobalStringPtr(ctx->builder, processed_str, "str");
-      format_str = "%s";
+      LLVMValueRef str =
+          LLVMBuildGlobalStringPtr(ctx->builder, processed_str, "str");
       free(processed_str);
-    } else {
-      // Handle different value types
-      if (is_range_type(value_type)) {
-        // Handle range printing
-        LLVMValueRef start_val = get_range_start_value(ctx, value);
-        LLVMValueRef end_val = get_range_end_value(ctx, value);
-
-        LLVMTypeRef field_types[2];
-        LLVMGetStructElementTypes(value_type, field_types);
-        LLVMTypeKind element_kind = LLVMGetTypeKind(field_types[0]);
-
-        const char *element_format =
-            (element_kind == LLVMFloatTypeKind)    ? "%.6f"
-            : (element_kind == LLVMDoubleTypeKind) ? "%.6lf"
-            : (element_kind == LLVMIntegerTypeKind &&
-               LLVMGetIntTypeWidth(field_types[0]) == 64)
-                ? "%lld"
-                : "%d";
-
-        char range_format[64];
-        snprintf(range_format, sizeof(range_format), "%s..%s", element_format,
-                 element_format);
-
-        LLVMValueRef range_format_str =
-            LLVMBuildGlobalStringPtr(ctx->builder, range_format, "range_fmt");
-
-        LLVMValueRef range_args[] = {range_format_str, start_val, end_val};
-        LLVMBuildCall2(ctx->builder, printf_type, printf_func, range_args, 3,
-                       "");
-        continue;
-      }
+      length = print_string(ctx, buffer, length, str);
+      continue;
+    }
 
-      // Regular value type handling
-      if (value_kind == LLVMIntegerTypeKind) {
-        unsigned int bits = LLVMGetIntTypeWidth(value_type);
-        if (bits == 1) {
-          format_str = "%s";
-          LLVMValueRef true_str =
-              LLVMBuildGlobalStringPtr(ctx->builder, "true", "true_str");
-          LLVMValueRef false_str =
-              LLVMBuildGlobalStringPtr(ctx->builder, "false", "false_str");
-          value = LLVMBuildSelect(ctx->builder, value, true_str, false_str,
-                                  "bool_str");
-        } else if (bits <= 32) {
-          format_str = "%d";
-        } else {
-          format_str = "%lld";
-        }
-      } else if (value_kind == LLVMFloatTypeKind) {
-        format_str = "%.6f";
-        value = LLVMBuildFPExt(ctx->builder, value,
-                               LLVMDoubleTypeInContext(ctx->context),
-                               "float_to_double");
-      } else if (value_kind == LLVMDoubleTypeKind) {
-        format_str = "%.6lf";
-      } else if (value_kind == LLVMPointerTypeKind) {
-        format_str = "%s"; // Assume string pointer
-      } else {
-        format_str = "%p"; // Fallback for unknown types
-      }
+    LLVMValueRef value = codegen_expr(ctx, expr);
+    if (!value) {
+      fprintf(stderr, "Error: Failed to generate expression for printing\n");
+      continue; // Skip this expression but continue with others
     }
 
-    // Print the value
-    if (format_str) {
-      LLVMValueRef format_str_val =
-          LLVMBuildGlobalStringPtr(ctx->builder, format_str, "fmt");
-      LLVMValueRef args[] = {format_str_val, value};
-      LLVMBuildCall2(ctx->builder, printf_type, printf_func, args, 2, "");
+    if (is_range_type(LLVMTypeOf(value))) {
+      // start..end
+      LLVMValueRef start_val = get_range_start_value(ctx, value);
+      LLVMValueRef end_val = get_range_end_value(ctx, value);
+      length = print_value(ctx, buffer, length, start_val);
+      length = print_string(
+          ctx, buffer, length,
+          LLVMBuildGlobalStringPtr(ctx->builder, "..", "range_sep"));
+      length = print_value(ctx, buffer, length, end_val);
+      continue;
     }
+
+    length = print_value(ctx, buffer, length, value);
   }
+
+  if (node->stmt.print_stmt.ln)
+    length = print_string(ctx, buffer, length,
+                          LLVMBuildGlobalStringPtr(ctx->builder, "\n", "nl"));
+  print_flush(ctx, buffer, length);
+
   // A print statement produces no value; return NULL rather than a null void
   // constant (LLVMConstNull on void traps with SIGILL on some LLVM builds).
   return NULL;
@@ -962,13 +983,15 @@ LLVMValueRef codegen_stmt_defer(CodeGenContext *ctx, AstNode *node) {
 LLVMValueRef codegen_stmt_break_continue(CodeGenContext *ctx, AstNode *node) {
   if (node->stmt.break_continue.is_continue) {
     if (ctx->loop_continue_block) {
-      LLVMBuildBr(ctx->builder, ctx->loop_continue_block);
+      build_scope_exit(ctx, ctx->loop_continue_block,
+                       loop_exit_scope(ctx, true));
     } else {
       fprintf(stderr, "Error: 'continue' used outside of a loop\n");
     }
   } else {
     if (ctx->loop_break_block) {
-      LLVMBuildBr(ctx->builder, ctx->loop_break_block);
+      build_scope_exit(ctx, ctx->loop_break_block,
+                       loop_exit_scope(ctx, false));
     } else {
       fprintf(stderr, "Error: 'break' used outside of a loop\n");
     }
@@ -984,10 +1007,11 @@ LLVMValueRef codegen_infinite_loop(CodeGenContext *ctx, AstNode *node) {
       ctx->context, ctx->current_function, "after_infinite_loop");
 
   // Branch to loop block
-  LLVMBuildBr(ctx->builder, loop_block);
+  LLVMValueRef entry_branch = LLVMBuildBr(ctx->builder, loop_block);
 
   // Generate loop block
   LLVMPositionBuilderAtEnd(ctx->builder, loop_block);
+  profile_loop_iteration(ctx, node);
 
   // Save old loop context
   LLVMBasicBlockRef old_continue = ctx->loop_continue_block;
@@ -1005,6 +1029,7 @@ LLVMValueRef codegen_infinite_loop(CodeGenContext *ctx, AstNode *node) {
   if (!LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(ctx->builder))) {
     LLVMBuildBr(ctx->builder, loop_block);
   }
+  apply_loop_hints(ctx, node, loop_block, entry_branch);
 
   // Restore old loop context
   ctx->loop_continue_block = old_continue;
@@ -1031,7 +1056,7 @@ LLVMValueRef codegen_while_loop(CodeGenContext *ctx, AstNode *node) {
   ctx->loop_continue_block = cond_block; // Continue jumps back to condition
   ctx->loop_break_block = after_block;   // Break jumps to after loop
 
-  LLVMBuildBr(ctx->builder, cond_block);
+  LLVMValueRef entry_branch = LLVMBuildBr(ctx->builder, cond_block);
 
   LLVMPositionBuilderAtEnd(ctx->builder, cond_block);
   if (node->stmt.loop_stmt.condition) {
@@ -1048,6 +1073,7 @@ LLVMValueRef codegen_while_loop(CodeGenContext *ctx, AstNode *node) {
   }
 
   LLVMPositionBuilderAtEnd(ctx->builder, body_block);
+  profile_loop_iteration(ctx, node);
   codegen_stmt(ctx, node->stmt.loop_stmt.body);
 
   if (node->stmt.loop_stmt.optional) {
@@ -1057,6 +1083,7 @@ LLVMValueRef codegen_while_loop(CodeGenContext *ctx, AstNode *node) {
   if (!LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(ctx->builder))) {
     LLVMBuildBr(ctx->builder, cond_block);
   }
+  apply_loop_hints(ctx, node, cond_block, entry_branch);
 
   // ADD THIS: Restore old loop context
   ctx->loop_continue_block = old_continue;
@@ -1100,14 +1127,18 @@ LLVMValueRef codegen_for_loop(CodeGenContext *ctx, AstNode *node) {
     }
   }
 
+  // With -fbounds-check, indices the loop's range proves are not checked
+  struct BoundsLoop *bounds = begin_bounds_loop(ctx, node);
+
   // Jump to condition check
-  LLVMBuildBr(ctx->builder, cond_block);
+  LLVMValueRef entry_branch = LLVMBuildBr(ctx->builder, cond_block);
 
   // Generate condition block
   LLVMPositionBuilderAtEnd(ctx->builder, cond_block);
   if (node->stmt.loop_stmt.condition) {
     LLVMValueRef cond = codegen_expr(ctx, node->stmt.loop_stmt.condition);
     if (!cond) {
+      end_bounds_loop(ctx, bounds, increment_block);
       // Restore old blocks
       ctx->loop_continue_block = old_continue;
       ctx->loop_break_block = old_break;
@@ -1121,6 +1152,7 @@ LLVMValueRef codegen_for_loop(CodeGenContext *ctx, AstNode *node) {
 
   // Generate loop body
   LLVMPositionBuilderAtEnd(ctx->builder, body_block);
+  profile_loop_iteration(ctx, node);
   codegen_stmt(ctx, node->stmt.loop_stmt.body);
 
   // If body doesn't have a terminator, jump to increment
@@ -1138,6 +1170,8 @@ LLVMValueRef codegen_for_loop(CodeGenContext *ctx, AstNode *node) {
 
   // Jump back to condition check
   LLVMBuildBr(ctx->builder, cond_block);
+  end_bounds_loop(ctx, bounds, increment_block);
+  apply_loop_hints(ctx, node, cond_block, entry_branch);
 
   // Restore old loop blocks
   ctx->loop_continue_block = old_continue;
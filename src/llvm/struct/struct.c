@@ -20,29 +20,32 @@ StructInfo *find_concrete_struct_for_base(CodeGenContext *ctx,
 
 // Find a struct type by name
 StructInfo *find_struct_type(CodeGenContext *ctx, const char *name) {
-  StructInfo *cached = lookup_cached_struct(name);
-  if (cached)
-    return cached;
+  Atom key = atom_find(name);
+  return key ? pointer_map_get(&ctx->struct_index, key) : NULL;
+}
 
-  for (StructInfo *info = ctx->struct_types; info; info = info->next) {
-    if (strcmp(info->name, name) == 0) {
-      cache_struct(name, info);
-      return info;
-    }
-  }
-  return NULL;
+StructInfo *find_struct_by_llvm_type(CodeGenContext *ctx, LLVMTypeRef type) {
+  return pointer_map_get(&ctx->struct_type_index, type);
 }
 
 // Add a struct type to the context
 void add_struct_type(CodeGenContext *ctx, StructInfo *struct_info) {
   struct_info->next = ctx->struct_types;
   ctx->struct_types = struct_info;
+  pointer_map_put(&ctx->struct_index, struct_info->name, struct_info);
+  pointer_map_put(&ctx->struct_type_index, struct_info->llvm_type,
+                  struct_info);
 }
 
 // Get field index by name in a struct
 int get_field_index(StructInfo *struct_info, const char *field_name) {
+  Atom key = atom_find(field_name);
+  if (!key) {
+    return -1;
+  }
+
   for (size_t i = 0; i < struct_info->field_count; i++) {
-    if (strcmp(struct_info->field_names[i], field_name) == 0) {
+    if (struct_info->field_names[i] == key) {
       return (int)i;
     }
   }
@@ -72,11 +75,304 @@ bool is_field_access_allowed(CodeGenContext *ctx, StructInfo *struct_info,
   return false;
 }
 
+bool is_padding_field(StructInfo *struct_info, size_t index) {
+  return !struct_info->field_names[index];
+}
+
+size_t named_field_count(StructInfo *struct_info) {
+  size_t count = 0;
+  for (size_t i = 0; i < struct_info->field_count; i++) {
+    if (!is_padding_field(struct_info, i))
+      count++;
+  }
+  return count;
+}
+
+// Alignment a field asks for: #packed makes it 1, #align(N) raises it to N.
+// 0 means the natural alignment of its type.
+static unsigned requested_field_alignment(AstNode *struct_node,
+                                          AstNode *field) {
+  bool packed = struct_node->stmt.struct_decl.is_packed ||
+                field->stmt.field_decl.is_packed;
+  unsigned align = packed ? 1 : 0;
+  if (field->stmt.field_decl.alignment > align)
+    align = (unsigned)field->stmt.field_decl.alignment;
+  return align;
+}
+
+// Lays out the n named fields collected in struct_info and sets the body of
+// its LLVM type. #reorder sorts the struct's own fields (the ones after the
+// spread prefix of inherited_count fields) by alignment, largest first.
+// When a field's alignment differs from its natural one, or the struct has
+// #packed or #align, the offsets are computed here and the gaps become
+// unnamed [k x i8] padding fields, so StructInfo indices stay LLVM element
+// indices.
+static void layout_struct_fields(CodeGenContext *ctx, AstNode *node,
+                                 StructInfo *struct_info, unsigned *requested,
+                                 size_t n, size_t inherited_count) {
+  LLVMTargetDataRef target_data = get_target_data(ctx);
+  if (!target_data) {
+    LLVMStructSetBody(struct_info->llvm_type, struct_info->field_types,
+                      (unsigned)n, false);
+    return;
+  }
+
+  unsigned *align = arena_alloc(ctx->arena, sizeof(unsigned) * n,
+                                alignof(unsigned));
+  bool explicit_layout = node->stmt.struct_decl.is_packed ||
+                         node->stmt.struct_decl.alignment != 0;
+  bool under_aligned = false;
+  for (size_t i = 0; i < n; i++) {
+    unsigned natural =
+        LLVMABIAlignmentOfType(target_data, struct_info->field_types[i]);
+    align[i] = requested[i] ? requested[i] : natural;
+    if (align[i] != natural)
+      explicit_layout = true;
+    if (align[i] < natural)
+      under_aligned = true;
+  }
+
+  if (node->stmt.struct_decl.reorder_fields) {
+    // Stable, so fields of equal alignment keep their declared order
+    for (size_t i = inherited_count + 1; i < n; i++) {
+      Atom name = struct_info->field_names[i];
+      LLVMTypeRef type = struct_info->field_types[i];
+      LLVMTypeRef element_type = struct_info->field_element_types[i];
+      bool is_public = struct_info->field_is_public[i];
+      unsigned a = align[i];
+      size_t j = i;
+      while (j > inherited_count && align[j - 1] < a) {
+        struct_info->field_names[j] = struct_info->field_names[j - 1];
+        struct_info->field_types[j] = struct_info->field_types[j - 1];
+        struct_info->field_element_types[j] =
+            struct_info->field_element_types[j - 1];
+        struct_info->field_is_public[j] = struct_info->field_is_public[j - 1];
+        align[j] = align[j - 1];
+        j--;
+      }
+      struct_info->field_names[j] = name;
+      struct_info->field_types[j] = type;
+      struct_info->field_element_types[j] = element_type;
+      struct_info->field_is_public[j] = is_public;
+      align[j] = a;
+    }
+  }
+
+  if (!explicit_layout) {
+    LLVMStructSetBody(struct_info->llvm_type, struct_info->field_types,
+                      (unsigned)n, false);
+    return;
+  }
+
+  // Room for a padding field before each field and one at the end
+  size_t capacity = 2 * n + 1;
+  Atom *names = arena_alloc(ctx->arena, sizeof(Atom) * capacity, alignof(Atom));
+  LLVMTypeRef *types = arena_alloc(ctx->arena, sizeof(LLVMTypeRef) * capacity,
+                                   alignof(LLVMTypeRef));
+  LLVMTypeRef *element_types = arena_alloc(
+      ctx->arena, sizeof(LLVMTypeRef) * capacity, alignof(LLVMTypeRef));
+  bool *is_public =
+      arena_alloc(ctx->arena, sizeof(bool) * capacity, alignof(bool));
+  unsigned *alignments = arena_alloc(ctx->arena, sizeof(unsigned) * capacity,
+                                     alignof(unsigned));
+
+  size_t count = 0;
+  uint64_t offset = 0;
+  unsigned struct_align = node->stmt.struct_decl.alignment
+                              ? (unsigned)node->stmt.struct_decl.alignment
+                              : 1;
+
+  for (size_t i = 0; i <= n; i++) {
+    unsigned a = i < n ? align[i] : 0;
+    if (i < n && a > struct_align)
+      struct_align = a;
+    // The tail pads the size to a multiple of the struct's alignment
+    uint64_t boundary = i < n ? a : struct_align;
+    uint64_t padding = (boundary - offset % boundary) % boundary;
+    if (padding) {
+      names[count] = NULL;
+      types[count] = LLVMArrayType(ctx->common_types.i8, (unsigned)padding);
+      element_types[count] = NULL;
+      is_public[count] = false;
+      alignments[count] = 1;
+      count++;
+      offset += padding;
+    }
+    if (i == n)
+      break;
+
+    names[count] = struct_info->field_names[i];
+    types[count] = struct_info->field_types[i];
+    element_types[count] = struct_info->field_element_types[i];
+    is_public[count] = struct_info->field_is_public[i];
+    alignments[count] = a;
+    count++;
+    offset += LLVMABISizeOfType(target_data, struct_info->field_types[i]);
+  }
+
+  struct_info->field_names = names;
+  struct_info->field_types = types;
+  struct_info->field_element_types = element_types;
+  struct_info->field_is_public = is_public;
+  struct_info->field_alignments = alignments;
+  struct_info->field_count = count;
+  struct_info->alignment = struct_align;
+
+  // Without under-aligned fields the padding already puts every field where
+  // LLVM would, so the type stays unpacked and keeps its alignment
+  struct_info->is_packed_layout = under_aligned;
+  if (under_aligned)
+    ctx->has_packed_structs = true;
+  LLVMStructSetBody(struct_info->llvm_type, types, (unsigned)count,
+                    under_aligned);
+}
+
+static bool is_gep(LLVMValueRef value) {
+  return LLVMIsAGetElementPtrInst(value) ||
+         (LLVMIsAConstantExpr(value) &&
+          LLVMGetConstOpcode(value) == LLVMGetElementPtr);
+}
+
+// Alignment a load or store through ptr can rely on when ptr points into a
+// packed struct, or 0 when it doesn't
+static unsigned packed_access_alignment(CodeGenContext *ctx,
+                                        LLVMTargetDataRef target_data,
+                                        LLVMValueRef ptr) {
+  for (bool direct = true; ptr && is_gep(ptr); direct = false) {
+    LLVMTypeRef source = LLVMGetGEPSourceElementType(ptr);
+    if (LLVMGetTypeKind(source) == LLVMStructTypeKind &&
+        LLVMIsPackedStruct(source)) {
+      LLVMValueRef field = LLVMGetNumOperands(ptr) == 3
+                               ? LLVMGetOperand(ptr, 2)
+                               : NULL;
+      if (!direct || !field || !LLVMIsAConstantInt(field))
+        return 1;
+
+      // The field's offset within the struct's own alignment
+      StructInfo *info = find_struct_by_llvm_type(ctx, source);
+      unsigned align = info && info->alignment ? info->alignment : 1;
+      unsigned long long offset = LLVMOffsetOfElement(
+          target_data, source, (unsigned)LLVMConstIntGetZExtValue(field));
+      while (offset % align)
+        align /= 2;
+      return align;
+    }
+    ptr = LLVMGetOperand(ptr, 0);
+  }
+  return 0;
+}
+
+void align_packed_accesses(CodeGenContext *ctx, LLVMModuleRef module) {
+  LLVMTargetDataRef target_data = get_target_data(ctx);
+  if (!target_data)
+    return;
+  for (LLVMValueRef fn = LLVMGetFirstFunction(module); fn;
+       fn = LLVMGetNextFunction(fn)) {
+    for (LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(fn); block;
+         block = LLVMGetNextBasicBlock(block)) {
+      for (LLVMValueRef inst = LLVMGetFirstInstruction(block); inst;
+           inst = LLVMGetNextInstruction(inst)) {
+        LLVMValueRef ptr;
+        if (LLVMIsALoadInst(inst))
+          ptr = LLVMGetOperand(inst, 0);
+        else if (LLVMIsAStoreInst(inst))
+          ptr = LLVMGetOperand(inst, 1);
+        else
+          continue;
+        unsigned align = packed_access_alignment(ctx, target_data, ptr);
+        if (align && align < LLVMGetAlignment(inst))
+          LLVMSetAlignment(inst, align);
+      }
+    }
+  }
+}
+
+// Generates the methods of a struct and registers those it inherits
+static void codegen_struct_methods(CodeGenContext *ctx, AstNode *node,
+                                   StructInfo *struct_info) {
+  const char *struct_name = node->stmt.struct_decl.name;
+  size_t public_count = node->stmt.struct_decl.public_count;
+  size_t private_count = node->stmt.struct_decl.private_count;
+  // Every module using an instance has its own copy of the methods
+  bool is_instance = node->stmt.struct_decl.is_instance;
+
+  // Process own methods (both non-static and static)
+  for (size_t i = 0; i < public_count; i++) {
+    AstNode *member = node->stmt.struct_decl.public_members[i];
+    if (member->type == AST_STMT_FIELD_DECL && member->stmt.field_decl.function) {
+      AstNode *func_node = member->stmt.field_decl.function;
+      const char *method_name = member->stmt.field_decl.name;
+      codegen_struct_method(ctx, func_node, struct_info, method_name,
+                            !is_instance, member->stmt.field_decl.is_static);
+    }
+  }
+  for (size_t i = 0; i < private_count; i++) {
+    AstNode *member = node->stmt.struct_decl.private_members[i];
+    if (member->type == AST_STMT_FIELD_DECL && member->stmt.field_decl.function) {
+      AstNode *func_node = member->stmt.field_decl.function;
+      const char *method_name = member->stmt.field_decl.name;
+      codegen_struct_method(ctx, func_node, struct_info, method_name, false,
+                            member->stmt.field_decl.is_static);
+    }
+  }
+
+  // Register inherited method symbols from spread_decl parents
+  // This allows "Child.method" qualified lookup to find the parent's function
+  // by creating "Child.method" symbol entries pointing to "Parent.method" LLVM functions
+  for (size_t i = 0; i < public_count; i++) {
+    AstNode *member = node->stmt.struct_decl.public_members[i];
+    if (member->type != AST_STMT_SPREAD_DECL) continue;
+    AstNode *parent_type = member->stmt.spread_decl.type;
+    if (!parent_type || parent_type->type != AST_TYPE_BASIC) continue;
+
+    LLVM_Symbol *sym = ctx->current_module ? ctx->current_module->symbols : NULL;
+    size_t parent_name_len = strlen(parent_type->type_data.basic.name);
+    while (sym) {
+      if (strncmp(sym->name, parent_type->type_data.basic.name, parent_name_len) == 0 &&
+          sym->name[parent_name_len] == '.') {
+        const char *method_part = sym->name + parent_name_len + 1;
+        size_t child_qlen = strlen(struct_name) + 1 + strlen(method_part) + 1;
+        char *child_qname = arena_alloc(ctx->arena, child_qlen, 1);
+        snprintf(child_qname, child_qlen, "%s.%s", struct_name, method_part);
+        add_symbol_to_module(ctx->current_module, child_qname, sym->value,
+                             sym->type, sym->is_function);
+      }
+      sym = sym->next;
+    }
+  }
+  for (size_t i = 0; i < private_count; i++) {
+    AstNode *member = node->stmt.struct_decl.private_members[i];
+    if (member->type != AST_STMT_SPREAD_DECL) continue;
+    AstNode *parent_type = member->stmt.spread_decl.type;
+    if (!parent_type || parent_type->type != AST_TYPE_BASIC) continue;
+
+    LLVM_Symbol *sym = ctx->current_module ? ctx->current_module->symbols : NULL;
+    size_t parent_name_len = strlen(parent_type->type_data.basic.name);
+    while (sym) {
+      if (strncmp(sym->name, parent_type->type_data.basic.name, parent_name_len) == 0 &&
+          sym->name[parent_name_len] == '.') {
+        const char *method_part = sym->name + parent_name_len + 1;
+        size_t child_qlen = strlen(struct_name) + 1 + strlen(method_part) + 1;
+        char *child_qname = arena_alloc(ctx->arena, child_qlen, 1);
+        snprintf(child_qname, child_qlen, "%s.%s", struct_name, method_part);
+        add_symbol_to_module(ctx->current_module, child_qname, sym->value,
+                             sym->type, sym->is_function);
+      }
+      sym = sym->next;
+    }
+  }
+
+}
+
 LLVMValueRef codegen_stmt_struct(CodeGenContext *ctx, AstNode *node) {
   if (!node || node->type != AST_STMT_STRUCT) {
     return NULL;
   }
 
+  // Generic structs are generated through their instances
+  if (node->stmt.struct_decl.type_param_count)
+    return NULL;
+
   const char *struct_name = node->stmt.struct_decl.name;
   size_t public_count = node->stmt.struct_decl.public_count;
   size_t private_count = node->stmt.struct_decl.private_count;
@@ -120,7 +416,13 @@ LLVMValueRef codegen_stmt_struct(CodeGenContext *ctx, AstNode *node) {
   }
 
   // Check if struct already exists
-  if (find_struct_type(ctx, struct_name)) {
+  StructInfo *existing = find_struct_type(ctx, struct_name);
+  if (existing && node->stmt.struct_decl.is_instance) {
+    // Another module made the same instance; the layout is the same
+    codegen_struct_methods(ctx, node, existing);
+    return NULL;
+  }
+  if (existing) {
     fprintf(stderr, "Error: Struct %s is already defined\n", struct_name);
     return NULL;
   }
@@ -129,19 +431,26 @@ LLVMValueRef codegen_stmt_struct(CodeGenContext *ctx, AstNode *node) {
   StructInfo *struct_info = (StructInfo *)arena_alloc(
       ctx->arena, sizeof(StructInfo), alignof(StructInfo));
 
-  struct_info->name = arena_strdup(ctx->arena, struct_name);
+  struct_info->name = intern(struct_name);
   struct_info->field_count = data_field_count;
   struct_info->is_public = node->stmt.struct_decl.is_public;
 
   // Allocate arrays for field information
-  struct_info->field_names = (char **)arena_alloc(
-      ctx->arena, sizeof(char *) * data_field_count, alignof(char *));
+  struct_info->field_names = (Atom *)arena_alloc(
+      ctx->arena, sizeof(Atom) * data_field_count, alignof(Atom));
   struct_info->field_types = (LLVMTypeRef *)arena_alloc(
       ctx->arena, sizeof(LLVMTypeRef) * data_field_count, alignof(LLVMTypeRef));
   struct_info->field_element_types = (LLVMTypeRef *)arena_alloc(
       ctx->arena, sizeof(LLVMTypeRef) * data_field_count, alignof(LLVMTypeRef));
   struct_info->field_is_public = (bool *)arena_alloc(
       ctx->arena, sizeof(bool) * data_field_count, alignof(bool));
+  struct_info->field_alignments = NULL;
+  struct_info->alignment = 0;
+  struct_info->is_packed_layout = false;
+
+  // Alignment each field asks for, 0 for natural
+  unsigned *requested_alignments = (unsigned *)arena_alloc(
+      ctx->arena, sizeof(unsigned) * data_field_count, alignof(unsigned));
 
   struct_info->llvm_type = LLVMStructCreateNamed(ctx->context, struct_name);
 
@@ -166,10 +475,15 @@ LLVMValueRef codegen_stmt_struct(CodeGenContext *ctx, AstNode *node) {
       return NULL;
     }
     for (size_t j = 0; j < parent->field_count; j++) {
-      struct_info->field_names[field_index] = arena_strdup(ctx->arena, parent->field_names[j]);
+      // The parent's padding is laid out again below
+      if (is_padding_field(parent, j))
+        continue;
+      struct_info->field_names[field_index] = parent->field_names[j];
       struct_info->field_types[field_index] = parent->field_types[j];
       struct_info->field_element_types[field_index] = parent->field_element_types[j];
       struct_info->field_is_public[field_index] = member->stmt.spread_decl.is_public;
+      requested_alignments[field_index] =
+          parent->field_alignments ? parent->field_alignments[j] : 0;
       field_index++;
     }
   }
@@ -187,14 +501,21 @@ LLVMValueRef codegen_stmt_struct(CodeGenContext *ctx, AstNode *node) {
       return NULL;
     }
     for (size_t j = 0; j < parent->field_count; j++) {
-      struct_info->field_names[field_index] = arena_strdup(ctx->arena, parent->field_names[j]);
+      // The parent's padding is laid out again below
+      if (is_padding_field(parent, j))
+        continue;
+      struct_info->field_names[field_index] = parent->field_names[j];
       struct_info->field_types[field_index] = parent->field_types[j];
       struct_info->field_element_types[field_index] = parent->field_element_types[j];
       struct_info->field_is_public[field_index] = member->stmt.spread_decl.is_public;
+      requested_alignments[field_index] =
+          parent->field_alignments ? parent->field_alignments[j] : 0;
       field_index++;
     }
   }
 
+  size_t inherited_count = field_index;
+
   // Process public data fields (own fields)
   for (size_t i = 0; i < public_count; i++) {
     AstNode *member = node->stmt.struct_decl.public_members[i];
@@ -203,18 +524,19 @@ LLVMValueRef codegen_stmt_struct(CodeGenContext *ctx, AstNode *node) {
     if (member->stmt.field_decl.function)
       continue;
 
-    const char *field_name = member->stmt.field_decl.name;
+    Atom field_name = intern(member->stmt.field_decl.name);
     for (size_t j = 0; j < field_index; j++) {
-      if (strcmp(struct_info->field_names[j], field_name) == 0) {
+      if (struct_info->field_names[j] == field_name) {
         fprintf(stderr, "Error: Duplicate field name '%s' in struct %s\n",
                 field_name, struct_name);
         return NULL;
       }
     }
-    struct_info->field_names[field_index] = arena_strdup(ctx->arena, field_name);
+    struct_info->field_names[field_index] = field_name;
     struct_info->field_types[field_index] = codegen_type(ctx, member->stmt.field_decl.type);
     struct_info->field_element_types[field_index] = extract_element_type_from_ast(ctx, member->stmt.field_decl.type);
     struct_info->field_is_public[field_index] = true;
+    requested_alignments[field_index] = requested_field_alignment(node, member);
     if (!struct_info->field_types[field_index]) {
       fprintf(stderr, "Error: Failed to resolve type for field %s in struct %s\n",
               field_name, struct_name);
@@ -231,18 +553,19 @@ LLVMValueRef codegen_stmt_struct(CodeGenContext *ctx, AstNode *node) {
     if (member->stmt.field_decl.function)
       continue;
 
-    const char *field_name = member->stmt.field_decl.name;
+    Atom field_name = intern(member->stmt.field_decl.name);
     for (size_t j = 0; j < field_index; j++) {
-      if (strcmp(struct_info->field_names[j], field_name) == 0) {
+      if (struct_info->field_names[j] == field_name) {
         fprintf(stderr, "Error: Duplicate field name '%s' in struct %s\n",
                 field_name, struct_name);
         return NULL;
       }
     }
-    struct_info->field_names[field_index] = arena_strdup(ctx->arena, field_name);
+    struct_info->field_names[field_index] = field_name;
     struct_info->field_types[field_index] = codegen_type(ctx, member->stmt.field_decl.type);
     struct_info->field_element_types[field_index] = extract_element_type_from_ast(ctx, member->stmt.field_decl.type);
     struct_info->field_is_public[field_index] = member->stmt.field_decl.is_public;
+    requested_alignments[field_index] = requested_field_alignment(node, member);
     if (!struct_info->field_types[field_index]) {
       fprintf(stderr, "Error: Failed to resolve type for field %s in struct %s\n",
               field_name, struct_name);
@@ -252,78 +575,11 @@ LLVMValueRef codegen_stmt_struct(CodeGenContext *ctx, AstNode *node) {
   }
 
   // CRITICAL: Set the struct body AFTER all field types are resolved
-  LLVMStructSetBody(struct_info->llvm_type, struct_info->field_types,
-                    data_field_count, false);
-
-  // Process own methods (both non-static and static)
-  for (size_t i = 0; i < public_count; i++) {
-    AstNode *member = node->stmt.struct_decl.public_members[i];
-    if (member->type == AST_STMT_FIELD_DECL && member->stmt.field_decl.function) {
-      AstNode *func_node = member->stmt.field_decl.function;
-      const char *method_name = member->stmt.field_decl.name;
-      codegen_struct_method(ctx, func_node, struct_info, method_name, true,
-                            member->stmt.field_decl.is_static);
-    }
-  }
-  for (size_t i = 0; i < private_count; i++) {
-    AstNode *member = node->stmt.struct_decl.private_members[i];
-    if (member->type == AST_STMT_FIELD_DECL && member->stmt.field_decl.function) {
-      AstNode *func_node = member->stmt.field_decl.function;
-      const char *method_name = member->stmt.field_decl.name;
-      codegen_struct_method(ctx, func_node, struct_info, method_name, false,
-                            member->stmt.field_decl.is_static);
-    }
-  }
-
-  // Register inherited method symbols from spread_decl parents
-  // This allows "Child.method" qualified lookup to find the parent's function
-  // by creating "Child.method" symbol entries pointing to "Parent.method" LLVM functions
-  for (size_t i = 0; i < public_count; i++) {
-    AstNode *member = node->stmt.struct_decl.public_members[i];
-    if (member->type != AST_STMT_SPREAD_DECL) continue;
-    AstNode *parent_type = member->stmt.spread_decl.type;
-    if (!parent_type || parent_type->type != AST_TYPE_BASIC) continue;
-
-    LLVM_Symbol *sym = ctx->current_module ? ctx->current_module->symbols : NULL;
-    size_t parent_name_len = strlen(parent_type->type_data.basic.name);
-    while (sym) {
-      if (strncmp(sym->name, parent_type->type_data.basic.name, parent_name_len) == 0 &&
-          sym->name[parent_name_len] == '.') {
-        const char *method_part = sym->name + parent_name_len + 1;
-        size_t child_qlen = strlen(struct_name) + 1 + strlen(method_part) + 1;
-        char *child_qname = arena_alloc(ctx->arena, child_qlen, 1);
-        snprintf(child_qname, child_qlen, "%s.%s", struct_name, method_part);
-        add_symbol_to_module(ctx->current_module, child_qname, sym->value,
-                             sym->type, sym->is_function);
-      }
-      sym = sym->next;
-    }
-  }
-  for (size_t i = 0; i < private_count; i++) {
-    AstNode *member = node->stmt.struct_decl.private_members[i];
-    if (member->type != AST_STMT_SPREAD_DECL) continue;
-    AstNode *parent_type = member->stmt.spread_decl.type;
-    if (!parent_type || parent_type->type != AST_TYPE_BASIC) continue;
-
-    LLVM_Symbol *sym = ctx->current_module ? ctx->current_module->symbols : NULL;
-    size_t parent_name_len = strlen(parent_type->type_data.basic.name);
-    while (sym) {
-      if (strncmp(sym->name, parent_type->type_data.basic.name, parent_name_len) == 0 &&
-          sym->name[parent_name_len] == '.') {
-        const char *method_part = sym->name + parent_name_len + 1;
-        size_t child_qlen = strlen(struct_name) + 1 + strlen(method_part) + 1;
-        char *child_qname = arena_alloc(ctx->arena, child_qlen, 1);
-        snprintf(child_qname, child_qlen, "%s.%s", struct_name, method_part);
-        add_symbol_to_module(ctx->current_module, child_qname, sym->value,
-                             sym->type, sym->is_function);
-      }
-      sym = sym->next;
-    }
-  }
-
-  // ===== CACHING =====
-  cache_struct(struct_info->name, struct_info);
+  struct_info->field_count = field_index;
+  layout_struct_fields(ctx, node, struct_info, requested_alignments,
+                       field_index, inherited_count);
 
+  codegen_struct_methods(ctx, node, struct_info);
   return NULL;
 }
 
@@ -403,8 +659,9 @@ LLVMValueRef codegen_struct_method(CodeGenContext *ctx, AstNode *func_node,
       ctx->current_module ? ctx->current_module->module : ctx->module;
 
   // CHANGED: Use qualified_method_name instead of method_name
+  LLVMTypeRef lowered_type = lower_function_type(ctx, func_type);
   LLVMValueRef func =
-      LLVMAddFunction(current_llvm_module, qualified_method_name, func_type);
+      LLVMAddFunction(current_llvm_module, qualified_method_name, lowered_type);
 
   if (!func) {
     fprintf(stderr, "Error: Failed to create LLVM function for method '%s'\n",
@@ -417,16 +674,29 @@ LLVMValueRef codegen_struct_method(CodeGenContext *ctx, AstNode *func_node,
   } else {
     LLVMSetLinkage(func, LLVMInternalLinkage);
   }
+  set_abi_attributes(ctx, func, func_type);
+  set_function_attributes(ctx, func, func_node);
+  if (!is_static) {
+    set_self_attributes(ctx, func, struct_info->llvm_type);
+  }
 
   // Register the function in the symbol table under its qualified name
   add_symbol_to_module(ctx->current_module, qualified_method_name, func,
-                       func_type, true);
+                       lowered_type, true);
+
+  // The body lives in a prebuilt object; a declaration can't be internal
+  if (ctx->declarations_only) {
+    LLVMSetLinkage(func, LLVMExternalLinkage);
+    return func;
+  }
 
   // CRITICAL: Save the old function context before starting method generation
   LLVMValueRef old_function = ctx->current_function;
+  DeferState old_defers = ctx->defers;
 
   // Set current function context
   ctx->current_function = func;
+  init_defer_stack(ctx);
 
   // Create entry basic block
   LLVMBasicBlockRef entry =
@@ -434,15 +704,20 @@ LLVMValueRef codegen_struct_method(CodeGenContext *ctx, AstNode *func_node,
   LLVMPositionBuilderAtEnd(ctx->builder, entry);
 
   // Add all parameters to symbol table
+  unsigned first_param = first_source_param(func);
   for (size_t i = 0; i < param_count; i++) {
-    LLVMValueRef param = LLVMGetParam(func, i);
+    unsigned index = (unsigned)i + first_param;
+    LLVMValueRef param = LLVMGetParam(func, index);
     const char *param_name = param_names[i];
 
     LLVMSetValueName2(param, param_name, strlen(param_name));
 
-    LLVMValueRef alloca =
-        LLVMBuildAlloca(ctx->builder, llvm_param_types[i], param_name);
-    LLVMBuildStore(ctx->builder, param, alloca);
+    // A byval struct already is the method's own copy
+    LLVMValueRef alloca = param;
+    if (!byval_type(func, index)) {
+      alloca = LLVMBuildAlloca(ctx->builder, llvm_param_types[i], param_name);
+      LLVMBuildStore(ctx->builder, param, alloca);
+    }
 
     LLVMTypeRef element_type = NULL;
 
@@ -463,12 +738,21 @@ LLVMValueRef codegen_struct_method(CodeGenContext *ctx, AstNode *func_node,
     codegen_stmt(ctx, body);
   }
 
-  // Add return if missing for void functions
-  if (LLVMGetTypeKind(llvm_return_type) == LLVMVoidTypeKind) {
-    if (!LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(ctx->builder))) {
+  // Add return if missing: void for void functions and structs returned in
+  // memory, and a zero value otherwise, as for free functions. The block
+  // after an endless `loop` is one such place.
+  LLVMTypeRef lowered_return = LLVMGetReturnType(lowered_type);
+  if (!LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(ctx->builder))) {
+    if (LLVMGetTypeKind(lowered_return) == LLVMVoidTypeKind) {
       LLVMBuildRetVoid(ctx->builder);
+    } else {
+      LLVMBuildRet(ctx->builder, LLVMConstNull(lowered_return));
     }
   }
+  finish_function_defers(ctx);
+
+  if (func_node && (func_node->stmt.func_decl.attributes & FN_ATTR_FLATTEN))
+    flatten_calls(ctx, func);
 
   // Verify the function
   if (LLVMVerifyFunction(func, LLVMReturnStatusAction)) {
@@ -477,11 +761,13 @@ LLVMValueRef codegen_struct_method(CodeGenContext *ctx, AstNode *func_node,
     LLVMDumpValue(func);
     // Restore context even on error
     ctx->current_function = old_function;
+    ctx->defers = old_defers;
     return NULL;
   }
 
   // CRITICAL: Restore the old function context
   ctx->current_function = old_function;
+  ctx->defers = old_defers;
 
   return func;
 }
@@ -627,7 +913,8 @@ LLVMValueRef codegen_expr_struct_assignment(CodeGenContext *ctx,
         LLVMBuildStructGEP2(ctx->builder, struct_info->llvm_type, struct_ptr,
                             field_index, "field_ptr");
 
-    LLVMBuildStore(ctx->builder, value, field_ptr);
+    LLVMValueRef store = LLVMBuildStore(ctx->builder, value, field_ptr);
+    tag_field_access(ctx, store, expected_type);
     return value;
   }
 
@@ -7,8 +7,8 @@
 
 // Field access cache for faster repeated lookups
 typedef struct FieldAccessCache {
-    const char *struct_name;
-    const char *field_name;
+    Atom struct_name;
+    Atom field_name;
     int field_index;
     LLVMTypeRef field_type;
     LLVMTypeRef element_type;
@@ -16,11 +16,11 @@ typedef struct FieldAccessCache {
     struct FieldAccessCache *next;
 } FieldAccessCache;
 
-static FieldAccessCache *field_cache[256] = {0};
-
 // Forward declarations
-static FieldAccessCache *lookup_field_cache(const char *struct_name, const char *field_name);
-static void cache_field_access(StructInfo *info, const char *field_name, int index);
+static FieldAccessCache *lookup_field_cache(CodeGenContext *ctx, Atom struct_name,
+                                           const char *field_name);
+static void cache_field_access(CodeGenContext *ctx, StructInfo *info,
+                               const char *field_name, int index);
 static LLVMValueRef handle_identifier_member(CodeGenContext *ctx, AstNode *node);
 static LLVMValueRef handle_chained_member(CodeGenContext *ctx, AstNode *node);
 static LLVMValueRef handle_indexed_member(CodeGenContext *ctx, AstNode *node);
@@ -53,13 +53,23 @@ LLVMValueRef codegen_expr_struct_access(CodeGenContext *ctx, AstNode *node) {
     }
 }
 
+// Struct and field names are atoms: hashed once when interned, compared by
+// pointer here
+static inline unsigned field_cache_bucket(Atom struct_name, Atom field_name) {
+    return (atom_hash(struct_name) * 31u + atom_hash(field_name)) % FIELD_CACHE_BUCKETS;
+}
+
 // Cache lookup - O(1) average case
-static FieldAccessCache *lookup_field_cache(const char *struct_name, const char *field_name) {
-    unsigned hash = (hash_string(struct_name) ^ hash_string(field_name)) % 256;
-    
-    for (FieldAccessCache *entry = field_cache[hash]; entry; entry = entry->next) {
-        if (strcmp(entry->struct_name, struct_name) == 0 &&
-            strcmp(entry->field_name, field_name) == 0) {
+static FieldAccessCache *lookup_field_cache(CodeGenContext *ctx, Atom struct_name,
+                                           const char *field_name) {
+    Atom field = atom_find(field_name);
+    if (!field) {
+        return NULL;
+    }
+
+    unsigned hash = field_cache_bucket(struct_name, field);
+    for (FieldAccessCache *entry = ctx->field_cache[hash]; entry; entry = entry->next) {
+        if (entry->struct_name == struct_name && entry->field_name == field) {
             return entry;
         }
     }
@@ -67,26 +77,29 @@ static FieldAccessCache *lookup_field_cache(const char *struct_name, const char
 }
 
 // Cache a field access
-static void cache_field_access(StructInfo *info, const char *field_name, int index) {
-    unsigned hash = (hash_string(info->name) ^ hash_string(field_name)) % 256;
-    
+// Entries live in the context's arena: they hold LLVM types of that context
+static void cache_field_access(CodeGenContext *ctx, StructInfo *info,
+                               const char *field_name, int index) {
+    Atom field = intern(field_name);
+    unsigned hash = field_cache_bucket(info->name, field);
+
     // Check if already cached
-    for (FieldAccessCache *entry = field_cache[hash]; entry; entry = entry->next) {
-        if (strcmp(entry->struct_name, info->name) == 0 &&
-            strcmp(entry->field_name, field_name) == 0) {
+    for (FieldAccessCache *entry = ctx->field_cache[hash]; entry; entry = entry->next) {
+        if (entry->struct_name == info->name && entry->field_name == field) {
             return; // Already cached
         }
     }
-    
-    FieldAccessCache *entry = malloc(sizeof(FieldAccessCache));
+
+    FieldAccessCache *entry = arena_alloc(ctx->arena, sizeof(FieldAccessCache),
+                                          alignof(FieldAccessCache));
     entry->struct_name = info->name;
-    entry->field_name = field_name;
+    entry->field_name = field;
     entry->field_index = index;
     entry->field_type = info->field_types[index];
     entry->element_type = info->field_element_types[index];
     entry->is_public = info->field_is_public[index];
-    entry->next = field_cache[hash];
-    field_cache[hash] = entry;
+    entry->next = ctx->field_cache[hash];
+    ctx->field_cache[hash] = entry;
 }
 
 // Handle: obj.field (where obj is identifier)
@@ -108,21 +121,12 @@ static LLVMValueRef handle_identifier_member(CodeGenContext *ctx, AstNode *node)
     LLVMTypeKind symbol_kind = LLVMGetTypeKind(symbol_type);
 
     if (symbol_kind == LLVMPointerTypeKind && sym->element_type) {
-        for (StructInfo *info = ctx->struct_types; info; info = info->next) {
-            if (info->llvm_type == sym->element_type) {
-                struct_info = info;
-                cached = lookup_field_cache(info->name, field_name);
-                break;
-            }
-        }
+        struct_info = find_struct_by_llvm_type(ctx, sym->element_type);
     } else if (symbol_kind == LLVMStructTypeKind) {
-        for (StructInfo *info = ctx->struct_types; info; info = info->next) {
-            if (info->llvm_type == symbol_type) {
-                struct_info = info;
-                cached = lookup_field_cache(info->name, field_name);
-                break;
-            }
-        }
+        struct_info = find_struct_by_llvm_type(ctx, symbol_type);
+    }
+    if (struct_info) {
+        cached = lookup_field_cache(ctx, struct_info->name, field_name);
     }
 
     // Fallback: resolve struct by name from LLVM type
@@ -182,7 +186,7 @@ static LLVMValueRef handle_identifier_member(CodeGenContext *ctx, AstNode *node)
         }
 
         field_type = struct_info->field_types[field_index];
-        cache_field_access(struct_info, field_name, field_index);
+        cache_field_access(ctx, struct_info, field_name, field_index);
     }
 
     // Get struct pointer
@@ -209,7 +213,10 @@ static LLVMValueRef handle_identifier_member(CodeGenContext *ctx, AstNode *node)
                             "array_field_ptr");
     }
 
-    return LLVMBuildLoad2(ctx->builder, field_type, field_ptr, "field_val");
+    LLVMValueRef value = LLVMBuildLoad2(ctx->builder, field_type, field_ptr,
+                                        "field_val");
+    tag_field_access(ctx, value, field_type);
+    return value;
 }
 
 // Handle: obj.field1.field2 (chained member access)
@@ -231,12 +238,7 @@ static LLVMValueRef handle_chained_member(CodeGenContext *ctx, AstNode *node) {
 
     if (base_kind == LLVMStructTypeKind) {
         // Find struct type
-        for (StructInfo *info = ctx->struct_types; info; info = info->next) {
-            if (info->llvm_type == base_type) {
-                struct_info = info;
-                break;
-            }
-        }
+        struct_info = find_struct_by_llvm_type(ctx, base_type);
 
         if (!struct_info) {
             const char *type_name = LLVMGetStructName(base_type);
@@ -264,7 +266,7 @@ static LLVMValueRef handle_chained_member(CodeGenContext *ctx, AstNode *node) {
     }
 
     // Use cached lookup
-    FieldAccessCache *cached = lookup_field_cache(struct_info->name, field_name);
+    FieldAccessCache *cached = lookup_field_cache(ctx, struct_info->name, field_name);
     int field_index;
     LLVMTypeRef field_type;
     
@@ -294,7 +296,7 @@ static LLVMValueRef handle_chained_member(CodeGenContext *ctx, AstNode *node) {
             return NULL;
         }
         field_type = struct_info->field_types[field_index];
-        cache_field_access(struct_info, field_name, field_index);
+        cache_field_access(ctx, struct_info, field_name, field_index);
     }
 
     return struct_gep_load(ctx, struct_info->llvm_type, struct_ptr,
@@ -319,13 +321,7 @@ static LLVMValueRef handle_indexed_member(CodeGenContext *ctx, AstNode *node) {
         return NULL;
     }
 
-    StructInfo *struct_info = NULL;
-    for (StructInfo *info = ctx->struct_types; info; info = info->next) {
-        if (info->llvm_type == indexed_type) {
-            struct_info = info;
-            break;
-        }
-    }
+    StructInfo *struct_info = find_struct_by_llvm_type(ctx, indexed_type);
 
     if (!struct_info) {
         const char *type_name = LLVMGetStructName(indexed_type);
@@ -340,7 +336,7 @@ static LLVMValueRef handle_indexed_member(CodeGenContext *ctx, AstNode *node) {
     LLVMValueRef struct_ptr = alloca_and_store(ctx, indexed_type, indexed_value,
                                                 "indexed_struct_temp");
 
-    FieldAccessCache *cached = lookup_field_cache(struct_info->name, field_name);
+    FieldAccessCache *cached = lookup_field_cache(ctx, struct_info->name, field_name);
     int field_index;
     LLVMTypeRef field_type;
     
@@ -365,7 +361,7 @@ static LLVMValueRef handle_indexed_member(CodeGenContext *ctx, AstNode *node) {
             return NULL;
         }
         field_type = struct_info->field_types[field_index];
-        cache_field_access(struct_info, field_name, field_index);
+        cache_field_access(ctx, struct_info, field_name, field_index);
     }
 
     return struct_gep_load(ctx, struct_info->llvm_type, struct_ptr,
@@ -386,12 +382,7 @@ static LLVMValueRef handle_call_result_member(CodeGenContext *ctx, AstNode *node
     LLVMValueRef struct_ptr;
 
     if (result_kind == LLVMStructTypeKind) {
-        for (StructInfo *info = ctx->struct_types; info; info = info->next) {
-            if (info->llvm_type == result_type) {
-                struct_info = info;
-                break;
-            }
-        }
+        struct_info = find_struct_by_llvm_type(ctx, result_type);
         if (!struct_info) {
             const char *type_name = LLVMGetStructName(result_type);
             if (type_name) struct_info = find_struct_type(ctx, type_name);
@@ -412,7 +403,7 @@ static LLVMValueRef handle_call_result_member(CodeGenContext *ctx, AstNode *node
 
     if (!struct_info || !struct_ptr) return NULL;
 
-    FieldAccessCache *cached = lookup_field_cache(struct_info->name, field_name);
+    FieldAccessCache *cached = lookup_field_cache(ctx, struct_info->name, field_name);
     int field_index;
     LLVMTypeRef field_type;
 
@@ -437,7 +428,7 @@ static LLVMValueRef handle_call_result_member(CodeGenContext *ctx, AstNode *node
             return NULL;
         }
         field_type = struct_info->field_types[field_index];
-        cache_field_access(struct_info, field_name, field_index);
+        cache_field_access(ctx, struct_info, field_name, field_index);
     }
 
     return struct_gep_load(ctx, struct_info->llvm_type, struct_ptr,
@@ -463,7 +454,7 @@ static LLVMValueRef handle_deref_member(CodeGenContext *ctx, AstNode *node) {
         return NULL;
     }
 
-    FieldAccessCache *cached = lookup_field_cache(struct_info->name, field_name);
+    FieldAccessCache *cached = lookup_field_cache(ctx, struct_info->name, field_name);
     int field_index;
     LLVMTypeRef field_type;
 
@@ -488,7 +479,7 @@ static LLVMValueRef handle_deref_member(CodeGenContext *ctx, AstNode *node) {
             return NULL;
         }
         field_type = struct_info->field_types[field_index];
-        cache_field_access(struct_info, field_name, field_index);
+        cache_field_access(ctx, struct_info, field_name, field_index);
     }
 
     return struct_gep_load(ctx, struct_info->llvm_type, ptr,
@@ -5,14 +5,15 @@ static StructInfo *infer_struct_type_from_context(CodeGenContext *ctx,
                                                   char **field_names,
                                                   size_t field_count) {
   for (StructInfo *info = ctx->struct_types; info; info = info->next) {
-    if (info->field_count != field_count)
+    if (named_field_count(info) != field_count)
       continue;
 
     bool all_match = true;
     for (size_t i = 0; i < field_count; i++) {
       bool found = false;
       for (size_t j = 0; j < info->field_count; j++) {
-        if (strcmp(field_names[i], info->field_names[j]) == 0) {
+        if (!is_padding_field(info, j) &&
+            strcmp(field_names[i], info->field_names[j]) == 0) {
           found = true;
           break;
         }
@@ -49,7 +50,16 @@ LLVMValueRef codegen_expr_struct_literal(CodeGenContext *ctx, AstNode *node) {
       return NULL;
     }
   } else {
-    struct_info = infer_struct_type_from_context(ctx, field_names, field_count);
+    // An anonymous literal checked against a declared struct type carries it
+    AstNode *checked = node->expr.checked_type;
+    if (checked && checked->type == AST_TYPE_STRUCT)
+      struct_info = find_struct_type(ctx, checked->type_data.struct_type.name);
+    else if (checked && checked->type == AST_TYPE_BASIC)
+      struct_info = find_struct_type(ctx, checked->type_data.basic.name);
+
+    if (!struct_info)
+      struct_info =
+          infer_struct_type_from_context(ctx, field_names, field_count);
     if (!struct_info) {
       fprintf(stderr, "Error: Could not infer struct type from field names.\n");
       return NULL;
@@ -60,9 +70,11 @@ LLVMValueRef codegen_expr_struct_literal(CodeGenContext *ctx, AstNode *node) {
   LLVMValueRef *llvm_field_values = (LLVMValueRef *)arena_alloc(
       ctx->arena, sizeof(LLVMValueRef) * struct_info->field_count, alignof(LLVMValueRef));
 
-  // Initialize all to NULL (not yet set)
+  // Initialize all to NULL (not yet set); padding is always zero
   for (size_t i = 0; i < struct_info->field_count; i++)
-    llvm_field_values[i] = NULL;
+    llvm_field_values[i] = is_padding_field(struct_info, i)
+                               ? LLVMConstNull(struct_info->field_types[i])
+                               : NULL;
 
   bool all_constant = true;
 
@@ -79,13 +91,7 @@ LLVMValueRef codegen_expr_struct_literal(CodeGenContext *ctx, AstNode *node) {
 
       // Determine the source struct type
       LLVMTypeRef spread_type = LLVMTypeOf(spread_val);
-      StructInfo *source_info = NULL;
-      for (StructInfo *info = ctx->struct_types; info; info = info->next) {
-        if (info->llvm_type == spread_type) {
-          source_info = info;
-          break;
-        }
-      }
+      StructInfo *source_info = find_struct_by_llvm_type(ctx, spread_type);
       if (!source_info) {
         const char *tn = LLVMGetStructName(spread_type);
         if (tn) source_info = find_struct_type(ctx, tn);
@@ -100,6 +106,8 @@ LLVMValueRef codegen_expr_struct_literal(CodeGenContext *ctx, AstNode *node) {
 
       // Copy each field from source to target by name
       for (size_t j = 0; j < source_info->field_count; j++) {
+        if (is_padding_field(source_info, j))
+          continue;
         int target_idx = get_field_index(struct_info, source_info->field_names[j]);
         if (target_idx < 0) {
           fprintf(stderr, "Error: Field '%s' from spread doesn't exist in target\n",
@@ -190,6 +198,8 @@ LLVMValueRef codegen_expr_struct_literal(CodeGenContext *ctx, AstNode *node) {
     LLVMValueRef struct_alloca =
         LLVMBuildAlloca(ctx->builder, struct_info->llvm_type, "struct_literal");
     for (size_t i = 0; i < struct_info->field_count; i++) {
+      if (is_padding_field(struct_info, i))
+        continue;
       LLVMValueRef field_ptr = LLVMBuildStructGEP2(
           ctx->builder, struct_info->llvm_type, struct_alloca, i, "field_ptr");
       LLVMBuildStore(ctx->builder, llvm_field_values[i], field_ptr);
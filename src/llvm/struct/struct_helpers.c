@@ -10,23 +10,13 @@ bool is_struct_type(CodeGenContext *ctx, LLVMTypeRef type) {
         return false;
     }
     
-    // Search through our registered struct types
-    for (StructInfo *info = ctx->struct_types; info; info = info->next) {
-        if (info->llvm_type == type) {
-            return true;
-        }
-    }
-    return false;
+    return find_struct_by_llvm_type(ctx, type) != NULL;
 }
 
 // Get struct name from LLVM type
 const char *get_struct_name_from_type(CodeGenContext *ctx, LLVMTypeRef type) {
-    for (StructInfo *info = ctx->struct_types; info; info = info->next) {
-        if (info->llvm_type == type) {
-            return info->name;
-        }
-    }
-    return NULL;
+    StructInfo *info = find_struct_by_llvm_type(ctx, type);
+    return info ? info->name : NULL;
 }
 
 // =============================================================================
@@ -104,6 +94,8 @@ void print_struct_info(CodeGenContext *ctx, const char *struct_name) {
     printf("Fields:\n");
     
     for (size_t i = 0; i < struct_info->field_count; i++) {
+        if (is_padding_field(struct_info, i))
+            continue;
         const char *visibility = struct_info->field_is_public[i] ? "public" : "private";
         
         // Get type name (simplified - you might want more detailed type info)
@@ -160,6 +152,8 @@ void debug_struct_layout(CodeGenContext *ctx, const char *struct_name) {
            (unsigned long long)LLVMStoreSizeOfType(NULL, struct_info->llvm_type));
     
     for (size_t i = 0; i < struct_info->field_count; i++) {
+        if (is_padding_field(struct_info, i))
+            continue;
         // Get offset (simplified calculation)
         printf("  Field %zu (%s): offset ~%zu bytes\n", 
                i, struct_info->field_names[i], i * 8); // Rough estimate
@@ -191,6 +185,8 @@ LLVMValueRef compare_structs_equal(CodeGenContext *ctx, LLVMValueRef struct1,
     LLVMBuildStore(ctx->builder, struct2, temp2);
     
     for (size_t i = 0; i < struct_info->field_count; i++) {
+        if (is_padding_field(struct_info, i))
+            continue;
         // Get field values
         LLVMValueRef field1_ptr = LLVMBuildStructGEP2(
             ctx->builder, struct_info->llvm_type, temp1, i, "field1_ptr");
@@ -88,6 +88,15 @@ LLVMTypeRef codegen_type_array(CodeGenContext *ctx, AstNode *node) {
   return NULL;
 }
 
+LLVMTypeRef codegen_type_vector(CodeGenContext *ctx, AstNode *node) {
+  LLVMTypeRef element_type =
+      codegen_type(ctx, node->type_data.vector.element_type);
+  if (!element_type)
+    return NULL;
+  return LLVMVectorType(element_type,
+                        (unsigned)node->type_data.vector.lane_count);
+}
+
 LLVMTypeRef codegen_type_function(CodeGenContext *ctx, AstNode *node) {
   LLVMTypeRef return_type =
       codegen_type(ctx, node->type_data.function.return_type);
@@ -108,3 +117,73 @@ LLVMTypeRef codegen_type_function(CodeGenContext *ctx, AstNode *node) {
   }
   return NULL;
 }
+
+static bool is_builtin_type_name(const char *name) {
+  return strcmp(name, "int") == 0 || strcmp(name, "float") == 0 ||
+         strcmp(name, "double") == 0 || strcmp(name, "bool") == 0 ||
+         strcmp(name, "void") == 0 || strcmp(name, "str") == 0 ||
+         strcmp(name, "string") == 0 || strcmp(name, "char") == 0;
+}
+
+// Like codegen_type, but quiet about names codegen doesn't know and aware of
+// the struct types the typechecker builds
+static LLVMTypeRef lower_checked_type(CodeGenContext *ctx, AstNode *type) {
+  if (!type || type->category != Node_Category_TYPE)
+    return NULL;
+
+  switch (type->type) {
+  case AST_TYPE_STRUCT: {
+    StructInfo *info = find_struct_type(ctx, type->type_data.struct_type.name);
+    return info ? info->llvm_type : NULL;
+  }
+  case AST_TYPE_BASIC: {
+    const char *name = type->type_data.basic.name;
+    if (!name)
+      return NULL;
+    if (is_builtin_type_name(name))
+      return codegen_type(ctx, type);
+    StructInfo *info = find_struct_type(ctx, name);
+    if (info)
+      return info->llvm_type;
+    return get_enum_type(ctx, name);
+  }
+  case AST_TYPE_POINTER: {
+    LLVMTypeRef pointee =
+        lower_checked_type(ctx, type->type_data.pointer.pointee_type);
+    return pointee ? LLVMPointerType(pointee, 0) : NULL;
+  }
+  case AST_TYPE_ARRAY: {
+    AstNode *size = type->type_data.array.size;
+    if (!size || size->type != AST_EXPR_LITERAL ||
+        size->expr.literal.lit_type != LITERAL_INT)
+      return NULL;
+    LLVMTypeRef element =
+        lower_checked_type(ctx, type->type_data.array.element_type);
+    return element ? LLVMArrayType(element,
+                                   (unsigned)size->expr.literal.value.int_val)
+                   : NULL;
+  }
+  case AST_TYPE_VECTOR:
+    return codegen_type(ctx, type);
+  default:
+    return NULL;
+  }
+}
+
+LLVMTypeRef codegen_checked_type(CodeGenContext *ctx, AstNode *expr) {
+  if (!expr || expr->category != Node_Category_EXPR)
+    return NULL;
+  return lower_checked_type(ctx, expr->expr.checked_type);
+}
+
+LLVMTypeRef codegen_checked_element_type(CodeGenContext *ctx, AstNode *expr) {
+  if (!expr || expr->category != Node_Category_EXPR || !expr->expr.checked_type)
+    return NULL;
+
+  AstNode *type = expr->expr.checked_type;
+  if (type->type == AST_TYPE_POINTER)
+    return lower_checked_type(ctx, type->type_data.pointer.pointee_type);
+  if (type->type == AST_TYPE_ARRAY)
+    return lower_checked_type(ctx, type->type_data.array.element_type);
+  return NULL;
+}
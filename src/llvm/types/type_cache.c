@@ -4,6 +4,9 @@
 void init_type_cache(CodeGenContext *ctx) {
   CommonTypes *types = &ctx->common_types;
 
+  // Types cached on canonical types by an earlier context don't apply
+  ctx->type_cache_owner = type_table_new_owner();
+
   // Integer types
   types->i1 = LLVMInt1TypeInContext(ctx->context);
   types->i8 = LLVMInt8TypeInContext(ctx->context);
@@ -90,6 +93,7 @@ LLVMValueRef get_default_value(LLVMTypeRef type) {
   case LLVMDoubleTypeKind:
   case LLVMStructTypeKind:
   case LLVMArrayTypeKind:
+  case LLVMVectorTypeKind:
     return LLVMConstNull(type);
 
   case LLVMPointerTypeKind:
@@ -0,0 +1,295 @@
+#include "../llvm.h"
+
+// Struct values bigger than two registers cross calls in memory, the way C
+// passes them: they are returned through a caller-allocated sret pointer and
+// passed as byval pointers, so the callee works on its own copy in place.
+// The rest of codegen deals in source-level function types, where structs
+// are plain values; only function declarations and call instructions see
+// the lowered type.
+
+bool passes_in_memory(CodeGenContext *ctx, LLVMTypeRef type) {
+  if (!type || LLVMGetTypeKind(type) != LLVMStructTypeKind ||
+      !LLVMTypeIsSized(type))
+    return false;
+  LLVMTargetDataRef target_data = get_target_data(ctx);
+  return target_data &&
+         LLVMABISizeOfType(target_data, type) > AGGREGATE_REGISTER_BYTES;
+}
+
+LLVMTypeRef lower_function_type(CodeGenContext *ctx, LLVMTypeRef source_type) {
+  LLVMTypeRef return_type = LLVMGetReturnType(source_type);
+  unsigned count = LLVMCountParamTypes(source_type);
+  unsigned sret = passes_in_memory(ctx, return_type) ? 1 : 0;
+
+  LLVMTypeRef *params = arena_alloc(
+      ctx->arena, sizeof(LLVMTypeRef) * (count + 1), alignof(LLVMTypeRef));
+  LLVMGetParamTypes(source_type, params + sret);
+
+  bool lowered = sret;
+  for (unsigned i = sret; i < count + sret; i++) {
+    if (passes_in_memory(ctx, params[i])) {
+      params[i] = LLVMPointerType(params[i], 0);
+      lowered = true;
+    }
+  }
+  if (!lowered)
+    return source_type;
+
+  if (sret) {
+    params[0] = LLVMPointerType(return_type, 0);
+    return_type = ctx->common_types.void_type;
+  }
+  return LLVMFunctionType(return_type, params, count + sret,
+                          LLVMIsFunctionVarArg(source_type));
+}
+
+static LLVMAttributeRef type_attribute(CodeGenContext *ctx, const char *name,
+                                       LLVMTypeRef type) {
+  unsigned kind = LLVMGetEnumAttributeKindForName(name, strlen(name));
+  return kind ? LLVMCreateTypeAttribute(ctx->context, kind, type) : NULL;
+}
+
+static LLVMAttributeRef enum_attribute(CodeGenContext *ctx, const char *name) {
+  unsigned kind = LLVMGetEnumAttributeKindForName(name, strlen(name));
+  return kind ? LLVMCreateEnumAttribute(ctx->context, kind, 0) : NULL;
+}
+
+// Puts sret and byval on a function (call == NULL) or on a call, which needs
+// them too when it goes through a function pointer
+static void add_abi_attributes(CodeGenContext *ctx, LLVMValueRef function,
+                               LLVMValueRef call, LLVMTypeRef source_type) {
+  LLVMTypeRef return_type = LLVMGetReturnType(source_type);
+  unsigned count = LLVMCountParamTypes(source_type);
+  unsigned sret = passes_in_memory(ctx, return_type) ? 1 : 0;
+
+  LLVMAttributeRef *attributes =
+      arena_alloc(ctx->arena, sizeof(LLVMAttributeRef) * (count + 2),
+                  alignof(LLVMAttributeRef));
+  LLVMAttributeIndex *indices =
+      arena_alloc(ctx->arena, sizeof(LLVMAttributeIndex) * (count + 2),
+                  alignof(LLVMAttributeIndex));
+  unsigned n = 0;
+
+  if (sret) {
+    attributes[n] = type_attribute(ctx, "sret", return_type);
+    indices[n++] = 1;
+    attributes[n] = enum_attribute(ctx, "noalias");
+    indices[n++] = 1;
+  }
+
+  LLVMTypeRef *params = arena_alloc(ctx->arena, sizeof(LLVMTypeRef) * count,
+                                    alignof(LLVMTypeRef));
+  LLVMGetParamTypes(source_type, params);
+  for (unsigned i = 0; i < count; i++) {
+    if (passes_in_memory(ctx, params[i])) {
+      attributes[n] = type_attribute(ctx, "byval", params[i]);
+      indices[n++] = i + 1 + sret;
+    }
+  }
+
+  for (unsigned i = 0; i < n; i++) {
+    if (!attributes[i])
+      continue;
+    if (call)
+      LLVMAddCallSiteAttribute(call, indices[i], attributes[i]);
+    else
+      LLVMAddAttributeAtIndex(function, indices[i], attributes[i]);
+  }
+}
+
+void set_abi_attributes(CodeGenContext *ctx, LLVMValueRef function,
+                        LLVMTypeRef source_type) {
+  add_abi_attributes(ctx, function, NULL, source_type);
+}
+
+static LLVMTypeRef attribute_type(LLVMValueRef function,
+                                  LLVMAttributeIndex index, const char *name) {
+  unsigned kind = LLVMGetEnumAttributeKindForName(name, strlen(name));
+  LLVMAttributeRef attribute =
+      kind ? LLVMGetEnumAttributeAtIndex(function, index, kind) : NULL;
+  return attribute ? LLVMGetTypeAttributeValue(attribute) : NULL;
+}
+
+LLVMTypeRef sret_type(LLVMValueRef function) {
+  if (!function || LLVMCountParams(function) == 0)
+    return NULL;
+  return attribute_type(function, 1, "sret");
+}
+
+unsigned first_source_param(LLVMValueRef function) {
+  return sret_type(function) ? 1 : 0;
+}
+
+LLVMTypeRef byval_type(LLVMValueRef function, unsigned param) {
+  return attribute_type(function, param + 1, "byval");
+}
+
+LLVMTypeRef source_function_type(CodeGenContext *ctx, LLVMValueRef function) {
+  LLVMTypeRef lowered = LLVMGlobalGetValueType(function);
+  unsigned count = LLVMCountParamTypes(lowered);
+  if (count == 0)
+    return lowered;
+
+  LLVMTypeRef return_type = sret_type(function);
+  unsigned sret = return_type ? 1 : 0;
+  bool lowered_params = false;
+
+  LLVMTypeRef *params = arena_alloc(ctx->arena, sizeof(LLVMTypeRef) * count,
+                                    alignof(LLVMTypeRef));
+  LLVMGetParamTypes(lowered, params);
+  for (unsigned i = sret; i < count; i++) {
+    LLVMTypeRef value_type = byval_type(function, i);
+    if (value_type) {
+      params[i] = value_type;
+      lowered_params = true;
+    }
+  }
+  if (!sret && !lowered_params)
+    return lowered;
+
+  return LLVMFunctionType(return_type ? return_type
+                                      : LLVMGetReturnType(lowered),
+                          params + sret, count - sret,
+                          LLVMIsFunctionVarArg(lowered));
+}
+
+// Allocas for call temporaries go in the entry block, so a call in a loop
+// reuses one slot instead of growing the stack
+LLVMValueRef entry_alloca(CodeGenContext *ctx, LLVMTypeRef type,
+                          const char *name) {
+  LLVMBasicBlockRef current = LLVMGetInsertBlock(ctx->builder);
+  LLVMValueRef function = LLVMGetBasicBlockParent(current);
+  LLVMBasicBlockRef entry = LLVMGetEntryBasicBlock(function);
+
+  LLVMBuilderRef builder = LLVMCreateBuilderInContext(ctx->context);
+  LLVMValueRef first = LLVMGetFirstInstruction(entry);
+  if (first)
+    LLVMPositionBuilderBefore(builder, first);
+  else
+    LLVMPositionBuilderAtEnd(builder, entry);
+  LLVMValueRef alloca = LLVMBuildAlloca(builder, type, name);
+  LLVMDisposeBuilder(builder);
+  return alloca;
+}
+
+// True when nothing from after the load up to (not including) end can
+// write memory
+static bool no_writes_between(LLVMValueRef load, LLVMValueRef end) {
+  for (LLVMValueRef inst = LLVMGetNextInstruction(load); inst != end;
+       inst = LLVMGetNextInstruction(inst)) {
+    if (LLVMIsAStoreInst(inst) || LLVMIsACallInst(inst) ||
+        LLVMIsAAtomicRMWInst(inst) || LLVMIsAAtomicCmpXchgInst(inst))
+      return false;
+  }
+  return true;
+}
+
+// The memory a byval argument is copied from. A struct that was just loaded,
+// with nothing written since, is passed from where it lives, which saves the
+// load and a temporary.
+static LLVMValueRef byval_source(CodeGenContext *ctx, LLVMValueRef value) {
+  if (LLVMIsALoadInst(value) && !LLVMGetVolatile(value) &&
+      !LLVMGetFirstUse(value) &&
+      LLVMGetInstructionParent(value) == LLVMGetInsertBlock(ctx->builder) &&
+      no_writes_between(value, NULL)) {
+    LLVMValueRef ptr = LLVMGetOperand(value, 0);
+    LLVMInstructionEraseFromParent(value);
+    return ptr;
+  }
+  LLVMValueRef temp = entry_alloca(ctx, LLVMTypeOf(value), "byval_tmp");
+  LLVMBuildStore(ctx->builder, value, temp);
+  return temp;
+}
+
+LLVMValueRef build_source_call(CodeGenContext *ctx, LLVMTypeRef source_type,
+                               LLVMValueRef callee, LLVMValueRef *args,
+                               unsigned arg_count, const char *name) {
+  LLVMTypeRef lowered = lower_function_type(ctx, source_type);
+  LLVMTypeRef return_type = LLVMGetReturnType(source_type);
+  if (lowered == source_type)
+    return LLVMBuildCall2(ctx->builder, source_type, callee, args, arg_count,
+                          LLVMGetTypeKind(return_type) == LLVMVoidTypeKind
+                              ? ""
+                              : name);
+
+  unsigned sret = passes_in_memory(ctx, return_type) ? 1 : 0;
+  unsigned param_count = LLVMCountParamTypes(source_type);
+  LLVMValueRef *lowered_args =
+      arena_alloc(ctx->arena, sizeof(LLVMValueRef) * (arg_count + 1),
+                  alignof(LLVMValueRef));
+
+  LLVMValueRef result = NULL;
+  if (sret) {
+    result = entry_alloca(ctx, return_type, "sret_tmp");
+    lowered_args[0] = result;
+  }
+
+  LLVMTypeRef *params = arena_alloc(
+      ctx->arena, sizeof(LLVMTypeRef) * (param_count + 1), alignof(LLVMTypeRef));
+  LLVMGetParamTypes(source_type, params);
+  for (unsigned i = 0; i < arg_count; i++) {
+    bool in_memory = i < param_count && passes_in_memory(ctx, params[i]) &&
+                     LLVMTypeOf(args[i]) == params[i];
+    lowered_args[i + sret] = in_memory ? byval_source(ctx, args[i]) : args[i];
+  }
+
+  LLVMValueRef call =
+      LLVMBuildCall2(ctx->builder, lowered, callee, lowered_args,
+                     arg_count + sret, sret ? "" : name);
+  add_abi_attributes(ctx, NULL, call, source_type);
+
+  if (!sret)
+    return call;
+  return LLVMBuildLoad2(ctx->builder, return_type, result, name);
+}
+
+// A load of a large struct whose only use is a store is a copy; emit it as
+// llvm.memcpy, which the backend turns into a few wide moves instead of one
+// move per field.
+static bool is_struct_copy(CodeGenContext *ctx, LLVMValueRef store) {
+  LLVMValueRef value = LLVMGetOperand(store, 0);
+  if (!LLVMIsALoadInst(value) || LLVMGetVolatile(value) ||
+      LLVMGetVolatile(store) ||
+      LLVMGetInstructionParent(value) != LLVMGetInstructionParent(store) ||
+      !passes_in_memory(ctx, LLVMTypeOf(value)))
+    return false;
+
+  LLVMUseRef use = LLVMGetFirstUse(value);
+  if (!use || LLVMGetNextUse(use))
+    return false;
+
+  // Nothing in between may write the source
+  return no_writes_between(value, store);
+}
+
+void lower_struct_copies(CodeGenContext *ctx, LLVMModuleRef module) {
+  LLVMTargetDataRef target_data = get_target_data(ctx);
+  if (!target_data)
+    return;
+
+  LLVMBuilderRef builder = LLVMCreateBuilderInContext(ctx->context);
+  for (LLVMValueRef fn = LLVMGetFirstFunction(module); fn;
+       fn = LLVMGetNextFunction(fn)) {
+    for (LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(fn); block;
+         block = LLVMGetNextBasicBlock(block)) {
+      LLVMValueRef inst = LLVMGetFirstInstruction(block);
+      while (inst) {
+        LLVMValueRef next = LLVMGetNextInstruction(inst);
+        if (LLVMIsAStoreInst(inst) && is_struct_copy(ctx, inst)) {
+          LLVMValueRef load = LLVMGetOperand(inst, 0);
+          LLVMTypeRef type = LLVMTypeOf(load);
+          LLVMPositionBuilderBefore(builder, inst);
+          LLVMBuildMemCpy(
+              builder, LLVMGetOperand(inst, 1), LLVMGetAlignment(inst),
+              LLVMGetOperand(load, 0), LLVMGetAlignment(load),
+              LLVMConstInt(ctx->common_types.i64,
+                           LLVMABISizeOfType(target_data, type), false));
+          LLVMInstructionEraseFromParent(inst);
+          LLVMInstructionEraseFromParent(load);
+        }
+        inst = next;
+      }
+    }
+  }
+  LLVMDisposeBuilder(builder);
+}
@@ -0,0 +1,231 @@
+#include "../llvm.h"
+
+// Function and parameter attributes, and the TBAA tags of struct fields.
+// Everything here only states facts the language guarantees, so LLVM can
+// use them to hoist, vectorize and drop redundant loads.
+
+void add_enum_attribute(CodeGenContext *ctx, LLVMValueRef function,
+                        LLVMAttributeIndex index, const char *name,
+                        uint64_t value) {
+  unsigned kind = LLVMGetEnumAttributeKindForName(name, strlen(name));
+  if (kind == 0)
+    return; // Not known to this LLVM
+  LLVMAddAttributeAtIndex(function, index,
+                          LLVMCreateEnumAttribute(ctx->context, kind, value));
+}
+
+// memory(read), or memory(argmem: read) when only what the pointer
+// arguments point to is read. LLVM 16 folded readnone, readonly and
+// argmemonly into one memory attribute holding two mod/ref bits per
+// location, argument memory first; a read is the ref bit, and bits for
+// locations this LLVM doesn't have are never looked at
+static void add_memory_attribute(CodeGenContext *ctx, LLVMValueRef function,
+                                 bool reads_any) {
+  if (LLVMGetEnumAttributeKindForName("memory", 6) != 0) {
+    add_enum_attribute(ctx, function, LLVMAttributeFunctionIndex, "memory",
+                       reads_any ? 0x55 : 0x1);
+    return;
+  }
+  add_enum_attribute(ctx, function, LLVMAttributeFunctionIndex, "readonly",
+                     0);
+  if (!reads_any)
+    add_enum_attribute(ctx, function, LLVMAttributeFunctionIndex,
+                       "argmemonly", 0);
+}
+
+static void set_optimization_attributes(CodeGenContext *ctx,
+                                        LLVMValueRef function,
+                                        unsigned attributes) {
+  static const struct {
+    unsigned flag;
+    const char *name;
+  } simple[] = {
+      {FN_ATTR_INLINE, "alwaysinline"},
+      {FN_ATTR_NOINLINE, "noinline"},
+      {FN_ATTR_HOT, "hot"},
+      // Branches into a cold function are weighted away from, so error
+      // paths that end in one are laid out after the hot code
+      {FN_ATTR_COLD, "cold"},
+  };
+  for (size_t i = 0; i < sizeof(simple) / sizeof(*simple); i++) {
+    if (attributes & simple[i].flag)
+      add_enum_attribute(ctx, function, LLVMAttributeFunctionIndex,
+                         simple[i].name, 0);
+  }
+
+  // The typechecker has made sure neither writes a global or through a
+  // pointer, nor calls a function that might, and that #const reads only
+  // through its pointer parameters, so calls can be hoisted, merged and
+  // dropped when unused
+  if (attributes & (FN_ATTR_PURE | FN_ATTR_CONST)) {
+    add_memory_attribute(ctx, function, attributes & FN_ATTR_PURE);
+    add_enum_attribute(ctx, function, LLVMAttributeFunctionIndex, "willreturn",
+                       0);
+  }
+}
+
+void flatten_calls(CodeGenContext *ctx, LLVMValueRef function) {
+  // LLVM has no flatten attribute; clang marks every call site in the body
+  // alwaysinline instead, and so does this
+  unsigned kind = LLVMGetEnumAttributeKindForName("alwaysinline", 12);
+  LLVMAttributeRef always_inline =
+      LLVMCreateEnumAttribute(ctx->context, kind, 0);
+
+  for (LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(function); block;
+       block = LLVMGetNextBasicBlock(block)) {
+    for (LLVMValueRef inst = LLVMGetFirstInstruction(block); inst;
+         inst = LLVMGetNextInstruction(inst)) {
+      if (!LLVMIsACallInst(inst))
+        continue;
+      LLVMValueRef callee = LLVMGetCalledValue(inst);
+      // Intrinsics and calls through function pointers stay as they are
+      if (!LLVMIsAFunction(callee) || LLVMGetIntrinsicID(callee) != 0 ||
+          callee == function)
+        continue;
+      LLVMAddCallSiteAttribute(inst, LLVMAttributeFunctionIndex,
+                               always_inline);
+    }
+  }
+}
+
+void set_function_attributes(CodeGenContext *ctx, LLVMValueRef function,
+                             AstNode *func_decl) {
+  // Luma has no exceptions, so nothing unwinds through its functions
+  add_enum_attribute(ctx, function, LLVMAttributeFunctionIndex, "nounwind", 0);
+
+  // #returns_ownership hands the caller a fresh allocation, which nothing
+  // else points into
+  if (func_decl && func_decl->stmt.func_decl.returns_ownership) {
+    LLVMTypeRef return_type =
+        LLVMGetReturnType(LLVMGlobalGetValueType(function));
+    if (LLVMGetTypeKind(return_type) == LLVMPointerTypeKind)
+      add_enum_attribute(ctx, function, LLVMAttributeReturnIndex, "noalias",
+                         0);
+  }
+
+  if (func_decl)
+    set_optimization_attributes(ctx, function,
+                                func_decl->stmt.func_decl.attributes);
+}
+
+void set_self_attributes(CodeGenContext *ctx, LLVMValueRef function,
+                         LLVMTypeRef struct_type) {
+  // self is the first parameter, after an sret pointer if there is one;
+  // methods are only ever called on a struct
+  LLVMAttributeIndex self = first_source_param(function) + 1;
+  add_enum_attribute(ctx, function, self, "noundef", 0);
+  add_enum_attribute(ctx, function, self, "nonnull", 0);
+
+  LLVMTargetDataRef target_data = get_target_data(ctx);
+  if (target_data && LLVMTypeIsSized(struct_type)) {
+    unsigned long long size = LLVMABISizeOfType(target_data, struct_type);
+    if (size > 0)
+      add_enum_attribute(ctx, function, self, "dereferenceable", size);
+  }
+}
+
+bool int_overflow_is_undefined(LLVMTypeRef type) {
+  // int and the C integers; char and byte arithmetic wraps like C's does
+  // after promotion, so it keeps plain add/sub/mul. Vectors go by their lanes
+  type = lane_type(type);
+  return LLVMGetTypeKind(type) == LLVMIntegerTypeKind &&
+         LLVMGetIntTypeWidth(type) >= 32;
+}
+
+// Scalar TBAA: every field access is tagged with the type it loads or
+// stores, so an int field is known not to alias a pointer or double field.
+// Bytes and aggregates are left untagged, as are accesses through plain
+// pointers, so they still alias everything.
+static LLVMMetadataRef tbaa_node(CodeGenContext *ctx, const char *name,
+                                 LLVMMetadataRef parent) {
+  LLVMMetadataRef ops[3] = {
+      LLVMMDStringInContext2(ctx->context, name, strlen(name)), parent,
+      LLVMValueAsMetadata(ctx->common_types.const_i64_0)};
+  return LLVMMDNodeInContext2(ctx->context, ops, parent ? 3 : 1);
+}
+
+static LLVMMetadataRef tbaa_access_tag(CodeGenContext *ctx,
+                                       LLVMMetadataRef type_node) {
+  LLVMMetadataRef ops[3] = {
+      type_node, type_node,
+      LLVMValueAsMetadata(ctx->common_types.const_i64_0)};
+  return LLVMMDNodeInContext2(ctx->context, ops, 3);
+}
+
+static LLVMMetadataRef tbaa_tag_for(CodeGenContext *ctx, LLVMTypeRef type) {
+  TBAATags *tbaa = &ctx->tbaa;
+  LLVMMetadataRef *slot;
+  const char *name;
+  switch (LLVMGetTypeKind(type)) {
+  case LLVMIntegerTypeKind:
+    switch (LLVMGetIntTypeWidth(type)) {
+    case 16:
+      slot = &tbaa->i16;
+      name = "i16";
+      break;
+    case 32:
+      slot = &tbaa->i32;
+      name = "i32";
+      break;
+    case 64:
+      slot = &tbaa->i64;
+      name = "int";
+      break;
+    default:
+      return NULL;
+    }
+    break;
+  case LLVMFloatTypeKind:
+    slot = &tbaa->f32;
+    name = "float";
+    break;
+  case LLVMDoubleTypeKind:
+    slot = &tbaa->f64;
+    name = "double";
+    break;
+  case LLVMPointerTypeKind:
+    slot = &tbaa->pointer;
+    name = "any pointer";
+    break;
+  default:
+    return NULL;
+  }
+
+  if (!*slot) {
+    if (!tbaa->root) {
+      tbaa->root = tbaa_node(ctx, "Luma TBAA", NULL);
+      tbaa->omnipotent_char = tbaa_node(ctx, "omnipotent char", tbaa->root);
+      tbaa->kind = LLVMGetMDKindIDInContext(ctx->context, "tbaa", 4);
+    }
+    *slot = tbaa_access_tag(ctx, tbaa_node(ctx, name, tbaa->omnipotent_char));
+  }
+  return *slot;
+}
+
+void tag_field_access(CodeGenContext *ctx, LLVMValueRef access,
+                      LLVMTypeRef field_type) {
+  if (!access || !LLVMIsAInstruction(access))
+    return;
+  LLVMMetadataRef tag = tbaa_tag_for(ctx, field_type);
+  if (tag)
+    LLVMSetMetadata(access, ctx->tbaa.kind,
+                    LLVMMetadataAsValue(ctx->context, tag));
+}
+
+// Imported declarations carry the definition's attributes, so callers in
+// other modules can rely on them too
+void copy_function_attributes(LLVMValueRef to, LLVMValueRef from) {
+  // Function, return value, then each parameter
+  unsigned index_count = LLVMCountParams(from) + 2;
+  for (unsigned i = 0; i < index_count; i++) {
+    LLVMAttributeIndex at =
+        i == 0 ? (LLVMAttributeIndex)LLVMAttributeFunctionIndex : i - 1;
+    unsigned count = LLVMGetAttributeCountAtIndex(from, at);
+    LLVMAttributeRef attributes[32];
+    if (count == 0 || count > 32)
+      continue;
+    LLVMGetAttributesAtIndex(from, at, attributes);
+    for (unsigned i = 0; i < count; i++)
+      LLVMAddAttributeAtIndex(to, at, attributes[i]);
+  }
+}
@@ -14,7 +14,9 @@ LLVMValueRef struct_gep_load(CodeGenContext *ctx, LLVMTypeRef struct_type,
                              LLVMTypeRef element_type, const char *name) {
   LLVMValueRef gep =
       LLVMBuildStructGEP2(ctx->builder, struct_type, ptr, index, "tmp_gep");
-  return LLVMBuildLoad2(ctx->builder, element_type, gep, name);
+  LLVMValueRef load = LLVMBuildLoad2(ctx->builder, element_type, gep, name);
+  tag_field_access(ctx, load, element_type);
+  return load;
 }
 
 // GEP + Store pattern for structs
@@ -22,7 +24,8 @@ void struct_gep_store(CodeGenContext *ctx, LLVMTypeRef struct_type,
                       LLVMValueRef ptr, unsigned index, LLVMValueRef value) {
   LLVMValueRef gep =
       LLVMBuildStructGEP2(ctx->builder, struct_type, ptr, index, "tmp_gep");
-  LLVMBuildStore(ctx->builder, value, gep);
+  LLVMValueRef store = LLVMBuildStore(ctx->builder, value, gep);
+  tag_field_access(ctx, store, LLVMTypeOf(value));
 }
 
 // Array GEP helper
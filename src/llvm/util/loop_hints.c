@@ -0,0 +1,127 @@
+#include "../llvm.h"
+
+// #unroll, #vectorize, #no_vectorize and #independent become llvm.loop
+// metadata on every branch back to the loop's header. #independent also
+// puts the memory accesses of the body in an access group the loop lists as
+// parallel, which tells the vectorizer no iteration depends on another's
+// memory, so it needs no runtime alias checks.
+
+static bool has_loop_hints(AstNode *loop) {
+  return loop->stmt.loop_stmt.unroll || loop->stmt.loop_stmt.vectorize ||
+         loop->stmt.loop_stmt.no_vectorize || loop->stmt.loop_stmt.independent;
+}
+
+static LLVMMetadataRef loop_property(CodeGenContext *ctx, const char *name,
+                                     LLVMMetadataRef value) {
+  LLVMMetadataRef ops[2] = {
+      LLVMMDStringInContext2(ctx->context, name, strlen(name)), value};
+  return LLVMMDNodeInContext2(ctx->context, ops, value ? 2 : 1);
+}
+
+static LLVMMetadataRef constant_property(CodeGenContext *ctx,
+                                         const char *name, LLVMTypeRef type,
+                                         unsigned long long value) {
+  return loop_property(ctx, name,
+                       LLVMValueAsMetadata(LLVMConstInt(type, value, false)));
+}
+
+static bool accesses_memory(LLVMValueRef inst) {
+  if (LLVMIsADbgInfoIntrinsic(inst))
+    return false;
+  return LLVMIsALoadInst(inst) || LLVMIsAStoreInst(inst) ||
+         LLVMIsACallInst(inst) || LLVMIsAAtomicRMWInst(inst) ||
+         LLVMIsAAtomicCmpXchgInst(inst);
+}
+
+// An access inside nested #independent loops belongs to each of their groups
+static void add_to_access_group(CodeGenContext *ctx, LLVMValueRef inst,
+                                unsigned kind, LLVMMetadataRef group) {
+  LLVMValueRef existing = LLVMGetMetadata(inst, kind);
+  if (!existing) {
+    LLVMSetMetadata(inst, kind, LLVMMetadataAsValue(ctx->context, group));
+    return;
+  }
+
+  LLVMMetadataRef groups[16];
+  size_t count = 0;
+  unsigned existing_count = LLVMGetMDNodeNumOperands(existing);
+  if (existing_count == 0) {
+    groups[count++] = LLVMValueAsMetadata(existing);
+  } else {
+    LLVMValueRef operands[15];
+    if (existing_count > 15)
+      return;
+    LLVMGetMDNodeOperands(existing, operands);
+    for (unsigned i = 0; i < existing_count; i++)
+      groups[count++] = LLVMValueAsMetadata(operands[i]);
+  }
+  groups[count++] = group;
+  LLVMSetMetadata(inst, kind,
+                  LLVMMetadataAsValue(
+                      ctx->context,
+                      LLVMMDNodeInContext2(ctx->context, groups, count)));
+}
+
+void apply_loop_hints(CodeGenContext *ctx, AstNode *loop,
+                      LLVMBasicBlockRef header, LLVMValueRef entry_branch) {
+  if (!loop || !has_loop_hints(loop))
+    return;
+
+  LLVMMetadataRef properties[4];
+  size_t count = 0;
+
+  if (loop->stmt.loop_stmt.unroll) {
+    size_t unroll_count = loop->stmt.loop_stmt.unroll_count;
+    if (unroll_count == 1)
+      properties[count++] =
+          loop_property(ctx, "llvm.loop.unroll.disable", NULL);
+    else if (unroll_count > 1)
+      properties[count++] =
+          constant_property(ctx, "llvm.loop.unroll.count",
+                            ctx->common_types.i32, unroll_count);
+    else
+      properties[count++] = loop_property(ctx, "llvm.loop.unroll.enable", NULL);
+  }
+
+  if (loop->stmt.loop_stmt.vectorize || loop->stmt.loop_stmt.no_vectorize) {
+    properties[count++] =
+        constant_property(ctx, "llvm.loop.vectorize.enable",
+                          ctx->common_types.i1, loop->stmt.loop_stmt.vectorize);
+    if (loop->stmt.loop_stmt.vectorize_width)
+      properties[count++] = constant_property(
+          ctx, "llvm.loop.vectorize.width", ctx->common_types.i32,
+          loop->stmt.loop_stmt.vectorize_width);
+  }
+
+  if (loop->stmt.loop_stmt.independent) {
+    LLVMMetadataRef group = create_access_group(ctx->context);
+    properties[count++] =
+        loop_property(ctx, "llvm.loop.parallel_accesses", group);
+
+    // The body's blocks are the header and everything appended after it
+    // while the loop was generated
+    unsigned kind =
+        LLVMGetMDKindIDInContext(ctx->context, "llvm.access.group", 17);
+    for (LLVMBasicBlockRef block = header; block;
+         block = LLVMGetNextBasicBlock(block)) {
+      for (LLVMValueRef inst = LLVMGetFirstInstruction(block); inst;
+           inst = LLVMGetNextInstruction(inst)) {
+        if (accesses_memory(inst))
+          add_to_access_group(ctx, inst, kind, group);
+      }
+    }
+  }
+
+  LLVMValueRef loop_id = LLVMMetadataAsValue(
+      ctx->context, create_loop_id(ctx->context, properties, count));
+
+  // Every branch to the header, other than the one entering the loop, is a
+  // latch; LLVM only trusts the ID when all latches carry it
+  unsigned loop_kind = LLVMGetMDKindIDInContext(ctx->context, "llvm.loop", 9);
+  for (LLVMUseRef use = LLVMGetFirstUse(LLVMBasicBlockAsValue(header)); use;
+       use = LLVMGetNextUse(use)) {
+    LLVMValueRef user = LLVMGetUser(use);
+    if (user != entry_branch && LLVMIsATerminatorInst(user))
+      LLVMSetMetadata(user, loop_kind, loop_id);
+  }
+}
@@ -0,0 +1,28 @@
+// loop_metadata.cpp - Distinct metadata nodes for loop hints
+//
+// A loop ID and an access group have to be distinct nodes, or two loops
+// with the same hints would share one. The C API only creates uniqued
+// nodes, so this small shim makes them.
+#include "llvm-c/Core.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Metadata.h"
+
+extern "C" LLVMMetadataRef create_access_group(LLVMContextRef context) {
+  return llvm::wrap(llvm::MDNode::getDistinct(*llvm::unwrap(context), {}));
+}
+
+// The first operand of a loop ID is the node itself
+extern "C" LLVMMetadataRef create_loop_id(LLVMContextRef context,
+                                          LLVMMetadataRef *properties,
+                                          size_t count) {
+  llvm::SmallVector<llvm::Metadata *, 8> operands;
+  operands.push_back(nullptr);
+  for (size_t i = 0; i < count; i++)
+    operands.push_back(llvm::unwrap(properties[i]));
+
+  llvm::MDNode *loop_id =
+      llvm::MDNode::getDistinct(*llvm::unwrap(context), operands);
+  loop_id->replaceOperandWith(0, loop_id);
+  return llvm::wrap(loop_id);
+}
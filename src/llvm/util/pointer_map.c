@@ -0,0 +1,75 @@
+#include "../llvm.h"
+#include <stdlib.h>
+
+#define POINTER_MAP_INITIAL_CAPACITY 64
+
+// Keys are atoms or LLVM handles, so their low bits are mostly alignment
+static size_t pointer_hash(const void *key) {
+  uint64_t hash = (uint64_t)(uintptr_t)key;
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  return (size_t)hash;
+}
+
+// Finds the slot holding @p key, or the empty slot where it belongs
+static size_t find_slot(const void **keys, size_t capacity, const void *key) {
+  size_t mask = capacity - 1;
+  size_t i = pointer_hash(key) & mask;
+  while (keys[i] && keys[i] != key) {
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+void *pointer_map_get(const PointerMap *map, const void *key) {
+  if (!key || map->count == 0) {
+    return NULL;
+  }
+  size_t slot = find_slot(map->keys, map->capacity, key);
+  return map->keys[slot] ? map->values[slot] : NULL;
+}
+
+static void grow(PointerMap *map) {
+  size_t capacity =
+      map->capacity ? map->capacity * 2 : POINTER_MAP_INITIAL_CAPACITY;
+  const void **keys = xcalloc(capacity, sizeof(*keys));
+  void **values = xcalloc(capacity, sizeof(*values));
+
+  for (size_t i = 0; i < map->capacity; i++) {
+    if (map->keys[i]) {
+      size_t slot = find_slot(keys, capacity, map->keys[i]);
+      keys[slot] = map->keys[i];
+      values[slot] = map->values[i];
+    }
+  }
+
+  free(map->keys);
+  free(map->values);
+  map->keys = keys;
+  map->values = values;
+  map->capacity = capacity;
+}
+
+void pointer_map_put(PointerMap *map, const void *key, void *value) {
+  if (!key) {
+    return;
+  }
+  // Keep the load factor at or below one half
+  if ((map->count + 1) * 2 > map->capacity) {
+    grow(map);
+  }
+
+  size_t slot = find_slot(map->keys, map->capacity, key);
+  if (!map->keys[slot]) {
+    map->keys[slot] = key;
+    map->count++;
+  }
+  map->values[slot] = value;
+}
+
+void pointer_map_free(PointerMap *map) {
+  free(map->keys);
+  free(map->values);
+  *map = (PointerMap){0};
+}
@@ -0,0 +1,423 @@
+#include "../llvm.h"
+
+// output and outputln format every value into a buffer on the stack and
+// hand the whole line to printf once, instead of making one printf call,
+// with its format parsing and stdout lock, per value. Integers and strings
+// are formatted by small routines emitted into each module that prints;
+// only floats go through snprintf. stdout itself still does the buffering,
+// so output keeps its order with everything else written through stdio
+// and is flushed on a newline to a terminal, when full, and at exit.
+
+#define PRINT_BUFFER_SIZE 256
+
+// Longest int: the sign and 19 digits
+#define PRINT_INT_DIGITS 20
+
+// Room snprintf gets before the buffer is flushed to make more
+#define PRINT_FLOAT_ROOM 32
+
+typedef struct PrintRuntime {
+  CodeGenContext *ctx;
+  LLVMModuleRef module;
+  LLVMBuilderRef builder;
+  LLVMTypeRef byte, byte_ptr, i32, i64;
+  LLVMValueRef size; // PRINT_BUFFER_SIZE as an i64
+} PrintRuntime;
+
+static LLVMValueRef libc_function(LLVMModuleRef module, const char *name,
+                                  LLVMTypeRef type) {
+  LLVMValueRef function = LLVMGetNamedFunction(module, name);
+  return function ? function : LLVMAddFunction(module, name, type);
+}
+
+static LLVMValueRef call_printf(PrintRuntime *rt, LLVMValueRef *args,
+                                unsigned arg_count) {
+  LLVMTypeRef type = LLVMFunctionType(rt->i32, &rt->byte_ptr, 1, true);
+  LLVMValueRef printf_func = libc_function(rt->module, "printf", type);
+  return LLVMBuildCall2(rt->builder, LLVMGlobalGetValueType(printf_func),
+                        printf_func, args, arg_count, "");
+}
+
+static LLVMValueRef runtime_string(PrintRuntime *rt, const char *text,
+                                   const char *name) {
+  return LLVMBuildGlobalStringPtr(rt->builder, text, name);
+}
+
+static LLVMValueRef define_runtime(PrintRuntime *rt, const char *name,
+                                   LLVMTypeRef *params, unsigned param_count) {
+  LLVMValueRef function = LLVMAddFunction(
+      rt->module, name, LLVMFunctionType(rt->i64, params, param_count, false));
+  LLVMSetLinkage(function, LLVMInternalLinkage);
+  add_enum_attribute(rt->ctx, function, LLVMAttributeFunctionIndex,
+                     "nounwind", 0);
+  LLVMPositionBuilderAtEnd(
+      rt->builder,
+      LLVMAppendBasicBlockInContext(rt->ctx->context, function, "entry"));
+  return function;
+}
+
+static LLVMBasicBlockRef runtime_block(PrintRuntime *rt, LLVMValueRef function,
+                                       const char *name) {
+  return LLVMAppendBasicBlockInContext(rt->ctx->context, function, name);
+}
+
+static LLVMValueRef byte_at(PrintRuntime *rt, LLVMValueRef base,
+                            LLVMValueRef index) {
+  return LLVMBuildInBoundsGEP2(rt->builder, rt->byte, base, &index, 1, "at");
+}
+
+// i64 flush(buf, len): writes out the len bytes buffered, returns 0
+static LLVMValueRef define_flush(PrintRuntime *rt) {
+  LLVMTypeRef params[] = {rt->byte_ptr, rt->i64};
+  LLVMValueRef function = define_runtime(rt, "__luma_print_flush", params, 2);
+  LLVMValueRef buffer = LLVMGetParam(function, 0);
+  LLVMValueRef length = LLVMGetParam(function, 1);
+
+  LLVMBasicBlockRef write = runtime_block(rt, function, "write");
+  LLVMBasicBlockRef done = runtime_block(rt, function, "done");
+  LLVMValueRef empty = LLVMBuildICmp(rt->builder, LLVMIntEQ, length,
+                                     LLVMConstInt(rt->i64, 0, false), "empty");
+  LLVMBuildCondBr(rt->builder, empty, done, write);
+
+  LLVMPositionBuilderAtEnd(rt->builder, write);
+  LLVMValueRef args[] = {
+      runtime_string(rt, "%.*s", "print_flush_fmt"),
+      LLVMBuildTrunc(rt->builder, length, rt->i32, "length"), buffer};
+  call_printf(rt, args, 3);
+  LLVMBuildBr(rt->builder, done);
+
+  LLVMPositionBuilderAtEnd(rt->builder, done);
+  LLVMBuildRet(rt->builder, LLVMConstInt(rt->i64, 0, false));
+  return function;
+}
+
+static LLVMValueRef call_flush(PrintRuntime *rt, LLVMValueRef flush,
+                               LLVMValueRef buffer, LLVMValueRef length) {
+  LLVMValueRef args[] = {buffer, length};
+  return LLVMBuildCall2(rt->builder, LLVMGlobalGetValueType(flush), flush,
+                        args, 2, "flushed");
+}
+
+// Flushes first when fewer than room bytes are left; returns the length to
+// append at
+static LLVMValueRef make_room(PrintRuntime *rt, LLVMValueRef function,
+                              LLVMValueRef flush, LLVMValueRef buffer,
+                              LLVMValueRef length, unsigned room) {
+  LLVMBasicBlockRef entry = LLVMGetInsertBlock(rt->builder);
+  LLVMBasicBlockRef flush_block = runtime_block(rt, function, "flush");
+  LLVMBasicBlockRef append = runtime_block(rt, function, "append");
+
+  LLVMValueRef needed = LLVMBuildAdd(
+      rt->builder, length, LLVMConstInt(rt->i64, room, false), "needed");
+  LLVMValueRef full =
+      LLVMBuildICmp(rt->builder, LLVMIntUGT, needed, rt->size, "full");
+  LLVMBuildCondBr(rt->builder, full, flush_block, append);
+
+  LLVMPositionBuilderAtEnd(rt->builder, flush_block);
+  LLVMValueRef flushed = call_flush(rt, flush, buffer, length);
+  LLVMBuildBr(rt->builder, append);
+
+  LLVMPositionBuilderAtEnd(rt->builder, append);
+  LLVMValueRef at = LLVMBuildPhi(rt->builder, rt->i64, "length");
+  LLVMValueRef incoming[] = {length, flushed};
+  LLVMBasicBlockRef from[] = {entry, flush_block};
+  LLVMAddIncoming(at, incoming, from, 2);
+  return at;
+}
+
+// i64 str(buf, len, s): copies s up to its NUL, flushing whenever the
+// buffer fills up, so strings of any length go through
+static void define_string(PrintRuntime *rt, LLVMValueRef flush) {
+  LLVMTypeRef params[] = {rt->byte_ptr, rt->i64, rt->byte_ptr};
+  LLVMValueRef function = define_runtime(rt, "__luma_print_str", params, 3);
+  LLVMValueRef buffer = LLVMGetParam(function, 0);
+  LLVMValueRef length = LLVMGetParam(function, 1);
+  LLVMValueRef string = LLVMGetParam(function, 2);
+  LLVMBasicBlockRef entry = LLVMGetInsertBlock(rt->builder);
+
+  // printf prints a null string as (null)
+  LLVMValueRef is_null = LLVMBuildIsNull(rt->builder, string, "is_null");
+  string = LLVMBuildSelect(rt->builder, is_null,
+                           runtime_string(rt, "(null)", "print_null"), string,
+                           "string");
+
+  LLVMBasicBlockRef loop = runtime_block(rt, function, "loop");
+  LLVMBasicBlockRef check = runtime_block(rt, function, "check");
+  LLVMBasicBlockRef flush_block = runtime_block(rt, function, "flush");
+  LLVMBasicBlockRef store = runtime_block(rt, function, "store");
+  LLVMBasicBlockRef done = runtime_block(rt, function, "done");
+  LLVMBuildBr(rt->builder, loop);
+
+  LLVMPositionBuilderAtEnd(rt->builder, loop);
+  LLVMValueRef current = LLVMBuildPhi(rt->builder, rt->i64, "length");
+  LLVMValueRef cursor = LLVMBuildPhi(rt->builder, rt->byte_ptr, "cursor");
+  LLVMValueRef c = LLVMBuildLoad2(rt->builder, rt->byte, cursor, "c");
+  LLVMValueRef end = LLVMBuildICmp(rt->builder, LLVMIntEQ, c,
+                                   LLVMConstInt(rt->byte, 0, false), "end");
+  LLVMBuildCondBr(rt->builder, end, done, check);
+
+  LLVMPositionBuilderAtEnd(rt->builder, check);
+  LLVMValueRef full =
+      LLVMBuildICmp(rt->builder, LLVMIntEQ, current, rt->size, "full");
+  LLVMBuildCondBr(rt->builder, full, flush_block, store);
+
+  LLVMPositionBuilderAtEnd(rt->builder, flush_block);
+  LLVMValueRef flushed = call_flush(rt, flush, buffer, current);
+  LLVMBuildBr(rt->builder, store);
+
+  LLVMPositionBuilderAtEnd(rt->builder, store);
+  LLVMValueRef at = LLVMBuildPhi(rt->builder, rt->i64, "at");
+  LLVMValueRef at_values[] = {current, flushed};
+  LLVMBasicBlockRef at_from[] = {check, flush_block};
+  LLVMAddIncoming(at, at_values, at_from, 2);
+  LLVMBuildStore(rt->builder, c, byte_at(rt, buffer, at));
+  LLVMValueRef next_length = LLVMBuildAdd(
+      rt->builder, at, LLVMConstInt(rt->i64, 1, false), "next_length");
+  LLVMValueRef next_cursor =
+      byte_at(rt, cursor, LLVMConstInt(rt->i64, 1, false));
+  LLVMBuildBr(rt->builder, loop);
+
+  LLVMValueRef length_values[] = {length, next_length};
+  LLVMValueRef cursor_values[] = {string, next_cursor};
+  LLVMBasicBlockRef loop_from[] = {entry, store};
+  LLVMAddIncoming(current, length_values, loop_from, 2);
+  LLVMAddIncoming(cursor, cursor_values, loop_from, 2);
+
+  LLVMPositionBuilderAtEnd(rt->builder, done);
+  LLVMBuildRet(rt->builder, current);
+}
+
+// i64 int(buf, len, v): the digits of v, written backwards into a scratch
+// buffer and copied over in one go
+static void define_int(PrintRuntime *rt, LLVMValueRef flush) {
+  LLVMTypeRef params[] = {rt->byte_ptr, rt->i64, rt->i64};
+  LLVMValueRef function = define_runtime(rt, "__luma_print_int", params, 3);
+  LLVMValueRef buffer = LLVMGetParam(function, 0);
+  LLVMValueRef length = LLVMGetParam(function, 1);
+  LLVMValueRef value = LLVMGetParam(function, 2);
+
+  LLVMTypeRef scratch_type = LLVMArrayType(rt->byte, PRINT_INT_DIGITS);
+  LLVMValueRef scratch = LLVMBuildAlloca(rt->builder, scratch_type, "digits");
+  LLVMValueRef zero = LLVMConstInt(rt->i64, 0, false);
+  LLVMValueRef first[] = {zero, zero};
+  LLVMValueRef digits = LLVMBuildInBoundsGEP2(rt->builder, scratch_type,
+                                              scratch, first, 2, "digits");
+
+  LLVMValueRef at =
+      make_room(rt, function, flush, buffer, length, PRINT_INT_DIGITS);
+  LLVMBasicBlockRef setup = LLVMGetInsertBlock(rt->builder);
+  LLVMValueRef negative =
+      LLVMBuildICmp(rt->builder, LLVMIntSLT, value, zero, "negative");
+  // The magnitude as unsigned, which INT_MIN has too
+  LLVMValueRef magnitude = LLVMBuildSelect(
+      rt->builder, negative, LLVMBuildNeg(rt->builder, value, "negated"),
+      value, "magnitude");
+
+  LLVMBasicBlockRef loop = runtime_block(rt, function, "digit");
+  LLVMBasicBlockRef done = runtime_block(rt, function, "copy");
+  LLVMBuildBr(rt->builder, loop);
+
+  LLVMPositionBuilderAtEnd(rt->builder, loop);
+  LLVMValueRef index = LLVMBuildPhi(rt->builder, rt->i64, "index");
+  LLVMValueRef rest = LLVMBuildPhi(rt->builder, rt->i64, "rest");
+  LLVMValueRef ten = LLVMConstInt(rt->i64, 10, false);
+  LLVMValueRef quotient = LLVMBuildUDiv(rt->builder, rest, ten, "quotient");
+  LLVMValueRef digit = LLVMBuildSub(
+      rt->builder, rest, LLVMBuildMul(rt->builder, quotient, ten, "tens"),
+      "digit");
+  LLVMValueRef next_index = LLVMBuildSub(
+      rt->builder, index, LLVMConstInt(rt->i64, 1, false), "next_index");
+  LLVMBuildStore(
+      rt->builder,
+      LLVMBuildAdd(rt->builder,
+                   LLVMBuildTrunc(rt->builder, digit, rt->byte, "digit"),
+                   LLVMConstInt(rt->byte, '0', false), "char"),
+      byte_at(rt, digits, next_index));
+  LLVMValueRef more =
+      LLVMBuildICmp(rt->builder, LLVMIntNE, quotient, zero, "more");
+  LLVMBuildCondBr(rt->builder, more, loop, done);
+
+  LLVMValueRef index_values[] = {
+      LLVMConstInt(rt->i64, PRINT_INT_DIGITS, false), next_index};
+  LLVMValueRef rest_values[] = {magnitude, quotient};
+  LLVMBasicBlockRef loop_from[] = {setup, loop};
+  LLVMAddIncoming(index, index_values, loop_from, 2);
+  LLVMAddIncoming(rest, rest_values, loop_from, 2);
+
+  // 19 digits at most, so there's always room left for the sign
+  LLVMPositionBuilderAtEnd(rt->builder, done);
+  LLVMValueRef sign_index = LLVMBuildSub(
+      rt->builder, next_index, LLVMConstInt(rt->i64, 1, false), "sign_index");
+  LLVMBuildStore(rt->builder, LLVMConstInt(rt->byte, '-', false),
+                 byte_at(rt, digits, sign_index));
+  LLVMValueRef start = LLVMBuildSelect(rt->builder, negative, sign_index,
+                                       next_index, "start");
+  LLVMValueRef count = LLVMBuildSub(
+      rt->builder, LLVMConstInt(rt->i64, PRINT_INT_DIGITS, false), start,
+      "count");
+  LLVMBuildMemCpy(rt->builder, byte_at(rt, buffer, at), 1,
+                  byte_at(rt, digits, start), 1, count);
+  LLVMBuildRet(rt->builder, LLVMBuildAdd(rt->builder, at, count, "length"));
+}
+
+// i64 float(buf, len, fmt, v): snprintf into the buffer, or straight to
+// printf for the rare value too long to fit
+static void define_float(PrintRuntime *rt, LLVMValueRef flush) {
+  LLVMTypeRef double_type = LLVMDoubleTypeInContext(rt->ctx->context);
+  LLVMTypeRef params[] = {rt->byte_ptr, rt->i64, rt->byte_ptr, double_type};
+  LLVMValueRef function = define_runtime(rt, "__luma_print_float", params, 4);
+  LLVMValueRef buffer = LLVMGetParam(function, 0);
+  LLVMValueRef length = LLVMGetParam(function, 1);
+  LLVMValueRef format = LLVMGetParam(function, 2);
+  LLVMValueRef value = LLVMGetParam(function, 3);
+
+  LLVMValueRef at =
+      make_room(rt, function, flush, buffer, length, PRINT_FLOAT_ROOM);
+  LLVMValueRef space = LLVMBuildSub(rt->builder, rt->size, at, "space");
+
+  LLVMTypeRef snprintf_params[] = {rt->byte_ptr, rt->i64, rt->byte_ptr};
+  LLVMValueRef snprintf_func = libc_function(
+      rt->module, "snprintf",
+      LLVMFunctionType(rt->i32, snprintf_params, 3, true));
+  LLVMValueRef snprintf_args[] = {byte_at(rt, buffer, at), space, format,
+                                  value};
+  LLVMValueRef written = LLVMBuildSExt(
+      rt->builder,
+      LLVMBuildCall2(rt->builder, LLVMGlobalGetValueType(snprintf_func),
+                     snprintf_func, snprintf_args, 4, "written"),
+      rt->i64, "written");
+
+  // A negative count, an error, compares as too long too
+  LLVMBasicBlockRef fits_block = runtime_block(rt, function, "fits");
+  LLVMBasicBlockRef direct = runtime_block(rt, function, "direct");
+  LLVMValueRef fits =
+      LLVMBuildICmp(rt->builder, LLVMIntULT, written, space, "fits");
+  LLVMBuildCondBr(rt->builder, fits, fits_block, direct);
+
+  LLVMPositionBuilderAtEnd(rt->builder, fits_block);
+  LLVMBuildRet(rt->builder, LLVMBuildAdd(rt->builder, at, written, "length"));
+
+  LLVMPositionBuilderAtEnd(rt->builder, direct);
+  call_flush(rt, flush, buffer, at);
+  LLVMValueRef printf_args[] = {format, value};
+  call_printf(rt, printf_args, 2);
+  LLVMBuildRet(rt->builder, LLVMConstInt(rt->i64, 0, false));
+}
+
+// The named print routine of the current module, emitting all of them the
+// first time one is asked for
+static LLVMValueRef print_routine(CodeGenContext *ctx, const char *name) {
+  LLVMModuleRef module =
+      ctx->current_module ? ctx->current_module->module : ctx->module;
+  LLVMValueRef routine = LLVMGetNamedFunction(module, name);
+  if (routine)
+    return routine;
+
+  PrintRuntime rt = {
+      .ctx = ctx,
+      .module = module,
+      .builder = LLVMCreateBuilderInContext(ctx->context),
+      .byte = LLVMInt8TypeInContext(ctx->context),
+      .i32 = ctx->common_types.i32,
+      .i64 = ctx->common_types.i64,
+  };
+  rt.byte_ptr = LLVMPointerType(rt.byte, 0);
+  rt.size = LLVMConstInt(rt.i64, PRINT_BUFFER_SIZE, false);
+
+  LLVMValueRef flush = define_flush(&rt);
+  define_string(&rt, flush);
+  define_int(&rt, flush);
+  define_float(&rt, flush);
+  LLVMDisposeBuilder(rt.builder);
+
+  return LLVMGetNamedFunction(module, name);
+}
+
+static LLVMValueRef call_routine(CodeGenContext *ctx, const char *name,
+                                 LLVMValueRef *args, unsigned arg_count) {
+  LLVMValueRef routine = print_routine(ctx, name);
+  return LLVMBuildCall2(ctx->builder, LLVMGlobalGetValueType(routine),
+                        routine, args, arg_count, "print_length");
+}
+
+LLVMValueRef print_buffer(CodeGenContext *ctx) {
+  // One buffer per function, shared by all its print statements
+  LLVMValueRef function =
+      LLVMGetBasicBlockParent(LLVMGetInsertBlock(ctx->builder));
+  if (ctx->print_buffer_function != function) {
+    ctx->print_buffer = entry_alloca(
+        ctx, LLVMArrayType(LLVMInt8TypeInContext(ctx->context),
+                           PRINT_BUFFER_SIZE),
+        "print_buffer");
+    ctx->print_buffer_function = function;
+  }
+  return LLVMBuildPointerCast(
+      ctx->builder, ctx->print_buffer,
+      LLVMPointerType(LLVMInt8TypeInContext(ctx->context), 0),
+      "print_buffer");
+}
+
+LLVMValueRef print_string(CodeGenContext *ctx, LLVMValueRef buffer,
+                          LLVMValueRef length, LLVMValueRef string) {
+  LLVMValueRef args[] = {buffer, length, string};
+  return call_routine(ctx, "__luma_print_str", args, 3);
+}
+
+LLVMValueRef print_value(CodeGenContext *ctx, LLVMValueRef buffer,
+                         LLVMValueRef length, LLVMValueRef value) {
+  LLVMTypeRef type = LLVMTypeOf(value);
+  LLVMTypeRef double_type = LLVMDoubleTypeInContext(ctx->context);
+
+  switch (LLVMGetTypeKind(type)) {
+  case LLVMIntegerTypeKind: {
+    if (LLVMGetIntTypeWidth(type) == 1) {
+      LLVMValueRef text = LLVMBuildSelect(
+          ctx->builder, value,
+          LLVMBuildGlobalStringPtr(ctx->builder, "true", "true_str"),
+          LLVMBuildGlobalStringPtr(ctx->builder, "false", "false_str"),
+          "bool_str");
+      return print_string(ctx, buffer, length, text);
+    }
+    LLVMValueRef args[] = {
+        buffer, length,
+        LLVMBuildSExtOrBitCast(ctx->builder, value, ctx->common_types.i64,
+                               "print_int")};
+    return call_routine(ctx, "__luma_print_int", args, 3);
+  }
+
+  case LLVMFloatTypeKind:
+  case LLVMDoubleTypeKind: {
+    LLVMValueRef args[] = {
+        buffer, length,
+        LLVMBuildGlobalStringPtr(ctx->builder, "%.6f", "float_fmt"),
+        LLVMBuildFPCast(ctx->builder, value, double_type, "print_float")};
+    return call_routine(ctx, "__luma_print_float", args, 4);
+  }
+
+  case LLVMPointerTypeKind:
+    return print_string(ctx, buffer, length, value); // Assume a string
+
+  default: {
+    // Anything else is printed as printf sees it, after what's buffered
+    print_flush(ctx, buffer, length);
+    LLVMModuleRef module =
+        ctx->current_module ? ctx->current_module->module : ctx->module;
+    LLVMTypeRef byte_ptr =
+        LLVMPointerType(LLVMInt8TypeInContext(ctx->context), 0);
+    LLVMValueRef printf_func = libc_function(
+        module, "printf",
+        LLVMFunctionType(ctx->common_types.i32, &byte_ptr, 1, true));
+    LLVMValueRef args[] = {
+        LLVMBuildGlobalStringPtr(ctx->builder, "%p", "fmt"), value};
+    LLVMBuildCall2(ctx->builder, LLVMGlobalGetValueType(printf_func),
+                   printf_func, args, 2, "");
+    return ctx->common_types.const_i64_0;
+  }
+  }
+}
+
+void print_flush(CodeGenContext *ctx, LLVMValueRef buffer,
+                 LLVMValueRef length) {
+  LLVMValueRef args[] = {buffer, length};
+  call_routine(ctx, "__luma_print_flush", args, 2);
+}
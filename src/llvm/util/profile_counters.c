@@ -0,0 +1,520 @@
+#include "../llvm.h"
+#include <string.h>
+
+// -fprofile-counters: every function counts its calls and the cycles spent
+// in it (callees included), and every loop counts its iterations, so a slow
+// program can be asked where its time goes without an external profiler.
+//
+// Each function or loop is a site with its own pair of counters. A module
+// lists its sites in a table that a constructor links onto a list shared by
+// all modules, and a destructor writes the list out as JSON once main has
+// returned or exit was called: to $LUMA_PROFILE, or luma-profile.json in the
+// working directory. Outside Windows, SIGUSR1 writes it out too, so a
+// long-running program can be looked at while it runs. The file is written
+// with stdio from the handler, which isn't async-signal-safe; it's a
+// diagnostic, not something to do in a loop.
+//
+// The list, the routine writing it out and the guard keeping it to one
+// write are emitted into every instrumented module with linkonce_odr
+// linkage, and the linker keeps one of each.
+
+#define PROFILE_DEFAULT_PATH "luma-profile.json"
+
+typedef struct ProfileSite {
+  const char *kind;       // "function" or "loop"
+  const char *function;   // JSON-escaped
+  const char *file;       // JSON-escaped
+  size_t line;
+  LLVMValueRef counters;  // {count, cycles}, in the module it was made in
+  LLVMValueRef start;     // Functions: the cycle count read on entry
+  struct ProfileSite *next;
+} ProfileSite;
+
+static LLVMModuleRef current_llvm_module(CodeGenContext *ctx) {
+  return ctx->current_module ? ctx->current_module->module : ctx->module;
+}
+
+static LLVMTypeRef counters_type(CodeGenContext *ctx) {
+  LLVMTypeRef fields[] = {ctx->common_types.i64, ctx->common_types.i64};
+  return LLVMStructTypeInContext(ctx->context, fields, 2, false);
+}
+
+static const char *json_escape(CodeGenContext *ctx, const char *text) {
+  if (!text)
+    return "";
+  size_t length = 0;
+  for (const char *c = text; *c; c++)
+    length += (*c == '"' || *c == '\\') ? 2 : 1;
+
+  char *escaped = arena_alloc(ctx->arena, length + 1, 1);
+  size_t at = 0;
+  for (const char *c = text; *c; c++) {
+    if (*c == '"' || *c == '\\')
+      escaped[at++] = '\\';
+    escaped[at++] = *c;
+  }
+  escaped[at] = '\0';
+  return escaped;
+}
+
+static ProfileSite *new_site(CodeGenContext *ctx, const char *kind,
+                             const char *function, size_t line) {
+  const char *file =
+      ctx->current_module_ast
+          ? ctx->current_module_ast->preprocessor.module.file_path
+          : NULL;
+
+  LLVMTypeRef type = counters_type(ctx);
+  LLVMValueRef counters =
+      LLVMAddGlobal(current_llvm_module(ctx), type, "__luma_prof.counters");
+  LLVMSetLinkage(counters, LLVMInternalLinkage);
+  LLVMSetInitializer(counters, LLVMConstNull(type));
+
+  ProfileSite *site =
+      arena_alloc(ctx->arena, sizeof(ProfileSite), alignof(ProfileSite));
+  *site = (ProfileSite){kind, json_escape(ctx, function),
+                        json_escape(ctx, file), line, counters, NULL,
+                        ctx->profile_sites};
+  ctx->profile_sites = site;
+  return site;
+}
+
+static LLVMValueRef counter_at(CodeGenContext *ctx, ProfileSite *site,
+                               unsigned field) {
+  return LLVMBuildStructGEP2(ctx->builder, counters_type(ctx), site->counters,
+                             field, field ? "prof_cycles" : "prof_count");
+}
+
+static LLVMValueRef read_cycle_counter(CodeGenContext *ctx) {
+  unsigned id = LLVMLookupIntrinsicID("llvm.readcyclecounter", 21);
+  LLVMValueRef intrinsic =
+      LLVMGetIntrinsicDeclaration(current_llvm_module(ctx), id, NULL, 0);
+  return LLVMBuildCall2(ctx->builder,
+                        LLVMIntrinsicGetType(ctx->context, id, NULL, 0),
+                        intrinsic, NULL, 0, "prof_cycles");
+}
+
+// Calls can come from any thread, and the add is small next to reading the
+// cycle counter
+static void atomic_add(CodeGenContext *ctx, LLVMValueRef counter,
+                       LLVMValueRef value) {
+  LLVMBuildAtomicRMW(ctx->builder, LLVMAtomicRMWBinOpAdd, counter, value,
+                     LLVMAtomicOrderingMonotonic, false);
+}
+
+// #pure and #const functions are declared memory(read) or memory(none), so
+// LLVM may merge or drop their calls; a counter written inside one would be
+// undefined behavior, and wrong anyway. They, and their loops, go uncounted.
+static bool writes_no_memory(LLVMValueRef function) {
+  static const char *const names[] = {"memory", "readnone", "readonly"};
+  for (size_t i = 0; i < sizeof(names) / sizeof(*names); i++) {
+    unsigned kind = LLVMGetEnumAttributeKindForName(names[i], strlen(names[i]));
+    if (kind && LLVMGetEnumAttributeAtIndex(function,
+                                            LLVMAttributeFunctionIndex, kind))
+      return true;
+  }
+  return false;
+}
+
+ProfileSite *profile_function_entry(CodeGenContext *ctx, AstNode *func_decl) {
+  if (!ctx->profile_counters || !ctx->current_function ||
+      writes_no_memory(ctx->current_function))
+    return NULL;
+
+  ProfileSite *site = new_site(ctx, "function", func_decl->stmt.func_decl.name,
+                               func_decl->line);
+  atomic_add(ctx, counter_at(ctx, site, 0),
+             LLVMConstInt(ctx->common_types.i64, 1, false));
+  site->start = read_cycle_counter(ctx);
+  return site;
+}
+
+void profile_function_exits(CodeGenContext *ctx, LLVMValueRef function,
+                            ProfileSite *site) {
+  if (!site)
+    return;
+
+  LLVMBasicBlockRef saved = LLVMGetInsertBlock(ctx->builder);
+  for (LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(function); block;
+       block = LLVMGetNextBasicBlock(block)) {
+    LLVMValueRef terminator = LLVMGetBasicBlockTerminator(block);
+    if (!terminator || LLVMGetInstructionOpcode(terminator) != LLVMRet)
+      continue;
+
+    // A musttail call must come right before its ret
+    LLVMValueRef previous = LLVMGetPreviousInstruction(terminator);
+    bool musttail = previous && LLVMIsACallInst(previous) &&
+                    LLVMGetTailCallKind(previous) == LLVMTailCallKindMustTail;
+    LLVMPositionBuilderBefore(ctx->builder,
+                              musttail ? previous : terminator);
+    LLVMValueRef spent = LLVMBuildSub(ctx->builder, read_cycle_counter(ctx),
+                                      site->start, "prof_spent");
+    atomic_add(ctx, counter_at(ctx, site, 1), spent);
+  }
+  if (saved)
+    LLVMPositionBuilderAtEnd(ctx->builder, saved);
+}
+
+void profile_loop_iteration(CodeGenContext *ctx, AstNode *loop) {
+  if (!ctx->profile_counters || !ctx->current_function ||
+      writes_no_memory(ctx->current_function))
+    return;
+
+  // A plain add: the optimizer can keep it in a register for the whole
+  // loop. Iterations racing on other threads may be lost.
+  size_t name_length = 0;
+  const char *function =
+      LLVMGetValueName2(ctx->current_function, &name_length);
+  ProfileSite *site = new_site(ctx, "loop", function, loop->line);
+  LLVMValueRef counter = counter_at(ctx, site, 0);
+  LLVMValueRef count =
+      LLVMBuildLoad2(ctx->builder, ctx->common_types.i64, counter, "prof_iter");
+  LLVMBuildStore(ctx->builder,
+                 LLVMBuildAdd(ctx->builder, count,
+                              LLVMConstInt(ctx->common_types.i64, 1, false),
+                              "prof_iter"),
+                 counter);
+}
+
+// =============================================================================
+// THE SHARED RUNTIME
+// =============================================================================
+
+typedef struct {
+  CodeGenContext *ctx;
+  LLVMModuleRef module;
+  LLVMBuilderRef builder;
+  LLVMTypeRef ptr, i8, i32, i64;
+  LLVMTypeRef record; // {kind, function, file, line, counters}
+  LLVMTypeRef node;   // {next, count, records}: one module's table
+} ProfileRuntime;
+
+static LLVMValueRef runtime_libc(ProfileRuntime *rt, const char *name,
+                                 LLVMTypeRef return_type, LLVMTypeRef *params,
+                                 unsigned param_count, bool variadic) {
+  LLVMValueRef function = LLVMGetNamedFunction(rt->module, name);
+  if (!function)
+    function = LLVMAddFunction(
+        rt->module, name,
+        LLVMFunctionType(return_type, params, param_count, variadic));
+  return function;
+}
+
+static LLVMValueRef runtime_call(ProfileRuntime *rt, LLVMValueRef function,
+                                 LLVMValueRef *args, unsigned arg_count,
+                                 const char *name) {
+  return LLVMBuildCall2(rt->builder, LLVMGlobalGetValueType(function),
+                        function, args, arg_count, name);
+}
+
+static LLVMValueRef shared_global(ProfileRuntime *rt, const char *name,
+                                  LLVMTypeRef type) {
+  LLVMValueRef global = LLVMGetNamedGlobal(rt->module, name);
+  if (global)
+    return global;
+  global = LLVMAddGlobal(rt->module, type, name);
+  LLVMSetLinkage(global, LLVMLinkOnceODRLinkage);
+  LLVMSetInitializer(global, LLVMConstNull(type));
+  return global;
+}
+
+static LLVMValueRef define_shared(ProfileRuntime *rt, const char *name,
+                                  LLVMTypeRef type) {
+  LLVMValueRef function = LLVMAddFunction(rt->module, name, type);
+  LLVMSetLinkage(function, LLVMLinkOnceODRLinkage);
+  add_enum_attribute(rt->ctx, function, LLVMAttributeFunctionIndex,
+                     "nounwind", 0);
+  add_enum_attribute(rt->ctx, function, LLVMAttributeFunctionIndex, "cold", 0);
+  LLVMPositionBuilderAtEnd(rt->builder,
+                           LLVMAppendBasicBlockInContext(rt->ctx->context,
+                                                         function, "entry"));
+  return function;
+}
+
+static LLVMBasicBlockRef runtime_block(ProfileRuntime *rt,
+                                       LLVMValueRef function,
+                                       const char *name) {
+  return LLVMAppendBasicBlockInContext(rt->ctx->context, function, name);
+}
+
+static LLVMValueRef field_of(ProfileRuntime *rt, LLVMTypeRef type,
+                             LLVMValueRef base, unsigned field,
+                             LLVMTypeRef field_type, const char *name) {
+  return LLVMBuildLoad2(
+      rt->builder, field_type,
+      LLVMBuildStructGEP2(rt->builder, type, base, field, name), name);
+}
+
+// void __luma_prof_dump(i32 signal): writes every registered site out
+static LLVMValueRef define_dump(ProfileRuntime *rt, LLVMValueRef head) {
+  LLVMValueRef function = LLVMGetNamedFunction(rt->module, "__luma_prof_dump");
+  if (function)
+    return function;
+
+  function = define_shared(rt, "__luma_prof_dump",
+                           LLVMFunctionType(LLVMVoidTypeInContext(
+                                                rt->ctx->context),
+                                            &rt->i32, 1, false));
+  LLVMValueRef getenv_func =
+      runtime_libc(rt, "getenv", rt->ptr, &rt->ptr, 1, false);
+  LLVMTypeRef two_ptrs[] = {rt->ptr, rt->ptr};
+  LLVMValueRef fopen_func =
+      runtime_libc(rt, "fopen", rt->ptr, two_ptrs, 2, false);
+  LLVMValueRef fprintf_func =
+      runtime_libc(rt, "fprintf", rt->i32, two_ptrs, 2, true);
+  LLVMValueRef fclose_func =
+      runtime_libc(rt, "fclose", rt->i32, &rt->ptr, 1, false);
+
+  LLVMBasicBlockRef open = runtime_block(rt, function, "open");
+  LLVMBasicBlockRef node_cond = runtime_block(rt, function, "node_cond");
+  LLVMBasicBlockRef site_cond = runtime_block(rt, function, "site_cond");
+  LLVMBasicBlockRef site_body = runtime_block(rt, function, "site_body");
+  LLVMBasicBlockRef node_next = runtime_block(rt, function, "node_next");
+  LLVMBasicBlockRef finish = runtime_block(rt, function, "finish");
+  LLVMBasicBlockRef done = runtime_block(rt, function, "done");
+
+  LLVMValueRef node_slot = LLVMBuildAlloca(rt->builder, rt->ptr, "node");
+  LLVMValueRef index_slot = LLVMBuildAlloca(rt->builder, rt->i64, "index");
+  LLVMValueRef separator_slot =
+      LLVMBuildAlloca(rt->builder, rt->ptr, "separator");
+
+  LLVMValueRef env_name = LLVMBuildGlobalStringPtr(rt->builder, "LUMA_PROFILE",
+                                                   "prof_env");
+  LLVMValueRef path = runtime_call(rt, getenv_func, &env_name, 1, "path");
+  path = LLVMBuildSelect(
+      rt->builder, LLVMBuildIsNull(rt->builder, path, "unset"),
+      LLVMBuildGlobalStringPtr(rt->builder, PROFILE_DEFAULT_PATH,
+                               "prof_default_path"),
+      path, "path");
+  LLVMValueRef open_args[] = {
+      path, LLVMBuildGlobalStringPtr(rt->builder, "w", "prof_mode")};
+  LLVMValueRef file = runtime_call(rt, fopen_func, open_args, 2, "file");
+  LLVMBuildCondBr(rt->builder, LLVMBuildIsNull(rt->builder, file, "failed"),
+                  done, open);
+
+  LLVMPositionBuilderAtEnd(rt->builder, open);
+  LLVMValueRef header_args[] = {
+      file, LLVMBuildGlobalStringPtr(rt->builder, "{\"sites\": [",
+                                     "prof_header")};
+  runtime_call(rt, fprintf_func, header_args, 2, "");
+  LLVMBuildStore(rt->builder, LLVMBuildLoad2(rt->builder, rt->ptr, head, "head"),
+                 node_slot);
+  LLVMBuildStore(rt->builder, LLVMBuildGlobalStringPtr(rt->builder, "", "none"),
+                 separator_slot);
+  LLVMBuildBr(rt->builder, node_cond);
+
+  // Every module's table in turn
+  LLVMPositionBuilderAtEnd(rt->builder, node_cond);
+  LLVMValueRef node = LLVMBuildLoad2(rt->builder, rt->ptr, node_slot, "node");
+  LLVMBuildStore(rt->builder, LLVMConstInt(rt->i64, 0, false), index_slot);
+  LLVMBuildCondBr(rt->builder, LLVMBuildIsNull(rt->builder, node, "last"),
+                  finish, site_cond);
+
+  LLVMPositionBuilderAtEnd(rt->builder, site_cond);
+  LLVMValueRef count = field_of(rt, rt->node, node, 1, rt->i64, "count");
+  LLVMValueRef index = LLVMBuildLoad2(rt->builder, rt->i64, index_slot, "i");
+  LLVMBuildCondBr(rt->builder,
+                  LLVMBuildICmp(rt->builder, LLVMIntULT, index, count, "more"),
+                  site_body, node_next);
+
+  LLVMPositionBuilderAtEnd(rt->builder, site_body);
+  LLVMValueRef records = field_of(rt, rt->node, node, 2, rt->ptr, "records");
+  LLVMValueRef record = LLVMBuildInBoundsGEP2(rt->builder, rt->record, records,
+                                              &index, 1, "record");
+  LLVMValueRef counters =
+      field_of(rt, rt->record, record, 4, rt->ptr, "counters");
+  LLVMTypeRef pair = counters_type(rt->ctx);
+  LLVMValueRef site_args[] = {
+      file,
+      LLVMBuildGlobalStringPtr(
+          rt->builder,
+          "%s\n  {\"kind\": \"%s\", \"function\": \"%s\", \"file\": \"%s\", "
+          "\"line\": %llu, \"count\": %llu, \"cycles\": %llu}",
+          "prof_site"),
+      LLVMBuildLoad2(rt->builder, rt->ptr, separator_slot, "separator"),
+      field_of(rt, rt->record, record, 0, rt->ptr, "kind"),
+      field_of(rt, rt->record, record, 1, rt->ptr, "function"),
+      field_of(rt, rt->record, record, 2, rt->ptr, "file"),
+      field_of(rt, rt->record, record, 3, rt->i64, "line"),
+      field_of(rt, pair, counters, 0, rt->i64, "count"),
+      field_of(rt, pair, counters, 1, rt->i64, "cycles")};
+  runtime_call(rt, fprintf_func, site_args, 9, "");
+  LLVMBuildStore(rt->builder, LLVMBuildGlobalStringPtr(rt->builder, ",", "comma"),
+                 separator_slot);
+  LLVMBuildStore(rt->builder,
+                 LLVMBuildAdd(rt->builder, index,
+                              LLVMConstInt(rt->i64, 1, false), "next"),
+                 index_slot);
+  LLVMBuildBr(rt->builder, site_cond);
+
+  LLVMPositionBuilderAtEnd(rt->builder, node_next);
+  LLVMBuildStore(rt->builder, field_of(rt, rt->node, node, 0, rt->ptr, "next"),
+                 node_slot);
+  LLVMBuildBr(rt->builder, node_cond);
+
+  LLVMPositionBuilderAtEnd(rt->builder, finish);
+  LLVMValueRef footer_args[] = {
+      file, LLVMBuildGlobalStringPtr(rt->builder, "\n]}\n", "prof_footer")};
+  runtime_call(rt, fprintf_func, footer_args, 2, "");
+  runtime_call(rt, fclose_func, &file, 1, "");
+  LLVMBuildBr(rt->builder, done);
+
+  LLVMPositionBuilderAtEnd(rt->builder, done);
+  LLVMBuildRetVoid(rt->builder);
+  return function;
+}
+
+// void __luma_prof_exit(): the destructor of every instrumented module,
+// writing the sites out the first time one runs
+static LLVMValueRef define_exit(ProfileRuntime *rt, LLVMValueRef dump) {
+  LLVMValueRef function = LLVMGetNamedFunction(rt->module, "__luma_prof_exit");
+  if (function)
+    return function;
+
+  LLVMValueRef written = shared_global(rt, "__luma_prof_written", rt->i8);
+  function = define_shared(
+      rt, "__luma_prof_exit",
+      LLVMFunctionType(LLVMVoidTypeInContext(rt->ctx->context), NULL, 0,
+                       false));
+  LLVMBasicBlockRef write = runtime_block(rt, function, "write");
+  LLVMBasicBlockRef done = runtime_block(rt, function, "done");
+
+  LLVMValueRef already = LLVMBuildLoad2(rt->builder, rt->i8, written, "written");
+  LLVMBuildCondBr(rt->builder,
+                  LLVMBuildICmp(rt->builder, LLVMIntNE, already,
+                                LLVMConstInt(rt->i8, 0, false), "already"),
+                  done, write);
+
+  LLVMPositionBuilderAtEnd(rt->builder, write);
+  LLVMBuildStore(rt->builder, LLVMConstInt(rt->i8, 1, false), written);
+  LLVMValueRef no_signal = LLVMConstInt(rt->i32, 0, false);
+  runtime_call(rt, dump, &no_signal, 1, "");
+  LLVMBuildBr(rt->builder, done);
+
+  LLVMPositionBuilderAtEnd(rt->builder, done);
+  LLVMBuildRetVoid(rt->builder);
+  return function;
+}
+
+// SIGUSR1 of the target, or 0 where there is none
+static unsigned target_sigusr1(const char *target_os) {
+  if (!target_os || strncmp(target_os, "windows", 7) == 0)
+    return 0;
+  if (strcmp(target_os, "macos") == 0 || strcmp(target_os, "ios") == 0 ||
+      strcmp(target_os, "apple") == 0 || strstr(target_os, "bsd") ||
+      strcmp(target_os, "dragonfly") == 0)
+    return 30;
+  return 10;
+}
+
+static void append_structor(ProfileRuntime *rt, const char *array_name,
+                            LLVMValueRef function) {
+  LLVMTypeRef fields[] = {rt->i32, rt->ptr, rt->ptr};
+  LLVMTypeRef entry_type =
+      LLVMStructTypeInContext(rt->ctx->context, fields, 3, false);
+  LLVMValueRef values[] = {LLVMConstInt(rt->i32, 65535, false), function,
+                           LLVMConstNull(rt->ptr)};
+  LLVMValueRef entry = LLVMConstNamedStruct(entry_type, values, 3);
+
+  LLVMValueRef array = LLVMAddGlobal(
+      rt->module, LLVMArrayType(entry_type, 1), array_name);
+  LLVMSetLinkage(array, LLVMAppendingLinkage);
+  LLVMSetInitializer(array, LLVMConstArray(entry_type, &entry, 1));
+}
+
+void emit_profile_table(CodeGenContext *ctx, ModuleCompilationUnit *unit) {
+  if (!ctx->profile_counters)
+    return;
+
+  // Sites made in this module, oldest first; any others stay for theirs
+  size_t count = 0;
+  ProfileSite **link = &ctx->profile_sites;
+  ProfileSite *sites = NULL;
+  while (*link) {
+    ProfileSite *site = *link;
+    if (LLVMGetGlobalParent(site->counters) != unit->module) {
+      link = &site->next;
+      continue;
+    }
+    *link = site->next;
+    site->next = sites;
+    sites = site;
+    count++;
+  }
+  if (count == 0)
+    return;
+
+  ProfileRuntime rt = {
+      .ctx = ctx,
+      .module = unit->module,
+      .builder = LLVMCreateBuilderInContext(ctx->context),
+      .i8 = LLVMInt8TypeInContext(ctx->context),
+      .i32 = ctx->common_types.i32,
+      .i64 = ctx->common_types.i64,
+  };
+  rt.ptr = LLVMPointerType(rt.i8, 0);
+  LLVMTypeRef record_fields[] = {rt.ptr, rt.ptr, rt.ptr, rt.i64, rt.ptr};
+  rt.record = LLVMStructTypeInContext(ctx->context, record_fields, 5, false);
+  LLVMTypeRef node_fields[] = {rt.ptr, rt.i64, rt.ptr};
+  rt.node = LLVMStructTypeInContext(ctx->context, node_fields, 3, false);
+
+  // The constructor puts this module's table at the front of the list. It's
+  // made first: the site strings are built from inside it.
+  LLVMValueRef constructor = LLVMAddFunction(
+      unit->module, "__luma_prof.register",
+      LLVMFunctionType(LLVMVoidTypeInContext(ctx->context), NULL, 0, false));
+  LLVMSetLinkage(constructor, LLVMInternalLinkage);
+  LLVMBasicBlockRef constructor_entry =
+      LLVMAppendBasicBlockInContext(ctx->context, constructor, "entry");
+  LLVMPositionBuilderAtEnd(rt.builder, constructor_entry);
+
+  LLVMValueRef *records =
+      arena_alloc(ctx->arena, count * sizeof(LLVMValueRef),
+                  alignof(LLVMValueRef));
+  size_t i = 0;
+  for (ProfileSite *site = sites; site; site = site->next) {
+    LLVMValueRef fields[] = {
+        LLVMBuildGlobalStringPtr(rt.builder, site->kind, "prof_kind"),
+        LLVMBuildGlobalStringPtr(rt.builder, site->function, "prof_name"),
+        LLVMBuildGlobalStringPtr(rt.builder, site->file, "prof_file"),
+        LLVMConstInt(rt.i64, site->line, false), site->counters};
+    records[i++] = LLVMConstNamedStruct(rt.record, fields, 5);
+  }
+  LLVMValueRef table = LLVMAddGlobal(
+      unit->module, LLVMArrayType(rt.record, (unsigned)count),
+      "__luma_prof.records");
+  LLVMSetLinkage(table, LLVMInternalLinkage);
+  LLVMSetGlobalConstant(table, true);
+  LLVMSetInitializer(table,
+                     LLVMConstArray(rt.record, records, (unsigned)count));
+
+  LLVMValueRef node_values[] = {LLVMConstNull(rt.ptr),
+                                LLVMConstInt(rt.i64, count, false), table};
+  LLVMValueRef node = LLVMAddGlobal(unit->module, rt.node, "__luma_prof.node");
+  LLVMSetLinkage(node, LLVMInternalLinkage);
+  LLVMSetInitializer(node, LLVMConstNamedStruct(rt.node, node_values, 3));
+
+  LLVMValueRef head = shared_global(&rt, "__luma_prof_head", rt.ptr);
+  LLVMValueRef dump = define_dump(&rt, head);
+  LLVMValueRef exit_function = define_exit(&rt, dump);
+
+  LLVMPositionBuilderAtEnd(rt.builder, constructor_entry);
+  LLVMBuildStore(rt.builder,
+                 LLVMBuildLoad2(rt.builder, rt.ptr, head, "head"),
+                 LLVMBuildStructGEP2(rt.builder, rt.node, node, 0, "next"));
+  LLVMBuildStore(rt.builder, node, head);
+
+  unsigned sigusr1 = target_sigusr1(ctx->target_os);
+  if (sigusr1) {
+    LLVMTypeRef signal_params[] = {rt.i32, rt.ptr};
+    LLVMValueRef signal_func =
+        runtime_libc(&rt, "signal", rt.ptr, signal_params, 2, false);
+    LLVMValueRef signal_args[] = {LLVMConstInt(rt.i32, sigusr1, false), dump};
+    runtime_call(&rt, signal_func, signal_args, 2, "");
+  }
+  LLVMBuildRetVoid(rt.builder);
+
+  append_structor(&rt, "llvm.global_ctors", constructor);
+  append_structor(&rt, "llvm.global_dtors", exit_function);
+  LLVMDisposeBuilder(rt.builder);
+}
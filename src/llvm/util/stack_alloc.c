@@ -0,0 +1,387 @@
+#include "../llvm.h"
+
+// Escape analysis for alloc(). A pointer bound by `let p = alloc(n)` (or by
+// a cast of it) that the function only indexes, dereferences, reads through
+// with `.`, compares with == or != and frees cannot outlive the function:
+// it is never returned, stored, aliased, passed to a call or reassigned.
+// Such an alloc is marked no_escape and its frees point back at it, so
+// codegen can give it a stack slot when the size is a small constant and
+// drop the frees. A name declared more than once in the function, or a
+// body holding a node this pass does not know, leaves every alloc on the
+// heap.
+
+#define MAX_CANDIDATES 32
+
+typedef struct {
+  const char *name;
+  AstNode *decl;
+  AstNode *alloc;
+  int free_count;
+  bool escapes;
+} Candidate;
+
+typedef struct {
+  Candidate candidates[MAX_CANDIDATES];
+  size_t count;
+  bool marking; // Second walk: point frees at surviving candidates
+  bool unknown; // Hit a node kind the walk does not cover
+} StackScan;
+
+static AstNode *alloc_initializer(AstNode *init) {
+  while (init) {
+    if (init->type == AST_EXPR_CAST)
+      init = init->expr.cast.castee;
+    else if (init->type == AST_EXPR_GROUPING)
+      init = init->expr.grouping.expr;
+    else
+      break;
+  }
+  return init && init->type == AST_EXPR_ALLOC ? init : NULL;
+}
+
+static Candidate *find_candidate(StackScan *scan, const char *name) {
+  if (!name)
+    return NULL;
+  for (size_t i = 0; i < scan->count; i++) {
+    if (strcmp(scan->candidates[i].name, name) == 0)
+      return &scan->candidates[i];
+  }
+  return NULL;
+}
+
+static void escape(StackScan *scan, const char *name) {
+  Candidate *candidate = find_candidate(scan, name);
+  if (candidate)
+    candidate->escapes = true;
+}
+
+// A candidate name in a position that uses the memory, not the pointer
+static bool is_candidate_name(StackScan *scan, AstNode *node) {
+  return node && node->type == AST_EXPR_IDENTIFIER &&
+         find_candidate(scan, node->expr.identifier.name);
+}
+
+static void collect(StackScan *scan, AstNode *node);
+static void scan_node(StackScan *scan, AstNode *node);
+
+static void collect_list(StackScan *scan, AstNode **nodes, size_t count) {
+  for (size_t i = 0; i < count; i++)
+    collect(scan, nodes[i]);
+}
+
+// First walk: every `let p = alloc(...)` becomes a candidate
+static void collect(StackScan *scan, AstNode *node) {
+  if (!node || node->category != Node_Category_STMT) {
+    if (node && node->type == AST_PREPROCESSOR_OS) {
+      collect_list(scan, node->preprocessor.os.bodies,
+                   node->preprocessor.os.arm_count);
+      collect(scan, node->preprocessor.os.default_body);
+    }
+    return;
+  }
+
+  switch (node->type) {
+  case AST_STMT_VAR_DECL: {
+    AstNode *alloc = alloc_initializer(node->stmt.var_decl.initializer);
+    if (alloc)
+      alloc->expr.alloc.no_escape = false;
+    if (alloc && scan->count < MAX_CANDIDATES &&
+        !find_candidate(scan, node->stmt.var_decl.name))
+      scan->candidates[scan->count++] =
+          (Candidate){node->stmt.var_decl.name, node, alloc, 0, false};
+    break;
+  }
+  case AST_STMT_BLOCK:
+    collect_list(scan, node->stmt.block.statements,
+                 node->stmt.block.stmt_count);
+    break;
+  case AST_STMT_IF:
+    collect(scan, node->stmt.if_stmt.then_stmt);
+    // An elif arm is an if node whose elif_count is its index, with no list
+    if (node->stmt.if_stmt.elif_stmts)
+      collect_list(scan, node->stmt.if_stmt.elif_stmts,
+                   node->stmt.if_stmt.elif_count);
+    collect(scan, node->stmt.if_stmt.else_stmt);
+    break;
+  case AST_STMT_LOOP:
+    collect_list(scan, node->stmt.loop_stmt.initializer,
+                 node->stmt.loop_stmt.init_count);
+    collect(scan, node->stmt.loop_stmt.body);
+    break;
+  case AST_STMT_DEFER:
+    collect(scan, node->stmt.defer_stmt.statement);
+    break;
+  case AST_STMT_SWITCH:
+    collect_list(scan, node->stmt.switch_stmt.cases,
+                 node->stmt.switch_stmt.case_count);
+    collect(scan, node->stmt.switch_stmt.default_case);
+    break;
+  case AST_STMT_CASE:
+    collect(scan, node->stmt.case_clause.body);
+    break;
+  case AST_STMT_DEFAULT:
+    collect(scan, node->stmt.default_clause.body);
+    break;
+  default:
+    break;
+  }
+}
+
+static void scan_list(StackScan *scan, AstNode **nodes, size_t count) {
+  for (size_t i = 0; i < count; i++)
+    scan_node(scan, nodes[i]);
+}
+
+// The memory behind a candidate, as in p[i] or p.field, rather than the
+// pointer itself
+static void scan_object(StackScan *scan, AstNode *object) {
+  if (!is_candidate_name(scan, object))
+    scan_node(scan, object);
+}
+
+// &p[i], &p.field and &*p point into a candidate's memory, and that pointer
+// can go anywhere, so they count as the candidate itself escaping
+static void scan_address(StackScan *scan, AstNode *object) {
+  AstNode *base = object;
+  while (base) {
+    if (base->type == AST_EXPR_GROUPING)
+      base = base->expr.grouping.expr;
+    else if (base->type == AST_EXPR_INDEX)
+      base = base->expr.index.object;
+    else if (base->type == AST_EXPR_MEMBER)
+      base = base->expr.member.object;
+    else if (base->type == AST_EXPR_DEREF)
+      base = base->expr.deref.object;
+    else
+      break;
+  }
+  if (base != object && is_candidate_name(scan, base))
+    escape(scan, base->expr.identifier.name);
+  scan_node(scan, object);
+}
+
+// Second walk: every way a candidate is used, and on the marking pass
+// every free of one that survived
+static void scan_node(StackScan *scan, AstNode *node) {
+  if (!node)
+    return;
+
+  switch (node->type) {
+  case AST_EXPR_LITERAL:
+  case AST_EXPR_SIZEOF:
+  case AST_STMT_BREAK_CONTINUE:
+    break;
+  case AST_EXPR_IDENTIFIER:
+    escape(scan, node->expr.identifier.name);
+    break;
+
+  // Uses of the memory
+  case AST_EXPR_INDEX:
+    scan_object(scan, node->expr.index.object);
+    scan_node(scan, node->expr.index.index);
+    break;
+  case AST_EXPR_DEREF:
+    scan_object(scan, node->expr.deref.object);
+    break;
+  case AST_EXPR_MEMBER:
+    scan_object(scan, node->expr.member.object);
+    break;
+  case AST_EXPR_BINARY:
+    if (node->expr.binary.op == BINOP_EQ || node->expr.binary.op == BINOP_NE) {
+      scan_object(scan, node->expr.binary.left);
+      scan_object(scan, node->expr.binary.right);
+    } else {
+      scan_node(scan, node->expr.binary.left);
+      scan_node(scan, node->expr.binary.right);
+    }
+    break;
+  case AST_EXPR_FREE: {
+    AstNode *ptr = node->expr.free.ptr;
+    if (!scan->marking) {
+      node->expr.free.stack_alloc = NULL;
+      Candidate *candidate =
+          ptr && ptr->type == AST_EXPR_IDENTIFIER
+              ? find_candidate(scan, ptr->expr.identifier.name)
+              : NULL;
+      if (candidate)
+        candidate->free_count++;
+      else
+        scan_node(scan, ptr);
+    } else if (ptr && ptr->type == AST_EXPR_IDENTIFIER) {
+      Candidate *candidate = find_candidate(scan, ptr->expr.identifier.name);
+      if (candidate && !candidate->escapes)
+        node->expr.free.stack_alloc = candidate->alloc;
+    }
+    break;
+  }
+
+  // Uses of the pointer itself
+  case AST_EXPR_CALL: {
+    // A method call passes its object as self
+    AstNode *callee = node->expr.call.callee;
+    if (callee && callee->type == AST_EXPR_MEMBER &&
+        is_candidate_name(scan, callee->expr.member.object))
+      escape(scan, callee->expr.member.object->expr.identifier.name);
+    else
+      scan_node(scan, callee);
+    scan_list(scan, node->expr.call.args, node->expr.call.arg_count);
+    break;
+  }
+  case AST_EXPR_ASSIGNMENT:
+    if (node->expr.assignment.target &&
+        node->expr.assignment.target->type == AST_EXPR_IDENTIFIER)
+      escape(scan, node->expr.assignment.target->expr.identifier.name);
+    else
+      scan_node(scan, node->expr.assignment.target);
+    scan_node(scan, node->expr.assignment.value);
+    break;
+  case AST_EXPR_UNARY:
+    scan_node(scan, node->expr.unary.operand);
+    break;
+  case AST_EXPR_TERNARY:
+    scan_node(scan, node->expr.ternary.condition);
+    scan_node(scan, node->expr.ternary.then_expr);
+    scan_node(scan, node->expr.ternary.else_expr);
+    break;
+  case AST_EXPR_GROUPING:
+    scan_node(scan, node->expr.grouping.expr);
+    break;
+  case AST_EXPR_ARRAY:
+    scan_list(scan, node->expr.array.elements, node->expr.array.element_count);
+    break;
+  case AST_EXPR_ADDR:
+    scan_address(scan, node->expr.addr.object);
+    break;
+  case AST_EXPR_ALLOC:
+    scan_node(scan, node->expr.alloc.size);
+    break;
+  case AST_EXPR_MEMCPY:
+    scan_node(scan, node->expr.memcpy.to);
+    scan_node(scan, node->expr.memcpy.from);
+    scan_node(scan, node->expr.memcpy.size);
+    break;
+  case AST_EXPR_CAST:
+    scan_node(scan, node->expr.cast.castee);
+    break;
+  case AST_EXPR_INPUT:
+    scan_node(scan, node->expr.input.msg);
+    break;
+  case AST_EXPR_SYSTEM:
+    scan_node(scan, node->expr._system.command);
+    break;
+  case AST_EXPR_SYSCALL:
+    scan_list(scan, node->expr.syscall.args, node->expr.syscall.count);
+    break;
+  case AST_EXPR_STRUCT:
+    scan_list(scan, node->expr.struct_expr.field_value,
+              node->expr.struct_expr.field_count);
+    break;
+  case AST_EXPR_SPREAD:
+    scan_node(scan, node->expr.spread.expr);
+    break;
+  case AST_EXPR_BUILTIN:
+    scan_list(scan, node->expr.builtin.args, node->expr.builtin.arg_count);
+    break;
+
+  // Statements
+  case AST_STMT_EXPRESSION:
+    scan_node(scan, node->stmt.expr_stmt.expression);
+    break;
+  case AST_STMT_VAR_DECL: {
+    Candidate *candidate = find_candidate(scan, node->stmt.var_decl.name);
+    if (candidate && candidate->decl != node)
+      candidate->escapes = true; // Shadowed or redeclared
+    if (candidate && candidate->decl == node)
+      scan_node(scan, candidate->alloc->expr.alloc.size);
+    else
+      scan_node(scan, node->stmt.var_decl.initializer);
+    break;
+  }
+  case AST_STMT_IF:
+    scan_node(scan, node->stmt.if_stmt.condition);
+    scan_node(scan, node->stmt.if_stmt.then_stmt);
+    if (node->stmt.if_stmt.elif_stmts)
+      scan_list(scan, node->stmt.if_stmt.elif_stmts,
+                node->stmt.if_stmt.elif_count);
+    scan_node(scan, node->stmt.if_stmt.else_stmt);
+    break;
+  case AST_STMT_LOOP:
+    scan_list(scan, node->stmt.loop_stmt.initializer,
+              node->stmt.loop_stmt.init_count);
+    scan_node(scan, node->stmt.loop_stmt.condition);
+    scan_node(scan, node->stmt.loop_stmt.optional);
+    scan_node(scan, node->stmt.loop_stmt.body);
+    break;
+  case AST_STMT_RETURN:
+    scan_node(scan, node->stmt.return_stmt.value);
+    break;
+  case AST_STMT_BLOCK:
+    scan_list(scan, node->stmt.block.statements, node->stmt.block.stmt_count);
+    break;
+  case AST_STMT_PRINT:
+    scan_list(scan, node->stmt.print_stmt.expressions,
+              node->stmt.print_stmt.expr_count);
+    break;
+  case AST_STMT_DEFER:
+    scan_node(scan, node->stmt.defer_stmt.statement);
+    break;
+  case AST_STMT_SWITCH:
+    scan_node(scan, node->stmt.switch_stmt.condition);
+    scan_list(scan, node->stmt.switch_stmt.cases,
+              node->stmt.switch_stmt.case_count);
+    scan_node(scan, node->stmt.switch_stmt.default_case);
+    break;
+  case AST_STMT_CASE:
+    scan_list(scan, node->stmt.case_clause.values,
+              node->stmt.case_clause.value_count);
+    scan_node(scan, node->stmt.case_clause.body);
+    break;
+  case AST_STMT_DEFAULT:
+    scan_node(scan, node->stmt.default_clause.body);
+    break;
+  case AST_PREPROCESSOR_OS:
+    scan_list(scan, node->preprocessor.os.bodies,
+              node->preprocessor.os.arm_count);
+    scan_node(scan, node->preprocessor.os.default_body);
+    break;
+
+  default:
+    scan->unknown = true;
+    break;
+  }
+}
+
+void mark_stack_allocations(AstNode *func) {
+  AstNode *body = func->stmt.func_decl.body;
+  if (!body)
+    return;
+
+  StackScan scan = {0};
+  collect(&scan, body);
+  if (scan.count == 0)
+    return;
+
+  // Parameters share the function's namespace with its locals
+  for (size_t i = 0; i < func->stmt.func_decl.param_count; i++)
+    escape(&scan, func->stmt.func_decl.param_names[i]);
+
+  scan_node(&scan, body);
+  if (scan.unknown)
+    return;
+
+  bool any = false;
+  for (size_t i = 0; i < scan.count; i++) {
+    Candidate *candidate = &scan.candidates[i];
+    if (candidate->free_count == 0)
+      candidate->escapes = true;
+    if (!candidate->escapes) {
+      candidate->alloc->expr.alloc.no_escape = true;
+      any = true;
+    }
+  }
+
+  if (any) {
+    scan.marking = true;
+    scan_node(&scan, body);
+  }
+}
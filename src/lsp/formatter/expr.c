@@ -1,3 +1,4 @@
+#include "../../ast/ast_utils.h"
 #include "formatter.h"
 
 void format_binary_expression(FormatterContext *ctx, Expr *expr) {
@@ -172,7 +173,7 @@ void format_literal_expression(FormatterContext *ctx, Expr *expr) {
     break;
   case LITERAL_CHAR:
     write_string(ctx, "'");
-    fputc(expr->expr.literal.value.char_val, ctx->output);
+    write_char(ctx, expr->expr.literal.value.char_val);
     write_string(ctx, "'");
     break;
   case LITERAL_BOOL:
@@ -183,6 +184,8 @@ void format_literal_expression(FormatterContext *ctx, Expr *expr) {
 
 void format_identifier_expression(FormatterContext *ctx, Expr *expr) {
   write_string(ctx, expr->expr.identifier.name);
+  format_type_args(ctx, expr->expr.identifier.type_args,
+                   expr->expr.identifier.type_arg_count);
 }
 
 void format_array(FormatterContext *ctx, Expr *expr) {
@@ -211,6 +214,8 @@ void format_member(FormatterContext *ctx, Expr *expr) {
     }
     
     write_string(ctx, expr->expr.member.member);
+    format_type_args(ctx, expr->expr.member.type_args,
+                     expr->expr.member.type_arg_count);
 }
 
 void format_index_expression(FormatterContext *ctx, Expr *expr) {
@@ -243,7 +248,7 @@ void format_alloc_expression(FormatterContext *ctx, Expr *expr) {
 }
 
 void format_memcpy_expression(FormatterContext *ctx, Expr *expr) {
-    write_string(ctx, "memcpy(");
+    write_string(ctx, "@memcpy(");
     format_expr(ctx, expr->expr.memcpy.to);
     write_string(ctx, ",");
     if (ctx->config.space_after_comma) {
@@ -258,6 +263,21 @@ void format_memcpy_expression(FormatterContext *ctx, Expr *expr) {
     write_string(ctx, ")");
 }
 
+void format_builtin_expression(FormatterContext *ctx, Expr *expr) {
+    write_string(ctx, builtin_to_string(expr->expr.builtin.kind));
+    write_string(ctx, "(");
+    for (size_t i = 0; i < expr->expr.builtin.arg_count; i++) {
+        if (i > 0) {
+            write_string(ctx, ",");
+            if (ctx->config.space_after_comma) {
+                write_space(ctx);
+            }
+        }
+        format_expr(ctx, expr->expr.builtin.args[i]);
+    }
+    write_string(ctx, ")");
+}
+
 void format_free_expression(FormatterContext *ctx, Expr *expr) {
     write_string(ctx, "free(");
     format_expr(ctx, expr->expr.free.ptr);
@@ -0,0 +1,533 @@
+// format_files.c - `luma fmt` over many files at once
+//
+// The paths given on the command line (files, directories searched for .lx
+// files, and glob patterns) are expanded into one sorted list, which up to
+// get_compile_thread_count() threads work through. Each thread formats into
+// its own arena, reset between files, and compares the formatted text with
+// the text read from disk in memory; a file is only written back when it
+// changed. Results are printed in path order once every file is done.
+//
+// Files found formatted are remembered by the hash of their contents in
+// "fmt-<hash of the settings>.cache" in the std cache (get_std_cache_path),
+// so a later run skips them without parsing. The settings hash covers the
+// compiler version and the FormatterConfig, since either can change what
+// formatted means.
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <glob.h>
+#endif
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "../../c_libs/error/error.h"
+#include "../../helper/help.h"
+#include "../../helper/std_path.h"
+#include "formatter.h"
+
+#define FORMAT_CACHE_HEADER "luma-fmt-cache 1"
+#define FORMAT_CACHE_MAX 65536
+#define FORMAT_ARENA_SIZE (256 * 1024)
+
+#define FNV64_OFFSET 0xcbf29ce484222325ull
+
+typedef enum {
+  FORMAT_CLEAN,   // Already formatted
+  FORMAT_CHANGED, // Differs from its formatted text
+  FORMAT_FAILED,  // Couldn't be read, parsed or written
+} FormatStatus;
+
+typedef struct {
+  const char *path;
+  char *formatted; // Only kept when it goes to stdout
+  size_t formatted_length;
+  uint64_t hash;         // Of the contents the file ends up with
+  bool formatted_on_disk; // So `hash` goes in the cache
+  FormatStatus status;
+  ErrorBuffer errors;
+} FormatTask;
+
+// Content hashes of formatted files, sorted
+typedef struct {
+  uint64_t *hashes;
+  size_t count;
+} FormatCache;
+
+typedef struct {
+  FormatTask *tasks;
+  size_t task_count;
+  atomic_size_t next_task;
+  const FormatCache *cache;
+  FormatterConfig config;
+  bool to_stdout;
+} FormatQueue;
+
+// ============================================================================
+// PATHS
+// ============================================================================
+
+static void add_file(GrowableArray *files, const char *path,
+                     ArenaAllocator *arena) {
+  const char **slot = growable_array_push(files);
+  if (slot)
+    *slot = arena_strdup(arena, path);
+}
+
+static bool is_luma_file(const char *name) {
+  size_t length = strlen(name);
+  return length > 3 && strcmp(name + length - 3, ".lx") == 0;
+}
+
+// Adds every .lx file under `dir`; hidden entries (.git, ...) are skipped
+static void collect_dir(GrowableArray *files, const char *dir,
+                        ArenaAllocator *arena) {
+  char child[1024];
+
+#ifdef _WIN32
+  WIN32_FIND_DATA find_data;
+  char search_path[1024];
+  snprintf(search_path, sizeof(search_path), "%s\\*", dir);
+
+  HANDLE hFind = FindFirstFile(search_path, &find_data);
+  if (hFind == INVALID_HANDLE_VALUE)
+    return;
+  do {
+    const char *name = find_data.cFileName;
+    if (name[0] == '.')
+      continue;
+    snprintf(child, sizeof(child), "%s\\%s", dir, name);
+    if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+      collect_dir(files, child, arena);
+    else if (is_luma_file(name))
+      add_file(files, child, arena);
+  } while (FindNextFile(hFind, &find_data));
+  FindClose(hFind);
+#else
+  DIR *handle = opendir(dir);
+  if (!handle)
+    return;
+  struct dirent *entry;
+  while ((entry = readdir(handle)) != NULL) {
+    const char *name = entry->d_name;
+    if (name[0] == '.')
+      continue;
+    snprintf(child, sizeof(child), "%s/%s", dir, name);
+    if (PathIsDir(child))
+      collect_dir(files, child, arena);
+    else if (is_luma_file(name))
+      add_file(files, child, arena);
+  }
+  closedir(handle);
+#endif
+}
+
+// Adds the files `pattern` matches; a matched directory is searched like
+// one given by name
+static bool collect_glob(GrowableArray *files, const char *pattern,
+                         ArenaAllocator *arena) {
+  size_t before = files->count;
+
+#ifdef _WIN32
+  // Wildcards are only expanded in the last component
+  const char *slash = strrchr(pattern, '\\');
+  const char *forward = strrchr(pattern, '/');
+  if (!slash || (forward && forward > slash))
+    slash = forward;
+  int dir_length = slash ? (int)(slash - pattern) : 0;
+
+  WIN32_FIND_DATA find_data;
+  HANDLE hFind = FindFirstFile(pattern, &find_data);
+  if (hFind != INVALID_HANDLE_VALUE) {
+    do {
+      const char *name = find_data.cFileName;
+      if (name[0] == '.')
+        continue;
+      char child[1024];
+      if (slash)
+        snprintf(child, sizeof(child), "%.*s\\%s", dir_length, pattern, name);
+      else
+        snprintf(child, sizeof(child), "%s", name);
+      if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        collect_dir(files, child, arena);
+      else
+        add_file(files, child, arena);
+    } while (FindNextFile(hFind, &find_data));
+    FindClose(hFind);
+  }
+#else
+  glob_t matches;
+  if (glob(pattern, 0, NULL, &matches) == 0) {
+    for (size_t i = 0; i < matches.gl_pathc; i++) {
+      if (PathIsDir(matches.gl_pathv[i]))
+        collect_dir(files, matches.gl_pathv[i], arena);
+      else
+        add_file(files, matches.gl_pathv[i], arena);
+    }
+  }
+  globfree(&matches);
+#endif
+
+  return files->count > before;
+}
+
+static int compare_paths(const void *a, const void *b) {
+  return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+// Expands `paths` into the sorted list of files to format, without
+// duplicates. False if a path names nothing.
+static bool expand_paths(const char *const *paths, size_t path_count,
+                         GrowableArray *files, ArenaAllocator *arena) {
+  bool ok = true;
+  for (size_t i = 0; i < path_count; i++) {
+    const char *path = paths[i];
+    if (PathIsDir(path)) {
+      collect_dir(files, path, arena);
+    } else if (PathExist(path)) {
+      add_file(files, path, arena);
+    } else if (strpbrk(path, "*?[")) {
+      if (!collect_glob(files, path, arena)) {
+        fprintf(stderr, "%s: No files match\n", path);
+        ok = false;
+      }
+    } else {
+      fprintf(stderr, "%s: No such file or directory\n", path);
+      ok = false;
+    }
+  }
+
+  const char **names = (const char **)files->data;
+  if (files->count > 1)
+    qsort(names, files->count, sizeof(*names), compare_paths);
+
+  size_t unique = 0;
+  for (size_t i = 0; i < files->count; i++) {
+    if (unique == 0 || strcmp(names[unique - 1], names[i]) != 0)
+      names[unique++] = names[i];
+  }
+  files->count = unique;
+  return ok;
+}
+
+// ============================================================================
+// CACHE
+// ============================================================================
+
+static bool cache_path(char *buffer, size_t size, FormatterConfig config) {
+  char cache_dir[768];
+  if (!get_std_cache_path(cache_dir, sizeof(cache_dir)))
+    return false;
+
+  // Only the settings that shape the output
+  int settings[] = {config.indent_size,
+                    config.use_tabs,
+                    config.max_line_length,
+                    config.space_around_operator,
+                    config.space_after_comma,
+                    config.compact_blocks};
+  uint64_t hash = cache_hash_bytes(FNV64_OFFSET, Luma_Compiler_version,
+                                   strlen(Luma_Compiler_version));
+  hash = cache_hash_bytes(hash, settings, sizeof(settings));
+
+  snprintf(buffer, size, "%s%cfmt-%016llx.cache", cache_dir, PATH_SEPARATOR,
+           (unsigned long long)hash);
+  return true;
+}
+
+static int compare_hashes(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static void load_cache(FormatCache *cache, const char *path) {
+  FILE *file = fopen(path, "r");
+  if (!file)
+    return;
+
+  char line[64];
+  if (fgets(line, sizeof(line), file) &&
+      strcmp(line, FORMAT_CACHE_HEADER "\n") == 0) {
+    size_t capacity = 0;
+    unsigned long long hash;
+    while (cache->count < FORMAT_CACHE_MAX &&
+           fscanf(file, "%16llx\n", &hash) == 1) {
+      if (cache->count == capacity) {
+        capacity = capacity ? capacity * 2 : 1024;
+        uint64_t *hashes = realloc(cache->hashes, capacity * sizeof(*hashes));
+        if (!hashes)
+          break;
+        cache->hashes = hashes;
+      }
+      cache->hashes[cache->count++] = hash;
+    }
+    if (cache->count > 1)
+      qsort(cache->hashes, cache->count, sizeof(uint64_t), compare_hashes);
+  }
+  fclose(file);
+}
+
+static bool cache_contains(const FormatCache *cache, uint64_t hash) {
+  return cache->count &&
+         bsearch(&hash, cache->hashes, cache->count, sizeof(uint64_t),
+                 compare_hashes) != NULL;
+}
+
+// Writes this run's formatted files first, then as many of the old entries
+// as still fit. It is written beside its path and renamed over it, so a run
+// reading it meanwhile sees the old one or the new one whole.
+static void save_cache(const FormatCache *cache, const char *path,
+                       const FormatTask *tasks, size_t task_count) {
+  FormatCache fresh = {malloc((task_count ? task_count : 1) * sizeof(uint64_t)),
+                       0};
+  if (!fresh.hashes)
+    return;
+  for (size_t i = 0; i < task_count; i++) {
+    if (tasks[i].formatted_on_disk)
+      fresh.hashes[fresh.count++] = tasks[i].hash;
+  }
+  if (fresh.count > 1)
+    qsort(fresh.hashes, fresh.count, sizeof(uint64_t), compare_hashes);
+
+  char temp_path[1100];
+  snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+  FILE *file = fopen(temp_path, "w");
+  if (!file) {
+    free(fresh.hashes);
+    return;
+  }
+
+  fprintf(file, FORMAT_CACHE_HEADER "\n");
+  size_t written = 0;
+  for (size_t i = 0; i < fresh.count && written < FORMAT_CACHE_MAX; i++) {
+    if (i > 0 && fresh.hashes[i] == fresh.hashes[i - 1])
+      continue;
+    fprintf(file, "%016llx\n", (unsigned long long)fresh.hashes[i]);
+    written++;
+  }
+  for (size_t i = 0; i < cache->count && written < FORMAT_CACHE_MAX; i++) {
+    if (cache_contains(&fresh, cache->hashes[i]))
+      continue;
+    fprintf(file, "%016llx\n", (unsigned long long)cache->hashes[i]);
+    written++;
+  }
+  free(fresh.hashes);
+
+  bool ok = !ferror(file);
+  ok = fclose(file) == 0 && ok;
+#ifdef _WIN32
+  if (ok)
+    remove(path);
+#endif
+  if (!ok || rename(temp_path, path) != 0)
+    remove(temp_path);
+}
+
+// ============================================================================
+// FORMATTING
+// ============================================================================
+
+static bool write_whole_file(const char *path, const char *text,
+                             size_t length) {
+  FILE *file = fopen(path, "wb");
+  if (!file)
+    return false;
+  bool ok = fwrite(text, 1, length, file) == length;
+  return fclose(file) == 0 && ok;
+}
+
+static void format_task(FormatTask *task, const FormatQueue *queue,
+                        ArenaAllocator *arena) {
+  char *original = (char *)read_file(task->path);
+  if (!original) {
+    task->status = FORMAT_FAILED;
+    return;
+  }
+  size_t original_length = strlen(original);
+  uint64_t original_hash =
+      cache_hash_bytes(FNV64_OFFSET, original, original_length);
+
+  if (cache_contains(queue->cache, original_hash)) {
+    task->status = FORMAT_CLEAN;
+  } else {
+    task->formatted = format_source(task->path, original,
+                                    &task->formatted_length, queue->config,
+                                    arena);
+    if (!task->formatted) {
+      task->status = FORMAT_FAILED;
+    } else if (task->formatted_length == original_length &&
+               memcmp(task->formatted, original, original_length) == 0) {
+      task->status = FORMAT_CLEAN;
+    } else {
+      task->status = FORMAT_CHANGED;
+      if (queue->config.write_in_place) {
+        if (write_whole_file(task->path, task->formatted,
+                             task->formatted_length)) {
+          task->hash = cache_hash_bytes(FNV64_OFFSET, task->formatted,
+                                        task->formatted_length);
+          task->formatted_on_disk = true;
+        } else {
+          task->status = FORMAT_FAILED;
+        }
+      }
+    }
+  }
+
+  if (task->status == FORMAT_CLEAN) {
+    task->hash = original_hash;
+    task->formatted_on_disk = true;
+  }
+
+  if (queue->to_stdout && task->status == FORMAT_CLEAN) {
+    // Printed as it is
+    free(task->formatted);
+    task->formatted = original;
+    task->formatted_length = original_length;
+    return;
+  }
+  if (!queue->to_stdout) {
+    free(task->formatted);
+    task->formatted = NULL;
+  }
+  free(original);
+}
+
+static void *format_worker(void *arg) {
+  FormatQueue *queue = (FormatQueue *)arg;
+
+  ArenaAllocator arena;
+  arena_allocator_init(&arena, FORMAT_ARENA_SIZE);
+
+  for (;;) {
+    size_t index = atomic_fetch_add(&queue->next_task, 1);
+    if (index >= queue->task_count)
+      break;
+
+    FormatTask *task = &queue->tasks[index];
+    error_begin_capture(&task->errors);
+    format_task(task, queue, &arena);
+    error_end_capture();
+    arena_reset(&arena);
+  }
+
+  arena_destroy(&arena);
+  return NULL;
+}
+
+static void *format_thread(void *arg) {
+  trace_set_thread_name("format worker");
+  return format_worker(arg);
+}
+
+static void format_parallel(FormatQueue *queue) {
+  size_t thread_count = get_compile_thread_count();
+  if (thread_count > queue->task_count)
+    thread_count = queue->task_count;
+
+  // The calling thread works the queue too
+  pthread_t *threads = NULL;
+  size_t started = 0;
+  if (thread_count > 1) {
+    threads = xmalloc(sizeof(pthread_t) * (thread_count - 1));
+    for (size_t i = 0; i < thread_count - 1; i++) {
+      if (pthread_create(&threads[started], NULL, format_thread, queue) != 0)
+        break;
+      started++;
+    }
+  }
+
+  format_worker(queue);
+
+  for (size_t i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+}
+
+// Formats every file `paths` names: checks it with config.check_only,
+// rewrites it with config.write_in_place, and prints it otherwise. Returns
+// false if a file couldn't be formatted, or needs formatting under
+// check_only.
+bool format_files(const char *const *paths, size_t path_count,
+                  FormatterConfig config) {
+  ArenaAllocator arena;
+  arena_allocator_init(&arena, 64 * 1024);
+
+  GrowableArray files;
+  if (!growable_array_init(&files, &arena, 16, sizeof(const char *))) {
+    arena_destroy(&arena);
+    return false;
+  }
+  bool ok = expand_paths(paths, path_count, &files, &arena);
+
+  FormatQueue queue = {
+      .tasks = xcalloc(files.count ? files.count : 1, sizeof(FormatTask)),
+      .task_count = files.count,
+      .config = config,
+      .to_stdout = !config.check_only && !config.write_in_place,
+  };
+  atomic_init(&queue.next_task, 0);
+  for (size_t i = 0; i < files.count; i++)
+    queue.tasks[i].path = ((const char **)files.data)[i];
+
+  // Printing to stdout doesn't settle whether a file is formatted on disk
+  // any faster, but it is still skipped without parsing when it is
+  char path[1024];
+  bool use_cache = cache_path(path, sizeof(path), config);
+  FormatCache cache = {0};
+  if (use_cache)
+    load_cache(&cache, path);
+  queue.cache = &cache;
+
+  if (queue.task_count > 0)
+    format_parallel(&queue);
+
+  size_t needs_formatting = 0;
+  for (size_t i = 0; i < queue.task_count; i++) {
+    FormatTask *task = &queue.tasks[i];
+    error_flush_buffer(&task->errors);
+    error_report();
+    error_clear();
+
+    switch (task->status) {
+    case FORMAT_FAILED:
+      fprintf(stderr, "Error: Failed to format file: %s\n", task->path);
+      ok = false;
+      break;
+    case FORMAT_CHANGED:
+      if (config.check_only) {
+        printf("File needs formatting: %s\n", task->path);
+        needs_formatting++;
+        ok = false;
+      } else if (config.write_in_place) {
+        printf("Formatted file in place: %s\n", task->path);
+      }
+      break;
+    case FORMAT_CLEAN:
+      if (config.check_only && queue.task_count == 1)
+        printf("File is already formatted: %s\n", task->path);
+      break;
+    }
+
+    if (queue.to_stdout && task->formatted)
+      fwrite(task->formatted, 1, task->formatted_length, stdout);
+    free(task->formatted);
+  }
+
+  if (config.check_only && queue.task_count > 1)
+    printf("%zu of %zu files need formatting\n", needs_formatting,
+           queue.task_count);
+
+  if (use_cache)
+    save_cache(&cache, path, queue.tasks, queue.task_count);
+
+  free(cache.hashes);
+  free(queue.tasks);
+  arena_destroy(&arena);
+  return ok;
+}
@@ -1,31 +1,17 @@
+#include <stdalign.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-// Platform-specific includes
-#ifdef _WIN32
-#include <fcntl.h>
-#include <io.h>
-#include <windows.h>
-#define mkstemp(template)                                                      \
-  _mktemp_s(template, strlen(template) + 1)                                    \
-      ? -1                                                                     \
-      : _open(template, _O_CREAT | _O_EXCL | _O_RDWR, _S_IREAD | _S_IWRITE)
-#define unlink _unlink
-#define close _close
-#else
-#include <errno.h>  // for errno
-#include <unistd.h> // for close(), unlink(), mkstemp()
-#endif
-
 #include "../../c_libs/error/error.h"
 #include "../../helper/help.h"
+#include "../../parser/parser.h"
 #include "formatter.h"
 
 FormatterConfig default_config = {
     .indent_size = 2,
     .use_tabs = false,
-    .max_line_length = 50,
+    .max_line_length = 100,
     .space_around_operator = true,
     .space_after_comma = true,
     .compact_blocks = false,
@@ -34,18 +20,38 @@ FormatterConfig default_config = {
     .output_file = NULL,
 };
 
+// Appends to the output, keeping it NUL-terminated
+static void emit(FormatterContext *ctx, const char *text, size_t length) {
+  if (ctx->output_length + length >= ctx->output_capacity) {
+    size_t capacity = ctx->output_capacity ? ctx->output_capacity * 2 : 256;
+    while (ctx->output_length + length >= capacity)
+      capacity *= 2;
+    char *output = realloc(ctx->output, capacity);
+    if (!output)
+      die("Out of memory while formatting");
+    ctx->output = output;
+    ctx->output_capacity = capacity;
+  }
+  memcpy(ctx->output + ctx->output_length, text, length);
+  ctx->output_length += length;
+  ctx->output[ctx->output_length] = '\0';
+}
+
+static void emit_repeated(FormatterContext *ctx, char c, int count) {
+  for (int i = 0; i < count; i++)
+    emit(ctx, &c, 1);
+}
+
 void write_indent(FormatterContext *ctx) {
   if (!ctx->at_line_start)
     return;
 
   if (ctx->config.use_tabs) {
-    for (int i = 0; i < ctx->current_indent; i++)
-      fputc('\t', ctx->output);
+    emit_repeated(ctx, '\t', ctx->current_indent);
     ctx->current_column = ctx->current_indent * 4;
   } else {
     int spaces = ctx->current_indent * ctx->config.indent_size;
-    for (int i = 0; i < spaces; i++)
-      fputc(' ', ctx->output);
+    emit_repeated(ctx, ' ', spaces);
     ctx->current_column = spaces;
   }
   ctx->at_line_start = false;
@@ -55,19 +61,26 @@ void write_string(FormatterContext *ctx, const char *str) {
   if (!str)
     return;
   write_indent(ctx);
-  fputs(str, ctx->output);
-  ctx->current_column += strlen(str);
+  size_t length = strlen(str);
+  emit(ctx, str, length);
+  ctx->current_column += length;
+}
+
+void write_char(FormatterContext *ctx, char c) {
+  write_indent(ctx);
+  emit(ctx, &c, 1);
+  ctx->current_column++;
 }
 
 void write_newline(FormatterContext *ctx) {
-  fputc('\n', ctx->output);
+  emit(ctx, "\n", 1);
   ctx->current_column = 0;
   ctx->at_line_start = true;
 }
 
 void write_space(FormatterContext *ctx) {
   if (!ctx->at_line_start) {
-    fputc(' ', ctx->output);
+    emit(ctx, " ", 1);
     ctx->current_column++;
   }
 }
@@ -96,10 +109,55 @@ void format_program(FormatterContext *ctx, Stmt *program) {
   }
 }
 
+// <int, *T> after a generic's name
+void format_type_args(FormatterContext *ctx, Type **args, size_t count) {
+  if (count == 0)
+    return;
+  write_string(ctx, "<");
+  for (size_t i = 0; i < count; i++) {
+    if (i > 0) {
+      write_string(ctx, ",");
+      if (ctx->config.space_after_comma) {
+        write_space(ctx);
+      }
+    }
+    format_type(ctx, args[i]);
+  }
+  write_string(ctx, ">");
+}
+
+// <T, U> after fn or struct
+void format_type_params(FormatterContext *ctx, char **params, size_t count) {
+  if (count == 0)
+    return;
+  write_string(ctx, "<");
+  for (size_t i = 0; i < count; i++) {
+    if (i > 0) {
+      write_string(ctx, ",");
+      if (ctx->config.space_after_comma) {
+        write_space(ctx);
+      }
+    }
+    write_string(ctx, params[i]);
+  }
+  write_string(ctx, ">");
+}
+
 void format_type(FormatterContext *ctx, Type *type) {
   switch (type->type) {
   case AST_TYPE_BASIC:
     write_string(ctx, type->type_data.basic.name);
+    format_type_args(ctx, type->type_data.basic.type_args,
+                     type->type_data.basic.type_arg_count);
+    break;
+  case AST_TYPE_RESOLUTION:
+    for (size_t i = 0; i < type->type_data.resolution.part_count; i++) {
+      if (i > 0)
+        write_string(ctx, "::");
+      write_string(ctx, type->type_data.resolution.parts[i]);
+    }
+    format_type_args(ctx, type->type_data.resolution.type_args,
+                     type->type_data.resolution.type_arg_count);
     break;
   case AST_TYPE_POINTER:
     write_string(ctx, "*");
@@ -117,6 +175,20 @@ void format_type(FormatterContext *ctx, Type *type) {
     write_string(ctx, "]");
     break;
   }
+  case AST_TYPE_VECTOR: {
+    // vec<type, lanes>
+    char lanes[32];
+    snprintf(lanes, sizeof(lanes), "%zu", type->type_data.vector.lane_count);
+    write_string(ctx, "vec<");
+    format_type(ctx, type->type_data.vector.element_type);
+    write_string(ctx, ",");
+    if (ctx->config.space_after_comma) {
+      write_space(ctx);
+    }
+    write_string(ctx, lanes);
+    write_string(ctx, ">");
+    break;
+  }
   case AST_TYPE_FUNCTION: {
     // Function type syntax: fn(param_types) return_type
     write_string(ctx, "fn(");
@@ -236,6 +308,9 @@ void format_expr(FormatterContext *ctx, Expr *expr) {
   case AST_EXPR_MEMCPY:
     format_memcpy_expression(ctx, expr);
     break;
+  case AST_EXPR_BUILTIN:
+    format_builtin_expression(ctx, expr);
+    break;
   case AST_EXPR_FREE:
     format_free_expression(ctx, expr);
     break;
@@ -278,116 +353,93 @@ void format_expr(FormatterContext *ctx, Expr *expr) {
   }
 }
 
-bool format_luma_code(const char *input_path, const char *output_path,
-                      FormatterConfig config, ArenaAllocator *allocator) {
-
-  // Parse using your existing function
+// Formats `source`, the text of `path`, without touching the disk. Returns
+// the formatted text (malloc'd) and its length, or NULL when it doesn't
+// parse; the errors go wherever errors on the calling thread go.
+char *format_source(const char *path, const char *source, size_t *length,
+                    FormatterConfig config, ArenaAllocator *allocator) {
   BuildConfig build_config = {0};
-  build_config.filepath = input_path;
+  build_config.filepath = path;
+
+  TokenStream *stream = arena_alloc(allocator, sizeof(TokenStream),
+                                    alignof(TokenStream));
+  if (!stream || !token_stream_init(stream, source, allocator))
+    return NULL;
+
+  // parse_stream() reports the errors that stop it; lexer errors it got past
+  // are checked here
+  AstNode *ast = parse_stream(stream, allocator, &build_config);
+  if (!ast || error_report())
+    return NULL;
+
+  // Formatted text is about as long as the source
+  size_t source_length = strlen(source);
+  FormatterContext ctx = {.output_capacity = source_length + 64,
+                          .at_line_start = true,
+                          .config = config,
+                          .arena = allocator};
+  ctx.output = xmalloc(ctx.output_capacity);
+  ctx.output[0] = '\0';
 
-  AstNode *ast = lex_and_parse_file(input_path, allocator, &build_config);
-  if (!ast) {
-    fprintf(stderr, "Failed to parse input file: %s\n", input_path);
+  format_node(&ctx, ast);
+
+  if (length)
+    *length = ctx.output_length;
+  return ctx.output;
+}
+
+bool format_luma_code(const char *input_path, const char *output_path,
+                      FormatterConfig config, ArenaAllocator *allocator) {
+  const char *source = read_file(input_path);
+  if (!source) {
+    fprintf(stderr, "Failed to read input file: %s\n", input_path);
     return false;
   }
 
-  // Check for parse errors
-  if (error_report()) {
+  size_t length = 0;
+  char *formatted =
+      format_source(input_path, source, &length, config, allocator);
+  free((void *)source);
+  if (!formatted) {
+    fprintf(stderr, "Failed to parse input file: %s\n", input_path);
     return false;
   }
 
-  // Open output file
   FILE *output = stdout;
   if (output_path) {
-    output = fopen(output_path, "w");
+    output = fopen(output_path, "wb");
     if (!output) {
       fprintf(stderr, "Failed to open output file: %s\n", output_path);
+      free(formatted);
       return false;
     }
   }
 
-  // Initialize formatter context
-  FormatterContext ctx = {.output = output,
-                          .current_indent = 0,
-                          .current_column = 0,
-                          .at_line_start = true,
-                          .config = config,
-                          .arena = allocator};
-
-  // Format the AST
-  format_node(&ctx, ast);
-
-  // Cleanup
-  if (output != stdout) {
-    fclose(output);
-  }
-
-  return true;
-}
-
-static int create_temp_file(char *template_path) {
-#ifdef _WIN32
-  if (_mktemp_s(template_path, strlen(template_path) + 1) != 0) {
-    return -1;
-  }
-  return _open(template_path, _O_CREAT | _O_EXCL | _O_RDWR, 0600);
-#else
-  return mkstemp(template_path);
-#endif
+  bool written = fwrite(formatted, 1, length, output) == length;
+  if (output != stdout)
+    written = fclose(output) == 0 && written;
+  free(formatted);
+  return written;
 }
 
+// Whether the file at `filepath` differs from its formatted text. The two
+// are compared in memory; a file that can't be read or parsed counts as
+// formatted.
 bool check_formatting(const char *filepath, FormatterConfig config,
                       ArenaAllocator *allocator) {
-
-  // Read original file using your existing read_file function
   const char *original = read_file(filepath);
   if (!original) {
     return false;
   }
 
-  // Create temporary file for formatted output
-#ifdef _WIN32
-  char temp_path[MAX_PATH];
-  if (GetTempPath(MAX_PATH, temp_path) == 0) {
-    free((void *)original);
-    return false;
-  }
-  strcat_s(temp_path, MAX_PATH, "luma_fmt_XXXXXX");
-#else
-  char temp_path[] = "/tmp/luma_fmt_XXXXXX";
-#endif
-
-  int temp_fd = create_temp_file(temp_path);
-  if (temp_fd == -1) {
-    free((void *)original);
-    return false;
-  }
-  close(temp_fd);
+  size_t length = 0;
+  char *formatted = format_source(filepath, original, &length, config,
+                                  allocator);
+  bool files_differ = formatted && (length != strlen(original) ||
+                                    memcmp(original, formatted, length) != 0);
 
-  // Format to temporary file
-  bool success = format_luma_code(filepath, temp_path, config, allocator);
-  if (!success) {
-    unlink(temp_path);
-    free((void *)original);
-    return false;
-  }
-
-  // Read formatted output using your existing read_file function
-  const char *formatted = read_file(temp_path);
-  unlink(temp_path);
-
-  if (!formatted) {
-    free((void *)original);
-    return false;
-  }
-
-  // Compare - return true if files differ (need formatting)
-  bool files_differ = strcmp(original, formatted) != 0;
-
-  // Free both malloced buffers from read_file
   free((void *)original);
-  free((void *)formatted);
-
+  free(formatted);
   return files_differ;
 }
 
@@ -18,7 +18,9 @@ typedef struct  {
 } FormatterConfig;
 
 typedef struct {
-    FILE *output;
+    char *output;           // Formatted text so far, NUL-terminated (malloc'd)
+    size_t output_length;
+    size_t output_capacity;
     int current_indent;
     int current_column;
     bool at_line_start;
@@ -26,11 +28,15 @@ typedef struct {
     ArenaAllocator *arena;
 } FormatterContext;
 
+// The settings `luma fmt` and the language server format with
+extern FormatterConfig default_config;
+
 // Core formatting functions
 void write_indent(FormatterContext *ctx);
 void write_string(FormatterContext *ctx, const char *str);
 void write_newline(FormatterContext *ctx);
 void write_space(FormatterContext *ctx);
+void write_char(FormatterContext *ctx, char c);
 
 void increase_indent(FormatterContext *ctx);
 void decrease_indent(FormatterContext *ctx);
@@ -39,6 +45,8 @@ void format_node(FormatterContext *ctx, AstNode *node);
 void format_stmt(FormatterContext *ctx, Stmt *stmt);
 void format_expr(FormatterContext *ctx, Expr *expr);
 void format_type(FormatterContext *ctx, Type *type);
+void format_type_args(FormatterContext *ctx, Type **args, size_t count);
+void format_type_params(FormatterContext *ctx, char **params, size_t count);
 
 void format_program(FormatterContext *ctx, Stmt *stmt);
 
@@ -74,6 +82,7 @@ void format_deref_expression(FormatterContext* ctx, Expr* expr);
 void format_addr_expression(FormatterContext* ctx, Expr* expr);
 void format_alloc_expression(FormatterContext* ctx, Expr* expr);
 void format_memcpy_expression(FormatterContext* ctx, Expr* expr);
+void format_builtin_expression(FormatterContext* ctx, Expr* expr);
 void format_free_expression(FormatterContext* ctx, Expr* expr);
 void format_cast_expression(FormatterContext* ctx, Expr* expr);
 void format_sizeof_expression(FormatterContext* ctx, Expr* expr);
@@ -81,8 +90,12 @@ void format_array(FormatterContext* ctx, Expr* expr);
 void format_member(FormatterContext* ctx, Expr* expr);
 
 // Main formatter functions
+char *format_source(const char *path, const char *source, size_t *length,
+                    FormatterConfig config, ArenaAllocator *allocator);
 bool format_luma_code(const char* input_path, const char* output_path, 
                       FormatterConfig config, ArenaAllocator* allocator);
 bool check_formatting(const char* filepath, FormatterConfig config, 
                       ArenaAllocator* allocator);
+bool format_files(const char *const *paths, size_t path_count,
+                  FormatterConfig config);
 void print_usage(const char* program_name);
\ No newline at end of file
@@ -46,7 +46,26 @@ void format_use_prep(FormatterContext *ctx, Stmt *use) {
   write_newline(ctx);
 }
 
+// Optimization attributes go in front of the declaration
+static void format_function_attributes(FormatterContext *ctx, Stmt *stmt) {
+  static const struct {
+    unsigned flag;
+    const char *text;
+  } attributes[] = {
+      {FN_ATTR_INLINE, "#inline "}, {FN_ATTR_NOINLINE, "#noinline "},
+      {FN_ATTR_HOT, "#hot "},       {FN_ATTR_COLD, "#cold "},
+      {FN_ATTR_PURE, "#pure "},     {FN_ATTR_CONST, "#const "},
+      {FN_ATTR_FLATTEN, "#flatten "},
+  };
+  for (size_t i = 0; i < sizeof(attributes) / sizeof(*attributes); i++) {
+    if (stmt->stmt.func_decl.attributes & attributes[i].flag)
+      write_string(ctx, attributes[i].text);
+  }
+}
+
 void format_function_definition(FormatterContext *ctx, Stmt *stmt) {
+  format_function_attributes(ctx, stmt);
+
   if (stmt->stmt.func_decl.is_public) {
     write_string(ctx, "pub ");
   } else {
@@ -60,7 +79,10 @@ void format_function_definition(FormatterContext *ctx, Stmt *stmt) {
     write_string(ctx, stmt->stmt.func_decl.name);
   }
 
-  write_string(ctx, " = fn ");
+  write_string(ctx, " = fn");
+  format_type_params(ctx, stmt->stmt.func_decl.type_params,
+                     stmt->stmt.func_decl.type_param_count);
+  write_space(ctx);
 
   // Format parameters
   write_string(ctx, "(");
@@ -150,7 +172,10 @@ void format_struct_definition(FormatterContext *ctx, Stmt *stmt) {
   if (stmt->stmt.struct_decl.name) {
     write_string(ctx, stmt->stmt.struct_decl.name);
   }
-  write_string(ctx, " = struct {");
+  write_string(ctx, " = struct");
+  format_type_params(ctx, stmt->stmt.struct_decl.type_params,
+                     stmt->stmt.struct_decl.type_param_count);
+  write_string(ctx, " {");
   write_newline(ctx);
 
   if (stmt->stmt.struct_decl.is_public) {
@@ -241,7 +266,34 @@ void format_if_statement(FormatterContext *ctx, Stmt *stmt) {
   write_newline(ctx);
 }
 
+// Loop hints go in front of the loop keyword
+static void format_loop_hints(FormatterContext *ctx, Stmt *stmt) {
+  char hint[48];
+  if (stmt->stmt.loop_stmt.unroll) {
+    if (stmt->stmt.loop_stmt.unroll_count)
+      snprintf(hint, sizeof(hint), "#unroll(%zu) ",
+               stmt->stmt.loop_stmt.unroll_count);
+    else
+      snprintf(hint, sizeof(hint), "#unroll ");
+    write_string(ctx, hint);
+  }
+  if (stmt->stmt.loop_stmt.vectorize) {
+    if (stmt->stmt.loop_stmt.vectorize_width)
+      snprintf(hint, sizeof(hint), "#vectorize(%zu) ",
+               stmt->stmt.loop_stmt.vectorize_width);
+    else
+      snprintf(hint, sizeof(hint), "#vectorize ");
+    write_string(ctx, hint);
+  }
+  if (stmt->stmt.loop_stmt.no_vectorize)
+    write_string(ctx, "#no_vectorize ");
+  if (stmt->stmt.loop_stmt.independent)
+    write_string(ctx, "#independent ");
+}
+
 void format_loop_statement(FormatterContext *ctx, Stmt *stmt) {
+  format_loop_hints(ctx, stmt);
+
   // Handle different types of loop statements based on Luma syntax
   write_string(ctx, "loop ");
 
@@ -9,6 +9,7 @@
 #include "../lexer/lexer.h"
 #include "../parser/parser.h"
 #include "../typechecker/type.h"
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 
@@ -26,17 +27,23 @@ typedef enum {
   LSP_METHOD_TEXT_DOCUMENT_DID_OPEN,
   LSP_METHOD_TEXT_DOCUMENT_DID_CHANGE,
   LSP_METHOD_TEXT_DOCUMENT_DID_CLOSE,
+  LSP_METHOD_TEXT_DOCUMENT_DID_SAVE,
   LSP_METHOD_TEXT_DOCUMENT_HOVER,
   LSP_METHOD_TEXT_DOCUMENT_DEFINITION,
   LSP_METHOD_TEXT_DOCUMENT_COMPLETION,
   LSP_METHOD_TEXT_DOCUMENT_DOCUMENT_SYMBOL,
   LSP_METHOD_TEXT_DOCUMENT_SEMANTIC_TOKENS,
+  LSP_METHOD_TEXT_DOCUMENT_SEMANTIC_TOKENS_DELTA,
+  LSP_METHOD_TEXT_DOCUMENT_SEMANTIC_TOKENS_RANGE,
   LSP_METHOD_TEXT_DOCUMENT_SIGNATURE_HELP,
   LSP_METHOD_TEXT_DOCUMENT_CODE_ACTION,
   LSP_METHOD_TEXT_DOCUMENT_RENAME,
   LSP_METHOD_TEXT_DOCUMENT_DOCUMENT_HIGHLIGHT,
   LSP_METHOD_TEXT_DOCUMENT_COMPLETION_ITEM_RESOLVE,
   LSP_METHOD_TEXT_DOCUMENT_FORMATTING,
+  LSP_METHOD_TEXT_DOCUMENT_RANGE_FORMATTING,
+  LSP_METHOD_TEXT_DOCUMENT_REFERENCES,
+  LSP_METHOD_WORKSPACE_SYMBOL,
   LSP_METHOD_UNKNOWN
 } LSPMethod;
 
@@ -59,6 +66,11 @@ typedef struct {
   LSPRange range;
 } LSPLocation;
 
+typedef struct {
+  LSPRange range;
+  const char *new_text;
+} LSPTextEdit;
+
 // ============================================================================
 // DIAGNOSTICS
 // ============================================================================
@@ -112,6 +124,14 @@ typedef struct LSPDocumentSymbol {
   size_t child_count;
 } LSPDocumentSymbol;
 
+// A top-level name found by workspace/symbol
+typedef struct {
+  const char *name;
+  LSPSymbolKind kind;
+  LSPLocation location;
+  const char *container; // Its module's name, NULL if the file has none
+} LSPWorkspaceSymbol;
+
 // ============================================================================
 // SIGNATURE HELP
 // ============================================================================
@@ -200,6 +220,23 @@ typedef struct {
   const char *filter_text;
 } LSPCompletionItem;
 
+// Of the matches of one completion, the best ones sent (see
+// lsp_completion_index.c)
+#define LSP_COMPLETION_PAGE 100
+#define LSP_COMPLETION_PREFIX_MAX 64
+
+typedef struct {
+  LSPCompletionItem *items; // One per label and kind, by filter text
+  const char **keys;        // Each one's filter text, lowercased
+  size_t count;
+
+  // What the last query matched, which a longer one only narrows down
+  char last_query[LSP_COMPLETION_PREFIX_MAX];
+  uint32_t *matches;
+  size_t match_count;
+  bool has_matches;
+} LSPCompletionIndex;
+
 // ============================================================================
 // MODULE SYSTEM
 // ============================================================================
@@ -208,19 +245,126 @@ typedef struct {
   const char *module_path; // e.g., "string", "std/memory"
   const char *alias;       // Import alias (e.g., "str")
   Scope *scope;            // Parsed scope from that module
+  const char *uri;         // Where the analysis found it, NULL if nowhere
 } ImportedModule;
 
+// Open-addressed map from atoms to indices, kept at most half full. A
+// zero-initialized table is empty; keys are never removed.
 typedef struct {
-  const char *module_name; // e.g., "math", "string"
-  const char *file_uri;    // Full file URI where module is defined
+  Atom *keys;
+  size_t *values;
+  size_t count;
+  size_t capacity; // Zero or a power of two
+} LSPAtomTable;
+
+#define LSP_ATOM_NONE ((size_t)-1)
+
+size_t lsp_atom_table_get(const LSPAtomTable *table, Atom key);
+bool lsp_atom_table_put(LSPAtomTable *table, Atom key, size_t value);
+void lsp_atom_table_clear(LSPAtomTable *table);
+void lsp_atom_table_free(LSPAtomTable *table);
+
+// A .lx file of the workspace (or a std module found by lookup_module),
+// with the mtime and size it had when its @module line was read
+typedef struct {
+  Atom path;
+  Atom module_name;     // NULL if the file declares none
+  const char *file_uri; // Made on first lookup
+  long mtime;
+  long size;
+  size_t dir;   // Index into the registry's dirs, LSP_ATOM_NONE for std
+  bool present; // False once the file is gone
 } ModuleRegistryEntry;
 
+// A directory of the workspace and its mtime when last listed, -1 if
+// it is still to be listed
+typedef struct {
+  Atom path;
+  long mtime;
+  bool present;
+} ModuleRegistryDir;
+
+// Module names of the workspace, persisted in the std cache directory so a
+// later session starts from them (see lsp_module_index.c)
 typedef struct {
   ModuleRegistryEntry *entries;
   size_t count;
   size_t capacity;
+  ModuleRegistryDir *dirs;
+  size_t dir_count;
+  size_t dir_capacity;
+  LSPAtomTable by_name; // Module name -> entry
+  LSPAtomTable by_path; // File path -> entry
+  LSPAtomTable dir_by_path;
+  const char *root; // The workspace's path, NULL before initialize
+  bool dirty;       // Differs from the index on disk
 } ModuleRegistry;
 
+// Where a module's top-level name occurs in one file
+typedef struct {
+  uint32_t symbol; // Index into the index's symbols
+  bool definition;
+  LSPRange range;
+} LSPSymbolOccurrence;
+
+// What the symbol index has of one file: its occurrences in text order,
+// and their positions in that order again, sorted by symbol
+typedef struct {
+  Atom uri;
+  Atom module_name; // NULL if the file declares none
+  LSPSymbolOccurrence *occurrences;
+  uint32_t *by_symbol;
+  size_t count;
+  long mtime; // Of the file read, -1 for the text of an open document
+} LSPIndexedFile;
+
+// A top-level name, keyed "<module>::<name>", and the files it occurs in
+typedef struct {
+  Atom key;
+  Atom module_name;
+  Atom name;
+  LSPSymbolKind kind;
+  uint32_t *files;
+  size_t file_count;
+  size_t file_capacity;
+  size_t defined_in; // Of those, the files declaring it
+} LSPIndexedSymbol;
+
+// A defined name from one of its word starts ("sort" of "quick_sort"), for
+// workspace/symbol
+typedef struct {
+  uint32_t symbol;
+  uint32_t offset;
+} LSPSymbolWord;
+
+// Every top-level name of the workspace and where it occurs, replaced one
+// file at a time as documents are published, imported modules checked and
+// the other files of the workspace read (see lsp_symbol_index.c). It has
+// its own lock, since the worker updates it while requests read it.
+typedef struct {
+  LSPIndexedFile *files;
+  size_t file_count;
+  size_t file_capacity;
+  LSPIndexedSymbol *symbols; // Never removed; one no file has is unused
+  size_t symbol_count;
+  size_t symbol_capacity;
+  LSPAtomTable file_by_uri;
+  LSPAtomTable symbol_by_key;
+
+  // Sorted by word, case aside; rebuilt by the query after a definition
+  // was added or dropped
+  LSPSymbolWord *words;
+  size_t word_count;
+  bool words_stale;
+
+  // Workspace files the worker has yet to compare against the index, from
+  // this entry of the module registry on
+  bool scan_pending;
+  size_t scan_next;
+
+  pthread_mutex_t lock;
+} LSPSymbolIndex;
+
 typedef struct {
   AstNode *ast;           // The module AST node
   Scope *scope;           // The scope created during typecheck
@@ -231,13 +375,183 @@ typedef struct {
 // DOCUMENT & SERVER STATE
 // ============================================================================
 
+// One buffer of a piece table, with the offset of every '\n' in it so a
+// line is found by binary search instead of a scan
+typedef struct {
+  char *data;
+  size_t length;
+  size_t capacity;
+  size_t *newlines;
+  size_t newline_count;
+  size_t newline_capacity;
+} LSPTextBuffer;
+
+typedef struct {
+  bool added; // In the add buffer rather than the original
+  size_t start;
+  size_t length;
+} LSPPiece;
+
+// Where a text differs from an earlier version of it: [start, new_end) now
+// holds what [start, old_end) did, and everything else only moved
+typedef struct {
+  size_t start;
+  size_t old_end;
+  size_t new_end;
+} LSPTextSpan;
+
+// Document text as the text of the last analysis (original) plus an
+// append-only buffer of what was typed since, so an edit costs its own size.
+// piece_table_text() folds the pieces back into one buffer, and the old
+// buffers are kept for the next fold instead of being freed.
+typedef struct {
+  LSPTextBuffer original;
+  LSPTextBuffer added;
+  LSPTextBuffer spare;
+  LSPPiece *pieces;
+  size_t piece_count;
+  size_t piece_capacity;
+  size_t length;
+
+  // Edits since piece_table_take_changes(), merged into one span
+  bool changed;
+  LSPTextSpan change;
+} LSPPieceTable;
+
+// One entry of didChange's contentChanges; without a range it is the
+// whole new text
+typedef struct {
+  bool has_range;
+  LSPRange range;
+  const char *text;
+} LSPTextChange;
+
+// A top-level statement of a document and the index of its first token
+typedef struct {
+  AstNode *node;
+  size_t first_token;
+} LSPDecl;
+
+// What the last analysis of a document lexed and parsed cleanly, kept so
+// the next one lexes and parses again only around the edits since. Tokens
+// alternate between the two arenas: a new buffer is built from the current
+// one in the other. Statements stay in their arena while they are reused; a
+// full parse moves to the other one unless the published results still
+// refer to that.
+typedef struct {
+  ArenaAllocator token_arenas[2];
+  TokenBuffer buffers[2];
+  int current;
+  ArenaAllocator ast_arenas[2];
+  int ast_current;
+  int ast_published; // -1 when no published scope refers to either
+
+  bool valid; // Whether buffers[current] and decls can be reused
+  LSPDecl *decls;
+  size_t decl_count;
+  size_t header_tokens; // Tokens of the module declaration
+  const char *module_name;
+  char *module_doc;
+  int module_line;
+  int module_col;
+
+  // Tokens parsed into the statement arena since it was last reset;
+  // statements that were replaced are still in it
+  size_t parsed_tokens;
+
+  // Edits since the last clean parse, which the next parse starts from
+  bool changed;
+  LSPTextSpan change;
+} LSPSyntax;
+
+// An analysis a document is waiting for, until the worker takes it. Edits
+// made meanwhile replace the text and merge into the change.
+typedef struct {
+  bool queued;
+  char *text; // malloc'd
+  int version;
+  size_t generation;
+  bool changed; // Since the text of the request before
+  LSPTextSpan change;
+  bool reload_imports; // Opened or saved: modules on disk may differ
+} LSPAnalysisRequest;
+
+// A module the documents import, parsed and typechecked once for all of
+// them (see lsp_module_cache.c). Entries are shared read-only, and live
+// while the cache or anything checked against them holds a reference.
+typedef struct LSPModule LSPModule;
+struct LSPModule {
+  char *uri; // malloc'd
+  uint64_t content_hash;
+  long mtime; // Of the file read, -1 to read it again regardless
+  long size;
+  bool from_document; // The text of an open document, not its file
+
+  AstNode *module; // NULL if it didn't parse
+  Scope *scope;    // Its checked module scope, NULL if it wasn't checked
+  bool ok;         // Whether it typechecked
+  uint64_t interface; // See module_interface_signature
+
+  // The modules it imports (NULL where one couldn't be had), and the
+  // interfaces they had when it was checked against them
+  const char **import_paths;
+  LSPModule **imports;
+  uint64_t *import_interfaces;
+  size_t import_count;
+
+  // What parsing and checking it reported, replayed into each analysis
+  // using it
+  ErrorInformation *errors;
+  int error_count;
+
+  size_t stamp;  // The last analysis that found it current
+  bool current;  // What the cache hands out for its URI
+  bool visiting; // Being checked or built: importing it again is a cycle
+  int refs;
+  ArenaAllocator arena;
+};
+
+typedef struct {
+  LSPModule **modules; // The current entry of each URI (malloc'd)
+  size_t count;
+  size_t capacity;
+  size_t stamp;       // Bumped by every analysis
+  BuildConfig config; // What the entries were checked with
+} LSPModuleCache;
+
+// What one analysis of a document produced. The worker fills one in its
+// own arena, and the document takes it over when it is published.
+typedef struct {
+  const char *content; // The text analyzed, in the arena
+  int version;
+  Token *tokens;
+  size_t token_count;
+  const LineTable *lines; // In the syntax's tokens, for diagnostics
+  AstNode *ast;
+  Scope *scope;
+  // Function bodies reused from the server's body cache, whose scopes are
+  // filled in as the results are published
+  PendingBodies *pending_bodies;
+  LSPDiagnostic *diagnostics;
+  size_t diagnostic_count;
+  ImportedModule *imports;
+  size_t import_count;
+  // The cached modules its scope refers to, each holding a reference
+  LSPModule **modules;
+  size_t module_count;
+  ArenaAllocator *arena;
+} LSPAnalysis;
+
 typedef struct {
   // Document identity
   const char *uri;
-  const char *content;
-  int version;
+  int version; // Of the text, which may be ahead of the analysis
+  LSPPieceTable text;
 
-  // Analysis results (cached)
+  // Results of the last published analysis, which requests answer from
+  // while the worker analyzes newer text (see lsp_analysis.c)
+  const char *content; // The text they are about
+  int analyzed_version;
   Token *tokens;
   size_t token_count;
   AstNode *ast;
@@ -248,22 +562,32 @@ typedef struct {
   // Module imports
   ImportedModule *imports;
   size_t import_count;
+  LSPModule **modules; // Referenced by the scope (see LSPAnalysis)
+  size_t module_count;
+
+  // Built by the first completion from the published results, in their
+  // arena, and dropped with them
+  LSPCompletionIndex *completion_index;
+
+  // The semantic tokens last sent in full or as a delta, which the next
+  // delta request is diffed against (malloc'd, the main thread's alone)
+  uint32_t *semantic_tokens;
+  size_t semantic_token_count;
+  unsigned semantic_result_id;
 
   // Memory & state
-  ArenaAllocator *arena;
+  ArenaAllocator *arena; // Holds the published results
   bool needs_reanalysis;
-} LSPDocument;
 
-// Cache entry for a parsed dependency module AST.
-// Invalidated when the file's mtime changes — so deps are only re-parsed
-// when actually saved, not on every keystroke of the open document.
-typedef struct {
-  const char *uri;    // file:// URI of the dependency
-  AstNode    *ast;    // result of parse() — owned by cache_arena
-  long        mtime;  // st_mtime when last parsed (time_t is long on all targets)
-} ModuleASTCacheEntry;
+  // Guarded by the server's queue_lock: bumped by every edit, so an
+  // analysis of older text knows to give up
+  size_t generation;
+  LSPAnalysisRequest request;
 
-#define MODULE_AST_CACHE_MAX 128
+  // The worker's alone
+  LSPSyntax syntax;
+  LSPAnalysis work;
+} LSPDocument;
 
 typedef struct {
   // Document tracking
@@ -273,12 +597,31 @@ typedef struct {
 
   // Module registry for workspace
   ModuleRegistry module_registry;
-
-  // Per-URI AST cache for dependency modules.
-  // parse_imported_module_ast() checks here before touching the filesystem.
-  ModuleASTCacheEntry ast_cache[MODULE_AST_CACHE_MAX];
-  size_t              ast_cache_count;
-  ArenaAllocator      cache_arena; // owns all cached AST memory
+  // Names lookup_module found nowhere, until a document is opened or saved
+  LSPAtomTable missing_modules;
+
+  // Imported modules, checked once for every document importing them
+  LSPModuleCache module_cache;
+
+  // Results of function bodies, reused by later analyses of any document
+  BodyCache *body_cache;
+
+  // Top-level names of the workspace and their occurrences
+  LSPSymbolIndex symbol_index;
+
+  // Analyses run one at a time on the worker thread. It holds
+  // compiler_lock while it analyzes, since the caches above, the module
+  // registry, the document list and the server arena are only safe from
+  // one thread, and snapshot_lock while it publishes results, which
+  // requests hold while they read them. queue_lock guards the documents'
+  // requests and generations.
+  pthread_t worker;
+  bool worker_started;
+  bool worker_stopping;
+  pthread_mutex_t queue_lock;
+  pthread_cond_t queue_cond;
+  pthread_mutex_t compiler_lock;
+  pthread_mutex_t snapshot_lock;
 
   // Server state
   ArenaAllocator *arena;
@@ -293,7 +636,13 @@ typedef struct {
 bool lsp_server_init(LSPServer *server, ArenaAllocator *arena);
 void lsp_server_run(LSPServer *server);
 void lsp_server_shutdown(LSPServer *server);
-void lsp_handle_message(LSPServer *server, const char *message);
+void lsp_handle_message(LSPServer *server, char *message, size_t length);
+
+// Session recording for bench/lsp_replay.py (LUMA_LSP_RECORD, see
+// lsp_server.c)
+bool lsp_record_begin(bool incoming, size_t length);
+void lsp_record_write(const char *data, size_t length);
+void lsp_record_end(void);
 
 // ============================================================================
 // DOCUMENT MANAGEMENT
@@ -302,11 +651,45 @@ void lsp_handle_message(LSPServer *server, const char *message);
 LSPDocument *lsp_document_open(LSPServer *server, const char *uri,
                                const char *content, int version);
 bool lsp_document_update(LSPServer *server, const char *uri,
-                         const char *content, int version);
+                         const LSPTextChange *changes, size_t change_count,
+                         int version);
 bool lsp_document_close(LSPServer *server, const char *uri);
 LSPDocument *lsp_document_find(LSPServer *server, const char *uri);
 bool lsp_document_analyze(LSPDocument *doc, LSPServer *server,
+                          const LSPAnalysisRequest *request,
                           BuildConfig *config);
+void lsp_document_publish(LSPDocument *doc, LSPServer *server);
+
+// Background analysis (see LSPServer)
+void lsp_worker_start(LSPServer *server);
+void lsp_worker_stop(LSPServer *server);
+void lsp_analysis_schedule(LSPServer *server, LSPDocument *doc,
+                           bool reload_imports);
+void lsp_analysis_cancel(LSPServer *server, LSPDocument *doc);
+void lsp_workspace_index_schedule(LSPServer *server);
+bool lsp_analysis_stale(LSPServer *server, const LSPDocument *doc,
+                        size_t generation);
+
+// Piece table behind each document's text (all memory is malloc'd and
+// owned by the table)
+bool piece_table_init(LSPPieceTable *table, const char *text);
+void piece_table_free(LSPPieceTable *table);
+bool piece_table_set(LSPPieceTable *table, const char *text);
+bool piece_table_replace(LSPPieceTable *table, LSPRange range,
+                         const char *text);
+const char *piece_table_text(LSPPieceTable *table);
+size_t piece_table_line_before(const LSPPieceTable *table, LSPPosition pos,
+                               char *out, size_t size);
+bool piece_table_take_changes(LSPPieceTable *table, LSPTextSpan *change);
+void lsp_text_span_add(LSPTextSpan *span, bool *changed, LSPTextSpan edit);
+
+// Incremental lexing and parsing of a document (see LSPSyntax)
+void lsp_syntax_init(LSPSyntax *syntax);
+void lsp_syntax_free(LSPSyntax *syntax);
+AstNode *lsp_syntax_parse(LSPSyntax *syntax, const char *text,
+                          BuildConfig *config, ArenaAllocator *arena,
+                          const TokenBuffer **tokens);
+void lsp_syntax_forget(LSPSyntax *syntax);
 
 // ============================================================================
 // MODULE & IMPORT RESOLUTION
@@ -314,21 +697,58 @@ bool lsp_document_analyze(LSPDocument *doc, LSPServer *server,
 
 void scan_std_library(LSPServer *server);
 void extract_imports(LSPDocument *doc, ArenaAllocator *arena);
-void resolve_imports(LSPServer *server, LSPDocument *doc, BuildConfig *config,
-                     GrowableArray *imported_modules);
+const char *extract_module_name(const char *content, ArenaAllocator *arena);
 void build_module_registry(LSPServer *server, const char *workspace_uri);
 const char *lookup_module(LSPServer *server, const char *module_name);
-AstNode *parse_imported_module_ast(LSPServer *server, const char *module_uri,
-                                   BuildConfig *config, ArenaAllocator *arena);
-
-// Module AST cache — call after lsp_server_init
-void lsp_ast_cache_init(LSPServer *server);
-// Invalidate a single URI (call when a file is saved/changed)
-void lsp_ast_cache_invalidate(LSPServer *server, const char *uri);
-// Clear the module-not-found negative cache (call on didOpen/didSave)
-void lsp_negative_cache_clear(void);
+
+// The workspace module index (see ModuleRegistry)
+const char *lsp_module_registry_find(LSPServer *server, Atom module_name,
+                                     bool refresh);
+const char *lsp_module_registry_add(LSPServer *server, Atom module_name,
+                                    const char *path);
+void lsp_module_registry_update(LSPServer *server, const char *uri);
+void lsp_module_registry_save(LSPServer *server);
+void lsp_module_registry_free(ModuleRegistry *registry);
+
+// Shared cache of imported modules (see LSPModule)
+void lsp_module_cache_init(LSPModuleCache *cache);
+void lsp_module_cache_free(LSPModuleCache *cache);
+void lsp_module_cache_begin(LSPServer *server, const BuildConfig *config);
+void lsp_module_cache_reload(LSPServer *server, const char *uri);
+LSPModule *lsp_module_get(LSPServer *server, const char *uri);
+bool lsp_module_closure(LSPModule *module, GrowableArray *closure);
+void lsp_module_retain(LSPModule *module);
+void lsp_module_release(LSPModule *module);
+void lsp_modules_release(LSPModule **modules, size_t count);
+char *lsp_read_file(const char *path, long *size);
+// Forget the modules lookup_module found nowhere (on didOpen/didSave)
+void lsp_missing_modules_clear(LSPServer *server);
 void lsp_check_pending_analysis(LSPServer *server);
 
+// Workspace symbol index (see LSPSymbolIndex)
+void lsp_symbol_index_init(LSPSymbolIndex *index);
+void lsp_symbol_index_free(LSPSymbolIndex *index);
+void lsp_symbol_index_update(LSPSymbolIndex *index, const char *uri,
+                             const char *module_name, const Token *tokens,
+                             size_t token_count, const ImportedModule *imports,
+                             size_t import_count, Scope *module_scope,
+                             long mtime);
+void lsp_symbol_index_update_text(LSPSymbolIndex *index, const char *uri,
+                                  const char *text, Scope *module_scope,
+                                  long mtime);
+void lsp_symbol_index_rescan(LSPSymbolIndex *index);
+bool lsp_symbol_index_scan_pending(LSPSymbolIndex *index);
+bool lsp_symbol_index_scan(LSPServer *server);
+size_t lsp_symbol_index_at(LSPSymbolIndex *index, const char *uri,
+                           LSPPosition position);
+LSPLocation *lsp_symbol_index_locations(LSPSymbolIndex *index, size_t symbol,
+                                        bool definitions, const char *uri,
+                                        size_t *count, bool **is_definition,
+                                        ArenaAllocator *arena);
+LSPWorkspaceSymbol *lsp_symbol_index_search(LSPSymbolIndex *index,
+                                            const char *query, size_t *count,
+                                            ArenaAllocator *arena);
+
 // ============================================================================
 // LSP FEATURES (Hover, Definition, Completion, etc.)
 // ============================================================================
@@ -340,22 +760,40 @@ LSPLocation *lsp_definition(LSPDocument *doc, LSPServer *server,
                             ArenaAllocator *arena);
 LSPCompletionItem *lsp_completion(LSPDocument *doc, LSPPosition position,
                                   size_t *completion_count,
-                                  ArenaAllocator *arena);
+                                  bool *is_incomplete, ArenaAllocator *arena);
 LSPCompletionItem *lsp_completion_resolve(LSPCompletionItem *item,
                                           ArenaAllocator *arena);
+LSPCompletionIndex *lsp_completion_index_build(const LSPCompletionItem *items,
+                                               size_t count,
+                                               ArenaAllocator *arena);
+LSPCompletionItem *lsp_completion_index_query(LSPCompletionIndex *index,
+                                              const char *prefix,
+                                              size_t *count,
+                                              bool *is_incomplete,
+                                              ArenaAllocator *arena);
 LSPSignatureInfo *lsp_signature_help(LSPDocument *doc, LSPPosition position,
                                      size_t *signature_count,
                                      ArenaAllocator *arena);
 LSPCodeAction *lsp_code_action(LSPDocument *doc, LSPPosition position,
                                size_t *action_count, ArenaAllocator *arena);
 LSPDocumentHighlight *lsp_document_highlight(LSPDocument *doc,
+                                             LSPServer *server,
                                              LSPPosition position,
                                              size_t *highlight_count,
                                              ArenaAllocator *arena);
-const char *lsp_rename(LSPDocument *doc, LSPPosition position,
-                       const char *new_name, ArenaAllocator *arena);
+LSPLocation *lsp_references(LSPDocument *doc, LSPServer *server,
+                            LSPPosition position, bool include_declaration,
+                            size_t *location_count, ArenaAllocator *arena);
+LSPLocation *lsp_rename(LSPDocument *doc, LSPServer *server,
+                        LSPPosition position, size_t *location_count,
+                        ArenaAllocator *arena);
+LSPWorkspaceSymbol *lsp_workspace_symbols(LSPServer *server, const char *query,
+                                          size_t *symbol_count,
+                                          ArenaAllocator *arena);
 LSPDocumentSymbol **lsp_document_symbols(LSPDocument *doc, size_t *symbol_count,
                                          ArenaAllocator *arena);
+LSPTextEdit *lsp_format(LSPDocument *doc, const LSPRange *range,
+                        size_t *edit_count, ArenaAllocator *arena);
 LSPDiagnostic *lsp_diagnostics(LSPDocument *doc, size_t *diagnostic_count,
                                ArenaAllocator *arena);
 LSPDiagnostic *convert_errors_to_diagnostics(size_t *diagnostic_count,
@@ -365,33 +803,126 @@ LSPDiagnostic *convert_errors_to_diagnostics(size_t *diagnostic_count,
 // JSON-RPC PROTOCOL
 // ============================================================================
 
-LSPMethod lsp_parse_method(const char *json);
+// A parsed message is a tape of values in document order: a container is
+// followed by its elements (an object's as key, value pairs), and each
+// value's span counts the entries it covers, so its next sibling is
+// value + span. Strings are decoded in place in the message text.
+typedef enum {
+  JSON_NULL,
+  JSON_FALSE,
+  JSON_TRUE,
+  JSON_NUMBER,
+  JSON_STRING,
+  JSON_ARRAY,
+  JSON_OBJECT
+} JsonKind;
+
+typedef struct {
+  JsonKind kind;
+  uint32_t span;    // Entries this value covers, its own included
+  uint32_t count;   // An array's elements, an object's members
+  uint32_t length;  // A string's decoded length
+  const char *text; // A string's decoded text, a number's digits
+} JsonValue;
+
+typedef struct {
+  JsonValue *values; // values[0] is the root
+  size_t count;
+  size_t capacity;
+} JsonDocument;
+
+bool json_parse(JsonDocument *doc, char *text, size_t length);
+void json_document_free(JsonDocument *doc);
+const JsonValue *json_get(const JsonValue *object, const char *key);
+const JsonValue *json_first(const JsonValue *array);
+const JsonValue *json_next(const JsonValue *array, const JsonValue *element);
+const char *json_as_string(const JsonValue *value);
+int json_as_int(const JsonValue *value, int fallback);
+
+// One message from the client
+typedef struct {
+  JsonDocument json;
+  LSPMethod method;
+  const char *method_name; // NULL for a response to one of our requests
+  int id;                  // -1 for a notification
+  const JsonValue *params;
+} LSPMessage;
+
+bool lsp_message_parse(LSPMessage *message, char *text, size_t length);
+void lsp_message_free(LSPMessage *message);
+LSPMethod lsp_parse_method(const char *method_name);
+
+// JSON written into chunks that never move, so a large response is
+// neither cut off nor copied as it grows. lsp_message_send writes the
+// chunks to stdout behind their Content-Length.
+#define JSON_WRITER_DEPTH 32
+
+typedef struct JsonChunk JsonChunk;
+
+typedef struct {
+  JsonChunk *head;
+  JsonChunk *tail;
+  size_t length;
+  bool failed; // Out of memory or nested too deep: nothing is sent
+  int depth;
+  bool has_items[JSON_WRITER_DEPTH]; // The open containers' first is written
+  bool after_key;
+} JsonWriter;
+
+void json_writer_init(JsonWriter *w);
+void json_writer_free(JsonWriter *w);
+void json_begin_object(JsonWriter *w);
+void json_end_object(JsonWriter *w);
+void json_begin_array(JsonWriter *w);
+void json_end_array(JsonWriter *w);
+void json_write_key(JsonWriter *w, const char *key);
+void json_write_string(JsonWriter *w, const char *text);
+void json_write_string_n(JsonWriter *w, const char *text, size_t length);
+void json_write_int(JsonWriter *w, long long value);
+void json_write_bool(JsonWriter *w, bool value);
+void json_write_null(JsonWriter *w);
+// A value already in JSON, written as it is
+void json_write_raw(JsonWriter *w, const char *json);
+void json_write_escaped(JsonWriter *w, const char *text);
+void json_write_range(JsonWriter *w, const char *key, LSPRange range);
+
+// A message is begun, its result (or params) written as the next value,
+// and then sent; sending frees the writer
+void lsp_response_begin(JsonWriter *w, int id);
+void lsp_notification_begin(JsonWriter *w, const char *method);
+void lsp_request_begin(JsonWriter *w, const char *method);
+void lsp_message_send(JsonWriter *w);
+
 void lsp_send_response(int id, const char *result);
 void lsp_send_request(const char *method, const char *params);
 void lsp_send_notification(const char *method, const char *params);
 void lsp_send_error(int id, int code, const char *message);
 
-// JSON extraction helpers
-char *extract_string(const char *json, const char *key, ArenaAllocator *arena);
-int extract_int(const char *json, const char *key);
-LSPPosition extract_position(const char *json);
-
 // JSON serialization helpers
-size_t json_escape(char *dst, size_t dst_size, const char *src);
-void serialize_diagnostics_to_json(const char *uri, LSPDiagnostic *diagnostics,
-                                   size_t diag_count, char *output,
-                                   size_t output_size);
-void serialize_completion_items(LSPCompletionItem *items, size_t count,
-                                char *output, size_t output_size);
-void serialize_signature_help(LSPSignatureInfo *sig, char *output,
-                              size_t output_size);
-void serialize_code_actions(LSPCodeAction *actions, size_t count,
-                            char *output, size_t output_size);
-void serialize_document_highlights(LSPDocumentHighlight *highlights,
-                                   size_t count, char *output,
-                                   size_t output_size);
-const char *serialize_rename_result(const char *edit_json,
-                                    ArenaAllocator *arena);
+void serialize_diagnostics_to_json(JsonWriter *w, const char *uri,
+                                   const LSPDiagnostic *diagnostics,
+                                   size_t diag_count);
+void serialize_completion_item(JsonWriter *w, const LSPCompletionItem *item);
+void serialize_completion_items(JsonWriter *w, const LSPCompletionItem *items,
+                                size_t count, bool is_incomplete);
+void serialize_signature_help(JsonWriter *w, const LSPSignatureInfo *sig);
+void serialize_code_actions(JsonWriter *w, const LSPCodeAction *actions,
+                            size_t count);
+void serialize_document_highlights(JsonWriter *w,
+                                   const LSPDocumentHighlight *highlights,
+                                   size_t count);
+void serialize_document_symbols(JsonWriter *w, LSPDocumentSymbol **symbols,
+                                size_t count);
+void serialize_location(JsonWriter *w, const LSPLocation *location);
+void serialize_locations(JsonWriter *w, const LSPLocation *locations,
+                         size_t count);
+void serialize_workspace_edit(JsonWriter *w, const LSPLocation *locations,
+                              size_t count, const char *new_text);
+void serialize_workspace_symbols(JsonWriter *w,
+                                 const LSPWorkspaceSymbol *symbols,
+                                 size_t count);
+void serialize_text_edits(JsonWriter *w, const LSPTextEdit *edits,
+                          size_t count);
 
 // ============================================================================
 // UTILITY FUNCTIONS
@@ -406,5 +937,10 @@ Token *lsp_token_at_position(LSPDocument *doc, LSPPosition position);
 AstNode *lsp_node_at_position(LSPDocument *doc, LSPPosition position);
 Symbol *lsp_symbol_at_position(LSPDocument *doc, LSPPosition position);
 
-char *lsp_semantic_tokens_full(LSPDocument *doc, ArenaAllocator *arena);
+void lsp_semantic_tokens_full(LSPDocument *doc, JsonWriter *w);
+void lsp_semantic_tokens_delta(LSPDocument *doc, const char *previous_result_id,
+                               JsonWriter *w);
+void lsp_semantic_tokens_range(LSPDocument *doc, LSPRange range,
+                               JsonWriter *w);
+void lsp_semantic_tokens_free(LSPDocument *doc);
 const char *lsp_semantic_tokens_capabilities(void);
\ No newline at end of file
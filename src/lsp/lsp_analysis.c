@@ -0,0 +1,203 @@
+#include "../helper/help.h"
+#include "lsp.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Analyses run on one worker thread, so hover, completion and the other
+// requests are answered from a document's published results while newer
+// text is analyzed. Each edit bumps the document's generation; an analysis
+// of an older one gives up at its next stage and never replaces the
+// results. A document has at most one request waiting, and edits made
+// before the worker takes it are merged into it.
+
+// A document with an analysis to run, under queue_lock
+static LSPDocument *next_request(LSPServer *server) {
+  for (size_t i = 0; i < server->document_count; i++) {
+    if (server->documents[i]->request.queued)
+      return server->documents[i];
+  }
+  return NULL;
+}
+
+static void publish_diagnostics(LSPDocument *doc) {
+  ArenaAllocator arena;
+  arena_allocator_init(&arena, 64 * 1024);
+
+  size_t diag_count;
+  LSPDiagnostic *diagnostics = lsp_diagnostics(doc, &diag_count, &arena);
+
+  JsonWriter w;
+  lsp_notification_begin(&w, "textDocument/publishDiagnostics");
+  serialize_diagnostics_to_json(&w, doc->uri, diagnostics, diag_count);
+  lsp_message_send(&w);
+  arena_destroy(&arena);
+
+  // Tell the client to re-request semantic tokens, which now come from the
+  // results just published
+  lsp_send_request("workspace/semanticTokens/refresh", "null");
+}
+
+static void run_analysis(LSPServer *server, LSPDocument *doc,
+                         const LSPAnalysisRequest *request) {
+  BuildConfig config = {0};
+  config.check_mem = true;
+  config.target_os = detect_target_os();
+  config.body_cache = server->body_cache;
+
+  // Opened or saved: modules missing before may exist now, and this file
+  // may declare another name
+  if (request->reload_imports) {
+    lsp_module_cache_reload(server, doc->uri);
+    lsp_module_registry_update(server, doc->uri);
+    lsp_missing_modules_clear(server);
+    lsp_symbol_index_rescan(&server->symbol_index);
+  }
+
+  if (!lsp_document_analyze(doc, server, request, &config)) {
+    fprintf(stderr, "[LSP] Dropped analysis of %s (version %d)\n", doc->uri,
+            request->version);
+    return;
+  }
+  lsp_document_publish(doc, server);
+  publish_diagnostics(doc);
+}
+
+static void *worker_main(void *arg) {
+  LSPServer *server = arg;
+
+  pthread_mutex_lock(&server->queue_lock);
+  while (!server->worker_stopping) {
+    if (!next_request(server)) {
+      // Idle: the symbol index reads what it lacks of the workspace, a
+      // batch at a time so an analysis queued meanwhile waits little
+      if (lsp_symbol_index_scan_pending(&server->symbol_index)) {
+        pthread_mutex_unlock(&server->queue_lock);
+        pthread_mutex_lock(&server->compiler_lock);
+        lsp_symbol_index_scan(server);
+        pthread_mutex_unlock(&server->compiler_lock);
+        pthread_mutex_lock(&server->queue_lock);
+        continue;
+      }
+      pthread_cond_wait(&server->queue_cond, &server->queue_lock);
+      continue;
+    }
+    pthread_mutex_unlock(&server->queue_lock);
+
+    // Taken again under compiler_lock: the document may have been closed
+    pthread_mutex_lock(&server->compiler_lock);
+    pthread_mutex_lock(&server->queue_lock);
+    LSPDocument *doc = next_request(server);
+    LSPAnalysisRequest request = {0};
+    if (doc) {
+      request = doc->request;
+      doc->request = (LSPAnalysisRequest){0};
+    }
+    pthread_mutex_unlock(&server->queue_lock);
+
+    if (doc)
+      run_analysis(server, doc, &request);
+    free(request.text);
+    pthread_mutex_unlock(&server->compiler_lock);
+
+    pthread_mutex_lock(&server->queue_lock);
+  }
+  pthread_mutex_unlock(&server->queue_lock);
+  return NULL;
+}
+
+void lsp_worker_start(LSPServer *server) {
+  pthread_mutex_init(&server->queue_lock, NULL);
+  pthread_cond_init(&server->queue_cond, NULL);
+  pthread_mutex_init(&server->compiler_lock, NULL);
+  pthread_mutex_init(&server->snapshot_lock, NULL);
+  server->worker_stopping = false;
+  server->worker_started =
+      pthread_create(&server->worker, NULL, worker_main, server) == 0;
+  if (!server->worker_started)
+    fprintf(stderr, "[LSP] Failed to start the analysis thread\n");
+}
+
+// Waits for the analysis running, if any; the ones queued are dropped
+void lsp_worker_stop(LSPServer *server) {
+  if (!server->worker_started)
+    return;
+  pthread_mutex_lock(&server->queue_lock);
+  server->worker_stopping = true;
+  pthread_cond_signal(&server->queue_cond);
+  pthread_mutex_unlock(&server->queue_lock);
+  pthread_join(server->worker, NULL);
+  server->worker_started = false;
+}
+
+// Queues an analysis of the document's current text. Without a worker
+// (it failed to start) the analysis runs right away instead.
+void lsp_analysis_schedule(LSPServer *server, LSPDocument *doc,
+                           bool reload_imports) {
+  const char *text = piece_table_text(&doc->text);
+  char *copy = text ? strdup(text) : NULL;
+  if (!copy) {
+    fprintf(stderr, "[LSP] No text to analyze for %s\n", doc->uri);
+    return;
+  }
+  LSPTextSpan change;
+  bool changed = piece_table_take_changes(&doc->text, &change);
+  doc->needs_reanalysis = false;
+
+  pthread_mutex_lock(&server->queue_lock);
+  LSPAnalysisRequest *request = &doc->request;
+  if (!request->queued)
+    *request = (LSPAnalysisRequest){0};
+  free(request->text);
+  request->queued = true;
+  request->text = copy;
+  request->version = doc->version;
+  request->generation = doc->generation;
+  if (changed)
+    lsp_text_span_add(&request->change, &request->changed, change);
+  request->reload_imports = request->reload_imports || reload_imports;
+  pthread_cond_signal(&server->queue_cond);
+  pthread_mutex_unlock(&server->queue_lock);
+
+  if (!server->worker_started) {
+    pthread_mutex_lock(&server->compiler_lock);
+    pthread_mutex_lock(&server->queue_lock);
+    LSPAnalysisRequest taken = doc->request;
+    doc->request = (LSPAnalysisRequest){0};
+    pthread_mutex_unlock(&server->queue_lock);
+    run_analysis(server, doc, &taken);
+    free(taken.text);
+    pthread_mutex_unlock(&server->compiler_lock);
+  }
+}
+
+// Has the worker read the workspace's files into the symbol index. Without
+// a worker they are read right away instead.
+void lsp_workspace_index_schedule(LSPServer *server) {
+  lsp_symbol_index_rescan(&server->symbol_index);
+  if (!server->worker_started) {
+    pthread_mutex_lock(&server->compiler_lock);
+    while (lsp_symbol_index_scan(server))
+      ;
+    pthread_mutex_unlock(&server->compiler_lock);
+    return;
+  }
+  pthread_mutex_lock(&server->queue_lock);
+  pthread_cond_signal(&server->queue_cond);
+  pthread_mutex_unlock(&server->queue_lock);
+}
+
+// The document's text changed: an analysis running is of older text
+void lsp_analysis_cancel(LSPServer *server, LSPDocument *doc) {
+  pthread_mutex_lock(&server->queue_lock);
+  doc->generation++;
+  pthread_mutex_unlock(&server->queue_lock);
+}
+
+bool lsp_analysis_stale(LSPServer *server, const LSPDocument *doc,
+                        size_t generation) {
+  pthread_mutex_lock(&server->queue_lock);
+  bool stale = doc->generation != generation;
+  pthread_mutex_unlock(&server->queue_lock);
+  return stale;
+}
@@ -0,0 +1,234 @@
+// lsp_completion_index.c - Completion candidates of a published analysis
+//
+// The first completion request after an analysis is published collects its
+// candidates once into an index in the results' arena: one entry per label
+// and kind, sorted by lowercased filter text. A request then only matches
+// the word before the cursor against it. A candidate matches when the word
+// is a subsequence of its filter text, and is scored higher for a prefix
+// match, for runs of consecutive characters and for starting at word
+// boundaries. The matches of the last query are kept, so typing one more
+// character only narrows them down. Results beyond LSP_COMPLETION_PAGE are
+// left out and the list is marked incomplete, so the client asks again as
+// the word grows.
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lsp.h"
+
+typedef struct {
+  uint32_t entry;
+  int score;
+} CompletionMatch;
+
+static char *lowercase(const char *text, ArenaAllocator *arena) {
+  size_t length = strlen(text);
+  char *lower = arena_alloc(arena, length + 1, 1);
+  if (!lower)
+    return NULL;
+  for (size_t i = 0; i < length; i++)
+    lower[i] = (char)tolower((unsigned char)text[i]);
+  lower[length] = '\0';
+  return lower;
+}
+
+static const char *filter_of(const LSPCompletionItem *item) {
+  return item->filter_text ? item->filter_text : item->label;
+}
+
+// The order of entries with the same filter text, and of an unfiltered
+// list: the items' own sort text, then their labels
+static int compare_ranked(const LSPCompletionItem *a,
+                          const LSPCompletionItem *b) {
+  int order = strcmp(a->sort_text ? a->sort_text : "",
+                     b->sort_text ? b->sort_text : "");
+  return order ? order : strcmp(a->label, b->label);
+}
+
+static const LSPCompletionItem *sort_items;
+static const char **sort_keys;
+
+static int compare_entries(const void *a, const void *b) {
+  uint32_t i = *(const uint32_t *)a, j = *(const uint32_t *)b;
+  int order = strcmp(sort_keys[i], sort_keys[j]);
+  return order ? order : compare_ranked(&sort_items[i], &sort_items[j]);
+}
+
+LSPCompletionIndex *lsp_completion_index_build(const LSPCompletionItem *items,
+                                               size_t count,
+                                               ArenaAllocator *arena) {
+  LSPCompletionIndex *index =
+      arena_alloc(arena, sizeof(LSPCompletionIndex), alignof(LSPCompletionIndex));
+  if (!index)
+    return NULL;
+  *index = (LSPCompletionIndex){0};
+
+  const char **keys = arena_alloc(arena, (count + 1) * sizeof(char *),
+                                  alignof(const char *));
+  uint32_t *order =
+      arena_alloc(arena, (count + 1) * sizeof(uint32_t), alignof(uint32_t));
+  index->items = arena_alloc(arena, (count + 1) * sizeof(LSPCompletionItem),
+                             alignof(LSPCompletionItem));
+  index->keys = arena_alloc(arena, (count + 1) * sizeof(char *),
+                            alignof(const char *));
+  index->matches = arena_alloc(arena, (count + 1) * sizeof(uint32_t),
+                               alignof(uint32_t));
+  if (!keys || !order || !index->items || !index->keys || !index->matches)
+    return NULL;
+
+  for (size_t i = 0; i < count; i++) {
+    keys[i] = lowercase(filter_of(&items[i]), arena);
+    if (!keys[i])
+      return NULL;
+    order[i] = (uint32_t)i;
+  }
+
+  // Not reentrant, like everything else on the main thread's side
+  sort_items = items;
+  sort_keys = keys;
+  qsort(order, count, sizeof(uint32_t), compare_entries);
+
+  // The same name can be visible from many scopes: the best ranked of
+  // each label and kind stays, with the filter text it sorted under
+  for (size_t i = 0; i < count; i++) {
+    const LSPCompletionItem *item = &items[order[i]];
+    bool duplicate = false;
+    for (size_t j = index->count; j-- > 0;) {
+      if (strcmp(index->keys[j], keys[order[i]]) != 0)
+        break;
+      if (index->items[j].kind == item->kind &&
+          strcmp(index->items[j].label, item->label) == 0) {
+        duplicate = true;
+        break;
+      }
+    }
+    if (duplicate)
+      continue;
+    index->keys[index->count] = keys[order[i]];
+    index->items[index->count] = *item;
+    index->count++;
+  }
+
+  fprintf(stderr, "[LSP] completion index: %zu entries from %zu items\n",
+          index->count, count);
+  return index;
+}
+
+static bool is_boundary(const char *text, size_t i) {
+  if (i == 0)
+    return true;
+  unsigned char before = (unsigned char)text[i - 1];
+  unsigned char at = (unsigned char)text[i];
+  return !isalnum(before) || (islower(before) && isupper(at));
+}
+
+// How well `query` (lowercase) matches the entry, or -1 when it is not a
+// subsequence of its filter text
+static int fuzzy_score(const char *key, const char *text, const char *query) {
+  size_t query_length = strlen(query);
+  if (strncmp(key, query, query_length) == 0)
+    return 1000 - (int)(strlen(key) - query_length);
+
+  int score = 0;
+  size_t q = 0, last = (size_t)-1;
+  for (size_t i = 0; key[i] && query[q]; i++) {
+    if (key[i] != query[q])
+      continue;
+    score += 1;
+    if (last != (size_t)-1 && i == last + 1)
+      score += 5;
+    if (is_boundary(text, i))
+      score += 8;
+    if (q == 0)
+      score -= (int)i;
+    last = i;
+    q++;
+  }
+  return query[q] ? -1 : score;
+}
+
+static int compare_matches(const void *a, const void *b) {
+  const CompletionMatch *x = a, *y = b;
+  if (x->score != y->score)
+    return y->score > x->score ? 1 : -1;
+  int order = compare_ranked(&sort_items[x->entry], &sort_items[y->entry]);
+  return order ? order : (x->entry > y->entry) - (x->entry < y->entry);
+}
+
+LSPCompletionItem *lsp_completion_index_query(LSPCompletionIndex *index,
+                                              const char *prefix,
+                                              size_t *count,
+                                              bool *is_incomplete,
+                                              ArenaAllocator *arena) {
+  *count = 0;
+  *is_incomplete = false;
+  if (!index || !prefix)
+    return NULL;
+
+  size_t prefix_length = strlen(prefix);
+  if (prefix_length >= LSP_COMPLETION_PREFIX_MAX)
+    prefix_length = LSP_COMPLETION_PREFIX_MAX - 1;
+  char query[LSP_COMPLETION_PREFIX_MAX];
+  for (size_t i = 0; i < prefix_length; i++)
+    query[i] = (char)tolower((unsigned char)prefix[i]);
+  query[prefix_length] = '\0';
+
+  // Everything the last query matched, when this one only adds to it
+  size_t last_length = strlen(index->last_query);
+  bool narrowing = index->has_matches && last_length <= prefix_length &&
+                   strncmp(index->last_query, query, last_length) == 0;
+  size_t candidates = narrowing ? index->match_count : index->count;
+
+  CompletionMatch *matches =
+      arena_alloc(arena, (candidates + 1) * sizeof(CompletionMatch),
+                  alignof(CompletionMatch));
+  if (!matches)
+    return NULL;
+
+  size_t match_count = 0;
+  for (size_t i = 0; i < candidates; i++) {
+    uint32_t entry = narrowing ? index->matches[i] : (uint32_t)i;
+    int score = 0;
+    if (prefix_length) {
+      score = fuzzy_score(index->keys[entry], filter_of(&index->items[entry]),
+                          query);
+      if (score < 0)
+        continue;
+    }
+    matches[match_count++] = (CompletionMatch){entry, score};
+  }
+
+  // Kept in index order, so the next query walks them the same way
+  for (size_t i = 0; i < match_count; i++)
+    index->matches[i] = matches[i].entry;
+  index->match_count = match_count;
+  memcpy(index->last_query, query, prefix_length + 1);
+  index->has_matches = true;
+
+  sort_items = index->items;
+  qsort(matches, match_count, sizeof(CompletionMatch), compare_matches);
+
+  size_t page = match_count < LSP_COMPLETION_PAGE ? match_count
+                                                  : LSP_COMPLETION_PAGE;
+  LSPCompletionItem *result = arena_alloc(
+      arena, (page + 1) * sizeof(LSPCompletionItem), alignof(LSPCompletionItem));
+  if (!result)
+    return NULL;
+
+  for (size_t i = 0; i < page; i++) {
+    result[i] = index->items[matches[i].entry];
+    // Ranked here, so the client keeps this order
+    if (prefix_length) {
+      char sort[16];
+      snprintf(sort, sizeof(sort), "%04zu", i);
+      result[i].sort_text = arena_strdup(arena, sort);
+    }
+  }
+
+  fprintf(stderr, "[LSP] completion index: '%s' matched %zu of %zu%s\n",
+          query, match_count, candidates, narrowing ? " (narrowed)" : "");
+  *count = page;
+  *is_incomplete = match_count > page;
+  return result;
+}
@@ -15,50 +15,76 @@ LSPDocument *lsp_document_open(LSPServer *server, const char *uri,
     return NULL;
   }
 
+  // The server arena and the document list are shared with the worker
+  pthread_mutex_lock(&server->compiler_lock);
   LSPDocument *doc =
       arena_alloc(server->arena, sizeof(LSPDocument), alignof(LSPDocument));
-  if (!doc)
+  ArenaAllocator *arenas =
+      arena_alloc(server->arena, 2 * sizeof(ArenaAllocator),
+                  alignof(ArenaAllocator));
+  const char *doc_uri = arena_strdup(server->arena, uri);
+  if (!doc || !arenas || !doc_uri) {
+    pthread_mutex_unlock(&server->compiler_lock);
     return NULL;
+  }
+  memset(doc, 0, sizeof(*doc));
+
+  // The text lives in the document's own piece table, not the server arena
+  if (!piece_table_init(&doc->text, content)) {
+    piece_table_free(&doc->text);
+    pthread_mutex_unlock(&server->compiler_lock);
+    return NULL;
+  }
 
-  doc->uri = arena_strdup(server->arena, uri);
-  doc->content = arena_strdup(server->arena, content);
+  doc->uri = doc_uri;
   doc->version = version;
-  doc->tokens = NULL;
-  doc->token_count = 0;
-  doc->ast = NULL;
-  doc->scope = NULL;
-  doc->diagnostics = NULL;
-  doc->diagnostic_count = 0;
+  doc->analyzed_version = -1;
   doc->needs_reanalysis = true;
+  lsp_syntax_init(&doc->syntax);
 
-  doc->arena = arena_alloc(server->arena, sizeof(ArenaAllocator),
-                           alignof(ArenaAllocator));
-  arena_allocator_init(doc->arena, 4 * 1024 * 1024);
+  // Published results and the worker's next ones trade arenas
+  doc->arena = &arenas[0];
+  doc->work.arena = &arenas[1];
+  arena_allocator_init(doc->arena, 64 * 1024);
+  arena_allocator_init(doc->work.arena, 4 * 1024 * 1024);
 
+  pthread_mutex_lock(&server->queue_lock);
   server->documents[server->document_count++] = doc;
+  pthread_mutex_unlock(&server->queue_lock);
+  pthread_mutex_unlock(&server->compiler_lock);
 
   return doc;
 }
 
+// Applies didChange's content changes in order. Ranges refer to the text as
+// left by the changes before them.
 bool lsp_document_update(LSPServer *server, const char *uri,
-                         const char *content, int version) {
-  if (!server || !uri || !content)
+                         const LSPTextChange *changes, size_t change_count,
+                         int version) {
+  if (!server || !uri || !changes)
     return false;
 
   LSPDocument *doc = lsp_document_find(server, uri);
   if (!doc)
     return false;
 
-  doc->content = arena_strdup(server->arena, content);
+  for (size_t i = 0; i < change_count; i++) {
+    const LSPTextChange *change = &changes[i];
+    if (!change->text)
+      continue;
+    bool applied = change->has_range
+                       ? piece_table_replace(&doc->text, change->range,
+                                             change->text)
+                       : piece_table_set(&doc->text, change->text);
+    if (!applied)
+      return false;
+  }
+
+  // Requests keep answering from the last analysis until the next one is
+  // published; one still running is of older text now
   doc->version = version;
   doc->needs_reanalysis = true;
-
-  // Invalidate stale analysis data — tokens/ast/scope reference old arena memory
-  doc->tokens = NULL;
-  doc->token_count = 0;
-  doc->ast = NULL;
-  doc->diagnostics = NULL;
-  doc->diagnostic_count = 0;
+  lsp_analysis_cancel(server, doc);
 
   return true;
 }
@@ -67,21 +93,36 @@ bool lsp_document_close(LSPServer *server, const char *uri) {
   if (!server || !uri)
     return false;
 
+  // Waits for an analysis that may be of this document
+  pthread_mutex_lock(&server->compiler_lock);
+  pthread_mutex_lock(&server->queue_lock);
+  bool closed = false;
   for (size_t i = 0; i < server->document_count; i++) {
-    if (strcmp(server->documents[i]->uri, uri) == 0) {
-      if (server->documents[i]->arena) {
-        arena_destroy(server->documents[i]->arena);
-      }
+    LSPDocument *doc = server->documents[i];
+    if (strcmp(doc->uri, uri) == 0) {
+      free(doc->request.text);
+      doc->request = (LSPAnalysisRequest){0};
+      lsp_modules_release(doc->modules, doc->module_count);
+      lsp_modules_release(doc->work.modules, doc->work.module_count);
+      arena_destroy(doc->arena);
+      arena_destroy(doc->work.arena);
+      piece_table_free(&doc->text);
+      lsp_syntax_free(&doc->syntax);
+      lsp_semantic_tokens_free(doc);
+      doc->content = NULL;
 
       for (size_t j = i; j < server->document_count - 1; j++) {
         server->documents[j] = server->documents[j + 1];
       }
       server->document_count--;
-      return true;
+      closed = true;
+      break;
     }
   }
+  pthread_mutex_unlock(&server->queue_lock);
+  pthread_mutex_unlock(&server->compiler_lock);
 
-  return false;
+  return closed;
 }
 
 LSPDocument *lsp_document_find(LSPServer *server, const char *uri) {
@@ -97,267 +138,276 @@ LSPDocument *lsp_document_find(LSPServer *server, const char *uri) {
   return NULL;
 }
 
-// Recursively collect all module dependencies (transitive closure)
-static void collect_all_module_deps(LSPServer *server, const char *module_uri,
-                                    BuildConfig *config, ArenaAllocator *arena,
-                                    GrowableArray *all_modules,
-                                    GrowableArray *visited_uris) {
-  for (size_t i = 0; i < visited_uris->count; i++) {
-    const char *visited = ((const char **)visited_uris->data)[i];
-    if (strcmp(visited, module_uri) == 0) {
-      fprintf(stderr, "[LSP] Skipping already visited module: %s\n", module_uri);
-      return;
-    }
-  }
-
-  const char **visited_slot = (const char **)growable_array_push(visited_uris);
-  if (visited_slot) {
-    *visited_slot = arena_strdup(arena, module_uri);
-  }
-
-  fprintf(stderr, "[LSP] Collecting dependencies for: %s\n", module_uri);
-
-  AstNode *module_ast =
-      parse_imported_module_ast(server, module_uri, config, arena);
-
-  if (!module_ast) {
-    fprintf(stderr, "[LSP] Failed to parse module: %s\n", module_uri);
-    return;
-  }
-
-  const char *file_path = lsp_uri_to_path(module_uri, arena);
-  if (!file_path) {
-    fprintf(stderr, "[LSP] Failed to convert URI to path: %s\n", module_uri);
-    return;
-  }
-
-  FILE *f = fopen(file_path, "r");
-  if (!f) {
-    fprintf(stderr, "[LSP] Failed to open file: %s\n", file_path);
-    return;
-  }
-
-  fseek(f, 0, SEEK_END);
-  long size = ftell(f);
-  fseek(f, 0, SEEK_SET);
-
-  char *content = arena_alloc(arena, size + 1, 1);
-  if (!content) { fclose(f); return; }
-  size_t nread = fread(content, 1, size, f);
-  content[nread] = '\0';
-  fclose(f);
-
-  LSPDocument temp_doc = {0};
-  temp_doc.content = content;
-  temp_doc.arena = arena;
-
-  extract_imports(&temp_doc, arena);
-
-  fprintf(stderr, "[LSP] Module %s has %zu imports\n", module_uri,
-          temp_doc.import_count);
-
-  for (size_t i = 0; i < temp_doc.import_count; i++) {
-    const char *imported_module_path = temp_doc.imports[i].module_path;
-    const char *resolved_uri = lookup_module(server, imported_module_path);
-
-    if (resolved_uri) {
-      fprintf(stderr, "[LSP] Recursively processing import: %s -> %s\n",
-              imported_module_path, resolved_uri);
-      collect_all_module_deps(server, resolved_uri, config, arena, all_modules,
-                              visited_uris);
-    } else {
-      fprintf(stderr, "[LSP] Warning: Could not resolve import '%s' in %s\n",
-              imported_module_path, module_uri);
-    }
-  }
-
-  AstNode **slot = (AstNode **)growable_array_push(all_modules);
-  if (slot) {
-    *slot = module_ast;
-    fprintf(stderr, "[LSP] Added module to list: %s (total: %zu)\n", module_uri,
-            all_modules->count);
-  }
-}
-
+// Analyzes the text of `request` into doc->work, on the worker thread.
+// Returns whether the results are worth publishing: false once an edit
+// made them stale, checked between the stages.
 bool lsp_document_analyze(LSPDocument *doc, LSPServer *server,
+                          const LSPAnalysisRequest *request,
                           BuildConfig *config) {
-  if (!doc || !doc->needs_reanalysis)
-    return true;
+  if (!doc || !request || !request->text)
+    return false;
 
-  // Save the last successful scope (allocated in server->arena, survives arena_destroy)
+  LSPAnalysis *work = &doc->work;
+
+  // The syntax takes the edits over even if these results are dropped, so
+  // the next parse still knows where the text changed
+  if (request->changed)
+    lsp_text_span_add(&doc->syntax.change, &doc->syntax.changed,
+                      request->change);
+
+  // Its arena held the results before the published ones, or ones dropped
+  lsp_modules_release(work->modules, work->module_count);
+  ArenaAllocator *arena = work->arena;
+  arena_destroy(arena);
+  arena_allocator_init(arena, 4 * 1024 * 1024);
+  *work = (LSPAnalysis){0};
+  work->arena = arena;
+  work->version = request->version;
+
+  // The last successful scope (allocated in server->arena) is kept when
+  // this one fails
   Scope *last_successful_scope = doc->scope;
 
-  arena_destroy(doc->arena);
-  arena_allocator_init(doc->arena, 4 * 1024 * 1024);
-
   error_clear();
 
-  // Clear negative module cache so failed lookups from prior analyses
-  // can be retried. Module files may become available mid-session.
-  lsp_negative_cache_clear();
-
-  const char *file_path = lsp_uri_to_path(doc->uri, doc->arena);
+  const char *file_path = lsp_uri_to_path(doc->uri, arena);
   if (!file_path) {
     file_path = doc->uri;
   }
 
   fprintf(stderr, "[LSP] Analyzing document: %s\n", file_path);
 
-  extract_imports(doc, doc->arena);
-
-  Lexer lexer;
-  init_lexer(&lexer, doc->content, doc->arena);
-
-  GrowableArray tokens;
-  growable_array_init(&tokens, doc->arena, 256, sizeof(Token));
-
-  Token token;
-  while ((token = next_token(&lexer)).type_ != TOK_EOF) {
-    Token *slot = (Token *)growable_array_push(&tokens);
-    if (slot)
-      *slot = token;
+  work->content = arena_strdup(arena, request->text);
+  if (!work->content) {
+    fprintf(stderr, "[LSP] No text for %s\n", file_path);
+    return false;
   }
 
-  doc->tokens = (Token *)tokens.data;
-  doc->token_count = tokens.count;
+  LSPDocument imports = {0};
+  imports.content = work->content;
+  extract_imports(&imports, arena);
+  work->imports = imports.imports;
+  work->import_count = imports.import_count;
+
+  // Lexes and parses again only around the edits since the last clean parse
+  const TokenBuffer *tokens = NULL;
+  work->ast = lsp_syntax_parse(&doc->syntax, work->content, config, arena,
+                               &tokens);
+  if (!tokens) {
+    fprintf(stderr, "[LSP] Failed to lex %s\n", file_path);
+    return false;
+  }
 
-  fprintf(stderr, "[LSP] Lexed %zu tokens\n", doc->token_count);
+  // Features look tokens up by position, so the results keep them whole
+  work->lines = &tokens->lines;
+  work->tokens = token_buffer_expand(tokens, arena);
+  work->token_count = work->tokens ? tokens->count : 0;
 
-  doc->ast = parse(&tokens, doc->arena, config);
+  fprintf(stderr, "[LSP] Lexed %zu tokens\n", work->token_count);
 
-  fprintf(stderr, "[LSP] Parse result: %s\n", doc->ast ? "success" : "failed");
+  fprintf(stderr, "[LSP] Parse result: %s\n", work->ast ? "success" : "failed");
 
-  if (!doc->ast || error_get_count() > 0) {
+  if (!work->ast || error_get_count() > 0) {
     fprintf(stderr, "[LSP] Parse has %d errors, skipping typecheck\n",
             error_get_count());
 
     if (last_successful_scope) {
       fprintf(stderr, "[LSP] Preserving last successful scope for completions\n");
-      doc->scope = last_successful_scope;
-    } else {
-      doc->scope = NULL;
     }
+    work->scope = last_successful_scope;
 
-    doc->diagnostics =
-        convert_errors_to_diagnostics(&doc->diagnostic_count, doc->arena);
-    doc->needs_reanalysis = false;
-    return false;
+    work->diagnostics =
+        convert_errors_to_diagnostics(&work->diagnostic_count, arena);
+    return !lsp_analysis_stale(server, doc, request->generation);
   }
 
-  // Collect ALL module dependencies (transitive closure)
-  GrowableArray all_modules;
-  growable_array_init(&all_modules, doc->arena, 16, sizeof(AstNode *));
+  if (lsp_analysis_stale(server, doc, request->generation))
+    return false;
 
-  GrowableArray visited_uris;
-  growable_array_init(&visited_uris, doc->arena, 16, sizeof(const char *));
+  // The modules it imports, and theirs, come checked from the module cache
+  lsp_module_cache_begin(server, config);
+  GrowableArray closure;
+  growable_array_init(&closure, arena, 16, sizeof(LSPModule *));
 
-  for (size_t i = 0; i < doc->import_count; i++) {
-    ImportedModule *import = &doc->imports[i];
+  for (size_t i = 0; i < work->import_count; i++) {
+    ImportedModule *import = &work->imports[i];
     const char *resolved_uri = lookup_module(server, import->module_path);
+    import->uri = resolved_uri;
 
-    if (resolved_uri) {
-      collect_all_module_deps(server, resolved_uri, config, doc->arena,
-                              &all_modules, &visited_uris);
-    }
+    if (resolved_uri)
+      lsp_module_closure(lsp_module_get(server, resolved_uri), &closure);
   }
 
-  // Add the main module last
-  AstNode *main_module = doc->ast;
-  if (doc->ast->type == AST_PROGRAM &&
-      doc->ast->stmt.program.module_count > 0) {
-    main_module = doc->ast->stmt.program.modules[0];
+  // The scope refers to them until the results are replaced
+  LSPModule **modules = (LSPModule **)closure.data;
+  work->modules = modules;
+  work->module_count = closure.count;
+  bool imports_ok = true;
+  for (size_t i = 0; i < closure.count; i++) {
+    lsp_module_retain(modules[i]);
+    for (int j = 0; j < modules[i]->error_count; j++)
+      error_add(modules[i]->errors[j]);
+    imports_ok = imports_ok && modules[i]->ok && modules[i]->scope;
   }
 
-  AstNode **main_slot = (AstNode **)growable_array_push(&all_modules);
-  if (main_slot) {
-    *main_slot = main_module;
+  AstNode *main_module = work->ast;
+  if (work->ast->type == AST_PROGRAM &&
+      work->ast->stmt.program.module_count > 0) {
+    main_module = work->ast->stmt.program.modules[0];
   }
 
-  // Create combined program with all modules
-  AstNode *combined_program = create_program_node(
-      doc->arena, (AstNode **)all_modules.data, all_modules.count, 0, 0);
-
-  if (!combined_program) {
-    if (last_successful_scope) {
-      doc->scope = last_successful_scope;
-    } else {
-      doc->scope = NULL;
-    }
-    doc->needs_reanalysis = false;
-    return false;
+  // Instances may come from every module's templates; only the document's
+  // own module is rewritten and checked
+  AstNode **module_asts = arena_alloc(
+      arena, (closure.count + 1) * sizeof(AstNode *), alignof(AstNode *));
+  if (module_asts) {
+    for (size_t i = 0; i < closure.count; i++)
+      module_asts[i] = modules[i]->module;
+    module_asts[closure.count] = main_module;
   }
+  AstNode *templates =
+      module_asts
+          ? create_program_node(arena, module_asts, closure.count + 1, 0, 0)
+          : NULL;
+  AstNode *program =
+      module_asts
+          ? create_program_node(arena, &module_asts[closure.count], 1, 0, 0)
+          : NULL;
 
   // Use SERVER arena for global scope (persists across analyses)
   Scope *global_scope =
-      arena_alloc(server->arena, sizeof(Scope), alignof(Scope));
+      templates && program
+          ? arena_alloc(server->arena, sizeof(Scope), alignof(Scope))
+          : NULL;
   if (!global_scope) {
-    if (last_successful_scope) {
-      doc->scope = last_successful_scope;
-    } else {
-      doc->scope = NULL;
-    }
-    doc->needs_reanalysis = false;
-    return false;
+    work->scope = last_successful_scope;
+    return !lsp_analysis_stale(server, doc, request->generation);
   }
 
   init_scope(global_scope, NULL, "global", server->arena);
   global_scope->config = config;
-  doc->scope = global_scope;
+  work->scope = global_scope;
+  for (size_t i = 0; imports_ok && i < closure.count; i++)
+    imports_ok = share_module_scope(global_scope, modules[i]->scope,
+                                    server->arena);
 
-  tc_error_init(doc->tokens, doc->token_count, file_path, doc->arena);
+  tc_error_init(work->lines, file_path, arena);
 
-  fprintf(stderr, "[LSP] Starting typecheck with %zu modules...\n",
-          all_modules.count);
+  if (lsp_analysis_stale(server, doc, request->generation))
+    return false;
 
+  fprintf(stderr, "[LSP] Starting typecheck with %zu cached modules...\n",
+          closure.count);
+
+  // A module it imports that failed to check fails it too, as in a build
   bool success = false;
 
-  if (combined_program && all_modules.count > 0) {
-    success = typecheck(combined_program, global_scope, server->arena, config);
+  if (imports_ok) {
+    // Instances rewrite type nodes in place, and reused statements are part
+    // of published results too
+    pthread_mutex_lock(&server->snapshot_lock);
+    success = instantiate_module_generics(templates, main_module, arena);
+    pthread_mutex_unlock(&server->snapshot_lock);
+    // Instances were added to the module and the names using them rewritten
+    if (!success || main_module->preprocessor.module.body_count !=
+                        doc->syntax.decl_count)
+      lsp_syntax_forget(&doc->syntax);
+    success =
+        success && typecheck(program, global_scope, server->arena, config);
+  }
+
+  if (success) {
+    work->pending_bodies = body_cache_take_pending(server->body_cache, arena);
+    if (work->pending_bodies)
+      fprintf(stderr, "[LSP] Reused %zu unchanged function bodies\n",
+              work->pending_bodies->count);
   }
 
   fprintf(stderr, "[LSP] Typecheck result: %s, errors: %d\n",
           success ? "success" : "failed", error_get_count());
 
+  if (lsp_analysis_stale(server, doc, request->generation))
+    return false;
+
   if (!success) {
     fprintf(stderr, "[LSP] Typecheck failed, preserving last successful scope\n");
-    if (last_successful_scope) {
-      doc->scope = last_successful_scope;
-    } else {
-      doc->scope = NULL;
-    }
+    work->scope = last_successful_scope;
   }
 
   // Link module scopes ONLY IF typecheck succeeded
   if (success) {
-    for (size_t i = 0; i < doc->import_count; i++) {
-      ImportedModule *import = &doc->imports[i];
-
-      for (size_t j = 0; j < all_modules.count - 1; j++) {
-        AstNode *module_ast = ((AstNode **)all_modules.data)[j];
-
-        if (module_ast->type == AST_PREPROCESSOR_MODULE) {
-          const char *module_file_name = module_ast->preprocessor.module.name;
-
-          if (strcmp(module_file_name, import->module_path) == 0) {
-            Scope *module_scope =
-                (Scope *)module_ast->preprocessor.module.scope;
-
-            if (module_scope) {
-              import->scope = module_scope;
-            }
-            break;
-          }
+    for (size_t i = 0; i < work->import_count; i++) {
+      ImportedModule *import = &work->imports[i];
+
+      for (size_t j = 0; j < closure.count; j++) {
+        if (strcmp(modules[j]->module->preprocessor.module.name,
+                   import->module_path) == 0) {
+          import->scope = modules[j]->scope;
+          break;
         }
       }
     }
   }
 
-  doc->diagnostics =
-      convert_errors_to_diagnostics(&doc->diagnostic_count, doc->arena);
+  work->diagnostics =
+      convert_errors_to_diagnostics(&work->diagnostic_count, arena);
 
-  doc->needs_reanalysis = false;
+  return true;
+}
+
+// Makes doc->work the results requests answer from. The reused bodies are
+// checked first, while requests wait, so no request sees a function scope
+// missing; the arena of the results replaced is the worker's next.
+void lsp_document_publish(LSPDocument *doc, LSPServer *server) {
+  LSPAnalysis *work = &doc->work;
+
+  pthread_mutex_lock(&server->snapshot_lock);
+  typecheck_pending_bodies(work->pending_bodies, server->arena);
+  work->pending_bodies = NULL;
+
+  // A new scope refers to the statements of this parse, and to the modules
+  // it was checked with; the last one kept still refers to the ones before
+  if (work->scope != doc->scope) {
+    doc->syntax.ast_published = doc->syntax.ast_current;
+    lsp_modules_release(doc->modules, doc->module_count);
+    doc->modules = work->modules;
+    doc->module_count = work->module_count;
+  } else {
+    // Their list moves over with the rest, out of the arena handed back
+    lsp_modules_release(work->modules, work->module_count);
+    LSPModule **kept =
+        arena_alloc(work->arena, doc->module_count * sizeof(LSPModule *) + 1,
+                    alignof(LSPModule *));
+    if (kept && doc->module_count)
+      memcpy(kept, doc->modules, doc->module_count * sizeof(LSPModule *));
+    doc->modules = kept;
+  }
 
-  return success;
+  ArenaAllocator *replaced = doc->arena;
+  doc->content = work->content;
+  doc->analyzed_version = work->version;
+  doc->tokens = work->tokens;
+  doc->token_count = work->token_count;
+  doc->ast = work->ast;
+  doc->scope = work->scope;
+  doc->diagnostics = work->diagnostics;
+  doc->diagnostic_count = work->diagnostic_count;
+  doc->imports = work->imports;
+  doc->import_count = work->import_count;
+  doc->arena = work->arena;
+  doc->completion_index = NULL; // In the arena handed back
+  *work = (LSPAnalysis){0};
+  work->arena = replaced;
+
+  // Requests find the names of these tokens in the symbol index
+  const char *module_name = extract_module_name(doc->content, doc->arena);
+  Scope *module_scope = doc->scope && module_name
+                            ? find_module_scope(doc->scope, module_name)
+                            : NULL;
+  lsp_symbol_index_update(&server->symbol_index, doc->uri, module_name,
+                          doc->tokens, doc->token_count, doc->imports,
+                          doc->import_count, module_scope, -1);
+  pthread_mutex_unlock(&server->snapshot_lock);
 }
 
 Token *lsp_token_at_position(LSPDocument *doc, LSPPosition position) {
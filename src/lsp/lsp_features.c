@@ -1,4 +1,5 @@
 #include "lsp.h"
+#include <ctype.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -159,9 +160,9 @@ static void collect_all_symbols(Scope *scope, ScopeSymbol *buf,
                                  bool is_imported) {
   if (!scope || *count >= capacity) return;
 
-  if (scope->symbols.data) {
+  if (scope->symbols.count) {
     for (size_t i = 0; i < scope->symbols.count && *count < capacity; i++) {
-      Symbol *sym = (Symbol *)((char *)scope->symbols.data + i * sizeof(Symbol));
+      Symbol *sym = scope_symbol(scope, i);
       if (sym && sym->name) {
         buf[*count].sym = sym;
         buf[*count].scope_name = scope->scope_name ? scope->scope_name : "?";
@@ -271,9 +272,9 @@ const char *lsp_hover(LSPDocument *doc, LSPPosition position,
 
     // Pass A: current file's own scopes (global + file module + all children
     // that are NOT imported dependency roots)
-    if (doc->scope->symbols.data) {
+    if (doc->scope->symbols.count) {
       for (size_t i = 0; i < doc->scope->symbols.count && sym_count < MAX_SYMS; i++) {
-        Symbol *sym = (Symbol *)((char *)doc->scope->symbols.data + i * sizeof(Symbol));
+        Symbol *sym = scope_symbol(doc->scope, i);
         if (sym && sym->name) {
           all_syms[sym_count].sym = sym;
           all_syms[sym_count].scope_name = doc->scope->scope_name ? doc->scope->scope_name : "global";
@@ -454,6 +455,21 @@ LSPLocation *lsp_definition(LSPDocument *doc, LSPServer *server,
 
   if (!doc->tokens) return NULL;
 
+  // A top-level name goes to where the index found it declared, in any
+  // file of the workspace
+  size_t symbol =
+      lsp_symbol_index_at(&server->symbol_index, doc->uri, position);
+  if (symbol != LSP_ATOM_NONE) {
+    size_t count = 0;
+    LSPLocation *found = lsp_symbol_index_locations(
+        &server->symbol_index, symbol, true, NULL, &count, NULL, arena);
+    if (found) {
+      fprintf(stderr, "[LSP] lsp_definition: %zu definitions indexed\n",
+              count);
+      return found;
+    }
+  }
+
   size_t name_len = tok->length;
   char name_buf[256];
   if (name_len >= sizeof(name_buf)) name_len = sizeof(name_buf) - 1;
@@ -486,7 +502,8 @@ LSPLocation *lsp_definition(LSPDocument *doc, LSPServer *server,
       if (imp_alias && strcmp(imp_alias, alias_buf) == 0) {
         fprintf(stderr, "[LSP] lsp_definition: found import '%s'\n",
                 imp->module_path);
-        const char *module_uri = lookup_module(server, imp->module_path);
+        // Resolved by the analysis, which owns the module registry
+        const char *module_uri = imp->uri;
         if (!module_uri) {
           fprintf(stderr, "[LSP] lsp_definition: can't resolve module\n");
           return NULL;
@@ -540,16 +557,13 @@ LSPLocation *lsp_definition(LSPDocument *doc, LSPServer *server,
                                    name_buf, name_len, doc->uri, arena);
 }
 
-LSPCompletionItem *lsp_completion(LSPDocument *doc, LSPPosition position,
-                                  size_t *completion_count,
-                                  ArenaAllocator *arena) {
-  (void)position;
-  if (!doc || !completion_count) {
-    return NULL;
-  }
-
-  GrowableArray completions;
-  growable_array_init(&completions, arena, 32, sizeof(LSPCompletionItem));
+// Every candidate the document's published results offer, whatever the
+// cursor is at: snippets, keywords, the names visible in its scopes and
+// the public names of its imports
+static void collect_completion_items(LSPDocument *doc,
+                                     GrowableArray *completions_out,
+                                     ArenaAllocator *arena) {
+  GrowableArray completions = *completions_out;
 
   const struct {
     const char *label;
@@ -728,10 +742,9 @@ LSPCompletionItem *lsp_completion(LSPDocument *doc, LSPPosition position,
 
       if (is_imported_scope) continue;
 
-      if (sc->symbols.data && sc->symbols.count > 0) {
+      if (sc->symbols.count > 0) {
         for (size_t j = 0; j < sc->symbols.count; j++) {
-          Symbol *sym = (Symbol *)((char *)sc->symbols.data +
-                                   j * sizeof(Symbol));
+          Symbol *sym = scope_symbol(sc, j);
           if (!sym || !sym->name || !sym->type) continue;
 
           LSPCompletionItem *item =
@@ -807,13 +820,12 @@ LSPCompletionItem *lsp_completion(LSPDocument *doc, LSPPosition position,
     for (size_t i = 0; i < doc->import_count; i++) {
       ImportedModule *import = &doc->imports[i];
 
-      if (!import->scope || !import->scope->symbols.data) continue;
+      if (!import->scope || !import->scope->symbols.count) continue;
 
       const char *prefix = import->alias ? import->alias : "module";
 
       for (size_t j = 0; j < import->scope->symbols.count; j++) {
-        Symbol *sym = (Symbol *)((char *)import->scope->symbols.data +
-                                 j * sizeof(Symbol));
+        Symbol *sym = scope_symbol(import->scope, j);
 
         if (!sym || !sym->name || !sym->type || !sym->is_public) continue;
         if (strncmp(sym->name, "__", 2) == 0) continue;
@@ -854,8 +866,49 @@ LSPCompletionItem *lsp_completion(LSPDocument *doc, LSPPosition position,
     }
   }
 
-  *completion_count = completions.count;
-  return (LSPCompletionItem *)completions.data;
+  *completions_out = completions;
+}
+
+// The word being completed: the name characters before the cursor in the
+// text as typed, which the published results may be behind
+static void completion_prefix(LSPDocument *doc, LSPPosition position,
+                              char prefix[LSP_COMPLETION_PREFIX_MAX]) {
+  char line[LSP_COMPLETION_PREFIX_MAX];
+  size_t length =
+      piece_table_line_before(&doc->text, position, line, sizeof(line));
+  size_t start = length;
+  while (start > 0 && (isalnum((unsigned char)line[start - 1]) ||
+                       line[start - 1] == '_'))
+    start--;
+  // Directives and attributes are completed with their sigil
+  if (start > 0 && (line[start - 1] == '@' || line[start - 1] == '#'))
+    start--;
+  memcpy(prefix, line + start, length - start + 1);
+}
+
+// Candidates matching the word at the cursor, best first. They come from
+// the index of the published results, built by the first request after
+// they are published (see lsp_completion_index.c).
+LSPCompletionItem *lsp_completion(LSPDocument *doc, LSPPosition position,
+                                  size_t *completion_count,
+                                  bool *is_incomplete, ArenaAllocator *arena) {
+  if (!doc || !completion_count || !is_incomplete) {
+    return NULL;
+  }
+
+  if (!doc->completion_index) {
+    GrowableArray completions;
+    growable_array_init(&completions, doc->arena, 256,
+                        sizeof(LSPCompletionItem));
+    collect_completion_items(doc, &completions, doc->arena);
+    doc->completion_index = lsp_completion_index_build(
+        completions.data, completions.count, doc->arena);
+  }
+
+  char prefix[LSP_COMPLETION_PREFIX_MAX];
+  completion_prefix(doc, position, prefix);
+  return lsp_completion_index_query(doc->completion_index, prefix,
+                                    completion_count, is_incomplete, arena);
 }
 
 LSPCompletionItem *lsp_completion_resolve(LSPCompletionItem *item,
@@ -1051,131 +1104,154 @@ LSPCodeAction *lsp_code_action(LSPDocument *doc, LSPPosition position,
   return (LSPCodeAction *)actions.data;
 }
 
-LSPDocumentHighlight *lsp_document_highlight(LSPDocument *doc,
-                                             LSPPosition position,
-                                             size_t *highlight_count,
-                                             ArenaAllocator *arena) {
-  if (!doc || !highlight_count || !doc->tokens) return NULL;
-
-  // Find the token at the cursor
+// Every identifier of the document spelled like the one at `position`,
+// for the names the symbol index doesn't have: locals, fields and names of
+// documents it couldn't read
+static LSPLocation *matching_tokens(LSPDocument *doc, LSPPosition position,
+                                    size_t *count, ArenaAllocator *arena) {
+  *count = 0;
   Token *tok = find_token_at(doc, position);
-  if (!tok || !token_is_name_like(tok) || !tok->value || tok->length == 0) {
-    *highlight_count = 0;
+  if (!tok || !token_is_name_like(tok) || !tok->value || tok->length == 0)
     return NULL;
-  }
 
-  // Extract the name
-  size_t name_len = tok->length;
-  char *name = arena_alloc(arena, name_len + 1, 1);
-  if (!name) { *highlight_count = 0; return NULL; }
-  memcpy(name, tok->value, name_len);
-  name[name_len] = '\0';
+  GrowableArray locations;
+  if (!growable_array_init(&locations, arena, 16, sizeof(LSPLocation)))
+    return NULL;
 
-  // Count all matching identifiers
-  size_t count = 0;
   for (size_t i = 0; i < doc->token_count; i++) {
     Token *t = &doc->tokens[i];
-    if (t->type_ == TOK_IDENTIFIER && t->length == (int)name_len &&
-        strncmp(t->value, name, name_len) == 0) {
-      count++;
+    if (t->type_ == TOK_IDENTIFIER && t->length == tok->length &&
+        strncmp(t->value, tok->value, (size_t)tok->length) == 0) {
+      LSPLocation *location = growable_array_push(&locations);
+      if (!location)
+        return NULL;
+      location->uri = doc->uri;
+      location->range.start.line = (int)t->line - 1;
+      location->range.start.character = (int)t->col - (int)t->length + 1;
+      location->range.end.line = (int)t->line - 1;
+      location->range.end.character = (int)t->col + 1;
     }
   }
 
-  if (count == 0) { *highlight_count = 0; return NULL; }
+  *count = locations.count;
+  return locations.count ? (LSPLocation *)locations.data : NULL;
+}
+
+LSPDocumentHighlight *lsp_document_highlight(LSPDocument *doc,
+                                             LSPServer *server,
+                                             LSPPosition position,
+                                             size_t *highlight_count,
+                                             ArenaAllocator *arena) {
+  if (!highlight_count) return NULL;
+  *highlight_count = 0;
+  if (!doc || !doc->tokens) return NULL;
+
+  // A top-level name's occurrences in this document, declarations as
+  // writes; anything else by its spelling
+  size_t count = 0;
+  bool *is_definition = NULL;
+  size_t symbol =
+      lsp_symbol_index_at(&server->symbol_index, doc->uri, position);
+  LSPLocation *locations =
+      symbol != LSP_ATOM_NONE
+          ? lsp_symbol_index_locations(&server->symbol_index, symbol, false,
+                                       doc->uri, &count, &is_definition,
+                                       arena)
+          : matching_tokens(doc, position, &count, arena);
+  if (!locations) return NULL;
 
   LSPDocumentHighlight *highlights =
       arena_alloc(arena, count * sizeof(LSPDocumentHighlight),
                   alignof(LSPDocumentHighlight));
-  if (!highlights) { *highlight_count = 0; return NULL; }
+  if (!highlights) return NULL;
 
-  size_t idx = 0;
-  for (size_t i = 0; i < doc->token_count && idx < count; i++) {
-    Token *t = &doc->tokens[i];
-    if (t->type_ == TOK_IDENTIFIER && t->length == (int)name_len &&
-        strncmp(t->value, name, name_len) == 0) {
-      highlights[idx].range.start.line = (int)t->line - 1;
-      highlights[idx].range.start.character = (int)t->col - 1;
-      highlights[idx].range.end.line = (int)t->line - 1;
-      highlights[idx].range.end.character = (int)t->col + (int)t->length - 1;
-      highlights[idx].kind = LSP_HIGHLIGHT_TEXT;
-      idx++;
-    }
+  for (size_t i = 0; i < count; i++) {
+    highlights[i].range = locations[i].range;
+    highlights[i].kind = !is_definition     ? LSP_HIGHLIGHT_TEXT
+                         : is_definition[i] ? LSP_HIGHLIGHT_WRITE
+                                            : LSP_HIGHLIGHT_READ;
   }
 
-  *highlight_count = idx;
+  *highlight_count = count;
   return highlights;
 }
 
-const char *lsp_rename(LSPDocument *doc, LSPPosition position,
-                       const char *new_name, ArenaAllocator *arena) {
-  if (!doc || !new_name || !doc->tokens) return NULL;
+// Where the name at `position` occurs: across the workspace for a
+// top-level name, else in the document
+LSPLocation *lsp_references(LSPDocument *doc, LSPServer *server,
+                            LSPPosition position, bool include_declaration,
+                            size_t *location_count, ArenaAllocator *arena) {
+  *location_count = 0;
+  if (!doc || !doc->tokens) return NULL;
 
-  Token *tok = find_token_at(doc, position);
-  if (!tok || !token_is_name_like(tok) || !tok->value || tok->length == 0)
-    return NULL;
+  size_t symbol =
+      lsp_symbol_index_at(&server->symbol_index, doc->uri, position);
+  if (symbol == LSP_ATOM_NONE)
+    return matching_tokens(doc, position, location_count, arena);
 
-  // Extract old name
-  size_t name_len = tok->length;
-  char *old_name = arena_alloc(arena, name_len + 1, 1);
-  if (!old_name) return NULL;
-  memcpy(old_name, tok->value, name_len);
-  old_name[name_len] = '\0';
-
-  // Build edit entries for each occurrence of the old name
-  // Output format: "\"uri\":[{edit1},{edit2},...]"
-  size_t buf_size = 65536;
-  char *result = arena_alloc(arena, buf_size, 1);
-  if (!result) return NULL;
-  result[0] = '\0';
-
-  // Count matches first
-  size_t match_count = 0;
-  for (size_t i = 0; i < doc->token_count; i++) {
-    Token *t = &doc->tokens[i];
-    if (t->type_ == TOK_IDENTIFIER && t->length == (int)name_len &&
-        strncmp(t->value, old_name, name_len) == 0) {
-      match_count++;
-    }
+  bool *is_definition = NULL;
+  size_t count = 0;
+  LSPLocation *locations =
+      lsp_symbol_index_locations(&server->symbol_index, symbol, false, NULL,
+                                 &count, &is_definition, arena);
+  if (!locations) return NULL;
+
+  size_t kept = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (include_declaration || !is_definition[i])
+      locations[kept++] = locations[i];
   }
+  *location_count = kept;
+  return kept ? locations : NULL;
+}
 
-  if (match_count == 0) return NULL;
+// The occurrences renaming the name at `position` edits, one file's after
+// another: across the workspace for a top-level name, else in the
+// document. A name declared outside the workspace (in std, say) isn't
+// renamed.
+LSPLocation *lsp_rename(LSPDocument *doc, LSPServer *server,
+                        LSPPosition position, size_t *location_count,
+                        ArenaAllocator *arena) {
+  *location_count = 0;
+  if (!doc || !doc->tokens) return NULL;
 
-  // Build edits for this document
-  char edits_section[65536];
-  size_t off = 0;
-  off += snprintf(edits_section + off, sizeof(edits_section) - off,
-                  "\"%s\":[", doc->uri);
+  // Without a workspace, only in the document
+  const char *root = server->module_registry.root;
+  size_t symbol =
+      root ? lsp_symbol_index_at(&server->symbol_index, doc->uri, position)
+           : LSP_ATOM_NONE;
+  if (symbol == LSP_ATOM_NONE)
+    return matching_tokens(doc, position, location_count, arena);
 
-  bool first = true;
-  for (size_t i = 0; i < doc->token_count; i++) {
-    Token *t = &doc->tokens[i];
-    if (t->type_ == TOK_IDENTIFIER && t->length == (int)name_len &&
-        strncmp(t->value, old_name, name_len) == 0) {
-      if (!first)
-        off += snprintf(edits_section + off, sizeof(edits_section) - off, ",");
-      first = false;
-
-      char escaped_new[256];
-      size_t esc_idx = 0;
-      for (const char *s = new_name; *s && esc_idx < sizeof(escaped_new) - 1; s++) {
-        if (*s == '"' || *s == '\\') {
-          escaped_new[esc_idx++] = '\\';
-        }
-        escaped_new[esc_idx++] = *s;
-      }
-      escaped_new[esc_idx] = '\0';
-
-      off += snprintf(edits_section + off, sizeof(edits_section) - off,
-                      "{\"range\":{"
-                      "\"start\":{\"line\":%d,\"character\":%d},"
-                      "\"end\":{\"line\":%d,\"character\":%d}"
-                      "},\"newText\":\"%s\"}",
-                      (int)t->line - 1, (int)t->col - 1,
-                      (int)t->line - 1, (int)t->col + (int)t->length - 1,
-                      escaped_new);
+  bool *is_definition = NULL;
+  size_t count = 0;
+  LSPLocation *locations =
+      lsp_symbol_index_locations(&server->symbol_index, symbol, false, NULL,
+                                 &count, &is_definition, arena);
+  if (!locations) return NULL;
+
+  // Nor is one whose declaration the index hasn't seen
+  bool declared = false;
+  for (size_t i = 0; i < count; i++) {
+    if (!is_definition[i])
+      continue;
+    const char *path = lsp_uri_to_path(locations[i].uri, arena);
+    if (!path || strncmp(path, root, strlen(root)) != 0) {
+      fprintf(stderr, "[LSP] lsp_rename: declared outside the workspace in %s\n",
+              locations[i].uri);
+      return NULL;
     }
+    declared = true;
   }
-  off += snprintf(edits_section + off, sizeof(edits_section) - off, "]");
+  if (!declared) return NULL;
 
-  return arena_strdup(arena, edits_section);
-}
\ No newline at end of file
+  *location_count = count;
+  return locations;
+}
+
+LSPWorkspaceSymbol *lsp_workspace_symbols(LSPServer *server, const char *query,
+                                          size_t *symbol_count,
+                                          ArenaAllocator *arena) {
+  return lsp_symbol_index_search(&server->symbol_index, query, symbol_count,
+                                 arena);
+}
@@ -0,0 +1,278 @@
+// lsp_format.c - textDocument/formatting and textDocument/rangeFormatting
+//
+// The document's current text is formatted whole, as `luma fmt` would, and
+// diffed against itself line by line (Myers' algorithm, after the common
+// head and tail are set aside), so the editor gets one edit per changed run
+// of lines instead of a new copy of the file. rangeFormatting keeps the
+// edits that touch the requested lines.
+//
+// The formatter prints from the AST, which has no comments; a run of lines
+// holding one is left alone rather than lose it.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "formatter/formatter.h"
+#include "lsp.h"
+
+// Beyond this many changed lines, the lines between the first and the last
+// change are replaced as one run
+#define FORMAT_DIFF_MAX_EDITS 1000
+
+typedef struct {
+  const char *start;
+  size_t length; // With its '\n', if any
+} TextLine;
+
+// A run of lines [a_start, a_end) of the original replaced by
+// [b_start, b_end) of the formatted text
+typedef struct {
+  size_t a_start, a_end;
+  size_t b_start, b_end;
+} LineRun;
+
+static TextLine *split_lines(const char *text, size_t length, size_t *count,
+                             ArenaAllocator *arena) {
+  size_t lines = 0;
+  for (size_t i = 0; i < length; i++) {
+    if (text[i] == '\n')
+      lines++;
+  }
+  if (length > 0 && text[length - 1] != '\n')
+    lines++;
+
+  TextLine *result =
+      arena_alloc(arena, (lines ? lines : 1) * sizeof(TextLine),
+                  alignof(TextLine));
+  if (!result)
+    return NULL;
+
+  size_t n = 0, start = 0;
+  for (size_t i = 0; i < length; i++) {
+    if (text[i] == '\n') {
+      result[n++] = (TextLine){text + start, i + 1 - start};
+      start = i + 1;
+    }
+  }
+  if (start < length)
+    result[n++] = (TextLine){text + start, length - start};
+
+  *count = n;
+  return result;
+}
+
+static bool same_line(TextLine a, TextLine b) {
+  return a.length == b.length && memcmp(a.start, b.start, a.length) == 0;
+}
+
+// Appends the runs that turn a[0, n) into b[0, m), offset by the lines set
+// aside in front. The trace keeps V[-d, d] of every round d, so its size
+// grows with the square of the edit count, which is capped.
+static bool diff_lines(const TextLine *a, size_t n, const TextLine *b,
+                       size_t m, size_t offset_a, size_t offset_b,
+                       GrowableArray *runs, ArenaAllocator *arena) {
+  size_t limit = n + m;
+  if (limit > FORMAT_DIFF_MAX_EDITS)
+    limit = FORMAT_DIFF_MAX_EDITS;
+
+  long center = (long)limit + 1;
+  long *v = arena_alloc(arena, (2 * limit + 3) * sizeof(long), alignof(long));
+  long **trace = arena_alloc(arena, (limit + 1) * sizeof(long *),
+                             alignof(long *));
+  if (!v || !trace)
+    return false;
+  v[center + 1] = 0;
+
+  long found = -1;
+  for (long d = 0; d <= (long)limit && found < 0; d++) {
+    for (long k = -d; k <= d; k += 2) {
+      long x = (k == -d || (k != d && v[center + k - 1] < v[center + k + 1]))
+                   ? v[center + k + 1]
+                   : v[center + k - 1] + 1;
+      long y = x - k;
+      while (x < (long)n && y < (long)m && same_line(a[x], b[y])) {
+        x++;
+        y++;
+      }
+      v[center + k] = x;
+      if (x >= (long)n && y >= (long)m)
+        found = d;
+    }
+    trace[d] = arena_alloc(arena, (2 * d + 1) * sizeof(long), alignof(long));
+    if (!trace[d])
+      return false;
+    memcpy(trace[d], &v[center - d], (2 * d + 1) * sizeof(long));
+  }
+
+  if (found < 0) {
+    // Too far apart to be worth it: one run
+    LineRun *run = growable_array_push(runs);
+    if (!run)
+      return false;
+    *run = (LineRun){offset_a, offset_a + n, offset_b, offset_b + m};
+    return true;
+  }
+
+  // Walk back from the end, collecting the lines both sides keep
+  size_t *keep_a = arena_alloc(arena, (n + 1) * sizeof(size_t),
+                               alignof(size_t));
+  size_t *keep_b = arena_alloc(arena, (n + 1) * sizeof(size_t),
+                               alignof(size_t));
+  if (!keep_a || !keep_b)
+    return false;
+  size_t kept = 0;
+
+  long x = (long)n, y = (long)m;
+  for (long d = found; d > 0; d--) {
+    const long *previous = trace[d - 1] + (d - 1); // Indexed by k
+    long k = x - y;
+    long prev_k = (k == -d || (k != d && previous[k - 1] < previous[k + 1]))
+                      ? k + 1
+                      : k - 1;
+    long prev_x = previous[prev_k];
+    long prev_y = prev_x - prev_k;
+    long snake_x = prev_k == k + 1 ? prev_x : prev_x + 1;
+    while (x > snake_x) {
+      x--;
+      y--;
+      keep_a[kept] = (size_t)x;
+      keep_b[kept++] = (size_t)y;
+    }
+    x = prev_x;
+    y = prev_y;
+  }
+  while (x > 0) {
+    x--;
+    y--;
+    keep_a[kept] = (size_t)x;
+    keep_b[kept++] = (size_t)y;
+  }
+
+  // The runs are the gaps between kept lines, which were found last first
+  size_t next_a = 0, next_b = 0;
+  for (size_t i = kept + 1; i-- > 0;) {
+    size_t at_a = i > 0 ? keep_a[i - 1] : n;
+    size_t at_b = i > 0 ? keep_b[i - 1] : m;
+    if (at_a > next_a || at_b > next_b) {
+      LineRun *run = growable_array_push(runs);
+      if (!run)
+        return false;
+      *run = (LineRun){offset_a + next_a, offset_a + at_a,
+                       offset_b + next_b, offset_b + at_b};
+    }
+    next_a = at_a + 1;
+    next_b = at_b + 1;
+  }
+  return true;
+}
+
+static bool has_comment(const TextLine *lines, size_t start, size_t end) {
+  for (size_t i = start; i < end; i++) {
+    for (size_t c = 0; c + 1 < lines[i].length; c++) {
+      if (lines[i].start[c] == '/' &&
+          (lines[i].start[c + 1] == '/' || lines[i].start[c + 1] == '*'))
+        return true;
+    }
+  }
+  return false;
+}
+
+// Position of the start of line `line`, or of the end of the text when
+// `line` is past its last line
+static LSPPosition line_position(const TextLine *lines, size_t count,
+                                 size_t line) {
+  if (line < count || count == 0 ||
+      lines[count - 1].start[lines[count - 1].length - 1] == '\n')
+    return (LSPPosition){(int)line, 0};
+
+  // The text doesn't end with a newline: the end of its last line, in
+  // UTF-16 code units
+  const TextLine *last = &lines[count - 1];
+  int units = 0;
+  for (size_t i = 0; i < last->length; i++) {
+    unsigned char c = (unsigned char)last->start[i];
+    if ((c & 0xC0) != 0x80)
+      units += c >= 0xF0 ? 2 : 1;
+  }
+  return (LSPPosition){(int)count - 1, units};
+}
+
+// Edits formatting the document's current text, or only those touching the
+// lines of `range` when it isn't NULL. NULL when the text doesn't parse.
+LSPTextEdit *lsp_format(LSPDocument *doc, const LSPRange *range,
+                        size_t *edit_count, ArenaAllocator *arena) {
+  *edit_count = 0;
+  const char *text = doc ? piece_table_text(&doc->text) : NULL;
+  if (!text)
+    return NULL;
+
+  ErrorBuffer dropped = {0};
+  ErrorBuffer *outer = error_get_capture();
+  error_begin_capture(&dropped);
+  size_t formatted_length = 0;
+  char *formatted = format_source(doc->uri, text, &formatted_length,
+                                  default_config, arena);
+  error_begin_capture(outer);
+  free(dropped.items);
+  if (!formatted)
+    return NULL;
+
+  size_t n = 0, m = 0;
+  TextLine *a = split_lines(text, strlen(text), &n, arena);
+  TextLine *b = split_lines(formatted, formatted_length, &m, arena);
+  GrowableArray runs;
+  if (!a || !b || !growable_array_init(&runs, arena, 8, sizeof(LineRun))) {
+    free(formatted);
+    return NULL;
+  }
+
+  // The head and tail both sides share are left out of the diff
+  size_t head = 0, tail = 0;
+  while (head < n && head < m && same_line(a[head], b[head]))
+    head++;
+  while (tail < n - head && tail < m - head &&
+         same_line(a[n - 1 - tail], b[m - 1 - tail]))
+    tail++;
+  if (!diff_lines(a + head, n - head - tail, b + head, m - head - tail, head,
+                  head, &runs, arena)) {
+    free(formatted);
+    return NULL;
+  }
+
+  LSPTextEdit *edits =
+      arena_alloc(arena, (runs.count ? runs.count : 1) * sizeof(LSPTextEdit),
+                  alignof(LSPTextEdit));
+  size_t count = 0;
+  for (size_t i = 0; edits && i < runs.count; i++) {
+    const LineRun *run = &((const LineRun *)runs.data)[i];
+    if (range) {
+      // An insertion touches the line it goes in front of
+      size_t last = run->a_end > run->a_start ? run->a_end - 1 : run->a_start;
+      if ((int)last < range->start.line || (int)run->a_start > range->end.line)
+        continue;
+    }
+    if (has_comment(a, run->a_start, run->a_end))
+      continue;
+
+    size_t new_length = 0;
+    for (size_t j = run->b_start; j < run->b_end; j++)
+      new_length += b[j].length;
+    char *new_text = arena_alloc(arena, new_length + 1, 1);
+    if (!new_text)
+      break;
+    size_t at = 0;
+    for (size_t j = run->b_start; j < run->b_end; j++) {
+      memcpy(new_text + at, b[j].start, b[j].length);
+      at += b[j].length;
+    }
+    new_text[at] = '\0';
+
+    edits[count++] = (LSPTextEdit){
+        {line_position(a, n, run->a_start), line_position(a, n, run->a_end)},
+        new_text};
+  }
+
+  free(formatted);
+  *edit_count = count;
+  return edits;
+}
@@ -1,510 +1,898 @@
 #include <ctype.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "lsp.h"
 
-// Skip over a JSON string value starting AT the opening '"'.
-// Returns pointer to the character AFTER the closing '"', or NULL on error.
-static const char *skip_json_string(const char *p) {
-  if (!p || *p != '"')
-    return NULL;
-  p++; // skip opening quote
-  while (*p) {
-    if (*p == '\\') {
-      p++; // skip escape char
-      if (!*p)
-        return NULL;
-      if (*p == 'u') {
-        // \uXXXX — skip 4 hex digits
-        for (int i = 0; i < 4 && *(p + 1); i++)
-          p++;
-      }
-    } else if (*p == '"') {
-      return p + 1; // past closing quote
-    }
-    p++;
-  }
-  return NULL; // unterminated string
-}
+// ============================================================================
+// PARSING
+// ============================================================================
 
-// Find the value pointer for `key` in `json`, skipping over string contents
-// so we never accidentally match a key name that appears inside a string value.
-// Returns a pointer to the first non-whitespace character of the value,
-// or NULL if not found.
-// Exported as find_json_value for use in lsp_message.c.
-const char *find_json_value(const char *json, const char *key) {
-  if (!json || !key)
-    return NULL;
+// Deeper nesting than any message the protocol defines
+#define JSON_MAX_DEPTH 128
 
-  size_t key_len = strlen(key);
-  const char *p = json;
+typedef struct {
+  char *p;
+  char *end;
+  JsonDocument *doc;
+} JsonParser;
 
-  while (*p) {
-    // Skip string values so we don't match keys inside them
-    if (*p == '"') {
-      // Read the full quoted token to get its exact content
-      const char *str_start = p + 1;
-      const char *after = skip_json_string(p);
-      if (!after)
-        break;
+static void skip_space(JsonParser *parser) {
+  while (parser->p < parser->end &&
+         (*parser->p == ' ' || *parser->p == '\t' || *parser->p == '\n' ||
+          *parser->p == '\r'))
+    parser->p++;
+}
 
-      size_t span = (size_t)(after - p - 2); // length between the quotes
-
-      // Only consider this an exact key match — no substring matches
-      if (span == key_len && strncmp(str_start, key, key_len) == 0) {
-        // Confirm it's a key: skip whitespace and look for ':'
-        const char *q = after;
-        while (*q && isspace(*q))
-          q++;
-        if (*q == ':') {
-          q++; // skip ':'
-          while (*q && isspace(*q))
-            q++;
-          return q;
-        }
-      }
-      // Not our key — jump past the whole string
-      p = after;
-      continue;
-    }
-    p++;
+// Index of a new value on the tape, or SIZE_MAX once out of memory
+static size_t push_value(JsonDocument *doc, JsonKind kind) {
+  if (doc->count == doc->capacity) {
+    size_t capacity = doc->capacity ? doc->capacity * 2 : 64;
+    JsonValue *values = realloc(doc->values, capacity * sizeof(*values));
+    if (!values)
+      return SIZE_MAX;
+    doc->values = values;
+    doc->capacity = capacity;
   }
-
-  return NULL;
+  doc->values[doc->count] = (JsonValue){.kind = kind, .span = 1};
+  return doc->count++;
 }
 
-char *extract_string(const char *json, const char *key, ArenaAllocator *arena) {
-  const char *value = find_json_value(json, key);
-  if (!value) {
-    fprintf(stderr, "[LSP] extract_string: key '%s' not found\n", key);
-    return NULL;
+// The code unit of a \uXXXX escape's four hex digits, or UINT_MAX
+static unsigned parse_hex4(const char *p) {
+  unsigned value = 0;
+  for (int i = 0; i < 4; i++) {
+    char c = p[i];
+    if (!isxdigit((unsigned char)c))
+      return UINT_MAX;
+    value = value * 16 + (unsigned)(isdigit((unsigned char)c)
+                                         ? c - '0'
+                                         : tolower((unsigned char)c) - 'a' + 10);
   }
+  return value;
+}
 
-  if (*value != '"') {
-    fprintf(stderr, "[LSP] extract_string: expected string value for key '%s'\n",
-            key);
-    return NULL;
+// Never longer than the six-character escape it came from
+static size_t encode_utf8(char *dst, unsigned cp) {
+  if (cp < 0x80) {
+    dst[0] = (char)cp;
+    return 1;
   }
-  value++; // skip opening quote
-
-  // Find the actual closing quote so we bound the read correctly.
-  // Using strlen(value) would read past the closing quote into trailing JSON,
-  // which is both wasteful and dangerous if there's a NUL byte after.
-  const char *end = value;
-  while (*end && *end != '"') {
-    if (*end == '\\') {
-      end++;
-      if (*end == 'u') {
-        for (int i = 0; i < 4 && *(end + 1); i++) end++;
-      }
-    }
-    if (*end) end++;
+  if (cp < 0x800) {
+    dst[0] = (char)(0xC0 | (cp >> 6));
+    dst[1] = (char)(0x80 | (cp & 0x3F));
+    return 2;
   }
-  size_t value_len = (size_t)(end - value);
-
-  // Allocate a worst-case buffer (unescaping never grows the string)
-  char *result = arena_alloc(arena, value_len + 1, 1);
-  if (!result) {
-    fprintf(stderr, "[LSP] extract_string: allocation failed\n");
-    return NULL;
+  if (cp < 0x10000) {
+    dst[0] = (char)(0xE0 | (cp >> 12));
+    dst[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    dst[2] = (char)(0x80 | (cp & 0x3F));
+    return 3;
   }
+  dst[0] = (char)(0xF0 | (cp >> 18));
+  dst[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+  dst[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+  dst[3] = (char)(0x80 | (cp & 0x3F));
+  return 4;
+}
 
-  char *dst = result;
-  const char *src = value;
+// Decodes the string after an opening quote where it is, since unescaping
+// never grows it, and ends it with a NUL where its closing quote was
+static bool parse_string(JsonParser *parser, size_t index) {
+  char *start = parser->p;
+  char *src = start;
+  char *dst = start;
+  char *end = parser->end;
+
+  while (src < end) {
+    char c = *src;
+    if (c == '"') {
+      *dst = '\0';
+      JsonValue *value = &parser->doc->values[index];
+      value->text = start;
+      value->length = (uint32_t)(dst - start);
+      parser->p = src + 1;
+      return true;
+    }
+    if (c != '\\') {
+      *dst++ = *src++;
+      continue;
+    }
 
-  while (src < end && *src != '"') {
-    if (*src == '\\') {
-      src++;
-      if (!*src)
-        break;
-      switch (*src) {
-      case 'n':  *dst++ = '\n'; break;
-      case 't':  *dst++ = '\t'; break;
-      case 'r':  *dst++ = '\r'; break;
-      case '"':  *dst++ = '"';  break;
-      case '\\': *dst++ = '\\'; break;
-      case '/':  *dst++ = '/';  break;
-      case 'b':  *dst++ = '\b'; break;
-      case 'f':  *dst++ = '\f'; break;
-      case 'u': {
-        // \uXXXX — simplified: emit '?' and skip the 4 hex digits
+    if (++src >= end)
+      return false;
+    switch (*src) {
+    case 'n':  *dst++ = '\n'; break;
+    case 't':  *dst++ = '\t'; break;
+    case 'r':  *dst++ = '\r'; break;
+    case 'b':  *dst++ = '\b'; break;
+    case 'f':  *dst++ = '\f'; break;
+    case 'u': {
+      // \uXXXX as UTF-8, so incremental edits count the same characters
+      // the client does. A surrogate pair is one code point.
+      unsigned cp = end - src > 4 ? parse_hex4(src + 1) : UINT_MAX;
+      if (cp == UINT_MAX) {
         *dst++ = '?';
-        for (int i = 0; i < 4 && *(src + 1); i++)
-          src++;
         break;
       }
-      default:
-        *dst++ = *src;
+      src += 4;
+      if (cp >= 0xD800 && cp < 0xDC00 && end - src > 6 && src[1] == '\\' &&
+          src[2] == 'u') {
+        unsigned low = parse_hex4(src + 3);
+        if (low >= 0xDC00 && low < 0xE000) {
+          cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+          src += 6;
+        }
+      }
+      dst += encode_utf8(dst, cp);
+      break;
+    }
+    default: // '"', '\\', '/' and anything else stand for themselves
+      *dst++ = *src;
+      break;
+    }
+    src++;
+  }
+  return false;
+}
+
+static bool parse_literal(JsonParser *parser, const char *word, JsonKind kind) {
+  size_t length = strlen(word);
+  if ((size_t)(parser->end - parser->p) < length ||
+      memcmp(parser->p, word, length) != 0)
+    return false;
+  parser->p += length;
+  return push_value(parser->doc, kind) != SIZE_MAX;
+}
+
+static bool parse_number(JsonParser *parser) {
+  char *start = parser->p;
+  while (parser->p < parser->end &&
+         (isdigit((unsigned char)*parser->p) || *parser->p == '-' ||
+          *parser->p == '+' || *parser->p == '.' || *parser->p == 'e' ||
+          *parser->p == 'E'))
+    parser->p++;
+  if (parser->p == start)
+    return false;
+
+  size_t index = push_value(parser->doc, JSON_NUMBER);
+  if (index == SIZE_MAX)
+    return false;
+  parser->doc->values[index].text = start;
+  parser->doc->values[index].length = (uint32_t)(parser->p - start);
+  return true;
+}
+
+static bool parse_value(JsonParser *parser, int depth);
+
+// Elements of an array, or key, value pairs of an object, up to `close`
+static bool parse_container(JsonParser *parser, JsonKind kind, int depth) {
+  char close = kind == JSON_OBJECT ? '}' : ']';
+  size_t index = push_value(parser->doc, kind);
+  if (index == SIZE_MAX || depth >= JSON_MAX_DEPTH)
+    return false;
+  parser->p++;
+
+  uint32_t count = 0;
+  skip_space(parser);
+  if (parser->p < parser->end && *parser->p == close) {
+    parser->p++;
+  } else {
+    for (;;) {
+      if (kind == JSON_OBJECT) {
+        skip_space(parser);
+        if (parser->p >= parser->end || *parser->p != '"')
+          return false;
+        parser->p++;
+        size_t key = push_value(parser->doc, JSON_STRING);
+        if (key == SIZE_MAX || !parse_string(parser, key))
+          return false;
+        skip_space(parser);
+        if (parser->p >= parser->end || *parser->p != ':')
+          return false;
+        parser->p++;
+      }
+      if (!parse_value(parser, depth + 1))
+        return false;
+      count++;
+
+      skip_space(parser);
+      if (parser->p < parser->end && *parser->p == ',') {
+        parser->p++;
+        continue;
+      }
+      if (parser->p < parser->end && *parser->p == close) {
+        parser->p++;
         break;
       }
-      src++;
-    } else {
-      *dst++ = *src++;
+      return false;
     }
   }
-  *dst = '\0';
 
-  fprintf(stderr, "[LSP] extract_string: key '%s' = '%.200s'\n", key, result);
-  return result;
+  JsonValue *value = &parser->doc->values[index];
+  value->count = count;
+  value->span = (uint32_t)(parser->doc->count - index);
+  return true;
 }
 
-int extract_int(const char *json, const char *key) {
-  const char *value = find_json_value(json, key);
-  if (!value) {
-    fprintf(stderr, "[LSP] extract_int: key '%s' not found\n", key);
-    return -1;
+static bool parse_value(JsonParser *parser, int depth) {
+  skip_space(parser);
+  if (parser->p >= parser->end)
+    return false;
+
+  switch (*parser->p) {
+  case '{':
+    return parse_container(parser, JSON_OBJECT, depth);
+  case '[':
+    return parse_container(parser, JSON_ARRAY, depth);
+  case '"': {
+    parser->p++;
+    size_t index = push_value(parser->doc, JSON_STRING);
+    return index != SIZE_MAX && parse_string(parser, index);
+  }
+  case 't':
+    return parse_literal(parser, "true", JSON_TRUE);
+  case 'f':
+    return parse_literal(parser, "false", JSON_FALSE);
+  case 'n':
+    return parse_literal(parser, "null", JSON_NULL);
+  default:
+    return parse_number(parser);
   }
+}
 
-  if (*value == '-' || isdigit((unsigned char)*value)) {
-    int v = atoi(value);
-    fprintf(stderr, "[LSP] extract_int: key '%s' = %d\n", key, v);
-    return v;
+// Parses `length` bytes of `text` in one pass. The strings are decoded
+// into `text` itself, which has to outlive the document.
+bool json_parse(JsonDocument *doc, char *text, size_t length) {
+  *doc = (JsonDocument){0};
+  JsonParser parser = {text, text + length, doc};
+  if (!parse_value(&parser, 0)) {
+    json_document_free(doc);
+    return false;
   }
+  skip_space(&parser);
+  return true;
+}
+
+void json_document_free(JsonDocument *doc) {
+  free(doc->values);
+  *doc = (JsonDocument){0};
+}
 
-  // Handle JSON null explicitly
-  if (strncmp(value, "null", 4) == 0) {
-    fprintf(stderr, "[LSP] extract_int: key '%s' is null\n", key);
-    return -1;
+// The value of `key` in `object`, NULL if it has none or isn't an object
+const JsonValue *json_get(const JsonValue *object, const char *key) {
+  if (!object || object->kind != JSON_OBJECT)
+    return NULL;
+  const JsonValue *member = object + 1;
+  for (uint32_t i = 0; i < object->count; i++) {
+    const JsonValue *value = member + 1;
+    if (strcmp(member->text, key) == 0)
+      return value;
+    member = value + value->span;
   }
+  return NULL;
+}
 
-  fprintf(stderr, "[LSP] extract_int: unexpected value for key '%s'\n", key);
-  return -1;
+const JsonValue *json_first(const JsonValue *array) {
+  return array && array->kind == JSON_ARRAY && array->count > 0 ? array + 1
+                                                                : NULL;
 }
 
-LSPPosition extract_position(const char *json) {
-  LSPPosition pos = {0, 0};
+const JsonValue *json_next(const JsonValue *array, const JsonValue *element) {
+  const JsonValue *next = element + element->span;
+  return next < array + array->span ? next : NULL;
+}
 
-  // Seek to the "position" object first so we don't pick up other
-  // "line"/"character" keys that might appear earlier in the message.
-  const char *position_obj = find_json_value(json, "position");
-  if (!position_obj)
-    return pos;
+const char *json_as_string(const JsonValue *value) {
+  return value && value->kind == JSON_STRING ? value->text : NULL;
+}
 
-  pos.line      = extract_int(position_obj, "line");
-  pos.character = extract_int(position_obj, "character");
-  return pos;
+int json_as_int(const JsonValue *value, int fallback) {
+  if (!value || value->kind != JSON_NUMBER)
+    return fallback;
+  return (int)strtol(value->text, NULL, 10);
 }
 
-LSPMethod lsp_parse_method(const char *json) {
-  if (!json) {
-    fprintf(stderr, "[LSP] parse_method: NULL input\n");
+// ============================================================================
+// MESSAGES
+// ============================================================================
+
+static const struct {
+  const char *name;
+  LSPMethod method;
+} methods[] = {
+    {"initialize", LSP_METHOD_INITIALIZE},
+    {"initialized", LSP_METHOD_INITIALIZED},
+    {"shutdown", LSP_METHOD_SHUTDOWN},
+    {"exit", LSP_METHOD_EXIT},
+    {"textDocument/didOpen", LSP_METHOD_TEXT_DOCUMENT_DID_OPEN},
+    {"textDocument/didChange", LSP_METHOD_TEXT_DOCUMENT_DID_CHANGE},
+    {"textDocument/didClose", LSP_METHOD_TEXT_DOCUMENT_DID_CLOSE},
+    {"textDocument/didSave", LSP_METHOD_TEXT_DOCUMENT_DID_SAVE},
+    {"textDocument/hover", LSP_METHOD_TEXT_DOCUMENT_HOVER},
+    {"textDocument/definition", LSP_METHOD_TEXT_DOCUMENT_DEFINITION},
+    {"textDocument/completion", LSP_METHOD_TEXT_DOCUMENT_COMPLETION},
+    {"textDocument/documentSymbol", LSP_METHOD_TEXT_DOCUMENT_DOCUMENT_SYMBOL},
+    {"textDocument/semanticTokens/full",
+     LSP_METHOD_TEXT_DOCUMENT_SEMANTIC_TOKENS},
+    {"textDocument/semanticTokens/full/delta",
+     LSP_METHOD_TEXT_DOCUMENT_SEMANTIC_TOKENS_DELTA},
+    {"textDocument/semanticTokens/range",
+     LSP_METHOD_TEXT_DOCUMENT_SEMANTIC_TOKENS_RANGE},
+    {"textDocument/signatureHelp", LSP_METHOD_TEXT_DOCUMENT_SIGNATURE_HELP},
+    {"textDocument/codeAction", LSP_METHOD_TEXT_DOCUMENT_CODE_ACTION},
+    {"textDocument/rename", LSP_METHOD_TEXT_DOCUMENT_RENAME},
+    {"textDocument/documentHighlight",
+     LSP_METHOD_TEXT_DOCUMENT_DOCUMENT_HIGHLIGHT},
+    {"completionItem/resolve", LSP_METHOD_TEXT_DOCUMENT_COMPLETION_ITEM_RESOLVE},
+    {"textDocument/formatting", LSP_METHOD_TEXT_DOCUMENT_FORMATTING},
+    {"textDocument/rangeFormatting",
+     LSP_METHOD_TEXT_DOCUMENT_RANGE_FORMATTING},
+    {"textDocument/references", LSP_METHOD_TEXT_DOCUMENT_REFERENCES},
+    {"workspace/symbol", LSP_METHOD_WORKSPACE_SYMBOL},
+};
+
+LSPMethod lsp_parse_method(const char *method_name) {
+  if (!method_name)
     return LSP_METHOD_UNKNOWN;
+  for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+    if (strcmp(methods[i].name, method_name) == 0)
+      return methods[i].method;
   }
+  fprintf(stderr, "[LSP] parse_method: unknown method %s\n", method_name);
+  return LSP_METHOD_UNKNOWN;
+}
 
-  fprintf(stderr, "[LSP] parse_method: checking message: %.200s\n", json);
+// Parses a message once; its strings are decoded into `text`, so they live
+// as long as it does
+bool lsp_message_parse(LSPMessage *message, char *text, size_t length) {
+  *message = (LSPMessage){.method = LSP_METHOD_UNKNOWN, .id = -1};
+  if (!json_parse(&message->json, text, length) ||
+      message->json.values[0].kind != JSON_OBJECT) {
+    fprintf(stderr, "[LSP] Malformed message\n");
+    json_document_free(&message->json);
+    return false;
+  }
 
-  const char *method_value = find_json_value(json, "method");
-  if (!method_value) {
-    fprintf(stderr, "[LSP] parse_method: no 'method' field found\n");
-    return LSP_METHOD_UNKNOWN;
+  const JsonValue *root = &message->json.values[0];
+  message->method_name = json_as_string(json_get(root, "method"));
+  message->method = lsp_parse_method(message->method_name);
+  message->id = json_as_int(json_get(root, "id"), -1);
+  message->params = json_get(root, "params");
+  return true;
+}
+
+void lsp_message_free(LSPMessage *message) {
+  json_document_free(&message->json);
+}
+
+// ============================================================================
+// WRITING
+// ============================================================================
+
+#define JSON_CHUNK_MIN (16 * 1024)
+#define JSON_CHUNK_MAX (1024 * 1024)
+
+struct JsonChunk {
+  JsonChunk *next;
+  size_t used;
+  size_t capacity;
+  char data[];
+};
+
+void json_writer_init(JsonWriter *w) { memset(w, 0, sizeof(*w)); }
+
+void json_writer_free(JsonWriter *w) {
+  JsonChunk *chunk = w->head;
+  while (chunk) {
+    JsonChunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
   }
+  memset(w, 0, sizeof(*w));
+}
 
-  if (*method_value == '"') {
-    method_value++;
-  }
-
-  fprintf(stderr, "[LSP] parse_method: found method starting with: %.50s\n",
-          method_value);
-
-  // Longest match first to avoid partial matches
-  if (strncmp(method_value, "textDocument/documentHighlight", 30) == 0)
-    return LSP_METHOD_TEXT_DOCUMENT_DOCUMENT_HIGHLIGHT;
-  if (strncmp(method_value, "textDocument/documentSymbol", 27) == 0)
-    return LSP_METHOD_TEXT_DOCUMENT_DOCUMENT_SYMBOL;
-  if (strncmp(method_value, "textDocument/semanticTokens", 27) == 0)
-    return LSP_METHOD_TEXT_DOCUMENT_SEMANTIC_TOKENS;
-  if (strncmp(method_value, "textDocument/signatureHelp", 26) == 0)
-    return LSP_METHOD_TEXT_DOCUMENT_SIGNATURE_HELP;
-  if (strncmp(method_value, "textDocument/completion", 23) == 0)
-    return LSP_METHOD_TEXT_DOCUMENT_COMPLETION;
-  if (strncmp(method_value, "textDocument/definition", 23) == 0)
-    return LSP_METHOD_TEXT_DOCUMENT_DEFINITION;
-  if (strncmp(method_value, "textDocument/didChange", 22) == 0)
-    return LSP_METHOD_TEXT_DOCUMENT_DID_CHANGE;
-  if (strncmp(method_value, "textDocument/formatting", 23) == 0)
-    return LSP_METHOD_TEXT_DOCUMENT_FORMATTING;
-  if (strncmp(method_value, "textDocument/didClose", 21) == 0)
-    return LSP_METHOD_TEXT_DOCUMENT_DID_CLOSE;
-  if (strncmp(method_value, "textDocument/didOpen", 20) == 0)
-    return LSP_METHOD_TEXT_DOCUMENT_DID_OPEN;
-  if (strncmp(method_value, "textDocument/rename", 19) == 0)
-    return LSP_METHOD_TEXT_DOCUMENT_RENAME;
-  if (strncmp(method_value, "textDocument/codeAction", 22) == 0)
-    return LSP_METHOD_TEXT_DOCUMENT_CODE_ACTION;
-  if (strncmp(method_value, "textDocument/hover", 18) == 0)
-    return LSP_METHOD_TEXT_DOCUMENT_HOVER;
-  if (strncmp(method_value, "completionItem/resolve", 22) == 0)
-    return LSP_METHOD_TEXT_DOCUMENT_COMPLETION_ITEM_RESOLVE;
-
-  // "initialized" must be checked before "initialize"
-  if (strncmp(method_value, "initialized", 11) == 0)
-    return LSP_METHOD_INITIALIZED;
-  if (strncmp(method_value, "initialize", 10) == 0)
-    return LSP_METHOD_INITIALIZE;
-
-  if (strncmp(method_value, "shutdown", 8) == 0)
-    return LSP_METHOD_SHUTDOWN;
-  if (strncmp(method_value, "exit", 4) == 0)
-    return LSP_METHOD_EXIT;
-
-  fprintf(stderr, "[LSP] parse_method: unknown method\n");
-  return LSP_METHOD_UNKNOWN;
+// Appends to the last chunk, and past it to a new one twice as large
+static void write_bytes(JsonWriter *w, const char *bytes, size_t length) {
+  if (w->failed)
+    return;
+
+  JsonChunk *tail = w->tail;
+  if (tail && tail->used < tail->capacity) {
+    size_t room = tail->capacity - tail->used;
+    size_t n = length < room ? length : room;
+    memcpy(tail->data + tail->used, bytes, n);
+    tail->used += n;
+    w->length += n;
+    bytes += n;
+    length -= n;
+  }
+  if (length == 0)
+    return;
+
+  size_t capacity = tail ? tail->capacity * 2 : JSON_CHUNK_MIN;
+  if (capacity > JSON_CHUNK_MAX)
+    capacity = JSON_CHUNK_MAX;
+  if (capacity < length)
+    capacity = length;
+
+  JsonChunk *chunk = malloc(sizeof(JsonChunk) + capacity);
+  if (!chunk) {
+    w->failed = true;
+    return;
+  }
+  chunk->next = NULL;
+  chunk->used = length;
+  chunk->capacity = capacity;
+  memcpy(chunk->data, bytes, length);
+  if (tail)
+    tail->next = chunk;
+  else
+    w->head = chunk;
+  w->tail = chunk;
+  w->length += length;
 }
 
-void lsp_send_response(int id, const char *result) {
-  // Use heap buffer so large responses (completions) don't overflow
-  size_t result_len = result ? strlen(result) : 4;
-  size_t buf_size = result_len + 128;
-  char *json_msg = (char *)malloc(buf_size);
-  if (!json_msg)
+// A comma before every element but an open container's first, none after
+// a key
+static void before_value(JsonWriter *w) {
+  if (w->after_key) {
+    w->after_key = false;
     return;
+  }
+  if (w->depth > 0) {
+    if (w->has_items[w->depth - 1])
+      write_bytes(w, ",", 1);
+    w->has_items[w->depth - 1] = true;
+  }
+}
 
-  int msg_len = snprintf(json_msg, buf_size,
-                         "{\"jsonrpc\":\"2.0\",\"id\":%d,\"result\":%s}",
-                         id, result ? result : "null");
+static void begin_container(JsonWriter *w, char open) {
+  before_value(w);
+  write_bytes(w, &open, 1);
+  if (w->depth == JSON_WRITER_DEPTH) {
+    w->failed = true;
+    return;
+  }
+  w->has_items[w->depth++] = false;
+}
 
-  printf("Content-Length: %d\r\n\r\n%s", msg_len, json_msg);
-  fflush(stdout);
-  free(json_msg);
+static void end_container(JsonWriter *w, char close) {
+  write_bytes(w, &close, 1);
+  if (w->depth > 0)
+    w->depth--;
 }
 
+void json_begin_object(JsonWriter *w) { begin_container(w, '{'); }
+void json_end_object(JsonWriter *w) { end_container(w, '}'); }
+void json_begin_array(JsonWriter *w) { begin_container(w, '['); }
+void json_end_array(JsonWriter *w) { end_container(w, ']'); }
+
+// `text` in quotes, written in runs between the characters it escapes
+static void write_quoted(JsonWriter *w, const char *text, size_t length) {
+  static const char hex[] = "0123456789abcdef";
+  write_bytes(w, "\"", 1);
+  size_t run = 0;
+  for (size_t i = 0; i < length; i++) {
+    unsigned char c = (unsigned char)text[i];
+    if (c >= 0x20 && c != '"' && c != '\\')
+      continue;
+
+    write_bytes(w, text + run, i - run);
+    run = i + 1;
+    char escape[6] = {'\\', 0};
+    switch (c) {
+    case '"':  escape[1] = '"';  break;
+    case '\\': escape[1] = '\\'; break;
+    case '\n': escape[1] = 'n';  break;
+    case '\r': escape[1] = 'r';  break;
+    case '\t': escape[1] = 't';  break;
+    case '\b': escape[1] = 'b';  break;
+    case '\f': escape[1] = 'f';  break;
+    default:
+      memcpy(escape + 1, "u00", 3);
+      escape[4] = hex[c >> 4];
+      escape[5] = hex[c & 0xF];
+      write_bytes(w, escape, 6);
+      continue;
+    }
+    write_bytes(w, escape, 2);
+  }
+  write_bytes(w, text + run, length - run);
+  write_bytes(w, "\"", 1);
+}
+
+void json_write_key(JsonWriter *w, const char *key) {
+  before_value(w);
+  write_quoted(w, key, strlen(key));
+  write_bytes(w, ":", 1);
+  w->after_key = true;
+}
+
+void json_write_string_n(JsonWriter *w, const char *text, size_t length) {
+  before_value(w);
+  write_quoted(w, text ? text : "", text ? length : 0);
+}
+
+void json_write_string(JsonWriter *w, const char *text) {
+  json_write_string_n(w, text, text ? strlen(text) : 0);
+}
+
+void json_write_int(JsonWriter *w, long long value) {
+  char digits[24];
+  int n = snprintf(digits, sizeof(digits), "%lld", value);
+  before_value(w);
+  write_bytes(w, digits, (size_t)n);
+}
+
+void json_write_bool(JsonWriter *w, bool value) {
+  before_value(w);
+  write_bytes(w, value ? "true" : "false", value ? 4 : 5);
+}
+
+void json_write_null(JsonWriter *w) {
+  before_value(w);
+  write_bytes(w, "null", 4);
+}
+
+void json_write_raw(JsonWriter *w, const char *json) {
+  before_value(w);
+  write_bytes(w, json, strlen(json));
+}
+
+// A string whose text is escaped for JSON already
+void json_write_escaped(JsonWriter *w, const char *text) {
+  before_value(w);
+  write_bytes(w, "\"", 1);
+  write_bytes(w, text, strlen(text));
+  write_bytes(w, "\"", 1);
+}
+
+void json_write_range(JsonWriter *w, const char *key, LSPRange range) {
+  json_write_key(w, key);
+  json_begin_object(w);
+  json_write_key(w, "start");
+  json_begin_object(w);
+  json_write_key(w, "line");
+  json_write_int(w, range.start.line);
+  json_write_key(w, "character");
+  json_write_int(w, range.start.character);
+  json_end_object(w);
+  json_write_key(w, "end");
+  json_begin_object(w);
+  json_write_key(w, "line");
+  json_write_int(w, range.end.line);
+  json_write_key(w, "character");
+  json_write_int(w, range.end.character);
+  json_end_object(w);
+  json_end_object(w);
+}
+
+// ============================================================================
+// SENDING
+// ============================================================================
+
+// The worker publishes diagnostics while requests are answered, and each
+// message goes out as several writes
+static pthread_mutex_t g_stdout_lock = PTHREAD_MUTEX_INITIALIZER;
 static int g_request_id = 0;
 
-void lsp_send_request(const char *method, const char *params) {
-  size_t params_len = params ? strlen(params) : 2;
-  size_t buf_size = strlen(method) + params_len + 64;
-  char *json_msg = (char *)malloc(buf_size);
-  if (!json_msg)
-    return;
+static void message_begin(JsonWriter *w) {
+  json_writer_init(w);
+  json_begin_object(w);
+  json_write_key(w, "jsonrpc");
+  json_write_string(w, "2.0");
+}
+
+void lsp_response_begin(JsonWriter *w, int id) {
+  message_begin(w);
+  json_write_key(w, "id");
+  json_write_int(w, id);
+  json_write_key(w, "result");
+}
 
-  int id = __sync_fetch_and_add(&g_request_id, 1);
-  int msg_len = snprintf(json_msg, buf_size,
-                         "{\"jsonrpc\":\"2.0\",\"id\":%d,\"method\":\"%s\",\"params\":%s}",
-                         id, method, params ? params : "{}");
+void lsp_notification_begin(JsonWriter *w, const char *method) {
+  message_begin(w);
+  json_write_key(w, "method");
+  json_write_string(w, method);
+  json_write_key(w, "params");
+}
 
-  printf("Content-Length: %d\r\n\r\n%s", msg_len, json_msg);
-  fflush(stdout);
-  free(json_msg);
+void lsp_request_begin(JsonWriter *w, const char *method) {
+  message_begin(w);
+  json_write_key(w, "id");
+  json_write_int(w, __sync_fetch_and_add(&g_request_id, 1));
+  json_write_key(w, "method");
+  json_write_string(w, method);
+  json_write_key(w, "params");
 }
 
-void lsp_send_notification(const char *method, const char *params) {
-  size_t params_len = params ? strlen(params) : 2;
-  size_t buf_size = strlen(method) + params_len + 64;
-  char *json_msg = (char *)malloc(buf_size);
-  if (!json_msg)
+// Closes the message and writes it out chunk by chunk, behind a
+// Content-Length counted as it was written
+void lsp_message_send(JsonWriter *w) {
+  json_end_object(w);
+  if (w->failed || w->depth != 0) {
+    fprintf(stderr, "[LSP] Dropped a message the writer could not finish\n");
+    json_writer_free(w);
     return;
+  }
 
-  int msg_len = snprintf(json_msg, buf_size,
-                         "{\"jsonrpc\":\"2.0\",\"method\":\"%s\",\"params\":%s}",
-                         method, params ? params : "{}");
-
-  printf("Content-Length: %d\r\n\r\n%s", msg_len, json_msg);
+  pthread_mutex_lock(&g_stdout_lock);
+  fprintf(stdout, "Content-Length: %zu\r\n\r\n", w->length);
+  for (JsonChunk *chunk = w->head; chunk; chunk = chunk->next)
+    fwrite(chunk->data, 1, chunk->used, stdout);
   fflush(stdout);
-  free(json_msg);
+  if (lsp_record_begin(false, w->length)) {
+    for (JsonChunk *chunk = w->head; chunk; chunk = chunk->next)
+      lsp_record_write(chunk->data, chunk->used);
+    lsp_record_end();
+  }
+  pthread_mutex_unlock(&g_stdout_lock);
+  json_writer_free(w);
 }
 
-void lsp_send_error(int id, int code, const char *message) {
-  size_t msg_len = strlen(message ? message : "") + 128;
-  char *json_msg = (char *)malloc(msg_len);
-  if (!json_msg)
-    return;
+void lsp_send_response(int id, const char *result) {
+  JsonWriter w;
+  lsp_response_begin(&w, id);
+  json_write_raw(&w, result ? result : "null");
+  lsp_message_send(&w);
+}
 
-  int len = snprintf(json_msg, msg_len,
-                     "{\"jsonrpc\":\"2.0\",\"id\":%d,\"error\":{"
-                     "\"code\":%d,\"message\":\"%s\"}}",
-                     id, code, message ? message : "");
+void lsp_send_request(const char *method, const char *params) {
+  JsonWriter w;
+  lsp_request_begin(&w, method);
+  json_write_raw(&w, params ? params : "{}");
+  lsp_message_send(&w);
+}
 
-  printf("Content-Length: %d\r\n\r\n%s", len, json_msg);
-  fflush(stdout);
-  free(json_msg);
+void lsp_send_notification(const char *method, const char *params) {
+  JsonWriter w;
+  lsp_notification_begin(&w, method);
+  json_write_raw(&w, params ? params : "{}");
+  lsp_message_send(&w);
 }
 
-// Write a JSON-escaped version of `src` into `dst`, stopping before
-// dst_end - 1 to leave room for the NUL terminator.
-// Returns number of bytes written (excluding NUL).
-size_t json_escape(char *dst, size_t dst_size, const char *src) {
-  char *out = dst;
-  char *end = dst + dst_size - 1; // reserve 1 for '\0'
-  while (*src && out < end) {
-    switch (*src) {
-    case '"':
-      if (out + 1 >= end) goto done;
-      *out++ = '\\'; *out++ = '"';  break;
-    case '\\':
-      if (out + 1 >= end) goto done;
-      *out++ = '\\'; *out++ = '\\'; break;
-    case '\n':
-      if (out + 1 >= end) goto done;
-      *out++ = '\\'; *out++ = 'n';  break;
-    case '\r':
-      if (out + 1 >= end) goto done;
-      *out++ = '\\'; *out++ = 'r';  break;
-    case '\t':
-      if (out + 1 >= end) goto done;
-      *out++ = '\\'; *out++ = 't';  break;
-    default:
-      *out++ = *src; break;
-    }
-    src++;
+void lsp_send_error(int id, int code, const char *message) {
+  JsonWriter w;
+  message_begin(&w);
+  json_write_key(&w, "id");
+  json_write_int(&w, id);
+  json_write_key(&w, "error");
+  json_begin_object(&w);
+  json_write_key(&w, "code");
+  json_write_int(&w, code);
+  json_write_key(&w, "message");
+  json_write_string(&w, message);
+  json_end_object(&w);
+  lsp_message_send(&w);
+}
+
+// ============================================================================
+// SERIALIZATION
+// ============================================================================
+
+// The params of textDocument/publishDiagnostics
+void serialize_diagnostics_to_json(JsonWriter *w, const char *uri,
+                                   const LSPDiagnostic *diagnostics,
+                                   size_t diag_count) {
+  json_begin_object(w);
+  json_write_key(w, "uri");
+  json_write_string(w, uri);
+  json_write_key(w, "diagnostics");
+  json_begin_array(w);
+  for (size_t i = 0; i < diag_count; i++) {
+    const LSPDiagnostic *diag = &diagnostics[i];
+    json_begin_object(w);
+    json_write_range(w, "range", diag->range);
+    json_write_key(w, "severity");
+    json_write_int(w, diag->severity);
+    json_write_key(w, "message");
+    json_write_string(w, diag->message);
+    json_write_key(w, "source");
+    json_write_string(w, diag->source ? diag->source : "luma");
+    json_end_object(w);
   }
-done:
-  *out = '\0';
-  return (size_t)(out - dst);
-}
-
-void serialize_diagnostics_to_json(const char *uri, LSPDiagnostic *diagnostics,
-                                   size_t diag_count, char *output,
-                                   size_t output_size) {
-  size_t offset = 0;
-  offset += snprintf(output + offset, output_size - offset,
-                     "{\"uri\":\"%s\",\"diagnostics\":[", uri);
-
-  for (size_t i = 0; i < diag_count && offset < output_size - 2; i++) {
-    LSPDiagnostic *diag = &diagnostics[i];
-    if (i > 0)
-      offset += snprintf(output + offset, output_size - offset, ",");
-
-    char escaped_msg[4096];
-    json_escape(escaped_msg, sizeof(escaped_msg),
-                diag->message ? diag->message : "");
-
-    offset += snprintf(
-        output + offset, output_size - offset,
-        "{\"range\":{\"start\":{\"line\":%d,\"character\":%d},"
-        "\"end\":{\"line\":%d,\"character\":%d}},"
-        "\"severity\":%d,\"message\":\"%s\",\"source\":\"%s\"}",
-        diag->range.start.line, diag->range.start.character,
-        diag->range.end.line,   diag->range.end.character,
-        diag->severity, escaped_msg,
-        diag->source ? diag->source : "luma");
-  }
-
-  if (offset < output_size)
-    snprintf(output + offset, output_size - offset, "]}");
-}
-
-void serialize_completion_items(LSPCompletionItem *items, size_t count,
-                                char *output, size_t output_size) {
-  size_t offset = 0;
-  offset += snprintf(output + offset, output_size - offset, "{\"items\":[");
-
-  for (size_t i = 0; i < count && offset < output_size - 2; i++) {
-    LSPCompletionItem *item = &items[i];
-    if (i > 0)
-      offset += snprintf(output + offset, output_size - offset, ",");
-
-    offset += snprintf(output + offset, output_size - offset,
-                       "{\"label\":\"%s\",\"kind\":%d",
-                       item->label ? item->label : "", item->kind);
-
-    if (item->insert_text) {
-      char escaped[2048];
-      json_escape(escaped, sizeof(escaped), item->insert_text);
-      offset += snprintf(output + offset, output_size - offset,
-                         ",\"insertText\":\"%s\",\"insertTextFormat\":%d",
-                         escaped, item->format);
-    }
+  json_end_array(w);
+  json_end_object(w);
+}
 
-    if (item->detail) {
-      char escaped_detail[512];
-      json_escape(escaped_detail, sizeof(escaped_detail), item->detail);
-      offset += snprintf(output + offset, output_size - offset,
-                         ",\"detail\":\"%s\"", escaped_detail);
+// Fields the item leaves unset (NULL, or a kind or format below 1) are
+// left out
+void serialize_completion_item(JsonWriter *w, const LSPCompletionItem *item) {
+  json_begin_object(w);
+  json_write_key(w, "label");
+  json_write_string(w, item->label);
+  if ((int)item->kind >= 1) {
+    json_write_key(w, "kind");
+    json_write_int(w, item->kind);
+  }
+  if (item->insert_text) {
+    json_write_key(w, "insertText");
+    json_write_string(w, item->insert_text);
+    if ((int)item->format >= 1) {
+      json_write_key(w, "insertTextFormat");
+      json_write_int(w, item->format);
     }
+  }
+  if (item->detail) {
+    json_write_key(w, "detail");
+    json_write_string(w, item->detail);
+  }
+  if (item->sort_text) {
+    json_write_key(w, "sortText");
+    json_write_string(w, item->sort_text);
+  }
+  if (item->filter_text) {
+    json_write_key(w, "filterText");
+    json_write_string(w, item->filter_text);
+  }
+  json_end_object(w);
+}
 
-    if (item->sort_text) {
-      offset += snprintf(output + offset, output_size - offset,
-                         ",\"sortText\":\"%s\"", item->sort_text);
-    }
+void serialize_completion_items(JsonWriter *w, const LSPCompletionItem *items,
+                                size_t count, bool is_incomplete) {
+  json_begin_object(w);
+  json_write_key(w, "isIncomplete");
+  json_write_bool(w, is_incomplete);
+  json_write_key(w, "items");
+  json_begin_array(w);
+  for (size_t i = 0; i < count; i++)
+    serialize_completion_item(w, &items[i]);
+  json_end_array(w);
+  json_end_object(w);
+}
 
-    if (item->filter_text) {
-      offset += snprintf(output + offset, output_size - offset,
-                         ",\"filterText\":\"%s\"", item->filter_text);
+void serialize_signature_help(JsonWriter *w, const LSPSignatureInfo *sig) {
+  json_begin_object(w);
+  json_write_key(w, "signatures");
+  json_begin_array(w);
+  json_begin_object(w);
+  json_write_key(w, "label");
+  json_write_string(w, sig->label);
+  if (sig->parameters && sig->parameter_count > 0) {
+    json_write_key(w, "parameters");
+    json_begin_array(w);
+    for (size_t i = 0; i < sig->parameter_count; i++) {
+      json_begin_object(w);
+      json_write_key(w, "label");
+      json_write_string(w, sig->parameters[i].label);
+      json_end_object(w);
     }
+    json_end_array(w);
+  }
+  json_end_object(w);
+  json_end_array(w);
+  json_write_key(w, "activeSignature");
+  json_write_int(w, 0);
+  json_write_key(w, "activeParameter");
+  json_write_int(w, (long long)sig->active_parameter);
+  json_end_object(w);
+}
 
-    offset += snprintf(output + offset, output_size - offset, "}");
+void serialize_code_actions(JsonWriter *w, const LSPCodeAction *actions,
+                            size_t count) {
+  json_begin_array(w);
+  for (size_t i = 0; i < count; i++) {
+    json_begin_object(w);
+    json_write_key(w, "title");
+    json_write_string(w, actions[i].title);
+    if (actions[i].kind) {
+      json_write_key(w, "kind");
+      json_write_string(w, actions[i].kind);
+    }
+    json_end_object(w);
   }
+  json_end_array(w);
+}
 
-  if (offset < output_size)
-    snprintf(output + offset, output_size - offset, "]}");
+void serialize_document_highlights(JsonWriter *w,
+                                   const LSPDocumentHighlight *highlights,
+                                   size_t count) {
+  json_begin_array(w);
+  for (size_t i = 0; i < count; i++) {
+    json_begin_object(w);
+    json_write_range(w, "range", highlights[i].range);
+    json_write_key(w, "kind");
+    json_write_int(w, highlights[i].kind);
+    json_end_object(w);
+  }
+  json_end_array(w);
 }
 
-void serialize_signature_help(LSPSignatureInfo *sig, char *output,
-                              size_t output_size) {
-  // Output: {"signatures":[{"label":"...","parameters":[...]}],"activeSignature":0,"activeParameter":N}
-  size_t off = 0;
-  off += snprintf(output + off, output_size - off,
-                  "{\"signatures\":[{\"label\":\"");
-  // Escape the label
-  for (const char *s = sig->label; *s && off < output_size - 10; s++) {
-    if (*s == '"') { output[off++] = '\\'; output[off++] = '"'; }
-    else if (*s == '\\') { output[off++] = '\\'; output[off++] = '\\'; }
-    else if (*s == '\n') { output[off++] = '\\'; output[off++] = 'n'; }
-    else { output[off++] = *s; }
+void serialize_document_symbols(JsonWriter *w, LSPDocumentSymbol **symbols,
+                                size_t count) {
+  json_begin_array(w);
+  for (size_t i = 0; i < count; i++) {
+    const LSPDocumentSymbol *sym = symbols[i];
+    json_begin_object(w);
+    json_write_key(w, "name");
+    json_write_string(w, sym->name);
+    json_write_key(w, "kind");
+    json_write_int(w, sym->kind);
+    json_write_range(w, "range", sym->range);
+    json_write_range(w, "selectionRange", sym->selection_range);
+    json_end_object(w);
   }
-  output[off] = '\0';
+  json_end_array(w);
+}
+
+void serialize_location(JsonWriter *w, const LSPLocation *location) {
+  json_begin_object(w);
+  json_write_key(w, "uri");
+  json_write_string(w, location->uri);
+  json_write_range(w, "range", location->range);
+  json_end_object(w);
+}
 
-  off += snprintf(output + off, output_size - off, "\"");
+void serialize_locations(JsonWriter *w, const LSPLocation *locations,
+                         size_t count) {
+  json_begin_array(w);
+  for (size_t i = 0; i < count; i++)
+    serialize_location(w, &locations[i]);
+  json_end_array(w);
+}
 
-  // Parameters
-  if (off < output_size && sig->parameters && sig->parameter_count > 0) {
-    off += snprintf(output + off, output_size - off, ",\"parameters\":[");
-    for (size_t i = 0; i < sig->parameter_count && off < output_size - 10; i++) {
-      if (i > 0) off += snprintf(output + off, output_size - off, ",");
-      off += snprintf(output + off, output_size - off,
-                      "{\"label\":\"%s\"}",
-                      sig->parameters[i].label ? sig->parameters[i].label : "");
+// A WorkspaceEdit replacing each location with `new_text`. The locations
+// of a document come one after another.
+void serialize_workspace_edit(JsonWriter *w, const LSPLocation *locations,
+                              size_t count, const char *new_text) {
+  json_begin_object(w);
+  json_write_key(w, "changes");
+  json_begin_object(w);
+  for (size_t i = 0; i < count; i++) {
+    if (i == 0 || strcmp(locations[i].uri, locations[i - 1].uri) != 0) {
+      if (i > 0)
+        json_end_array(w);
+      json_write_key(w, locations[i].uri);
+      json_begin_array(w);
     }
-    if (off < output_size)
-      off += snprintf(output + off, output_size - off, "]");
-  }
-
-  if (off < output_size)
-    off += snprintf(output + off, output_size - off, "}]");
-  if (off < output_size)
-    off += snprintf(output + off, output_size - off,
-                    ",\"activeSignature\":0,\"activeParameter\":%zu}",
-                    sig->active_parameter);
-}
-
-void serialize_code_actions(LSPCodeAction *actions, size_t count,
-                            char *output, size_t output_size) {
-  size_t off = 0;
-  off += snprintf(output + off, output_size - off, "[");
-  for (size_t i = 0; i < count && off < output_size - 4; i++) {
-    if (i > 0) off += snprintf(output + off, output_size - off, ",");
-    off += snprintf(output + off, output_size - off,
-                    "{\"title\":\"%s\"",
-                    actions[i].title ? actions[i].title : "");
-    if (actions[i].kind) {
-      off += snprintf(output + off, output_size - off,
-                      ",\"kind\":\"%s\"", actions[i].kind);
+    json_begin_object(w);
+    json_write_range(w, "range", locations[i].range);
+    json_write_key(w, "newText");
+    json_write_string(w, new_text);
+    json_end_object(w);
+  }
+  if (count > 0)
+    json_end_array(w);
+  json_end_object(w);
+  json_end_object(w);
+}
+
+// SymbolInformation[] for workspace/symbol
+void serialize_workspace_symbols(JsonWriter *w,
+                                 const LSPWorkspaceSymbol *symbols,
+                                 size_t count) {
+  json_begin_array(w);
+  for (size_t i = 0; i < count; i++) {
+    json_begin_object(w);
+    json_write_key(w, "name");
+    json_write_string(w, symbols[i].name);
+    json_write_key(w, "kind");
+    json_write_int(w, symbols[i].kind);
+    json_write_key(w, "location");
+    serialize_location(w, &symbols[i].location);
+    if (symbols[i].container) {
+      json_write_key(w, "containerName");
+      json_write_string(w, symbols[i].container);
     }
-    off += snprintf(output + off, output_size - off, "}");
-  }
-  if (off < output_size)
-  if (off < output_size)
-    snprintf(output + off, output_size - off, "]");
-}
-
-void serialize_document_highlights(LSPDocumentHighlight *highlights,
-                                   size_t count, char *output,
-                                   size_t output_size) {
-  size_t off = 0;
-  off += snprintf(output + off, output_size - off, "[");
-  for (size_t i = 0; i < count && off < output_size - 4; i++) {
-    if (i > 0) off += snprintf(output + off, output_size - off, ",");
-    off += snprintf(
-        output + off, output_size - off,
-        "{\"range\":{\"start\":{\"line\":%d,\"character\":%d},"
-        "\"end\":{\"line\":%d,\"character\":%d}},\"kind\":%d}",
-        highlights[i].range.start.line,
-        highlights[i].range.start.character,
-        highlights[i].range.end.line,
-        highlights[i].range.end.character,
-        highlights[i].kind);
-  }
-  snprintf(output + off, output_size - off, "]");
-}
\ No newline at end of file
+    json_end_object(w);
+  }
+  json_end_array(w);
+}
+
+// TextEdit[] for formatting and rangeFormatting
+void serialize_text_edits(JsonWriter *w, const LSPTextEdit *edits,
+                          size_t count) {
+  json_begin_array(w);
+  for (size_t i = 0; i < count; i++) {
+    json_begin_object(w);
+    json_write_range(w, "range", edits[i].range);
+    json_write_key(w, "newText");
+    json_write_string(w, edits[i].new_text);
+    json_end_object(w);
+  }
+  json_end_array(w);
+}
@@ -14,39 +14,7 @@ static long ms_since(struct timespec *t) {
   return (now.tv_sec - t->tv_sec) * 1000 + (now.tv_nsec - t->tv_nsec) / 1000000;
 }
 
-// Run analysis + publish diagnostics for a document.
-// Called either immediately (on save/open) or after debounce (on change).
-static void analyze_and_publish(LSPServer *server, LSPDocument *doc,
-                                const char *uri, ArenaAllocator *arena) {
-  if (!server || !doc || !uri || !arena)
-    return;
-
-  BuildConfig config = {0};
-  config.check_mem = true;
-  config.target_os = detect_target_os();
-  lsp_document_analyze(doc, server, &config);
-
-  size_t diag_count;
-  LSPDiagnostic *diagnostics = lsp_diagnostics(doc, &diag_count, arena);
-
-  size_t buf_size = 65536;
-  char *params = (char *)malloc(buf_size);
-  if (params) {
-    serialize_diagnostics_to_json(uri, diagnostics, diag_count, params, buf_size);
-    lsp_send_notification("textDocument/publishDiagnostics", params);
-    free(params);
-  }
-
-  // After analysis completes, tokens are freshly populated.
-  // Tell the client to re-request semantic tokens — it previously got
-  // {"data":[]} because didChange cleared the token array before the
-  // debounced analysis had run.
-  lsp_send_request("workspace/semanticTokens/refresh", "null");
-
-  g_pending_analysis = false;
-}
-
-// Check if a pending debounced analysis is due and run it.
+// Check if a pending debounced analysis is due and queue it.
 // Called at the top of the message loop (from lsp_server_run) so we process
 // the debounced typecheck even when no new messages arrive.
 void lsp_check_pending_analysis(LSPServer *server) {
@@ -59,48 +27,107 @@ void lsp_check_pending_analysis(LSPServer *server) {
   for (size_t i = 0; i < server->document_count; i++) {
     LSPDocument *doc = server->documents[i];
     if (doc && doc->needs_reanalysis) {
-      ArenaAllocator temp;
-      arena_allocator_init(&temp, 64 * 1024);
-      fprintf(stderr, "[LSP] Debounce: running deferred analysis for %s\n",
+      fprintf(stderr, "[LSP] Debounce: queueing deferred analysis for %s\n",
               doc->uri);
-      analyze_and_publish(server, doc, doc->uri, &temp);
-      arena_destroy(&temp);
+      lsp_analysis_schedule(server, doc, false);
     }
   }
+  g_pending_analysis = false;
+}
+
+// Requests answered from the documents' published analyses
+static bool reads_analysis(LSPMethod method) {
+  switch (method) {
+  case LSP_METHOD_TEXT_DOCUMENT_HOVER:
+  case LSP_METHOD_TEXT_DOCUMENT_DEFINITION:
+  case LSP_METHOD_TEXT_DOCUMENT_COMPLETION:
+  case LSP_METHOD_TEXT_DOCUMENT_DOCUMENT_SYMBOL:
+  case LSP_METHOD_TEXT_DOCUMENT_SEMANTIC_TOKENS:
+  case LSP_METHOD_TEXT_DOCUMENT_SEMANTIC_TOKENS_DELTA:
+  case LSP_METHOD_TEXT_DOCUMENT_SEMANTIC_TOKENS_RANGE:
+  case LSP_METHOD_TEXT_DOCUMENT_SIGNATURE_HELP:
+  case LSP_METHOD_TEXT_DOCUMENT_CODE_ACTION:
+  case LSP_METHOD_TEXT_DOCUMENT_RENAME:
+  case LSP_METHOD_TEXT_DOCUMENT_DOCUMENT_HIGHLIGHT:
+  case LSP_METHOD_TEXT_DOCUMENT_REFERENCES:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// params.textDocument.uri, the document most requests are about
+static const char *document_uri(const JsonValue *params) {
+  return json_as_string(json_get(json_get(params, "textDocument"), "uri"));
+}
+
+static LSPPosition position_of(const JsonValue *position) {
+  LSPPosition pos = {0, 0};
+  if (position) {
+    pos.line = json_as_int(json_get(position, "line"), -1);
+    pos.character = json_as_int(json_get(position, "character"), -1);
+  }
+  return pos;
 }
 
-void lsp_handle_message(LSPServer *server, const char *message) {
-  if (!server || !message)
+// The folder to index: the first workspace folder, or else the root
+static const char *workspace_uri(const JsonValue *params) {
+  const char *uri = json_as_string(
+      json_get(json_first(json_get(params, "workspaceFolders")), "uri"));
+  return uri ? uri : json_as_string(json_get(params, "rootUri"));
+}
+
+// Handles one message. Its text is parsed once, in place: the strings the
+// handlers read are decoded into it.
+void lsp_handle_message(LSPServer *server, char *text, size_t length) {
+  if (!server || !text)
+    return;
+
+  fprintf(stderr, "[LSP] Received message: %.500s...\n", text);
+
+  LSPMessage message;
+  if (!lsp_message_parse(&message, text, length))
     return;
 
-  fprintf(stderr, "[LSP] Received message: %.500s...\n", message);
+  LSPMethod method = message.method;
+  int request_id = message.id;
+  const JsonValue *params = message.params;
 
-  LSPMethod method = lsp_parse_method(message);
-  int request_id = extract_int(message, "id");
+  fprintf(stderr, "[LSP] Method %s, request_id %d\n",
+          message.method_name ? message.method_name : "(response)",
+          request_id);
 
-  fprintf(stderr, "[LSP] Extracted request_id: %d\n", request_id);
+  // The worker waits to publish newer results until the request is done
+  bool reading = reads_analysis(method);
+  if (reading)
+    pthread_mutex_lock(&server->snapshot_lock);
 
   ArenaAllocator temp_arena;
   arena_allocator_init(&temp_arena, 64 * 1024);
+  JsonWriter w;
 
   switch (method) {
   case LSP_METHOD_INITIALIZE: {
-    fprintf(stderr, "[LSP] FULL INIT MESSAGE: %s\n", message);
     fprintf(stderr, "[LSP] Handling initialize\n");
 
     if (request_id >= 0) {
-      const char *workspace_uri = extract_string(message, "uri", &temp_arena);
-      if (workspace_uri) {
-        build_module_registry(server, workspace_uri);
+      const char *workspace = workspace_uri(params);
+      if (workspace) {
+        pthread_mutex_lock(&server->compiler_lock);
+        build_module_registry(server, workspace);
+        pthread_mutex_unlock(&server->compiler_lock);
+        lsp_workspace_index_schedule(server);
       }
 
       server->initialized = true;
       const char *capabilities =
           "{"
           "\"capabilities\":{"
-          "\"textDocumentSync\":1,"
+          "\"textDocumentSync\":{\"openClose\":true,\"change\":2},"
           "\"hoverProvider\":true,"
           "\"definitionProvider\":true,"
+          "\"referencesProvider\":true,"
+          "\"workspaceSymbolProvider\":true,"
           "\"completionProvider\":{"
           "\"triggerCharacters\":[\".\",\":\",\"(\",\",\",\" \"],"
           "\"resolveProvider\":true"
@@ -113,6 +140,7 @@ void lsp_handle_message(LSPServer *server, const char *message) {
           "\"documentHighlightProvider\":true,"
           "\"documentSymbolProvider\":true,"
           "\"documentFormattingProvider\":true,"
+          "\"documentRangeFormattingProvider\":true,"
           "\"semanticTokensProvider\":{"
           "\"legend\":{"
           "\"tokenTypes\":["
@@ -128,8 +156,8 @@ void lsp_handle_message(LSPServer *server, const char *message) {
           "\"readonly\",\"static\",\"defaultLibrary\""
           "]"
           "},"
-          "\"full\":true,"
-          "\"range\":false"
+          "\"full\":{\"delta\":true},"
+          "\"range\":true"
           "}"
           "},"
           "\"serverInfo\":{\"name\":\"Luma LSP\",\"version\":\"0.2.0\"}"
@@ -148,22 +176,20 @@ void lsp_handle_message(LSPServer *server, const char *message) {
   case LSP_METHOD_TEXT_DOCUMENT_DID_OPEN: {
     fprintf(stderr, "[LSP] Handling didOpen\n");
 
-    const char *uri = extract_string(message, "uri", &temp_arena);
-    const char *text = extract_string(message, "text", &temp_arena);
-    int version = extract_int(message, "version");
+    const JsonValue *document = json_get(params, "textDocument");
+    const char *uri = json_as_string(json_get(document, "uri"));
+    const char *text = json_as_string(json_get(document, "text"));
+    int version = json_as_int(json_get(document, "version"), -1);
 
     if (uri && text) {
       fprintf(stderr, "[LSP] Opening document: %s (version %d)\n", uri,
               version);
       fprintf(stderr, "[LSP] Document content length: %zu\n", strlen(text));
 
-      lsp_ast_cache_invalidate(server, uri);
-      lsp_negative_cache_clear();
-
       LSPDocument *doc = lsp_document_open(server, uri, text, version);
       if (doc) {
         // Always analyze immediately on open
-        analyze_and_publish(server, doc, uri, &temp_arena);
+        lsp_analysis_schedule(server, doc, true);
       }
     }
     break;
@@ -172,12 +198,39 @@ void lsp_handle_message(LSPServer *server, const char *message) {
   case LSP_METHOD_TEXT_DOCUMENT_DID_CHANGE: {
     fprintf(stderr, "[LSP] Handling didChange\n");
 
-    const char *uri = extract_string(message, "uri", &temp_arena);
-    const char *text = extract_string(message, "text", &temp_arena);
-    int version = extract_int(message, "version");
+    const char *uri = document_uri(params);
+    int version =
+        json_as_int(json_get(json_get(params, "textDocument"), "version"), -1);
+
+    // Sync is incremental: each change is a range and its replacement, or
+    // the whole text when the client sends it that way
+    const JsonValue *entries = json_get(params, "contentChanges");
+    size_t change_count =
+        entries && entries->kind == JSON_ARRAY ? entries->count : 0;
+    LSPTextChange *changes =
+        arena_alloc(&temp_arena, (change_count + 1) * sizeof(LSPTextChange),
+                    alignof(LSPTextChange));
+
+    size_t i = 0;
+    for (const JsonValue *entry = json_first(entries); changes && entry;
+         entry = json_next(entries, entry), i++) {
+      changes[i].text = json_as_string(json_get(entry, "text"));
+      const JsonValue *range = json_get(entry, "range");
+      changes[i].has_range = range && range->kind == JSON_OBJECT;
+      if (changes[i].has_range) {
+        const JsonValue *start = json_get(range, "start");
+        const JsonValue *end = json_get(range, "end");
+        changes[i].range.start.line = json_as_int(json_get(start, "line"), 0);
+        changes[i].range.start.character =
+            json_as_int(json_get(start, "character"), 0);
+        changes[i].range.end.line = json_as_int(json_get(end, "line"), 0);
+        changes[i].range.end.character =
+            json_as_int(json_get(end, "character"), 0);
+      }
+    }
 
-    if (uri && text) {
-      lsp_document_update(server, uri, text, version);
+    if (uri && changes && change_count > 0) {
+      lsp_document_update(server, uri, changes, change_count, version);
 
       // Mark as pending — debounced analysis will fire after DEBOUNCE_MS
       clock_gettime(CLOCK_MONOTONIC, &g_last_change);
@@ -191,7 +244,7 @@ void lsp_handle_message(LSPServer *server, const char *message) {
 
   case LSP_METHOD_TEXT_DOCUMENT_DID_CLOSE: {
     fprintf(stderr, "[LSP] Handling didClose\n");
-    const char *uri = extract_string(message, "uri", &temp_arena);
+    const char *uri = document_uri(params);
     if (uri) {
       lsp_document_close(server, uri);
     }
@@ -199,24 +252,15 @@ void lsp_handle_message(LSPServer *server, const char *message) {
   }
 
   // textDocument/didSave — treat as immediate re-analysis trigger
-  case LSP_METHOD_UNKNOWN: {
-    // Check if it's didSave (we don't have a dedicated enum value for it)
-    const char *method_val = extract_string(message, "method", &temp_arena);
-    if (method_val && strncmp(method_val, "textDocument/didSave", 20) == 0) {
-      fprintf(stderr,
-              "[LSP] Handling didSave — triggering immediate analysis\n");
-      const char *uri = extract_string(message, "uri", &temp_arena);
-      if (uri) {
-        lsp_ast_cache_invalidate(server, uri);
-        lsp_negative_cache_clear();
-        LSPDocument *doc = lsp_document_find(server, uri);
-        if (doc) {
-          doc->needs_reanalysis = true;
-          analyze_and_publish(server, doc, uri, &temp_arena);
-        }
+  case LSP_METHOD_TEXT_DOCUMENT_DID_SAVE: {
+    fprintf(stderr, "[LSP] Handling didSave — triggering immediate analysis\n");
+    const char *uri = document_uri(params);
+    if (uri) {
+      LSPDocument *doc = lsp_document_find(server, uri);
+      if (doc) {
+        lsp_analysis_cancel(server, doc);
+        lsp_analysis_schedule(server, doc, true);
       }
-    } else {
-      fprintf(stderr, "[LSP] Unhandled method\n");
     }
     break;
   }
@@ -224,32 +268,26 @@ void lsp_handle_message(LSPServer *server, const char *message) {
   case LSP_METHOD_TEXT_DOCUMENT_HOVER: {
     fprintf(stderr, "[LSP] Handling hover\n");
 
-    const char *uri = extract_string(message, "uri", &temp_arena);
-    LSPPosition position = extract_position(message);
+    const char *uri = document_uri(params);
+    LSPPosition position = position_of(json_get(params, "position"));
+    LSPDocument *doc = uri ? lsp_document_find(server, uri) : NULL;
+    const char *hover_text =
+        doc ? lsp_hover(doc, position, &temp_arena) : NULL;
 
-    if (uri) {
-      LSPDocument *doc = lsp_document_find(server, uri);
-      if (doc) {
-        const char *hover_text = lsp_hover(doc, position, &temp_arena);
-        if (hover_text) {
-          size_t hover_len = strlen(hover_text);
-          size_t result_size = hover_len + 128;
-          char *result = (char *)malloc(result_size);
-          if (result) {
-            snprintf(result, result_size,
-                     "{\"contents\":{\"kind\":\"markdown\",\"value\":\"%s\"}}",
-                     hover_text);
-            lsp_send_response(request_id, result);
-            free(result);
-          } else {
-            lsp_send_response(request_id, "null");
-          }
-        } else {
-          lsp_send_response(request_id, "null");
-        }
-      } else {
-        lsp_send_response(request_id, "null");
-      }
+    if (uri && !hover_text) {
+      lsp_send_response(request_id, "null");
+    } else if (hover_text) {
+      lsp_response_begin(&w, request_id);
+      json_begin_object(&w);
+      json_write_key(&w, "contents");
+      json_begin_object(&w);
+      json_write_key(&w, "kind");
+      json_write_string(&w, "markdown");
+      json_write_key(&w, "value");
+      json_write_escaped(&w, hover_text);
+      json_end_object(&w);
+      json_end_object(&w);
+      lsp_message_send(&w);
     }
     break;
   }
@@ -257,29 +295,17 @@ void lsp_handle_message(LSPServer *server, const char *message) {
   case LSP_METHOD_TEXT_DOCUMENT_DEFINITION: {
     fprintf(stderr, "[LSP] Handling definition\n");
 
-    const char *uri = extract_string(message, "uri", &temp_arena);
-    LSPPosition position = extract_position(message);
+    const char *uri = document_uri(params);
+    LSPPosition position = position_of(json_get(params, "position"));
 
     if (uri) {
       LSPDocument *doc = lsp_document_find(server, uri);
-      if (doc) {
-        LSPLocation *loc = lsp_definition(doc, server, position, &temp_arena);
-        if (loc) {
-          size_t uri_len = loc->uri ? strlen(loc->uri) : 0;
-          size_t result_size = uri_len + 256;
-          char *result = (char *)malloc(result_size);
-          if (!result) { lsp_send_response(request_id, "null"); break; }
-          snprintf(result, result_size,
-                   "{\"uri\":\"%s\",\"range\":{\"start\":{\"line\":%d,"
-                   "\"character\":%d},"
-                   "\"end\":{\"line\":%d,\"character\":%d}}}",
-                   loc->uri, loc->range.start.line, loc->range.start.character,
-                   loc->range.end.line, loc->range.end.character);
-          lsp_send_response(request_id, result);
-          free(result);
-        } else {
-          lsp_send_response(request_id, "null");
-        }
+      LSPLocation *loc =
+          doc ? lsp_definition(doc, server, position, &temp_arena) : NULL;
+      if (loc) {
+        lsp_response_begin(&w, request_id);
+        serialize_location(&w, loc);
+        lsp_message_send(&w);
       } else {
         lsp_send_response(request_id, "null");
       }
@@ -290,103 +316,63 @@ void lsp_handle_message(LSPServer *server, const char *message) {
   case LSP_METHOD_TEXT_DOCUMENT_COMPLETION: {
     fprintf(stderr, "[LSP] Handling completion\n");
 
-    const char *uri = extract_string(message, "uri", &temp_arena);
-    LSPPosition position = extract_position(message);
+    const char *uri = document_uri(params);
+    LSPPosition position = position_of(json_get(params, "position"));
 
     fprintf(stderr, "[LSP] Completion: uri=%s line=%d character=%d\n",
             uri ? uri : "NULL", position.line, position.character);
 
-    if (!uri) {
-      lsp_send_response(request_id, "{\"items\":[]}");
-      break;
-    }
-
-    LSPDocument *doc = lsp_document_find(server, uri);
-    if (!doc) {
+    LSPDocument *doc = uri ? lsp_document_find(server, uri) : NULL;
+    if (uri && !doc)
       fprintf(stderr, "[LSP] Completion: document not found\n");
-      lsp_send_response(request_id, "{\"items\":[]}");
-      break;
-    }
 
     size_t count = 0;
+    bool is_incomplete = false;
     LSPCompletionItem *items =
-        lsp_completion(doc, position, &count, &temp_arena);
+        doc ? lsp_completion(doc, position, &count, &is_incomplete,
+                             &temp_arena)
+            : NULL;
 
     fprintf(stderr, "[LSP] Completion: got %zu items\n", count);
 
-    if (!items || count == 0) {
-      lsp_send_response(request_id, "{\"items\":[]}");
-      break;
-    }
-
-    size_t result_size = count * 512 + 64;
-    char *result = (char *)malloc(result_size);
-    if (!result) {
-      lsp_send_response(request_id, "{\"items\":[]}");
-      break;
-    }
-
-    serialize_completion_items(items, count, result, result_size);
-
-    fprintf(
-        stderr,
-        "[LSP] Completion: sending response (id=%d, items=%zu, bytes=%zu)\n",
-        request_id, count, strlen(result));
-
-    lsp_send_response(request_id, result);
-    free(result);
+    lsp_response_begin(&w, request_id);
+    serialize_completion_items(&w, items, items ? count : 0, is_incomplete);
+    fprintf(stderr,
+            "[LSP] Completion: sending response (id=%d, items=%zu, "
+            "bytes=%zu)\n",
+            request_id, count, w.length);
+    lsp_message_send(&w);
     break;
   }
 
   case LSP_METHOD_TEXT_DOCUMENT_SIGNATURE_HELP: {
     fprintf(stderr, "[LSP] Handling signatureHelp\n");
-    const char *uri = extract_string(message, "uri", &temp_arena);
-    LSPPosition position = extract_position(message);
-
-    if (!uri) {
-      lsp_send_response(request_id, "null");
-      break;
-    }
-
-    LSPDocument *doc = lsp_document_find(server, uri);
-    if (!doc) {
-      lsp_send_response(request_id, "null");
-      break;
-    }
+    const char *uri = document_uri(params);
+    LSPPosition position = position_of(json_get(params, "position"));
+    LSPDocument *doc = uri ? lsp_document_find(server, uri) : NULL;
 
     size_t sig_count = 0;
     LSPSignatureInfo *sigs =
-        lsp_signature_help(doc, position, &sig_count, &temp_arena);
+        doc ? lsp_signature_help(doc, position, &sig_count, &temp_arena)
+            : NULL;
 
     if (!sigs || sig_count == 0) {
       lsp_send_response(request_id, "null");
       break;
     }
 
-    size_t result_size = 8192;
-    char *result = (char *)malloc(result_size);
-    if (!result) {
-      lsp_send_response(request_id, "null");
-      break;
-    }
-
-    serialize_signature_help(sigs, result, result_size);
-    lsp_send_response(request_id, result);
-    free(result);
+    lsp_response_begin(&w, request_id);
+    serialize_signature_help(&w, sigs);
+    lsp_message_send(&w);
     break;
   }
 
   case LSP_METHOD_TEXT_DOCUMENT_CODE_ACTION: {
     fprintf(stderr, "[LSP] Handling codeAction\n");
-    const char *uri = extract_string(message, "uri", &temp_arena);
-    LSPPosition position = extract_position(message);
-
-    if (!uri) {
-      lsp_send_response(request_id, "{\"actions\":[]}");
-      break;
-    }
+    const char *uri = document_uri(params);
+    LSPPosition position = position_of(json_get(params, "position"));
+    LSPDocument *doc = uri ? lsp_document_find(server, uri) : NULL;
 
-    LSPDocument *doc = lsp_document_find(server, uri);
     if (!doc) {
       lsp_send_response(request_id, "{\"actions\":[]}");
       break;
@@ -396,29 +382,17 @@ void lsp_handle_message(LSPServer *server, const char *message) {
     LSPCodeAction *actions =
         lsp_code_action(doc, position, &action_count, &temp_arena);
 
-    if (!actions || action_count == 0) {
-      lsp_send_response(request_id, "[]");
-      break;
-    }
-
-    size_t result_size = action_count * 512 + 64;
-    char *result = (char *)malloc(result_size);
-    if (!result) {
-      lsp_send_response(request_id, "[]");
-      break;
-    }
-
-    serialize_code_actions(actions, action_count, result, result_size);
-    lsp_send_response(request_id, result);
-    free(result);
+    lsp_response_begin(&w, request_id);
+    serialize_code_actions(&w, actions, actions ? action_count : 0);
+    lsp_message_send(&w);
     break;
   }
 
   case LSP_METHOD_TEXT_DOCUMENT_RENAME: {
     fprintf(stderr, "[LSP] Handling rename\n");
-    const char *uri = extract_string(message, "uri", &temp_arena);
-    LSPPosition position = extract_position(message);
-    const char *new_name = extract_string(message, "newName", &temp_arena);
+    const char *uri = document_uri(params);
+    LSPPosition position = position_of(json_get(params, "position"));
+    const char *new_name = json_as_string(json_get(params, "newName"));
 
     if (!uri || !new_name) {
       lsp_send_error(request_id, -32602, "Invalid params for rename");
@@ -426,239 +400,185 @@ void lsp_handle_message(LSPServer *server, const char *message) {
     }
 
     LSPDocument *doc = lsp_document_find(server, uri);
-    if (!doc) {
+    size_t count = 0;
+    LSPLocation *locations =
+        doc ? lsp_rename(doc, server, position, &count, &temp_arena) : NULL;
+    if (!locations) {
       lsp_send_response(request_id, "null");
       break;
     }
 
-    const char *edit_json = lsp_rename(doc, position, new_name, &temp_arena);
-    if (edit_json) {
-      size_t result_size = strlen(edit_json) + 64;
-      char *result = (char *)malloc(result_size);
-      if (result) {
-        snprintf(result, result_size, "{\"changes\":{%s}}", edit_json);
-        lsp_send_response(request_id, result);
-        free(result);
-      } else {
-        lsp_send_response(request_id, "null");
-      }
-    } else {
-      lsp_send_response(request_id, "null");
-    }
+    lsp_response_begin(&w, request_id);
+    serialize_workspace_edit(&w, locations, count, new_name);
+    lsp_message_send(&w);
     break;
   }
 
-  case LSP_METHOD_TEXT_DOCUMENT_DOCUMENT_HIGHLIGHT: {
-    fprintf(stderr, "[LSP] Handling documentHighlight\n");
-    const char *uri = extract_string(message, "uri", &temp_arena);
-    LSPPosition position = extract_position(message);
+  case LSP_METHOD_TEXT_DOCUMENT_REFERENCES: {
+    fprintf(stderr, "[LSP] Handling references\n");
+    const char *uri = document_uri(params);
+    LSPPosition position = position_of(json_get(params, "position"));
+    const JsonValue *include = json_get(json_get(params, "context"),
+                                        "includeDeclaration");
+    bool include_declaration = include && include->kind == JSON_TRUE;
+    LSPDocument *doc = uri ? lsp_document_find(server, uri) : NULL;
 
-    if (!uri) {
-      lsp_send_response(request_id, "[]");
-      break;
-    }
-
-    LSPDocument *doc = lsp_document_find(server, uri);
-    if (!doc) {
-      lsp_send_response(request_id, "[]");
-      break;
-    }
-
-    size_t hl_count = 0;
-    LSPDocumentHighlight *highlights =
-        lsp_document_highlight(doc, position, &hl_count, &temp_arena);
+    size_t count = 0;
+    LSPLocation *locations =
+        doc ? lsp_references(doc, server, position, include_declaration,
+                             &count, &temp_arena)
+            : NULL;
+
+    lsp_response_begin(&w, request_id);
+    serialize_locations(&w, locations, locations ? count : 0);
+    lsp_message_send(&w);
+    break;
+  }
 
-    if (!highlights || hl_count == 0) {
-      lsp_send_response(request_id, "[]");
-      break;
-    }
+  case LSP_METHOD_WORKSPACE_SYMBOL: {
+    fprintf(stderr, "[LSP] Handling workspace/symbol\n");
+    const char *query = json_as_string(json_get(params, "query"));
 
-    size_t result_size = hl_count * 128 + 16;
-    char *result = (char *)malloc(result_size);
-    if (!result) {
-      lsp_send_response(request_id, "[]");
-      break;
-    }
+    size_t count = 0;
+    LSPWorkspaceSymbol *symbols =
+        lsp_workspace_symbols(server, query, &count, &temp_arena);
 
-    serialize_document_highlights(highlights, hl_count, result, result_size);
-    lsp_send_response(request_id, result);
-    free(result);
+    lsp_response_begin(&w, request_id);
+    serialize_workspace_symbols(&w, symbols, symbols ? count : 0);
+    lsp_message_send(&w);
     break;
   }
 
-  case LSP_METHOD_TEXT_DOCUMENT_COMPLETION_ITEM_RESOLVE: {
-    fprintf(stderr, "[LSP] Handling completionItem/resolve\n");
-    char *label = extract_string(message, "label", &temp_arena);
-    int kind = extract_int(message, "kind");
-    char *detail = extract_string(message, "detail", &temp_arena);
-    char *insert_text = extract_string(message, "insertText", &temp_arena);
-    int insert_fmt = extract_int(message, "insertTextFormat");
-    char *sort_text = extract_string(message, "sortText", &temp_arena);
-    char *filter_text = extract_string(message, "filterText", &temp_arena);
-
-    if (label) {
-      size_t result_size = 4096;
-      char *result = (char *)malloc(result_size);
-      if (!result) { lsp_send_response(request_id, "null"); break; }
-
-      size_t off = 0;
-      if (off < result_size)
-        off += snprintf(result + off, result_size - off,
-                        "{\"label\":\"%s\"", label);
-
-      if (kind >= 1 && off < result_size)
-        off += snprintf(result + off, result_size - off,
-                        ",\"kind\":%d", kind);
-
-      if (detail && off < result_size) {
-        char escaped[512];
-        json_escape(escaped, sizeof(escaped), detail);
-        off += snprintf(result + off, result_size - off,
-                        ",\"detail\":\"%s\"", escaped);
-      }
-
-      if (insert_text && off < result_size) {
-        char escaped[2048];
-        json_escape(escaped, sizeof(escaped), insert_text);
-        off += snprintf(result + off, result_size - off,
-                        ",\"insertText\":\"%s\"", escaped);
-        if (insert_fmt >= 1 && off < result_size)
-          off += snprintf(result + off, result_size - off,
-                          ",\"insertTextFormat\":%d", insert_fmt);
-      }
-
-      if (sort_text && off < result_size) {
-        char escaped[64];
-        json_escape(escaped, sizeof(escaped), sort_text);
-        off += snprintf(result + off, result_size - off,
-                        ",\"sortText\":\"%s\"", escaped);
-      }
+  case LSP_METHOD_TEXT_DOCUMENT_DOCUMENT_HIGHLIGHT: {
+    fprintf(stderr, "[LSP] Handling documentHighlight\n");
+    const char *uri = document_uri(params);
+    LSPPosition position = position_of(json_get(params, "position"));
+    LSPDocument *doc = uri ? lsp_document_find(server, uri) : NULL;
 
-      if (filter_text && off < result_size) {
-        char escaped[256];
-        json_escape(escaped, sizeof(escaped), filter_text);
-        off += snprintf(result + off, result_size - off,
-                        ",\"filterText\":\"%s\"", escaped);
-      }
+    size_t hl_count = 0;
+    LSPDocumentHighlight *highlights =
+        doc ? lsp_document_highlight(doc, server, position, &hl_count,
+                                     &temp_arena)
+            : NULL;
 
-      if (off < result_size)
-        off += snprintf(result + off, result_size - off, "}");
-      lsp_send_response(request_id, result);
-      free(result);
-    } else {
-      lsp_send_response(request_id, "null");
-    }
+    lsp_response_begin(&w, request_id);
+    serialize_document_highlights(&w, highlights, highlights ? hl_count : 0);
+    lsp_message_send(&w);
     break;
   }
 
-  case LSP_METHOD_TEXT_DOCUMENT_FORMATTING: {
-    fprintf(stderr, "[LSP] Handling formatting\n");
-    const char *uri = extract_string(message, "uri", &temp_arena);
-
-    if (!uri) {
-      lsp_send_response(request_id, "[]");
+  case LSP_METHOD_TEXT_DOCUMENT_COMPLETION_ITEM_RESOLVE: {
+    fprintf(stderr, "[LSP] Handling completionItem/resolve\n");
+    // The item comes back as it was sent, and goes out again as it came
+    LSPCompletionItem item = {
+        .label = json_as_string(json_get(params, "label")),
+        .kind = json_as_int(json_get(params, "kind"), -1),
+        .insert_text = json_as_string(json_get(params, "insertText")),
+        .format = json_as_int(json_get(params, "insertTextFormat"), -1),
+        .detail = json_as_string(json_get(params, "detail")),
+        .sort_text = json_as_string(json_get(params, "sortText")),
+        .filter_text = json_as_string(json_get(params, "filterText")),
+    };
+
+    if (!item.label) {
+      lsp_send_response(request_id, "null");
       break;
     }
 
-    LSPDocument *doc = lsp_document_find(server, uri);
-    if (!doc || !doc->content) {
-      lsp_send_response(request_id, "[]");
-      break;
-    }
+    lsp_response_begin(&w, request_id);
+    serialize_completion_item(&w, &item);
+    lsp_message_send(&w);
+    break;
+  }
 
-    // Use the built-in formatter on the document content
-    // Return empty edits for now - formatter is invoked separately
-    lsp_send_response(request_id, "[]");
+  case LSP_METHOD_TEXT_DOCUMENT_FORMATTING:
+  case LSP_METHOD_TEXT_DOCUMENT_RANGE_FORMATTING: {
+    bool whole = method == LSP_METHOD_TEXT_DOCUMENT_FORMATTING;
+    fprintf(stderr, "[LSP] Handling %s\n",
+            whole ? "formatting" : "rangeFormatting");
+    const char *uri = document_uri(params);
+    LSPDocument *doc = uri ? lsp_document_find(server, uri) : NULL;
+    const JsonValue *range = json_get(params, "range");
+    LSPRange lines = {position_of(json_get(range, "start")),
+                      position_of(json_get(range, "end"))};
+
+    // The formatter reads the document's current text, not its analysis
+    size_t edit_count = 0;
+    LSPTextEdit *edits =
+        doc ? lsp_format(doc, whole ? NULL : &lines, &edit_count, &temp_arena)
+            : NULL;
+
+    fprintf(stderr, "[LSP] formatting: sending %zu edits\n", edit_count);
+    lsp_response_begin(&w, request_id);
+    serialize_text_edits(&w, edits, edit_count);
+    lsp_message_send(&w);
     break;
   }
 
   case LSP_METHOD_TEXT_DOCUMENT_DOCUMENT_SYMBOL: {
     fprintf(stderr, "[LSP] Handling documentSymbol\n");
 
-    const char *uri = extract_string(message, "uri", &temp_arena);
-
-    if (!uri) {
-      lsp_send_response(request_id, "[]");
-      break;
-    }
-
-    LSPDocument *doc = lsp_document_find(server, uri);
-    if (!doc) {
+    const char *uri = document_uri(params);
+    LSPDocument *doc = uri ? lsp_document_find(server, uri) : NULL;
+    if (uri && !doc)
       fprintf(stderr, "[LSP] documentSymbol: document not found for %s\n", uri);
-      lsp_send_response(request_id, "[]");
-      break;
-    }
-
-    ArenaAllocator sym_arena;
-    arena_allocator_init(&sym_arena, 64 * 1024);
 
     size_t sym_count = 0;
     LSPDocumentSymbol **symbols =
-        lsp_document_symbols(doc, &sym_count, &sym_arena);
+        doc ? lsp_document_symbols(doc, &sym_count, &temp_arena) : NULL;
 
-    if (!symbols || sym_count == 0) {
-      arena_destroy(&sym_arena);
-      lsp_send_response(request_id, "[]");
-      break;
-    }
-
-    size_t buf_size = sym_count * 512 + 16;
-    char *result = (char *)malloc(buf_size);
-    if (!result) {
-      arena_destroy(&sym_arena);
-      lsp_send_response(request_id, "[]");
-      break;
-    }
-
-    size_t off = 0;
-    off += snprintf(result + off, buf_size - off, "[");
-    for (size_t i = 0; i < sym_count && off < buf_size - 2; i++) {
-      LSPDocumentSymbol *sym = symbols[i];
-      if (i > 0)
-        off += snprintf(result + off, buf_size - off, ",");
-      off += snprintf(
-          result + off, buf_size - off,
-          "{\"name\":\"%s\",\"kind\":%d,"
-          "\"range\":{\"start\":{\"line\":%d,\"character\":%d},"
-          "\"end\":{\"line\":%d,\"character\":%d}},"
-          "\"selectionRange\":{\"start\":{\"line\":%d,\"character\":%d},"
-          "\"end\":{\"line\":%d,\"character\":%d}}}",
-          sym->name ? sym->name : "", (int)sym->kind, sym->range.start.line,
-          sym->range.start.character, sym->range.end.line,
-          sym->range.end.character, sym->selection_range.start.line,
-          sym->selection_range.start.character, sym->selection_range.end.line,
-          sym->selection_range.end.character);
-    }
-    snprintf(result + off, buf_size - off, "]");
-
-    fprintf(stderr, "[LSP] documentSymbol: sending %zu symbols\n", sym_count);
-    lsp_send_response(request_id, result);
-    free(result);
-    arena_destroy(&sym_arena);
+    fprintf(stderr, "[LSP] documentSymbol: sending %zu symbols\n",
+            symbols ? sym_count : 0);
+    lsp_response_begin(&w, request_id);
+    serialize_document_symbols(&w, symbols, symbols ? sym_count : 0);
+    lsp_message_send(&w);
     break;
   }
 
   case LSP_METHOD_TEXT_DOCUMENT_SEMANTIC_TOKENS: {
     fprintf(stderr, "[LSP] Handling semanticTokens/full\n");
-    const char *uri = extract_string(message, "uri", &temp_arena);
-    if (!uri) {
-      lsp_send_response(request_id, "{\"data\":[]}");
-      break;
-    }
+    const char *uri = document_uri(params);
+    LSPDocument *doc = uri ? lsp_document_find(server, uri) : NULL;
 
-    LSPDocument *doc = lsp_document_find(server, uri);
-    if (!doc) {
-      lsp_send_response(request_id, "{\"data\":[]}");
-      break;
-    }
+    lsp_response_begin(&w, request_id);
+    lsp_semantic_tokens_full(doc, &w);
+    lsp_message_send(&w);
+    break;
+  }
+
+  case LSP_METHOD_TEXT_DOCUMENT_SEMANTIC_TOKENS_DELTA: {
+    fprintf(stderr, "[LSP] Handling semanticTokens/full/delta\n");
+    const char *uri = document_uri(params);
+    LSPDocument *doc = uri ? lsp_document_find(server, uri) : NULL;
+    const char *previous_result_id =
+        json_as_string(json_get(params, "previousResultId"));
 
-    char *result = lsp_semantic_tokens_full(doc, &temp_arena);
-    lsp_send_response(request_id, result ? result : "{\"data\":[]}");
+    lsp_response_begin(&w, request_id);
+    lsp_semantic_tokens_delta(doc, previous_result_id, &w);
+    lsp_message_send(&w);
+    break;
+  }
+
+  case LSP_METHOD_TEXT_DOCUMENT_SEMANTIC_TOKENS_RANGE: {
+    fprintf(stderr, "[LSP] Handling semanticTokens/range\n");
+    const char *uri = document_uri(params);
+    LSPDocument *doc = uri ? lsp_document_find(server, uri) : NULL;
+    const JsonValue *range = json_get(params, "range");
+    LSPRange lines = {position_of(json_get(range, "start")),
+                      position_of(json_get(range, "end"))};
+
+    lsp_response_begin(&w, request_id);
+    lsp_semantic_tokens_range(doc, lines, &w);
+    lsp_message_send(&w);
     break;
   }
 
   case LSP_METHOD_SHUTDOWN:
     fprintf(stderr, "[LSP] Handling shutdown\n");
+    // exit ends the process without a way back here
+    pthread_mutex_lock(&server->compiler_lock);
+    lsp_module_registry_save(server);
+    pthread_mutex_unlock(&server->compiler_lock);
     lsp_send_response(request_id, "null");
     break;
 
@@ -668,9 +588,13 @@ void lsp_handle_message(LSPServer *server, const char *message) {
     break;
 
   default:
-    fprintf(stderr, "[LSP] Unhandled method\n");
+    if (message.method_name)
+      fprintf(stderr, "[LSP] Unhandled method\n");
     break;
   }
 
+  if (reading)
+    pthread_mutex_unlock(&server->snapshot_lock);
   arena_destroy(&temp_arena);
-}
\ No newline at end of file
+  lsp_message_free(&message);
+}
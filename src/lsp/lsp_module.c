@@ -1,9 +1,4 @@
-#ifdef _WIN32
-#include <windows.h>
-#endif
-
 #include <ctype.h>
-#include <dirent.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -12,37 +7,10 @@
 
 #define LUMA_STD_PATH "/usr/local/lib/luma"
 
-#define NEGATIVE_CACHE_MAX 64
-static const char *negative_cache[NEGATIVE_CACHE_MAX];
-static size_t      negative_cache_count = 0;
-
-static int negative_cache_contains(const char *module_name) {
-  for (size_t i = 0; i < negative_cache_count; i++) {
-    if (negative_cache[i] && strcmp(negative_cache[i], module_name) == 0)
-      return 1;
-  }
-  return 0;
-}
-
-static void negative_cache_insert(const char *module_name) {
-  if (negative_cache_count >= NEGATIVE_CACHE_MAX)
-    return;
-  char *copy = malloc(strlen(module_name) + 1);
-  if (copy) {
-    strcpy(copy, module_name);
-    negative_cache[negative_cache_count++] = copy;
-  }
+void lsp_missing_modules_clear(LSPServer *server) {
+  lsp_atom_table_clear(&server->missing_modules);
 }
 
-void lsp_negative_cache_clear(void) {
-  for (size_t i = 0; i < negative_cache_count; i++) {
-    free((void *)negative_cache[i]);
-    negative_cache[i] = NULL;
-  }
-  negative_cache_count = 0;
-}
-
-
 // Extract @module declaration from file content
 const char *extract_module_name(const char *content, ArenaAllocator *arena) {
   if (!content)
@@ -98,157 +66,29 @@ const char *extract_module_name(const char *content, ArenaAllocator *arena) {
   return NULL;
 }
 
-void scan_file_for_module(LSPServer *server, const char *file_uri,
-                          ArenaAllocator *temp_arena) {
-  const char *file_path = lsp_uri_to_path(file_uri, temp_arena);
-  if (!file_path)
-    return;
-
-  FILE *f = fopen(file_path, "r");
-  if (!f)
-    return;
-
-  char buffer[1024];
-  size_t read = fread(buffer, 1, sizeof(buffer) - 1, f);
-  buffer[read] = '\0';
-  fclose(f);
-
-  const char *module_name = extract_module_name(buffer, temp_arena);
-  if (!module_name)
-    return;
-
-  for (size_t i = 0; i < server->module_registry.count; i++) {
-    if (strcmp(server->module_registry.entries[i].module_name, module_name) == 0) {
-      server->module_registry.entries[i].file_uri =
-          arena_strdup(server->arena, file_uri);
-      return;
-    }
-  }
-
-  if (server->module_registry.count >= server->module_registry.capacity) {
-    size_t new_capacity = server->module_registry.capacity * 2;
-    if (new_capacity == 0)
-      new_capacity = 32;
-
-    ModuleRegistryEntry *new_entries =
-        arena_alloc(server->arena, new_capacity * sizeof(ModuleRegistryEntry),
-                    alignof(ModuleRegistryEntry));
-
-    if (server->module_registry.entries) {
-      memcpy(new_entries, server->module_registry.entries,
-             server->module_registry.count * sizeof(ModuleRegistryEntry));
-    }
-
-    server->module_registry.entries = new_entries;
-    server->module_registry.capacity = new_capacity;
-  }
-
-  ModuleRegistryEntry *entry =
-      &server->module_registry.entries[server->module_registry.count++];
-  entry->module_name = arena_strdup(server->arena, module_name);
-  entry->file_uri = arena_strdup(server->arena, file_uri);
-}
-
-void scan_directory_recursive(LSPServer *server, const char *dir_path,
-                              ArenaAllocator *temp_arena) {
-#ifdef _WIN32
-  WIN32_FIND_DATA find_data;
-  char search_path[512];
-  snprintf(search_path, sizeof(search_path), "%s\\*", dir_path);
-
-  HANDLE hFind = FindFirstFile(search_path, &find_data);
-  if (hFind == INVALID_HANDLE_VALUE)
-    return;
-
-  do {
-    if (strcmp(find_data.cFileName, ".") == 0 ||
-        strcmp(find_data.cFileName, "..") == 0) {
-      continue;
-    }
-
-    char full_path[512];
-    snprintf(full_path, sizeof(full_path), "%s\\%s", dir_path,
-             find_data.cFileName);
-
-    if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-      scan_directory_recursive(server, full_path, temp_arena);
-    } else {
-      const char *ext = strrchr(find_data.cFileName, '.');
-      if (ext && strcmp(ext, ".lx") == 0) {
-        const char *uri = lsp_path_to_uri(full_path, temp_arena);
-        if (uri) {
-          scan_file_for_module(server, uri, temp_arena);
-        }
-      }
-    }
-  } while (FindNextFile(hFind, &find_data));
-
-  FindClose(hFind);
-#else
-  DIR *dir = opendir(dir_path);
-  if (!dir)
-    return;
-
-  struct dirent *entry;
-  while ((entry = readdir(dir)) != NULL) {
-    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-      continue;
-    }
-
-    char full_path[512];
-    snprintf(full_path, sizeof(full_path), "%s/%s", dir_path, entry->d_name);
-
-    struct stat st;
-    if (stat(full_path, &st) == 0) {
-      if (S_ISDIR(st.st_mode)) {
-        scan_directory_recursive(server, full_path, temp_arena);
-      } else if (S_ISREG(st.st_mode)) {
-        const char *ext = strrchr(entry->d_name, '.');
-        if (ext && strcmp(ext, ".lx") == 0) {
-          const char *uri = lsp_path_to_uri(full_path, temp_arena);
-          if (uri) {
-            scan_file_for_module(server, uri, temp_arena);
-          }
-        }
-      }
-    }
-  }
-
-  closedir(dir);
-#endif
-}
-
-void build_module_registry(LSPServer *server, const char *workspace_uri) {
-  ArenaAllocator temp_arena;
-  arena_allocator_init(&temp_arena, 64 * 1024);
-
-  const char *workspace_path = lsp_uri_to_path(workspace_uri, &temp_arena);
-  if (!workspace_path) {
-    arena_destroy(&temp_arena);
-    return;
-  }
-
-  scan_directory_recursive(server, workspace_path, &temp_arena);
-  arena_destroy(&temp_arena);
-}
-
 const char *lookup_module(LSPServer *server, const char *module_name) {
   if (!module_name) return NULL;
+  Atom name = intern(module_name);
 
-  // 1. Workspace registry (always in-memory, fast)
-  for (size_t i = 0; i < server->module_registry.count; i++) {
-    if (strcmp(server->module_registry.entries[i].module_name, module_name) == 0)
-      return server->module_registry.entries[i].file_uri;
-  }
+  // 1. Workspace registry, and std modules found before
+  const char *found = lsp_module_registry_find(server, name, false);
+  if (found)
+    return found;
 
   // 2. Negative cache — skip filesystem probe for known-missing modules.
-  //    Cleared before each analysis in lsp_document_analyze so retries work.
-  if (negative_cache_contains(module_name)) {
+  //    Cleared when a document is opened or saved so retries work.
+  if (lsp_atom_table_get(&server->missing_modules, name) != LSP_ATOM_NONE) {
     fprintf(stderr, "[LSP] Module '%s' in negative cache, skipping probe\n",
             module_name);
     return NULL;
   }
 
+  // The workspace may have changed on disk since its directories were
+  // last listed
+  found = lsp_module_registry_find(server, name, true);
+  if (found)
+    return found;
+
   // 3. Check whether the std lib directory exists (re-check every time in case
   //    it became available after server start).
   //    Also try LUMA_STD_PATH/std as a fallback in case the binary layout uses
@@ -266,7 +106,7 @@ const char *lookup_module(LSPServer *server, const char *module_name) {
     if (!found) {
       fprintf(stderr, "[LSP] Std lib path '%s' not available, skipping\n",
               LUMA_STD_PATH);
-      negative_cache_insert(module_name);
+      lsp_atom_table_put(&server->missing_modules, name, 0);
       return NULL;
     }
   }
@@ -302,7 +142,7 @@ const char *lookup_module(LSPServer *server, const char *module_name) {
       FILE *test = fopen(std_path, "r");
       if (test) {
         fclose(test);
-        const char *uri = lsp_path_to_uri(std_path, server->arena);
+        const char *uri = lsp_module_registry_add(server, name, std_path);
         free(std_path);
         fprintf(stderr, "[LSP] Found module '%s' in std lib: %s\n",
                 module_name, uri);
@@ -322,7 +162,7 @@ const char *lookup_module(LSPServer *server, const char *module_name) {
       FILE *test = fopen(std_path, "r");
       if (test) {
         fclose(test);
-        const char *uri = lsp_path_to_uri(std_path, server->arena);
+        const char *uri = lsp_module_registry_add(server, name, std_path);
         free(std_path);
         fprintf(stderr, "[LSP] Found module '%s' in std lib (flat): %s\n",
                 module_name, uri);
@@ -344,7 +184,7 @@ const char *lookup_module(LSPServer *server, const char *module_name) {
       FILE *test = fopen(std_path, "r");
       if (test) {
         fclose(test);
-        const char *uri = lsp_path_to_uri(std_path, server->arena);
+        const char *uri = lsp_module_registry_add(server, name, std_path);
         free(std_path);
         fprintf(stderr, "[LSP] Found module '%s' in std lib (std/ fallback): %s\n",
                 module_name, uri);
@@ -354,7 +194,7 @@ const char *lookup_module(LSPServer *server, const char *module_name) {
     }
   }
 
-  negative_cache_insert(module_name);
+  lsp_atom_table_put(&server->missing_modules, name, 0);
   fprintf(stderr, "[LSP] Module '%s' not found, cached as negative\n",
           module_name);
   return NULL;
@@ -449,6 +289,7 @@ void extract_imports(LSPDocument *doc, ArenaAllocator *arena) {
           import->module_path = module_path;
           import->alias       = alias;
           import->scope       = NULL;
+          import->uri         = NULL;
         }
       }
       continue;
@@ -488,101 +329,3 @@ const char *resolve_module_path(const char *current_uri,
 
   return lsp_path_to_uri(full_path, arena);
 }
-
-void lsp_ast_cache_init(LSPServer *server) {
-  (void)server;
-}
-
-void lsp_ast_cache_invalidate(LSPServer *server, const char *uri) {
-  (void)server;
-  (void)uri;
-}
-
-AstNode *parse_imported_module_ast(LSPServer *server, const char *module_uri,
-                                   BuildConfig *config, ArenaAllocator *arena) {
-  // 1. If the file is already open in the editor, use its AST directly.
-  LSPDocument *module_doc = lsp_document_find(server, module_uri);
-  if (module_doc && module_doc->ast) {
-    fprintf(stderr, "[LSP] Cache: open doc hit for %s\n", module_uri);
-    return module_doc->ast;
-  }
-
-  const char *file_path = lsp_uri_to_path(module_uri, arena);
-  if (!file_path)
-    return NULL;
-
-  struct stat st;
-  if (stat(file_path, &st) != 0)
-    return NULL;
-
-  // Allocate into the caller's arena (doc->arena), NOT cache_arena.
-  // The typechecker mutates AST nodes in place. Using cache_arena meant
-  // every analysis corrupted the shared cache, requiring full invalidation
-  // and re-parse on every keystroke. By using the caller's arena each dep
-  // gets a fresh copy that can be safely mutated.
-  fprintf(stderr, "[LSP] Parsing dep %s into caller arena\n", module_uri);
-
-  FILE *f = fopen(file_path, "r");
-  if (!f)
-    return NULL;
-
-  fseek(f, 0, SEEK_END);
-  long size = ftell(f);
-  fseek(f, 0, SEEK_SET);
-
-  char *file_content = arena_alloc(arena, size + 1, 1);
-  if (!file_content) { fclose(f); return NULL; }
-  fread(file_content, 1, size, f);
-  file_content[size] = '\0';
-  fclose(f);
-
-  Lexer lexer;
-  init_lexer(&lexer, file_content, arena);
-
-  GrowableArray tokens;
-  growable_array_init(&tokens, arena, 256, sizeof(Token));
-
-  Token token;
-  while ((token = next_token(&lexer)).type_ != TOK_EOF) {
-    Token *slot = (Token *)growable_array_push(&tokens);
-    if (slot) *slot = token;
-  }
-
-  AstNode *module_ast = parse(&tokens, arena, config);
-  if (!module_ast)
-    return NULL;
-
-  AstNode *result = module_ast;
-  if (module_ast->type == AST_PROGRAM &&
-      module_ast->stmt.program.module_count > 0) {
-    result = module_ast->stmt.program.modules[0];
-  }
-
-  return result;
-}
-
-void resolve_imports(LSPServer *server, LSPDocument *doc, BuildConfig *config,
-                     GrowableArray *imported_modules) {
-  if (!doc || !doc->imports || doc->import_count == 0)
-    return;
-
-  for (size_t i = 0; i < doc->import_count; i++) {
-    ImportedModule *import = &doc->imports[i];
-
-    const char *resolved_uri = lookup_module(server, import->module_path);
-
-    if (!resolved_uri) {
-      continue;
-    }
-
-    AstNode *module_ast =
-        parse_imported_module_ast(server, resolved_uri, config, doc->arena);
-
-    if (module_ast) {
-      AstNode **slot = (AstNode **)growable_array_push(imported_modules);
-      if (slot) {
-        *slot = module_ast;
-      }
-    }
-  }
-}
\ No newline at end of file
@@ -0,0 +1,447 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "../c_libs/error/error.h"
+#include "lsp.h"
+
+// Imported modules, std above all, are parsed and typechecked once for
+// every document that imports them rather than in each analysis. An entry
+// is checked under a global scope of its own, in which the modules it
+// imports are shared (share_module_scope); analyses share it the same way.
+//
+// Each analysis asks again for what it imports, and an entry is current
+// while its text is unchanged (its file's mtime, or else the hash of its
+// text) and every module it imports still has the interface it was checked
+// against. A module whose text changed is checked again, but the modules
+// importing it only are when its interface changed too: until then they
+// keep the entry they were checked against alive, and their results hold.
+
+#define MODULE_CACHE_FNV_OFFSET 0xcbf29ce484222325ULL
+#define MODULE_CACHE_FNV_PRIME 0x100000001b3ULL
+
+static uint64_t hash_text(const char *text) {
+  uint64_t hash = MODULE_CACHE_FNV_OFFSET;
+  for (const unsigned char *c = (const unsigned char *)text; *c; c++)
+    hash = (hash ^ *c) * MODULE_CACHE_FNV_PRIME;
+  return hash;
+}
+
+void lsp_module_cache_init(LSPModuleCache *cache) {
+  memset(cache, 0, sizeof(*cache));
+}
+
+void lsp_module_cache_free(LSPModuleCache *cache) {
+  for (size_t i = 0; i < cache->count; i++) {
+    cache->modules[i]->current = false;
+    lsp_module_release(cache->modules[i]);
+  }
+  free(cache->modules);
+  memset(cache, 0, sizeof(*cache));
+}
+
+// Starts an analysis: entries are looked at again, once each
+void lsp_module_cache_begin(LSPServer *server, const BuildConfig *config) {
+  server->module_cache.stamp++;
+  server->module_cache.config = *config;
+}
+
+void lsp_module_retain(LSPModule *module) {
+  if (module)
+    module->refs++;
+}
+
+void lsp_module_release(LSPModule *module) {
+  if (!module || --module->refs > 0)
+    return;
+  for (size_t i = 0; i < module->import_count; i++)
+    lsp_module_release(module->imports[i]);
+  arena_destroy(&module->arena);
+  free(module->uri);
+  free(module);
+}
+
+void lsp_modules_release(LSPModule **modules, size_t count) {
+  for (size_t i = 0; i < count; i++)
+    lsp_module_release(modules[i]);
+}
+
+static size_t cache_find(const LSPModuleCache *cache, const char *uri) {
+  for (size_t i = 0; i < cache->count; i++) {
+    if (strcmp(cache->modules[i]->uri, uri) == 0)
+      return i;
+  }
+  return cache->count;
+}
+
+// The file may have changed within its mtime's resolution (saved), so it
+// is read again however it looks
+void lsp_module_cache_reload(LSPServer *server, const char *uri) {
+  LSPModuleCache *cache = &server->module_cache;
+  size_t index = cache_find(cache, uri);
+  if (index < cache->count)
+    cache->modules[index]->mtime = -1;
+}
+
+// Makes `module` the current entry of its URI, in place of `index`'s
+static bool cache_put(LSPModuleCache *cache, size_t index, LSPModule *module) {
+  if (index < cache->count) {
+    LSPModule *replaced = cache->modules[index];
+    replaced->current = false;
+    cache->modules[index] = module;
+    lsp_module_release(replaced);
+    return true;
+  }
+  if (cache->count == cache->capacity) {
+    size_t capacity = cache->capacity ? cache->capacity * 2 : 32;
+    LSPModule **modules = realloc(cache->modules, capacity * sizeof(*modules));
+    if (!modules)
+      return false;
+    cache->modules = modules;
+    cache->capacity = capacity;
+  }
+  cache->modules[cache->count++] = module;
+  return true;
+}
+
+// A file's whole text (malloc'd), and its size
+char *lsp_read_file(const char *path, long *size) {
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return NULL;
+
+  fseek(f, 0, SEEK_END);
+  *size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  char *content = *size >= 0 ? malloc((size_t)*size + 1) : NULL;
+  if (!content) {
+    fclose(f);
+    return NULL;
+  }
+  size_t nread = fread(content, 1, (size_t)*size, f);
+  content[nread] = '\0';
+  fclose(f);
+  return content;
+}
+
+// Where a module's text comes from: an open document's last analyzed text,
+// or its file
+typedef struct {
+  const char *path;
+  const char *text;  // NULL when `unchanged` spared reading it
+  char *owned;       // malloc'd copy of a file's text
+  bool from_document;
+  bool unchanged;    // The file's mtime and size are the entry's
+  long mtime;
+  long size;
+} ModuleSource;
+
+static bool open_source(LSPServer *server, const char *uri,
+                        const LSPModule *entry, ArenaAllocator *scratch,
+                        ModuleSource *source) {
+  memset(source, 0, sizeof(*source));
+  source->mtime = -1;
+  source->path = lsp_uri_to_path(uri, scratch);
+  if (!source->path)
+    return false;
+
+  LSPDocument *doc = lsp_document_find(server, uri);
+  if (doc && doc->content) {
+    source->text = doc->content;
+    source->from_document = true;
+    return true;
+  }
+
+  struct stat st;
+  if (stat(source->path, &st) != 0)
+    return false;
+  source->mtime = (long)st.st_mtime;
+  source->size = (long)st.st_size;
+  if (entry && !entry->from_document && entry->mtime != -1 &&
+      entry->mtime == source->mtime && entry->size == source->size) {
+    source->unchanged = true;
+    return true;
+  }
+
+  source->owned = lsp_read_file(source->path, &source->size);
+  source->text = source->owned;
+  return source->text != NULL;
+}
+
+static AstNode *parse_module(const char *text, const char *path,
+                             BuildConfig *config, ArenaAllocator *arena) {
+  TokenStream stream;
+  if (!token_stream_init(&stream, text, arena))
+    return NULL;
+
+  AstNode *program = parse_stream(&stream, arena, config);
+  if (!program || program->type != AST_PROGRAM ||
+      program->stmt.program.module_count == 0)
+    return NULL;
+  token_stream_finish(&stream);
+
+  AstNode *module = program->stmt.program.modules[0];
+  if (!module || module->type != AST_PREPROCESSOR_MODULE)
+    return NULL;
+  module->preprocessor.module.lines = line_table_copy(&stream.lines, arena);
+  module->preprocessor.module.token_digest = stream.digest;
+  module->preprocessor.module.token_position_digest = stream.position_digest;
+  module->preprocessor.module.file_path = arena_strdup(arena, path);
+  return module;
+}
+
+static const char *module_name(const LSPModule *module) {
+  return module->module->preprocessor.module.name;
+}
+
+// Adds `module`, if it parsed, and the modules it imports to `closure` in
+// their dependency order. An import of a name that's there already is the
+// same module, or an older entry of it whose interface is the same; the
+// current entry stands for both.
+bool lsp_module_closure(LSPModule *module, GrowableArray *closure) {
+  if (!module || !module->module)
+    return true;
+
+  LSPModule **have = (LSPModule **)closure->data;
+  for (size_t i = 0; i < closure->count; i++) {
+    if (have[i] == module)
+      return true;
+    if (strcmp(module_name(have[i]), module_name(module)) == 0) {
+      if (module->current && !have[i]->current)
+        have[i] = module;
+      return true;
+    }
+  }
+
+  for (size_t i = 0; i < module->import_count; i++) {
+    if (!lsp_module_closure(module->imports[i], closure))
+      return false;
+  }
+
+  LSPModule **slot = growable_array_push(closure);
+  if (!slot)
+    return false;
+  *slot = module;
+  return true;
+}
+
+// Whether what the entry was checked against is still what its imports
+// resolve to
+static bool imports_current(LSPServer *server, LSPModule *entry) {
+  for (size_t i = 0; i < entry->import_count; i++) {
+    const char *uri = lookup_module(server, entry->import_paths[i]);
+    LSPModule *now = uri ? lsp_module_get(server, uri) : NULL;
+    LSPModule *then = entry->imports[i];
+    if (now == then)
+      continue;
+    if (!now || !then || !now->scope || !then->scope ||
+        now->interface != entry->import_interfaces[i])
+      return false;
+  }
+  return true;
+}
+
+static bool resolve_module_imports(LSPServer *server, LSPModule *module,
+                                   const char *text) {
+  ArenaAllocator *arena = &module->arena;
+  LSPDocument scan = {0};
+  scan.content = text;
+  extract_imports(&scan, arena);
+
+  module->import_count = scan.import_count;
+  module->import_paths =
+      arena_alloc(arena, scan.import_count * sizeof(const char *) + 1,
+                  alignof(const char *));
+  module->imports = arena_alloc(
+      arena, scan.import_count * sizeof(LSPModule *) + 1, alignof(LSPModule *));
+  module->import_interfaces = arena_alloc(
+      arena, scan.import_count * sizeof(uint64_t) + 1, alignof(uint64_t));
+  if (!module->import_paths || !module->imports || !module->import_interfaces) {
+    module->import_count = 0;
+    return false;
+  }
+
+  for (size_t i = 0; i < scan.import_count; i++) {
+    const char *path = scan.imports[i].module_path;
+    const char *uri = lookup_module(server, path);
+    LSPModule *import = uri ? lsp_module_get(server, uri) : NULL;
+    if (!uri)
+      fprintf(stderr, "[LSP] Warning: Could not resolve import '%s' in %s\n",
+              path, module->uri);
+    lsp_module_retain(import);
+    module->import_paths[i] = path;
+    module->imports[i] = import;
+    module->import_interfaces[i] = import ? import->interface : 0;
+  }
+  return true;
+}
+
+// Typechecks the module under a global scope holding the modules it needs.
+// A module whose import failed isn't checked, as in a build.
+static void check_module(LSPServer *server, LSPModule *module) {
+  ArenaAllocator *arena = &module->arena;
+  BuildConfig *config = &server->module_cache.config;
+
+  GrowableArray closure;
+  if (!growable_array_init(&closure, arena, 16, sizeof(LSPModule *)))
+    return;
+  for (size_t i = 0; i < module->import_count; i++) {
+    if (!lsp_module_closure(module->imports[i], &closure))
+      return;
+  }
+
+  LSPModule **needed = (LSPModule **)closure.data;
+  AstNode **modules = arena_alloc(arena, (closure.count + 1) * sizeof(AstNode *),
+                                  alignof(AstNode *));
+  Scope *global_scope = arena_alloc(arena, sizeof(Scope), alignof(Scope));
+  if (!modules || !global_scope)
+    return;
+  init_scope(global_scope, NULL, "global", arena);
+  global_scope->config = config;
+
+  for (size_t i = 0; i < closure.count; i++) {
+    if (!needed[i]->ok || !needed[i]->scope)
+      return;
+    modules[i] = needed[i]->module;
+    if (!share_module_scope(global_scope, needed[i]->scope, arena))
+      return;
+  }
+  modules[closure.count] = module->module;
+
+  AstNode *templates =
+      create_program_node(arena, modules, closure.count + 1, 0, 0);
+  AstNode *program =
+      create_program_node(arena, &modules[closure.count], 1, 0, 0);
+  if (!templates || !program)
+    return;
+
+  module->ok = instantiate_module_generics(templates, module->module, arena) &&
+               typecheck(program, global_scope, arena, config);
+
+  // The bodies the check reused are checked now: importers only read it
+  typecheck_pending_bodies(body_cache_take_pending(server->body_cache, arena),
+                           arena);
+
+  module->scope = find_module_scope(global_scope, module_name(module));
+  if (module->scope)
+    module->interface =
+        module_interface_signature(module->module, module->scope, arena);
+}
+
+static LSPModule *build_module(LSPServer *server, const char *uri,
+                               size_t index, const ModuleSource *source,
+                               uint64_t content_hash) {
+  LSPModuleCache *cache = &server->module_cache;
+  LSPModule *module = calloc(1, sizeof(LSPModule));
+  char *uri_copy = strdup(uri);
+  if (!module || !uri_copy) {
+    free(module);
+    free(uri_copy);
+    return NULL;
+  }
+  module->uri = uri_copy;
+  module->content_hash = content_hash;
+  module->mtime = source->mtime;
+  module->size = source->size;
+  module->from_document = source->from_document;
+  module->current = true;
+  module->visiting = true;
+  module->refs = 1; // The cache's
+  arena_allocator_init(&module->arena, 256 * 1024);
+  if (!cache_put(cache, index, module)) {
+    lsp_module_release(module);
+    return NULL;
+  }
+
+  fprintf(stderr, "[LSP] Checking module %s\n", uri);
+
+  char *text = arena_strdup(&module->arena, source->text);
+  if (!text || !resolve_module_imports(server, module, text)) {
+    module->visiting = false;
+    return module;
+  }
+
+  ErrorBuffer errors = {0};
+  ErrorBuffer *outer = error_get_capture();
+  error_begin_capture(&errors);
+
+  module->module =
+      parse_module(text, source->path, &cache->config, &module->arena);
+  if (module->module)
+    check_module(server, module);
+
+  error_begin_capture(outer);
+  module->errors = arena_alloc(&module->arena,
+                               sizeof(ErrorInformation) * errors.count + 1,
+                               alignof(ErrorInformation));
+  if (module->errors) {
+    memcpy(module->errors, errors.items,
+           sizeof(ErrorInformation) * errors.count);
+    module->error_count = errors.count;
+  }
+  free(errors.items);
+
+  // An open document's text is indexed as its analysis is published
+  if (!source->from_document)
+    lsp_symbol_index_update_text(&server->symbol_index, uri, text,
+                                 module->scope, source->mtime);
+
+  module->visiting = false;
+  return module;
+}
+
+// The current entry of a module, checked again first if it isn't current.
+// NULL if there's no such module, or it imports itself through `uri`.
+LSPModule *lsp_module_get(LSPServer *server, const char *uri) {
+  LSPModuleCache *cache = &server->module_cache;
+  size_t index = cache_find(cache, uri);
+  LSPModule *entry = index < cache->count ? cache->modules[index] : NULL;
+  if (entry && entry->visiting)
+    return NULL;
+  if (entry && entry->stamp == cache->stamp)
+    return entry;
+
+  ArenaAllocator scratch;
+  arena_allocator_init(&scratch, 4096);
+  ModuleSource source;
+  if (!open_source(server, uri, entry, &scratch, &source)) {
+    arena_destroy(&scratch);
+    return NULL;
+  }
+
+  uint64_t content_hash =
+      source.unchanged ? entry->content_hash : hash_text(source.text);
+  if (entry && entry->content_hash == content_hash) {
+    entry->visiting = true;
+    bool current = imports_current(server, entry);
+    entry->visiting = false;
+    if (current) {
+      // A file that was saved unchanged is found by its mtime again
+      entry->mtime = source.mtime;
+      entry->size = source.size;
+      entry->from_document = source.from_document;
+      entry->stamp = cache->stamp;
+      free(source.owned);
+      arena_destroy(&scratch);
+      return entry;
+    }
+  }
+
+  if (!source.text) {
+    // Unchanged, but something it imports isn't
+    free(source.owned);
+    source.owned = lsp_read_file(source.path, &source.size);
+    source.text = source.owned;
+  }
+  LSPModule *module =
+      source.text ? build_module(server, uri, index, &source, content_hash)
+                  : NULL;
+  if (module)
+    module->stamp = cache->stamp;
+
+  free(source.owned);
+  arena_destroy(&scratch);
+  return module;
+}
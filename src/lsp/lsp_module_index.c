@@ -0,0 +1,639 @@
+// lsp_module_index.c - The workspace's module names, kept across sessions
+//
+// The registry maps each module name to the .lx file declaring it. It is
+// saved to "lsp-<hash of the workspace path>.idx" in the std cache
+// (get_std_cache_path) with the mtime of every directory and the mtime and
+// size of every file, so a session starts from the last one's index:
+// only the directories whose mtime changed are listed again, and only the
+// files new or changed in them are read. The other files are checked when
+// a lookup reaches them, and a file changed in place is read again then.
+// A name found nowhere makes the next lookup list every directory again.
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "../helper/help.h"
+#include "../helper/std_path.h"
+#include "lsp.h"
+
+#define INDEX_FORMAT "luma-module-index 1"
+#define ATOM_TABLE_INITIAL_CAPACITY 64
+
+// ============================================================================
+// ATOM TABLE
+// ============================================================================
+
+// Finds the slot holding @p key, or the empty slot where it belongs
+static size_t atom_slot(const Atom *keys, size_t capacity, Atom key) {
+  size_t mask = capacity - 1;
+  size_t i = atom_hash(key) & mask;
+  while (keys[i] && keys[i] != key)
+    i = (i + 1) & mask;
+  return i;
+}
+
+size_t lsp_atom_table_get(const LSPAtomTable *table, Atom key) {
+  if (!key || table->count == 0)
+    return LSP_ATOM_NONE;
+  size_t slot = atom_slot(table->keys, table->capacity, key);
+  return table->keys[slot] ? table->values[slot] : LSP_ATOM_NONE;
+}
+
+static bool atom_table_grow(LSPAtomTable *table) {
+  size_t capacity =
+      table->capacity ? table->capacity * 2 : ATOM_TABLE_INITIAL_CAPACITY;
+  Atom *keys = calloc(capacity, sizeof(*keys));
+  size_t *values = malloc(capacity * sizeof(*values));
+  if (!keys || !values) {
+    free(keys);
+    free(values);
+    return false;
+  }
+
+  for (size_t i = 0; i < table->capacity; i++) {
+    if (table->keys[i]) {
+      size_t slot = atom_slot(keys, capacity, table->keys[i]);
+      keys[slot] = table->keys[i];
+      values[slot] = table->values[i];
+    }
+  }
+
+  free(table->keys);
+  free(table->values);
+  table->keys = keys;
+  table->values = values;
+  table->capacity = capacity;
+  return true;
+}
+
+// Inserts or replaces the value stored for key; LSP_ATOM_NONE stands for
+// no value
+bool lsp_atom_table_put(LSPAtomTable *table, Atom key, size_t value) {
+  if (!key)
+    return false;
+  if ((table->count + 1) * 2 > table->capacity && !atom_table_grow(table))
+    return false;
+
+  size_t slot = atom_slot(table->keys, table->capacity, key);
+  if (!table->keys[slot]) {
+    table->keys[slot] = key;
+    table->count++;
+  }
+  table->values[slot] = value;
+  return true;
+}
+
+void lsp_atom_table_clear(LSPAtomTable *table) {
+  if (table->keys)
+    memset(table->keys, 0, table->capacity * sizeof(*table->keys));
+  table->count = 0;
+}
+
+void lsp_atom_table_free(LSPAtomTable *table) {
+  free(table->keys);
+  free(table->values);
+  *table = (LSPAtomTable){0};
+}
+
+// ============================================================================
+// ENTRIES
+// ============================================================================
+
+static bool is_module_file(const char *name) {
+  const char *ext = strrchr(name, '.');
+  return ext && strcmp(ext, ".lx") == 0;
+}
+
+// The @module name at the top of the file at @p path
+static Atom read_module_name(const char *path, ArenaAllocator *temp_arena) {
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return NULL;
+
+  char buffer[1024];
+  size_t read = fread(buffer, 1, sizeof(buffer) - 1, f);
+  buffer[read] = '\0';
+  fclose(f);
+
+  const char *module_name = extract_module_name(buffer, temp_arena);
+  return module_name ? intern(module_name) : NULL;
+}
+
+// Names the entry `name`. The name it had goes to any other file still
+// declaring it; the last file to declare a name is the one it finds.
+static void set_entry_name(ModuleRegistry *registry, size_t index, Atom name) {
+  ModuleRegistryEntry *entry = &registry->entries[index];
+  Atom old = entry->module_name;
+  entry->module_name = name;
+
+  if (old && old != name &&
+      lsp_atom_table_get(&registry->by_name, old) == index) {
+    size_t other = LSP_ATOM_NONE;
+    for (size_t i = 0; i < registry->count; i++) {
+      if (i != index && registry->entries[i].present &&
+          registry->entries[i].module_name == old)
+        other = i;
+    }
+    lsp_atom_table_put(&registry->by_name, old, other);
+  }
+  if (name && (old != name ||
+               lsp_atom_table_get(&registry->by_name, name) == LSP_ATOM_NONE))
+    lsp_atom_table_put(&registry->by_name, name, index);
+  if (old != name)
+    registry->dirty = true;
+}
+
+static size_t add_entry(ModuleRegistry *registry, Atom path, size_t dir) {
+  size_t index = lsp_atom_table_get(&registry->by_path, path);
+  if (index != LSP_ATOM_NONE)
+    return index;
+
+  if (registry->count == registry->capacity) {
+    size_t capacity = registry->capacity ? registry->capacity * 2 : 32;
+    ModuleRegistryEntry *entries =
+        realloc(registry->entries, capacity * sizeof(*entries));
+    if (!entries)
+      return LSP_ATOM_NONE;
+    registry->entries = entries;
+    registry->capacity = capacity;
+  }
+
+  index = registry->count;
+  if (!lsp_atom_table_put(&registry->by_path, path, index))
+    return LSP_ATOM_NONE;
+  registry->entries[registry->count++] = (ModuleRegistryEntry){
+      .path = path, .mtime = -1, .size = -1, .dir = dir};
+  return index;
+}
+
+static void drop_entry(ModuleRegistry *registry, size_t index) {
+  if (!registry->entries[index].present)
+    return;
+  set_entry_name(registry, index, NULL);
+  registry->entries[index].present = false;
+  registry->entries[index].mtime = -1;
+  registry->dirty = true;
+}
+
+// Records the file at `path` as present, reading its @module line unless
+// its mtime and size are the ones recorded
+static void scan_file(ModuleRegistry *registry, Atom path, size_t dir,
+                      const struct stat *st, ArenaAllocator *temp_arena) {
+  size_t index = add_entry(registry, path, dir);
+  if (index == LSP_ATOM_NONE)
+    return;
+
+  ModuleRegistryEntry *entry = &registry->entries[index];
+  bool unchanged = entry->mtime != -1 && entry->dir == dir &&
+                   entry->mtime == (long)st->st_mtime &&
+                   entry->size == (long)st->st_size;
+  entry->present = true;
+  if (unchanged)
+    return;
+
+  entry->dir = dir;
+  entry->mtime = (long)st->st_mtime;
+  entry->size = (long)st->st_size;
+  registry->dirty = true;
+  set_entry_name(registry, index, read_module_name(path, temp_arena));
+}
+
+// Whether the entry's file is still there, after reading it again if it
+// changed. A std module's name comes from its path, so only its existence
+// is checked.
+static bool validate_entry(ModuleRegistry *registry, size_t index,
+                           ArenaAllocator *temp_arena) {
+  ModuleRegistryEntry *entry = &registry->entries[index];
+  if (!entry->present)
+    return false;
+
+  struct stat st;
+  if (stat(entry->path, &st) != 0 || !S_ISREG(st.st_mode)) {
+    drop_entry(registry, index);
+    return false;
+  }
+  if (entry->dir != LSP_ATOM_NONE)
+    scan_file(registry, entry->path, entry->dir, &st, temp_arena);
+  return registry->entries[index].present;
+}
+
+// ============================================================================
+// DIRECTORIES
+// ============================================================================
+
+static size_t add_dir(ModuleRegistry *registry, Atom path, long mtime) {
+  size_t index = lsp_atom_table_get(&registry->dir_by_path, path);
+  if (index != LSP_ATOM_NONE) {
+    if (!registry->dirs[index].present) {
+      registry->dirs[index].present = true;
+      registry->dirs[index].mtime = mtime;
+    }
+    return index;
+  }
+
+  if (registry->dir_count == registry->dir_capacity) {
+    size_t capacity = registry->dir_capacity ? registry->dir_capacity * 2 : 16;
+    ModuleRegistryDir *dirs =
+        realloc(registry->dirs, capacity * sizeof(*dirs));
+    if (!dirs)
+      return LSP_ATOM_NONE;
+    registry->dirs = dirs;
+    registry->dir_capacity = capacity;
+  }
+
+  index = registry->dir_count;
+  if (!lsp_atom_table_put(&registry->dir_by_path, path, index))
+    return LSP_ATOM_NONE;
+  registry->dirs[registry->dir_count++] =
+      (ModuleRegistryDir){.path = path, .mtime = mtime, .present = true};
+  registry->dirty = true;
+  return index;
+}
+
+static void drop_dir(ModuleRegistry *registry, size_t dir) {
+  registry->dirs[dir].present = false;
+  for (size_t i = 0; i < registry->count; i++) {
+    if (registry->entries[i].dir == dir)
+      drop_entry(registry, i);
+  }
+  registry->dirty = true;
+}
+
+// A child of directory `dir`: a subdirectory is added to be listed in turn
+static void visit_child(ModuleRegistry *registry, size_t dir,
+                        const char *dir_path, const char *name,
+                        ArenaAllocator *temp_arena) {
+  if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+    return;
+
+  char full_path[1024];
+  snprintf(full_path, sizeof(full_path), "%s%c%s", dir_path, PATH_SEPARATOR,
+           name);
+
+  struct stat st;
+  if (stat(full_path, &st) != 0)
+    return;
+  if (S_ISDIR(st.st_mode)) {
+    add_dir(registry, intern(full_path), -1);
+  } else if (S_ISREG(st.st_mode) && is_module_file(name)) {
+    scan_file(registry, intern(full_path), dir, &st, temp_arena);
+  }
+}
+
+// Lists directory `dir` again. Its files are marked absent first, so the
+// ones the listing doesn't show are dropped after it.
+static void list_dir(ModuleRegistry *registry, size_t dir,
+                     ArenaAllocator *temp_arena) {
+  Atom dir_path = registry->dirs[dir].path;
+
+  size_t listed = registry->count;
+  for (size_t i = 0; i < listed; i++) {
+    if (registry->entries[i].dir == dir)
+      registry->entries[i].present = false;
+  }
+
+#ifdef _WIN32
+  WIN32_FIND_DATA find_data;
+  char search_path[1024];
+  snprintf(search_path, sizeof(search_path), "%s\\*", dir_path);
+
+  HANDLE hFind = FindFirstFile(search_path, &find_data);
+  if (hFind != INVALID_HANDLE_VALUE) {
+    do {
+      visit_child(registry, dir, dir_path, find_data.cFileName, temp_arena);
+    } while (FindNextFile(hFind, &find_data));
+    FindClose(hFind);
+  }
+#else
+  DIR *handle = opendir(dir_path);
+  if (handle) {
+    struct dirent *entry;
+    while ((entry = readdir(handle)) != NULL)
+      visit_child(registry, dir, dir_path, entry->d_name, temp_arena);
+    closedir(handle);
+  }
+#endif
+
+  for (size_t i = 0; i < listed; i++) {
+    ModuleRegistryEntry *entry = &registry->entries[i];
+    if (entry->dir == dir && !entry->present && entry->mtime != -1) {
+      // Present again only so drop_entry takes its name away
+      entry->present = true;
+      drop_entry(registry, i);
+    }
+  }
+}
+
+// Lists the directories whose mtime changed, or all of them with `all`;
+// directories found on the way are listed too
+static void refresh_registry(ModuleRegistry *registry, bool all,
+                             ArenaAllocator *temp_arena) {
+  for (size_t i = 0; i < registry->dir_count; i++) {
+    if (!registry->dirs[i].present)
+      continue;
+
+    struct stat st;
+    if (stat(registry->dirs[i].path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+      drop_dir(registry, i);
+      continue;
+    }
+    // The mtime is taken before listing, so a change made meanwhile is
+    // seen by the next refresh
+    if (all || registry->dirs[i].mtime != (long)st.st_mtime) {
+      if (registry->dirs[i].mtime != (long)st.st_mtime)
+        registry->dirty = true;
+      registry->dirs[i].mtime = (long)st.st_mtime;
+      list_dir(registry, i, temp_arena);
+    }
+  }
+}
+
+// ============================================================================
+// INDEX FILE
+// ============================================================================
+
+static bool index_path(char *buffer, size_t size, const char *root) {
+  char cache_dir[768];
+  if (!get_std_cache_path(cache_dir, sizeof(cache_dir)))
+    return false;
+
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (const char *p = root; *p; p++) {
+    hash ^= (unsigned char)*p;
+    hash *= 0x100000001b3ull;
+  }
+  snprintf(buffer, size, "%s%clsp-%016llx.idx", cache_dir, PATH_SEPARATOR,
+           (unsigned long long)hash);
+  return true;
+}
+
+// Splits the next tab-separated field off `*line`
+static char *next_field(char **line) {
+  char *field = *line;
+  if (!field)
+    return NULL;
+  char *tab = strchr(field, '\t');
+  if (tab) {
+    *tab = '\0';
+    *line = tab + 1;
+  } else {
+    *line = NULL;
+  }
+  return field;
+}
+
+static bool load_index(ModuleRegistry *registry, const char *root) {
+  char path[1024];
+  if (!index_path(path, sizeof(path), root))
+    return false;
+
+  FILE *file = fopen(path, "r");
+  if (!file)
+    return false;
+
+  char line[2048];
+  char version[64] = {0};
+  bool current =
+      fgets(line, sizeof(line), file) &&
+      strcmp(line, INDEX_FORMAT "\n") == 0 &&
+      fscanf(file, "compiler %63s\n", version) == 1 &&
+      strcmp(version, Luma_Compiler_version) == 0 &&
+      fgets(line, sizeof(line), file) && strncmp(line, "root ", 5) == 0 &&
+      strcspn(line + 5, "\n") == strlen(root) &&
+      strncmp(line + 5, root, strlen(root)) == 0;
+
+  // A line of the wrong shape is skipped: its directory is listed again,
+  // or its file read again, when the listing finds it missing
+  size_t dir_base = registry->dir_count;
+  while (current && fgets(line, sizeof(line), file)) {
+    line[strcspn(line, "\n")] = '\0';
+    char *rest = line;
+    char *kind = next_field(&rest);
+
+    if (strcmp(kind, "d") == 0) {
+      char *mtime = next_field(&rest);
+      char *dir_path = next_field(&rest);
+      if (mtime && dir_path && *dir_path)
+        add_dir(registry, intern(dir_path), strtol(mtime, NULL, 10));
+    } else if (strcmp(kind, "f") == 0) {
+      char *dir = next_field(&rest);
+      char *mtime = next_field(&rest);
+      char *size = next_field(&rest);
+      char *name = next_field(&rest);
+      char *file_path = next_field(&rest);
+      size_t dir_index = dir ? dir_base + strtoul(dir, NULL, 10) : 0;
+      if (!file_path || !*file_path || dir_index >= registry->dir_count)
+        continue;
+
+      size_t index = add_entry(registry, intern(file_path), dir_index);
+      if (index == LSP_ATOM_NONE)
+        continue;
+      ModuleRegistryEntry *entry = &registry->entries[index];
+      entry->present = true;
+      entry->mtime = strtol(mtime, NULL, 10);
+      entry->size = strtol(size, NULL, 10);
+      set_entry_name(registry, index, *name ? intern(name) : NULL);
+    }
+  }
+  fclose(file);
+  registry->dirty = false;
+  return current;
+}
+
+static bool writable(const char *text) { return !strpbrk(text, "\t\n\r"); }
+
+// Writes the index if it changed since it was loaded or last written. It
+// is written beside its path and renamed over it, so a session reading it
+// meanwhile sees the old one or the new one whole.
+void lsp_module_registry_save(LSPServer *server) {
+  ModuleRegistry *registry = &server->module_registry;
+  if (!registry->root || !registry->dirty)
+    return;
+
+  char path[1024];
+  char temp_path[1100];
+  if (!index_path(path, sizeof(path), registry->root))
+    return;
+  snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+  size_t *written = malloc((registry->dir_count + 1) * sizeof(*written));
+  FILE *file = written ? fopen(temp_path, "w") : NULL;
+  if (!file) {
+    free(written);
+    return;
+  }
+
+  fprintf(file, INDEX_FORMAT "\ncompiler %s\nroot %s\n", Luma_Compiler_version,
+          registry->root);
+
+  size_t dir_count = 0;
+  for (size_t i = 0; i < registry->dir_count; i++) {
+    const ModuleRegistryDir *dir = &registry->dirs[i];
+    written[i] = LSP_ATOM_NONE;
+    if (!dir->present || !writable(dir->path))
+      continue;
+    written[i] = dir_count++;
+    fprintf(file, "d\t%ld\t%s\n", dir->mtime, dir->path);
+  }
+
+  for (size_t i = 0; i < registry->count; i++) {
+    const ModuleRegistryEntry *entry = &registry->entries[i];
+    if (!entry->present || entry->dir == LSP_ATOM_NONE ||
+        written[entry->dir] == LSP_ATOM_NONE || !writable(entry->path) ||
+        (entry->module_name && !writable(entry->module_name)))
+      continue;
+    fprintf(file, "f\t%zu\t%ld\t%ld\t%s\t%s\n", written[entry->dir],
+            entry->mtime, entry->size,
+            entry->module_name ? entry->module_name : "", entry->path);
+  }
+  free(written);
+
+  bool ok = !ferror(file);
+  ok = fclose(file) == 0 && ok;
+#ifdef _WIN32
+  if (ok)
+    remove(path);
+#endif
+  if (ok && rename(temp_path, path) == 0) {
+    registry->dirty = false;
+  } else {
+    remove(temp_path);
+    fprintf(stderr, "[LSP] Failed to write module index %s\n", path);
+  }
+}
+
+// ============================================================================
+// REGISTRY
+// ============================================================================
+
+void build_module_registry(LSPServer *server, const char *workspace_uri) {
+  ModuleRegistry *registry = &server->module_registry;
+  ArenaAllocator temp_arena;
+  arena_allocator_init(&temp_arena, 64 * 1024);
+
+  const char *workspace_path = lsp_uri_to_path(workspace_uri, &temp_arena);
+  if (!workspace_path || registry->root) {
+    arena_destroy(&temp_arena);
+    return;
+  }
+
+  char *root = arena_strdup(server->arena, workspace_path);
+  size_t len = strlen(root);
+  while (len > 1 && (root[len - 1] == '/' || root[len - 1] == '\\'))
+    root[--len] = '\0';
+  registry->root = root;
+
+  bool loaded = load_index(registry, root);
+  add_dir(registry, intern(root), -1);
+  refresh_registry(registry, false, &temp_arena);
+
+  size_t modules = 0;
+  for (size_t i = 0; i < registry->count; i++)
+    modules += registry->entries[i].present && registry->entries[i].module_name;
+  fprintf(stderr, "[LSP] Module index: %zu modules in %zu directories (%s)\n",
+          modules, registry->dir_count, loaded ? "cached" : "scanned");
+
+  lsp_module_registry_save(server);
+  arena_destroy(&temp_arena);
+}
+
+// The file declaring `module_name`, checked against the disk first. With
+// `refresh`, every directory is listed again before the lookup.
+const char *lsp_module_registry_find(LSPServer *server, Atom module_name,
+                                     bool refresh) {
+  ModuleRegistry *registry = &server->module_registry;
+  ArenaAllocator temp_arena;
+  arena_allocator_init(&temp_arena, 16 * 1024);
+
+  if (refresh) {
+    refresh_registry(registry, true, &temp_arena);
+    lsp_module_registry_save(server);
+  }
+
+  // A file checked may turn out to declare another name now, and the name
+  // goes to another file declaring it
+  const char *uri = NULL;
+  for (size_t tries = 0; tries <= registry->count; tries++) {
+    size_t index = lsp_atom_table_get(&registry->by_name, module_name);
+    if (index == LSP_ATOM_NONE)
+      break;
+    if (validate_entry(registry, index, &temp_arena) &&
+        registry->entries[index].module_name == module_name) {
+      ModuleRegistryEntry *entry = &registry->entries[index];
+      if (!entry->file_uri)
+        entry->file_uri = lsp_path_to_uri(entry->path, server->arena);
+      uri = entry->file_uri;
+      break;
+    }
+  }
+
+  arena_destroy(&temp_arena);
+  return uri;
+}
+
+// Records where lookup_module found a std module, so the next lookup only
+// checks the file is still there
+const char *lsp_module_registry_add(LSPServer *server, Atom module_name,
+                                    const char *path) {
+  ModuleRegistry *registry = &server->module_registry;
+  const char *uri = lsp_path_to_uri(path, server->arena);
+  struct stat st;
+  size_t index = stat(path, &st) == 0
+                     ? add_entry(registry, intern(path), LSP_ATOM_NONE)
+                     : LSP_ATOM_NONE;
+  if (index == LSP_ATOM_NONE)
+    return uri;
+
+  // A workspace file keeps the name it declares
+  ModuleRegistryEntry *entry = &registry->entries[index];
+  if (entry->dir != LSP_ATOM_NONE)
+    return uri;
+  entry->present = true;
+  entry->mtime = (long)st.st_mtime;
+  entry->size = (long)st.st_size;
+  entry->file_uri = uri;
+  set_entry_name(registry, index, module_name);
+  return uri;
+}
+
+// The document at `uri` was opened or saved: a file of the workspace is
+// read again, since it may declare another name now
+void lsp_module_registry_update(LSPServer *server, const char *uri) {
+  ModuleRegistry *registry = &server->module_registry;
+  ArenaAllocator temp_arena;
+  arena_allocator_init(&temp_arena, 16 * 1024);
+
+  const char *path = lsp_uri_to_path(uri, &temp_arena);
+  const char *slash = path ? strrchr(path, PATH_SEPARATOR) : NULL;
+  struct stat st;
+  if (slash && is_module_file(path) && stat(path, &st) == 0) {
+    Atom dir_path = intern_n(path, (size_t)(slash - path));
+    size_t dir = lsp_atom_table_get(&registry->dir_by_path, dir_path);
+    if (dir != LSP_ATOM_NONE && registry->dirs[dir].present) {
+      Atom file_path = intern(path);
+      size_t index = lsp_atom_table_get(&registry->by_path, file_path);
+      // Saved within the recorded mtime, perhaps
+      if (index != LSP_ATOM_NONE)
+        registry->entries[index].mtime = -1;
+      scan_file(registry, file_path, dir, &st, &temp_arena);
+    }
+  }
+
+  arena_destroy(&temp_arena);
+}
+
+void lsp_module_registry_free(ModuleRegistry *registry) {
+  free(registry->entries);
+  free(registry->dirs);
+  lsp_atom_table_free(&registry->by_name);
+  lsp_atom_table_free(&registry->by_path);
+  lsp_atom_table_free(&registry->dir_by_path);
+  *registry = (ModuleRegistry){0};
+}
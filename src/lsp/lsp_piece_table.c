@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lsp.h"
+
+// Room for `length` bytes and the NUL after them
+static bool buffer_reserve(LSPTextBuffer *buf, size_t length) {
+  if (length < buf->capacity)
+    return true;
+  size_t capacity = buf->capacity ? buf->capacity : 256;
+  while (capacity <= length)
+    capacity *= 2;
+  char *data = realloc(buf->data, capacity);
+  if (!data) {
+    fprintf(stderr, "[LSP] piece table: out of memory\n");
+    return false;
+  }
+  buf->data = data;
+  buf->capacity = capacity;
+  return true;
+}
+
+static bool buffer_append(LSPTextBuffer *buf, const char *text, size_t length) {
+  if (!buffer_reserve(buf, buf->length + length))
+    return false;
+  for (size_t i = 0; i < length; i++) {
+    if (text[i] != '\n')
+      continue;
+    if (buf->newline_count == buf->newline_capacity) {
+      size_t capacity = buf->newline_capacity ? buf->newline_capacity * 2 : 64;
+      size_t *newlines = realloc(buf->newlines, capacity * sizeof(size_t));
+      if (!newlines) {
+        fprintf(stderr, "[LSP] piece table: out of memory\n");
+        return false;
+      }
+      buf->newlines = newlines;
+      buf->newline_capacity = capacity;
+    }
+    buf->newlines[buf->newline_count++] = buf->length + i;
+  }
+  memcpy(buf->data + buf->length, text, length);
+  buf->length += length;
+  buf->data[buf->length] = '\0';
+  return true;
+}
+
+static void buffer_clear(LSPTextBuffer *buf) {
+  buf->length = 0;
+  buf->newline_count = 0;
+  if (buf->data)
+    buf->data[0] = '\0';
+}
+
+static void buffer_free(LSPTextBuffer *buf) {
+  free(buf->data);
+  free(buf->newlines);
+  memset(buf, 0, sizeof(*buf));
+}
+
+// How many newlines of the buffer come before `offset`
+static size_t newlines_before(const LSPTextBuffer *buf, size_t offset) {
+  size_t lo = 0, hi = buf->newline_count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (buf->newlines[mid] < offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static const LSPTextBuffer *piece_buffer(const LSPPieceTable *table,
+                                         const LSPPiece *piece) {
+  return piece->added ? &table->added : &table->original;
+}
+
+static bool insert_piece(LSPPieceTable *table, size_t index, LSPPiece piece) {
+  if (table->piece_count == table->piece_capacity) {
+    size_t capacity = table->piece_capacity ? table->piece_capacity * 2 : 16;
+    LSPPiece *pieces = realloc(table->pieces, capacity * sizeof(LSPPiece));
+    if (!pieces) {
+      fprintf(stderr, "[LSP] piece table: out of memory\n");
+      return false;
+    }
+    table->pieces = pieces;
+    table->piece_capacity = capacity;
+  }
+  memmove(&table->pieces[index + 1], &table->pieces[index],
+          (table->piece_count - index) * sizeof(LSPPiece));
+  table->pieces[index] = piece;
+  table->piece_count++;
+  return true;
+}
+
+// The whole text is the original buffer again
+static bool reset_pieces(LSPPieceTable *table) {
+  buffer_clear(&table->added);
+  table->piece_count = 0;
+  table->length = table->original.length;
+  if (table->length == 0)
+    return true;
+  return insert_piece(table, 0, (LSPPiece){false, 0, table->length});
+}
+
+bool piece_table_init(LSPPieceTable *table, const char *text) {
+  memset(table, 0, sizeof(*table));
+  bool ok = piece_table_set(table, text);
+  table->changed = false;
+  return ok;
+}
+
+void piece_table_free(LSPPieceTable *table) {
+  buffer_free(&table->original);
+  buffer_free(&table->added);
+  buffer_free(&table->spare);
+  free(table->pieces);
+  memset(table, 0, sizeof(*table));
+}
+
+// Grows `span` to cover an edit that replaced the bytes [start, old_end)
+// of the text it ends at with [start, new_end). Bytes the span takes in on
+// either side are unchanged, so they stand for the same old bytes they did
+// before the edit.
+void lsp_text_span_add(LSPTextSpan *span, bool *changed, LSPTextSpan edit) {
+  if (!*changed) {
+    *span = (LSPTextSpan){edit.start, edit.old_end, edit.old_end};
+    *changed = true;
+  }
+  if (edit.start < span->start)
+    span->start = edit.start;
+  if (edit.old_end > span->new_end) {
+    span->old_end += edit.old_end - span->new_end;
+    span->new_end = edit.old_end;
+  }
+  span->new_end = span->new_end - (edit.old_end - edit.start) +
+                  (edit.new_end - edit.start);
+}
+
+static void note_change(LSPPieceTable *table, size_t start, size_t end,
+                        size_t length) {
+  lsp_text_span_add(&table->change, &table->changed,
+                    (LSPTextSpan){start, end, start + length});
+}
+
+// Hands over the edits since the last call, false when there were none
+bool piece_table_take_changes(LSPPieceTable *table, LSPTextSpan *change) {
+  if (!table->changed)
+    return false;
+  *change = table->change;
+  table->changed = false;
+  return true;
+}
+
+bool piece_table_set(LSPPieceTable *table, const char *text) {
+  note_change(table, 0, table->length, strlen(text));
+  buffer_clear(&table->original);
+  // An empty document still has a terminated buffer to hand out
+  if (!buffer_reserve(&table->original, 0) ||
+      !buffer_append(&table->original, text, strlen(text)))
+    return false;
+  return reset_pieces(table);
+}
+
+// Byte offset of an LSP position, whose character counts UTF-16 code units.
+// Pieces are skipped by their newline counts, so only the line itself is
+// walked. Positions past the end of a line or the text are clamped to it.
+static size_t position_offset(const LSPPieceTable *table, LSPPosition pos) {
+  size_t line = 0, target = pos.line > 0 ? (size_t)pos.line : 0;
+  size_t i = 0, piece_offset = 0, skip = 0;
+
+  for (; line < target && i < table->piece_count; i++) {
+    const LSPPiece *piece = &table->pieces[i];
+    const LSPTextBuffer *buf = piece_buffer(table, piece);
+    size_t first = newlines_before(buf, piece->start);
+    size_t inside = newlines_before(buf, piece->start + piece->length) - first;
+    if (line + inside >= target) {
+      // The line starts after the (target - line)th newline of this piece
+      skip = buf->newlines[first + (target - line) - 1] + 1 - piece->start;
+      line = target;
+      break;
+    }
+    line += inside;
+    piece_offset += piece->length;
+  }
+  if (line < target)
+    return table->length;
+
+  size_t units = 0, want = pos.character > 0 ? (size_t)pos.character : 0;
+  for (; i < table->piece_count; i++, skip = 0) {
+    const LSPPiece *piece = &table->pieces[i];
+    const char *data = piece_buffer(table, piece)->data + piece->start;
+    for (size_t k = skip; k < piece->length; k++) {
+      unsigned char c = (unsigned char)data[k];
+      if ((c & 0xC0) == 0x80)
+        continue; // UTF-8 continuation byte
+      if (c == '\n' || units >= want)
+        return piece_offset + k;
+      units += c >= 0xF0 ? 2 : 1; // Outside the BMP is a surrogate pair
+    }
+    piece_offset += piece->length;
+  }
+  return table->length;
+}
+
+// Index of the piece that starts at `offset`, splitting the piece it falls
+// inside of
+static bool split_at(LSPPieceTable *table, size_t offset, size_t *index) {
+  size_t start = 0;
+  for (size_t i = 0; i < table->piece_count; i++) {
+    LSPPiece *piece = &table->pieces[i];
+    if (offset == start) {
+      *index = i;
+      return true;
+    }
+    if (offset < start + piece->length) {
+      size_t left = offset - start;
+      LSPPiece right = {piece->added, piece->start + left,
+                        piece->length - left};
+      piece->length = left;
+      *index = i + 1;
+      return insert_piece(table, i + 1, right);
+    }
+    start += piece->length;
+  }
+  *index = table->piece_count;
+  return true;
+}
+
+bool piece_table_replace(LSPPieceTable *table, LSPRange range,
+                         const char *text) {
+  size_t start = position_offset(table, range.start);
+  size_t end = position_offset(table, range.end);
+  if (end < start)
+    end = start;
+
+  size_t first, last;
+  if (!split_at(table, start, &first) || !split_at(table, end, &last))
+    return false;
+  note_change(table, start, end, strlen(text));
+  memmove(&table->pieces[first], &table->pieces[last],
+          (table->piece_count - last) * sizeof(LSPPiece));
+  table->piece_count -= last - first;
+  table->length -= end - start;
+
+  size_t length = strlen(text);
+  if (length == 0)
+    return true;
+  size_t added_start = table->added.length;
+  if (!buffer_append(&table->added, text, length))
+    return false;
+  table->length += length;
+
+  // Typing a run of characters keeps growing the same piece
+  LSPPiece *prev = first > 0 ? &table->pieces[first - 1] : NULL;
+  if (prev && prev->added && prev->start + prev->length == added_start) {
+    prev->length += length;
+    return true;
+  }
+  return insert_piece(table, first, (LSPPiece){true, added_start, length});
+}
+
+// The text as one NUL-terminated string. It is folded into the spare buffer,
+// which then becomes the original, and the add buffer starts over; the
+// string stays valid until the next edit.
+// Copies what comes before `pos` on its line, up to size - 1 bytes of it,
+// into `out` and returns its length, without folding the pieces
+size_t piece_table_line_before(const LSPPieceTable *table, LSPPosition pos,
+                               char *out, size_t size) {
+  size_t end = position_offset(table, pos);
+  size_t start = end > size - 1 ? end - (size - 1) : 0;
+  size_t length = 0, piece_offset = 0;
+
+  for (size_t i = 0; i < table->piece_count && piece_offset < end; i++) {
+    const LSPPiece *piece = &table->pieces[i];
+    size_t from = start > piece_offset ? start - piece_offset : 0;
+    size_t to = end - piece_offset < piece->length ? end - piece_offset
+                                                   : piece->length;
+    if (from < to) {
+      memcpy(out + length, piece_buffer(table, piece)->data + piece->start + from,
+             to - from);
+      length += to - from;
+    }
+    piece_offset += piece->length;
+  }
+  out[length] = '\0';
+
+  const char *newline = strrchr(out, '\n');
+  if (newline) {
+    length -= (size_t)(newline + 1 - out);
+    memmove(out, newline + 1, length + 1);
+  }
+  return length;
+}
+
+const char *piece_table_text(LSPPieceTable *table) {
+  if (table->piece_count <= 1 && table->added.length == 0 &&
+      table->length == table->original.length)
+    return table->original.data;
+
+  LSPTextBuffer *spare = &table->spare;
+  buffer_clear(spare);
+  if (!buffer_reserve(spare, table->length))
+    return NULL;
+  spare->data[0] = '\0';
+  for (size_t i = 0; i < table->piece_count; i++) {
+    const LSPPiece *piece = &table->pieces[i];
+    if (!buffer_append(spare, piece_buffer(table, piece)->data + piece->start,
+                       piece->length))
+      return NULL;
+  }
+
+  LSPTextBuffer folded = *spare;
+  *spare = table->original;
+  table->original = folded;
+  if (!reset_pieces(table))
+    return NULL;
+  return table->original.data;
+}
@@ -1,9 +1,12 @@
 /**
  * @file lsp_semantic_tokens.c
- * @brief LSP textDocument/semanticTokens/full implementation for Luma.
+ * @brief LSP textDocument/semanticTokens/full, full/delta and range
+ * implementation for Luma.
  *
  * We classify every token the lexer produced and encode them in the LSP
- * delta-encoded wire format (5 integers per token).
+ * delta-encoded wire format (5 integers per token). The array last sent is
+ * kept with its result id, so full/delta only sends the span that changed,
+ * and range encodes just the lines the editor shows.
  *
  * Token type legend (indices MUST match the "tokenTypes" array sent in the
  * capabilities response — see lsp_message.c):
@@ -37,6 +40,8 @@
  */
 
 #include "lsp.h"
+#include <limits.h>
+#include <stdlib.h>
 #include <string.h>
 
 enum SemanticTokenType {
@@ -77,10 +82,9 @@ static Symbol *find_symbol_anywhere(Scope *scope, const char *name) {
   if (!scope || !name)
     return NULL;
 
-  if (scope->symbols.data) {
+  if (scope->symbols.count) {
     for (size_t i = 0; i < scope->symbols.count; i++) {
-      Symbol *sym =
-          (Symbol *)((char *)scope->symbols.data + i * sizeof(Symbol));
+      Symbol *sym = scope_symbol(scope, i);
       if (sym && sym->name && strcmp(sym->name, name) == 0)
         return sym;
     }
@@ -214,6 +218,7 @@ static TokenClass classify_token(LSPDocument *doc, size_t tok_idx) {
   case TOK_FREE:
   case TOK_SYSTEM:
   case TOK_SYSCALL:
+  case TOK_BUILTIN:
   case TOK_CAST:
   case TOK_SIZE_OF:
     return (TokenClass){ST_FUNCTION, SM_DEFAULT_LIB};
@@ -228,6 +233,21 @@ static TokenClass classify_token(LSPDocument *doc, size_t tok_idx) {
   case TOK_TAKES_OWNERSHIP:
   case TOK_DLL_IMPORT:
   case TOK_LIB_IMPORT:
+  case TOK_PACKED:
+  case TOK_ALIGN:
+  case TOK_REORDER:
+  case TOK_UNROLL:
+  case TOK_VECTORIZE:
+  case TOK_NO_VECTORIZE:
+  case TOK_INDEPENDENT:
+  case TOK_INLINE:
+  case TOK_NOINLINE:
+  case TOK_HOT:
+  case TOK_COLD:
+  case TOK_PURE:
+  case TOK_CONST_ATTR:
+  case TOK_FLATTEN:
+  case TOK_MUSTTAIL:
     return (TokenClass){ST_MODIFIER, SM_DEFAULT_LIB};
 
   /* --- Operators --- */
@@ -360,42 +380,48 @@ static void token_display_col_and_len(Token *tok, int *out_col, int *out_len) {
   }
 }
 
-char *lsp_semantic_tokens_full(LSPDocument *doc, ArenaAllocator *arena) {
-  if (!doc || !doc->tokens || doc->token_count == 0)
-    return NULL;
-
-  fprintf(stderr, "[LSP] semanticTokens: encoding %zu tokens\n",
-          doc->token_count);
+typedef struct {
+  uint32_t *data;
+  size_t count;
+  size_t capacity;
+} EncodedTokens;
+
+static bool push_token(EncodedTokens *out, const uint32_t token[5]) {
+  if (out->count + 5 > out->capacity) {
+    size_t capacity = out->capacity ? out->capacity * 2 : 5 * 256;
+    uint32_t *data = realloc(out->data, capacity * sizeof(uint32_t));
+    if (!data)
+      return false;
+    out->data = data;
+    out->capacity = capacity;
+  }
+  memcpy(out->data + out->count, token, 5 * sizeof(uint32_t));
+  out->count += 5;
+  return true;
+}
 
-  /* Heap-allocate the data buffer so we never blow a 64KB temp arena. */
-  size_t data_buf_size = doc->token_count * 64 + 64;
-  char *data_buf = (char *)malloc(data_buf_size);
-  if (!data_buf)
-    return NULL;
+// Encodes the tokens on lines first_line..last_line (0-based, inclusive)
+// into `out`, malloc'd. The first one is relative to the document start, as
+// a range result's has to be.
+static void encode_tokens(LSPDocument *doc, int first_line, int last_line,
+                          EncodedTokens *out) {
+  *out = (EncodedTokens){0};
+  if (!doc || !doc->tokens || doc->token_count == 0)
+    return;
 
-  size_t offset = 0;
   int prev_line = 0;
   int prev_char = 0;
-  size_t token_count = 0;
 
   for (size_t i = 0; i < doc->token_count; i++) {
     Token *tok = &doc->tokens[i];
+    if ((int)tok->line - 1 < first_line || (int)tok->line - 1 > last_line)
+      continue;
+
     TokenClass cls = classify_token(doc, i);
 
     if (cls.type < 0)
       continue; /* skip punctuation, whitespace, etc. */
 
-    /* Grow buffer defensively. */
-    if (offset + 80 > data_buf_size) {
-      data_buf_size *= 2;
-      char *tmp = (char *)realloc(data_buf, data_buf_size);
-      if (!tmp) {
-        free(data_buf);
-        return NULL;
-      }
-      data_buf = tmp;
-    }
-
     if ((int)tok->line < 1 || (int)tok->col < 1) {
       fprintf(stderr,
               "[LSP] semanticTokens: skipping token '%.*s' with "
@@ -428,27 +454,141 @@ char *lsp_semantic_tokens_full(LSPDocument *doc, ArenaAllocator *arena) {
       continue;
     }
 
-    if (token_count > 0)
-      data_buf[offset++] = ',';
-
-    offset += (size_t)snprintf(data_buf + offset, data_buf_size - offset,
-                               "%d,%d,%d,%d,%d", delta_line, delta_char,
-                               tok_len, cls.type, cls.mods);
+    uint32_t token[5] = {(uint32_t)delta_line, (uint32_t)delta_char,
+                         (uint32_t)tok_len, (uint32_t)cls.type,
+                         (uint32_t)cls.mods};
+    if (!push_token(out, token))
+      break;
     prev_line = line;
     prev_char = col;
-    token_count++;
+  }
+}
+
+static void write_data(JsonWriter *w, const uint32_t *data, size_t count) {
+  json_begin_array(w);
+  for (size_t i = 0; i < count; i++)
+    json_write_int(w, (int)data[i]);
+  json_end_array(w);
+}
+
+// Keeps `tokens` as what the client now has, under a new result id
+static void remember_tokens(LSPDocument *doc, EncodedTokens *tokens) {
+  free(doc->semantic_tokens);
+  doc->semantic_tokens = tokens->data;
+  doc->semantic_token_count = tokens->count;
+  doc->semantic_result_id++;
+}
+
+static void write_result_id(JsonWriter *w, LSPDocument *doc) {
+  char id[16];
+  snprintf(id, sizeof(id), "%u", doc->semantic_result_id);
+  json_write_key(w, "resultId");
+  json_write_string(w, id);
+}
+
+// Writes the {"resultId":...,"data":[...]} result for the document's
+// published tokens
+void lsp_semantic_tokens_full(LSPDocument *doc, JsonWriter *w) {
+  json_begin_object(w);
+
+  if (!doc) {
+    json_write_key(w, "data");
+    json_begin_array(w);
+    json_end_array(w);
+    json_end_object(w);
+    return;
   }
 
+  EncodedTokens tokens;
+  encode_tokens(doc, 0, INT_MAX, &tokens);
   fprintf(stderr, "[LSP] semanticTokens: emitting %zu classified tokens\n",
-          token_count);
+          tokens.count / 5);
+  remember_tokens(doc, &tokens);
+
+  write_result_id(w, doc);
+  json_write_key(w, "data");
+  write_data(w, doc->semantic_tokens, doc->semantic_token_count);
+  json_end_object(w);
+}
+
+// Writes the edits turning the tokens last sent under previous_result_id
+// into the current ones: a single replacement of whatever lies between
+// their common prefix and suffix, in whole tokens. Falls back to the full
+// result when that id is not the last one sent.
+void lsp_semantic_tokens_delta(LSPDocument *doc, const char *previous_result_id,
+                               JsonWriter *w) {
+  char last[16];
+  if (doc)
+    snprintf(last, sizeof(last), "%u", doc->semantic_result_id);
+  if (!doc || !previous_result_id || doc->semantic_result_id == 0 ||
+      strcmp(previous_result_id, last) != 0) {
+    lsp_semantic_tokens_full(doc, w);
+    return;
+  }
 
-  size_t result_size = offset + 32;
-  char *result = arena_alloc(arena, result_size, 1);
-  if (result) {
-    snprintf(result, result_size, "{\"data\":[%.*s]}", (int)offset, data_buf);
+  EncodedTokens tokens;
+  encode_tokens(doc, 0, INT_MAX, &tokens);
+
+  const uint32_t *old_data = doc->semantic_tokens;
+  size_t old_count = doc->semantic_token_count;
+  size_t shorter = old_count < tokens.count ? old_count : tokens.count;
+
+  size_t prefix = 0;
+  while (prefix < shorter && old_data[prefix] == tokens.data[prefix])
+    prefix++;
+  prefix -= prefix % 5;
+
+  size_t suffix = 0;
+  while (suffix < shorter - prefix &&
+         old_data[old_count - 1 - suffix] ==
+             tokens.data[tokens.count - 1 - suffix])
+    suffix++;
+  suffix -= suffix % 5;
+
+  size_t delete_count = old_count - prefix - suffix;
+  size_t insert_count = tokens.count - prefix - suffix;
+  fprintf(stderr,
+          "[LSP] semanticTokens: delta replaces %zu of %zu values with %zu\n",
+          delete_count, old_count, insert_count);
+
+  json_begin_object(w);
+  json_write_key(w, "edits");
+  json_begin_array(w);
+  if (delete_count || insert_count) {
+    json_begin_object(w);
+    json_write_key(w, "start");
+    json_write_int(w, (int)prefix);
+    json_write_key(w, "deleteCount");
+    json_write_int(w, (int)delete_count);
+    json_write_key(w, "data");
+    write_data(w, tokens.data + prefix, insert_count);
+    json_end_object(w);
   }
-  free(data_buf);
-  return result;
+  json_end_array(w);
+
+  remember_tokens(doc, &tokens);
+  write_result_id(w, doc);
+  json_end_object(w);
+}
+
+// Writes the {"data":[...]} result for the lines `range` touches. It has
+// no result id, and leaves what a later delta is diffed against alone.
+void lsp_semantic_tokens_range(LSPDocument *doc, LSPRange range,
+                               JsonWriter *w) {
+  EncodedTokens tokens;
+  encode_tokens(doc, range.start.line, range.end.line, &tokens);
+
+  json_begin_object(w);
+  json_write_key(w, "data");
+  write_data(w, tokens.data, tokens.count);
+  json_end_object(w);
+  free(tokens.data);
+}
+
+void lsp_semantic_tokens_free(LSPDocument *doc) {
+  free(doc->semantic_tokens);
+  doc->semantic_tokens = NULL;
+  doc->semantic_token_count = 0;
 }
 
 const char *lsp_semantic_tokens_capabilities(void) {
@@ -481,6 +621,7 @@ const char *lsp_semantic_tokens_capabilities(void) {
          "\"defaultLibrary\"" /* bit 4 */
          "]"
          "},"
-         "\"full\":true"
+         "\"full\":{\"delta\":true},"
+         "\"range\":true"
          "}";
 }
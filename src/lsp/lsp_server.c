@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #if defined(_WIN32) || defined(__MINGW32__)
   #include <winsock2.h>   /* select(), fd_set, struct timeval */
@@ -121,6 +122,71 @@ static void watchdog_init(void) {
   pthread_create(&g_watchdog.thread, NULL, watchdog_thread, NULL);
 }
 
+// ============================================================================
+// SESSION RECORDING
+// ============================================================================
+
+// With LUMA_LSP_RECORD set to a path, every message read and written is
+// appended there as a line "<microseconds since start> <in|out> <bytes>",
+// the message itself and a newline, for bench/lsp_replay.py to play back.
+// Each one is flushed as it is written, since exit ends the process.
+typedef struct {
+  FILE *file;
+  struct timespec start;
+  pthread_mutex_t mu;
+} Recorder;
+
+static Recorder g_recorder = {NULL, {0, 0}, PTHREAD_MUTEX_INITIALIZER};
+
+static void record_open(const char *path) {
+  g_recorder.file = fopen(path, "wb");
+  if (!g_recorder.file) {
+    fprintf(stderr, "[LSP] Cannot record the session to %s: %s\n", path,
+            strerror(errno));
+    return;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &g_recorder.start);
+  fprintf(stderr, "[LSP] Recording the session to %s\n", path);
+}
+
+static void record_close(void) {
+  pthread_mutex_lock(&g_recorder.mu);
+  if (g_recorder.file)
+    fclose(g_recorder.file);
+  g_recorder.file = NULL;
+  pthread_mutex_unlock(&g_recorder.mu);
+}
+
+// Starts an entry of `length` bytes, written with lsp_record_write() and
+// ended with lsp_record_end(). Returns false when not recording, and then
+// neither is to be called.
+bool lsp_record_begin(bool incoming, size_t length) {
+  if (!g_recorder.file)
+    return false;
+  pthread_mutex_lock(&g_recorder.mu);
+  if (!g_recorder.file) {
+    pthread_mutex_unlock(&g_recorder.mu);
+    return false;
+  }
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  long long us = (long long)(now.tv_sec - g_recorder.start.tv_sec) * 1000000 +
+                 (now.tv_nsec - g_recorder.start.tv_nsec) / 1000;
+  fprintf(g_recorder.file, "%lld %s %zu\n", us, incoming ? "in" : "out",
+          length);
+  return true;
+}
+
+void lsp_record_write(const char *data, size_t length) {
+  fwrite(data, 1, length, g_recorder.file);
+}
+
+void lsp_record_end(void) {
+  fputc('\n', g_recorder.file);
+  fflush(g_recorder.file);
+  pthread_mutex_unlock(&g_recorder.mu);
+}
+
 const char *lsp_uri_to_path(const char *uri, ArenaAllocator *arena) {
   if (!uri) return NULL;
   if (strncmp(uri, "file://", 7) == 0) {
@@ -151,7 +217,8 @@ bool lsp_server_init(LSPServer *server, ArenaAllocator *arena) {
 
   install_crash_handlers();
   watchdog_init();
-  lsp_ast_cache_init(server);
+  lsp_module_cache_init(&server->module_cache);
+  lsp_symbol_index_init(&server->symbol_index);
 
   server->arena = arena;
   server->initialized = false;
@@ -163,9 +230,11 @@ bool lsp_server_init(LSPServer *server, ArenaAllocator *arena) {
       arena_alloc(arena, server->document_capacity * sizeof(LSPDocument *),
                   alignof(LSPDocument *));
 
-  server->module_registry.entries = NULL;
-  server->module_registry.count   = 0;
-  server->module_registry.capacity = 0;
+  server->module_registry = (ModuleRegistry){0};
+  server->missing_modules = (LSPAtomTable){0};
+
+  server->body_cache = body_cache_create();
+  lsp_worker_start(server);
 
   return server->documents != NULL;
 }
@@ -176,6 +245,14 @@ void lsp_server_run(LSPServer *server) {
   fprintf(stderr, "[LSP] Server started, waiting for messages...\n");
   fflush(stderr);
 
+  // select() only sees what is still in the pipe, so messages read ahead
+  // into a stdio buffer would wait for the next one to arrive
+  setvbuf(stdin, NULL, _IONBF, 0);
+
+  const char *record_path = getenv("LUMA_LSP_RECORD");
+  if (record_path && *record_path)
+    record_open(record_path);
+
   int stdin_fd = fileno(stdin);
   char header_buf[8192];
 
@@ -261,11 +338,16 @@ void lsp_server_run(LSPServer *server) {
 
     message[total_read] = '\0';
 
+    if (lsp_record_begin(true, total_read)) {
+      lsp_record_write(message, total_read);
+      lsp_record_end();
+    }
+
     fprintf(stderr, "[LSP] Dispatching (%zu bytes)\n", total_read);
     fflush(stderr);
 
     watchdog_arm();
-    lsp_handle_message(server, message);
+    lsp_handle_message(server, message, total_read);
     watchdog_disarm();
 
     free(message);
@@ -275,6 +357,7 @@ void lsp_server_run(LSPServer *server) {
   }
 
 done:
+  record_close();
   fprintf(stderr, "[LSP] Server loop exited\n");
   fflush(stderr);
 }
@@ -285,15 +368,33 @@ void lsp_server_shutdown(LSPServer *server) {
   g_watchdog.done = 1;
   pthread_cond_signal(&g_watchdog.cv);
 
+  lsp_worker_stop(server);
+
   for (size_t i = 0; i < server->document_count; i++) {
     if (server->documents[i]) {
+      lsp_modules_release(server->documents[i]->modules,
+                          server->documents[i]->module_count);
+      lsp_modules_release(server->documents[i]->work.modules,
+                          server->documents[i]->work.module_count);
       if (server->documents[i]->arena)
         arena_destroy(server->documents[i]->arena);
+      if (server->documents[i]->work.arena)
+        arena_destroy(server->documents[i]->work.arena);
+      free(server->documents[i]->request.text);
+      lsp_semantic_tokens_free(server->documents[i]);
       server->documents[i] = NULL;
     }
   }
 
-  arena_destroy(&server->cache_arena);
+  lsp_module_cache_free(&server->module_cache);
+  lsp_symbol_index_free(&server->symbol_index);
+
+  lsp_module_registry_save(server);
+  lsp_module_registry_free(&server->module_registry);
+  lsp_atom_table_free(&server->missing_modules);
+
+  body_cache_destroy(server->body_cache);
+  server->body_cache = NULL;
 
   server->initialized = false;
   server->document_count = 0;
@@ -0,0 +1,795 @@
+// lsp_symbol_index.c - Top-level names of the workspace and where they occur
+//
+// Each file indexed is read once into the occurrences of top-level names in
+// it: where its module declares one (`const name` or `let name` outside any
+// braces), and where one is used, either through an import alias
+// (`io::print` is "std_io::print") or unqualified in the module declaring
+// it. A name that a declaration also binds locally (a parameter, a `let`, a
+// loop variable or a field) stands for that local from there to the end of
+// the declaration. Kinds come from the module's checked scope when it has
+// one, and from the declaration's tokens otherwise.
+//
+// A name is keyed "<module>::<name>" (a file declaring no module stands for
+// its own) and lists the files it occurs in, and a file's occurrences are
+// sorted by name too, so definition, references, rename and highlight cost
+// the occurrences they return. A file is replaced whole: an open document
+// when its analysis is published, an imported module when the module cache
+// checks it, and the other files of the module registry by the worker when
+// it has nothing else to do.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "../c_libs/error/error.h"
+#include "lsp.h"
+
+#define SYMBOL_KEY_MAX 512
+#define SYMBOL_SCAN_BATCH 64
+#define WORKSPACE_SYMBOL_PAGE 256
+
+void lsp_symbol_index_init(LSPSymbolIndex *index) {
+  *index = (LSPSymbolIndex){0};
+  pthread_mutex_init(&index->lock, NULL);
+}
+
+void lsp_symbol_index_free(LSPSymbolIndex *index) {
+  for (size_t i = 0; i < index->file_count; i++) {
+    free(index->files[i].occurrences);
+    free(index->files[i].by_symbol);
+  }
+  for (size_t i = 0; i < index->symbol_count; i++)
+    free(index->symbols[i].files);
+  free(index->files);
+  free(index->symbols);
+  free(index->words);
+  lsp_atom_table_free(&index->file_by_uri);
+  lsp_atom_table_free(&index->symbol_by_key);
+  pthread_mutex_destroy(&index->lock);
+  *index = (LSPSymbolIndex){0};
+}
+
+// ============================================================================
+// SYMBOLS AND FILES
+// ============================================================================
+
+static size_t index_symbol(LSPSymbolIndex *index, const char *module,
+                          Atom module_name, Atom name) {
+  char text[SYMBOL_KEY_MAX];
+  int length = snprintf(text, sizeof(text), "%s::%s", module, name);
+  if (length < 0 || (size_t)length >= sizeof(text))
+    return LSP_ATOM_NONE;
+  Atom key = intern(text);
+  size_t found = lsp_atom_table_get(&index->symbol_by_key, key);
+  if (found != LSP_ATOM_NONE)
+    return found;
+
+  if (index->symbol_count >= UINT32_MAX)
+    return LSP_ATOM_NONE;
+  if (index->symbol_count == index->symbol_capacity) {
+    size_t capacity = index->symbol_capacity ? index->symbol_capacity * 2 : 256;
+    LSPIndexedSymbol *symbols =
+        realloc(index->symbols, capacity * sizeof(LSPIndexedSymbol));
+    if (!symbols)
+      return LSP_ATOM_NONE;
+    index->symbols = symbols;
+    index->symbol_capacity = capacity;
+  }
+  if (!lsp_atom_table_put(&index->symbol_by_key, key, index->symbol_count))
+    return LSP_ATOM_NONE;
+  index->symbols[index->symbol_count] = (LSPIndexedSymbol){
+      .key = key,
+      .module_name = module_name,
+      .name = name,
+      .kind = LSP_SYMBOL_VARIABLE,
+  };
+  return index->symbol_count++;
+}
+
+static bool symbol_add_file(LSPIndexedSymbol *symbol, uint32_t file) {
+  if (symbol->file_count == symbol->file_capacity) {
+    size_t capacity = symbol->file_capacity ? symbol->file_capacity * 2 : 4;
+    uint32_t *files = realloc(symbol->files, capacity * sizeof(uint32_t));
+    if (!files)
+      return false;
+    symbol->files = files;
+    symbol->file_capacity = capacity;
+  }
+  symbol->files[symbol->file_count++] = file;
+  return true;
+}
+
+static bool symbol_remove_file(LSPIndexedSymbol *symbol, uint32_t file) {
+  for (size_t i = 0; i < symbol->file_count; i++) {
+    if (symbol->files[i] == file) {
+      symbol->files[i] = symbol->files[--symbol->file_count];
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool run_defines(const LSPIndexedFile *file, size_t start, size_t end) {
+  for (size_t i = start; i < end; i++) {
+    if (file->occurrences[file->by_symbol[i]].definition)
+      return true;
+  }
+  return false;
+}
+
+// Takes the file's occurrences out of the symbols listing it
+static void drop_occurrences(LSPSymbolIndex *index, uint32_t f) {
+  LSPIndexedFile *file = &index->files[f];
+  for (size_t start = 0, end; start < file->count; start = end) {
+    uint32_t symbol = file->occurrences[file->by_symbol[start]].symbol;
+    for (end = start + 1; end < file->count &&
+                          file->occurrences[file->by_symbol[end]].symbol ==
+                              symbol;
+         end++)
+      ;
+    LSPIndexedSymbol *entry = &index->symbols[symbol];
+    // Not listed if it ran out of memory attaching them
+    if (symbol_remove_file(entry, f) && run_defines(file, start, end)) {
+      entry->defined_in--;
+      index->words_stale = true;
+    }
+  }
+  free(file->occurrences);
+  free(file->by_symbol);
+  file->occurrences = NULL;
+  file->by_symbol = NULL;
+  file->count = 0;
+}
+
+// Not reentrant, and only sorted under the index's lock
+static const LSPSymbolOccurrence *sort_occurrences;
+
+static int compare_by_symbol(const void *a, const void *b) {
+  uint32_t i = *(const uint32_t *)a, j = *(const uint32_t *)b;
+  uint32_t si = sort_occurrences[i].symbol, sj = sort_occurrences[j].symbol;
+  if (si != sj)
+    return si < sj ? -1 : 1;
+  return i < j ? -1 : i > j;
+}
+
+// Lists the file under the symbols of its new occurrences, which it takes
+// over
+static bool attach_occurrences(LSPSymbolIndex *index, uint32_t f,
+                               LSPSymbolOccurrence *occurrences,
+                               size_t count) {
+  LSPIndexedFile *file = &index->files[f];
+  uint32_t *by_symbol = malloc((count + 1) * sizeof(uint32_t));
+  if (!by_symbol) {
+    free(occurrences);
+    return false;
+  }
+  for (size_t i = 0; i < count; i++)
+    by_symbol[i] = (uint32_t)i;
+  sort_occurrences = occurrences;
+  qsort(by_symbol, count, sizeof(uint32_t), compare_by_symbol);
+
+  file->occurrences = occurrences;
+  file->by_symbol = by_symbol;
+  file->count = count;
+
+  size_t end;
+  for (size_t start = 0; start < count; start = end) {
+    uint32_t symbol = occurrences[by_symbol[start]].symbol;
+    for (end = start + 1;
+         end < count && occurrences[by_symbol[end]].symbol == symbol; end++)
+      ;
+    LSPIndexedSymbol *entry = &index->symbols[symbol];
+    if (symbol_add_file(entry, f) && run_defines(file, start, end)) {
+      entry->defined_in++;
+      index->words_stale = true;
+    }
+  }
+  return true;
+}
+
+static size_t file_slot(LSPSymbolIndex *index, Atom uri) {
+  size_t f = lsp_atom_table_get(&index->file_by_uri, uri);
+  if (f != LSP_ATOM_NONE)
+    return f;
+  if (index->file_count == index->file_capacity) {
+    size_t capacity = index->file_capacity ? index->file_capacity * 2 : 64;
+    LSPIndexedFile *files =
+        realloc(index->files, capacity * sizeof(LSPIndexedFile));
+    if (!files)
+      return LSP_ATOM_NONE;
+    index->files = files;
+    index->file_capacity = capacity;
+  }
+  if (!lsp_atom_table_put(&index->file_by_uri, uri, index->file_count))
+    return LSP_ATOM_NONE;
+  index->files[index->file_count] = (LSPIndexedFile){.uri = uri};
+  return index->file_count++;
+}
+
+// ============================================================================
+// READING A FILE
+// ============================================================================
+
+static LSPRange token_range(const Token *tok) {
+  int line = tok->line - 1;
+  int start = tok->col - tok->length + 1;
+  return (LSPRange){{line, start}, {line, start + tok->length}};
+}
+
+// The module an import alias stands for
+static const char *aliased_module(const ImportedModule *imports, size_t count,
+                                  Atom alias) {
+  for (size_t i = 0; i < count; i++) {
+    const char *name = imports[i].alias ? imports[i].alias
+                                        : imports[i].module_path;
+    if (name && strcmp(name, alias) == 0)
+      return imports[i].module_path;
+  }
+  return NULL;
+}
+
+static bool declares_top_level(const Token *tokens, size_t i, int depth) {
+  return depth == 0 && i > 0 &&
+         (tokens[i - 1].type_ == TOK_CONST || tokens[i - 1].type_ == TOK_VAR);
+}
+
+// A parameter, local, loop variable or field: `let x`, `(x: T`, `, x: T`,
+// `[x: T` or `{ x: T`
+static bool declares_local(const Token *tokens, size_t count, size_t i,
+                           int depth) {
+  if (depth == 0 || i == 0)
+    return false;
+  LumaTokenType prev = tokens[i - 1].type_;
+  if (prev == TOK_VAR || prev == TOK_CONST)
+    return true;
+  if (i + 1 >= count || tokens[i + 1].type_ != TOK_COLON)
+    return false;
+  return prev == TOK_LPAREN || prev == TOK_COMMA || prev == TOK_LBRACKET ||
+         prev == TOK_LBRACE || prev == TOK_COLON;
+}
+
+static LSPSymbolKind checked_kind(const Symbol *symbol) {
+  if (!symbol->type)
+    return symbol->is_mutable ? LSP_SYMBOL_VARIABLE : LSP_SYMBOL_CONSTANT;
+  switch (symbol->type->type) {
+  case AST_TYPE_FUNCTION:
+    return LSP_SYMBOL_FUNCTION;
+  case AST_TYPE_STRUCT:
+    return LSP_SYMBOL_STRUCT;
+  case AST_TYPE_ENUM:
+    return LSP_SYMBOL_ENUM;
+  default:
+    return symbol->is_mutable ? LSP_SYMBOL_VARIABLE : LSP_SYMBOL_CONSTANT;
+  }
+}
+
+// The kind of a declaration the scope doesn't have: `const f -> fn`, and so
+// on
+static LSPSymbolKind declared_kind(const Token *tokens, size_t count,
+                                   size_t i) {
+  if (i + 2 < count && tokens[i + 1].type_ == TOK_RIGHT_ARROW) {
+    switch (tokens[i + 2].type_) {
+    case TOK_FN:
+      return LSP_SYMBOL_FUNCTION;
+    case TOK_STRUCT:
+      return LSP_SYMBOL_STRUCT;
+    case TOK_ENUM:
+      return LSP_SYMBOL_ENUM;
+    default:
+      break;
+    }
+  }
+  return tokens[i - 1].type_ == TOK_VAR ? LSP_SYMBOL_VARIABLE
+                                        : LSP_SYMBOL_CONSTANT;
+}
+
+static void track_depth(const Token *tok, int *depth) {
+  switch (tok->type_) {
+  case TOK_LBRACE:
+  case TOK_LPAREN:
+  case TOK_LBRACKET:
+    (*depth)++;
+    break;
+  case TOK_RBRACE:
+  case TOK_RPAREN:
+  case TOK_RBRACKET:
+    if (*depth > 0)
+      (*depth)--;
+    break;
+  default:
+    break;
+  }
+}
+
+typedef struct {
+  LSPSymbolOccurrence *items;
+  size_t count;
+  size_t capacity;
+} OccurrenceList;
+
+static bool add_occurrence(OccurrenceList *list, size_t symbol,
+                           bool definition, const Token *tok) {
+  if (symbol == LSP_ATOM_NONE)
+    return true;
+  if (list->count == list->capacity) {
+    size_t capacity = list->capacity ? list->capacity * 2 : 64;
+    LSPSymbolOccurrence *items =
+        realloc(list->items, capacity * sizeof(LSPSymbolOccurrence));
+    if (!items)
+      return false;
+    list->items = items;
+    list->capacity = capacity;
+  }
+  list->items[list->count++] = (LSPSymbolOccurrence){
+      .symbol = (uint32_t)symbol,
+      .definition = definition,
+      .range = token_range(tok),
+  };
+  return true;
+}
+
+// Replaces what the index has of `uri` with the occurrences in `tokens`.
+// `module_scope` is the file's checked module scope, if it has one.
+void lsp_symbol_index_update(LSPSymbolIndex *index, const char *uri,
+                             const char *module_name, const Token *tokens,
+                             size_t token_count, const ImportedModule *imports,
+                             size_t import_count, Scope *module_scope,
+                             long mtime) {
+  if (!uri || !tokens)
+    return;
+  Atom uri_atom = intern(uri);
+  Atom module_atom = module_name ? intern(module_name) : NULL;
+  const char *module = module_atom ? module_atom : uri_atom;
+
+  // What the checked scope declares, by name
+  LSPAtomTable checked = {0};
+  for (size_t i = 0; module_scope && i < module_scope->symbols.count; i++) {
+    Symbol *symbol = scope_symbol(module_scope, i);
+    if (symbol && symbol->name)
+      lsp_atom_table_put(&checked, symbol->name, i);
+  }
+
+  pthread_mutex_lock(&index->lock);
+
+  // The module's own names first, which it may use before declaring them
+  LSPAtomTable top_level = {0};
+  int depth = 0;
+  for (size_t i = 0; i < token_count; i++) {
+    const Token *tok = &tokens[i];
+    if (tok->type_ == TOK_IDENTIFIER && declares_top_level(tokens, i, depth)) {
+      Atom name = intern_n(tok->value, (size_t)tok->length);
+      size_t symbol = index_symbol(index, module, module_atom, name);
+      if (symbol == LSP_ATOM_NONE)
+        continue;
+      lsp_atom_table_put(&top_level, name, symbol);
+      size_t position = lsp_atom_table_get(&checked, name);
+      index->symbols[symbol].kind =
+          position != LSP_ATOM_NONE
+              ? checked_kind(scope_symbol(module_scope, position))
+              : declared_kind(tokens, token_count, i);
+    }
+    track_depth(tok, &depth);
+  }
+
+  OccurrenceList list = {0};
+  LSPAtomTable locals = {0};
+  bool ok = true;
+  depth = 0;
+  for (size_t i = 0; ok && i < token_count; i++) {
+    const Token *tok = &tokens[i];
+    if (tok->type_ != TOK_IDENTIFIER || tok->length == 0) {
+      track_depth(tok, &depth);
+      continue;
+    }
+    Atom name = intern_n(tok->value, (size_t)tok->length);
+    LumaTokenType prev = i > 0 ? tokens[i - 1].type_ : TOK_EOF;
+    LumaTokenType next = i + 1 < token_count ? tokens[i + 1].type_ : TOK_EOF;
+
+    if (declares_top_level(tokens, i, depth)) {
+      // The next declaration's locals are its own
+      lsp_atom_table_clear(&locals);
+      ok = add_occurrence(&list, lsp_atom_table_get(&top_level, name), true,
+                          tok);
+    } else if (prev == TOK_DOT) {
+      // A field or method
+    } else if (prev == TOK_RESOLVE) {
+      const Token *base = i >= 2 ? &tokens[i - 2] : NULL;
+      const char *imported =
+          base && base->type_ == TOK_IDENTIFIER
+              ? aliased_module(imports, import_count,
+                               intern_n(base->value, (size_t)base->length))
+              : NULL;
+      if (imported)
+        ok = add_occurrence(
+            &list, index_symbol(index, imported, intern(imported), name), false,
+            tok);
+    } else if (next == TOK_RESOLVE &&
+               aliased_module(imports, import_count, name)) {
+      // An import alias
+    } else if (declares_local(tokens, token_count, i, depth)) {
+      lsp_atom_table_put(&locals, name, i);
+    } else if (lsp_atom_table_get(&locals, name) == LSP_ATOM_NONE) {
+      ok = add_occurrence(&list, lsp_atom_table_get(&top_level, name), false,
+                          tok);
+    }
+  }
+
+  size_t f = ok ? file_slot(index, uri_atom) : LSP_ATOM_NONE;
+  if (f != LSP_ATOM_NONE) {
+    drop_occurrences(index, (uint32_t)f);
+    index->files[f].module_name = module_atom;
+    index->files[f].mtime = mtime;
+    attach_occurrences(index, (uint32_t)f, list.items, list.count);
+  } else {
+    free(list.items);
+  }
+
+  pthread_mutex_unlock(&index->lock);
+  lsp_atom_table_free(&top_level);
+  lsp_atom_table_free(&locals);
+  lsp_atom_table_free(&checked);
+}
+
+// Lexes `text` and indexes it. What the lexer reports is dropped: the
+// module's own analysis reports it.
+void lsp_symbol_index_update_text(LSPSymbolIndex *index, const char *uri,
+                                  const char *text, Scope *module_scope,
+                                  long mtime) {
+  if (!uri || !text)
+    return;
+  ArenaAllocator arena;
+  arena_allocator_init(&arena, 64 * 1024);
+  ErrorBuffer dropped = {0};
+  ErrorBuffer *outer = error_get_capture();
+  error_begin_capture(&dropped);
+
+  TokenBuffer buffer;
+  Token *tokens = token_buffer_lex(&buffer, text, &arena)
+                      ? token_buffer_expand(&buffer, &arena)
+                      : NULL;
+  if (tokens) {
+    LSPDocument scan = {0};
+    scan.content = text;
+    extract_imports(&scan, &arena);
+    lsp_symbol_index_update(index, uri, extract_module_name(text, &arena),
+                            tokens, buffer.count, scan.imports,
+                            scan.import_count, module_scope, mtime);
+  }
+
+  error_begin_capture(outer);
+  free(dropped.items);
+  arena_destroy(&arena);
+}
+
+// ============================================================================
+// THE REST OF THE WORKSPACE
+// ============================================================================
+
+// Has the worker compare every file of the module registry against the
+// index again, as it did after initialize
+void lsp_symbol_index_rescan(LSPSymbolIndex *index) {
+  pthread_mutex_lock(&index->lock);
+  index->scan_pending = true;
+  index->scan_next = 0;
+  pthread_mutex_unlock(&index->lock);
+}
+
+bool lsp_symbol_index_scan_pending(LSPSymbolIndex *index) {
+  pthread_mutex_lock(&index->lock);
+  bool pending = index->scan_pending;
+  pthread_mutex_unlock(&index->lock);
+  return pending;
+}
+
+static long indexed_mtime(LSPSymbolIndex *index, const char *uri) {
+  pthread_mutex_lock(&index->lock);
+  size_t f = lsp_atom_table_get(&index->file_by_uri, atom_find(uri));
+  long mtime = f != LSP_ATOM_NONE ? index->files[f].mtime : -2;
+  pthread_mutex_unlock(&index->lock);
+  return mtime;
+}
+
+// Indexes a batch of the workspace's files that the index lacks or has
+// older text of, under compiler_lock since it reads the module registry.
+// Open documents are left to their analyses. Returns whether files are
+// left for the next batch.
+bool lsp_symbol_index_scan(LSPServer *server) {
+  LSPSymbolIndex *index = &server->symbol_index;
+  ModuleRegistry *registry = &server->module_registry;
+
+  pthread_mutex_lock(&index->lock);
+  bool pending = index->scan_pending;
+  size_t next = index->scan_next;
+  pthread_mutex_unlock(&index->lock);
+  if (!pending)
+    return false;
+
+  size_t read = 0;
+  while (next < registry->count && read < SYMBOL_SCAN_BATCH) {
+    ModuleRegistryEntry *entry = &registry->entries[next++];
+    if (!entry->present || entry->dir == LSP_ATOM_NONE)
+      continue;
+    if (!entry->file_uri)
+      entry->file_uri = lsp_path_to_uri(entry->path, server->arena);
+    if (!entry->file_uri || lsp_document_find(server, entry->file_uri))
+      continue;
+
+    struct stat st;
+    if (stat(entry->path, &st) != 0 ||
+        indexed_mtime(index, entry->file_uri) == (long)st.st_mtime)
+      continue;
+
+    long size;
+    char *text = lsp_read_file(entry->path, &size);
+    if (text)
+      lsp_symbol_index_update_text(index, entry->file_uri, text, NULL,
+                                   (long)st.st_mtime);
+    free(text);
+    read++;
+  }
+
+  pthread_mutex_lock(&index->lock);
+  index->scan_next = next;
+  if (next >= registry->count)
+    index->scan_pending = false;
+  pending = index->scan_pending;
+  pthread_mutex_unlock(&index->lock);
+
+  if (!pending)
+    fprintf(stderr, "[LSP] Symbol index: %zu files, %zu names\n",
+            index->file_count, index->symbol_count);
+  return pending;
+}
+
+// ============================================================================
+// QUERIES
+// ============================================================================
+
+static int position_compare(LSPPosition a, LSPPosition b) {
+  if (a.line != b.line)
+    return a.line < b.line ? -1 : 1;
+  return a.character < b.character ? -1 : a.character > b.character;
+}
+
+// The symbol of the occurrence at `position` in the file, LSP_ATOM_NONE if
+// what's there isn't a top-level name
+size_t lsp_symbol_index_at(LSPSymbolIndex *index, const char *uri,
+                           LSPPosition position) {
+  pthread_mutex_lock(&index->lock);
+  size_t symbol = LSP_ATOM_NONE;
+  size_t f = lsp_atom_table_get(&index->file_by_uri, atom_find(uri));
+  if (f != LSP_ATOM_NONE) {
+    const LSPIndexedFile *file = &index->files[f];
+    // The last occurrence starting at or before it
+    size_t low = 0, high = file->count;
+    while (low < high) {
+      size_t mid = low + (high - low) / 2;
+      if (position_compare(file->occurrences[mid].range.start, position) <= 0)
+        low = mid + 1;
+      else
+        high = mid;
+    }
+    if (low > 0 &&
+        position_compare(position, file->occurrences[low - 1].range.end) < 0)
+      symbol = file->occurrences[low - 1].symbol;
+  }
+  pthread_mutex_unlock(&index->lock);
+  return symbol;
+}
+
+// The first of the file's by_symbol positions holding `symbol`
+static size_t first_of_symbol(const LSPIndexedFile *file, uint32_t symbol) {
+  size_t low = 0, high = file->count;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (file->occurrences[file->by_symbol[mid]].symbol < symbol)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+// Where `symbol` occurs, one file's occurrences after another in text
+// order: only its definitions with `definitions`, and only in `uri` unless
+// that is NULL. With `is_definition`, whether each is a definition too.
+LSPLocation *lsp_symbol_index_locations(LSPSymbolIndex *index, size_t symbol,
+                                        bool definitions, const char *uri,
+                                        size_t *count, bool **is_definition,
+                                        ArenaAllocator *arena) {
+  *count = 0;
+  GrowableArray locations, flags;
+  if (!growable_array_init(&locations, arena, 16, sizeof(LSPLocation)) ||
+      !growable_array_init(&flags, arena, 16, sizeof(bool)))
+    return NULL;
+  Atom only = uri ? atom_find(uri) : NULL;
+
+  pthread_mutex_lock(&index->lock);
+  bool ok = symbol < index->symbol_count && (!uri || only);
+  const LSPIndexedSymbol *entry = ok ? &index->symbols[symbol] : NULL;
+  for (size_t i = 0; ok && i < entry->file_count; i++) {
+    const LSPIndexedFile *file = &index->files[entry->files[i]];
+    if (only && file->uri != only)
+      continue;
+    for (size_t k = first_of_symbol(file, (uint32_t)symbol);
+         ok && k < file->count &&
+         file->occurrences[file->by_symbol[k]].symbol == symbol;
+         k++) {
+      const LSPSymbolOccurrence *occurrence =
+          &file->occurrences[file->by_symbol[k]];
+      if (definitions && !occurrence->definition)
+        continue;
+      LSPLocation *location = growable_array_push(&locations);
+      bool *flag = growable_array_push(&flags);
+      ok = location && flag;
+      if (ok) {
+        *location = (LSPLocation){file->uri, occurrence->range};
+        *flag = occurrence->definition;
+      }
+    }
+  }
+  pthread_mutex_unlock(&index->lock);
+
+  if (!ok || locations.count == 0)
+    return NULL;
+  *count = locations.count;
+  if (is_definition)
+    *is_definition = (bool *)flags.data;
+  return (LSPLocation *)locations.data;
+}
+
+static char fold(char c) {
+  return c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c;
+}
+
+// Compares case aside, the first `limit` characters at most
+static int compare_folded(const char *a, const char *b, size_t limit) {
+  for (size_t i = 0; i < limit; i++) {
+    char x = fold(a[i]), y = fold(b[i]);
+    if (x != y)
+      return (unsigned char)x < (unsigned char)y ? -1 : 1;
+    if (!x)
+      return 0;
+  }
+  return 0;
+}
+
+static const LSPIndexedSymbol *sort_symbols;
+
+static const char *word_text(const LSPIndexedSymbol *symbols,
+                             const LSPSymbolWord *word) {
+  return symbols[word->symbol].name + word->offset;
+}
+
+static int compare_words(const void *a, const void *b) {
+  return compare_folded(word_text(sort_symbols, a), word_text(sort_symbols, b),
+                        SIZE_MAX);
+}
+
+static bool word_starts(const char *name, size_t i) {
+  if (i == 0)
+    return true;
+  char c = name[i], before = name[i - 1];
+  if (before == '_')
+    return c != '_';
+  return c >= 'A' && c <= 'Z' && before >= 'a' && before <= 'z';
+}
+
+// Every word start of every defined name, sorted
+static void build_words(LSPSymbolIndex *index) {
+  free(index->words);
+  index->words = NULL;
+  index->word_count = 0;
+  size_t capacity = 0;
+
+  for (size_t s = 0; s < index->symbol_count; s++) {
+    const LSPIndexedSymbol *symbol = &index->symbols[s];
+    if (symbol->defined_in == 0)
+      continue;
+    for (size_t i = 0; symbol->name[i]; i++) {
+      if (!word_starts(symbol->name, i))
+        continue;
+      if (index->word_count == capacity) {
+        capacity = capacity ? capacity * 2 : 1024;
+        LSPSymbolWord *words =
+            realloc(index->words, capacity * sizeof(LSPSymbolWord));
+        if (!words)
+          return;
+        index->words = words;
+      }
+      index->words[index->word_count++] =
+          (LSPSymbolWord){(uint32_t)s, (uint32_t)i};
+    }
+  }
+
+  sort_symbols = index->symbols;
+  qsort(index->words, index->word_count, sizeof(LSPSymbolWord), compare_words);
+  index->words_stale = false;
+}
+
+// The first definition of the symbol, which is defined somewhere
+static bool first_definition(const LSPSymbolIndex *index, uint32_t symbol,
+                             LSPLocation *location) {
+  const LSPIndexedSymbol *entry = &index->symbols[symbol];
+  for (size_t i = 0; i < entry->file_count; i++) {
+    const LSPIndexedFile *file = &index->files[entry->files[i]];
+    for (size_t k = first_of_symbol(file, symbol);
+         k < file->count &&
+         file->occurrences[file->by_symbol[k]].symbol == symbol;
+         k++) {
+      const LSPSymbolOccurrence *occurrence =
+          &file->occurrences[file->by_symbol[k]];
+      if (occurrence->definition) {
+        *location = (LSPLocation){file->uri, occurrence->range};
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Defined names with a word starting with `query`, case aside (all of them
+// for an empty one), up to WORKSPACE_SYMBOL_PAGE
+LSPWorkspaceSymbol *lsp_symbol_index_search(LSPSymbolIndex *index,
+                                            const char *query, size_t *count,
+                                            ArenaAllocator *arena) {
+  *count = 0;
+  if (!query)
+    query = "";
+  size_t length = strlen(query);
+  GrowableArray found, symbols;
+  if (!growable_array_init(&found, arena, 32, sizeof(LSPWorkspaceSymbol)) ||
+      !growable_array_init(&symbols, arena, 32, sizeof(uint32_t)))
+    return NULL;
+  const uint32_t *seen = NULL;
+
+  pthread_mutex_lock(&index->lock);
+  if (index->words_stale || !index->words)
+    build_words(index);
+
+  size_t low = 0, high = index->word_count;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (compare_folded(word_text(index->symbols, &index->words[mid]), query,
+                       length) < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  for (size_t i = low; i < index->word_count && found.count <
+                                                    WORKSPACE_SYMBOL_PAGE;
+       i++) {
+    const LSPSymbolWord *word = &index->words[i];
+    if (compare_folded(word_text(index->symbols, word), query, length) != 0)
+      break;
+    if (length == 0 && word->offset != 0)
+      continue;
+
+    // A name matching through two of its words is listed once
+    const LSPIndexedSymbol *symbol = &index->symbols[word->symbol];
+    bool duplicate = false;
+    for (size_t j = 0; j < found.count && !duplicate; j++)
+      duplicate = seen[j] == word->symbol;
+    LSPLocation location;
+    if (duplicate || !first_definition(index, word->symbol, &location))
+      continue;
+
+    uint32_t *mark = growable_array_push(&symbols);
+    LSPWorkspaceSymbol *out = growable_array_push(&found);
+    if (!mark || !out)
+      break;
+    *mark = word->symbol;
+    seen = (const uint32_t *)symbols.data;
+    *out = (LSPWorkspaceSymbol){
+        .name = symbol->name,
+        .kind = symbol->kind,
+        .location = location,
+        .container = symbol->module_name,
+    };
+  }
+  pthread_mutex_unlock(&index->lock);
+
+  *count = found.count;
+  return found.count ? (LSPWorkspaceSymbol *)found.data : NULL;
+}
@@ -50,8 +50,7 @@ LSPDocumentSymbol **lsp_document_symbols(LSPDocument *doc,
 
   *symbol_count = 0;
 
-  if (!doc->scope || !doc->scope->symbols.data ||
-      doc->scope->symbols.count == 0) {
+  if (!doc->scope || doc->scope->symbols.count == 0) {
     return NULL;
   }
 
@@ -67,14 +66,13 @@ LSPDocumentSymbol **lsp_document_symbols(LSPDocument *doc,
   size_t out = 0;
 
   for (size_t i = 0; i < count; i++) {
-    Symbol *sym = (Symbol *)((char *)doc->scope->symbols.data +
-                             i * sizeof(Symbol));
+    Symbol *sym = scope_symbol(doc->scope, i);
 
     if (!sym || !sym->name)
       continue;
 
-    // Skip internal/compiler-generated symbols
-    if (strncmp(sym->name, "__", 2) == 0)
+    // Skip internal/compiler-generated symbols, generic instances included
+    if (strncmp(sym->name, "__", 2) == 0 || strchr(sym->name, '<'))
       continue;
 
     LSPDocumentSymbol *dsym =
@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "../ast/ast_utils.h"
+#include "../c_libs/error/error.h"
+#include "lsp.h"
+
+// The statement arena starts over with a full parse once this many times
+// the document's tokens were parsed into it, most of them for statements
+// that have since been replaced
+#define SYNTAX_GARBAGE_FACTOR 4
+
+void lsp_syntax_init(LSPSyntax *syntax) {
+  memset(syntax, 0, sizeof(*syntax));
+  arena_allocator_init(&syntax->token_arenas[0], 256 * 1024);
+  arena_allocator_init(&syntax->token_arenas[1], 256 * 1024);
+  arena_allocator_init(&syntax->ast_arenas[0], 1024 * 1024);
+  arena_allocator_init(&syntax->ast_arenas[1], 1024 * 1024);
+  syntax->ast_published = -1;
+}
+
+void lsp_syntax_free(LSPSyntax *syntax) {
+  arena_destroy(&syntax->token_arenas[0]);
+  arena_destroy(&syntax->token_arenas[1]);
+  arena_destroy(&syntax->ast_arenas[0]);
+  arena_destroy(&syntax->ast_arenas[1]);
+  memset(syntax, 0, sizeof(*syntax));
+}
+
+// The statements were changed in a way parsing only the edits again
+// wouldn't undo (instances of generics were added to the module); the next
+// analysis parses the whole document
+void lsp_syntax_forget(LSPSyntax *syntax) { syntax->valid = false; }
+
+// Index of the statement holding token `index`: the last one starting at
+// or before it, or the first one
+static size_t decl_holding(const LSPSyntax *syntax, size_t index) {
+  size_t lo = 0, hi = syntax->decl_count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (syntax->decls[mid].first_token <= index)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo ? lo - 1 : 0;
+}
+
+static bool push_decl(GrowableArray *decls, AstNode *node,
+                      size_t first_token) {
+  LSPDecl *slot = growable_array_push(decls);
+  if (!slot)
+    return false;
+  *slot = (LSPDecl){node, first_token};
+  return true;
+}
+
+// Whether the module declaration is as it was. The relexing may start in
+// it since the lexer looks past a token's end; then `relexed` is moved to
+// after it.
+static bool same_header(const TokenBuffer *tokens, const TokenBuffer *old,
+                        size_t header_tokens, TokenRelex *relexed) {
+  if (relexed->first >= header_tokens)
+    return true;
+  if (relexed->end < header_tokens)
+    return false;
+  for (size_t i = relexed->first; i < header_tokens; i++) {
+    if (tokens->offsets[i] != old->offsets[i] ||
+        tokens->kinds[i] != old->kinds[i] ||
+        tokens->lengths[i] != old->lengths[i])
+      return false;
+  }
+  relexed->first = header_tokens;
+  return true;
+}
+
+// Whether old statement `old_index` can stand for the one at new token
+// `index`, which must be past the edit. Its nodes keep their columns, so its
+// first line has to start the same distance before it; `delta` receives how
+// many lines it moved.
+static bool can_reuse(const TokenBuffer *tokens, size_t index,
+                      const TokenBuffer *old, size_t old_index, long *delta) {
+  Token now = token_buffer_get(tokens, index, NULL);
+  Token then = token_buffer_get(old, old_index, NULL);
+  if (now.col != then.col)
+    return false;
+  *delta = (long)now.line - (long)then.line;
+  return true;
+}
+
+// Parses a document's text into a program of its one module, allocated
+// from `arena` around statements that live as long as they are reused.
+// With a clean earlier parse, only the tokens around the edits since
+// (syntax->change) are lexed again, and only the statements holding them
+// are parsed again: the statements before them are kept, and so are the
+// ones from the first old statement that starts at a token the relexing
+// copied. Parse errors are left in the error list; `tokens` receives the
+// tokens unless lexing ran out of memory.
+AstNode *lsp_syntax_parse(LSPSyntax *syntax, const char *text,
+                          BuildConfig *config, ArenaAllocator *arena,
+                          const TokenBuffer **tokens) {
+  int next = !syntax->current;
+  ArenaAllocator *token_arena = &syntax->token_arenas[next];
+  TokenBuffer *buf = &syntax->buffers[next];
+  const TokenBuffer *old = &syntax->buffers[syntax->current];
+  *tokens = NULL;
+
+  arena_reset(token_arena);
+  TokenRelex relexed = {0};
+  bool incremental =
+      syntax->valid && syntax->parsed_tokens <=
+                           SYNTAX_GARBAGE_FACTOR * (old->count + 1024);
+  if (incremental) {
+    size_t length = strlen(text);
+    LSPTextSpan change = syntax->changed
+                             ? syntax->change
+                             : (LSPTextSpan){length, length, length};
+    if (!token_buffer_relex(buf, old, text, change.start,
+                            change.old_end, change.new_end, token_arena,
+                            &relexed))
+      return NULL;
+    incremental = same_header(buf, old, syntax->header_tokens, &relexed);
+  } else if (!token_buffer_lex(buf, text, token_arena)) {
+    return NULL;
+  }
+  *tokens = buf;
+
+  // Nodes count on fresh arena memory being zeroed, so the arena is made
+  // again rather than reset
+  if (!incremental) {
+    syntax->valid = false;
+    if (syntax->ast_current == syntax->ast_published)
+      syntax->ast_current = !syntax->ast_current;
+    arena_destroy(&syntax->ast_arenas[syntax->ast_current]);
+    arena_allocator_init(&syntax->ast_arenas[syntax->ast_current],
+                         1024 * 1024);
+    syntax->parsed_tokens = 0;
+  }
+
+  Parser parser;
+  parser_init(&parser, buf, &syntax->ast_arenas[syntax->ast_current], config);
+  GrowableArray decls;
+  if (!growable_array_init(&decls, token_arena, syntax->decl_count + 16,
+                           sizeof(LSPDecl)))
+    return NULL;
+
+  const char *module_name = syntax->module_name;
+  char *module_doc = syntax->module_doc;
+  int module_line = syntax->module_line;
+  int module_col = syntax->module_col;
+  size_t header_tokens = syntax->header_tokens;
+  size_t old_decl = 0;
+
+  if (incremental) {
+    old_decl = decl_holding(syntax, relexed.first - 1);
+    for (size_t i = 0; i < old_decl; i++) {
+      if (!push_decl(&decls, syntax->decls[i].node,
+                     syntax->decls[i].first_token))
+        return NULL;
+    }
+    parser.pos = old_decl < syntax->decl_count
+                     ? syntax->decls[old_decl].first_token
+                     : header_tokens;
+  } else {
+    Token module_tok = p_current(&parser);
+    module_doc = NULL;
+    module_name = parse_module_declaration(&parser, &module_doc);
+    if (!module_name)
+      return NULL;
+    module_line = module_tok.line;
+    module_col = module_tok.col;
+    header_tokens = parser.pos;
+  }
+
+  // Old statements from reuse_from on follow the new ones, moved by
+  // reuse_delta lines once the parse is known to have succeeded
+  size_t reuse_from = syntax->decl_count;
+  long reuse_delta = 0;
+  while (p_current(&parser).type_ != TOK_EOF) {
+    if (incremental && parser.pos >= relexed.end) {
+      size_t old_index = parser.pos - relexed.end + relexed.old_end;
+      while (old_decl < syntax->decl_count &&
+             syntax->decls[old_decl].first_token < old_index)
+        old_decl++;
+      if (old_decl < syntax->decl_count &&
+          syntax->decls[old_decl].first_token == old_index &&
+          can_reuse(buf, parser.pos, old, old_index, &reuse_delta)) {
+        reuse_from = old_decl;
+        break;
+      }
+    }
+
+    size_t first = parser.pos;
+    Stmt *stmt = parse_stmt(&parser);
+    if (!stmt)
+      return NULL;
+    syntax->parsed_tokens += parser.pos - first;
+    if (!push_decl(&decls, stmt, first))
+      return NULL;
+  }
+  if (error_get_count() > 0)
+    return NULL;
+
+  for (size_t i = reuse_from; incremental && i < syntax->decl_count; i++) {
+    const LSPDecl *decl = &syntax->decls[i];
+    if (reuse_delta)
+      ast_shift_lines(decl->node, reuse_delta);
+    if (!push_decl(&decls, decl->node,
+                   decl->first_token - relexed.old_end + relexed.end))
+      return NULL;
+  }
+
+  AstNode **body = arena_alloc(arena, (decls.count + 1) * sizeof(AstNode *),
+                               alignof(AstNode *));
+  AstNode **modules = arena_alloc(arena, sizeof(AstNode *),
+                                  alignof(AstNode *));
+  if (!body || !modules)
+    return NULL;
+  LSPDecl *parsed = (LSPDecl *)decls.data;
+  for (size_t i = 0; i < decls.count; i++)
+    body[i] = parsed[i].node;
+  modules[0] = create_module_node(arena, module_name, module_doc, 0, body,
+                                  decls.count, module_line, module_col);
+  if (!modules[0])
+    return NULL;
+
+  // This parse is the one the next edit is relative to
+  syntax->current = next;
+  syntax->valid = true;
+  syntax->decls = parsed;
+  syntax->decl_count = decls.count;
+  syntax->header_tokens = header_tokens;
+  syntax->module_name = module_name;
+  syntax->module_doc = module_doc;
+  syntax->module_line = module_line;
+  syntax->module_col = module_col;
+  syntax->changed = false;
+
+  return create_program_node(arena, modules, 1, 0, 0);
+}
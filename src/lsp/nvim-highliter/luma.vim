@@ -23,7 +23,7 @@ hi def lumaDocComment guifg=#8ec07c gui=italic
 " PREPROCESSORS & ATTRIBUTES
 " =====================
 syn match lumaPreprocessor /@\w\+/
-syn match lumaAttribute /#returns_ownership\|#takes_ownership\|#lib_import\(.*\)\|#dll_import\(.*\)/
+syn match lumaAttribute /#returns_ownership\|#takes_ownership\|#lib_import\(.*\)\|#dll_import\(.*\)\|#packed\|#align\(.*\)\|#reorder\|#unroll\(.*\)\|#vectorize\(.*\)\|#no_vectorize\|#independent\|#inline\|#noinline\|#hot\|#cold\|#pure\|#const\|#flatten\|#musttail/
 " @os, @module, @use, @link directives
 syn match lumaDirective /@module\|@use\|@os\|@link/
 hi def lumaPreprocessor guifg=#d3869b gui=bold
@@ -42,6 +42,7 @@ hi def lumaKeyword guifg=#fb4934 gui=bold
 " TYPES
 " =====================
 syn keyword lumaType int float double bool byte void uint
+syn match lumaType /\<vec\ze\s*</
 hi def lumaType guifg=#fabd2f gui=italic
 
 " =====================
@@ -115,6 +116,8 @@ hi def lumaTypeCast guifg=#fabd2f gui=italic
 " =====================
 syn keyword lumaBuiltinFunction output outputln alloc free sizeof cast
 syn keyword lumaBuiltinFunction input system
+" @memcpy, @clz, ... compiler builtins
+syn match lumaBuiltinFunction /@\(memcpy\|memmove\|memset\|clz\|ctz\|popcount\|bswap\|expect\|likely\|unlikely\|prefetch\|assume\|rdtsc\|black_box\|wrapping_add\|wrapping_sub\|wrapping_mul\|atomic_load\|atomic_store\|atomic_rmw\|atomic_cas\|fence\)\>/
 hi def lumaBuiltinFunction guifg=#fe8019 gui=bold,italic
 
 " =====================
@@ -22,7 +22,10 @@
  * ```
  */
 
+#include "ast/type_table.h"
+#include "c_libs/intern/intern.h"
 #include "c_libs/memory/memory.h"
+#include "c_libs/source/source.h"
 #include "helper/help.h"
 #include "lsp/lsp.h"
 
@@ -59,13 +62,15 @@ int main(int argc, char *argv[]) {
   }
 
   // Step 4: Ensure a source file was provided
-  if (!config.filepath) {
+  if (!config.filepath && config.format_paths.count == 0) {
     fprintf(stderr, "No source file provided.\n");
     return ARGC_ERROR;
   }
 
   // Step 6: Run build process
   bool success;
+  int exit_status = 0;
+  config.exit_status = &exit_status;
 
   if (config.format || config.format_check || config.format_in_place) {
     success = run_formatter(config, &allocator);
@@ -74,9 +79,15 @@ int main(int argc, char *argv[]) {
     success = run_build(config, &allocator);
   }
 
-  // Step 7: Clean up resources
+  // Step 7: Clean up resources; tokens point into the loaded sources and
+  // names are interned, so those go last
   arena_destroy(&allocator);
+  source_release_all();
+  type_table_release_all();
+  intern_release_all();
 
-  // Step 8: Return exit status
+  // Step 8: Return exit status (main's own under `luma run`)
+  if (success && config.jit_run)
+    return exit_status;
   return success ? 0 : 1;
 }
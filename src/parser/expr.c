@@ -18,6 +18,7 @@
  * - Grouping expressions with parentheses
  * - Array literal expressions
  * - Adder, Deref, Alloc, Free, Cast, Sizeof
+ * - Compiler builtins: @memcpy, @clz, @expect, ...
  *
  * All parsing functions follow the Pratt parser pattern, where expressions are
  * built recursively based on operator precedence (binding power). The functions
@@ -33,8 +34,78 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "../ast/ast_utils.h"
 #include "parser.h"
 
+// After a name, '<' opens type arguments only when everything up to the
+// matching '>' can be part of a type and a call, a struct literal or '::'
+// follows: max<int>(a, b), Box<int> { ... }, Vector<int>::create(). Anything
+// else, like a < b, stays a comparison.
+//
+// Builds parse from a TokenStream, which only keeps TOKEN_STREAM_WINDOW
+// tokens, so the scan stops short of pushing the current token out of it:
+// longer type argument lists aren't recognized.
+static bool type_args_ahead(Parser *parser) {
+  int depth = 0;
+  int brackets = 0;
+  for (size_t i = 0; i + 1 < TOKEN_STREAM_WINDOW; i++) {
+    switch (p_peek(parser, i).type_) {
+    case TOK_LT:
+      depth++;
+      break;
+    case TOK_GT:
+      depth--;
+      break;
+    case TOK_SHIFT_RIGHT:
+      depth -= 2;
+      break;
+    case TOK_IDENTIFIER:
+    case TOK_INT:
+    case TOK_UINT:
+    case TOK_DOUBLE:
+    case TOK_FLOAT:
+    case TOK_BOOL:
+    case TOK_VOID:
+    case TOK_CHAR:
+    case TOK_STAR:
+    case TOK_NUMBER:
+    case TOK_COMMA:
+    case TOK_RESOLVE:
+      break;
+    case TOK_LBRACKET:
+      brackets++;
+      break;
+    case TOK_RBRACKET:
+      brackets--;
+      break;
+    // Only an array type's [T; N] has a ';' inside type arguments; any other
+    // ends the statement
+    case TOK_SEMICOLON:
+      if (brackets <= 0)
+        return false;
+      break;
+    default:
+      return false;
+    }
+
+    if (depth < 0)
+      return false;
+    if (depth == 0) {
+      LumaTokenType next = p_peek(parser, i + 1).type_;
+      return next == TOK_LPAREN || next == TOK_LBRACE || next == TOK_RESOLVE;
+    }
+  }
+  return false;
+}
+
+// Parses the type arguments after a name when there are any
+static bool name_type_args(Parser *parser, AstNode ***args, size_t *count) {
+  if (p_current(parser).type_ != TOK_LT || !type_args_ahead(parser))
+    return true;
+  *args = type_args(parser, count);
+  return *args != NULL;
+}
+
 Expr *primary(Parser *parser) {
   int line = p_current(parser).line;
   int col = p_current(parser).col;
@@ -54,9 +125,10 @@ Expr *primary(Parser *parser) {
       *(double *)value = strtod(current.value, NULL);
       break;
     case LITERAL_STRING:
-      value = arena_alloc(parser->arena, strlen(get_name(parser)) + 1,
-                          alignof(char));
-      strcpy((char *)value, get_name(parser));
+      // String contents aren't names; create_literal_expr copies them
+      value = arena_alloc(parser->arena, current.length + 1, alignof(char));
+      memcpy(value, current.value, current.length);
+      ((char *)value)[current.length] = '\0';
       break;
     case LITERAL_CHAR:
       value = arena_alloc(parser->arena, sizeof(char), alignof(char));
@@ -67,7 +139,7 @@ Expr *primary(Parser *parser) {
       *(bool *)value = (current.type_ == TOK_TRUE);
       break;
     case LITERAL_IDENT:
-      value = get_name(parser); // Get the identifier name
+      value = (void *)get_name(parser); // Get the identifier name
       break;
     default:
       value = NULL; // Handle null or unsupported literal types
@@ -76,7 +148,12 @@ Expr *primary(Parser *parser) {
     p_advance(parser); // Consume the token
 
     if (lit_type == LITERAL_IDENT) {
-      return create_identifier_expr(parser->arena, (char *)value, line, col);
+      Expr *identifier =
+          create_identifier_expr(parser->arena, (char *)value, line, col);
+      if (!name_type_args(parser, &identifier->expr.identifier.type_args,
+                          &identifier->expr.identifier.type_arg_count))
+        return NULL;
+      return identifier;
     }
     return create_literal_expr(parser->arena, lit_type, value, line, col);
   }
@@ -91,7 +168,8 @@ Expr *unary(Parser *parser) {
   Token current = p_current(parser);
   UnaryOp op = TOKEN_TO_UNOP_MAP[current.type_];
 
-  if (op) {
+  // UNOP_NOT is 0, so a zero entry alone doesn't mean "not a unary operator"
+  if (op || current.type_ == TOK_BANG) {
     p_advance(parser);
     Expr *operand = parse_expr(parser, BP_UNARY);
     if (!operand) {
@@ -233,10 +311,17 @@ Expr *prefix_expr(Parser *parser, Expr *left, BindingPower bp) {
       return NULL;
     }
 
-    char *member = get_name(parser);
+    Atom member = get_name(parser);
     p_advance(parser); // Consume the identifier token
-    return create_member_expr(parser->arena, left, is_compiletime, member,
-                              op_token.line, op_token.col);
+    Expr *access = create_member_expr(parser->arena, left, is_compiletime,
+                                      member, op_token.line, op_token.col);
+
+    // module::Name<T>; methods after '.' aren't generic
+    if (is_compiletime &&
+        !name_type_args(parser, &access->expr.member.type_args,
+                        &access->expr.member.type_arg_count))
+      return NULL;
+    return access;
   }
 
   case TOK_PLUSPLUS:
@@ -369,7 +454,7 @@ Expr *struct_expr(Parser *parser) {
       return NULL;
     }
 
-    char *field_name = get_name(parser);
+    Atom field_name = get_name(parser);
     p_advance(parser); // Consume the field name
 
     p_consume(parser, TOK_COLON, "Expected ':' after field name");
@@ -395,7 +480,7 @@ Expr *struct_expr(Parser *parser) {
       return NULL;
     }
 
-    *name_slot = field_name;
+    *name_slot = (char *)field_name;
     *value_slot = field_value;
 
     // Handle comma separator
@@ -425,11 +510,16 @@ Expr *named_struct_expr(Parser *parser, Expr *left, BindingPower bp) {
   (void)bp; // Unused parameter
 
   char *struct_name = NULL;
+  AstNode **type_args = NULL;
+  size_t type_arg_count = 0;
+  const char *qualifier = NULL;
 
   // Handle both identifier and member expressions
   if (left->type == AST_EXPR_IDENTIFIER) {
     // Simple case: Point { ... }
     struct_name = left->expr.identifier.name;
+    type_args = left->expr.identifier.type_args;
+    type_arg_count = left->expr.identifier.type_arg_count;
   } else if (left->type == AST_EXPR_MEMBER) {
     // Namespace resolution: namespace::Point { ... }
     // Build the full qualified name from the member expression
@@ -443,6 +533,12 @@ Expr *named_struct_expr(Parser *parser, Expr *left, BindingPower bp) {
     // "namespace::Point")
     struct_name = left->expr.member.member;
 
+    // A generic's instance is found through the module it comes from
+    type_args = left->expr.member.type_args;
+    type_arg_count = left->expr.member.type_arg_count;
+    if (type_args && left->expr.member.object->type == AST_EXPR_IDENTIFIER)
+      qualifier = left->expr.member.object->expr.identifier.name;
+
     // Note: If you need the full qualified name, you'll need to traverse
     // the member expression tree and build the complete path
     // For example: if left->expr.member.object is also a member expr,
@@ -520,7 +616,7 @@ Expr *named_struct_expr(Parser *parser, Expr *left, BindingPower bp) {
       return NULL;
     }
 
-    char *field_name = get_name(parser);
+    Atom field_name = get_name(parser);
     p_advance(parser); // Consume the field name
 
     p_consume(parser, TOK_COLON, "Expected ':' after field name");
@@ -546,7 +642,7 @@ Expr *named_struct_expr(Parser *parser, Expr *left, BindingPower bp) {
       return NULL;
     }
 
-    *name_slot = field_name;
+    *name_slot = (char *)field_name;
     *value_slot = field_value;
 
     // Handle comma separator
@@ -565,9 +661,15 @@ Expr *named_struct_expr(Parser *parser, Expr *left, BindingPower bp) {
 
   // Store the full expression (identifier or member) for later use
   // This allows the semantic analyzer to resolve the namespace properly
-  return create_struct_expr(
+  Expr *literal = create_struct_expr(
       parser->arena, struct_name, (char **)field_names.data,
       (AstNode **)field_values.data, field_names.count, line, col);
+  if (literal) {
+    literal->expr.struct_expr.type_args = type_args;
+    literal->expr.struct_expr.type_arg_count = type_arg_count;
+    literal->expr.struct_expr.qualifier = qualifier;
+  }
+  return literal;
 }
 
 Expr *deref_expr(Parser *parser) {
@@ -633,9 +735,9 @@ Expr *cast_expr(Parser *parser) {
   Type *cast_type = parse_type(parser);
   // parse_type() has already advanced past the type
 
-  p_consume(parser, TOK_GT,
-            "Expected a '>' after defining the type you want to cast to, but "
-            "before defining what you are casting");
+  p_consume_angle_close(
+      parser, "Expected a '>' after defining the type you want to cast to, but "
+              "before defining what you are casting");
 
   p_consume(parser, TOK_LPAREN,
             "Expected a '(' before defining what you are casting");
@@ -661,8 +763,8 @@ Expr *input_expr(Parser *parser) {
   Type *type = parse_type(parser);
   // parse_type() has already advanced past the type
 
-  p_consume(parser, TOK_GT,
-            "Expected a '>' after defining the type you want to input");
+  p_consume_angle_close(
+      parser, "Expected a '>' after defining the type you want to input");
 
   p_consume(parser, TOK_LPAREN,
             "Expected a '(' before defining the input message");
@@ -738,6 +840,76 @@ Expr *syscall_expr(Parser *parser) {
 
 // size_t sizeof(TYPE);
 // sizeof<int>         Compile-time constant
+// @memcpy(dest, src, n), @clz(x), @likely(cond), ...
+// The lexer only produces TOK_BUILTIN for known names; @memcpy builds the
+// memcpy node, the rest a builtin node with their arguments
+Expr *builtin_expr(Parser *parser) {
+  Token name = p_current(parser);
+  int line = name.line;
+  int col = name.col;
+  p_advance(parser);
+
+  p_consume(parser, TOK_LPAREN, "Expected '(' after builtin name");
+
+  GrowableArray args;
+  if (!growable_array_init(&args, parser->arena, 3, sizeof(Expr *))) {
+    parser_error(parser, "SyntaxError", parser->file_path,
+                 "Internal error: failed to initialize builtin arguments",
+                 line, col, 0);
+    return NULL;
+  }
+
+  while (p_current(parser).type_ != TOK_RPAREN &&
+         p_current(parser).type_ != TOK_EOF) {
+    Expr *arg = parse_expr(parser, BP_NONE);
+    if (!arg) {
+      parser_error(parser, "SyntaxError", parser->file_path,
+                   "Expected expression inside builtin argument list",
+                   p_current(parser).line, p_current(parser).col,
+                   p_current(parser).length);
+      return NULL;
+    }
+
+    Expr **slot = (Expr **)growable_array_push(&args);
+    if (!slot) {
+      parser_error(parser, "SyntaxError", parser->file_path,
+                   "Internal error: out of memory growing builtin arguments",
+                   p_current(parser).line, p_current(parser).col, 0);
+      return NULL;
+    }
+    *slot = arg;
+
+    if (p_current(parser).type_ != TOK_COMMA)
+      break;
+    p_advance(parser);
+  }
+  p_consume(parser, TOK_RPAREN, "Expected ')' after builtin arguments");
+
+  Expr **arg_list = (Expr **)args.data;
+  if (name.length == 7 && strncmp(name.value, "@memcpy", 7) == 0) {
+    if (args.count != 3) {
+      parser_error(parser, "SyntaxError", parser->file_path,
+                   "@memcpy takes (dest, src, n)", line, col, name.length);
+      return NULL;
+    }
+    return create_memcpy_expr(parser->arena, arg_list[0], arg_list[1],
+                              arg_list[2], line, col);
+  }
+
+  for (BuiltinKind kind = BUILTIN_MEMMOVE; kind <= BUILTIN_FENCE; kind++) {
+    const char *builtin = builtin_to_string(kind);
+    if ((size_t)name.length == strlen(builtin) &&
+        strncmp(name.value, builtin, name.length) == 0) {
+      return create_builtin_expr(parser->arena, kind, arg_list, args.count,
+                                 line, col);
+    }
+  }
+
+  parser_error(parser, "SyntaxError", parser->file_path, "Unknown builtin",
+               line, col, name.length);
+  return NULL;
+}
+
 // sizeof<[10]int>     Compile-time constant
 // sizeof<[n]int>      Runtime when n is variable
 // sizeof<MyStruct>    Compile-time constant
@@ -766,9 +938,9 @@ Expr *sizeof_expr(Parser *parser) {
     is_type = false;
   }
 
-  p_consume(parser, TOK_GT,
-            "Expected a '>' after defining the var or type you want to get the "
-            "size of.");
+  p_consume_angle_close(parser,
+                        "Expected a '>' after defining the var or type you "
+                        "want to get the size of.");
 
   return create_sizeof_expr(parser->arena, object, is_type, line, col);
 }
\ No newline at end of file
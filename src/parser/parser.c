@@ -19,6 +19,7 @@
  */
 
 #include <stdalign.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #include "../ast/ast.h"
@@ -48,13 +49,17 @@
 void parser_error(Parser *psr, const char *error_type, const char *file,
                   const char *msg, int line, int col, int tk_length) {
   (void)file;
+  // Whatever fails to parse after a lexer error is a consequence of it
+  if (psr->stream && psr->stream->failed)
+    return;
+
   ErrorInformation err = {
       .error_type = error_type,
       .file_path = psr->file_path,
       .message = msg,
       .line = line,
       .col = col,
-      .line_text = generate_line(psr->arena, psr->tks, psr->tk_count, err.line),
+      .line_text = generate_line(psr->arena, psr->lines, line),
       .token_length = tk_length,
       .label = "Parser Error",
       .note = NULL,
@@ -64,61 +69,30 @@ void parser_error(Parser *psr, const char *error_type, const char *file,
 }
 
 /**
- * @brief Main parsing function that converts tokens into an AST
+ * @brief Parses the module declaration and every statement of one file
  *
- * This is the entry point for the parser. It takes a growable array of tokens
- * and converts them into a complete program AST node containing all parsed
- * statements.
+ * Shared by parse() and parse_stream(); the parser reads its tokens through
+ * p_current()/p_advance() either way.
  *
- * @param tks Growable array containing all tokens from the lexer
- * @param arena Arena allocator for memory management during parsing
+ * @param parser Parser set up over a token buffer or a token stream
  *
  * @return Pointer to the root AST node (Program node) containing all parsed
  * statements, or NULL if parsing fails
  *
- * @note The function estimates the initial capacity for statements based on
- * token count
- * @note All memory allocations use the provided arena allocator
- *
  * @see Parser, parse_stmt(), create_program_node()
  */
-
-/**
- * @brief Main parsing function that converts tokens into an AST
- *
- * This is the entry point for the parser. It takes a growable array of tokens
- * and converts them into a complete program AST node containing all parsed
- * statements.
- */
-
-Stmt *parse(GrowableArray *tks, ArenaAllocator *arena, BuildConfig *config) {
-  // Initialize parser
-  Parser parser = {
-      .file_path = config->filepath,
-      .arena = arena,
-      .tks = (Token *)tks->data,
-      .tk_count = tks->count,
-      .capacity = (tks->count / 4) + 10,
-      .pos = 0,
-  };
-
-  if (!parser.tks) {
-    parser_error(&parser, "SyntaxError", parser.file_path,
-                 "Internal error: failed to get tokens from token array", 0, 0,
-                 0);
-    return NULL;
-  }
-
+static Stmt *parse_program(Parser *parser) {
   // Initialize arrays
-  GrowableArray stmts, modules;
-  if (!init_parser_arrays(&parser, &stmts, &modules)) {
+  ChunkedArray stmts;
+  GrowableArray modules;
+  if (!init_parser_arrays(parser, &stmts, &modules)) {
     return NULL;
   }
 
   // Parse module declaration
   char *module_doc = NULL;
-  Token module_tok = p_current(&parser);
-  const char *module_name = parse_module_declaration(&parser, &module_doc);
+  Token module_tok = p_current(parser);
+  const char *module_name = parse_module_declaration(parser, &module_doc);
   if (!module_name) {
     error_report();
     return NULL;
@@ -127,7 +101,7 @@ Stmt *parse(GrowableArray *tks, ArenaAllocator *arena, BuildConfig *config) {
   // Create module node with doc comment
   // Signature: create_module_node(arena, name, doc_comment, potions, body,
   // body_count, line, column)
-  Stmt *module_stmt = create_module_node(parser.arena, module_name,
+  Stmt *module_stmt = create_module_node(parser->arena, module_name,
                                          module_doc, // doc_comment parameter
                                          0,          // potions
                                          NULL,       // body (initially NULL)
@@ -136,27 +110,27 @@ Stmt *parse(GrowableArray *tks, ArenaAllocator *arena, BuildConfig *config) {
 
   Stmt **module_slot = (Stmt **)growable_array_push(&modules);
   if (!module_slot) {
-    parser_error(&parser, "SyntaxError", parser.file_path,
+    parser_error(parser, "SyntaxError", parser->file_path,
                  "Internal error: out of memory growing modules array",
-                 p_current(&parser).line, p_current(&parser).col, 0);
+                 p_current(parser).line, p_current(parser).col, 0);
     return NULL;
   }
   *module_slot = module_stmt;
 
   // Parse all statements
-  while (p_current(&parser).type_ != TOK_EOF) {
-    Stmt *stmt = parse_stmt(&parser);
+  while (p_current(parser).type_ != TOK_EOF) {
+    Stmt *stmt = parse_stmt(parser);
     if (!stmt) {
       // CRITICAL: Report accumulated errors before returning
       error_report();
       return NULL;
     }
 
-    Stmt **slot = (Stmt **)growable_array_push(&stmts);
+    Stmt **slot = (Stmt **)chunked_array_push(&stmts);
     if (!slot) {
-      parser_error(&parser, "SyntaxError", parser.file_path,
+      parser_error(parser, "SyntaxError", parser->file_path,
                    "Internal error: out of memory growing statements array",
-                   p_current(&parser).line, p_current(&parser).col, 0);
+                   p_current(parser).line, p_current(parser).col, 0);
       error_report();
       return NULL;
     }
@@ -164,18 +138,95 @@ Stmt *parse(GrowableArray *tks, ArenaAllocator *arena, BuildConfig *config) {
   }
 
   // Update module with parsed statements
-  *module_slot = create_module_node(parser.arena, module_name,
+  Stmt **body = (Stmt **)chunked_array_flatten(&stmts, parser->arena);
+  if (stmts.count > 0 && !body) {
+    parser_error(parser, "SyntaxError", parser->file_path,
+                 "Internal error: out of memory collecting statements",
+                 module_tok.line, module_tok.col, 0);
+    error_report();
+    return NULL;
+  }
+  *module_slot = create_module_node(parser->arena, module_name,
                                     module_doc, // doc_comment parameter
                                     0,          // potions
-                                    (Stmt **)stmts.data, // body
-                                    stmts.count,         // body_count
+                                    body,         // body
+                                    stmts.count,  // body_count
                                     module_tok.line, module_tok.col);
 
   // Create and return program node
-  return create_program_node(parser.arena, (AstNode **)modules.data,
+  return create_program_node(parser->arena, (AstNode **)modules.data,
                              modules.count, 0, 0);
 }
 
+/**
+ * @brief Main parsing function that converts tokens into an AST
+ *
+ * This is the entry point for the parser when the whole file has been lexed
+ * up front. It takes the token buffer of a file and converts it into a
+ * complete program AST node containing all parsed statements.
+ *
+ * @param tokens Token buffer holding all tokens from the lexer
+ * @param arena Arena allocator for memory management during parsing
+ *
+ * @note The function estimates the initial capacity for statements based on
+ * token count
+ */
+void parser_init(Parser *parser, const TokenBuffer *tokens,
+                 ArenaAllocator *arena, BuildConfig *config) {
+  *parser = (Parser){
+      .file_path = config->filepath,
+      .arena = arena,
+      .tokens = tokens,
+      .lines = &tokens->lines,
+      .tk_count = tokens->count,
+      .line_hint = 0,
+      .capacity = (tokens->count / 4) + 10,
+      .pos = 0,
+  };
+}
+
+Stmt *parse(const TokenBuffer *tokens, ArenaAllocator *arena,
+            BuildConfig *config) {
+  Parser parser;
+  parser_init(&parser, tokens, arena, config);
+
+  if (!tokens->kinds) {
+    parser_error(&parser, "SyntaxError", parser.file_path,
+                 "Internal error: failed to get tokens from token array", 0, 0,
+                 0);
+    return NULL;
+  }
+
+  return parse_program(&parser);
+}
+
+/**
+ * @brief Parses a file while it is being lexed
+ *
+ * Tokens are pulled from @p stream as the parser reaches them, so only a
+ * small window of them exists at any time. The token count isn't known in
+ * advance; the statement capacity is estimated from the source length
+ * instead (about one token per five bytes).
+ *
+ * @param stream Token stream positioned at the start of the file
+ * @param arena Arena allocator for memory management during parsing
+ */
+Stmt *parse_stream(TokenStream *stream, ArenaAllocator *arena,
+                   BuildConfig *config) {
+  Parser parser = {
+      .file_path = config->filepath,
+      .arena = arena,
+      .stream = stream,
+      .lines = &stream->lines,
+      .tk_count = SIZE_MAX,
+      .line_hint = 0,
+      .capacity = (stream->lines.length / 20) + 10,
+      .pos = 0,
+  };
+
+  return parse_program(&parser);
+}
+
 /**
  * @brief Gets the binding power (precedence) for a given token type
  *
@@ -333,6 +384,8 @@ Expr *nud(Parser *parser) {
     return system_expr(parser);
   case TOK_SYSCALL:
     return syscall_expr(parser);
+  case TOK_BUILTIN:
+    return builtin_expr(parser);
 
   // Compile time
   case TOK_SIZE_OF:
@@ -472,13 +525,71 @@ Stmt *parse_stmt(Parser *parser) {
   const char *lib_name = NULL;
   const char *dll_name = NULL;
   const char *dll_callconv = NULL;
-
-  while (p_current(parser).type_ == TOK_RETURNES_OWNERSHIP ||
+  bool is_packed = false;
+  bool reorder_fields = false;
+  size_t alignment = 0;
+  bool unroll = false;
+  bool vectorize = false;
+  bool no_vectorize = false;
+  bool independent = false;
+  bool musttail = false;
+  size_t unroll_count = 0;
+  size_t vectorize_width = 0;
+  unsigned fn_attributes = 0;
+
+  while (function_attribute(p_current(parser).type_) ||
+         p_current(parser).type_ == TOK_RETURNES_OWNERSHIP ||
          p_current(parser).type_ == TOK_TAKES_OWNERSHIP ||
          p_current(parser).type_ == TOK_DLL_IMPORT ||
-         p_current(parser).type_ == TOK_LIB_IMPORT) {
+         p_current(parser).type_ == TOK_LIB_IMPORT ||
+         p_current(parser).type_ == TOK_PACKED ||
+         p_current(parser).type_ == TOK_ALIGN ||
+         p_current(parser).type_ == TOK_REORDER ||
+         p_current(parser).type_ == TOK_UNROLL ||
+         p_current(parser).type_ == TOK_VECTORIZE ||
+         p_current(parser).type_ == TOK_NO_VECTORIZE ||
+         p_current(parser).type_ == TOK_INDEPENDENT ||
+         p_current(parser).type_ == TOK_MUSTTAIL) {
+
+    if (function_attribute(p_current(parser).type_)) {
+      fn_attributes |= function_attribute(p_current(parser).type_);
+      p_advance(parser);
+
+    } else if (p_current(parser).type_ == TOK_UNROLL) {
+      unroll = true;
+      if (!loop_hint_count(parser, "#unroll", &unroll_count))
+        return NULL;
+
+    } else if (p_current(parser).type_ == TOK_VECTORIZE) {
+      vectorize = true;
+      if (!loop_hint_count(parser, "#vectorize", &vectorize_width))
+        return NULL;
+
+    } else if (p_current(parser).type_ == TOK_NO_VECTORIZE) {
+      no_vectorize = true;
+      p_advance(parser);
+
+    } else if (p_current(parser).type_ == TOK_INDEPENDENT) {
+      independent = true;
+      p_advance(parser);
+
+    } else if (p_current(parser).type_ == TOK_MUSTTAIL) {
+      musttail = true;
+      p_advance(parser);
+
+    } else if (p_current(parser).type_ == TOK_PACKED) {
+      is_packed = true;
+      p_advance(parser);
+
+    } else if (p_current(parser).type_ == TOK_REORDER) {
+      reorder_fields = true;
+      p_advance(parser);
+
+    } else if (p_current(parser).type_ == TOK_ALIGN) {
+      if (!align_attribute(parser, &alignment))
+        return NULL;
 
-    if (p_current(parser).type_ == TOK_RETURNES_OWNERSHIP) {
+    } else if (p_current(parser).type_ == TOK_RETURNES_OWNERSHIP) {
       returns_ownership = true;
       p_advance(parser);
 
@@ -515,7 +626,7 @@ Stmt *parse_stmt(Parser *parser) {
           return NULL;
         }
 
-        char *kw = get_name(parser);
+        Atom kw = get_name(parser);
         p_advance(parser); // consume option name
 
         if (strcmp(kw, "callconv") != 0) {
@@ -671,6 +782,55 @@ Stmt *parse_stmt(Parser *parser) {
     apply_lib_import(node, lib_name);
   }
 
+  if (node && fn_attributes &&
+      !apply_function_attributes(parser, node, fn_attributes))
+    return NULL;
+
+  if (node && (is_packed || reorder_fields || alignment != 0)) {
+    if (node->type != AST_STMT_STRUCT) {
+      parser_error(parser, "SyntaxError", parser->file_path,
+                   "#packed, #align and #reorder can only be applied to "
+                   "struct declarations",
+                   node->line, node->column, 0);
+      return NULL;
+    }
+    node->stmt.struct_decl.is_packed = is_packed;
+    node->stmt.struct_decl.reorder_fields = reorder_fields;
+    node->stmt.struct_decl.alignment = alignment;
+  }
+
+  if (node && (unroll || vectorize || no_vectorize || independent)) {
+    if (node->type != AST_STMT_LOOP) {
+      parser_error(parser, "SyntaxError", parser->file_path,
+                   "#unroll, #vectorize, #no_vectorize and #independent can "
+                   "only be applied to loops",
+                   node->line, node->column, 0);
+      return NULL;
+    }
+    if (vectorize && no_vectorize) {
+      parser_error(parser, "SyntaxError", parser->file_path,
+                   "A loop can't be both #vectorize and #no_vectorize",
+                   node->line, node->column, 0);
+      return NULL;
+    }
+    node->stmt.loop_stmt.unroll = unroll;
+    node->stmt.loop_stmt.unroll_count = unroll_count;
+    node->stmt.loop_stmt.vectorize = vectorize;
+    node->stmt.loop_stmt.vectorize_width = vectorize_width;
+    node->stmt.loop_stmt.no_vectorize = no_vectorize;
+    node->stmt.loop_stmt.independent = independent;
+  }
+
+  if (node && musttail) {
+    if (node->type != AST_STMT_RETURN) {
+      parser_error(parser, "SyntaxError", parser->file_path,
+                   "#musttail can only be applied to return statements",
+                   node->line, node->column, 0);
+      return NULL;
+    }
+    node->stmt.return_stmt.musttail = true;
+  }
+
   return node;
 }
 
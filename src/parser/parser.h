@@ -21,6 +21,7 @@
 #include <stddef.h>
 
 #include "../ast/ast.h"
+#include "../c_libs/intern/intern.h"
 #include "../c_libs/memory/memory.h"
 #include "../helper/help.h"
 #include "../lexer/lexer.h"
@@ -44,6 +45,9 @@
 #define MAX_EXPR 1024
 #define MAX_TYPE 1024
 
+#define PARSER_SPAN_FNV_OFFSET 0xcbf29ce484222325ULL
+#define PARSER_SPAN_FNV_PRIME 0x100000001b3ULL
+
 /**
  * @enum BindingPower
  * @brief Binding power (precedence) levels for expression parsing.
@@ -116,11 +120,24 @@ static const UnaryOp TOKEN_TO_UNOP_MAP[] = {
 typedef struct {
   const char *file_path;
   ArenaAllocator *arena;
-  Token *tks;
+  const TokenBuffer *tokens; // NULL when reading from stream
+  TokenStream *stream;       // NULL when reading from tokens
+  const LineTable *lines;
   size_t tk_count;
+  size_t line_hint; // Line of the last materialized token (token_buffer_get)
   size_t capacity;
   size_t pos;
   char *pending_doc_comment; // NEW: Doc comment waiting to be attached
+
+  // Tokens consumed since the current span began (see fn_stmt)
+  bool in_span;
+  int span_line;
+  uint64_t span_digest;
+
+  // A vector type or type argument list closed on the first '>' of a '>>'
+  // (cast<vec<int, 4>>, Vector<Box<int>>); the second one is still to be
+  // consumed (see p_consume_angle_close)
+  bool split_shift;
 } Parser;
 
 /**
@@ -144,22 +161,48 @@ Token p_peek(Parser *psr, size_t offset);
 Token p_current(Parser *psr);
 Token p_advance(Parser *psr);
 Token p_consume(Parser *psr, LumaTokenType type, const char *error_msg);
-char *get_name(Parser *psr);
+Token p_consume_angle_close(Parser *psr, const char *error_msg);
+void parser_span_fold(Parser *psr, Token tk);
+Atom get_name(Parser *psr);
+
+/**
+ * @brief Sets @p parser up at the first token of @p tokens.
+ *
+ * For callers that drive parse_module_declaration() and parse_stmt()
+ * themselves, such as the language server reparsing part of a file; move
+ * @c pos to start elsewhere.
+ */
+void parser_init(Parser *parser, const TokenBuffer *tokens,
+                 ArenaAllocator *arena, BuildConfig *config);
 
 /**
  * @brief Parses a full program from tokens into an AST of statements.
  *
- * @param tks GrowableArray containing tokens.
+ * @param tokens Lexed tokens of one file.
+ * @param arena Memory arena for allocations.
+ * @return Pointer to the root AST statement node (program).
+ */
+Stmt *parse(const TokenBuffer *tokens, ArenaAllocator *arena,
+            BuildConfig *config);
+
+/**
+ * @brief Parses a full program, lexing it on demand through @p stream.
+ *
+ * Lexer errors surface as they are reached, so check error_report() even
+ * when this succeeds.
+ *
+ * @param stream Initialized token stream of one file.
  * @param arena Memory arena for allocations.
  * @return Pointer to the root AST statement node (program).
  */
-Stmt *parse(GrowableArray *tks, ArenaAllocator *arena, BuildConfig *config);
+Stmt *parse_stream(TokenStream *stream, ArenaAllocator *arena,
+                   BuildConfig *config);
 Expr *parse_expr(Parser *parser, BindingPower bp);
 Stmt *parse_stmt(Parser *parser);
 Type *parse_type(Parser *parser);
 
 // Helper functions for the parser
-bool init_parser_arrays(Parser *parser, GrowableArray *stmts,
+bool init_parser_arrays(Parser *parser, ChunkedArray *stmts,
                         GrowableArray *modules);
 const char *parse_module_declaration(Parser *parser, char **out_module_doc);
 
@@ -194,6 +237,7 @@ Expr *cast_expr(Parser *parser);
 Expr *input_expr(Parser *parser);
 Expr *system_expr(Parser *parser);
 Expr *syscall_expr(Parser *parser);
+Expr *builtin_expr(Parser *parser);
 Expr *sizeof_expr(Parser *parser);
 Expr *struct_expr(Parser *parser);
 Expr *named_struct_expr(Parser *parser, Expr *left, BindingPower bp);
@@ -204,7 +248,9 @@ BindingPower tget_bp(Parser *parser, LumaTokenType kind);
 
 Type *pointer(Parser *parser);
 Type *array_type(Parser *parser);
+Type *vector_type(Parser *parser);
 Type *function_type(Parser *parser, Type *return_type);
+AstNode **type_args(Parser *parser, size_t *count);
 
 Stmt *use_stmt(Parser *parser);
 Stmt *os_stmt(Parser *parser);
@@ -217,6 +263,11 @@ Stmt *fn_stmt(Parser *parser, const char *name, bool is_public,
               bool is_static, bool returns_ownership, bool takes_ownership);
 Stmt *enum_stmt(Parser *parser, const char *name, bool is_public);
 Stmt *struct_stmt(Parser *parser, const char *name, bool is_public);
+bool type_params(Parser *parser, char ***params, size_t *count);
+bool align_attribute(Parser *parser, size_t *alignment);
+bool loop_hint_count(Parser *parser, const char *attribute, size_t *count);
+unsigned function_attribute(LumaTokenType type);
+bool apply_function_attributes(Parser *parser, Stmt *fn, unsigned attributes);
 Stmt *print_stmt(Parser *parser, bool ln);
 Stmt *return_stmt(Parser *parser);
 Stmt *block_stmt(Parser *parser);
@@ -11,7 +11,7 @@
  * - Token stream navigation (current, peek, advance)
  * - Token consumption with error reporting
  * - Token validation and bounds checking
- * - String extraction and memory management for identifiers
+ * - Name interning for identifiers
  *
  * All functions are designed to be safe and handle edge cases like
  * end-of-stream conditions gracefully by returning EOF tokens.
@@ -45,7 +45,23 @@
  * @see p_current(), p_advance()
  */
 bool p_has_tokens(Parser *psr) {
-  return (psr->pos < psr->tk_count && psr->tks[psr->pos].type_ != TOK_EOF);
+  if (psr->stream)
+    return token_stream_get(psr->stream, psr->pos).type_ != TOK_EOF;
+  return (psr->pos < psr->tk_count &&
+          psr->tokens->kinds[psr->pos] != TOK_EOF);
+}
+
+/**
+ * @internal
+ * @brief Token @p index from whichever source the parser reads, or an EOF
+ * token past the end.
+ */
+static Token token_at(Parser *psr, size_t index) {
+  if (psr->stream)
+    return token_stream_get(psr->stream, index);
+  return index < psr->tk_count
+             ? token_buffer_get(psr->tokens, index, &psr->line_hint)
+             : (Token){.type_ = TOK_EOF}; // Return EOF token if out of bounds
 }
 
 /**
@@ -70,9 +86,7 @@ bool p_has_tokens(Parser *psr) {
  * @see p_current(), Token, TOK_EOF
  */
 Token p_peek(Parser *psr, size_t offset) {
-  return (psr->pos + offset < psr->tk_count)
-             ? psr->tks[psr->pos + offset]
-             : (Token){.type_ = TOK_EOF}; // Return EOF token if out of bounds
+  return token_at(psr, psr->pos + offset);
 }
 
 /**
@@ -93,11 +107,7 @@ Token p_peek(Parser *psr, size_t offset) {
  *
  * @see p_advance(), p_peek(), Token
  */
-Token p_current(Parser *psr) {
-  return psr->pos < psr->tk_count
-             ? psr->tks[psr->pos]
-             : (Token){.type_ = TOK_EOF}; // Return EOF token if no tokens left
-}
+Token p_current(Parser *psr) { return token_at(psr, psr->pos); }
 
 /**
  * @brief Advances to the next token and returns the current token
@@ -122,11 +132,37 @@ Token p_current(Parser *psr) {
  */
 Token p_advance(Parser *psr) {
   if (p_has_tokens(psr)) {
-    return psr->tks[psr->pos++];
+    Token tk = token_at(psr, psr->pos++);
+    if (psr->in_span)
+      parser_span_fold(psr, tk);
+    return tk;
   }
   return (Token){.type_ = TOK_EOF}; // Return EOF token if no tokens left
 }
 
+/**
+ * @brief Folds a consumed token into the parser's span digest.
+ *
+ * The kind, text and column of the token count, and its line relative to
+ * where the span began, so a span that only moved up or down keeps its
+ * digest.
+ */
+void parser_span_fold(Parser *psr, Token tk) {
+  uint64_t hash = psr->span_digest;
+  uint64_t parts[3] = {(uint64_t)tk.type_, (uint64_t)tk.length,
+                       ((uint64_t)(uint32_t)(tk.line - psr->span_line) << 32) |
+                           (uint32_t)tk.col};
+  for (size_t i = 0; i < 3; i++) {
+    hash ^= parts[i];
+    hash *= PARSER_SPAN_FNV_PRIME;
+  }
+  for (int i = 0; i < tk.length; i++) {
+    hash ^= (unsigned char)tk.value[i];
+    hash *= PARSER_SPAN_FNV_PRIME;
+  }
+  psr->span_digest = hash;
+}
+
 /**
  * @brief Consumes a token of the expected type or reports an error
  *
@@ -173,46 +209,55 @@ Token p_consume(Parser *psr, LumaTokenType type, const char *error_msg) {
 }
 
 /**
- * @brief Extracts and duplicates the current token's string value
+ * @brief Consumes the '>' closing a cast<...>, input<...> or size_of<...>
  *
- * This function creates a null-terminated string copy of the current token's
- * value using the arena allocator. It's primarily used for extracting
- * identifier names, string literals, and other textual token content that
- * needs to be preserved in the AST.
+ * A vector type in the brackets ends on the first character of a '>>' token
+ * and leaves the parser on it with split_shift set; the token then closes
+ * both.
  *
  * @param psr Pointer to the parser instance
+ * @param error_msg Error message to display if no '>' follows
  *
- * @return Pointer to a null-terminated string containing the current token's
- * value, allocated using the parser's arena allocator
+ * @return The consumed token, or an EOF token on error
  *
- * @note The returned string is allocated using arena_alloc() for automatic
- * memory management
- * @note The string is properly null-terminated for safe use with standard
- * string functions
- * @note The original token value is copied, so the returned string is
- * independent
- * @note Memory is automatically managed by the arena - no manual deallocation
- * needed
+ * @see p_consume(), vector_type()
+ */
+Token p_consume_angle_close(Parser *psr, const char *error_msg) {
+  if (psr->split_shift && p_current(psr).type_ == TOK_SHIFT_RIGHT) {
+    psr->split_shift = false;
+    return p_advance(psr);
+  }
+  psr->split_shift = false;
+  return p_consume(psr, TOK_GT, error_msg);
+}
+
+/**
+ * @brief Interns the current token's text
+ *
+ * Used for identifier names, module names and other names that end up in the
+ * AST. Every later pass compares and hashes names through the returned atom,
+ * so the text is interned here, once, rather than copied at each use.
+ *
+ * @param psr Pointer to the parser instance
+ *
+ * @return Atom holding the current token's text
  *
  * @warning This function assumes the current token has a valid value field
- * @warning Should only be called when you know the current token contains
- * string data
  *
- * @see CURRENT_TOKEN_VALUE(), CURRENT_TOKEN_LENGTH(), arena_alloc()
+ * @see CURRENT_TOKEN_VALUE(), CURRENT_TOKEN_LENGTH(), intern_n()
  */
-char *get_name(Parser *psr) {
-  char *name = (char *)arena_alloc(psr->arena, CURRENT_TOKEN_LENGTH(psr) + 1,
-                                   alignof(char));
-  memcpy((void *)name, CURRENT_TOKEN_VALUE(psr), CURRENT_TOKEN_LENGTH(psr));
-  ((char *)name)[CURRENT_TOKEN_LENGTH(psr)] = '\0';
-  return name;
+Atom get_name(Parser *psr) {
+  return intern_n(CURRENT_TOKEN_VALUE(psr), (size_t)CURRENT_TOKEN_LENGTH(psr));
 }
 
 // Helper function to handle parser initialization errors
-bool init_parser_arrays(Parser *parser, GrowableArray *stmts,
+// Statements are collected in chunks and flattened once the module ends, so
+// a small module doesn't reserve room for a large one and a large one isn't
+// copied every time it outgrows its array
+bool init_parser_arrays(Parser *parser, ChunkedArray *stmts,
                         GrowableArray *modules) {
-  if (!growable_array_init(stmts, parser->arena, 1024, sizeof(Stmt *)) ||
-      !growable_array_init(modules, parser->arena, 16, sizeof(Stmt *))) {
+  chunked_array_init(stmts, parser->arena, 64, sizeof(Stmt *));
+  if (!growable_array_init(modules, parser->arena, 16, sizeof(Stmt *))) {
     fprintf(stderr, "Failed to initialize parser arrays\n");
     return false;
   }
@@ -298,6 +343,11 @@ const char *parse_module_declaration(Parser *parser, char **out_module_doc) {
  * @return Concatenated doc comment string, or NULL if no doc comments found
  */
 char *collect_doc_comments(Parser *parser) {
+  // A token stream doesn't keep the tokens already consumed
+  if (!parser->tokens) {
+    return NULL;
+  }
+
   // Look backward through tokens to find doc comments
   // We need to track which comments we've already consumed
 
@@ -311,11 +361,11 @@ char *collect_doc_comments(Parser *parser) {
 
   // Skip backward over any doc comment tokens
   while (doc_start >= 0) {
-    Token tk = parser->tks[doc_start];
+    LumaTokenType type = parser->tokens->kinds[doc_start];
 
-    if (tk.type_ == TOK_DOC_COMMENT || tk.type_ == TOK_MODULE_DOC) {
+    if (type == TOK_DOC_COMMENT || type == TOK_MODULE_DOC) {
       doc_start--;
-    } else if (tk.type_ == TOK_WHITESPACE || tk.type_ == TOK_COMMENT) {
+    } else if (type == TOK_WHITESPACE || type == TOK_COMMENT) {
       // Skip whitespace and regular comments between doc comments
       doc_start--;
     } else {
@@ -334,9 +384,9 @@ char *collect_doc_comments(Parser *parser) {
   // Collect all doc comments forward
   int total_length = 0;
   for (int i = doc_start; i < (int)parser->pos; i++) {
-    Token tk = parser->tks[i];
-    if (tk.type_ == TOK_DOC_COMMENT || tk.type_ == TOK_MODULE_DOC) {
-      total_length += tk.length + 1; // +1 for newline
+    LumaTokenType type = parser->tokens->kinds[i];
+    if (type == TOK_DOC_COMMENT || type == TOK_MODULE_DOC) {
+      total_length += token_buffer_length(parser->tokens, i) + 1; // newline
     }
   }
 
@@ -350,7 +400,7 @@ char *collect_doc_comments(Parser *parser) {
   char *ptr = result;
 
   for (int i = doc_start; i < (int)parser->pos; i++) {
-    Token tk = parser->tks[i];
+    Token tk = token_buffer_get(parser->tokens, i, &parser->line_hint);
     if (tk.type_ == TOK_DOC_COMMENT || tk.type_ == TOK_MODULE_DOC) {
       memcpy(ptr, tk.value, tk.length);
       ptr += tk.length;
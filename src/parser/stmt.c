@@ -23,6 +23,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 // #include "../ast/ast_utils.h"
@@ -64,7 +65,7 @@ Stmt *use_stmt(Parser *parser) {
   int col = p_current(parser).col;
 
   p_consume(parser, TOK_USE, "Expected '@use' keyword");
-  const char *module_name = get_name(parser);
+  Atom module_name = get_name(parser);
   p_advance(parser); // Advance past the identifier token
   const char *module_alias = NULL;
   if (p_current(parser).type_ == TOK_AS) {
@@ -141,7 +142,7 @@ Stmt *os_stmt(Parser *parser) {
       return NULL;
     }
 
-    char *platform = get_name(parser);
+    Atom platform = get_name(parser);
     p_advance(parser); // consume platform string
 
     p_consume(parser, TOK_RIGHT_ARROW,
@@ -166,7 +167,7 @@ Stmt *os_stmt(Parser *parser) {
       return NULL;
     }
 
-    *platform_slot = platform;
+    *platform_slot = (char *)platform;
     *body_slot = arm_body;
   }
 
@@ -264,7 +265,7 @@ Stmt *const_stmt(Parser *parser, bool is_public, bool returns_ownership,
   int col = p_current(parser).col;
 
   p_consume(parser, TOK_CONST, "Expected 'const' keyword");
-  const char *name = get_name(parser);
+  Atom name = get_name(parser);
   p_advance(parser);
 
   if (p_current(parser).type_ == TOK_COLON) {
@@ -323,7 +324,8 @@ Stmt *const_stmt(Parser *parser, bool is_public, bool returns_ownership,
  * @brief Parses a function declaration statement
  *
  * Handles function declarations with the syntax:
- * `fn(param1: Type1, param2: Type2, ...) ReturnType { body }`
+ * `fn(param1: Type1, param2: Type2, ...) ReturnType { body }`, or
+ * `fn<T, ...>(...)` for a generic function
  *
  * @param parser Pointer to the parser instance
  * @param name Function name (already parsed by caller)
@@ -338,8 +340,129 @@ Stmt *const_stmt(Parser *parser, bool is_public, bool returns_ownership,
  *
  * @see parse_type(), block_stmt(), create_func_decl_stmt()
  */
+static Stmt *fn_stmt_tokens(Parser *parser, const char *name, bool is_public,
+                            bool is_static, bool returns_ownership,
+                            bool takes_ownership);
+
 Stmt *fn_stmt(Parser *parser, const char *name, bool is_public, bool is_static,
               bool returns_ownership, bool takes_ownership) {
+  // The declaration's tokens are folded into its own digest, which lets
+  // the typechecker tell an edited body from one that only moved
+  bool outer_in_span = parser->in_span;
+  int outer_line = parser->span_line;
+  uint64_t outer_digest = parser->span_digest;
+
+  parser->in_span = true;
+  parser->span_line = p_current(parser).line;
+  parser->span_digest = PARSER_SPAN_FNV_OFFSET;
+
+  // What was parsed before 'fn' but still shapes the body
+  uint64_t flags = (uint64_t)is_public | (uint64_t)is_static << 1 |
+                   (uint64_t)returns_ownership << 2 |
+                   (uint64_t)takes_ownership << 3;
+  parser->span_digest =
+      (parser->span_digest ^ flags) * PARSER_SPAN_FNV_PRIME;
+
+  Stmt *fn = fn_stmt_tokens(parser, name, is_public, is_static,
+                            returns_ownership, takes_ownership);
+  uint64_t digest = parser->span_digest;
+
+  // A declaration nested in another still counts toward the outer one
+  parser->in_span = outer_in_span;
+  parser->span_line = outer_line;
+  parser->span_digest = (outer_digest ^ digest) * PARSER_SPAN_FNV_PRIME;
+
+  if (fn)
+    fn->stmt.func_decl.body_digest = digest;
+  return fn;
+}
+
+/**
+ * @brief Parses the type parameters of a generic function or struct
+ *
+ * `fn<T, U>(...)` and `struct<T> { ... }` name their type parameters in
+ * angle brackets after the keyword. Without a '<' there are none.
+ *
+ * @param parser Pointer to the parser instance
+ * @param params Receives the type parameter names, NULL when there are none
+ * @param count Receives the number of type parameters
+ *
+ * @return false after reporting an error on malformed parameters
+ *
+ * @see instantiate_generics()
+ */
+bool type_params(Parser *parser, char ***params, size_t *count) {
+  *params = NULL;
+  *count = 0;
+  if (p_current(parser).type_ != TOK_LT)
+    return true;
+
+  int line = p_current(parser).line;
+  int col = p_current(parser).col;
+  p_advance(parser); // Consume '<'
+
+  GrowableArray names;
+  if (!growable_array_init(&names, parser->arena, 2, sizeof(char *))) {
+    parser_error(parser, "SyntaxError", parser->file_path,
+                 "Internal error: failed to initialize type parameter array",
+                 line, col, 0);
+    return false;
+  }
+
+  while (true) {
+    if (p_current(parser).type_ != TOK_IDENTIFIER) {
+      parser_error(parser, "SyntaxError", parser->file_path,
+                   "Expected a type parameter name", p_current(parser).line,
+                   p_current(parser).col, p_current(parser).length);
+      return false;
+    }
+
+    Atom param = get_name(parser);
+    for (size_t i = 0; i < names.count; i++) {
+      if (((char **)names.data)[i] == param) {
+        parser_error(parser, "SyntaxError", parser->file_path,
+                     "Duplicate type parameter name", p_current(parser).line,
+                     p_current(parser).col, p_current(parser).length);
+        return false;
+      }
+    }
+
+    char **slot = (char **)growable_array_push(&names);
+    if (!slot) {
+      parser_error(parser, "SyntaxError", parser->file_path,
+                   "Internal error: out of memory growing type parameters",
+                   line, col, 0);
+      return false;
+    }
+    *slot = (char *)param;
+    p_advance(parser); // Consume the name
+
+    if (p_current(parser).type_ != TOK_COMMA)
+      break;
+    p_advance(parser); // Consume ','
+  }
+
+  if (p_consume(parser, TOK_GT, "Expected '>' after type parameters").type_ !=
+      TOK_GT)
+    return false;
+
+  *params = (char **)names.data;
+  *count = names.count;
+  return true;
+}
+
+// Attaches the type parameters parsed after 'fn' to the declaration
+static Stmt *with_type_params(Stmt *fn, char **params, size_t count) {
+  if (fn) {
+    fn->stmt.func_decl.type_params = params;
+    fn->stmt.func_decl.type_param_count = count;
+  }
+  return fn;
+}
+
+static Stmt *fn_stmt_tokens(Parser *parser, const char *name, bool is_public,
+                            bool is_static, bool returns_ownership,
+                            bool takes_ownership) {
   char *doc_comment = parser->pending_doc_comment;
   parser->pending_doc_comment = NULL;
 
@@ -356,6 +479,12 @@ Stmt *fn_stmt(Parser *parser, const char *name, bool is_public, bool is_static,
   }
 
   p_consume(parser, TOK_FN, "Expected 'fn' keyword");
+
+  char **generic_params = NULL;
+  size_t type_param_count = 0;
+  if (!type_params(parser, &generic_params, &type_param_count))
+    return NULL;
+
   p_consume(parser, TOK_LPAREN, "Expected '(' after function name");
 
   while (p_has_tokens(parser) && p_current(parser).type_ != TOK_RPAREN) {
@@ -367,7 +496,7 @@ Stmt *fn_stmt(Parser *parser, const char *name, bool is_public, bool is_static,
       return NULL;
     }
 
-    char *param_name = get_name(parser);
+    Atom param_name = get_name(parser);
     p_advance(parser);
 
     p_consume(parser, TOK_COLON, "Expected ':' after parameter name");
@@ -389,7 +518,7 @@ Stmt *fn_stmt(Parser *parser, const char *name, bool is_public, bool is_static,
       return NULL;
     }
 
-    *name_slot = param_name;
+    *name_slot = (char *)param_name;
     *type_slot = param_type;
 
     if (p_current(parser).type_ == TOK_COMMA) {
@@ -411,10 +540,14 @@ Stmt *fn_stmt(Parser *parser, const char *name, bool is_public, bool is_static,
   if (p_current(parser).type_ == TOK_SEMICOLON) {
     p_consume(parser, TOK_SEMICOLON,
               "Expected semicolon after function prototype");
-    return create_func_decl_stmt(
-        parser->arena, name, doc_comment, (char **)param_names.data,
-        (AstNode **)param_types.data, param_names.count, return_type, is_public,
-        is_static, returns_ownership, takes_ownership, true, NULL, line, col);
+    return with_type_params(
+        create_func_decl_stmt(parser->arena, name, doc_comment,
+                              (char **)param_names.data,
+                              (AstNode **)param_types.data, param_names.count,
+                              return_type, is_public, is_static,
+                              returns_ownership, takes_ownership, true, NULL,
+                              line, col),
+        generic_params, type_param_count);
   }
 
   if (p_current(parser).type_ == TOK_EQUAL) {
@@ -436,10 +569,14 @@ Stmt *fn_stmt(Parser *parser, const char *name, bool is_public, bool is_static,
         arena_alloc(parser->arena, sizeof(AstNode *), alignof(AstNode *));
     stmts[0] = body_stmt;
     AstNode *body = create_block_stmt(parser->arena, stmts, 1, line, col);
-    return create_func_decl_stmt(
-        parser->arena, name, doc_comment, (char **)param_names.data,
-        (AstNode **)param_types.data, param_names.count, return_type, is_public,
-        is_static, returns_ownership, takes_ownership, false, body, line, col);
+    return with_type_params(
+        create_func_decl_stmt(parser->arena, name, doc_comment,
+                              (char **)param_names.data,
+                              (AstNode **)param_types.data, param_names.count,
+                              return_type, is_public, is_static,
+                              returns_ownership, takes_ownership, false, body,
+                              line, col),
+        generic_params, type_param_count);
   }
 
   Stmt *body = block_stmt(parser);
@@ -450,10 +587,14 @@ Stmt *fn_stmt(Parser *parser, const char *name, bool is_public, bool is_static,
     return NULL;
   }
 
-  return create_func_decl_stmt(
-      parser->arena, name, doc_comment, (char **)param_names.data,
-      (AstNode **)param_types.data, param_names.count, return_type, is_public,
-      is_static, returns_ownership, takes_ownership, false, body, line, col);
+  return with_type_params(
+      create_func_decl_stmt(parser->arena, name, doc_comment,
+                            (char **)param_names.data,
+                            (AstNode **)param_types.data, param_names.count,
+                            return_type, is_public, is_static,
+                            returns_ownership, takes_ownership, false, body,
+                            line, col),
+      generic_params, type_param_count);
 }
 
 /**
@@ -502,7 +643,7 @@ Stmt *enum_stmt(Parser *parser, const char *name, bool is_public) {
       return NULL;
     }
 
-    char *member_name = get_name(parser);
+    Atom member_name = get_name(parser);
     p_advance(parser); // Advance past the identifier token
 
     char **slot = (char **)growable_array_push(&members);
@@ -512,7 +653,7 @@ Stmt *enum_stmt(Parser *parser, const char *name, bool is_public) {
                    p_current(parser).line, p_current(parser).col, 0);
       return NULL;
     }
-    *slot = member_name;
+    *slot = (char *)member_name;
 
     if (p_current(parser).type_ == TOK_COMMA) {
       p_advance(parser); // Advance past the comma
@@ -527,6 +668,155 @@ Stmt *enum_stmt(Parser *parser, const char *name, bool is_public) {
                                line, col);
 }
 
+/**
+ * @brief Parses an #align attribute: #align(N)
+ *
+ * The current token must be the #align itself. N has to be a power of two.
+ *
+ * @param parser Pointer to the parser instance
+ * @param alignment Receives N
+ *
+ * @return true on success, false after reporting an error
+ */
+bool align_attribute(Parser *parser, size_t *alignment) {
+  int line = p_current(parser).line;
+  int col = p_current(parser).col;
+  p_advance(parser); // consume #align
+
+  if (p_consume(parser, TOK_LPAREN, "Expected '(' after #align").type_ !=
+      TOK_LPAREN)
+    return false;
+
+  unsigned long long value = 0;
+  if (p_current(parser).type_ == TOK_NUMBER)
+    value = strtoull(get_name(parser), NULL, 0);
+  if (value == 0 || (value & (value - 1)) != 0) {
+    parser_error(parser, "SyntaxError", parser->file_path,
+                 "#align expects a power of two, like #align(64)", line, col,
+                 6);
+    return false;
+  }
+  p_advance(parser); // consume N
+
+  if (p_consume(parser, TOK_RPAREN, "Expected ')' to close #align").type_ !=
+      TOK_RPAREN)
+    return false;
+  *alignment = (size_t)value;
+  return true;
+}
+
+/**
+ * @brief Parses a loop hint that takes an optional count, like #unroll(4)
+ *
+ * The current token must be the attribute itself. Without parentheses the
+ * count is left at 0, so LLVM picks it.
+ *
+ * @param parser Pointer to the parser instance
+ * @param attribute The attribute's name, for error messages
+ * @param count Receives the count, or 0 when none was given
+ *
+ * @return true on success, false after reporting an error
+ */
+bool loop_hint_count(Parser *parser, const char *attribute, size_t *count) {
+  int line = p_current(parser).line;
+  int col = p_current(parser).col;
+  int length = p_current(parser).length;
+  p_advance(parser); // consume the attribute
+
+  *count = 0;
+  if (p_current(parser).type_ != TOK_LPAREN)
+    return true;
+  p_advance(parser); // consume (
+
+  unsigned long long value = 0;
+  if (p_current(parser).type_ == TOK_NUMBER)
+    value = strtoull(get_name(parser), NULL, 0);
+  if (value == 0) {
+    char message[96];
+    snprintf(message, sizeof(message),
+             "%s expects a positive count, like %s(4)", attribute, attribute);
+    parser_error(parser, "SyntaxError", parser->file_path,
+                 arena_strdup(parser->arena, message), line, col, length);
+    return false;
+  }
+  p_advance(parser); // consume N
+
+  if (p_consume(parser, TOK_RPAREN, "Expected ')' to close loop hint").type_ !=
+      TOK_RPAREN)
+    return false;
+  *count = (size_t)value;
+  return true;
+}
+
+/**
+ * @brief The FunctionAttribute flag an attribute token stands for
+ *
+ * @return The flag, or 0 when @p type is not a function optimization
+ * attribute
+ */
+unsigned function_attribute(LumaTokenType type) {
+  switch (type) {
+  case TOK_INLINE:
+    return FN_ATTR_INLINE;
+  case TOK_NOINLINE:
+    return FN_ATTR_NOINLINE;
+  case TOK_HOT:
+    return FN_ATTR_HOT;
+  case TOK_COLD:
+    return FN_ATTR_COLD;
+  case TOK_PURE:
+    return FN_ATTR_PURE;
+  case TOK_CONST_ATTR:
+    return FN_ATTR_CONST;
+  case TOK_FLATTEN:
+    return FN_ATTR_FLATTEN;
+  default:
+    return 0;
+  }
+}
+
+/**
+ * @brief Stamps #inline, #cold, #pure and the other function attributes
+ * onto a function declaration
+ *
+ * The attributes are folded into the declaration's digest too, so a body
+ * that only gained #pure is checked again.
+ *
+ * @param parser Pointer to the parser instance
+ * @param fn The declaration the attributes were written before
+ * @param attributes FunctionAttribute flags
+ *
+ * @return true on success, false after reporting an error
+ */
+bool apply_function_attributes(Parser *parser, Stmt *fn, unsigned attributes) {
+  if (fn->type != AST_STMT_FUNCTION) {
+    parser_error(parser, "SyntaxError", parser->file_path,
+                 "#inline, #noinline, #hot, #cold, #pure, #const and "
+                 "#flatten can only be applied to functions",
+                 fn->line, fn->column, 0);
+    return false;
+  }
+
+  const char *conflict = NULL;
+  if ((attributes & FN_ATTR_INLINE) && (attributes & FN_ATTR_NOINLINE))
+    conflict = "A function can't be both #inline and #noinline";
+  else if ((attributes & FN_ATTR_HOT) && (attributes & FN_ATTR_COLD))
+    conflict = "A function can't be both #hot and #cold";
+  else if ((attributes & FN_ATTR_PURE) && (attributes & FN_ATTR_CONST))
+    conflict = "#const already implies #pure; use one of them";
+  if (conflict) {
+    parser_error(parser, "SyntaxError", parser->file_path, conflict, fn->line,
+                 fn->column, 0);
+    return false;
+  }
+
+  fn->stmt.func_decl.attributes = attributes;
+  if (fn->stmt.func_decl.body_digest)
+    fn->stmt.func_decl.body_digest =
+        (fn->stmt.func_decl.body_digest ^ attributes) * PARSER_SPAN_FNV_PRIME;
+  return true;
+}
+
 /**
  * @brief Parses a structure declaration statement
  *
@@ -551,6 +841,7 @@ Stmt *enum_stmt(Parser *parser, const char *name, bool is_public) {
  * @note Supports both data fields (name: Type) and methods (name = fn ...)
  * @note Visibility defaults to public unless explicitly changed
  * @note Visibility changes affect all subsequent members until changed again
+ * @note `struct<T> { ... }` declares a generic struct (see type_params())
  *
  * @see fn_stmt(), create_field_decl_stmt(), create_struct_decl_stmt()
  */
@@ -564,6 +855,12 @@ Stmt *struct_stmt(Parser *parser, const char *name, bool is_public) {
   int col = p_current(parser).col;
 
   p_consume(parser, TOK_STRUCT, "Expected 'struct' keyword");
+
+  char **generic_params = NULL;
+  size_t type_param_count = 0;
+  if (!type_params(parser, &generic_params, &type_param_count))
+    return NULL;
+
   p_consume(parser, TOK_LBRACE, "Expected '{' after struct name");
 
   GrowableArray public_fields, private_fields;
@@ -640,6 +937,32 @@ Stmt *struct_stmt(Parser *parser, const char *name, bool is_public) {
     int field_line = p_current(parser).line;
     int field_col = p_current(parser).col;
 
+    // Layout attributes of a data field
+    bool field_packed = false;
+    size_t field_alignment = 0;
+    unsigned method_attributes = 0;
+    while (p_current(parser).type_ == TOK_PACKED ||
+           p_current(parser).type_ == TOK_ALIGN ||
+           p_current(parser).type_ == TOK_REORDER ||
+           function_attribute(p_current(parser).type_)) {
+      if (function_attribute(p_current(parser).type_)) {
+        method_attributes |= function_attribute(p_current(parser).type_);
+        p_advance(parser);
+      } else if (p_current(parser).type_ == TOK_REORDER) {
+        parser_error(parser, "SyntaxError", parser->file_path,
+                     "#reorder can only be applied to a struct declaration",
+                     p_current(parser).line, p_current(parser).col,
+                     p_current(parser).length);
+        return NULL;
+      } else if (p_current(parser).type_ == TOK_PACKED) {
+        field_packed = true;
+        p_advance(parser);
+      } else if (!align_attribute(parser, &field_alignment)) {
+        return NULL;
+      }
+    }
+    bool has_layout = field_packed || field_alignment != 0;
+
     // Check for ownership modifiers
     bool takes_ownership = false;
     bool returns_ownership = false;
@@ -658,7 +981,7 @@ Stmt *struct_stmt(Parser *parser, const char *name, bool is_public) {
       p_advance(parser);
     }
 
-    char *field_name = get_name(parser);
+    Atom field_name = get_name(parser);
     p_advance(parser);
 
     Stmt *field_function = NULL;
@@ -670,17 +993,36 @@ Stmt *struct_stmt(Parser *parser, const char *name, bool is_public) {
       // it
       parser->pending_doc_comment = field_doc;
       p_consume(parser, TOK_RIGHT_ARROW, "Expected '->' after field name");
+      if (has_layout) {
+        parser_error(parser, "SyntaxError", parser->file_path,
+                     "#packed and #align only apply to data fields",
+                     field_line, field_col, 1);
+        return NULL;
+      }
       field_function = fn_stmt(parser, field_name, public_member, is_static,
                                returns_ownership, takes_ownership);
+      if (field_function && field_function->stmt.func_decl.type_param_count) {
+        parser_error(parser, "SyntaxError", parser->file_path,
+                     "Methods can't take type parameters; make the struct "
+                     "generic instead",
+                     field_line, field_col, 1);
+        return NULL;
+      }
+      if (field_function && method_attributes &&
+          !apply_function_attributes(parser, field_function,
+                                     method_attributes))
+        return NULL;
     } else {
       // Data field
       p_consume(parser, TOK_COLON, "Expected ':' after field name");
       field_type = parse_type(parser);
 
-      if (takes_ownership || returns_ownership || is_static) {
+      if (takes_ownership || returns_ownership || is_static ||
+          method_attributes) {
         parser_error(
             parser, "Invalid Modifier", __FILE__,
-            "Static and ownership modifiers are only valid for methods",
+            "Static, ownership and function attributes are only valid for "
+            "methods",
             field_line, field_col, 1);
         return NULL;
       }
@@ -702,6 +1044,8 @@ Stmt *struct_stmt(Parser *parser, const char *name, bool is_public) {
     Stmt *field_decl = create_field_decl_stmt(
         parser->arena, field_name, field_doc, field_type, field_function,
         public_member, is_static, field_line, field_col);
+    field_decl->stmt.field_decl.is_packed = field_packed;
+    field_decl->stmt.field_decl.alignment = field_alignment;
 
     Stmt **slot = public_member ? (Stmt **)growable_array_push(&public_fields)
                                 : (Stmt **)growable_array_push(&private_fields);
@@ -720,10 +1064,15 @@ Stmt *struct_stmt(Parser *parser, const char *name, bool is_public) {
             "Expected semicolon after struct declaration");
 
   // Pass struct doc comment to creation function
-  return create_struct_decl_stmt(
+  Stmt *decl = create_struct_decl_stmt(
       parser->arena, name, struct_doc, (Stmt **)public_fields.data,
       public_fields.count, (Stmt **)private_fields.data, private_fields.count,
       is_public, line, col);
+  if (decl) {
+    decl->stmt.struct_decl.type_params = generic_params;
+    decl->stmt.struct_decl.type_param_count = type_param_count;
+  }
+  return decl;
 }
 
 /**
@@ -753,7 +1102,7 @@ Stmt *var_stmt(Parser *parser, bool is_public) {
   int col = p_current(parser).col;
 
   p_consume(parser, TOK_VAR, "Expected 'var' keyword");
-  const char *name = get_name(parser);
+  Atom name = get_name(parser);
   p_advance(parser);
 
   p_consume(parser, TOK_COLON, "Expected ':' after variable name");
@@ -1042,7 +1391,7 @@ Stmt *infinite_loop_stmt(Parser *parser, int line, int col) {
  * @see create_var_decl_stmt()
  */
 Stmt *loop_init(Parser *parser, int line, int col) {
-  const char *name = get_name(parser);
+  Atom name = get_name(parser);
   p_advance(parser); // Advance past the identifier token
 
   p_consume(parser, TOK_COLON, "Expected ':' after loop initializer");
@@ -1524,7 +1873,7 @@ Stmt *impl_stmt(Parser *parser) {
       return NULL;
     }
 
-    char *function_list_name = get_name(parser);
+    Atom function_list_name = get_name(parser);
     p_advance(parser);
     p_consume(parser, TOK_COLON, "Expected ':' after parameter name");
 
@@ -1546,7 +1895,7 @@ Stmt *impl_stmt(Parser *parser) {
                    p_current(parser).line, p_current(parser).col, 0);
       return NULL;
     }
-    *name_identifier = function_list_name;
+    *name_identifier = (char *)function_list_name;
     *type_specifier = function_list_type;
 
     if (p_current(parser).type_ == TOK_COMMA) {
@@ -1567,7 +1916,7 @@ Stmt *impl_stmt(Parser *parser) {
                    p_current(parser).length);
       return NULL;
     }
-    char *struct_list_name = get_name(parser);
+    Atom struct_list_name = get_name(parser);
     p_advance(parser);
     char **struct_identifier = (char **)growable_array_push(&struct_name_list);
 
@@ -1577,7 +1926,7 @@ Stmt *impl_stmt(Parser *parser) {
                    p_current(parser).line, p_current(parser).col, 0);
       return NULL;
     }
-    *struct_identifier = struct_list_name;
+    *struct_identifier = (char *)struct_list_name;
     if (p_current(parser).type_ == TOK_COMMA) {
       p_advance(parser);
     }
@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "../ast/ast.h"
 #include "parser.h"
@@ -61,6 +63,109 @@ Type *array_type(Parser *parser) {
   return create_array_type(parser->arena, element_type, size_expr, line, col);
 }
 
+static bool is_vector_element_name(const char *name) {
+  return strcmp(name, "int") == 0 || strcmp(name, "float") == 0 ||
+         strcmp(name, "double") == 0 || strcmp(name, "char") == 0 ||
+         strcmp(name, "bool") == 0;
+}
+
+// vec<Type, Lanes>
+Type *vector_type(Parser *parser) {
+  int line = p_current(parser).line;
+  int col = p_current(parser).col;
+
+  p_advance(parser); // Consume 'vec'
+  p_advance(parser); // Consume '<'
+
+  Type *element_type = parse_type(parser);
+  if (!element_type)
+    return NULL;
+  if (element_type->type != AST_TYPE_BASIC ||
+      !is_vector_element_name(element_type->type_data.basic.name)) {
+    parser_error(parser, "TypeError", parser->file_path,
+                 "Vector elements must be int, float, double, char or bool",
+                 (int)element_type->line, (int)element_type->column, 0);
+    return NULL;
+  }
+
+  if (p_consume(parser, TOK_COMMA,
+                "Expected ',' between the element type and lane count of a "
+                "vector type")
+          .type_ != TOK_COMMA)
+    return NULL;
+
+  unsigned long long lanes = 0;
+  if (p_current(parser).type_ == TOK_NUMBER)
+    lanes = strtoull(get_name(parser), NULL, 0);
+  if (lanes < 2 || lanes > 64 || (lanes & (lanes - 1)) != 0) {
+    parser_error(parser, "TypeError", parser->file_path,
+                 "Vector lane counts must be a power of two from 2 to 64",
+                 p_current(parser).line, p_current(parser).col,
+                 p_current(parser).length);
+    return NULL;
+  }
+  p_advance(parser); // Consume the lane count
+
+  // In cast<vec<int, 4>>(...) both closing brackets lex as one '>>'
+  if (p_current(parser).type_ == TOK_SHIFT_RIGHT) {
+    parser->split_shift = true;
+  } else if (p_consume(parser, TOK_GT, "Expected '>' to close vector type")
+                 .type_ != TOK_GT) {
+    return NULL;
+  }
+
+  return create_vector_type(parser->arena, element_type, (size_t)lanes, line,
+                            col);
+}
+
+// Name<Type, ...>: the type arguments of a generic struct
+AstNode **type_args(Parser *parser, size_t *count) {
+  int line = p_current(parser).line;
+  int col = p_current(parser).col;
+  *count = 0;
+
+  p_advance(parser); // Consume '<'
+
+  GrowableArray args;
+  if (!growable_array_init(&args, parser->arena, 2, sizeof(Type *))) {
+    parser_error(parser, "SyntaxError", parser->file_path,
+                 "Internal error: failed to initialize type argument array",
+                 line, col, 0);
+    return NULL;
+  }
+
+  while (true) {
+    Type *arg = parse_type(parser);
+    if (!arg)
+      return NULL;
+
+    Type **slot = (Type **)growable_array_push(&args);
+    if (!slot) {
+      parser_error(parser, "SyntaxError", parser->file_path,
+                   "Internal error: out of memory growing type arguments",
+                   line, col, 0);
+      return NULL;
+    }
+    *slot = arg;
+
+    if (p_current(parser).type_ != TOK_COMMA)
+      break;
+    p_advance(parser); // Consume ','
+  }
+
+  // In Vector<Box<int>> the inner list closes on the first half of '>>'
+  if (p_current(parser).type_ == TOK_SHIFT_RIGHT && !parser->split_shift) {
+    parser->split_shift = true;
+  } else if (p_consume_angle_close(parser,
+                                   "Expected '>' to close the type arguments")
+                 .type_ == TOK_EOF) {
+    return NULL;
+  }
+
+  *count = args.count;
+  return (AstNode **)args.data;
+}
+
 // Handle namespace::Type resolution
 // Returns a type and DOES advance past all consumed tokens
 Type *resolution_type(Parser *parser) {
@@ -68,7 +173,7 @@ Type *resolution_type(Parser *parser) {
   int col = p_current(parser).col;
 
   // We start with an identifier (the namespace or first part)
-  char *first_name = get_name(parser);
+  Atom first_name = get_name(parser);
   p_advance(parser); // Consume the identifier
 
   // Check if we have a resolution operator
@@ -95,7 +200,7 @@ Type *resolution_type(Parser *parser) {
                  col, 0);
     return NULL;
   }
-  *slot = first_name;
+  *slot = (char *)first_name;
 
   // Parse remaining parts separated by '::'
   while (p_current(parser).type_ == TOK_RESOLVE) {
@@ -108,7 +213,7 @@ Type *resolution_type(Parser *parser) {
       return NULL;
     }
 
-    char *part = get_name(parser);
+    Atom part = get_name(parser);
     p_advance(parser); // Consume the identifier
 
     slot = (char **)growable_array_push(&parts);
@@ -118,7 +223,7 @@ Type *resolution_type(Parser *parser) {
                    p_current(parser).line, p_current(parser).col, 0);
       return NULL;
     }
-    *slot = part;
+    *slot = (char *)part;
   }
 
   // Create a resolution type with the collected parts
@@ -221,7 +326,29 @@ Type *tnud(Parser *parser) {
     p_advance(parser);
     return function_type(parser, NULL);
   case TOK_IDENTIFIER:
-    return resolution_type(parser);
+    // vec is only a type name in front of '<'; elsewhere it's an identifier
+    if (p_peek(parser, 1).type_ == TOK_LT &&
+        p_current(parser).length == 3 &&
+        strncmp(p_current(parser).value, "vec", 3) == 0)
+      return vector_type(parser);
+    {
+      Type *named = resolution_type(parser);
+      if (!named || p_current(parser).type_ != TOK_LT)
+        return named;
+
+      size_t count = 0;
+      AstNode **args = type_args(parser, &count);
+      if (!args)
+        return NULL;
+      if (named->type == AST_TYPE_BASIC) {
+        named->type_data.basic.type_args = args;
+        named->type_data.basic.type_arg_count = count;
+      } else {
+        named->type_data.resolution.type_args = args;
+        named->type_data.resolution.type_arg_count = count;
+      }
+      return named;
+    }
   default:
     parser_error(parser, "TypeError", parser->file_path,
                  "Expected a type name here", line, col,
@@ -196,7 +196,8 @@ bool validate_array_initializer(AstNode *declared_type, AstNode *initializer,
   }
 
   // Check that array literal type matches declared array type
-  AstNode *init_type = typecheck_array_expr(initializer, scope, arena);
+  AstNode *init_type = record_checked_type(
+      initializer, typecheck_array_expr(initializer, scope, arena));
   if (!init_type) {
     return false;
   }
@@ -5,19 +5,18 @@
 #include <stdlib.h>
 #include <string.h>
 
-Token *g_tokens = NULL;
-int g_token_count = 0;
-const char *g_file_path = NULL;
-ArenaAllocator *g_arena = NULL;
+// Per thread, since function bodies are checked on several threads
+_Thread_local const LineTable *g_lines = NULL;
+_Thread_local const char *g_file_path = NULL;
+_Thread_local ArenaAllocator *g_arena = NULL;
 
 /**
  * @brief Set global context for error reporting
  * Call this once at the start of typechecking
  */
-void tc_error_init(Token *tokens, int token_count, const char *file_path,
+void tc_error_init(const LineTable *lines, const char *file_path,
                    ArenaAllocator *arena) {
-  g_tokens = tokens;
-  g_token_count = token_count;
+  g_lines = lines;
   g_file_path = file_path;
   g_arena = arena;
 }
@@ -54,9 +53,9 @@ void tc_error(AstNode *node, const char *error_type, const char *format, ...) {
   error.col = (int)node->column;
   error.token_length = 1;
 
-  if (g_tokens && g_token_count > 0) {
+  if (g_lines) {
     error.line_text =
-        generate_line(g_arena, g_tokens, g_token_count, error.line);
+        generate_line(g_arena, g_lines, error.line);
   }
 
   error_add(error);
@@ -95,9 +94,9 @@ void tc_error_help(AstNode *node, const char *error_type, const char *help,
   error.token_length = 1;
   error.help = help;
 
-  if (g_tokens && g_token_count > 0) {
+  if (g_lines) {
     error.line_text =
-        generate_line(g_arena, g_tokens, g_token_count, error.line);
+        generate_line(g_arena, g_lines, error.line);
   }
 
   error_add(error);
@@ -132,9 +131,9 @@ void tc_error_id(AstNode *node, const char *identifier, const char *error_type,
   error.col = (int)node->column;
   error.token_length = identifier ? (int)strlen(identifier) : 1;
 
-  if (g_tokens && g_token_count > 0) {
+  if (g_lines) {
     error.line_text =
-        generate_line(g_arena, g_tokens, g_token_count, error.line);
+        generate_line(g_arena, g_lines, error.line);
   }
 
   error_add(error);
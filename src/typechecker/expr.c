@@ -1,7 +1,7 @@
 #include <stdio.h>
 #include <string.h>
 
-// #include "../ast/ast_utils.h"
+#include "../ast/ast_utils.h"
 #include "type.h"
 
 AstNode *typecheck_binary_expr(AstNode *expr, Scope *scope,
@@ -18,6 +18,9 @@ AstNode *typecheck_binary_expr(AstNode *expr, Scope *scope,
 
   BinaryOp op = expr->expr.binary.op;
 
+  if (is_vector_type(left_type) || is_vector_type(right_type))
+    return typecheck_vector_binary(expr, left_type, right_type, arena);
+
   // Arithmetic operators
   if (op >= BINOP_ADD && op <= BINOP_POW) {
     if (!is_numeric_type(left_type)) {
@@ -163,6 +166,20 @@ AstNode *typecheck_unary_expr(AstNode *expr, Scope *scope,
 
   UnaryOp op = expr->expr.unary.op;
 
+  // Lane by lane: -v on numeric lanes, ~v on integer or bool lanes and !v on
+  // bool lanes
+  if (is_vector_type(operand_type)) {
+    AstNode *element = operand_type->type_data.vector.element_type;
+    if ((op == UNOP_NEG && is_numeric_type(element)) ||
+        (op == UNOP_BIT_NOT &&
+         (is_integer_type(element) || is_bool_type(element))) ||
+        (op == UNOP_NOT && is_bool_type(element)))
+      return operand_type;
+    tc_error(expr, "Type Error", "Unsupported unary operation on '%s'",
+             type_to_string(operand_type, arena));
+    return NULL;
+  }
+
   if (op == UNOP_NEG) {
     if (!is_numeric_type(operand_type)) {
       tc_error(expr, "Type Error", "Unary negation on non-numeric type");
@@ -177,6 +194,8 @@ AstNode *typecheck_unary_expr(AstNode *expr, Scope *scope,
       tc_error(expr, "Type Error", "Increment/decrement on non-numeric type");
       return NULL;
     }
+    if (!check_pure_write(expr, expr->expr.unary.operand, scope))
+      return NULL;
     return operand_type; // Increment/decrement does not change type
   }
 
@@ -197,6 +216,163 @@ AstNode *typecheck_unary_expr(AstNode *expr, Scope *scope,
   return NULL;
 }
 
+// The FunctionAttribute flags of the function scope is in, 0 outside one
+static unsigned enclosing_function_attributes(Scope *scope) {
+  while (scope && !scope->is_function_scope)
+    scope = scope->parent;
+  return scope && scope->associated_node
+             ? scope->associated_node->stmt.func_decl.attributes
+             : 0;
+}
+
+// Whether name is a local or a parameter of the function scope is in,
+// rather than a variable of the module around it
+static bool is_function_local(Scope *scope, const char *name) {
+  for (; scope; scope = scope->parent) {
+    if (scope_lookup_current_only(scope, name))
+      return true;
+    if (scope->is_function_scope)
+      break;
+  }
+  return false;
+}
+
+static const char *purity_attribute(unsigned attributes) {
+  return attributes & FN_ATTR_CONST ? "#const" : "#pure";
+}
+
+// #pure and #const functions only write their own locals: the LLVM
+// attributes they lower to let calls be merged or dropped
+bool check_pure_write(AstNode *expr, AstNode *target, Scope *scope) {
+  unsigned attributes = enclosing_function_attributes(scope);
+  if (!(attributes & (FN_ATTR_PURE | FN_ATTR_CONST)))
+    return true;
+
+  for (;;) {
+    AstNode *object = NULL;
+    if (target->type == AST_EXPR_INDEX)
+      object = target->expr.index.object;
+    else if (target->type == AST_EXPR_MEMBER)
+      object = target->expr.member.object;
+    else if (target->type == AST_EXPR_GROUPING)
+      object = target->expr.grouping.expr;
+
+    if (target->type == AST_EXPR_DEREF ||
+        (object && target->type != AST_EXPR_GROUPING &&
+         is_pointer_type(object->expr.checked_type))) {
+      tc_error_help(expr, "Purity Error",
+                    "Drop the attribute, or return the result instead of "
+                    "storing it",
+                    "A %s function can't write through a pointer",
+                    purity_attribute(attributes));
+      return false;
+    }
+    if (!object)
+      break;
+    target = object;
+  }
+
+  if (target->type == AST_EXPR_IDENTIFIER &&
+      !is_function_local(scope, target->expr.identifier.name)) {
+    tc_error_help(expr, "Purity Error",
+                  "Drop the attribute, or return the result instead of "
+                  "storing it",
+                  "A %s function can't write the global '%s'",
+                  purity_attribute(attributes), target->expr.identifier.name);
+    return false;
+  }
+  return true;
+}
+
+// Whether name is a parameter of the function scope is in
+static bool is_function_parameter(Scope *scope, const char *name) {
+  for (; scope; scope = scope->parent) {
+    if (scope_lookup_current_only(scope, name))
+      return scope->is_function_scope;
+    if (scope->is_function_scope)
+      break;
+  }
+  return false;
+}
+
+// #const functions don't read memory they weren't handed, so module
+// variables are off limits; constants and functions are not
+bool check_const_read(AstNode *expr, Symbol *symbol, Scope *scope) {
+  if (!(enclosing_function_attributes(scope) & FN_ATTR_CONST) ||
+      !symbol->is_mutable ||
+      (symbol->type && symbol->type->type == AST_TYPE_FUNCTION) ||
+      is_function_local(scope, expr->expr.identifier.name))
+    return true;
+
+  tc_error_help(expr, "Purity Error",
+                "Pass the value in as a parameter, or use #pure to allow "
+                "reading memory",
+                "A #const function can't read the global '%s'",
+                expr->expr.identifier.name);
+  return false;
+}
+
+// #const lowers to memory(argmem: read): what a pointer parameter points to
+// is all a #const function may read. A pointer loaded from memory, or held
+// in a local, is not one LLVM can tell is based on a parameter, so the
+// pointer read through has to be a parameter, plus or minus an offset.
+bool check_const_deref(AstNode *expr, AstNode *pointer, Scope *scope) {
+  if (!(enclosing_function_attributes(scope) & FN_ATTR_CONST))
+    return true;
+
+  for (;;) {
+    if (pointer->type == AST_EXPR_GROUPING) {
+      pointer = pointer->expr.grouping.expr;
+    } else if (pointer->type == AST_EXPR_CAST) {
+      pointer = pointer->expr.cast.castee;
+    } else if (pointer->type == AST_EXPR_BINARY &&
+               is_pointer_type(pointer->expr.binary.left->expr.checked_type)) {
+      pointer = pointer->expr.binary.left;
+    } else if (pointer->type == AST_EXPR_BINARY &&
+               is_pointer_type(
+                   pointer->expr.binary.right->expr.checked_type)) {
+      pointer = pointer->expr.binary.right;
+    } else {
+      break;
+    }
+  }
+  if (pointer->type == AST_EXPR_IDENTIFIER &&
+      is_function_parameter(scope, pointer->expr.identifier.name))
+    return true;
+
+  tc_error_help(expr, "Purity Error",
+                "Read through a pointer parameter, or use #pure to allow "
+                "reading any memory",
+                "A #const function can only read memory its pointer "
+                "parameters point to");
+  return false;
+}
+
+// What a #pure or #const body calls has to promise as much: #pure calls
+// #pure or #const functions, #const only #const ones. Calls through
+// function values promise nothing.
+bool check_pure_call(AstNode *expr, Symbol *callee, const char *callee_name,
+                     Scope *scope) {
+  unsigned attributes = enclosing_function_attributes(scope);
+  if (!(attributes & (FN_ATTR_PURE | FN_ATTR_CONST)))
+    return true;
+
+  unsigned allowed =
+      attributes & FN_ATTR_CONST ? FN_ATTR_CONST : FN_ATTR_PURE | FN_ATTR_CONST;
+  if (callee->attributes & allowed)
+    return true;
+
+  tc_error_help(expr, "Purity Error",
+                attributes & FN_ATTR_CONST
+                    ? "Mark the callee #const as well, or drop the attribute"
+                    : "Mark the callee #pure as well, or drop the attribute",
+                "A %s function can't call '%s', which isn't %s",
+                purity_attribute(attributes),
+                callee_name ? callee_name : "this function",
+                attributes & FN_ATTR_CONST ? "#const" : "#pure or #const");
+  return false;
+}
+
 AstNode *typecheck_assignment_expr(AstNode *expr, Scope *scope,
                                    ArenaAllocator *arena) {
   AstNode *target_type =
@@ -207,6 +383,9 @@ AstNode *typecheck_assignment_expr(AstNode *expr, Scope *scope,
   if (!target_type || !value_type)
     return NULL;
 
+  if (!check_pure_write(expr, expr->expr.assignment.target, scope))
+    return NULL;
+
   // Check that assignment target is mutable
   if (expr->expr.assignment.target->type == AST_EXPR_IDENTIFIER) {
     const char *var_name = expr->expr.assignment.target->expr.identifier.name;
@@ -218,6 +397,31 @@ AstNode *typecheck_assignment_expr(AstNode *expr, Scope *scope,
     }
   }
 
+  // Vector lanes are written one at a time, v[i] = value, through the
+  // variable holding the vector
+  AstNode *target = expr->expr.assignment.target;
+  AstNode *lanes_of = NULL;
+  if (target->type == AST_EXPR_INDEX)
+    lanes_of = target->expr.index.object;
+  else if (target->type == AST_EXPR_MEMBER)
+    lanes_of = target->expr.member.object;
+  if (lanes_of && is_vector_type(lanes_of->expr.checked_type)) {
+    if (target->type == AST_EXPR_MEMBER ||
+        lanes_of->type != AST_EXPR_IDENTIFIER) {
+      tc_error_help(expr, "Type Error",
+                    "Assign vector lanes with v[i] = value on a variable",
+                    "Cannot assign to this lane of '%s'",
+                    type_to_string(lanes_of->expr.checked_type, arena));
+      return NULL;
+    }
+    Symbol *sym = scope_lookup(scope, lanes_of->expr.identifier.name);
+    if (sym && !sym->is_mutable) {
+      tc_error(expr, "Type Error", "Cannot assign to immutable variable '%s'",
+               lanes_of->expr.identifier.name);
+      return NULL;
+    }
+  }
+
   // Determine function scope for ownership checks
   bool in_returns_ownership_func = false;
   Scope *func_scope = scope;
@@ -245,8 +449,7 @@ AstNode *typecheck_assignment_expr(AstNode *expr, Scope *scope,
             func_name = func_scope->associated_node->stmt.func_decl.name;
           }
           static_memory_track_alloc(analyzer, expr->line, expr->column,
-                                    var_name, func_name, g_tokens,
-                                    g_token_count, g_file_path);
+                                    var_name, func_name, g_lines, g_file_path);
         }
       }
     }
@@ -278,8 +481,7 @@ AstNode *typecheck_assignment_expr(AstNode *expr, Scope *scope,
         const char *func_name = get_current_function_name(scope);
         if (var_name) {
           static_memory_track_alloc(analyzer, expr->line, expr->column,
-                                    var_name, func_name, g_tokens,
-                                    g_token_count, g_file_path);
+                                    var_name, func_name, g_lines, g_file_path);
         }
       }
     }
@@ -454,6 +656,9 @@ AstNode *typecheck_call_expr(AstNode *expr, Scope *scope,
         return NULL;
       }
 
+      if (base_type->type == AST_TYPE_VECTOR)
+        return typecheck_vector_method(expr, base_type, arena);
+
       // Resolve base_type to actual struct type (handle pointers, basic types,
       // etc.)
       if (base_type->type == AST_TYPE_POINTER) {
@@ -499,6 +704,16 @@ AstNode *typecheck_call_expr(AstNode *expr, Scope *scope,
           func_symbol->takes_ownership = false;
           func_name = member_name;
 
+          // #pure and the like are kept on the method's qualified name
+          size_t method_ql = strlen(base_type->type_data.struct_type.name) +
+                             strlen(member_name) + 2;
+          char *method_qn = arena_alloc(arena, method_ql, 1);
+          snprintf(method_qn, method_ql, "%s.%s",
+                   base_type->type_data.struct_type.name, member_name);
+          Symbol *method_symbol = scope_lookup(scope, method_qn);
+          func_symbol->attributes =
+              method_symbol ? method_symbol->attributes : 0;
+
           // CRITICAL FIX: Use the base expression directly, not just base_name
           // This handles complex expressions like p.instr.push_back
           if (!base_expr) {
@@ -506,6 +721,13 @@ AstNode *typecheck_call_expr(AstNode *expr, Scope *scope,
             return NULL;
           }
 
+          // Checked before (the language server checks a tree again): the
+          // object is the first argument already
+          if (expr->expr.call.self_added) {
+            is_method_call = true;
+            goto process_call;
+          }
+
           size_t new_arg_count = arg_count + 1;
           AstNode **new_arguments = arena_alloc(
               arena, new_arg_count * sizeof(AstNode *), alignof(AstNode *));
@@ -540,12 +762,8 @@ AstNode *typecheck_call_expr(AstNode *expr, Scope *scope,
                         ->type->type == AST_TYPE_POINTER));
 
           if (expects_pointer && !have_pointer) {
-            AstNode *addr_expr =
-                arena_alloc(arena, sizeof(AstNode), alignof(AstNode));
-            addr_expr->type = AST_EXPR_ADDR;
-            addr_expr->category = Node_Category_EXPR;
-            addr_expr->line = base_expr->line;
-            addr_expr->column = base_expr->column;
+            AstNode *addr_expr = create_expr_node(
+                arena, AST_EXPR_ADDR, base_expr->line, base_expr->column);
             addr_expr->expr.addr.object = base_expr;
             new_arguments[0] = addr_expr;
           } else {
@@ -561,6 +779,7 @@ AstNode *typecheck_call_expr(AstNode *expr, Scope *scope,
           is_method_call = true;
           expr->expr.call.args = new_arguments;
           expr->expr.call.arg_count = new_arg_count;
+          expr->expr.call.self_added = true;
         } else if (member_type) {
           tc_error(expr, "Runtime Call Error",
                    "Cannot call non-function member '%s' on struct '%s'",
@@ -635,6 +854,9 @@ AstNode *typecheck_call_expr(AstNode *expr, Scope *scope,
     return NULL;
   }
 
+  if (!check_pure_call(expr, func_symbol, func_name, scope))
+    return NULL;
+
   AstNode **param_types = func_type->type_data.function.param_types;
   size_t param_count = func_type->type_data.function.param_count;
   AstNode *return_type = func_type->type_data.function.return_type;
@@ -833,7 +1055,7 @@ AstNode *typecheck_index_expr(AstNode *expr, Scope *scope,
 
   if (expr->expr.index.object->type == AST_EXPR_IDENTIFIER) {
     StaticMemoryAnalyzer *analyzer = get_static_analyzer(scope);
-    if (analyzer && g_tokens && g_token_count > 0 && g_file_path &&
+    if (analyzer && g_lines && g_file_path &&
         scope->config && scope->config->check_mem) {
       const char *var_name = expr->expr.index.object->expr.identifier.name;
 
@@ -849,7 +1071,7 @@ AstNode *typecheck_index_expr(AstNode *expr, Scope *scope,
       static_memory_check_use_after_free(analyzer, var_name,
                                          expr->expr.index.object->line,
                                          expr->expr.index.object->column, arena,
-                                         g_tokens, g_token_count, g_file_path,
+                                         g_lines, g_file_path,
                                          func_name);
     }
   }
@@ -861,6 +1083,9 @@ AstNode *typecheck_index_expr(AstNode *expr, Scope *scope,
              "Failed to determine type of indexed expression");
     return NULL;
   }
+  if (object_type->type == AST_TYPE_POINTER &&
+      !check_const_deref(expr, expr->expr.index.object, scope))
+    return NULL;
 
   AstNode *index_type =
       typecheck_expression(expr->expr.index.index, scope, arena);
@@ -873,7 +1098,8 @@ AstNode *typecheck_index_expr(AstNode *expr, Scope *scope,
   if (!is_integer_type(index_type)) {
     tc_error_help(
         expr, "Index Type Error",
-        "Array and pointer indices must be integer types (int or char)",
+        "Array, pointer and vector indices must be integer types (int or "
+        "char)",
         "Index has type '%s', expected integer type",
         type_to_string(index_type, arena));
     return NULL;
@@ -895,13 +1121,16 @@ AstNode *typecheck_index_expr(AstNode *expr, Scope *scope,
     }
     return pointee_type;
 
+  } else if (object_type->type == AST_TYPE_VECTOR) {
+    return object_type->type_data.vector.element_type;
+
   } else if (object_type->type == AST_TYPE_BASIC &&
              strcmp(object_type->type_data.basic.name, "string") == 0) {
     return create_basic_type(arena, "char", expr->line, expr->column);
 
   } else {
     tc_error_help(expr, "Index Error",
-                  "Only arrays, pointers, and strings can be indexed",
+                  "Only arrays, pointers, vectors and strings can be indexed",
                   "Cannot index expression of type '%s'",
                   type_to_string(object_type, arena));
     return NULL;
@@ -930,9 +1159,8 @@ AstNode *typecheck_member_expr(AstNode *expr, Scope *scope,
       // First try module-qualified symbol lookup
       Symbol *module_symbol =
           lookup_qualified_symbol(scope, base_name, member_name);
-      if (module_symbol) {
+      if (module_symbol)
         return module_symbol->type;
-      }
 
       // Try direct symbol lookup (for enum types in current scope)
       Symbol *base_symbol = scope_lookup(scope, base_name);
@@ -971,7 +1199,8 @@ AstNode *typecheck_member_expr(AstNode *expr, Scope *scope,
     } else if (base_object->type == AST_EXPR_MEMBER) {
       // Chained case: ast::ExprKind::EXPR_NUMBER
       // First resolve the inner member expression recursively
-      base_type = typecheck_member_expr(base_object, scope, arena);
+      base_type = record_checked_type(
+          base_object, typecheck_member_expr(base_object, scope, arena));
       if (!base_type) {
         tc_error(expr, "Compile-time Access Error",
                  "Failed to resolve base expression in chained access");
@@ -1146,11 +1375,18 @@ AstNode *typecheck_member_expr(AstNode *expr, Scope *scope,
       return NULL;
     }
 
+    if (base_type->type == AST_TYPE_VECTOR)
+      return typecheck_vector_swizzle(expr, base_type, arena);
+
+    if (base_type->type == AST_TYPE_POINTER &&
+        !check_const_deref(expr, base_object, scope))
+      return NULL;
+
     // Check use-after-free for pointer-to-struct member access
     if (base_type->type == AST_TYPE_POINTER &&
         base_object->type == AST_EXPR_IDENTIFIER) {
       StaticMemoryAnalyzer *analyzer = get_static_analyzer(scope);
-      if (analyzer && g_tokens && g_token_count > 0 && g_file_path &&
+      if (analyzer && g_lines && g_file_path &&
           scope->config && scope->config->check_mem) {
         const char *var_name = base_object->expr.identifier.name;
         const char *func_name = NULL;
@@ -1164,7 +1400,7 @@ AstNode *typecheck_member_expr(AstNode *expr, Scope *scope,
         static_memory_check_use_after_free(analyzer, var_name,
                                            base_object->line,
                                            base_object->column, arena,
-                                           g_tokens, g_token_count,
+                                           g_lines,
                                            g_file_path, func_name);
       }
     }
@@ -1314,7 +1550,7 @@ AstNode *typecheck_deref_expr(AstNode *expr, Scope *scope,
                               ArenaAllocator *arena) {
   if (expr->expr.deref.object->type == AST_EXPR_IDENTIFIER) {
     StaticMemoryAnalyzer *analyzer = get_static_analyzer(scope);
-    if (analyzer && g_tokens && g_token_count > 0 && g_file_path &&
+    if (analyzer && g_lines && g_file_path &&
         scope->config && scope->config->check_mem) {
       const char *var_name = expr->expr.deref.object->expr.identifier.name;
 
@@ -1330,7 +1566,7 @@ AstNode *typecheck_deref_expr(AstNode *expr, Scope *scope,
       static_memory_check_use_after_free(analyzer, var_name,
                                          expr->expr.deref.object->line,
                                          expr->expr.deref.object->column, arena,
-                                         g_tokens, g_token_count, g_file_path,
+                                         g_lines, g_file_path,
                                          func_name);
     }
   }
@@ -1346,6 +1582,8 @@ AstNode *typecheck_deref_expr(AstNode *expr, Scope *scope,
     tc_error(expr, "Type Error", "Cannot dereference non-pointer type");
     return NULL;
   }
+  if (!check_const_deref(expr, expr->expr.deref.object, scope))
+    return NULL;
   return pointer_type->type_data.pointer.pointee_type;
 }
 
@@ -1486,8 +1724,7 @@ AstNode *typecheck_free_expr(AstNode *expr, Scope *scope,
     // Only warn about non-allocated free when it's &variable (reliably wrong)
     if (expr->expr.free.ptr->type == AST_EXPR_ADDR) {
       static_memory_check_free_nonalloc(analyzer, var_name, expr->line,
-                                         expr->column, g_tokens,
-                                         g_token_count, g_file_path,
+                                         expr->column, g_lines, g_file_path,
                                          func_name, arena);
     }
     static_memory_track_free(analyzer, var_name, func_name,
@@ -1497,11 +1734,349 @@ AstNode *typecheck_free_expr(AstNode *expr, Scope *scope,
   return create_basic_type(arena, "void", expr->line, expr->column);
 }
 
+// Typechecks a builtin argument, returning its type when accepts() takes it
+static AstNode *builtin_arg(AstNode *expr, const char *builtin, AstNode *arg,
+                            Scope *scope, ArenaAllocator *arena,
+                            bool (*accepts)(AstNode *), const char *expected) {
+  AstNode *type = typecheck_expression(arg, scope, arena);
+  if (!type)
+    return NULL;
+  if (!accepts(type)) {
+    tc_error(expr, "Builtin Argument Error", "%s expects %s, got '%s'",
+             builtin, expected, type_to_string(type, arena));
+    return NULL;
+  }
+  return type;
+}
+
+// @memcpy(dest, src, n): n bytes from src to dest, which must not overlap
 AstNode *typecheck_memcpy_expr(AstNode *expr, Scope *scope,
                                ArenaAllocator *arena) {
-  (void)expr;
-  (void)scope;
-  (void)arena;
+  if (!builtin_arg(expr, "@memcpy", expr->expr.memcpy.to, scope, arena,
+                   is_pointer_type, "a destination pointer") ||
+      !builtin_arg(expr, "@memcpy", expr->expr.memcpy.from, scope, arena,
+                   is_pointer_type, "a source pointer") ||
+      !builtin_arg(expr, "@memcpy", expr->expr.memcpy.size, scope, arena,
+                   is_integer_type, "an integer byte count"))
+    return NULL;
+  return create_basic_type(arena, "void", expr->line, expr->column);
+}
+
+// Types an atomic instruction can work on: integers, floating point and
+// pointers. bool is a single bit, which LLVM can't access atomically.
+static bool is_atomic_type(AstNode *type) {
+  if (is_integer_type(type) || is_pointer_type(type))
+    return true;
+  return type && type->category == Node_Category_TYPE &&
+         type->type == AST_TYPE_BASIC &&
+         (strcmp(type->type_data.basic.name, "float") == 0 ||
+          strcmp(type->type_data.basic.name, "double") == 0);
+}
+
+static bool is_floating_type(AstNode *type) {
+  return is_atomic_type(type) && !is_integer_type(type) &&
+         !is_pointer_type(type);
+}
+
+// The ordering arguments are bare names, never looked up in scope
+static bool atomic_order_arg(AstNode *expr, const char *builtin, AstNode *arg,
+                             AtomicOrder *order) {
+  if (arg->type != AST_EXPR_IDENTIFIER ||
+      !atomic_order_from_string(arg->expr.identifier.name, order)) {
+    tc_error_help(expr, "Builtin Argument Error",
+                  "Orderings are relaxed, acquire, release, acq_rel and "
+                  "seq_cst",
+                  "%s expects a memory ordering", builtin);
+    return false;
+  }
+  return true;
+}
+
+// A value stored through an atomic pointer: the pointee's type, or another
+// integer or floating point type codegen converts from
+static bool atomic_value_arg(AstNode *expr, const char *builtin, AstNode *arg,
+                             AstNode *pointee, Scope *scope,
+                             ArenaAllocator *arena) {
+  AstNode *type = typecheck_expression(arg, scope, arena);
+  if (!type)
+    return false;
+  if (types_match(pointee, type) != TYPE_MATCH_NONE ||
+      (is_integer_type(pointee) && is_integer_type(type)))
+    return true;
+  tc_error(expr, "Builtin Argument Error", "%s stores '%s', got '%s'", builtin,
+           type_to_string(pointee, arena), type_to_string(type, arena));
+  return false;
+}
+
+// @atomic_load, @atomic_store, @atomic_rmw, @atomic_cas and @fence. The
+// first argument points at the value, the ordering comes last and defaults
+// to seq_cst.
+static AstNode *typecheck_atomic_builtin(AstNode *expr, Scope *scope,
+                                         ArenaAllocator *arena) {
+  BuiltinKind kind = expr->expr.builtin.kind;
+  AstNode **args = expr->expr.builtin.args;
+  size_t arg_count = expr->expr.builtin.arg_count;
+  const char *name = builtin_to_string(kind);
+
+  // Arguments before the orderings, and how many orderings may follow
+  size_t operands = 0;
+  size_t orderings = 1;
+  switch (kind) {
+  case BUILTIN_ATOMIC_LOAD:
+    operands = 1;
+    break;
+  case BUILTIN_ATOMIC_STORE:
+    operands = 2;
+    break;
+  case BUILTIN_ATOMIC_RMW:
+  case BUILTIN_ATOMIC_CAS:
+    operands = 3;
+    orderings = kind == BUILTIN_ATOMIC_CAS ? 2 : 1;
+    break;
+  default:
+    break;
+  }
+
+  if (arg_count < operands || arg_count > operands + orderings) {
+    tc_error(expr, "Argument Count Error",
+             "%s takes %zu to %zu arguments, got %zu", name, operands,
+             operands + orderings, arg_count);
+    return NULL;
+  }
+
+  AtomicOrder order = ATOMIC_SEQ_CST;
+  if (arg_count > operands &&
+      !atomic_order_arg(expr, name, args[operands], &order))
+    return NULL;
+
+  // Loads only acquire, stores only release, and a fence that orders
+  // nothing is no fence
+  if ((kind == BUILTIN_ATOMIC_LOAD &&
+       (order == ATOMIC_RELEASE || order == ATOMIC_ACQ_REL)) ||
+      (kind == BUILTIN_ATOMIC_STORE &&
+       (order == ATOMIC_ACQUIRE || order == ATOMIC_ACQ_REL)) ||
+      (kind == BUILTIN_FENCE && order == ATOMIC_RELAXED)) {
+    tc_error(expr, "Builtin Argument Error", "%s can't be %s", name,
+             args[operands]->expr.identifier.name);
+    return NULL;
+  }
+
+  if (kind == BUILTIN_FENCE)
+    return create_basic_type(arena, "void", expr->line, expr->column);
+
+  // A failed compare-exchange only loads
+  if (kind == BUILTIN_ATOMIC_CAS && arg_count == 5) {
+    AtomicOrder failure;
+    if (!atomic_order_arg(expr, name, args[4], &failure))
+      return NULL;
+    if (failure == ATOMIC_RELEASE || failure == ATOMIC_ACQ_REL) {
+      tc_error_help(expr, "Builtin Argument Error",
+                    "The failure ordering is relaxed, acquire or seq_cst",
+                    "%s can't fail with %s", name,
+                    args[4]->expr.identifier.name);
+      return NULL;
+    }
+  }
+
+  AstNode *ptr_type = builtin_arg(expr, name, args[0], scope, arena,
+                                  is_pointer_type, "a pointer");
+  if (!ptr_type)
+    return NULL;
+  AstNode *pointee = ptr_type->type_data.pointer.pointee_type;
+  if (!is_atomic_type(pointee)) {
+    tc_error_help(expr, "Builtin Argument Error",
+                  "Atomics work on int, char, float, double and pointers; "
+                  "keep a flag in a char",
+                  "%s can't access '%s' atomically", name,
+                  type_to_string(pointee, arena));
+    return NULL;
+  }
+
+  switch (kind) {
+  case BUILTIN_ATOMIC_LOAD:
+    return pointee;
+
+  case BUILTIN_ATOMIC_STORE:
+    if (!atomic_value_arg(expr, name, args[1], pointee, scope, arena))
+      return NULL;
+    return create_basic_type(arena, "void", expr->line, expr->column);
+
+  case BUILTIN_ATOMIC_RMW: {
+    AtomicRmwOp op;
+    if (args[1]->type != AST_EXPR_IDENTIFIER ||
+        !atomic_rmw_op_from_string(args[1]->expr.identifier.name, &op)) {
+      tc_error_help(expr, "Builtin Argument Error",
+                    "Operations are xchg, add, sub, and, or, xor, nand, min "
+                    "and max",
+                    "%s expects an operation", name);
+      return NULL;
+    }
+    // Pointers can only be exchanged, floating point values also added
+    // and subtracted
+    bool allowed = op == ATOMIC_RMW_XCHG || is_integer_type(pointee) ||
+                   (is_floating_type(pointee) &&
+                    (op == ATOMIC_RMW_ADD || op == ATOMIC_RMW_SUB));
+    if (!allowed) {
+      tc_error(expr, "Builtin Argument Error", "%s can't %s a '%s'", name,
+               args[1]->expr.identifier.name, type_to_string(pointee, arena));
+      return NULL;
+    }
+    if (!atomic_value_arg(expr, name, args[2], pointee, scope, arena))
+      return NULL;
+    return pointee;
+  }
+
+  case BUILTIN_ATOMIC_CAS:
+    if (!atomic_value_arg(expr, name, args[1], pointee, scope, arena) ||
+        !atomic_value_arg(expr, name, args[2], pointee, scope, arena))
+      return NULL;
+    return pointee;
+
+  default:
+    break;
+  }
+
+  tc_error(expr, "Internal Error", "Unknown builtin %d", (int)kind);
+  return NULL;
+}
+
+AstNode *typecheck_builtin_expr(AstNode *expr, Scope *scope,
+                                ArenaAllocator *arena) {
+  if (expr->expr.builtin.kind >= BUILTIN_ATOMIC_LOAD)
+    return typecheck_atomic_builtin(expr, scope, arena);
+
+  BuiltinKind kind = expr->expr.builtin.kind;
+  AstNode **args = expr->expr.builtin.args;
+  size_t arg_count = expr->expr.builtin.arg_count;
+  const char *name = builtin_to_string(kind);
+
+  size_t expected = 1;
+  if (kind == BUILTIN_MEMMOVE || kind == BUILTIN_MEMSET)
+    expected = 3;
+  else if (kind == BUILTIN_EXPECT || kind == BUILTIN_WRAPPING_ADD ||
+           kind == BUILTIN_WRAPPING_SUB || kind == BUILTIN_WRAPPING_MUL)
+    expected = 2;
+  else if (kind == BUILTIN_PREFETCH && arg_count == 3)
+    expected = 3;
+  else if (kind == BUILTIN_RDTSC)
+    expected = 0;
+
+  if (arg_count != expected) {
+    tc_error(expr, "Argument Count Error", "%s takes %zu argument%s, got %zu",
+             name, expected, expected == 1 ? "" : "s", arg_count);
+    return NULL;
+  }
+
+  switch (kind) {
+  case BUILTIN_MEMMOVE:
+  case BUILTIN_MEMSET:
+    if (!builtin_arg(expr, name, args[0], scope, arena, is_pointer_type,
+                     "a destination pointer") ||
+        !(kind == BUILTIN_MEMMOVE
+              ? builtin_arg(expr, name, args[1], scope, arena, is_pointer_type,
+                            "a source pointer")
+              : builtin_arg(expr, name, args[1], scope, arena,
+                            is_integer_type, "an integer byte value")) ||
+        !builtin_arg(expr, name, args[2], scope, arena, is_integer_type,
+                     "an integer byte count"))
+      return NULL;
+    return create_basic_type(arena, "void", expr->line, expr->column);
+
+  case BUILTIN_CLZ:
+  case BUILTIN_CTZ:
+  case BUILTIN_POPCOUNT:
+  case BUILTIN_BSWAP:
+    return builtin_arg(expr, name, args[0], scope, arena, is_integer_type,
+                       "an integer");
+
+  case BUILTIN_EXPECT: {
+    AstNode *type = typecheck_expression(args[0], scope, arena);
+    if (!type)
+      return NULL;
+    if (!is_integer_type(type) && !is_bool_type(type)) {
+      tc_error(expr, "Builtin Argument Error",
+               "@expect expects an integer or bool, got '%s'",
+               type_to_string(type, arena));
+      return NULL;
+    }
+    // The expected value is folded into branch weights, so it must be known
+    // now
+    AstNode *value = args[1];
+    if (value->type != AST_EXPR_LITERAL ||
+        (value->expr.literal.lit_type != LITERAL_INT &&
+         value->expr.literal.lit_type != LITERAL_BOOL)) {
+      tc_error(expr, "Builtin Argument Error",
+               "@expect needs a literal as the expected value");
+      return NULL;
+    }
+    if (!typecheck_expression(value, scope, arena))
+      return NULL;
+    return type;
+  }
+
+  case BUILTIN_LIKELY:
+  case BUILTIN_UNLIKELY:
+    return builtin_arg(expr, name, args[0], scope, arena, is_bool_type,
+                       "a bool condition");
+
+  case BUILTIN_ASSUME:
+    if (!builtin_arg(expr, name, args[0], scope, arena, is_bool_type,
+                     "a bool condition"))
+      return NULL;
+    return create_basic_type(arena, "void", expr->line, expr->column);
+
+  case BUILTIN_RDTSC:
+    return create_basic_type(arena, "int", expr->line, expr->column);
+
+  // Any value passes through unchanged
+  case BUILTIN_BLACK_BOX:
+    return typecheck_expression(args[0], scope, arena);
+
+  // The result has the first operand's type; the second converts to it
+  case BUILTIN_WRAPPING_ADD:
+  case BUILTIN_WRAPPING_SUB:
+  case BUILTIN_WRAPPING_MUL: {
+    AstNode *type = builtin_arg(expr, name, args[0], scope, arena,
+                                is_integer_type, "an integer");
+    if (!type || !builtin_arg(expr, name, args[1], scope, arena,
+                              is_integer_type, "an integer"))
+      return NULL;
+    return type;
+  }
+
+  case BUILTIN_PREFETCH:
+    if (!builtin_arg(expr, name, args[0], scope, arena, is_pointer_type,
+                     "a pointer"))
+      return NULL;
+    // @prefetch(ptr, rw, locality): 0 = read or 1 = write, and how long to
+    // keep the line cached, from 0 (not at all) to 3 (in every level)
+    for (size_t i = 1; i < arg_count; i++) {
+      AstNode *arg = args[i];
+      long long max = i == 1 ? 1 : 3;
+      if (arg->type != AST_EXPR_LITERAL ||
+          arg->expr.literal.lit_type != LITERAL_INT ||
+          arg->expr.literal.value.int_val < 0 ||
+          arg->expr.literal.value.int_val > max) {
+        tc_error_help(expr, "Builtin Argument Error",
+                      "Use @prefetch(ptr) or @prefetch(ptr, rw, locality)",
+                      "%s must be a literal from 0 to %lld",
+                      i == 1 ? "rw" : "locality", max);
+        return NULL;
+      }
+      if (!typecheck_expression(arg, scope, arena))
+        return NULL;
+    }
+    return create_basic_type(arena, "void", expr->line, expr->column);
+
+  case BUILTIN_ATOMIC_LOAD:
+  case BUILTIN_ATOMIC_STORE:
+  case BUILTIN_ATOMIC_RMW:
+  case BUILTIN_ATOMIC_CAS:
+  case BUILTIN_FENCE:
+    break; // typecheck_atomic_builtin
+  }
+
+  tc_error(expr, "Internal Error", "Unknown builtin %d", (int)kind);
   return NULL;
 }
 
@@ -1781,8 +2356,9 @@ AstNode *typecheck_array_expr(AstNode *expr, Scope *scope,
     if (elements[i]->type == AST_EXPR_STRUCT &&
         !elements[i]->expr.struct_expr.name) {
       // Anonymous struct - use internal function with expected type
-      element_type = typecheck_struct_expr_internal(elements[i], scope, arena,
-                                                    first_element_type);
+      element_type = record_checked_type(
+          elements[i], typecheck_struct_expr_internal(elements[i], scope, arena,
+                                                      first_element_type));
     } else {
       // Regular expression - typecheck normally
       element_type = typecheck_expression(elements[i], scope, arena);
@@ -0,0 +1,1244 @@
+// generics.c - Monomorphization of generic functions and structs
+//
+// `fn<T>(...)` and `struct<T> { ... }` declare templates, which nothing
+// checks or generates directly. This pass runs between parsing and
+// typechecking and replaces every Name<Args> with a copy of the template
+// made for those arguments, named after them ("Vector<int>"). From then on
+// an instance is an ordinary function or struct, so the typechecker sees
+// concrete types and codegen gives each instance its own typed LLVM
+// functions.
+//
+// An instance is placed in the module that uses it, right before the first
+// declaration needing it, since its type arguments (a struct of that module,
+// say) may not be visible where the template was written. Names the
+// template takes from its own module are qualified with the user's alias
+// for that module, so they have to be public there. Every module keeps
+// private copies of the instances it uses.
+#include <stdio.h>
+#include <string.h>
+
+#include "type.h"
+
+// Instances that instantiate further generics, like a Vector<Vector<int>>,
+// stop nesting here; it catches templates that grow their own arguments
+#define GENERIC_DEPTH_LIMIT 64
+
+typedef struct {
+  ArenaAllocator *arena;
+  AstNode *program;
+  AstNode *module;       // The module being rewritten, which gets instances
+  GrowableArray body;    // Its new body, instances before their first use
+  GrowableArray names;   // Atom names of the instances it already has
+  bool ok;
+} Instantiator;
+
+// Where the code being walked was written
+typedef struct {
+  AstNode *origin;   // Module of the template, or the module itself
+  const char *alias; // The module's alias for origin; NULL when they're one
+  GrowableArray *locals; // Names the enclosing function binds itself
+  // Type arguments copied into the template, which were written in the
+  // module being rewritten rather than in origin
+  GrowableArray *spliced;
+  int depth;
+} Context;
+
+typedef struct {
+  char **params;
+  AstNode **args;
+  size_t count;
+  GrowableArray *spliced; // Receives each copy of an argument
+} Substitution;
+
+static void rewrite(Instantiator *in, Context *cx, AstNode *node);
+
+// ============================================================================
+// Declarations
+// ============================================================================
+
+static bool is_template(const AstNode *node) {
+  return node &&
+         ((node->type == AST_STMT_FUNCTION &&
+           node->stmt.func_decl.type_param_count) ||
+          (node->type == AST_STMT_STRUCT &&
+           node->stmt.struct_decl.type_param_count));
+}
+
+static const char *decl_name(const AstNode *node) {
+  switch (node->type) {
+  case AST_STMT_FUNCTION:
+    return node->stmt.func_decl.name;
+  case AST_STMT_STRUCT:
+    return node->stmt.struct_decl.name;
+  case AST_STMT_ENUM:
+    return node->stmt.enum_decl.name;
+  case AST_STMT_VAR_DECL:
+    return node->stmt.var_decl.name;
+  default:
+    return NULL;
+  }
+}
+
+static bool decl_is_public(const AstNode *node) {
+  switch (node->type) {
+  case AST_STMT_FUNCTION:
+    return node->stmt.func_decl.is_public;
+  case AST_STMT_STRUCT:
+    return node->stmt.struct_decl.is_public;
+  case AST_STMT_ENUM:
+    return node->stmt.enum_decl.is_public;
+  case AST_STMT_VAR_DECL:
+    return node->stmt.var_decl.is_public;
+  default:
+    return false;
+  }
+}
+
+static AstNode *find_program_module(AstNode *program, const char *name) {
+  for (size_t i = 0; i < program->stmt.program.module_count; i++) {
+    AstNode *module = program->stmt.program.modules[i];
+    if (module && module->type == AST_PREPROCESSOR_MODULE &&
+        strcmp(module->preprocessor.module.name, name) == 0)
+      return module;
+  }
+  return NULL;
+}
+
+// The @use in @p module that imports under @p alias
+static AstNode *find_use(AstNode *module, const char *alias) {
+  for (size_t i = 0; i < module->preprocessor.module.body_count; i++) {
+    AstNode *stmt = module->preprocessor.module.body[i];
+    if (stmt && stmt->type == AST_PREPROCESSOR_USE &&
+        stmt->preprocessor.use.alias &&
+        strcmp(stmt->preprocessor.use.alias, alias) == 0)
+      return stmt;
+  }
+  return NULL;
+}
+
+// @p module's alias for the module named @p name, NULL if it doesn't use it
+static const char *alias_for(AstNode *module, const char *name) {
+  for (size_t i = 0; i < module->preprocessor.module.body_count; i++) {
+    AstNode *stmt = module->preprocessor.module.body[i];
+    if (stmt && stmt->type == AST_PREPROCESSOR_USE &&
+        strcmp(stmt->preprocessor.use.module_name, name) == 0)
+      return stmt->preprocessor.use.alias;
+  }
+  return NULL;
+}
+
+// A top-level declaration of @p module; templates only when @p generic
+static AstNode *find_decl(AstNode *module, const char *name, bool generic) {
+  for (size_t i = 0; i < module->preprocessor.module.body_count; i++) {
+    AstNode *stmt = module->preprocessor.module.body[i];
+    if (!stmt || is_template(stmt) != generic)
+      continue;
+    const char *stmt_name = decl_name(stmt);
+    if (stmt_name && strcmp(stmt_name, name) == 0)
+      return stmt;
+  }
+  return NULL;
+}
+
+static bool is_local(const Context *cx, const char *name) {
+  if (strcmp(name, "self") == 0)
+    return true;
+  if (!cx->locals)
+    return false;
+  for (size_t i = 0; i < cx->locals->count; i++) {
+    if (strcmp(((const char **)cx->locals->data)[i], name) == 0)
+      return true;
+  }
+  return false;
+}
+
+// ============================================================================
+// Instance names
+// ============================================================================
+
+typedef struct {
+  char text[1024];
+  size_t length;
+  bool truncated;
+} Spelling;
+
+static void spell(Spelling *out, const char *text) {
+  size_t length = strlen(text);
+  if (out->length + length >= sizeof(out->text)) {
+    out->truncated = true;
+    return;
+  }
+  memcpy(out->text + out->length, text, length + 1);
+  out->length += length;
+}
+
+// Luma's own spelling of a type, for the names of instances
+static void spell_type(Spelling *out, const AstNode *type) {
+  char number[32];
+  switch (type->type) {
+  case AST_TYPE_BASIC:
+    spell(out, type->type_data.basic.name);
+    return;
+  case AST_TYPE_RESOLUTION:
+    for (size_t i = 0; i < type->type_data.resolution.part_count; i++) {
+      if (i)
+        spell(out, "::");
+      spell(out, type->type_data.resolution.parts[i]);
+    }
+    return;
+  case AST_TYPE_POINTER:
+    spell(out, "*");
+    spell_type(out, type->type_data.pointer.pointee_type);
+    return;
+  case AST_TYPE_ARRAY: {
+    const AstNode *size = type->type_data.array.size;
+    spell(out, "[");
+    spell_type(out, type->type_data.array.element_type);
+    spell(out, "; ");
+    if (size && size->type == AST_EXPR_LITERAL) {
+      snprintf(number, sizeof(number), "%lld", size->expr.literal.value.int_val);
+      spell(out, number);
+    } else if (size && size->type == AST_EXPR_IDENTIFIER) {
+      spell(out, size->expr.identifier.name);
+    } else {
+      spell(out, "?");
+    }
+    spell(out, "]");
+    return;
+  }
+  case AST_TYPE_VECTOR:
+    spell(out, "vec<");
+    spell_type(out, type->type_data.vector.element_type);
+    snprintf(number, sizeof(number), ", %zu>",
+             type->type_data.vector.lane_count);
+    spell(out, number);
+    return;
+  case AST_TYPE_FUNCTION:
+    spell(out, "fn(");
+    for (size_t i = 0; i < type->type_data.function.param_count; i++) {
+      if (i)
+        spell(out, ", ");
+      spell_type(out, type->type_data.function.param_types[i]);
+    }
+    spell(out, ") ");
+    spell_type(out, type->type_data.function.return_type);
+    return;
+  default:
+    spell(out, "?");
+    return;
+  }
+}
+
+static Atom instance_name(const char *name, AstNode **args, size_t count) {
+  Spelling out = {.length = 0, .truncated = false};
+  out.text[0] = '\0';
+  spell(&out, name);
+  spell(&out, "<");
+  for (size_t i = 0; i < count; i++) {
+    if (i)
+      spell(&out, ", ");
+    spell_type(&out, args[i]);
+  }
+  spell(&out, ">");
+  return out.truncated ? NULL : intern(out.text);
+}
+
+// ============================================================================
+// Copying templates
+// ============================================================================
+
+static AstNode *clone(ArenaAllocator *arena, const AstNode *node,
+                      const Substitution *sub);
+
+static AstNode **clone_list(ArenaAllocator *arena, AstNode **list,
+                            size_t count, const Substitution *sub) {
+  if (!list || !count)
+    return list;
+  AstNode **copy =
+      arena_alloc(arena, count * sizeof(AstNode *), alignof(AstNode *));
+  for (size_t i = 0; i < count; i++)
+    copy[i] = clone(arena, list[i], sub);
+  return copy;
+}
+
+static void splice(const Substitution *sub, AstNode *node) {
+  AstNode **slot = growable_array_push(sub->spliced);
+  if (slot)
+    *slot = node;
+}
+
+static AstNode *type_argument(const Substitution *sub, const char *name) {
+  for (size_t i = 0; i < sub->count; i++) {
+    if (strcmp(sub->params[i], name) == 0)
+      return sub->args[i];
+  }
+  return NULL;
+}
+
+// T used where a name goes, as in T::create() or T { ... }
+static void substitute_name(ArenaAllocator *arena, AstNode *node,
+                            const char *name, const Substitution *sub) {
+  AstNode *arg = type_argument(sub, name);
+  if (!arg)
+    return;
+
+  splice(sub, node);
+  if (arg->type == AST_TYPE_BASIC) {
+    node->expr.identifier.name = (char *)arg->type_data.basic.name;
+    node->expr.identifier.type_args =
+        clone_list(arena, arg->type_data.basic.type_args,
+                   arg->type_data.basic.type_arg_count, NULL);
+    node->expr.identifier.type_arg_count = arg->type_data.basic.type_arg_count;
+  } else if (arg->type == AST_TYPE_RESOLUTION &&
+             arg->type_data.resolution.part_count == 2) {
+    AstNode *module = create_identifier_expr(
+        arena, arg->type_data.resolution.parts[0], node->line, node->column);
+    node->type = AST_EXPR_MEMBER;
+    node->expr.member.is_compiletime = true;
+    node->expr.member.object = module;
+    node->expr.member.member = arg->type_data.resolution.parts[1];
+    node->expr.member.type_args =
+        clone_list(arena, arg->type_data.resolution.type_args,
+                   arg->type_data.resolution.type_arg_count, NULL);
+    node->expr.member.type_arg_count =
+        arg->type_data.resolution.type_arg_count;
+  }
+}
+
+// A deep copy of @p node with the type parameters in @p sub replaced; the
+// copy has no typechecker state
+static AstNode *clone(ArenaAllocator *arena, const AstNode *node,
+                      const Substitution *sub) {
+  if (!node)
+    return NULL;
+
+  if (sub && node->type == AST_TYPE_BASIC &&
+      !node->type_data.basic.type_arg_count) {
+    AstNode *arg = type_argument(sub, node->type_data.basic.name);
+    if (arg) {
+      AstNode *copy = clone(arena, arg, NULL);
+      splice(sub, copy);
+      return copy;
+    }
+  }
+
+  size_t size = ast_node_size(node->type);
+  AstNode *copy = arena_alloc(arena, size, alignof(AstNode));
+  memcpy(copy, node, size);
+
+#define CLONE(field) copy->field = clone(arena, node->field, sub)
+#define CLONE_LIST(field, count)                                               \
+  copy->field = clone_list(arena, node->field, node->count, sub)
+
+  switch (node->type) {
+  // Expressions
+  case AST_EXPR_IDENTIFIER:
+    CLONE_LIST(expr.identifier.type_args, expr.identifier.type_arg_count);
+    if (sub && !node->expr.identifier.type_arg_count)
+      substitute_name(arena, copy, node->expr.identifier.name, sub);
+    break;
+  case AST_EXPR_BINARY:
+    CLONE(expr.binary.left);
+    CLONE(expr.binary.right);
+    break;
+  case AST_EXPR_UNARY:
+    CLONE(expr.unary.operand);
+    break;
+  case AST_EXPR_CALL:
+    CLONE(expr.call.callee);
+    CLONE_LIST(expr.call.args, expr.call.arg_count);
+    break;
+  case AST_EXPR_ASSIGNMENT:
+    CLONE(expr.assignment.target);
+    CLONE(expr.assignment.value);
+    break;
+  case AST_EXPR_TERNARY:
+    CLONE(expr.ternary.condition);
+    CLONE(expr.ternary.then_expr);
+    CLONE(expr.ternary.else_expr);
+    break;
+  case AST_EXPR_MEMBER:
+    CLONE(expr.member.object);
+    CLONE_LIST(expr.member.type_args, expr.member.type_arg_count);
+    break;
+  case AST_EXPR_INDEX:
+    CLONE(expr.index.object);
+    CLONE(expr.index.index);
+    break;
+  case AST_EXPR_GROUPING:
+    CLONE(expr.grouping.expr);
+    break;
+  case AST_EXPR_ARRAY:
+    CLONE_LIST(expr.array.elements, expr.array.element_count);
+    break;
+  case AST_EXPR_DEREF:
+    CLONE(expr.deref.object);
+    break;
+  case AST_EXPR_ADDR:
+    CLONE(expr.addr.object);
+    break;
+  case AST_EXPR_ALLOC:
+    CLONE(expr.alloc.size);
+    break;
+  case AST_EXPR_MEMCPY:
+    CLONE(expr.memcpy.to);
+    CLONE(expr.memcpy.from);
+    CLONE(expr.memcpy.size);
+    break;
+  case AST_EXPR_FREE:
+    CLONE(expr.free.ptr);
+    break;
+  case AST_EXPR_CAST:
+    CLONE(expr.cast.type);
+    CLONE(expr.cast.castee);
+    break;
+  case AST_EXPR_INPUT:
+    CLONE(expr.input.type);
+    CLONE(expr.input.msg);
+    break;
+  case AST_EXPR_SIZEOF:
+    CLONE(expr.size_of.object);
+    break;
+  case AST_EXPR_SYSTEM:
+    CLONE(expr._system.command);
+    break;
+  case AST_EXPR_SYSCALL:
+    CLONE_LIST(expr.syscall.args, expr.syscall.count);
+    break;
+  case AST_EXPR_STRUCT:
+    CLONE_LIST(expr.struct_expr.field_value, expr.struct_expr.field_count);
+    CLONE_LIST(expr.struct_expr.type_args, expr.struct_expr.type_arg_count);
+    if (sub && node->expr.struct_expr.name &&
+        !node->expr.struct_expr.type_arg_count) {
+      AstNode *arg = type_argument(sub, node->expr.struct_expr.name);
+      if (arg && arg->type == AST_TYPE_BASIC)
+        copy->expr.struct_expr.name = (char *)arg->type_data.basic.name;
+    }
+    break;
+  case AST_EXPR_SPREAD:
+    CLONE(expr.spread.expr);
+    break;
+  case AST_EXPR_BUILTIN:
+    CLONE_LIST(expr.builtin.args, expr.builtin.arg_count);
+    break;
+
+  // Statements
+  case AST_STMT_EXPRESSION:
+    CLONE(stmt.expr_stmt.expression);
+    break;
+  case AST_STMT_VAR_DECL:
+    CLONE(stmt.var_decl.var_type);
+    CLONE(stmt.var_decl.initializer);
+    break;
+  case AST_STMT_FUNCTION:
+    CLONE_LIST(stmt.func_decl.param_types, stmt.func_decl.param_count);
+    CLONE(stmt.func_decl.return_type);
+    CLONE(stmt.func_decl.body);
+    copy->stmt.func_decl.scope = NULL;
+    // The digest is of the template's tokens, which the instance doesn't
+    // share with other instances
+    copy->stmt.func_decl.body_digest = 0;
+    break;
+  case AST_STMT_IF:
+    CLONE(stmt.if_stmt.condition);
+    CLONE(stmt.if_stmt.then_stmt);
+    CLONE_LIST(stmt.if_stmt.elif_stmts, stmt.if_stmt.elif_count);
+    CLONE(stmt.if_stmt.else_stmt);
+    copy->stmt.if_stmt.scope = NULL;
+    copy->stmt.if_stmt.then_scope = NULL;
+    copy->stmt.if_stmt.else_scope = NULL;
+    break;
+  case AST_STMT_LOOP:
+    CLONE(stmt.loop_stmt.condition);
+    CLONE(stmt.loop_stmt.optional);
+    CLONE(stmt.loop_stmt.body);
+    CLONE_LIST(stmt.loop_stmt.initializer, stmt.loop_stmt.init_count);
+    copy->stmt.loop_stmt.scope = NULL;
+    break;
+  case AST_STMT_RETURN:
+    CLONE(stmt.return_stmt.value);
+    break;
+  case AST_STMT_BLOCK:
+    CLONE_LIST(stmt.block.statements, stmt.block.stmt_count);
+    copy->stmt.block.scope = NULL;
+    break;
+  case AST_STMT_PRINT:
+    CLONE_LIST(stmt.print_stmt.expressions, stmt.print_stmt.expr_count);
+    break;
+  case AST_STMT_DEFER:
+    CLONE(stmt.defer_stmt.statement);
+    break;
+  case AST_STMT_SWITCH:
+    CLONE(stmt.switch_stmt.condition);
+    CLONE_LIST(stmt.switch_stmt.cases, stmt.switch_stmt.case_count);
+    CLONE(stmt.switch_stmt.default_case);
+    copy->stmt.switch_stmt.scope = NULL;
+    break;
+  case AST_STMT_CASE:
+    CLONE_LIST(stmt.case_clause.values, stmt.case_clause.value_count);
+    CLONE(stmt.case_clause.body);
+    break;
+  case AST_STMT_DEFAULT:
+    CLONE(stmt.default_clause.body);
+    break;
+  case AST_STMT_STRUCT:
+    CLONE_LIST(stmt.struct_decl.public_members, stmt.struct_decl.public_count);
+    CLONE_LIST(stmt.struct_decl.private_members,
+               stmt.struct_decl.private_count);
+    break;
+  case AST_STMT_FIELD_DECL:
+    CLONE(stmt.field_decl.type);
+    CLONE(stmt.field_decl.function);
+    break;
+  case AST_STMT_SPREAD_DECL:
+    CLONE(stmt.spread_decl.type);
+    break;
+  case AST_STMT_IMPL:
+    CLONE_LIST(stmt.impl_stmt.function_type_list,
+               stmt.impl_stmt.function_name_count);
+    CLONE(stmt.impl_stmt.body);
+    break;
+
+  // Types
+  case AST_TYPE_BASIC:
+    CLONE_LIST(type_data.basic.type_args, type_data.basic.type_arg_count);
+    break;
+  case AST_TYPE_RESOLUTION:
+    CLONE_LIST(type_data.resolution.type_args,
+               type_data.resolution.type_arg_count);
+    break;
+  case AST_TYPE_POINTER:
+    CLONE(type_data.pointer.pointee_type);
+    break;
+  case AST_TYPE_ARRAY:
+    CLONE(type_data.array.element_type);
+    CLONE(type_data.array.size);
+    break;
+  case AST_TYPE_VECTOR:
+    CLONE(type_data.vector.element_type);
+    break;
+  case AST_TYPE_FUNCTION:
+    CLONE_LIST(type_data.function.param_types,
+               type_data.function.param_count);
+    CLONE(type_data.function.return_type);
+    break;
+  case AST_TYPE_STRUCT:
+    CLONE_LIST(type_data.struct_type.member_types,
+               type_data.struct_type.member_count);
+    break;
+  default:
+    break;
+  }
+
+#undef CLONE
+#undef CLONE_LIST
+
+  if (copy->category == Node_Category_EXPR) {
+    copy->expr.checked_type = NULL;
+  } else if (copy->category == Node_Category_TYPE) {
+    copy->type_data.canonical = NULL;
+  }
+  return copy;
+}
+
+// ============================================================================
+// Instantiation
+// ============================================================================
+
+static void set_error_module(Instantiator *in, AstNode *module) {
+  tc_error_init(module->preprocessor.module.lines,
+                module->preprocessor.module.file_path, in->arena);
+}
+
+static bool has_instance(Instantiator *in, Atom name) {
+  for (size_t i = 0; i < in->names.count; i++) {
+    if (((Atom *)in->names.data)[i] == name)
+      return true;
+  }
+  return false;
+}
+
+static void add_to_body(Instantiator *in, AstNode *stmt) {
+  AstNode **slot = growable_array_push(&in->body);
+  if (slot)
+    *slot = stmt;
+}
+
+// The name of @p name<@p args>'s instance in the module being rewritten,
+// made first if the module doesn't have it yet; NULL after an error
+static Atom instantiate(Instantiator *in, Context *cx, AstNode *node,
+                        const char *name, const char *qualifier,
+                        AstNode **args, size_t count) {
+  for (size_t i = 0; i < count; i++)
+    rewrite(in, cx, args[i]);
+
+  AstNode *home = cx->origin;
+  if (qualifier) {
+    AstNode *use = find_use(cx->origin, qualifier);
+    home = use ? find_program_module(in->program, use->preprocessor.use.module_name)
+               : NULL;
+    if (!home) {
+      tc_error_id(node, qualifier, "Generic Error",
+                  "'%s' is not a module used here", qualifier);
+      in->ok = false;
+      return NULL;
+    }
+  }
+
+  AstNode *template = find_decl(home, name, true);
+  if (!template) {
+    tc_error_help(node, "Generic Error",
+                  "Only functions and structs declared with fn<T> or "
+                  "struct<T> take type arguments",
+                  "'%s' is not generic", name);
+    in->ok = false;
+    return NULL;
+  }
+
+  bool is_function = template->type == AST_STMT_FUNCTION;
+  char **params = is_function ? template->stmt.func_decl.type_params
+                              : template->stmt.struct_decl.type_params;
+  size_t param_count = is_function
+                           ? template->stmt.func_decl.type_param_count
+                           : template->stmt.struct_decl.type_param_count;
+  if (param_count != count) {
+    tc_error(node, "Generic Error", "'%s' takes %zu type argument%s, not %zu",
+             name, param_count, param_count == 1 ? "" : "s", count);
+    in->ok = false;
+    return NULL;
+  }
+  if (home != cx->origin && !decl_is_public(template)) {
+    tc_error_id(node, name, "Generic Error",
+                "'%s' is private to module '%s'", name,
+                home->preprocessor.module.name);
+    in->ok = false;
+    return NULL;
+  }
+
+  Atom instance = instance_name(name, args, count);
+  if (!instance) {
+    tc_error(node, "Generic Error", "The type arguments of '%s' are too long",
+             name);
+    in->ok = false;
+    return NULL;
+  }
+  if (has_instance(in, instance))
+    return instance;
+
+  if (cx->depth >= GENERIC_DEPTH_LIMIT) {
+    tc_error_help(node, "Generic Error",
+                  "A generic that instantiates itself with ever larger type "
+                  "arguments never ends",
+                  "Instantiating '%s' nests generics more than %d deep",
+                  instance, GENERIC_DEPTH_LIMIT);
+    in->ok = false;
+    return NULL;
+  }
+
+  const char *home_name = home->preprocessor.module.name;
+  const char *alias = NULL;
+  if (home != in->module) {
+    alias = alias_for(in->module, home_name);
+    if (!alias) {
+      tc_error_help(node, "Generic Error",
+                    "An instance is made in the module that uses it, from "
+                    "where the template's own names must be reachable",
+                    "'%s' needs @use \"%s\" in module '%s'", instance,
+                    home_name, in->module->preprocessor.module.name);
+      in->ok = false;
+      return NULL;
+    }
+  }
+
+  GrowableArray spliced;
+  growable_array_init(&spliced, in->arena, 8, sizeof(AstNode *));
+  Substitution sub = {params, args, count, &spliced};
+  AstNode *copy = clone(in->arena, template, &sub);
+  if (is_function) {
+    copy->stmt.func_decl.name = instance;
+    copy->stmt.func_decl.type_params = NULL;
+    copy->stmt.func_decl.type_param_count = 0;
+    // Other modules have their own copy
+    copy->stmt.func_decl.is_public = false;
+    copy->stmt.func_decl.template_module = home != in->module ? home : NULL;
+  } else {
+    copy->stmt.struct_decl.name = instance;
+    copy->stmt.struct_decl.type_params = NULL;
+    copy->stmt.struct_decl.type_param_count = 0;
+    copy->stmt.struct_decl.is_instance = true;
+    copy->stmt.struct_decl.template_module = home != in->module ? home : NULL;
+  }
+
+  // Known before its body is walked, so it can refer to itself
+  Atom *slot = growable_array_push(&in->names);
+  if (slot)
+    *slot = instance;
+
+  Context inner = {home, alias, NULL, &spliced, cx->depth + 1};
+  if (home != cx->origin)
+    set_error_module(in, home);
+  rewrite(in, &inner, copy);
+  if (home != cx->origin)
+    set_error_module(in, cx->origin);
+
+  add_to_body(in, copy);
+  return instance;
+}
+
+// ============================================================================
+// Rewriting
+// ============================================================================
+
+// Names a function binds itself, which keep their meaning in an instance
+static void collect_locals(AstNode *node, GrowableArray *locals) {
+  if (!node)
+    return;
+
+  const char **slot;
+  switch (node->type) {
+  case AST_STMT_VAR_DECL:
+    slot = growable_array_push(locals);
+    if (slot)
+      *slot = node->stmt.var_decl.name;
+    break;
+  case AST_STMT_BLOCK:
+    for (size_t i = 0; i < node->stmt.block.stmt_count; i++)
+      collect_locals(node->stmt.block.statements[i], locals);
+    break;
+  case AST_STMT_IF:
+    collect_locals(node->stmt.if_stmt.then_stmt, locals);
+    // An elif's own elif_count is its position, with no list
+    for (int i = 0; node->stmt.if_stmt.elif_stmts &&
+                    i < node->stmt.if_stmt.elif_count;
+         i++)
+      collect_locals(node->stmt.if_stmt.elif_stmts[i], locals);
+    collect_locals(node->stmt.if_stmt.else_stmt, locals);
+    break;
+  case AST_STMT_LOOP:
+    for (size_t i = 0; i < node->stmt.loop_stmt.init_count; i++)
+      collect_locals(node->stmt.loop_stmt.initializer[i], locals);
+    collect_locals(node->stmt.loop_stmt.body, locals);
+    break;
+  case AST_STMT_SWITCH:
+    for (size_t i = 0; i < node->stmt.switch_stmt.case_count; i++)
+      collect_locals(node->stmt.switch_stmt.cases[i], locals);
+    collect_locals(node->stmt.switch_stmt.default_case, locals);
+    break;
+  case AST_STMT_CASE:
+    collect_locals(node->stmt.case_clause.body, locals);
+    break;
+  case AST_STMT_DEFAULT:
+    collect_locals(node->stmt.default_clause.body, locals);
+    break;
+  case AST_STMT_DEFER:
+    collect_locals(node->stmt.defer_stmt.statement, locals);
+    break;
+  default:
+    break;
+  }
+}
+
+// A name the template took from its own module, seen from the instance
+static AstNode *origin_decl(Instantiator *in, Context *cx, AstNode *node,
+                            const char *name) {
+  if (!cx->alias || is_local(cx, name))
+    return NULL;
+
+  AstNode *decl = find_decl(cx->origin, name, false);
+  if (decl && !decl_is_public(decl)) {
+    tc_error_help(node, "Generic Error",
+                  "Instances are made in the module that uses the generic, "
+                  "so the names a template uses from its own module have "
+                  "to be public",
+                  "'%s' is private to module '%s'", name,
+                  cx->origin->preprocessor.module.name);
+    in->ok = false;
+    return NULL;
+  }
+  return decl;
+}
+
+// The instance's alias for a module the template's module has as @p alias
+static const char *origin_import(Instantiator *in, Context *cx, AstNode *node,
+                                 const char *alias) {
+  if (!cx->alias || is_local(cx, alias))
+    return alias;
+
+  AstNode *use = find_use(cx->origin, alias);
+  if (!use)
+    return alias;
+
+  const char *mapped = alias_for(in->module, use->preprocessor.use.module_name);
+  if (!mapped) {
+    tc_error_help(node, "Generic Error",
+                  "Instances are made in the module that uses the generic, "
+                  "which has to use the modules the template uses",
+                  "Module '%s' needs @use \"%s\"",
+                  in->module->preprocessor.module.name,
+                  use->preprocessor.use.module_name);
+    in->ok = false;
+  }
+  return mapped ? mapped : alias;
+}
+
+// Reports a template named without type arguments, which the typechecker
+// would only call undefined
+static void check_type_args_given(Instantiator *in, Context *cx,
+                                  AstNode *node, const char *name) {
+  if (!name || is_local(cx, name) || find_decl(cx->origin, name, false) ||
+      !find_decl(cx->origin, name, true))
+    return;
+  tc_error_help(node, "Generic Error",
+                "Generics are instantiated with explicit type arguments",
+                "'%s' is generic; write %s<...>", name, name);
+  in->ok = false;
+}
+
+static void rewrite_list(Instantiator *in, Context *cx, AstNode **list,
+                         size_t count) {
+  for (size_t i = 0; list && i < count; i++)
+    rewrite(in, cx, list[i]);
+}
+
+static void rewrite_function(Instantiator *in, Context *cx, AstNode *node) {
+  GrowableArray locals;
+  GrowableArray *outer = cx->locals;
+  if (cx->alias) {
+    growable_array_init(&locals, in->arena, 8, sizeof(const char *));
+    for (size_t i = 0; i < node->stmt.func_decl.param_count; i++) {
+      const char **slot = growable_array_push(&locals);
+      if (slot)
+        *slot = node->stmt.func_decl.param_names[i];
+    }
+    collect_locals(node->stmt.func_decl.body, &locals);
+    cx->locals = &locals;
+  }
+
+  rewrite_list(in, cx, node->stmt.func_decl.param_types,
+               node->stmt.func_decl.param_count);
+  rewrite(in, cx, node->stmt.func_decl.return_type);
+  rewrite(in, cx, node->stmt.func_decl.body);
+  cx->locals = outer;
+}
+
+// Replaces every Name<Args> under @p node with the name of its instance and
+// qualifies the names an instance takes from its template's module
+static void rewrite(Instantiator *in, Context *cx, AstNode *node) {
+  if (!node)
+    return;
+
+  // A type argument means what it meant where it was written
+  if (cx->alias) {
+    for (size_t i = 0; i < cx->spliced->count; i++) {
+      if (((AstNode **)cx->spliced->data)[i] == node) {
+        Context user = {in->module, NULL, NULL, NULL, cx->depth};
+        rewrite(in, &user, node);
+        return;
+      }
+    }
+  }
+
+  switch (node->type) {
+  // Expressions
+  case AST_EXPR_IDENTIFIER: {
+    const char *name = node->expr.identifier.name;
+    if (node->expr.identifier.type_arg_count) {
+      Atom instance =
+          instantiate(in, cx, node, name, NULL, node->expr.identifier.type_args,
+                      node->expr.identifier.type_arg_count);
+      if (instance)
+        node->expr.identifier.name = (char *)instance;
+      node->expr.identifier.type_args = NULL;
+      node->expr.identifier.type_arg_count = 0;
+    } else if (origin_decl(in, cx, node, name)) {
+      AstNode *module = create_identifier_expr(in->arena, cx->alias,
+                                               node->line, node->column);
+      node->type = AST_EXPR_MEMBER;
+      node->expr.member.is_compiletime = true;
+      node->expr.member.object = module;
+      node->expr.member.member = (char *)name;
+      node->expr.member.type_args = NULL;
+      node->expr.member.type_arg_count = 0;
+    }
+    return;
+  }
+
+  case AST_EXPR_MEMBER: {
+    AstNode *object = node->expr.member.object;
+    bool module_access = node->expr.member.is_compiletime && object &&
+                         object->type == AST_EXPR_IDENTIFIER &&
+                         !object->expr.identifier.type_arg_count;
+
+    if (node->expr.member.type_arg_count) {
+      if (!module_access) {
+        tc_error_help(node, "Generic Error",
+                      "Write module::Name<T> or Name<T>",
+                      "Type arguments here need a module in front");
+        in->ok = false;
+        return;
+      }
+
+      // module::Name<T> names the instance, which is in this module
+      Atom instance = instantiate(
+          in, cx, node, node->expr.member.member,
+          object->expr.identifier.name, node->expr.member.type_args,
+          node->expr.member.type_arg_count);
+      if (!instance)
+        return;
+      node->type = AST_EXPR_IDENTIFIER;
+      node->expr.identifier.name = (char *)instance;
+      node->expr.identifier.type_args = NULL;
+      node->expr.identifier.type_arg_count = 0;
+      return;
+    }
+
+    if (module_access && cx->alias && find_use(cx->origin,
+                                               object->expr.identifier.name)) {
+      object->expr.identifier.name = (char *)origin_import(
+          in, cx, object, object->expr.identifier.name);
+      return;
+    }
+    rewrite(in, cx, object);
+    return;
+  }
+
+  case AST_EXPR_STRUCT: {
+    rewrite_list(in, cx, node->expr.struct_expr.field_value,
+                 node->expr.struct_expr.field_count);
+    const char *name = node->expr.struct_expr.name;
+    if (node->expr.struct_expr.type_arg_count) {
+      Atom instance = instantiate(in, cx, node, name,
+                                  node->expr.struct_expr.qualifier,
+                                  node->expr.struct_expr.type_args,
+                                  node->expr.struct_expr.type_arg_count);
+      if (instance)
+        node->expr.struct_expr.name = (char *)instance;
+      node->expr.struct_expr.type_args = NULL;
+      node->expr.struct_expr.type_arg_count = 0;
+      node->expr.struct_expr.qualifier = NULL;
+      return;
+    }
+    if (!name || node->expr.struct_expr.qualifier)
+      return;
+    check_type_args_given(in, cx, node, name);
+    if (origin_decl(in, cx, node, name)) {
+      // Struct literals can't name another module's struct
+      tc_error_help(node, "Generic Error",
+                    "Build it through a public function of its module "
+                    "instead",
+                    "An instance can't write a '%s' literal outside module "
+                    "'%s'",
+                    name, cx->origin->preprocessor.module.name);
+      in->ok = false;
+    }
+    return;
+  }
+
+  case AST_EXPR_BINARY:
+    rewrite(in, cx, node->expr.binary.left);
+    rewrite(in, cx, node->expr.binary.right);
+    return;
+  case AST_EXPR_UNARY:
+    rewrite(in, cx, node->expr.unary.operand);
+    return;
+  case AST_EXPR_CALL: {
+    AstNode *callee = node->expr.call.callee;
+    if (callee && callee->type == AST_EXPR_IDENTIFIER &&
+        !callee->expr.identifier.type_arg_count)
+      check_type_args_given(in, cx, callee, callee->expr.identifier.name);
+    rewrite(in, cx, callee);
+    rewrite_list(in, cx, node->expr.call.args, node->expr.call.arg_count);
+    return;
+  }
+  case AST_EXPR_ASSIGNMENT:
+    rewrite(in, cx, node->expr.assignment.target);
+    rewrite(in, cx, node->expr.assignment.value);
+    return;
+  case AST_EXPR_TERNARY:
+    rewrite(in, cx, node->expr.ternary.condition);
+    rewrite(in, cx, node->expr.ternary.then_expr);
+    rewrite(in, cx, node->expr.ternary.else_expr);
+    return;
+  case AST_EXPR_INDEX:
+    rewrite(in, cx, node->expr.index.object);
+    rewrite(in, cx, node->expr.index.index);
+    return;
+  case AST_EXPR_GROUPING:
+    rewrite(in, cx, node->expr.grouping.expr);
+    return;
+  case AST_EXPR_ARRAY:
+    rewrite_list(in, cx, node->expr.array.elements,
+                 node->expr.array.element_count);
+    return;
+  case AST_EXPR_DEREF:
+    rewrite(in, cx, node->expr.deref.object);
+    return;
+  case AST_EXPR_ADDR:
+    rewrite(in, cx, node->expr.addr.object);
+    return;
+  case AST_EXPR_ALLOC:
+    rewrite(in, cx, node->expr.alloc.size);
+    return;
+  case AST_EXPR_MEMCPY:
+    rewrite(in, cx, node->expr.memcpy.to);
+    rewrite(in, cx, node->expr.memcpy.from);
+    rewrite(in, cx, node->expr.memcpy.size);
+    return;
+  case AST_EXPR_FREE:
+    rewrite(in, cx, node->expr.free.ptr);
+    return;
+  case AST_EXPR_CAST:
+    rewrite(in, cx, node->expr.cast.type);
+    rewrite(in, cx, node->expr.cast.castee);
+    return;
+  case AST_EXPR_INPUT:
+    rewrite(in, cx, node->expr.input.type);
+    rewrite(in, cx, node->expr.input.msg);
+    return;
+  case AST_EXPR_SIZEOF:
+    rewrite(in, cx, node->expr.size_of.object);
+    return;
+  case AST_EXPR_SYSTEM:
+    rewrite(in, cx, node->expr._system.command);
+    return;
+  case AST_EXPR_SYSCALL:
+    rewrite_list(in, cx, node->expr.syscall.args, node->expr.syscall.count);
+    return;
+  case AST_EXPR_SPREAD:
+    rewrite(in, cx, node->expr.spread.expr);
+    return;
+  case AST_EXPR_BUILTIN:
+    rewrite_list(in, cx, node->expr.builtin.args, node->expr.builtin.arg_count);
+    return;
+
+  // Statements
+  case AST_STMT_EXPRESSION:
+    rewrite(in, cx, node->stmt.expr_stmt.expression);
+    return;
+  case AST_STMT_VAR_DECL:
+    rewrite(in, cx, node->stmt.var_decl.var_type);
+    rewrite(in, cx, node->stmt.var_decl.initializer);
+    return;
+  case AST_STMT_FUNCTION:
+    rewrite_function(in, cx, node);
+    return;
+  case AST_STMT_IF:
+    rewrite(in, cx, node->stmt.if_stmt.condition);
+    rewrite(in, cx, node->stmt.if_stmt.then_stmt);
+    rewrite_list(in, cx, node->stmt.if_stmt.elif_stmts,
+                 (size_t)node->stmt.if_stmt.elif_count);
+    rewrite(in, cx, node->stmt.if_stmt.else_stmt);
+    return;
+  case AST_STMT_LOOP:
+    rewrite_list(in, cx, node->stmt.loop_stmt.initializer,
+                 node->stmt.loop_stmt.init_count);
+    rewrite(in, cx, node->stmt.loop_stmt.condition);
+    rewrite(in, cx, node->stmt.loop_stmt.optional);
+    rewrite(in, cx, node->stmt.loop_stmt.body);
+    return;
+  case AST_STMT_RETURN:
+    rewrite(in, cx, node->stmt.return_stmt.value);
+    return;
+  case AST_STMT_BLOCK:
+    rewrite_list(in, cx, node->stmt.block.statements,
+                 node->stmt.block.stmt_count);
+    return;
+  case AST_STMT_PRINT:
+    rewrite_list(in, cx, node->stmt.print_stmt.expressions,
+                 node->stmt.print_stmt.expr_count);
+    return;
+  case AST_STMT_DEFER:
+    rewrite(in, cx, node->stmt.defer_stmt.statement);
+    return;
+  case AST_STMT_SWITCH:
+    rewrite(in, cx, node->stmt.switch_stmt.condition);
+    rewrite_list(in, cx, node->stmt.switch_stmt.cases,
+                 node->stmt.switch_stmt.case_count);
+    rewrite(in, cx, node->stmt.switch_stmt.default_case);
+    return;
+  case AST_STMT_CASE:
+    rewrite_list(in, cx, node->stmt.case_clause.values,
+                 node->stmt.case_clause.value_count);
+    rewrite(in, cx, node->stmt.case_clause.body);
+    return;
+  case AST_STMT_DEFAULT:
+    rewrite(in, cx, node->stmt.default_clause.body);
+    return;
+  case AST_STMT_STRUCT:
+    rewrite_list(in, cx, node->stmt.struct_decl.public_members,
+                 node->stmt.struct_decl.public_count);
+    rewrite_list(in, cx, node->stmt.struct_decl.private_members,
+                 node->stmt.struct_decl.private_count);
+    return;
+  case AST_STMT_FIELD_DECL:
+    rewrite(in, cx, node->stmt.field_decl.type);
+    rewrite(in, cx, node->stmt.field_decl.function);
+    return;
+  case AST_STMT_SPREAD_DECL:
+    rewrite(in, cx, node->stmt.spread_decl.type);
+    return;
+  case AST_STMT_IMPL:
+    rewrite_list(in, cx, node->stmt.impl_stmt.function_type_list,
+                 node->stmt.impl_stmt.function_name_count);
+    rewrite(in, cx, node->stmt.impl_stmt.body);
+    return;
+
+  // Types
+  case AST_TYPE_BASIC: {
+    const char *name = node->type_data.basic.name;
+    if (node->type_data.basic.type_arg_count) {
+      Atom instance =
+          instantiate(in, cx, node, name, NULL, node->type_data.basic.type_args,
+                      node->type_data.basic.type_arg_count);
+      if (instance)
+        node->type_data.basic.name = instance;
+      node->type_data.basic.type_args = NULL;
+      node->type_data.basic.type_arg_count = 0;
+      return;
+    }
+    check_type_args_given(in, cx, node, name);
+    if (origin_decl(in, cx, node, name)) {
+      char **parts = arena_alloc(in->arena, 2 * sizeof(char *),
+                                 alignof(char *));
+      parts[0] = (char *)cx->alias;
+      parts[1] = (char *)name;
+      node->type = AST_TYPE_RESOLUTION;
+      node->type_data.resolution.parts = parts;
+      node->type_data.resolution.part_count = 2;
+      node->type_data.resolution.type_args = NULL;
+      node->type_data.resolution.type_arg_count = 0;
+    }
+    return;
+  }
+
+  case AST_TYPE_RESOLUTION: {
+    char **parts = node->type_data.resolution.parts;
+    size_t part_count = node->type_data.resolution.part_count;
+    if (node->type_data.resolution.type_arg_count) {
+      if (part_count != 2) {
+        tc_error_help(node, "Generic Error", "Write module::Name<T>",
+                      "Type arguments here need exactly one module in "
+                      "front");
+        in->ok = false;
+        return;
+      }
+      Atom instance = instantiate(in, cx, node, parts[1], parts[0],
+                                  node->type_data.resolution.type_args,
+                                  node->type_data.resolution.type_arg_count);
+      if (!instance)
+        return;
+      node->type = AST_TYPE_BASIC;
+      node->type_data.basic.name = instance;
+      node->type_data.basic.type_args = NULL;
+      node->type_data.basic.type_arg_count = 0;
+      return;
+    }
+
+    if (cx->alias && part_count > 1 && find_use(cx->origin, parts[0])) {
+      char **mapped = arena_alloc(in->arena, part_count * sizeof(char *),
+                                  alignof(char *));
+      memcpy(mapped, parts, part_count * sizeof(char *));
+      mapped[0] = (char *)origin_import(in, cx, node, parts[0]);
+      node->type_data.resolution.parts = mapped;
+    }
+    return;
+  }
+
+  case AST_TYPE_POINTER:
+    rewrite(in, cx, node->type_data.pointer.pointee_type);
+    return;
+  case AST_TYPE_ARRAY:
+    rewrite(in, cx, node->type_data.array.element_type);
+    rewrite(in, cx, node->type_data.array.size);
+    return;
+  case AST_TYPE_VECTOR:
+    rewrite(in, cx, node->type_data.vector.element_type);
+    return;
+  case AST_TYPE_FUNCTION:
+    rewrite_list(in, cx, node->type_data.function.param_types,
+                 node->type_data.function.param_count);
+    rewrite(in, cx, node->type_data.function.return_type);
+    return;
+
+  default:
+    return;
+  }
+}
+
+static bool instantiate_module(AstNode *program, AstNode *module,
+                               ArenaAllocator *arena) {
+  AstNode **body = module->preprocessor.module.body;
+  size_t body_count = module->preprocessor.module.body_count;
+
+  Instantiator in = {.arena = arena,
+                     .program = program,
+                     .module = module,
+                     .ok = true};
+  growable_array_init(&in.body, arena, body_count + 8,
+                      sizeof(AstNode *));
+  growable_array_init(&in.names, arena, 8, sizeof(Atom));
+
+  // Instances from an earlier run over the same tree (the language server
+  // checks a module's AST again when a file that uses it changes)
+  for (size_t i = 0; i < body_count; i++) {
+    const char *name = body[i] ? decl_name(body[i]) : NULL;
+    Atom *slot;
+    if (name && strchr(name, '<') && (slot = growable_array_push(&in.names)))
+      *slot = intern(name);
+  }
+
+  set_error_module(&in, module);
+  Context cx = {module, NULL, NULL, NULL, 0};
+  for (size_t i = 0; i < body_count; i++) {
+    if (body[i] && !is_template(body[i]))
+      rewrite(&in, &cx, body[i]);
+    add_to_body(&in, body[i]);
+  }
+
+  if (in.body.count != body_count) {
+    module->preprocessor.module.body = (AstNode **)in.body.data;
+    module->preprocessor.module.body_count = in.body.count;
+  }
+  return in.ok;
+}
+
+// Rewrites the modules of `program` that `only` allows (all when NULL)
+static bool instantiate_program(AstNode *program, AstNode *only,
+                                ArenaAllocator *arena) {
+  if (!program || program->type != AST_PROGRAM)
+    return true;
+
+  // Errors point into each module's file while it's rewritten; the caller's
+  // error context comes back after
+  const LineTable *lines = g_lines;
+  const char *file_path = g_file_path;
+  ArenaAllocator *error_arena = g_arena;
+
+  bool ok = true;
+  for (size_t i = 0; i < program->stmt.program.module_count; i++) {
+    AstNode *module = program->stmt.program.modules[i];
+    if (module && module->type == AST_PREPROCESSOR_MODULE &&
+        (!only || module == only))
+      ok = instantiate_module(program, module, arena) && ok;
+  }
+
+  tc_error_init(lines, file_path, error_arena);
+  return ok;
+}
+
+bool instantiate_generics(AstNode *program, ArenaAllocator *arena) {
+  return instantiate_program(program, NULL, arena);
+}
+
+bool instantiate_module_generics(AstNode *program, AstNode *module,
+                                 ArenaAllocator *arena) {
+  return module ? instantiate_program(program, module, arena) : true;
+}
+
+bool module_declares_templates(const AstNode *module) {
+  for (size_t i = 0; i < module->preprocessor.module.body_count; i++) {
+    if (is_template(module->preprocessor.module.body[i]))
+      return true;
+  }
+  return false;
+}
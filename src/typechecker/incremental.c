@@ -0,0 +1,486 @@
+// incremental.c - Reusing the results of unchanged function bodies
+//
+// A long-lived process (the language server) typechecks the same modules
+// over and over. Each module-level function body checked with a BodyCache
+// leaves an entry behind: the digest of the declaration's tokens (see
+// fn_stmt), the diagnostics and memory report it produced, and every name
+// it resolved outside its own scopes together with a signature of what the
+// name resolved to (or that it resolved to nothing).
+//
+// On the next check a body is reused when its digest is unchanged and each
+// recorded name still resolves to a symbol with the same signature: nothing
+// the body can observe has changed, so neither would its results. The
+// digest covers lines relative to the declaration, so a body that only moved
+// is reused too, unless it has diagnostics: their messages may mention
+// absolute lines.
+#include "type.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BODY_CACHE_INITIAL_SLOTS 64
+#define SIGNATURE_FNV_OFFSET 0xcbf29ce484222325ULL
+#define SIGNATURE_FNV_PRIME 0x100000001b3ULL
+
+struct BodyCacheEntry {
+  Atom module;
+  Atom function;
+  uint64_t digest;
+  uint64_t imports; // See imports_signature
+  bool check_mem;
+  bool ok;
+  int line; // Of the declaration when it was checked
+
+  BodyDependency *dependencies;
+  size_t dependency_count;
+
+  // Copies owned by the entry; file_path and line_text are filled in again
+  // on replay
+  ErrorInformation *errors;
+  int error_count;
+  ErrorInformation *memory_errors;
+  int memory_error_count;
+};
+
+struct BodyCache {
+  BodyCacheEntry **slots; // NULL or an entry; capacity is a power of two
+  size_t count;
+  size_t capacity;
+
+  PendingBody *pending; // Bodies reused by the current check
+  size_t pending_count;
+  size_t pending_capacity;
+};
+
+typedef struct {
+  GrowableArray *dependencies;
+  Scope *module_scope; // Of the body being recorded
+  ArenaAllocator *arena;
+  int paused;
+  bool opaque;
+} DependencyRecorder;
+
+static _Thread_local DependencyRecorder recorder;
+
+// ---------------------------------------------------------------------------
+// Dependencies
+// ---------------------------------------------------------------------------
+
+static inline uint64_t mix(uint64_t hash, uint64_t value) {
+  return (hash ^ value) * SIGNATURE_FNV_PRIME;
+}
+
+static uint64_t spelling_of(AstNode *type, ArenaAllocator *arena) {
+  return type ? (uint64_t)(uintptr_t)intern(type_to_string(type, arena)) : 0;
+}
+
+// What a body can observe about a symbol. Spellings are atoms, so equal
+// spellings mix in equal pointers within one process.
+static uint64_t symbol_signature(Symbol *symbol, ArenaAllocator *arena) {
+  if (!symbol)
+    return 0;
+
+  uint64_t hash = SIGNATURE_FNV_OFFSET;
+  hash = mix(hash, (uint64_t)symbol->is_public |
+                       (uint64_t)symbol->is_mutable << 1 |
+                       (uint64_t)symbol->returns_ownership << 2 |
+                       (uint64_t)symbol->takes_ownership << 3 |
+                       (uint64_t)symbol->attributes << 4);
+
+  AstNode *type = symbol->type;
+  hash = mix(hash, spelling_of(type, arena));
+
+  // A struct is spelled by name only; its members are part of it too
+  if (type && type->type == AST_TYPE_STRUCT) {
+    size_t member_count = type->type_data.struct_type.member_count;
+    hash = mix(hash, member_count);
+    for (size_t i = 0; i < member_count; i++) {
+      const char *member = type->type_data.struct_type.member_names[i];
+      hash = mix(hash, (uint64_t)(uintptr_t)intern(member));
+      hash = mix(hash,
+                 spelling_of(type->type_data.struct_type.member_types[i], arena));
+    }
+  }
+
+  return hash | 1; // 0 means "resolved to nothing"
+}
+
+// Bodies also scan the module's imports directly (to tell a module alias
+// from an undefined name), so the import list is part of every entry
+static uint64_t imports_signature(const Scope *module_scope) {
+  uint64_t hash = SIGNATURE_FNV_OFFSET;
+  for (size_t i = 0; i < module_scope->imported_modules.count; i++) {
+    const ModuleImport *import =
+        (const ModuleImport *)((const char *)module_scope->imported_modules.data +
+                               i * sizeof(ModuleImport));
+    hash = mix(hash, (uint64_t)(uintptr_t)import->alias);
+    hash = mix(hash, (uint64_t)(uintptr_t)import->module_name);
+  }
+  return hash;
+}
+
+// What importers can observe about a module: its public symbols. A module
+// declaring templates also hands out their bodies, which instances copy, so
+// its tokens count as well.
+uint64_t module_interface_signature(AstNode *module, Scope *module_scope,
+                                    ArenaAllocator *arena) {
+  uint64_t hash = SIGNATURE_FNV_OFFSET;
+  for (size_t i = 0; i < module_scope->symbols.count; i++) {
+    Symbol *symbol = scope_symbol(module_scope, i);
+    if (!symbol->is_public)
+      continue;
+    hash = mix(hash, (uint64_t)(uintptr_t)symbol->name);
+    hash = mix(hash, symbol_signature(symbol, arena));
+  }
+  if (module_declares_templates(module))
+    hash = mix(hash, module->preprocessor.module.token_digest);
+  return hash;
+}
+
+void body_dependencies_begin(GrowableArray *dependencies, Scope *module_scope,
+                             ArenaAllocator *arena) {
+  recorder.dependencies = dependencies;
+  recorder.module_scope = module_scope;
+  recorder.arena = arena;
+  recorder.paused = 0;
+  recorder.opaque = false;
+}
+
+bool body_dependencies_end(void) {
+  bool complete = recorder.dependencies && !recorder.opaque;
+  recorder.dependencies = NULL;
+  recorder.module_scope = NULL;
+  recorder.arena = NULL;
+  return complete;
+}
+
+void body_dependencies_pause(void) { recorder.paused++; }
+
+void body_dependencies_resume(void) { recorder.paused--; }
+
+void body_dependencies_opaque(void) {
+  if (recorder.dependencies && !recorder.paused)
+    recorder.opaque = true;
+}
+
+bool scope_is_local(const Scope *scope) {
+  return scope && scope->module_scope && scope->module_scope != scope;
+}
+
+void body_dependency_note(BodyDependencyKind kind, const Scope *scope,
+                          const char *alias, const char *name,
+                          const Scope *requesting_module_scope,
+                          Symbol *symbol) {
+  if (!recorder.dependencies || recorder.paused || recorder.opaque || !name)
+    return;
+
+  // Lookups made on behalf of another module can't be repeated from the
+  // body's own scope
+  if (requesting_module_scope &&
+      requesting_module_scope != recorder.module_scope) {
+    recorder.opaque = true;
+    return;
+  }
+
+  // Scopes other than module scopes and the global scope can't be found
+  // again by name
+  bool in_scope = kind == BODY_DEP_IN_SCOPE || kind == BODY_DEP_IN_SCOPE_ONLY;
+  if (in_scope && scope->module_scope != scope && scope->parent) {
+    recorder.opaque = true;
+    return;
+  }
+
+  BodyDependency *dependency =
+      (BodyDependency *)growable_array_push(recorder.dependencies);
+  if (!dependency) {
+    recorder.opaque = true;
+    return;
+  }
+
+  dependency->kind = kind;
+  dependency->target = NULL;
+  if (kind == BODY_DEP_QUALIFIED)
+    dependency->target = intern(alias);
+  else if (in_scope && scope->module_name)
+    dependency->target = intern(scope->module_name);
+  dependency->name = intern(name);
+  dependency->from_body = requesting_module_scope != NULL;
+  dependency->signature = symbol_signature(symbol, recorder.arena);
+}
+
+// Resolves a recorded name again as the body would now, from @p probe: an
+// empty scope standing where the body's function scope would be
+static Symbol *resolve_again(const BodyDependency *dependency, Scope *probe) {
+  Scope *module_scope = probe->module_scope;
+  Scope *requesting = dependency->from_body ? module_scope : NULL;
+
+  switch (dependency->kind) {
+  case BODY_DEP_UNQUALIFIED:
+    return scope_lookup_with_visibility(probe, dependency->name, requesting);
+  case BODY_DEP_QUALIFIED:
+    return lookup_qualified_symbol(probe, dependency->target,
+                                   dependency->name);
+  case BODY_DEP_IN_SCOPE:
+  case BODY_DEP_IN_SCOPE_ONLY: {
+    Scope *global_scope = module_scope->parent;
+    Scope *target = dependency->target
+                        ? find_module_scope(global_scope, dependency->target)
+                        : global_scope;
+    if (!target)
+      return NULL;
+    if (dependency->kind == BODY_DEP_IN_SCOPE)
+      return scope_lookup_with_visibility(target, dependency->name,
+                                          requesting);
+    return scope_lookup_current_only_with_visibility(target, dependency->name,
+                                                     requesting);
+  }
+  }
+  return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Cache
+// ---------------------------------------------------------------------------
+
+BodyCache *body_cache_create(void) { return xcalloc(1, sizeof(BodyCache)); }
+
+static void free_errors(ErrorInformation *errors, int count) {
+  for (int i = 0; i < count; i++) {
+    free((char *)errors[i].error_type);
+    free((char *)errors[i].message);
+    free((char *)errors[i].label);
+    free((char *)errors[i].note);
+    free((char *)errors[i].help);
+  }
+  free(errors);
+}
+
+static void free_entry(BodyCacheEntry *entry) {
+  free(entry->dependencies);
+  free_errors(entry->errors, entry->error_count);
+  free_errors(entry->memory_errors, entry->memory_error_count);
+  free(entry);
+}
+
+void body_cache_destroy(BodyCache *cache) {
+  if (!cache)
+    return;
+  for (size_t i = 0; i < cache->capacity; i++) {
+    if (cache->slots[i])
+      free_entry(cache->slots[i]);
+  }
+  free(cache->slots);
+  free(cache->pending);
+  free(cache);
+}
+
+static inline size_t key_hash(Atom module, Atom function) {
+  return (size_t)atom_hash(module) * 31 + atom_hash(function);
+}
+
+// Finds the slot holding the entry for @p module and @p function, or the
+// empty slot where it belongs
+static BodyCacheEntry **find_slot(BodyCacheEntry **slots, size_t capacity,
+                                  Atom module, Atom function) {
+  size_t mask = capacity - 1;
+  for (size_t i = key_hash(module, function) & mask;; i = (i + 1) & mask) {
+    BodyCacheEntry *entry = slots[i];
+    if (!entry || (entry->module == module && entry->function == function))
+      return &slots[i];
+  }
+}
+
+static bool grow_slots(BodyCache *cache) {
+  size_t capacity =
+      cache->capacity ? cache->capacity * 2 : BODY_CACHE_INITIAL_SLOTS;
+  BodyCacheEntry **slots = calloc(capacity, sizeof(BodyCacheEntry *));
+  if (!slots)
+    return false;
+
+  for (size_t i = 0; i < cache->capacity; i++) {
+    BodyCacheEntry *entry = cache->slots[i];
+    if (entry)
+      *find_slot(slots, capacity, entry->module, entry->function) = entry;
+  }
+
+  free(cache->slots);
+  cache->slots = slots;
+  cache->capacity = capacity;
+  return true;
+}
+
+static inline char *copy_text(const char *text) {
+  return text ? strdup(text) : NULL;
+}
+
+static ErrorInformation *copy_errors(const ErrorBuffer *buffer) {
+  if (!buffer->count)
+    return NULL;
+
+  ErrorInformation *errors = xmalloc(sizeof(ErrorInformation) * buffer->count);
+  for (int i = 0; i < buffer->count; i++) {
+    ErrorInformation error = buffer->items[i];
+    error.error_type = copy_text(error.error_type);
+    error.message = copy_text(error.message);
+    error.label = copy_text(error.label);
+    error.note = copy_text(error.note);
+    error.help = copy_text(error.help);
+    error.file_path = NULL;
+    error.line_text = NULL;
+    errors[i] = error;
+  }
+  return errors;
+}
+
+const BodyCacheEntry *body_cache_lookup(BodyCache *cache, AstNode *node,
+                                        Scope *module_scope, bool check_mem,
+                                        ArenaAllocator *arena) {
+  if (!cache->capacity || !node->stmt.func_decl.body_digest)
+    return NULL;
+
+  Atom module = intern(module_scope->module_name);
+  Atom function = intern(node->stmt.func_decl.name);
+  if (!module || !function)
+    return NULL;
+
+  BodyCacheEntry *entry =
+      *find_slot(cache->slots, cache->capacity, module, function);
+  if (!entry || entry->digest != node->stmt.func_decl.body_digest ||
+      entry->check_mem != check_mem ||
+      entry->imports != imports_signature(module_scope))
+    return NULL;
+  if ((entry->error_count || entry->memory_error_count) &&
+      entry->line != (int)node->line)
+    return NULL;
+
+  Scope probe;
+  init_scope(&probe, module_scope, function, arena);
+  probe.is_function_scope = true;
+
+  for (size_t i = 0; i < entry->dependency_count; i++) {
+    const BodyDependency *dependency = &entry->dependencies[i];
+    Symbol *symbol = resolve_again(dependency, &probe);
+    if (symbol_signature(symbol, arena) != dependency->signature)
+      return NULL;
+  }
+  return entry;
+}
+
+static void replay_errors(const ErrorInformation *errors, int count,
+                          ArenaAllocator *arena) {
+  for (int i = 0; i < count; i++) {
+    ErrorInformation error = errors[i];
+    error.error_type = arena_strdup(arena, error.error_type);
+    error.message = arena_strdup(arena, error.message);
+    error.label = error.label ? arena_strdup(arena, error.label) : NULL;
+    error.note = error.note ? arena_strdup(arena, error.note) : NULL;
+    error.help = error.help ? arena_strdup(arena, error.help) : NULL;
+    error.file_path = g_file_path;
+    error.line_text = generate_line(arena, g_lines, error.line);
+    error_add(error);
+  }
+}
+
+bool body_cache_replay(const BodyCacheEntry *entry, ErrorBuffer *memory_report,
+                       ArenaAllocator *arena) {
+  replay_errors(entry->errors, entry->error_count, arena);
+
+  ErrorBuffer *outer = error_get_capture();
+  error_begin_capture(memory_report);
+  replay_errors(entry->memory_errors, entry->memory_error_count, arena);
+  error_begin_capture(outer);
+
+  return entry->ok;
+}
+
+void body_cache_store(BodyCache *cache, AstNode *node, Scope *module_scope,
+                      bool check_mem, const GrowableArray *dependencies,
+                      const ErrorBuffer *errors,
+                      const ErrorBuffer *memory_report, bool ok) {
+  Atom module = intern(module_scope->module_name);
+  Atom function = intern(node->stmt.func_decl.name);
+  if (!module || !function || !node->stmt.func_decl.body_digest)
+    return;
+
+  // Keep the load factor at or below one half
+  if ((cache->count + 1) * 2 > cache->capacity && !grow_slots(cache))
+    return;
+
+  BodyCacheEntry **slot =
+      find_slot(cache->slots, cache->capacity, module, function);
+  if (*slot) {
+    free_entry(*slot);
+    cache->count--;
+  }
+
+  BodyCacheEntry *entry = xcalloc(1, sizeof(BodyCacheEntry));
+  entry->module = module;
+  entry->function = function;
+  entry->digest = node->stmt.func_decl.body_digest;
+  entry->imports = imports_signature(module_scope);
+  entry->check_mem = check_mem;
+  entry->ok = ok;
+  entry->line = (int)node->line;
+
+  // A name is usually resolved many times in one body; keep each once
+  size_t count = dependencies->count;
+  const BodyDependency *recorded = (const BodyDependency *)dependencies->data;
+  entry->dependencies = count ? xmalloc(sizeof(BodyDependency) * count) : NULL;
+  for (size_t i = 0; i < count; i++) {
+    bool seen = false;
+    for (size_t j = entry->dependency_count; j-- > 0 && !seen;) {
+      const BodyDependency *kept = &entry->dependencies[j];
+      seen = kept->kind == recorded[i].kind &&
+             kept->target == recorded[i].target &&
+             kept->name == recorded[i].name &&
+             kept->from_body == recorded[i].from_body;
+    }
+    if (!seen)
+      entry->dependencies[entry->dependency_count++] = recorded[i];
+  }
+
+  entry->errors = copy_errors(errors);
+  entry->error_count = errors->count;
+  entry->memory_errors = copy_errors(memory_report);
+  entry->memory_error_count = memory_report->count;
+
+  *slot = entry;
+  cache->count++;
+}
+
+// ---------------------------------------------------------------------------
+// Reused bodies
+// ---------------------------------------------------------------------------
+
+void body_cache_begin_check(BodyCache *cache) { cache->pending_count = 0; }
+
+void body_cache_add_pending(BodyCache *cache, const PendingBody *body) {
+  if (cache->pending_count == cache->pending_capacity) {
+    size_t capacity = cache->pending_capacity ? cache->pending_capacity * 2 : 16;
+    PendingBody *pending =
+        realloc(cache->pending, sizeof(PendingBody) * capacity);
+    if (!pending)
+      return;
+    cache->pending = pending;
+    cache->pending_capacity = capacity;
+  }
+  cache->pending[cache->pending_count++] = *body;
+}
+
+PendingBodies *body_cache_take_pending(BodyCache *cache,
+                                       ArenaAllocator *arena) {
+  if (!cache || !cache->pending_count)
+    return NULL;
+
+  PendingBodies *taken =
+      arena_alloc(arena, sizeof(PendingBodies), alignof(PendingBodies));
+  PendingBody *bodies = arena_alloc(
+      arena, sizeof(PendingBody) * cache->pending_count, alignof(PendingBody));
+  if (!taken || !bodies)
+    return NULL;
+
+  memcpy(bodies, cache->pending, sizeof(PendingBody) * cache->pending_count);
+  taken->bodies = bodies;
+  taken->count = cache->pending_count;
+  cache->pending_count = 0;
+  return taken;
+}
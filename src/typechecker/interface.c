@@ -0,0 +1,514 @@
+// interface.c - Precompiled interfaces for standard library modules
+//
+// After a std module typechecks cleanly, its interface is written to the std
+// cache (get_std_cache_path) as "<file>-<path hash>.lxi". The interface is
+// the module's source with the body of every function and method cut out,
+// which leaves its @use's, signatures with their attributes and ownership
+// annotations, struct layouts, enums, constants, and the generic templates
+// importers instantiate (those keep their bodies). Cut bodies keep their
+// newlines, so every declaration stays on its source line. Comments after
+// them record the compiler version, a hash of the source text, the module's
+// token digests and its key, along with the key of every module it @use's.
+// Codegen publishes the module's object next to it.
+//
+// Before the next build parses anything, choose_std_interfaces picks the std
+// files whose source, dependencies and cached object are all unchanged.
+// Those are parsed from their interface instead, so their bodies are never
+// lexed or parsed. resolve_prebuilt_std_modules then marks them prebuilt:
+// their declarations are registered in the module scope, and the cached
+// object is linked instead of generating code.
+#include "../c_libs/source/source.h"
+#include "../helper/std_path.h"
+#include "../lexer/lexer.h"
+#include "type.h"
+#include <stdio.h>
+#include <string.h>
+
+#define INTERFACE_FORMAT "// luma-interface 2"
+#define FNV64_OFFSET 14695981039346656037ull
+
+// A module an interface's module @use's, and the key it had then
+typedef struct {
+  char name[256];
+  uint64_t keys[2]; // Without and with debug info (positions)
+} InterfaceUse;
+
+// What the comments ending an interface record
+typedef struct {
+  char module[256];
+  uint64_t source_hash;
+  uint64_t token_digest;
+  uint64_t token_position_digest;
+  uint64_t keys[2];
+  InterfaceUse *uses; // malloc'd
+  size_t use_count;
+} InterfaceRecord;
+
+// Interfaces are named after their source file, so one can be found before
+// the file is parsed; the path hash tells apart std trees sharing the cache
+static bool interface_path(char *buffer, size_t size, const char *source_path) {
+  char cache_dir[768];
+  if (!source_path || !get_std_cache_path(cache_dir, sizeof(cache_dir)))
+    return false;
+
+  const char *stem = source_path;
+  for (const char *c = source_path; *c; c++) {
+    if (*c == '/' || *c == '\\')
+      stem = c + 1;
+  }
+  size_t stem_length = strcspn(stem, ".");
+  snprintf(buffer, size, "%s%c%.*s-%016llx.lxi", cache_dir, PATH_SEPARATOR,
+           (int)stem_length, stem,
+           (unsigned long long)cache_hash_string(FNV64_OFFSET, source_path));
+  return true;
+}
+
+static uint64_t build_fingerprint(const BuildConfig *config) {
+  return codegen_build_fingerprint(
+      Luma_Compiler_version, config->opt_level, config->passes,
+      config->is_debug, config->lto_mode, config->target_os,
+      &(TargetCPUOptions){config->march, config->mcpu, config->mattr},
+      &config->profile, config->bounds_check, config->profile_counters);
+}
+
+// Reads the record ending the interface at path; false when there is none, or it
+// was written by another compiler or in another format
+static bool read_interface_record(const char *path, InterfaceRecord *record) {
+  memset(record, 0, sizeof(*record));
+  FILE *file = fopen(path, "r");
+  if (!file)
+    return false;
+
+  // The record follows the declarations, so those keep their line numbers
+  char line[512];
+  bool line_start = true;
+  bool found = false;
+  while (!found && fgets(line, sizeof(line), file)) {
+    found = line_start && strcmp(line, INTERFACE_FORMAT "\n") == 0;
+    line_start = strchr(line, '\n') != NULL;
+  }
+
+  char version[64] = {0};
+  unsigned long long values[3] = {0};
+  bool ok =
+      found &&
+      fscanf(file, "// compiler %63s\n", version) == 1 &&
+      strcmp(version, Luma_Compiler_version) == 0 &&
+      fscanf(file, "// module %255s\n", record->module) == 1 &&
+      fscanf(file, "// source %llx\n", &values[0]) == 1 &&
+      fscanf(file, "// digest %llx %llx\n", &values[1], &values[2]) == 2;
+  record->source_hash = values[0];
+  record->token_digest = values[1];
+  record->token_position_digest = values[2];
+
+  unsigned long long keys[2] = {0};
+  ok = ok && fscanf(file, "// key %llx %llx\n", &keys[0], &keys[1]) == 2;
+  record->keys[0] = keys[0];
+  record->keys[1] = keys[1];
+
+  size_t capacity = 0;
+  while (ok && fgets(line, sizeof(line), file) &&
+         strcmp(line, "// end\n") != 0) {
+    if (record->use_count == capacity) {
+      capacity = capacity ? capacity * 2 : 4;
+      InterfaceUse *uses = realloc(record->uses, capacity * sizeof(*uses));
+      if (!uses) {
+        ok = false;
+        break;
+      }
+      record->uses = uses;
+    }
+    InterfaceUse *use = &record->uses[record->use_count++];
+    ok = sscanf(line, "// use %255s %llx %llx", use->name, &keys[0],
+                &keys[1]) == 3;
+    use->keys[0] = keys[0];
+    use->keys[1] = keys[1];
+  }
+
+  fclose(file);
+  if (!ok) {
+    free(record->uses);
+    record->uses = NULL;
+  }
+  return ok;
+}
+
+static bool interface_is_current(const char *source_path, bool is_debug,
+                                 uint64_t key) {
+  char path[1024];
+  InterfaceRecord record;
+  if (!interface_path(path, sizeof(path), source_path) ||
+      !read_interface_record(path, &record))
+    return false;
+  free(record.uses);
+  return record.keys[is_debug] == key;
+}
+
+// One std file of the build, while choose_std_interfaces decides on it
+typedef struct {
+  InterfaceRecord record;
+  char path[1024];
+  bool usable;
+} Candidate;
+
+void choose_std_interfaces(const char *const *paths, size_t count,
+                           const BuildConfig *config,
+                           StdInterfaceChoice *choices,
+                           ArenaAllocator *arena) {
+  // --clean asks for a full rebuild, and LTO has to see every body
+  if (!config || config->clean || config->lto_mode != LTO_NONE || !count)
+    return;
+  uint64_t fingerprint = build_fingerprint(config);
+  if (!fingerprint)
+    return;
+
+  bool is_debug = config->is_debug;
+  Candidate *candidates = xcalloc(count, sizeof(Candidate));
+  for (size_t i = 0; i < count; i++) {
+    Candidate *candidate = &candidates[i];
+    if (!paths[i] || !is_std_library_file(paths[i]) ||
+        !interface_path(candidate->path, sizeof(candidate->path), paths[i]) ||
+        !read_interface_record(candidate->path, &candidate->record))
+      continue;
+
+    // The build reads the file through the same source manager, so this is
+    // the only read either way
+    size_t length = 0;
+    const char *source = source_open(paths[i], &length);
+    char object_path[1024];
+    candidate->usable =
+        source &&
+        cache_hash_bytes(FNV64_OFFSET, source, length) ==
+            candidate->record.source_hash &&
+        std_object_cache_path(
+            object_path, sizeof(object_path), candidate->record.module,
+            object_cache_key(fingerprint, candidate->record.keys[is_debug])) &&
+        file_exists(object_path);
+  }
+
+  // A module's key covers the keys of the modules it @use's, so its
+  // interface and object are only current when each of those is still in
+  // the build under the key it had. Dropping one can invalidate its users.
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (size_t i = 0; i < count; i++) {
+      Candidate *candidate = &candidates[i];
+      for (size_t u = 0; candidate->usable && u < candidate->record.use_count;
+           u++) {
+        const InterfaceUse *use = &candidate->record.uses[u];
+        bool found = false;
+        for (size_t j = 0; j < count && !found; j++) {
+          found = candidates[j].usable &&
+                  strcmp(candidates[j].record.module, use->name) == 0 &&
+                  candidates[j].record.keys[is_debug] == use->keys[is_debug];
+        }
+        if (!found) {
+          candidate->usable = false;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    Candidate *candidate = &candidates[i];
+    if (candidate->usable) {
+      choices[i] = (StdInterfaceChoice){
+          .interface_path = arena_strdup(arena, candidate->path),
+          .source_path = paths[i],
+          .token_digest = candidate->record.token_digest,
+          .token_position_digest = candidate->record.token_position_digest,
+      };
+    }
+    free(candidate->record.uses);
+  }
+  free(candidates);
+}
+
+void adopt_std_interface(AstNode *module, const StdInterfaceChoice *choice) {
+  // Keyed, located and reported as the source it stands for
+  module->preprocessor.module.file_path = choice->source_path;
+  module->preprocessor.module.token_digest = choice->token_digest;
+  module->preprocessor.module.token_position_digest =
+      choice->token_position_digest;
+  module->preprocessor.module.from_interface = true;
+}
+
+bool resolve_prebuilt_std_modules(AstNode *program, BuildConfig *config,
+                                  ArenaAllocator *arena) {
+  if (!program || program->type != AST_PROGRAM || !config)
+    return true;
+
+  AstNode **modules = program->stmt.program.modules;
+  size_t module_count = program->stmt.program.module_count;
+
+  bool has_std = false;
+  for (size_t i = 0; i < module_count && !has_std; i++) {
+    has_std = modules[i] && modules[i]->type == AST_PREPROCESSOR_MODULE &&
+              is_std_library_file(modules[i]->preprocessor.module.file_path);
+  }
+  if (!has_std)
+    return true;
+
+  // Same keys codegen computes, so the cached object is found under the name
+  // this build would publish it under. An interface records both kinds, so
+  // a debug build and a release one can share it.
+  ModuleGraph *graph = module_graph_get(program, arena);
+  uint64_t *keys[2] = {xcalloc(module_count, sizeof(uint64_t)),
+                       xcalloc(module_count, sizeof(uint64_t))};
+  compute_module_keys(modules, graph, false, keys[0]);
+  compute_module_keys(modules, graph, true, keys[1]);
+  bool is_debug = config->is_debug;
+
+  // --clean asks for a full rebuild, and LTO has to see every body
+  uint64_t fingerprint = config->clean || config->lto_mode != LTO_NONE
+                             ? 0
+                             : build_fingerprint(config);
+
+  bool ok = true;
+  for (size_t i = 0; i < module_count; i++) {
+    AstNode *module = modules[i];
+    if (!module || module->type != AST_PREPROCESSOR_MODULE ||
+        !is_std_library_file(module->preprocessor.module.file_path))
+      continue;
+
+    const char *name = module->preprocessor.module.name;
+    uint64_t key = keys[is_debug][i];
+    module->preprocessor.module.interface_key = key ? key : 1;
+
+    // The stamp of the interface this build would write
+    char stamp[4096];
+    int used = snprintf(stamp, sizeof(stamp), "// key %016llx %016llx\n",
+                        (unsigned long long)keys[0][i],
+                        (unsigned long long)keys[1][i]);
+    for (size_t u = 0; u < graph->use_counts[i] && used > 0 &&
+                       (size_t)used < sizeof(stamp);
+         u++) {
+      const ModuleUse *use = &graph->uses[i][u];
+      // A module outside the build can't be checked, so the interface
+      // won't be chosen
+      int target = use->module;
+      used += snprintf(stamp + used, sizeof(stamp) - (size_t)used,
+                       "// use %s %016llx %016llx\n", use->name,
+                       (unsigned long long)(target < 0 ? 0 : keys[0][target]),
+                       (unsigned long long)(target < 0 ? 0 : keys[1][target]));
+    }
+    module->preprocessor.module.interface_stamp =
+        used > 0 && (size_t)used < sizeof(stamp) ? arena_strdup(arena, stamp)
+                                                  : NULL;
+
+    char object_path[1024];
+    bool current =
+        fingerprint &&
+        interface_is_current(module->preprocessor.module.file_path, is_debug,
+                             key) &&
+        std_object_cache_path(object_path, sizeof(object_path), name,
+                              object_cache_key(fingerprint, key)) &&
+        file_exists(object_path);
+    if (current) {
+      module->preprocessor.module.prebuilt_object =
+          arena_strdup(arena, object_path);
+    } else if (module->preprocessor.module.from_interface) {
+      // Only declarations were parsed, so there is nothing to compile
+      fprintf(stderr,
+              "Error: the cached interface of std module '%s' is out of "
+              "date; rebuild with --clean\n",
+              name);
+      ok = false;
+    }
+  }
+
+  free(keys[0]);
+  free(keys[1]);
+  return ok;
+}
+
+// Byte offset of a token's text in source
+static size_t token_offset(const char *source, Token token) {
+  return (size_t)(token.value - source);
+}
+
+// Index of the token closing the bracket opened at tokens[open], or count
+static size_t matching_close(const Token *tokens, size_t count, size_t open) {
+  int depth = 0;
+  for (size_t i = open; i < count; i++) {
+    switch (tokens[i].type_) {
+    case TOK_LPAREN:
+    case TOK_LBRACKET:
+    case TOK_LBRACE:
+      depth++;
+      break;
+    case TOK_RPAREN:
+    case TOK_RBRACKET:
+    case TOK_RBRACE:
+      if (--depth == 0)
+        return i;
+      break;
+    default:
+      break;
+    }
+  }
+  return count;
+}
+
+// Copies source[*cursor, start) to file, then only the newlines of
+// source[start, end), and moves the cursor to end
+static void cut_range(FILE *file, const char *source, size_t *cursor,
+                      size_t start, size_t end, const char *replacement) {
+  fwrite(source + *cursor, 1, start - *cursor, file);
+  fputs(replacement, file);
+  for (size_t i = start; i < end; i++) {
+    if (source[i] == '\n')
+      fputc('\n', file);
+  }
+  *cursor = end;
+}
+
+// Writes source with the bodies of its functions and methods cut out: a
+// block body is left empty and an "= expression" body becomes an empty
+// block. Generic functions and the methods of generic structs keep theirs.
+static bool write_declarations(FILE *file, const char *source,
+                               size_t length) {
+  ArenaAllocator scratch;
+  if (arena_allocator_init(&scratch, 64 * 1024) != 0)
+    return false;
+
+  Lexer lexer;
+  init_lexer(&lexer, source, &scratch);
+  size_t count = 0, capacity = 1024;
+  Token *tokens = xmalloc(capacity * sizeof(Token));
+  for (;;) {
+    Token token = next_token(&lexer);
+    if (token.type_ == TOK_EOF || token.type_ == TOK_ERROR)
+      break;
+    if (count == capacity) {
+      capacity *= 2;
+      Token *grown = realloc(tokens, capacity * sizeof(*grown));
+      if (!grown) {
+        free(tokens);
+        arena_destroy(&scratch);
+        return false;
+      }
+      tokens = grown;
+    }
+    tokens[count++] = token;
+  }
+
+  size_t cursor = 0;
+  for (size_t i = 0; i < count; i++) {
+    // struct<T> { ... }: instances copy the methods
+    if (tokens[i].type_ == TOK_STRUCT && i + 1 < count &&
+        tokens[i + 1].type_ == TOK_LT) {
+      while (i < count && tokens[i].type_ != TOK_LBRACE)
+        i++;
+      i = matching_close(tokens, count, i);
+      continue;
+    }
+
+    // name -> fn (...) T, where fn<T> is a template kept whole
+    if (tokens[i].type_ != TOK_RIGHT_ARROW || i + 2 >= count ||
+        tokens[i + 1].type_ != TOK_FN || tokens[i + 2].type_ != TOK_LPAREN)
+      continue;
+
+    // The return type ends at the body, '=' or the ';' of a prototype
+    size_t j = matching_close(tokens, count, i + 2) + 1;
+    int depth = 0;
+    for (; j < count; j++) {
+      LumaTokenType type = tokens[j].type_;
+      if (depth == 0 && (type == TOK_LBRACE || type == TOK_EQUAL ||
+                         type == TOK_SEMICOLON))
+        break;
+      depth += type == TOK_LPAREN || type == TOK_LBRACKET;
+      depth -= type == TOK_RPAREN || type == TOK_RBRACKET;
+    }
+    if (j >= count)
+      break;
+
+    if (tokens[j].type_ == TOK_LBRACE) {
+      size_t close = matching_close(tokens, count, j);
+      if (close >= count)
+        break;
+      cut_range(file, source, &cursor,
+                token_offset(source, tokens[j]) + 1,
+                token_offset(source, tokens[close]), "");
+      i = close;
+    } else if (tokens[j].type_ == TOK_EQUAL) {
+      // The expression ends at the ';' of the declaration, or the ',' or
+      // '}' after a method
+      size_t end = j + 1;
+      for (depth = 0; end < count; end++) {
+        LumaTokenType type = tokens[end].type_;
+        if (depth == 0 && (type == TOK_SEMICOLON || type == TOK_COMMA ||
+                           type == TOK_RBRACE))
+          break;
+        depth += type == TOK_LPAREN || type == TOK_LBRACKET ||
+                 type == TOK_LBRACE;
+        depth -= type == TOK_RPAREN || type == TOK_RBRACKET ||
+                 type == TOK_RBRACE;
+      }
+      if (end >= count)
+        break;
+      cut_range(file, source, &cursor, token_offset(source, tokens[j]),
+                token_offset(source, tokens[end]), "{}");
+      i = end - 1;
+    } else {
+      i = j;
+    }
+  }
+  fwrite(source + cursor, 1, length - cursor, file);
+
+  free(tokens);
+  arena_destroy(&scratch);
+  return true;
+}
+
+bool write_module_interface(AstNode *module) {
+  const char *name = module->preprocessor.module.name;
+  const char *source_path = module->preprocessor.module.file_path;
+  const char *stamp = module->preprocessor.module.interface_stamp;
+  if (!stamp || module->preprocessor.module.from_interface)
+    return false;
+
+  char path[1024];
+  size_t length = 0;
+  const char *source = source_open(source_path, &length);
+  if (!source || !interface_path(path, sizeof(path), source_path))
+    return false;
+
+  // Written beside the interface under a per-process name and renamed, so
+  // concurrent builds sharing the std cache never see a partial one
+#if defined(__MINGW32__) || defined(_WIN32)
+  long pid = (long)GetCurrentProcessId();
+#else
+  long pid = (long)getpid();
+#endif
+  char temp_path[1060];
+  snprintf(temp_path, sizeof(temp_path), "%s.tmp%ld", path, pid);
+
+  FILE *file = fopen(temp_path, "w");
+  if (!file)
+    return false;
+
+  bool ok = write_declarations(file, source, length);
+  if (length && source[length - 1] != '\n')
+    fputc('\n', file);
+  fprintf(file, INTERFACE_FORMAT "\n");
+  fprintf(file, "// compiler %s\n", Luma_Compiler_version);
+  fprintf(file, "// module %s\n", name);
+  fprintf(file, "// source %016llx\n",
+          (unsigned long long)cache_hash_bytes(FNV64_OFFSET, source, length));
+  fprintf(file, "// digest %016llx %016llx\n",
+          (unsigned long long)module->preprocessor.module.token_digest,
+          (unsigned long long)module->preprocessor.module.token_position_digest);
+  fputs(stamp, file);
+  fputs("// end\n", file);
+
+  ok = fclose(file) == 0 && ok;
+  if (ok) {
+    remove(path);
+    ok = rename(temp_path, path) == 0;
+  }
+  if (!ok)
+    remove(temp_path);
+  return ok;
+}
@@ -1,6 +1,8 @@
 #include <stddef.h>
 #include <stdio.h>
 
+#include "../ast/module_graph.h"
+#include "../c_libs/trace/trace.h"
 #include "type.h"
 
 bool typecheck_statement(AstNode *stmt, Scope *scope, ArenaAllocator *arena) {
@@ -95,8 +97,8 @@ bool typecheck_statement(AstNode *stmt, Scope *scope, ArenaAllocator *arena) {
   }
 }
 
-AstNode *typecheck_expression(AstNode *expr, Scope *scope,
-                              ArenaAllocator *arena) {
+static AstNode *check_expression(AstNode *expr, Scope *scope,
+                                 ArenaAllocator *arena) {
   switch (expr->type) {
   case AST_EXPR_LITERAL: {
     switch (expr->expr.literal.lit_type) {
@@ -124,6 +126,8 @@ AstNode *typecheck_expression(AstNode *expr, Scope *scope,
                expr->expr.identifier.name, expr->line);
       return NULL;
     }
+    if (!check_const_read(expr, symbol, scope))
+      return NULL;
     return symbol->type;
   }
   case AST_EXPR_BINARY:
@@ -160,6 +164,8 @@ AstNode *typecheck_expression(AstNode *expr, Scope *scope,
     return typecheck_free_expr(expr, scope, arena);
   case AST_EXPR_MEMCPY:
     return typecheck_memcpy_expr(expr, scope, arena);
+  case AST_EXPR_BUILTIN:
+    return typecheck_builtin_expr(expr, scope, arena);
   case AST_EXPR_SIZEOF:
     return typecheck_sizeof_expr(expr, scope, arena);
   case AST_EXPR_STRUCT:
@@ -173,6 +179,18 @@ AstNode *typecheck_expression(AstNode *expr, Scope *scope,
   }
 }
 
+AstNode *typecheck_expression(AstNode *expr, Scope *scope,
+                              ArenaAllocator *arena) {
+  return record_checked_type(expr, check_expression(expr, scope, arena));
+}
+
+AstNode *record_checked_type(AstNode *expr, AstNode *type) {
+  // Each body is checked by one thread, so its nodes have a single writer
+  if (expr && expr->category == Node_Category_EXPR)
+    expr->expr.checked_type = type;
+  return type;
+}
+
 /**
  * @brief Three-pass typechecking for modules to handle forward references
  *
@@ -201,6 +219,7 @@ bool typecheck_program_multipass(AstNode *program, Scope *global_scope,
   // -------------------------------------------------------------------------
   // This creates empty module scopes so they can be found by @use statements
   // in any module, regardless of declaration order.
+  uint64_t pass_start = trace_now_us();
   for (size_t i = 0; i < module_count; i++) {
     AstNode *module = modules[i];
     if (!module || module->type != AST_PREPROCESSOR_MODULE) {
@@ -215,9 +234,6 @@ bool typecheck_program_multipass(AstNode *program, Scope *global_scope,
       return false;
     }
 
-    Token *tokens = module->preprocessor.module.tokens;
-    size_t token_count = module->preprocessor.module.token_count;
-
     // Check if module already exists (duplicate module definition)
     Scope *existing = find_module_scope(global_scope, module_name);
     if (existing) {
@@ -235,11 +251,15 @@ bool typecheck_program_multipass(AstNode *program, Scope *global_scope,
     }
   }
 
+  trace_complete("Typecheck: register modules", "typecheck", NULL,
+                 pass_start);
+
   // -------------------------------------------------------------------------
   // PASS 2: Process all @use statements
   // -------------------------------------------------------------------------
   // Now that all modules exist, we can resolve imports. This must happen
   // before typechecking bodies because code may reference imported symbols.
+  pass_start = trace_now_us();
   for (size_t i = 0; i < module_count; i++) {
     AstNode *module = modules[i];
     if (!module || module->type != AST_PREPROCESSOR_MODULE) {
@@ -272,27 +292,45 @@ bool typecheck_program_multipass(AstNode *program, Scope *global_scope,
     }
   }
 
+  trace_complete("Typecheck: resolve @use", "typecheck", NULL, pass_start);
+
   // -------------------------------------------------------------------------
   // PASS 3: Typecheck all module bodies (in dependency order)
   // -------------------------------------------------------------------------
-  GrowableArray dep_graph;
-  growable_array_init(&dep_graph, arena, module_count,
-                      sizeof(ModuleDependency));
-  build_dependency_graph(modules, module_count, &dep_graph, arena);
-
-  // Process each module in dependency order
-  for (size_t i = 0; i < module_count; i++) {
-    AstNode *module = modules[i];
-    if (!module || module->type != AST_PREPROCESSOR_MODULE)
-      continue;
+  // Module-level function bodies are queued while the modules are walked and
+  // then checked in parallel (see parallel.c).
+  pass_start = trace_now_us();
+  ModuleGraph *graph = module_graph_get(program, arena);
+  if (graph->cyclic_count > 0) {
+    for (size_t i = 0; i < module_count; i++) {
+      AstNode *module = modules[i];
+      if (!module || module->type != AST_PREPROCESSOR_MODULE ||
+          graph->levels[i] >= 0)
+        continue;
 
-    const char *module_name = module->preprocessor.module.name;
+      g_lines = module->preprocessor.module.lines;
+      g_file_path = module->preprocessor.module.file_path;
+      tc_error_init(g_lines, g_file_path, arena);
+      tc_error(module, "Import Error",
+               "Module '%s' can't be ordered: its @use chain is circular",
+               module->preprocessor.module.name);
+    }
+    return false;
+  }
 
-    if (!process_module_in_order(module_name, &dep_graph, modules, module_count,
-                                 global_scope, arena)) {
-      return false;
+  // Process each module in dependency order
+  BuildConfig *config = global_scope->config;
+  FunctionBodyQueue *bodies =
+      function_body_queue_begin(arena, config ? config->body_cache : NULL);
+  bool ok = true;
+  for (size_t i = 0; i < graph->order_count; i++) {
+    if (!typecheck_module(modules[graph->order[i]], global_scope, arena)) {
+      ok = false;
+      break;
     }
   }
+  ok = function_body_queue_finish(bodies, ok);
 
-  return true;
+  trace_complete("Typecheck: module bodies", "typecheck", NULL, pass_start);
+  return ok;
 }
@@ -1,3 +1,4 @@
+#include "../c_libs/error/error.h"
 #include "type.h"
 #include <stdio.h>
 #include <string.h>
@@ -35,6 +36,20 @@ Scope *find_module_scope(Scope *global_scope, const char *module_name) {
   return NULL;
 }
 
+/**
+ * @brief Make a module checked under another global scope visible in this
+ * one, as if it had been registered here. Its scope keeps its own parent.
+ */
+bool share_module_scope(Scope *global_scope, Scope *module_scope,
+                        ArenaAllocator *arena) {
+  Scope **slot = (Scope **)growable_array_push(&global_scope->children);
+  if (!slot)
+    return false;
+  *slot = module_scope;
+  return register_module(global_scope, module_scope->module_name, module_scope,
+                         arena);
+}
+
 /**
  * @brief Add a module import to a scope
  */
@@ -47,8 +62,9 @@ bool add_module_import(Scope *importing_scope, const char *module_name,
     return false;
   }
 
-  import->module_name = arena_strdup(arena, module_name);
-  import->alias = arena_strdup(arena, alias);
+  (void)arena; // Names are interned so lookups compare atoms
+  import->module_name = intern(module_name);
+  import->alias = intern(alias);
   import->module_scope = module_scope;
 
   return true;
@@ -58,26 +74,32 @@ bool add_module_import(Scope *importing_scope, const char *module_name,
  * @brief Look up a qualified symbol (module_alias.symbol_name) with visibility
  * rules
  */
-Symbol *lookup_qualified_symbol(Scope *scope, const char *module_alias,
+static Symbol *lookup_qualified(Scope *scope, const char *module_alias,
                                 const char *symbol_name) {
+  Atom alias = atom_find(module_alias);
+  Atom name = atom_find(symbol_name);
+  if (!alias || !name) {
+    return NULL;
+  }
+
   Scope *current = scope;
   while (current) {
+    if (current->imported_modules.count) {
+      Symbol *cached = scope_import_cache_get(current, alias, name);
+      if (cached) {
+        return cached;
+      }
+    }
+
     for (size_t i = 0; i < current->imported_modules.count; i++) {
       ModuleImport *import =
           (ModuleImport *)((char *)current->imported_modules.data +
                            i * sizeof(ModuleImport));
 
-      if (strcmp(import->alias, module_alias) == 0) {
-        // Check what symbols exist in the module
-        for (size_t j = 0; j < import->module_scope->symbols.count; j++) {
-          Symbol *s = (Symbol *)((char *)import->module_scope->symbols.data +
-                                 j * sizeof(Symbol));
-        }
-
-        Scope *requesting_module = find_containing_module(scope);
+      if (import->alias == alias) {
         Symbol *result = scope_lookup_current_only_with_visibility(
-            import->module_scope, symbol_name, requesting_module);
-
+            import->module_scope, name, scope->module_scope);
+        scope_import_cache_put(current, alias, name, result);
         return result;
       }
     }
@@ -87,6 +109,23 @@ Symbol *lookup_qualified_symbol(Scope *scope, const char *module_alias,
   return NULL;
 }
 
+Symbol *lookup_qualified_symbol(Scope *scope, const char *module_alias,
+                                const char *symbol_name) {
+  // Recorded as one name (see body_dependency_note), not as the lookup in
+  // the imported module it turns into
+  body_dependencies_pause();
+  Symbol *symbol = lookup_qualified(scope, module_alias, symbol_name);
+  body_dependencies_resume();
+
+  // Resolving the alias depends on the scope it starts from
+  if (scope_is_local(scope) || scope == scope->module_scope)
+    body_dependency_note(BODY_DEP_QUALIFIED, scope, module_alias, symbol_name,
+                         NULL, symbol);
+  else
+    body_dependencies_opaque();
+  return symbol;
+}
+
 /**
  * @brief Create a new module scope
  */
@@ -94,6 +133,7 @@ Scope *create_module_scope(Scope *global_scope, const char *module_name,
                            ArenaAllocator *arena) {
   Scope *module_scope = create_child_scope(global_scope, module_name, arena);
   module_scope->is_module_scope = true;
+  module_scope->module_scope = module_scope;
   module_scope->module_name = arena_strdup(arena, module_name);
 
   growable_array_init(&module_scope->imported_modules, arena, 4,
@@ -102,85 +142,16 @@ Scope *create_module_scope(Scope *global_scope, const char *module_name,
   return module_scope;
 }
 
-void build_dependency_graph(AstNode **modules, size_t module_count,
-                            GrowableArray *dep_graph, ArenaAllocator *arena) {
-  for (size_t i = 0; i < module_count; i++) {
-    AstNode *module = modules[i];
-    if (!module || module->type != AST_PREPROCESSOR_MODULE)
-      continue;
-
-    const char *module_name = module->preprocessor.module.name;
-
-    ModuleDependency *dep = (ModuleDependency *)growable_array_push(dep_graph);
-    dep->module_name = module_name;
-    dep->processed = false;
-    growable_array_init(&dep->dependencies, arena, 4, sizeof(const char *));
-
-    // Scan for @use statements to find dependencies
-    AstNode **body = module->preprocessor.module.body;
-    int body_count = module->preprocessor.module.body_count;
-
-    for (int j = 0; j < body_count; j++) {
-      if (body[j] && body[j]->type == AST_PREPROCESSOR_USE) {
-        const char *imported_module = body[j]->preprocessor.use.module_name;
-        const char **dep_slot =
-            (const char **)growable_array_push(&dep->dependencies);
-        *dep_slot = imported_module;
-      }
-    }
-  }
-}
-
 /**
- * @brief Process modules in dependency order (topological sort)
+ * @brief Typechecks one module; the modules it uses were checked before it
  */
-bool process_module_in_order(const char *module_name, GrowableArray *dep_graph,
-                             AstNode **modules, size_t module_count,
-                             Scope *global_scope, ArenaAllocator *arena) {
-  ModuleDependency *current_dep = NULL;
-  for (size_t i = 0; i < dep_graph->count; i++) {
-    ModuleDependency *dep = (ModuleDependency *)((char *)dep_graph->data +
-                                                 i * sizeof(ModuleDependency));
-    if (strcmp(dep->module_name, module_name) == 0) {
-      current_dep = dep;
-      break;
-    }
-  }
-
-  if (!current_dep)
-    return true;
-  if (current_dep->processed)
-    return true;
+bool typecheck_module(AstNode *module, Scope *global_scope,
+                      ArenaAllocator *arena) {
+  const char *module_name = module->preprocessor.module.name;
 
-  for (size_t i = 0; i < current_dep->dependencies.count; i++) {
-    const char **dep_name =
-        (const char **)((char *)current_dep->dependencies.data +
-                        i * sizeof(const char *));
-    if (!process_module_in_order(*dep_name, dep_graph, modules, module_count,
-                                 global_scope, arena)) {
-      return false;
-    }
-  }
-
-  AstNode *module = NULL;
-  for (size_t i = 0; i < module_count; i++) {
-    if (modules[i] && modules[i]->type == AST_PREPROCESSOR_MODULE &&
-        strcmp(modules[i]->preprocessor.module.name, module_name) == 0) {
-      module = modules[i];
-      break;
-    }
-  }
-
-  if (!module) {
-    tc_error(modules[0], "Internal Error", "Module '%s' not found",
-             module_name);
-    return false;
-  }
-
-  g_tokens = module->preprocessor.module.tokens;
-  g_token_count = module->preprocessor.module.token_count;
+  g_lines = module->preprocessor.module.lines;
   g_file_path = module->preprocessor.module.file_path;
-  tc_error_init(g_tokens, g_token_count, g_file_path, arena);
+  tc_error_init(g_lines, g_file_path, arena);
 
   Scope *module_scope = find_module_scope(global_scope, module_name);
   if (!module_scope) {
@@ -192,6 +163,10 @@ bool process_module_in_order(const char *module_name, GrowableArray *dep_graph,
   AstNode **body = module->preprocessor.module.body;
   int body_count = module->preprocessor.module.body_count;
 
+  module_scope->interface_only =
+      module->preprocessor.module.prebuilt_object != NULL;
+  int errors_before = error_get_count();
+
   // ===== PASS 1: Forward declarations =====
   for (int j = 0; j < body_count; j++) {
     if (!body[j])
@@ -246,11 +221,14 @@ bool process_module_in_order(const char *module_name, GrowableArray *dep_graph,
 
         if (!scope_lookup_current_only(module_scope,
                                        inner->stmt.func_decl.name)) {
-          scope_add_symbol_with_ownership(
-              module_scope, inner->stmt.func_decl.name, func_type,
-              inner->stmt.func_decl.is_public, false,
-              inner->stmt.func_decl.returns_ownership,
-              inner->stmt.func_decl.takes_ownership, arena);
+          if (scope_add_symbol_with_ownership(
+                  module_scope, inner->stmt.func_decl.name, func_type,
+                  inner->stmt.func_decl.is_public, false,
+                  inner->stmt.func_decl.returns_ownership,
+                  inner->stmt.func_decl.takes_ownership, arena))
+            scope_lookup_current_only(module_scope,
+                                      inner->stmt.func_decl.name)
+                ->attributes = inner->stmt.func_decl.attributes;
         }
       } else {
         // For constants and everything else, just typecheck them directly
@@ -279,11 +257,30 @@ bool process_module_in_order(const char *module_name, GrowableArray *dep_graph,
         body[j]->stmt.func_decl.forward_declared)
       continue;
 
+    // An instance of another module's generic reports its errors in the
+    // template's file, where its line numbers are from
+    AstNode *template_module = NULL;
+    if (body[j]->type == AST_STMT_FUNCTION)
+      template_module = body[j]->stmt.func_decl.template_module;
+    else if (body[j]->type == AST_STMT_STRUCT)
+      template_module = body[j]->stmt.struct_decl.template_module;
+    if (template_module) {
+      g_lines = template_module->preprocessor.module.lines;
+      g_file_path = template_module->preprocessor.module.file_path;
+      tc_error_init(g_lines, g_file_path, arena);
+    }
+
     if (!typecheck(body[j], module_scope, arena, global_scope->config)) {
       tc_error(body[j], "Module Error",
                "Failed to typecheck statement in module '%s'", module_name);
       return false;
     }
+
+    if (template_module) {
+      g_lines = module->preprocessor.module.lines;
+      g_file_path = module->preprocessor.module.file_path;
+      tc_error_init(g_lines, g_file_path, arena);
+    }
   }
 
   // ===== PASS 3: Typecheck @os blocks, @links =====
@@ -300,15 +297,8 @@ bool process_module_in_order(const char *module_name, GrowableArray *dep_graph,
     }
   }
 
-  module->preprocessor.module.scope = (void *)module_scope;
-
-  StaticMemoryAnalyzer *analyzer = get_static_analyzer(module_scope);
-  if (analyzer && g_tokens && g_token_count > 0 && g_file_path &&
-      global_scope->config->check_mem) {
-    static_memory_check_and_report(analyzer, arena);
-  }
-
-  current_dep->processed = true;
+  typecheck_finish_module(module, module_scope, global_scope,
+                          error_get_count() == errors_before, arena);
   return true;
 }
 
@@ -0,0 +1,471 @@
+// parallel.c - Checking module-level function bodies on several threads
+//
+// While modules are processed in dependency order, a module-level function
+// is only validated and registered; its body is queued. Once every module
+// has been through that serial pass the queued bodies are checked in
+// parallel, each in a fresh function scope allocated from its thread's own
+// arena, with its own static memory analyzer and its own diagnostics.
+//
+// Diagnostics from the serial pass are staged between queue entries, so the
+// final list is put back together in exactly the order a serial check would
+// have produced, and a body sees only the module symbols declared before it.
+// The first body that fails ends the check there, as it would serially.
+// What happens at the end of a module (publishing a std interface, the
+// memory report) is queued too, because it needs the module's bodies.
+//
+// With a BodyCache (see incremental.c) a body whose tokens and resolved
+// names haven't changed since the last check replays what it reported then,
+// and bodies checked anew are recorded for the next check.
+#include "../c_libs/error/error.h"
+#include "../c_libs/trace/trace.h"
+#include "../llvm/llvm.h"
+#include "type.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BODY_ARENA_SIZE (256 * 1024)
+
+typedef enum { BODY_ENTRY_FUNCTION, BODY_ENTRY_MODULE_END } BodyEntryKind;
+
+typedef struct {
+  BodyEntryKind kind;
+  ErrorBuffer preceding; // Serial-pass diagnostics raised before this entry
+  AstNode *node;         // The function declaration, or the module
+  Scope *module_scope;
+  const LineTable *lines;
+  const char *file_path;
+
+  // BODY_ENTRY_FUNCTION
+  size_t child_slot;       // Reserved slot in module_scope->children
+  size_t visible_symbols;  // Module symbols declared before the body
+  size_t root_allocations; // Module-level allocations tracked before it
+  StaticMemoryAnalyzer analyzer;
+  ErrorBuffer errors;
+  ErrorBuffer memory_report; // The analyzer's report, made by the worker
+  bool ok;
+
+  // With a cache: what the body resolved, or whether it was reused instead
+  GrowableArray dependencies;
+  bool recorded;
+  bool reused;
+
+  // BODY_ENTRY_MODULE_END
+  Scope *global_scope;
+} BodyEntry;
+
+struct FunctionBodyQueue {
+  GrowableArray entries; // BodyEntry, in serial order
+  size_t function_count;
+  ErrorBuffer pending; // Captures the serial pass since the last entry
+  ErrorBuffer *outer_capture;
+  FunctionBodyQueue *outer_queue;
+  ArenaAllocator *arena;
+  BodyCache *cache; // NULL when bodies aren't reused across checks
+  atomic_size_t next_entry;
+};
+
+typedef struct {
+  FunctionBodyQueue *queue;
+  ArenaAllocator arena;
+} BodyWorker;
+
+static _Thread_local FunctionBodyQueue *active_queue = NULL;
+
+static inline BodyEntry *entry_at(FunctionBodyQueue *queue, size_t index) {
+  return (BodyEntry *)((char *)queue->entries.data + index * sizeof(BodyEntry));
+}
+
+FunctionBodyQueue *function_body_queue_begin(ArenaAllocator *arena,
+                                             BodyCache *cache) {
+  FunctionBodyQueue *queue = arena_alloc(arena, sizeof(FunctionBodyQueue),
+                                         alignof(FunctionBodyQueue));
+  if (!queue)
+    return NULL;
+  memset(queue, 0, sizeof(*queue));
+  if (!growable_array_init(&queue->entries, arena, 64, sizeof(BodyEntry)))
+    return NULL;
+
+  queue->arena = arena;
+  queue->cache = cache;
+  if (cache)
+    body_cache_begin_check(cache);
+  queue->outer_capture = error_get_capture();
+  queue->outer_queue = active_queue;
+  atomic_init(&queue->next_entry, 0);
+
+  error_begin_capture(&queue->pending);
+  active_queue = queue;
+  return queue;
+}
+
+// Appends an entry that takes over the diagnostics staged so far
+static BodyEntry *push_entry(FunctionBodyQueue *queue, BodyEntryKind kind) {
+  BodyEntry *entry = (BodyEntry *)growable_array_push(&queue->entries);
+  if (!entry)
+    return NULL;
+  memset(entry, 0, sizeof(*entry));
+  entry->kind = kind;
+  entry->preceding = queue->pending;
+  entry->lines = g_lines;
+  entry->file_path = g_file_path;
+  queue->pending = (ErrorBuffer){0};
+  return entry;
+}
+
+bool typecheck_defer_function_body(AstNode *node, Scope *scope) {
+  FunctionBodyQueue *queue = active_queue;
+  if (!queue || !scope->is_module_scope)
+    return false;
+
+  // The scope is created by the worker; reserving its slot now keeps the
+  // module's children in declaration order
+  Scope **slot = (Scope **)growable_array_push(&scope->children);
+  if (!slot)
+    return false;
+  *slot = NULL;
+
+  BodyEntry *entry = push_entry(queue, BODY_ENTRY_FUNCTION);
+  if (!entry) {
+    scope->children.count--;
+    return false;
+  }
+
+  StaticMemoryAnalyzer *root = get_static_analyzer(scope);
+  entry->node = node;
+  entry->module_scope = scope;
+  entry->child_slot = scope->children.count - 1;
+  entry->visible_symbols = scope->symbols.count;
+  entry->root_allocations = root ? root->allocations.count : 0;
+  queue->function_count++;
+  return true;
+}
+
+/**
+ * @brief Publishes a std module's interface and reports its memory issues.
+ *
+ * @param functions The module's queued bodies, in order (NULL when the body
+ * checks ran inline); their analyzers are reported between the module-level
+ * allocations tracked before each of them.
+ */
+static void finish_module_now(AstNode *module, Scope *module_scope,
+                              Scope *global_scope, bool checked_cleanly,
+                              BodyEntry **functions, size_t function_count,
+                              ArenaAllocator *arena) {
+  module->preprocessor.module.scope = (void *)module_scope;
+
+  // A std module that checked cleanly gets its interface (re)published
+  if (module->preprocessor.module.interface_key &&
+      !module_scope->interface_only && checked_cleanly) {
+    write_module_interface(module);
+  }
+
+  StaticMemoryAnalyzer *analyzer = get_static_analyzer(module_scope);
+  if (!analyzer || !g_lines || !g_file_path ||
+      !global_scope->config->check_mem) {
+    for (size_t i = 0; i < function_count; i++)
+      free(functions[i]->memory_report.items);
+    return;
+  }
+
+  for (size_t i = 0; i < function_count; i++) {
+    static_memory_check_and_report_until(
+        analyzer, functions[i]->root_allocations, arena);
+    error_flush_buffer(&functions[i]->memory_report);
+  }
+  static_memory_check_and_report(analyzer, arena);
+}
+
+void typecheck_finish_module(AstNode *module, Scope *module_scope,
+                             Scope *global_scope, bool checked_cleanly,
+                             ArenaAllocator *arena) {
+  FunctionBodyQueue *queue = active_queue;
+  BodyEntry *entry = queue ? push_entry(queue, BODY_ENTRY_MODULE_END) : NULL;
+  if (!entry) {
+    finish_module_now(module, module_scope, global_scope, checked_cleanly,
+                      NULL, 0, arena);
+    return;
+  }
+
+  entry->node = module;
+  entry->module_scope = module_scope;
+  entry->global_scope = global_scope;
+}
+
+static void check_function_body(FunctionBodyQueue *queue, BodyEntry *entry,
+                                ArenaAllocator *arena) {
+  AstNode *node = entry->node;
+  Scope *module_scope = entry->module_scope;
+  bool check_mem = module_scope->config && module_scope->config->check_mem;
+
+  error_begin_capture(&entry->errors);
+  tc_error_init(entry->lines, entry->file_path, arena);
+  scope_limit_visible(module_scope, entry->visible_symbols);
+
+  const BodyCacheEntry *cached =
+      queue->cache ? body_cache_lookup(queue->cache, node, module_scope,
+                                       check_mem, arena)
+                   : NULL;
+  if (cached) {
+    entry->ok = body_cache_replay(cached, &entry->memory_report, arena);
+    entry->reused = true;
+    scope_limit_visible(NULL, 0);
+    error_end_capture();
+    return;
+  }
+
+  Scope *func_scope = arena_alloc(arena, sizeof(Scope), alignof(Scope));
+  if (!func_scope) {
+    tc_error(node, "Internal Error", "Out of memory checking function '%s'",
+             node->stmt.func_decl.name);
+    entry->ok = false;
+    scope_limit_visible(NULL, 0);
+    error_end_capture();
+    return;
+  }
+
+  init_scope(func_scope, module_scope, node->stmt.func_decl.name, arena);
+  ((Scope **)module_scope->children.data)[entry->child_slot] = func_scope;
+
+  // Allocations are matched within one function, so each body gets its own
+  // analyzer instead of sharing the root scope's
+  static_memory_analyzer_init(&entry->analyzer, arena);
+  func_scope->memory_analyzer = &entry->analyzer;
+
+  bool record = queue->cache &&
+                growable_array_init(&entry->dependencies, arena, 32,
+                                    sizeof(BodyDependency));
+  if (record)
+    body_dependencies_begin(&entry->dependencies, module_scope, arena);
+  entry->ok = typecheck_func_body(node, func_scope, arena);
+  if (record)
+    entry->recorded = body_dependencies_end();
+  scope_limit_visible(NULL, 0);
+
+  // The body's allocations are complete, so its part of the module's memory
+  // report can be made here; finish_module_now puts it in place
+  if (check_mem && entry->lines && entry->file_path) {
+    error_begin_capture(&entry->memory_report);
+    static_memory_check_and_report(&entry->analyzer, arena);
+  }
+
+  error_end_capture();
+}
+
+static void *body_worker(void *arg) {
+  BodyWorker *worker = (BodyWorker *)arg;
+  FunctionBodyQueue *queue = worker->queue;
+
+  for (;;) {
+    size_t index = atomic_fetch_add(&queue->next_entry, 1);
+    if (index >= queue->entries.count)
+      break;
+
+    BodyEntry *entry = entry_at(queue, index);
+    if (entry->kind == BODY_ENTRY_FUNCTION)
+      check_function_body(queue, entry, &worker->arena);
+  }
+
+  return NULL;
+}
+
+static void *body_thread(void *arg) {
+  trace_set_thread_name("typecheck worker");
+  return body_worker(arg);
+}
+
+// Checks every queued body, using up to get_compile_thread_count() threads
+// including the calling one, then hands the workers' arenas to the queue's
+static void check_function_bodies(FunctionBodyQueue *queue) {
+  size_t thread_count = get_compile_thread_count();
+  if (thread_count > queue->function_count)
+    thread_count = queue->function_count;
+  if (thread_count == 0)
+    return;
+
+  BodyWorker *workers = xcalloc(thread_count, sizeof(BodyWorker));
+  for (size_t i = 0; i < thread_count; i++) {
+    workers[i].queue = queue;
+    if (arena_allocator_init(&workers[i].arena, BODY_ARENA_SIZE) != 0) {
+      thread_count = i;
+      break;
+    }
+  }
+
+  if (thread_count == 0) {
+    // No private arena: check everything here from the shared one
+    for (size_t i = 0; i < queue->entries.count; i++) {
+      BodyEntry *entry = entry_at(queue, i);
+      if (entry->kind == BODY_ENTRY_FUNCTION)
+        check_function_body(queue, entry, queue->arena);
+    }
+    free(workers);
+    return;
+  }
+
+  pthread_t *threads = NULL;
+  size_t started = 0;
+  if (thread_count > 1) {
+    threads = xmalloc(sizeof(pthread_t) * (thread_count - 1));
+    for (size_t i = 1; i < thread_count; i++) {
+      if (pthread_create(&threads[started], NULL, body_thread, &workers[i]) !=
+          0)
+        break;
+      started++;
+    }
+  }
+
+  body_worker(&workers[0]);
+
+  for (size_t i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+
+  // Scopes, types and messages made by the workers live as long as the AST
+  for (size_t i = 0; i < thread_count; i++) {
+    arena_adopt(queue->arena, &workers[i].arena);
+    arena_destroy(&workers[i].arena);
+  }
+  free(workers);
+}
+
+// Runs before any diagnostics are flushed, while every buffer is still whole
+static void update_body_cache(FunctionBodyQueue *queue) {
+  for (size_t i = 0; i < queue->entries.count; i++) {
+    BodyEntry *entry = entry_at(queue, i);
+    if (entry->kind != BODY_ENTRY_FUNCTION)
+      continue;
+
+    if (entry->reused) {
+      PendingBody body = {entry->node,          entry->module_scope,
+                          entry->child_slot,    entry->visible_symbols,
+                          entry->lines,         entry->file_path};
+      body_cache_add_pending(queue->cache, &body);
+    } else if (entry->recorded) {
+      Scope *module_scope = entry->module_scope;
+      body_cache_store(queue->cache, entry->node, module_scope,
+                       module_scope->config && module_scope->config->check_mem,
+                       &entry->dependencies, &entry->errors,
+                       &entry->memory_report, entry->ok);
+    }
+  }
+}
+
+void typecheck_pending_bodies(PendingBodies *pending, ArenaAllocator *arena) {
+  if (!pending)
+    return;
+
+  // Everything these bodies report was reported already, from the cache
+  ErrorBuffer *outer = error_get_capture();
+  ErrorBuffer discarded = {0};
+  error_begin_capture(&discarded);
+
+  for (size_t i = 0; i < pending->count; i++) {
+    PendingBody *body = &pending->bodies[i];
+    Scope *func_scope = arena_alloc(arena, sizeof(Scope), alignof(Scope));
+    StaticMemoryAnalyzer *analyzer = arena_alloc(
+        arena, sizeof(StaticMemoryAnalyzer), alignof(StaticMemoryAnalyzer));
+    if (!func_scope || !analyzer)
+      break;
+
+    tc_error_init(body->lines, body->file_path, arena);
+    init_scope(func_scope, body->module_scope, body->node->stmt.func_decl.name,
+               arena);
+    ((Scope **)body->module_scope->children.data)[body->child_slot] =
+        func_scope;
+    static_memory_analyzer_init(analyzer, arena);
+    func_scope->memory_analyzer = analyzer;
+
+    scope_limit_visible(body->module_scope, body->visible_symbols);
+    typecheck_func_body(body->node, func_scope, arena);
+    scope_limit_visible(NULL, 0);
+  }
+  pending->count = 0;
+
+  free(discarded.items);
+  error_begin_capture(outer);
+}
+
+bool function_body_queue_finish(FunctionBodyQueue *queue, bool serial_ok) {
+  if (!queue)
+    return serial_ok;
+
+  active_queue = queue->outer_queue;
+  error_end_capture();
+
+  uint64_t start = trace_now_us();
+  check_function_bodies(queue);
+  trace_complete("Typecheck: function bodies", "typecheck", NULL, start);
+
+  if (queue->cache)
+    update_body_cache(queue);
+
+  // Diagnostics go wherever they went before the queue began
+  if (queue->outer_capture)
+    error_begin_capture(queue->outer_capture);
+
+  bool ok = serial_ok;
+  bool stopped = false;
+  size_t module_start = 0;
+  int module_errors = 0;
+
+  for (size_t i = 0; i < queue->entries.count; i++) {
+    BodyEntry *entry = entry_at(queue, i);
+
+    if (stopped) {
+      free(entry->preceding.items);
+      free(entry->errors.items);
+      free(entry->memory_report.items);
+      continue;
+    }
+
+    module_errors += entry->preceding.count;
+    error_flush_buffer(&entry->preceding);
+
+    if (entry->kind == BODY_ENTRY_FUNCTION) {
+      module_errors += entry->errors.count;
+      error_flush_buffer(&entry->errors);
+      if (!entry->ok) {
+        // What the module pass reports when a statement fails serially
+        tc_error_init(entry->lines, entry->file_path, queue->arena);
+        tc_error(entry->node, "Module Error",
+                 "Failed to typecheck statement in module '%s'",
+                 entry->module_scope->module_name);
+        ok = false;
+        stopped = true;
+      }
+      continue;
+    }
+
+    // The module's entries sit between the previous module's end and its own
+    BodyEntry **functions =
+        arena_alloc(queue->arena, (i - module_start + 1) * sizeof(BodyEntry *),
+                    alignof(BodyEntry *));
+    size_t function_count = 0;
+    for (size_t j = module_start; functions && j < i; j++) {
+      BodyEntry *function = entry_at(queue, j);
+      if (function->kind == BODY_ENTRY_FUNCTION &&
+          function->module_scope == entry->module_scope)
+        functions[function_count++] = function;
+    }
+
+    tc_error_init(entry->lines, entry->file_path, queue->arena);
+    finish_module_now(entry->node, entry->module_scope, entry->global_scope,
+                      module_errors == 0, functions, function_count,
+                      queue->arena);
+    module_start = i + 1;
+    module_errors = 0;
+  }
+
+  // Whatever the serial pass reported after the last entry, unless a body
+  // failed first (the serial check would have stopped there)
+  if (stopped)
+    free(queue->pending.items);
+  else
+    error_flush_buffer(&queue->pending);
+
+  return ok;
+}
@@ -14,6 +14,7 @@
  * - Automatic parent-child relationship management
  */
 
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -61,6 +62,12 @@ void init_scope(Scope *scope, Scope *parent, const char *name,
   scope->is_module_scope = false;
   scope->associated_node = NULL;
   scope->module_name = NULL;
+  scope->module_scope = parent ? parent->module_scope : NULL;
+  scope->import_cache = NULL;
+  scope->import_cache_capacity = 0;
+  scope->import_cache_count = 0;
+  scope->import_cache_generation = 0;
+  scope->interface_only = false;
   scope->config = parent ? parent->config : NULL; // ADD THIS LINE
 
   if (!parent) {
@@ -71,42 +78,240 @@ void init_scope(Scope *scope, Scope *parent, const char *name,
     scope->memory_analyzer = parent->memory_analyzer;
   }
 
-  growable_array_init(&scope->symbols, arena, 16, sizeof(Symbol));
+  chunked_array_init(&scope->symbols, arena, 16, sizeof(Symbol));
+  scope->symbol_index = NULL;
+  scope->index_capacity = 0;
   growable_array_init(&scope->children, arena, 8, sizeof(Scope *));
   growable_array_init(&scope->imported_modules, arena, 4, sizeof(ModuleImport));
   growable_array_init(&scope->deferred_frees, arena, 4, sizeof(const char *));
   growable_array_init(&scope->link_libs, arena, 4, sizeof(const char *));
 }
 
-Symbol *scope_lookup_with_visibility(Scope *scope, const char *name,
-                                     Scope *requesting_module_scope) {
+// Scopes with more symbols than this get a hash index; below it, comparing
+// every atom is as fast as hashing
+#define SCOPE_INDEX_THRESHOLD 8
+
+// A function body checked after the rest of its module sees only the module
+// symbols declared before it (see scope_limit_visible)
+static _Thread_local const Scope *limited_scope = NULL;
+static _Thread_local size_t limited_count = 0;
+
+void scope_limit_visible(const Scope *scope, size_t count) {
+  limited_scope = scope;
+  limited_count = count;
+}
+
+/**
+ * @brief Finds the symbol named @p key declared directly in @p scope
+ */
+static Symbol *find_symbol_atom(const Scope *scope, Atom key) {
+  size_t count = scope == limited_scope ? limited_count : scope->symbols.count;
+
+  if (!scope->symbol_index) {
+    for (size_t i = 0; i < count; ++i) {
+      Symbol *s = scope_symbol(scope, i);
+      if (s->name == key)
+        return s;
+    }
+    return NULL;
+  }
+
+  size_t mask = scope->index_capacity - 1;
+  for (size_t i = atom_hash(key) & mask;; i = (i + 1) & mask) {
+    uint32_t slot = scope->symbol_index[i];
+    if (!slot)
+      return NULL;
+    Symbol *s = scope_symbol(scope, slot - 1);
+    if (s->name == key)
+      return slot - 1 < count ? s : NULL;
+  }
+}
+
+static void index_insert(uint32_t *index, size_t capacity, Atom key,
+                         size_t position) {
+  size_t mask = capacity - 1;
+  size_t i = atom_hash(key) & mask;
+  while (index[i])
+    i = (i + 1) & mask;
+  index[i] = (uint32_t)position + 1;
+}
+
+/**
+ * @brief Adds the newest symbol of @p scope to its index, building or
+ * growing the index (kept at most half full) when needed. If memory runs
+ * out the index is dropped, and lookups fall back to a linear scan.
+ */
+static void index_new_symbol(Scope *scope) {
+  size_t count = scope->symbols.count;
+  if (!scope->symbol_index && count <= SCOPE_INDEX_THRESHOLD)
+    return;
+
+  if (scope->symbol_index && count * 2 <= scope->index_capacity) {
+    index_insert(scope->symbol_index, scope->index_capacity,
+                 scope_symbol(scope, count - 1)->name, count - 1);
+    return;
+  }
+
+  size_t capacity = scope->index_capacity ? scope->index_capacity * 2 : 32;
+  while (count * 2 > capacity)
+    capacity *= 2;
+
+  uint32_t *index = arena_alloc(scope->symbols.arena,
+                                capacity * sizeof(uint32_t), alignof(uint32_t));
+  if (!index) {
+    scope->symbol_index = NULL;
+    scope->index_capacity = 0;
+    return;
+  }
+  memset(index, 0, capacity * sizeof(uint32_t));
+  for (size_t i = 0; i < count; i++)
+    index_insert(index, capacity, scope_symbol(scope, i)->name, i);
+
+  scope->symbol_index = index;
+  scope->index_capacity = capacity;
+}
+
+// Bumped whenever a module scope gains a symbol: an import cache entry may
+// then be shadowed by an earlier import, so every cache starts over
+static size_t import_generation = 1;
+
+// Lookups fill the caches, and function bodies are looked up from several
+// threads at once
+static pthread_mutex_t import_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline size_t import_cache_hash(Atom alias, Atom name) {
+  return (alias ? atom_hash(alias) : 0) * 31u + atom_hash(name);
+}
+
+// Caller holds import_cache_lock
+static Symbol *import_cache_find(Scope *scope, Atom alias, Atom name) {
+  if (!scope->import_cache ||
+      scope->import_cache_generation != import_generation)
+    return NULL;
+
+  size_t mask = scope->import_cache_capacity - 1;
+  for (size_t i = import_cache_hash(alias, name) & mask;; i = (i + 1) & mask) {
+    ImportCacheEntry *entry = &scope->import_cache[i];
+    if (!entry->name)
+      return NULL;
+    if (entry->name == name && entry->alias == alias)
+      return entry->symbol;
+  }
+}
+
+// Caller holds import_cache_lock
+static void import_cache_insert(Scope *scope, Atom alias, Atom name,
+                                Symbol *symbol) {
+  if (scope->import_cache_generation != import_generation) {
+    if (scope->import_cache)
+      memset(scope->import_cache, 0,
+             scope->import_cache_capacity * sizeof(ImportCacheEntry));
+    scope->import_cache_count = 0;
+    scope->import_cache_generation = import_generation;
+  }
+
+  if ((scope->import_cache_count + 1) * 2 > scope->import_cache_capacity) {
+    size_t capacity =
+        scope->import_cache_capacity ? scope->import_cache_capacity * 2 : 16;
+    ImportCacheEntry *cache =
+        arena_alloc(scope->symbols.arena, capacity * sizeof(ImportCacheEntry),
+                    alignof(ImportCacheEntry));
+    if (!cache)
+      return;
+    memset(cache, 0, capacity * sizeof(ImportCacheEntry));
+
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < scope->import_cache_capacity; i++) {
+      ImportCacheEntry *old = &scope->import_cache[i];
+      if (!old->name)
+        continue;
+      size_t j = import_cache_hash(old->alias, old->name) & mask;
+      while (cache[j].name)
+        j = (j + 1) & mask;
+      cache[j] = *old;
+    }
+    scope->import_cache = cache;
+    scope->import_cache_capacity = capacity;
+  }
+
+  size_t mask = scope->import_cache_capacity - 1;
+  size_t i = import_cache_hash(alias, name) & mask;
+  while (scope->import_cache[i].name) {
+    if (scope->import_cache[i].name == name &&
+        scope->import_cache[i].alias == alias)
+      return;
+    i = (i + 1) & mask;
+  }
+  scope->import_cache[i] = (ImportCacheEntry){alias, name, symbol};
+  scope->import_cache_count++;
+}
+
+Symbol *scope_import_cache_get(Scope *scope, Atom alias, Atom name) {
+  pthread_mutex_lock(&import_cache_lock);
+  Symbol *symbol = import_cache_find(scope, alias, name);
+  pthread_mutex_unlock(&import_cache_lock);
+  return symbol;
+}
+
+/**
+ * @brief Remembers that @p name (qualified by @p alias, or NULL) resolves to
+ * @p symbol through the imports of @p scope. Only public symbols belong
+ * here: whether a private one is visible depends on who is asking. A full
+ * table grows; if memory runs out the name is simply not cached.
+ */
+void scope_import_cache_put(Scope *scope, Atom alias, Atom name,
+                            Symbol *symbol) {
+  if (!name || !symbol || !symbol->is_public)
+    return;
+  pthread_mutex_lock(&import_cache_lock);
+  import_cache_insert(scope, alias, name, symbol);
+  pthread_mutex_unlock(&import_cache_lock);
+}
+
+static Symbol *lookup_atom_current_only(Scope *scope, Atom key,
+                                        Scope *requesting_module_scope);
+
+// @p found_in is set to the scope declaring the name when it is declared on
+// the way up (as opposed to found through an import or not at all)
+static Symbol *lookup_with_visibility(Scope *scope, const char *name,
+                                      Scope *requesting_module_scope,
+                                      Scope **found_in) {
+  // Symbol names are atoms: a name that was never interned names nothing,
+  // and the rest of the search compares pointers
+  Atom key = atom_find(name);
+  if (!key)
+    return NULL;
+
   Scope *current = scope;
 
   while (current) {
-    // Linear search through current scope's symbols
-    for (size_t i = 0; i < current->symbols.count; ++i) {
-      Symbol *s =
-          (Symbol *)((char *)current->symbols.data + i * sizeof(Symbol));
-      if (strcmp(s->name, name) == 0) {
-
-        // Check visibility rules
-        if (s->is_public) {
-          return s; // Public symbols are always accessible
-        }
-
-        // Private symbols: check if we're in the same module
-        Scope *symbol_module = find_containing_module(current);
-        Scope *requesting_module = requesting_module_scope
-                                       ? requesting_module_scope
-                                       : find_containing_module(scope);
-
-        if (symbol_module == requesting_module) {
-          return s; // Same module - private symbol is accessible
-        }
-
-        // Different module and symbol is private - not accessible
-        return NULL;
+    Symbol *s = find_symbol_atom(current, key);
+    if (s) {
+      *found_in = current;
+
+      // Check visibility rules
+      if (s->is_public) {
+        return s; // Public symbols are always accessible
+      }
+
+      // Private symbols: check if we're in the same module
+      Scope *symbol_module = current->module_scope;
+      Scope *requesting_module = requesting_module_scope
+                                     ? requesting_module_scope
+                                     : scope->module_scope;
+
+      if (symbol_module == requesting_module) {
+        return s; // Same module - private symbol is accessible
       }
+
+      // Different module and symbol is private - not accessible
+      return NULL;
+    }
+
+    if (current->imported_modules.count) {
+      Symbol *cached = scope_import_cache_get(current, NULL, key);
+      if (cached)
+        return cached;
     }
 
     for (size_t i = 0; i < current->imported_modules.count; i++) {
@@ -115,10 +320,11 @@ Symbol *scope_lookup_with_visibility(Scope *scope, const char *name,
                            i * sizeof(ModuleImport));
 
       // Search in the imported module's scope
-      Symbol *found = scope_lookup_current_only_with_visibility(
-          import->module_scope, name, scope);
+      Symbol *found =
+          lookup_atom_current_only(import->module_scope, key, scope);
 
       if (found) {
+        scope_import_cache_put(current, NULL, key, found);
         return found;
       }
     }
@@ -129,6 +335,23 @@ Symbol *scope_lookup_with_visibility(Scope *scope, const char *name,
   return NULL;
 }
 
+Symbol *scope_lookup_with_visibility(Scope *scope, const char *name,
+                                     Scope *requesting_module_scope) {
+  Scope *found_in = NULL;
+  Symbol *s =
+      lookup_with_visibility(scope, name, requesting_module_scope, &found_in);
+
+  // A body being recorded for reuse depends on every name it resolves
+  // outside its own scopes, including the names that resolve to nothing
+  if (!scope_is_local(scope))
+    body_dependency_note(BODY_DEP_IN_SCOPE, scope, NULL, name,
+                         requesting_module_scope, s);
+  else if (!scope_is_local(found_in))
+    body_dependency_note(BODY_DEP_UNQUALIFIED, scope, NULL, name,
+                         requesting_module_scope, s);
+  return s;
+}
+
 const char *get_current_function_name(Scope *scope) {
   Scope *current = scope;
   while (current) {
@@ -145,12 +368,14 @@ bool scope_add_symbol_with_ownership(Scope *scope, const char *name,
                                      bool is_mutable, bool returns_ownership,
                                      bool takes_ownership,
                                      ArenaAllocator *arena) {
-  Symbol *existing = scope_lookup_current_only(scope, name);
+  (void)arena; // The name is interned rather than copied
+  Atom key = intern(name);
+  Symbol *existing = lookup_atom_current_only(scope, key, NULL);
   if (existing) {
     return true; // Already registered, skip silently
   }
 
-  Symbol *s = (Symbol *)growable_array_push(&scope->symbols);
+  Symbol *s = (Symbol *)chunked_array_push(&scope->symbols);
   if (!s) {
     if (type) {
       tc_error(type, "Internal Error", "Out of memory while adding symbol '%s'",
@@ -159,14 +384,18 @@ bool scope_add_symbol_with_ownership(Scope *scope, const char *name,
     return false;
   }
 
-  s->name = arena_strdup(arena, name);
+  s->name = key;
   s->type = type;
   s->is_public = is_public;
   s->is_mutable = is_mutable;
   s->scope_depth = scope->depth;
   s->returns_ownership = returns_ownership;
   s->takes_ownership = takes_ownership;
+  s->attributes = 0;
 
+  index_new_symbol(scope);
+  if (scope->is_module_scope)
+    import_generation++;
   return true;
 }
 
@@ -181,14 +410,8 @@ bool scope_add_symbol(Scope *scope, const char *name, AstNode *type,
  * @brief Find the containing module scope for a given scope
  */
 Scope *find_containing_module(Scope *scope) {
-  Scope *current = scope;
-  while (current) {
-    if (current->is_module_scope) {
-      return current;
-    }
-    current = current->parent;
-  }
-  return NULL; // Global scope or not in a module
+  // Each scope records it when created; NULL for the global scope
+  return scope ? scope->module_scope : NULL;
 }
 
 /**
@@ -199,39 +422,49 @@ Symbol *scope_lookup(Scope *scope, const char *name) {
 }
 
 /**
- * @brief Look up a symbol only in the current scope with visibility rules
+ * @brief Look up an interned name in one scope with visibility rules
  */
-Symbol *
-scope_lookup_current_only_with_visibility(Scope *scope, const char *name,
-                                          Scope *requesting_module_scope) {
-  // Linear search through current scope's symbols only
-  for (size_t i = 0; i < scope->symbols.count; ++i) {
-    Symbol *s = (Symbol *)((char *)scope->symbols.data + i * sizeof(Symbol));
-    if (strcmp(s->name, name) == 0) {
-
-      // Check visibility rules
-      if (s->is_public) {
-        return s; // Public symbols are always accessible
-      }
+static Symbol *lookup_atom_current_only(Scope *scope, Atom key,
+                                        Scope *requesting_module_scope) {
+  Symbol *s = find_symbol_atom(scope, key);
+  if (!s) {
+    return NULL;
+  }
 
-      // Private symbols: check if we're in the same module
-      Scope *symbol_module = find_containing_module(scope);
-      Scope *requesting_module = requesting_module_scope
-                                     ? requesting_module_scope
-                                     : find_containing_module(scope);
+  // Check visibility rules
+  if (s->is_public) {
+    return s; // Public symbols are always accessible
+  }
 
-      if (symbol_module == requesting_module) {
-        return s; // Same module - private symbol is accessible
-      }
+  // Private symbols: check if we're in the same module
+  Scope *symbol_module = scope->module_scope;
+  Scope *requesting_module = requesting_module_scope
+                                 ? requesting_module_scope
+                                 : scope->module_scope;
 
-      // Different module and symbol is private - not accessible
-      return NULL;
-    }
+  if (symbol_module == requesting_module) {
+    return s; // Same module - private symbol is accessible
   }
 
+  // Different module and symbol is private - not accessible
   return NULL;
 }
 
+/**
+ * @brief Look up a symbol only in the current scope with visibility rules
+ */
+Symbol *
+scope_lookup_current_only_with_visibility(Scope *scope, const char *name,
+                                          Scope *requesting_module_scope) {
+  Atom key = atom_find(name);
+  Symbol *s =
+      key ? lookup_atom_current_only(scope, key, requesting_module_scope) : NULL;
+  if (!scope_is_local(scope))
+    body_dependency_note(BODY_DEP_IN_SCOPE_ONLY, scope, NULL, name,
+                         requesting_module_scope, s);
+  return s;
+}
+
 /**
  * @brief Original scope_lookup_current_only - now wraps the visibility version
  */
@@ -248,12 +481,14 @@ Symbol *scope_lookup_current_only(Scope *scope, const char *name) {
  *
  * @param parent Parent scope for the new child (NULL for root scope)
  * @param name Descriptive name for the new scope
- * @param arena Arena allocator for memory management
+ * @param arena Arena allocator for a scope without a parent
  * @return Pointer to the newly created and initialized child scope
  *
  * @details
  * Creation process:
- * 1. Allocate memory for new Scope structure from arena
+ * 1. Allocate memory for new Scope structure from the parent's arena, so a
+ *    whole scope tree lives in the arena its root was set up with and can
+ *    be released apart from the types and AST the typechecker builds
  * 2. Initialize the scope with proper parent linkage
  * 3. Add the new scope to parent's children array (if parent exists)
  * 4. Return pointer to fully initialized child scope
@@ -272,7 +507,9 @@ Symbol *scope_lookup_current_only(Scope *scope, const char *name) {
  */
 Scope *create_child_scope(Scope *parent, const char *name,
                           ArenaAllocator *arena) {
-  // Allocate memory for new scope structure from arena
+  // Allocate memory for new scope structure from the parent's arena
+  if (parent)
+    arena = parent->symbols.arena;
   Scope *child = arena_alloc(arena, sizeof(Scope), alignof(Scope));
 
   // Initialize the child scope with proper parent linkage
@@ -3,20 +3,81 @@
 #include <stdio.h>
 #include <string.h>
 
+#define BINDING_INITIAL_SLOTS 32
+
 void static_memory_analyzer_init(StaticMemoryAnalyzer *analyzer,
                                  ArenaAllocator *arena) {
   analyzer->arena = arena;
   analyzer->skip_memory_tracking = false;
+  analyzer->bindings = NULL;
+  analyzer->binding_capacity = 0;
+  analyzer->binding_count = 0;
   growable_array_init(&analyzer->allocations, arena, 32,
                       sizeof(StaticAllocation));
 }
 
+static inline size_t binding_hash(Atom function, Atom name) {
+  return (function ? atom_hash(function) : 0) * 31u + atom_hash(name);
+}
+
+// Finds the slot bound to @p name in @p function, or the empty slot where it
+// belongs
+static AllocationBinding *find_binding(AllocationBinding *bindings,
+                                       size_t capacity, Atom function,
+                                       Atom name) {
+  size_t mask = capacity - 1;
+  for (size_t i = binding_hash(function, name) & mask;; i = (i + 1) & mask) {
+    AllocationBinding *binding = &bindings[i];
+    if (!binding->name ||
+        (binding->name == name && binding->function == function))
+      return binding;
+  }
+}
+
+static bool grow_bindings(StaticMemoryAnalyzer *analyzer) {
+  size_t capacity = analyzer->binding_capacity
+                        ? analyzer->binding_capacity * 2
+                        : BINDING_INITIAL_SLOTS;
+  AllocationBinding *bindings =
+      arena_alloc(analyzer->arena, capacity * sizeof(AllocationBinding),
+                  alignof(AllocationBinding));
+  if (!bindings)
+    return false;
+  memset(bindings, 0, capacity * sizeof(AllocationBinding));
+
+  for (size_t i = 0; i < analyzer->binding_capacity; i++) {
+    AllocationBinding *old = &analyzer->bindings[i];
+    if (old->name)
+      *find_binding(bindings, capacity, old->function, old->name) = *old;
+  }
+
+  analyzer->bindings = bindings;
+  analyzer->binding_capacity = capacity;
+  return true;
+}
+
+// Makes @p name refer to the allocation at @p position, unless it already
+// refers to a newer one
+static void bind_name(StaticMemoryAnalyzer *analyzer, Atom function, Atom name,
+                      size_t position) {
+  if ((analyzer->binding_count + 1) * 2 > analyzer->binding_capacity &&
+      !grow_bindings(analyzer))
+    return;
+
+  AllocationBinding *binding = find_binding(
+      analyzer->bindings, analyzer->binding_capacity, function, name);
+  if (!binding->name) {
+    *binding = (AllocationBinding){function, name, position};
+    analyzer->binding_count++;
+  } else if (binding->allocation < position) {
+    binding->allocation = position;
+  }
+}
+
 void static_memory_track_alloc(StaticMemoryAnalyzer *analyzer, size_t line,
                                size_t column, const char *var_name,
-                               const char *function_name, Token *tokens,
-                               size_t token_count, const char *file_path) {
-  (void)tokens;
-  (void)token_count;
+                               const char *function_name,
+                               const LineTable *lines, const char *file_path) {
   if (!var_name || strcmp(var_name, "anonymous") == 0) {
     return;
   }
@@ -26,69 +87,52 @@ void static_memory_track_alloc(StaticMemoryAnalyzer *analyzer, size_t line,
   if (alloc) {
     alloc->line = line;
     alloc->column = column;
-    alloc->variable_name = arena_strdup(analyzer->arena, var_name);
+    alloc->variable_name = intern(var_name);
     alloc->has_matching_free = false;
     alloc->free_count = 0;
+    alloc->conditional_free_count = 0;
     alloc->reported = false;
-    alloc->function_name =
-        function_name ? arena_strdup(analyzer->arena, function_name) : NULL;
+    alloc->address_taken = false;
+    alloc->function_name = intern(function_name);
 
     alloc->file_path =
         file_path ? arena_strdup(analyzer->arena, file_path) : NULL;
+    alloc->lines = lines;
 
-    growable_array_init(&alloc->aliases, analyzer->arena, 4, sizeof(char *));
+    growable_array_init(&alloc->aliases, analyzer->arena, 4, sizeof(Atom));
+    bind_name(analyzer, alloc->function_name, alloc->variable_name,
+              analyzer->allocations.count - 1);
   }
 }
 
+/**
+ * @brief The allocation @p var_name refers to in @p current_function: the
+ * newest one made under that name or that it became an alias of.
+ */
 static StaticAllocation *find_allocation_by_name(StaticMemoryAnalyzer *analyzer,
                                                  const char *var_name,
                                                  const char *current_function) {
-  if (!var_name)
+  if (!var_name || !analyzer->binding_count)
     return NULL;
 
-  // Search in reverse order to find the most recent allocation
-  for (size_t i = analyzer->allocations.count; i > 0; i--) {
-    StaticAllocation *alloc =
-        (StaticAllocation *)((char *)analyzer->allocations.data +
-                             (i - 1) * sizeof(StaticAllocation));
-
-    // Match both variable name AND function scope
-    if (alloc->variable_name && strcmp(alloc->variable_name, var_name) == 0) {
-      // If we're tracking function names, ensure they match
-      if (alloc->function_name && current_function) {
-        if (strcmp(alloc->function_name, current_function) == 0) {
-          return alloc; // Return first match in this function
-        }
-      } else if (!alloc->function_name && !current_function) {
-        return alloc; // Global scope match
-      }
-    }
-
-    // Also check aliases
-    if (alloc->aliases.data) {
-      for (size_t j = 0; j < alloc->aliases.count; j++) {
-        char **alias =
-            (char **)((char *)alloc->aliases.data + j * sizeof(char *));
-        if (*alias && strcmp(*alias, var_name) == 0) {
-          if (alloc->function_name && current_function) {
-            if (strcmp(alloc->function_name, current_function) == 0) {
-              return alloc;
-            }
-          } else if (!alloc->function_name && !current_function) {
-            return alloc;
-          }
-        }
-      }
-    }
-  }
+  // A name that was never interned was never bound
+  Atom name = atom_find(var_name);
+  Atom function = atom_find(current_function);
+  if (!name || (current_function && !function))
+    return NULL;
 
-  return NULL;
+  AllocationBinding *binding = find_binding(
+      analyzer->bindings, analyzer->binding_capacity, function, name);
+  if (!binding->name)
+    return NULL;
+  return (StaticAllocation *)((char *)analyzer->allocations.data +
+                              binding->allocation * sizeof(StaticAllocation));
 }
 
 void static_memory_check_free_nonalloc(StaticMemoryAnalyzer *analyzer,
                                        const char *var_name, size_t line,
                                        size_t column,
-                                       Token *tokens, int token_count,
+                                       const LineTable *lines,
                                        const char *file_path,
                                        const char *function_name,
                                        ArenaAllocator *arena) {
@@ -105,7 +149,7 @@ void static_memory_check_free_nonalloc(StaticMemoryAnalyzer *analyzer,
     error.line = (int)line;
     error.col = (int)column;
     error.token_length = (int)strlen(var_name);
-    error.line_text = generate_line(arena, tokens, token_count, error.line);
+    error.line_text = generate_line(arena, lines, error.line);
     error.message =
         "Freeing pointer that was not allocated with alloc()";
     error.note = "Only pointers from alloc() should be freed";
@@ -154,11 +198,10 @@ void static_memory_track_free(StaticMemoryAnalyzer *analyzer,
 bool static_memory_check_use_after_free(StaticMemoryAnalyzer *analyzer,
                                         const char *var_name, size_t line,
                                         size_t column, ArenaAllocator *arena,
-                                        Token *tokens, int token_count,
+                                        const LineTable *lines,
                                         const char *file_path,
                                         const char *function_name) {
-  (void)tokens;
-  (void)token_count;
+  (void)lines;
   if (!var_name)
     return true;
 
@@ -180,7 +223,7 @@ bool static_memory_check_use_after_free(StaticMemoryAnalyzer *analyzer,
              var_name, alloc->line);
     error.message = message;
 
-    error.line_text = generate_line(arena, g_tokens, g_token_count, error.line);
+    error.line_text = generate_line(arena, g_lines, error.line);
     error.note = "Memory was freed earlier in this scope";
     error.help = "Remove the use after free or restructure your code";
 
@@ -202,24 +245,19 @@ void static_memory_track_alias(StaticMemoryAnalyzer *analyzer,
       find_allocation_by_name(analyzer, source_var, function_name);
 
   if (!source_alloc) {
-    // fprintf(stderr, "DEBUG: Source allocation not found for '%s'\n",
-    // source_var);
     return;
   }
 
-  // fprintf(stderr, "DEBUG: Found source allocation, adding alias '%s'\n",
-  // new_var);
+  // The new name joins the allocation's alias set. Sets never merge, so
+  // each name points straight at its allocation instead of at another name
+  Atom alias = intern(new_var);
+  Atom *alias_slot = (Atom *)growable_array_push(&source_alloc->aliases);
+  if (alias_slot)
+    *alias_slot = alias;
 
-  // Add new_var as an alias to the same allocation
-  char **alias_slot = (char **)growable_array_push(&source_alloc->aliases);
-  if (alias_slot) {
-    *alias_slot = arena_strdup(analyzer->arena, new_var);
-    // fprintf(stderr, "DEBUG: Successfully added alias. Total aliases: %zu\n",
-    // source_alloc->aliases.count);
-  } else {
-    // fprintf(stderr, "DEBUG: FAILED to add alias (growable_array_push
-    // failed)\n");
-  }
+  size_t position =
+      (size_t)(source_alloc - (StaticAllocation *)analyzer->allocations.data);
+  bind_name(analyzer, source_alloc->function_name, alias, position);
 }
 
 StaticMemoryAnalyzer *get_static_analyzer(Scope *scope) {
@@ -247,9 +285,20 @@ void static_memory_mark_addr_taken(StaticMemoryAnalyzer *analyzer,
 
 int static_memory_check_and_report(StaticMemoryAnalyzer *analyzer,
                                    ArenaAllocator *arena) {
+  return static_memory_check_and_report_until(
+      analyzer, analyzer->allocations.count, arena);
+}
+
+// Reports the allocations before position @p limit, so a caller can
+// interleave the reports of several analyzers in source order
+int static_memory_check_and_report_until(StaticMemoryAnalyzer *analyzer,
+                                         size_t limit, ArenaAllocator *arena) {
   int issues_found = 0;
 
-  for (size_t i = 0; i < analyzer->allocations.count; i++) {
+  if (limit > analyzer->allocations.count)
+    limit = analyzer->allocations.count;
+
+  for (size_t i = 0; i < limit; i++) {
     StaticAllocation *alloc =
         (StaticAllocation *)((char *)analyzer->allocations.data +
                              i * sizeof(StaticAllocation));
@@ -262,24 +311,6 @@ int static_memory_check_and_report(StaticMemoryAnalyzer *analyzer,
       // Double free detected: multiple unconditional frees at function scope
       // (conditional frees in branches are tracked separately to avoid
       // false positives from the early-return + cleanup pattern)
-      // need to re-read the file
-      const char *source = read_file(alloc->file_path);
-      if (!source)
-        continue;
-
-      Lexer temp_lexer;
-      init_lexer(&temp_lexer, source, arena);
-
-      GrowableArray temp_tokens;
-      growable_array_init(&temp_tokens, arena, 100, sizeof(Token));
-
-      Token tk;
-      while ((tk = next_token(&temp_lexer)).type_ != TOK_EOF) {
-        Token *slot = (Token *)growable_array_push(&temp_tokens);
-        if (slot)
-          *slot = tk;
-      }
-
       ErrorInformation error = {0};
       error.error_type = "Double Free";
       error.file_path = alloc->file_path;
@@ -294,10 +325,8 @@ int static_memory_check_and_report(StaticMemoryAnalyzer *analyzer,
                "Variable '%s' freed %d times (should only be freed once)",
                alloc->variable_name, alloc->free_count);
       error.message = message;
-      error.line_text = generate_line(arena, (Token *)temp_tokens.data,
-                                      temp_tokens.count, error.line);
+      error.line_text = generate_line(arena, alloc->lines, error.line);
 
-      free((void *)source);
       error_add(error);
       issues_found++;
 
@@ -308,24 +337,7 @@ int static_memory_check_and_report(StaticMemoryAnalyzer *analyzer,
         alloc->reported = true;
         continue;
       }
-      // Memory leak - re-read the file
-      const char *source = read_file(alloc->file_path);
-      if (!source)
-        continue;
-
-      Lexer temp_lexer;
-      init_lexer(&temp_lexer, source, arena);
-
-      GrowableArray temp_tokens;
-      growable_array_init(&temp_tokens, arena, 100, sizeof(Token));
-
-      Token tk;
-      while ((tk = next_token(&temp_lexer)).type_ != TOK_EOF) {
-        Token *slot = (Token *)growable_array_push(&temp_tokens);
-        if (slot)
-          *slot = tk;
-      }
-
+      // Memory leak
       ErrorInformation error = {0};
       error.error_type = "Memory Leak";
       error.file_path = alloc->file_path;
@@ -341,8 +353,7 @@ int static_memory_check_and_report(StaticMemoryAnalyzer *analyzer,
         char alias_list[256] = {0};
         size_t offset = 0;
         for (size_t j = 0; j < alloc->aliases.count && offset < 250; j++) {
-          char **alias =
-              (char **)((char *)alloc->aliases.data + j * sizeof(char *));
+          Atom *alias = (Atom *)((char *)alloc->aliases.data + j * sizeof(Atom));
           if (*alias) {
             offset += snprintf(alias_list + offset, 256 - offset, "%s%s",
                                j > 0 ? ", " : "", *alias);
@@ -357,10 +368,8 @@ int static_memory_check_and_report(StaticMemoryAnalyzer *analyzer,
       }
 
       error.message = message;
-      error.line_text = generate_line(arena, (Token *)temp_tokens.data,
-                                      temp_tokens.count, error.line);
+      error.line_text = generate_line(arena, alloc->lines, error.line);
 
-      free((void *)source);
       error_add(error);
       issues_found++;
     }
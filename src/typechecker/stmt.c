@@ -155,8 +155,7 @@ bool typecheck_var_decl(AstNode *node, Scope *scope, ArenaAllocator *arena) {
           func_name = func_scope->associated_node->stmt.func_decl.name;
         }
         static_memory_track_alloc(analyzer, node->line, node->column, name,
-                                  func_name, g_tokens, g_token_count,
-                                  g_file_path);
+                                  func_name, g_lines, g_file_path);
       }
     }
   } // Track pointer aliasing in variable initialization
@@ -193,8 +192,7 @@ bool typecheck_var_decl(AstNode *node, Scope *scope, ArenaAllocator *arena) {
       if (analyzer) {
         const char *func_name = get_current_function_name(scope);
         static_memory_track_alloc(analyzer, node->line, node->column, name,
-                                  func_name, g_tokens, g_token_count,
-                                  g_file_path);
+                                  func_name, g_lines, g_file_path);
       }
     }
   }
@@ -204,8 +202,9 @@ bool typecheck_var_decl(AstNode *node, Scope *scope, ArenaAllocator *arena) {
 
     if (initializer->type == AST_EXPR_STRUCT &&
         !initializer->expr.struct_expr.name && declared_type) {
-      init_type = typecheck_struct_expr_internal(initializer, scope, arena,
-                                                 declared_type);
+      init_type = record_checked_type(
+          initializer, typecheck_struct_expr_internal(initializer, scope,
+                                                      arena, declared_type));
     } else {
       init_type = typecheck_expression(initializer, scope, arena);
     }
@@ -294,6 +293,10 @@ bool typecheck_var_decl(AstNode *node, Scope *scope, ArenaAllocator *arena) {
 }
 
 bool typecheck_func_decl(AstNode *node, Scope *scope, ArenaAllocator *arena) {
+  // A generic function is checked through its instances
+  if (node->stmt.func_decl.type_param_count)
+    return true;
+
   const char *name = node->stmt.func_decl.name;
   AstNode *return_type = node->stmt.func_decl.return_type;
   AstNode **param_types = node->stmt.func_decl.param_types;
@@ -329,11 +332,15 @@ bool typecheck_func_decl(AstNode *node, Scope *scope, ArenaAllocator *arena) {
         arena, node->stmt.func_decl.param_types,
         node->stmt.func_decl.param_count, node->stmt.func_decl.return_type,
         node->line, node->column);
-    return scope_add_symbol_with_ownership(
-        scope, node->stmt.func_decl.name, func_type,
-        node->stmt.func_decl.is_public, false,
-        node->stmt.func_decl.returns_ownership,
-        node->stmt.func_decl.takes_ownership, arena);
+    if (!scope_add_symbol_with_ownership(
+            scope, node->stmt.func_decl.name, func_type,
+            node->stmt.func_decl.is_public, false,
+            node->stmt.func_decl.returns_ownership,
+            node->stmt.func_decl.takes_ownership, arena))
+      return false;
+    scope_lookup_current_only(scope, name)->attributes =
+        node->stmt.func_decl.attributes;
+    return true;
   }
 
   // Main function validation
@@ -485,6 +492,9 @@ bool typecheck_func_decl(AstNode *node, Scope *scope, ArenaAllocator *arena) {
       return false;
     }
 
+    // The definition's attributes count even when the prototype had none
+    existing->attributes |= node->stmt.func_decl.attributes;
+
   } else {
     // First declaration of this function
     if (!scope_add_symbol_with_ownership(scope, name, func_type, is_public,
@@ -494,6 +504,8 @@ bool typecheck_func_decl(AstNode *node, Scope *scope, ArenaAllocator *arena) {
                   "Failed to add function '%s' to scope", name);
       return false;
     }
+    scope_lookup_current_only(scope, name)->attributes =
+        node->stmt.func_decl.attributes;
   }
 
   // Forward declarations and #dll_import functions are both complete without
@@ -509,8 +521,35 @@ bool typecheck_func_decl(AstNode *node, Scope *scope, ArenaAllocator *arena) {
     return false;
   }
 
+  // Unchanged std module: the body was checked when its object was built
+  Scope *containing_module = find_containing_module(scope);
+  if (containing_module && containing_module->interface_only) {
+    return true;
+  }
+
+  // Top-level bodies are checked later, possibly on another thread
+  if (typecheck_defer_function_body(node, scope)) {
+    return true;
+  }
+
   // Create function scope for parameters and body
   Scope *func_scope = create_child_scope(scope, name, arena);
+  return typecheck_func_body(node, func_scope, arena);
+}
+
+/**
+ * @brief Typechecks the parameters and body of a function whose signature
+ * is already registered, in @p func_scope (a fresh child of its declaring
+ * scope).
+ */
+bool typecheck_func_body(AstNode *node, Scope *func_scope,
+                         ArenaAllocator *arena) {
+  const char *name = node->stmt.func_decl.name;
+  AstNode **param_types = node->stmt.func_decl.param_types;
+  char **param_names = node->stmt.func_decl.param_names;
+  size_t param_count = node->stmt.func_decl.param_count;
+  AstNode *body = node->stmt.func_decl.body;
+
   func_scope->is_function_scope = true;
   func_scope->associated_node = node;
 
@@ -668,6 +707,10 @@ bool typecheck_struct_decl(AstNode *node, Scope *scope, ArenaAllocator *arena) {
     return false;
   }
 
+  // A generic struct is checked through its instances
+  if (node->stmt.struct_decl.type_param_count)
+    return true;
+
   const char *struct_name = node->stmt.struct_decl.name;
   AstNode **public_members = node->stmt.struct_decl.public_members;
   size_t public_count = node->stmt.struct_decl.public_count;
@@ -1009,9 +1052,9 @@ bool typecheck_struct_decl(AstNode *node, Scope *scope, ArenaAllocator *arena) {
       } \
     } \
     \
-    /* Typecheck the method body */ \
+    /* Typecheck the method body (not for prebuilt std modules) */ \
     AstNode *m_body = m_fn->stmt.func_decl.body; \
-    if (m_body) { \
+    if (m_body && !skip_method_bodies) { \
       if (!typecheck_statement(m_body, m_scope, arena)) { \
         tc_error(node, "Struct Method Error", \
                  "Method '%s' in struct '%s' failed type checking", \
@@ -1056,6 +1099,8 @@ bool typecheck_struct_decl(AstNode *node, Scope *scope, ArenaAllocator *arena) {
                "Failed to register method '%s' in scope", m_name); \
       return false; \
     } \
+    scope_lookup_current_only(scope, m_qname)->attributes = \
+        m_fn->stmt.func_decl.attributes; \
     \
     /* For non-static methods, add to struct type's member list */ \
     /* (static methods are only accessible via :: and not via dot) */ \
@@ -1067,6 +1112,9 @@ bool typecheck_struct_decl(AstNode *node, Scope *scope, ArenaAllocator *arena) {
     } \
   } while(0)
 
+  Scope *struct_module = find_containing_module(scope);
+  bool skip_method_bodies = struct_module && struct_module->interface_only;
+
   // SECOND PASS: Process methods
   for (size_t i = 0; i < public_count; i++) {
     AstNode *member = public_members[i];
@@ -1124,6 +1172,181 @@ bool typecheck_enum_decl(AstNode *node, Scope *scope, ArenaAllocator *arena) {
   return true;
 }
 
+// LLVM only keeps a tail call when both prototypes lower alike
+static bool same_lowered_type(AstNode *a, AstNode *b, ArenaAllocator *arena) {
+  if (types_match(a, b) == TYPE_MATCH_EXACT)
+    return true;
+  return strcmp(type_to_string(a, arena), type_to_string(b, arena)) == 0;
+}
+
+// Whether a defer is in effect at @p target inside @p node: -1 when
+// @p target isn't under @p node
+static int defer_reaches(AstNode *node, AstNode *target) {
+  if (!node)
+    return -1;
+  if (node == target)
+    return 0;
+
+  switch (node->type) {
+  case AST_STMT_BLOCK: {
+    bool deferred = false;
+    for (size_t i = 0; i < node->stmt.block.stmt_count; i++) {
+      AstNode *stmt = node->stmt.block.statements[i];
+      int found = defer_reaches(stmt, target);
+      if (found >= 0)
+        return deferred ? 1 : found;
+      if (stmt && stmt->type == AST_STMT_DEFER)
+        deferred = true;
+    }
+    return -1;
+  }
+  case AST_STMT_IF: {
+    int found = defer_reaches(node->stmt.if_stmt.then_stmt, target);
+    for (int i = 0; found < 0 && node->stmt.if_stmt.elif_stmts &&
+                    i < node->stmt.if_stmt.elif_count;
+         i++)
+      found = defer_reaches(node->stmt.if_stmt.elif_stmts[i], target);
+    return found >= 0 ? found
+                      : defer_reaches(node->stmt.if_stmt.else_stmt, target);
+  }
+  case AST_STMT_LOOP:
+    return defer_reaches(node->stmt.loop_stmt.body, target);
+  case AST_STMT_SWITCH: {
+    for (size_t i = 0; i < node->stmt.switch_stmt.case_count; i++) {
+      int found = defer_reaches(node->stmt.switch_stmt.cases[i], target);
+      if (found >= 0)
+        return found;
+    }
+    return defer_reaches(node->stmt.switch_stmt.default_case, target);
+  }
+  case AST_STMT_CASE:
+    return defer_reaches(node->stmt.case_clause.body, target);
+  case AST_STMT_DEFAULT:
+    return defer_reaches(node->stmt.default_clause.body, target);
+  default:
+    return -1;
+  }
+}
+
+// The symbol a #musttail return calls, or NULL after reporting why it can't
+static Symbol *musttail_callee(AstNode *node, AstNode *call, Scope *scope,
+                               ArenaAllocator *arena) {
+  AstNode *callee = call->expr.call.callee;
+  Symbol *symbol = NULL;
+
+  if (callee->type == AST_EXPR_IDENTIFIER) {
+    symbol = scope_lookup(scope, callee->expr.identifier.name);
+  } else if (callee->type == AST_EXPR_MEMBER &&
+             callee->expr.member.is_compiletime &&
+             callee->expr.member.object->type == AST_EXPR_IDENTIFIER) {
+    const char *base = callee->expr.member.object->expr.identifier.name;
+    const char *member = callee->expr.member.member;
+    symbol = lookup_qualified_symbol(scope, base, member);
+    if (!symbol) {
+      size_t len = strlen(base) + strlen("::") + strlen(member) + 1;
+      char *static_name = arena_alloc(arena, len, 1);
+      snprintf(static_name, len, "%s::%s", base, member);
+      symbol = scope_lookup(scope, static_name);
+    }
+  } else {
+    tc_error_help(node, "Tail Call Error",
+                  "Methods take self as a hidden first argument; call a "
+                  "function or a static method instead",
+                  "#musttail can't call a method");
+    return NULL;
+  }
+
+  if (!symbol || !symbol->type || symbol->type->type != AST_TYPE_FUNCTION) {
+    tc_error(node, "Tail Call Error", "#musttail needs a function to call");
+    return NULL;
+  }
+  return symbol;
+}
+
+// A #musttail return reuses the caller's frame for the call it returns, so
+// the two prototypes have to agree and nothing may point into the frame
+static bool typecheck_musttail(AstNode *node, Scope *scope, Scope *func_scope,
+                               ArenaAllocator *arena) {
+  AstNode *call = node->stmt.return_stmt.value;
+  if (!call || call->type != AST_EXPR_CALL) {
+    tc_error_help(node, "Tail Call Error",
+                  "Write #musttail return f(args);",
+                  "#musttail needs a call to return");
+    return false;
+  }
+  if (!func_scope || !func_scope->associated_node ||
+      func_scope->associated_node->type != AST_STMT_FUNCTION) {
+    tc_error(node, "Tail Call Error", "#musttail needs an enclosing function");
+    return false;
+  }
+
+  AstNode *caller = func_scope->associated_node;
+  if (scope_lookup_current_only(func_scope, "self")) {
+    tc_error_help(node, "Tail Call Error",
+                  "Methods take self as a hidden first argument; move the "
+                  "loop into a function",
+                  "#musttail can't be used in a method");
+    return false;
+  }
+
+  if (defer_reaches(caller->stmt.func_decl.body, node) > 0) {
+    tc_error_help(node, "Tail Call Error",
+                  "Deferred statements would have to run after the call",
+                  "#musttail can't return from under a defer");
+    return false;
+  }
+
+  Symbol *callee = musttail_callee(node, call, scope, arena);
+  if (!callee)
+    return false;
+
+  AstNode *callee_type = callee->type;
+  size_t param_count = caller->stmt.func_decl.param_count;
+  bool matches =
+      callee_type->type_data.function.param_count == param_count &&
+      same_lowered_type(callee_type->type_data.function.return_type,
+                        caller->stmt.func_decl.return_type, arena);
+  for (size_t i = 0; matches && i < param_count; i++) {
+    matches = same_lowered_type(callee_type->type_data.function.param_types[i],
+                                caller->stmt.func_decl.param_types[i], arena);
+  }
+  if (!matches) {
+    AstNode *caller_type = create_function_type(
+        arena, caller->stmt.func_decl.param_types, param_count,
+        caller->stmt.func_decl.return_type, caller->line, caller->column);
+    tc_error_help(node, "Tail Call Error",
+                  "A guaranteed tail call needs the callee to take and "
+                  "return exactly what the caller does",
+                  "'%s' has type '%s', but '%s' is '%s'", callee->name,
+                  type_to_string(callee_type, arena),
+                  caller->stmt.func_decl.name,
+                  type_to_string(caller_type, arena));
+    return false;
+  }
+
+  // The frame is gone by the time the callee runs
+  for (size_t i = 0; i < call->expr.call.arg_count; i++) {
+    AstNode *arg = call->expr.call.args[i];
+    if (!arg || arg->type != AST_EXPR_ADDR ||
+        arg->expr.addr.object->type != AST_EXPR_IDENTIFIER)
+      continue;
+    const char *name = arg->expr.addr.object->expr.identifier.name;
+    for (Scope *s = scope; s; s = s->parent) {
+      if (scope_lookup_current_only(s, name)) {
+        tc_error_help(arg, "Tail Call Error",
+                      "The caller's frame is reused by the call; pass a "
+                      "pointer to memory that outlives it",
+                      "#musttail can't pass the address of local '%s'",
+                      name);
+        return false;
+      }
+      if (s == func_scope)
+        break;
+    }
+  }
+  return true;
+}
+
 bool typecheck_return_decl(AstNode *node, Scope *scope, ArenaAllocator *arena) {
   // Find the enclosing function's return type
   AstNode *expected_return_type = get_enclosing_function_return_type(scope);
@@ -1139,6 +1362,16 @@ bool typecheck_return_decl(AstNode *node, Scope *scope, ArenaAllocator *arena) {
       (expected_return_type->type == AST_TYPE_BASIC &&
        strcmp(expected_return_type->type_data.basic.name, "void") == 0);
 
+  // A void function can still tail call another void function
+  if (expects_void && return_value && node->stmt.return_stmt.musttail) {
+    if (!typecheck_expression(return_value, scope, arena))
+      return false;
+    Scope *func_scope = scope;
+    while (func_scope && !func_scope->is_function_scope)
+      func_scope = func_scope->parent;
+    return typecheck_musttail(node, scope, func_scope, arena);
+  }
+
   if (expects_void && return_value != NULL) {
     tc_error(node, "Return Error", "Void function cannot return a value");
     return false;
@@ -1173,6 +1406,10 @@ bool typecheck_return_decl(AstNode *node, Scope *scope, ArenaAllocator *arena) {
       func_scope = func_scope->parent;
     }
 
+    if (node->stmt.return_stmt.musttail &&
+        !typecheck_musttail(node, scope, func_scope, arena))
+      return false;
+
     if (func_scope && func_scope->associated_node) {
       bool returns_ownership =
           func_scope->associated_node->stmt.func_decl.returns_ownership;
@@ -1581,10 +1818,13 @@ void find_enum_members(Scope *scope, const char *enum_name,
   // Recursively search up the scope chain
   Scope *current = scope;
   while (current) {
+    // Not a lookup by name, so a body doing this can't be reused
+    if (!scope_is_local(current))
+      body_dependencies_opaque();
+
     // Check all symbols in current scope
     for (size_t i = 0; i < current->symbols.count; i++) {
-      Symbol *symbol =
-          (Symbol *)((char *)current->symbols.data + i * sizeof(Symbol));
+      Symbol *symbol = scope_symbol(current, i);
 
       // Look for symbols that match the pattern "EnumName.MemberName"
       if (strncmp(symbol->name, enum_name, enum_name_len) == 0 &&
@@ -13,6 +13,7 @@
 #include <string.h>
 
 #include "src/ast/ast.h"
+#include "src/ast/type_table.h"
 #include "type.h"
 
 TypeMatchResult types_match(AstNode *type1, AstNode *type2) {
@@ -30,6 +31,12 @@ TypeMatchResult types_match(AstNode *type1, AstNode *type2) {
     return TYPE_MATCH_NONE;
   }
 
+  // Same canonical type - same spelling, so an exact match. Different
+  // canonical types can still be compatible, so those fall through.
+  CanonicalType *canonical1 = type_canonical(type1);
+  if (canonical1 && canonical1 == type_canonical(type2))
+    return TYPE_MATCH_EXACT;
+
   if (type1->type == AST_TYPE_STRUCT && type2->type == AST_TYPE_STRUCT) {
     // Structs match if they have the same name
     // (assuming nominal typing - structs with same structure but different
@@ -183,6 +190,19 @@ TypeMatchResult types_match(AstNode *type1, AstNode *type2) {
                        type2->type_data.array.element_type);
   }
 
+  // Vectors only match vectors of the same element type and lane count;
+  // converting lanes takes a cast
+  if (type1->type == AST_TYPE_VECTOR && type2->type == AST_TYPE_VECTOR) {
+    if (type1->type_data.vector.lane_count !=
+        type2->type_data.vector.lane_count)
+      return TYPE_MATCH_NONE;
+    return types_match(type1->type_data.vector.element_type,
+                       type2->type_data.vector.element_type) ==
+                   TYPE_MATCH_EXACT
+               ? TYPE_MATCH_EXACT
+               : TYPE_MATCH_NONE;
+  }
+
   if (type1->type == AST_TYPE_FUNCTION && type2->type == AST_TYPE_FUNCTION) {
     if (type1->type_data.function.param_count !=
         type2->type_data.function.param_count) {
@@ -260,6 +280,11 @@ bool is_array_type(AstNode *type) {
          type->type == AST_TYPE_ARRAY;
 }
 
+bool is_vector_type(AstNode *type) {
+  return type && type->category == Node_Category_TYPE &&
+         type->type == AST_TYPE_VECTOR;
+}
+
 bool is_void_type(AstNode *type) {
   return type && type->category == Node_Category_TYPE &&
          type->type == AST_TYPE_BASIC &&
@@ -291,6 +316,9 @@ bool is_cast_valid(AstNode *from_type, AstNode *to_type) {
   if (match != TYPE_MATCH_NONE)
     return true;
 
+  if (is_vector_type(from_type) || is_vector_type(to_type))
+    return is_vector_cast_valid(from_type, to_type);
+
   // Gather type properties
   bool from_num = is_numeric_type(from_type) || is_bool_type(from_type);
   bool to_num = is_numeric_type(to_type) || is_bool_type(to_type);
@@ -351,6 +379,9 @@ bool is_pointer_to_function_type(AstNode *type) {
          type->type_data.pointer.pointee_type->type == AST_TYPE_FUNCTION;
 }
 
+static const char *type_to_string_uncached(AstNode *type,
+                                           ArenaAllocator *arena);
+
 const char *type_to_string(AstNode *type, ArenaAllocator *arena) {
   // Handle null or invalid type nodes
   if (!type) {
@@ -361,6 +392,25 @@ const char *type_to_string(AstNode *type, ArenaAllocator *arena) {
     return arena_strdup(arena, "<invalid_type>");
   }
 
+  // A canonical type is spelled once; the spelling is an atom, so callers
+  // get the same text back on every call
+  CanonicalType *canonical = type_canonical(type);
+  if (canonical) {
+    const char *spelling = canonical_type_spelling(canonical);
+    if (!spelling) {
+      spelling = intern(type_to_string_uncached(type, arena));
+      if (!spelling)
+        return "<unknown_type>";
+      canonical_type_set_spelling(canonical, spelling);
+    }
+    return spelling;
+  }
+
+  return type_to_string_uncached(type, arena);
+}
+
+static const char *type_to_string_uncached(AstNode *type,
+                                           ArenaAllocator *arena) {
   switch (type->type) {
   case AST_TYPE_BASIC: {
     const char *name = type->type_data.basic.name;
@@ -405,6 +455,17 @@ const char *type_to_string(AstNode *type, ArenaAllocator *arena) {
     return result;
   }
 
+  case AST_TYPE_VECTOR: {
+    AstNode *element = type->type_data.vector.element_type;
+    const char *element_str =
+        element ? type_to_string(element, arena) : "<null>";
+    size_t len = strlen(element_str) + 32;
+    char *result = arena_alloc(arena, len, 1);
+    snprintf(result, len, "vec<%s, %zu>", element_str,
+             type->type_data.vector.lane_count);
+    return result;
+  }
+
   case AST_TYPE_FUNCTION: {
     AstNode *return_type = type->type_data.function.return_type;
     AstNode **param_types = type->type_data.function.param_types;
@@ -458,11 +519,8 @@ AstNode *get_enclosing_function_return_type(Scope *scope) {
 AstNode *create_struct_type(ArenaAllocator *arena, const char *name,
                             AstNode **member_types, const char **member_names,
                             size_t member_count, size_t line, size_t column) {
-  AstNode *struct_type = arena_alloc(arena, sizeof(AstNode), alignof(AstNode));
-  struct_type->type = AST_TYPE_STRUCT;
-  struct_type->category = Node_Category_TYPE;
-  struct_type->line = line;
-  struct_type->column = column;
+  AstNode *struct_type =
+      create_type_node(arena, AST_TYPE_STRUCT, line, column);
 
   struct_type->type_data.struct_type.name = arena_strdup(arena, name);
   struct_type->type_data.struct_type.member_count = member_count;
@@ -585,7 +643,7 @@ void debug_print_scope(Scope *scope, int indent_level) {
   // Print all symbols in the current scope
   for (size_t i = 0; i < scope->symbols.count; i++) {
     // Calculate symbol pointer using array base + offset
-    Symbol *s = (Symbol *)((char *)scope->symbols.data + i * sizeof(Symbol));
+    Symbol *s = scope_symbol(scope, i);
 
     // Indent for symbol display
     for (int j = 0; j < indent_level + 1; j++)
@@ -15,18 +15,19 @@
 #pragma once
 
 #include "../ast/ast.h"
+#include "../c_libs/error/error.h"
 #include "../c_libs/memory/memory.h"
 #include "../helper/help.h"
+#include "../c_libs/intern/intern.h"
 #include "../lexer/lexer.h"
 
 // ============================================================================
 // Data Structures
 // ============================================================================
 
-extern Token *g_tokens;
-extern int g_token_count;
-extern const char *g_file_path;
-extern ArenaAllocator *g_arena;
+extern _Thread_local const LineTable *g_lines;
+extern _Thread_local const char *g_file_path;
+extern _Thread_local ArenaAllocator *g_arena;
 
 typedef struct {
   size_t line;
@@ -35,15 +36,31 @@ typedef struct {
   bool has_matching_free;
   int free_count;
   int conditional_free_count;
-  GrowableArray aliases;
+  GrowableArray aliases; // Atoms, for the report; lookups use the bindings
   bool reported;
   bool address_taken;
-  const char *function_name;
+  Atom function_name;
   const char *file_path;
+  const LineTable *lines; // Of file_path, for the report's line text
 } StaticAllocation;
 
+/**
+ * @brief What a variable of a function refers to: the newest allocation
+ * made under its name or that it was made an alias of.
+ */
+typedef struct {
+  Atom function; // NULL outside any function
+  Atom name;     // NULL for an empty slot
+  size_t allocation;
+} AllocationBinding;
+
 typedef struct {
-  GrowableArray allocations;
+  GrowableArray allocations; // In tracking order, which is report order
+  // Open-addressing map from (function, variable) to its binding, kept at
+  // most half full
+  AllocationBinding *bindings;
+  size_t binding_capacity; // Power of two, or 0 before the first allocation
+  size_t binding_count;
   ArenaAllocator *arena;
   bool skip_memory_tracking;
 } StaticMemoryAnalyzer;
@@ -52,21 +69,39 @@ typedef struct {
  * @brief Represents a symbol with associated type and metadata.
  */
 typedef struct {
-  const char *name;   /**< Symbol name */
+  Atom name;          /**< Symbol name */
   AstNode *type;      /**< AST type node */
   bool is_public;     /**< Public accessibility flag */
   bool is_mutable;    /**< Mutability flag */
   size_t scope_depth; /**< Nesting level for debugging */
   bool returns_ownership;
   bool takes_ownership;
+  unsigned attributes; /**< FN_ATTR_* flags of a function */
 } Symbol;
 
+/**
+ * @brief A resolved name in a scope's import cache. @c alias is NULL for
+ * names found through an unqualified lookup.
+ */
+typedef struct {
+  Atom alias;
+  Atom name;
+  Symbol *symbol;
+} ImportCacheEntry;
+
 /**
  * @brief Represents a lexical scope with hierarchical relationships.
  */
 typedef struct Scope {
   struct Scope *parent;
-  GrowableArray symbols;
+  // In declaration order, for completions and dumps. Chunked, so a Symbol
+  // pointer stays valid while more symbols are declared
+  ChunkedArray symbols;
+  // Open-addressing index over symbols by name atom, built once the scope
+  // outgrows a linear scan. Slots hold a position in symbols plus one; 0 is
+  // empty.
+  uint32_t *symbol_index;
+  size_t index_capacity; // Power of two, or 0 without an index
   GrowableArray children;
   const char *scope_name;
   size_t depth;
@@ -77,6 +112,14 @@ typedef struct Scope {
   bool is_module_scope;
   const char *module_name;
   GrowableArray imported_modules;
+  // Nearest module scope at or above this one, NULL outside any module
+  struct Scope *module_scope;
+  // Public symbols already resolved through imported_modules, so repeated
+  // references skip the import scan. Open addressing, at most half full.
+  ImportCacheEntry *import_cache;
+  size_t import_cache_capacity; // Power of two, or 0 before the first entry
+  size_t import_cache_count;
+  size_t import_cache_generation;
 
   bool returns_ownership;
   bool takes_ownership;
@@ -87,6 +130,10 @@ typedef struct Scope {
 
   GrowableArray link_libs;
 
+  // Module scope of a prebuilt std module: declarations are registered but
+  // function bodies are not checked again
+  bool interface_only;
+
   // Build configuration
   BuildConfig *config;
 } Scope;
@@ -95,17 +142,11 @@ typedef struct Scope {
  * @brief Represents an imported module with optional aliasing.
  */
 typedef struct {
-  const char *module_name; /**< Original module name */
-  const char *alias;       /**< Alias in importing module */
+  Atom module_name; /**< Original module name */
+  Atom alias;       /**< Alias in importing module */
   Scope *module_scope;
 } ModuleImport;
 
-typedef struct {
-  const char *module_name;
-  GrowableArray dependencies; // Array of const char* (module names)
-  bool processed;
-} ModuleDependency;
-
 /**
  * @brief Result of type compatibility checking.
  */
@@ -133,17 +174,19 @@ void static_memory_analyzer_init(StaticMemoryAnalyzer *analyzer,
                                  ArenaAllocator *arena);
 void static_memory_track_alloc(StaticMemoryAnalyzer *analyzer, size_t line,
                                size_t column, const char *var_name,
-                               const char *function_name, Token *tokens,
-                               size_t token_count, const char *file_path);
+                               const char *function_name,
+                               const LineTable *lines, const char *file_path);
 void static_memory_track_free(StaticMemoryAnalyzer *analyzer,
                               const char *var_name, const char *function_name,
                               bool is_conditional);
 int static_memory_check_and_report(StaticMemoryAnalyzer *analyzer,
                                    ArenaAllocator *arena);
+int static_memory_check_and_report_until(StaticMemoryAnalyzer *analyzer,
+                                         size_t limit, ArenaAllocator *arena);
 bool static_memory_check_use_after_free(StaticMemoryAnalyzer *analyzer,
                                         const char *var_name, size_t line,
                                         size_t column, ArenaAllocator *arena,
-                                        Token *tokens, int token_count,
+                                        const LineTable *lines,
                                         const char *file_path,
                                         const char *function_name);
 
@@ -158,7 +201,7 @@ void static_memory_mark_addr_taken(StaticMemoryAnalyzer *analyzer,
 void static_memory_check_free_nonalloc(StaticMemoryAnalyzer *analyzer,
                                        const char *var_name, size_t line,
                                        size_t column,
-                                       Token *tokens, int token_count,
+                                       const LineTable *lines,
                                        const char *file_path,
                                        const char *function_name,
                                        ArenaAllocator *arena);
@@ -185,20 +228,160 @@ Symbol *
 scope_lookup_current_only_with_visibility(Scope *scope, const char *name,
                                           Scope *requesting_module_scope);
 Scope *find_containing_module(Scope *scope);
+void scope_limit_visible(const Scope *scope, size_t count);
+Symbol *scope_import_cache_get(Scope *scope, Atom alias, Atom name);
+void scope_import_cache_put(Scope *scope, Atom alias, Atom name,
+                            Symbol *symbol);
 
 Scope *create_child_scope(Scope *parent, const char *name,
                           ArenaAllocator *arena);
+
+// The @p position-th symbol declared in @p scope
+static inline Symbol *scope_symbol(const Scope *scope, size_t position) {
+  return (Symbol *)chunked_array_get(&scope->symbols, position);
+}
 void debug_print_scope(Scope *scope, int indent_level);
 void debug_print_struct_type(AstNode *struct_type, int indent);
-void build_dependency_graph(AstNode **modules, size_t module_count,
-                            GrowableArray *dep_graph, ArenaAllocator *arena);
-bool process_module_in_order(const char *module_name, GrowableArray *dep_graph,
-                             AstNode **modules, size_t module_count,
-                             Scope *global_scope, ArenaAllocator *arena);
+bool typecheck_module(AstNode *module, Scope *global_scope,
+                      ArenaAllocator *arena);
 bool typecheck_program_multipass(AstNode *program, Scope *global_scope,
                                  ArenaAllocator *arena);
 const char *get_current_function_name(Scope *scope);
 
+// ============================================================================
+// Function Bodies
+// ============================================================================
+
+// While a queue is active on a thread, module-level function bodies are
+// queued instead of checked, then checked in parallel by the queue's finish
+typedef struct FunctionBodyQueue FunctionBodyQueue;
+
+FunctionBodyQueue *function_body_queue_begin(ArenaAllocator *arena,
+                                             struct BodyCache *cache);
+bool function_body_queue_finish(FunctionBodyQueue *queue, bool serial_ok);
+bool typecheck_defer_function_body(AstNode *node, Scope *scope);
+void typecheck_finish_module(AstNode *module, Scope *module_scope,
+                             Scope *global_scope, bool checked_cleanly,
+                             ArenaAllocator *arena);
+
+// ============================================================================
+// Incremental Function Bodies
+// ============================================================================
+
+// Results of module-level function bodies kept across typechecks of the
+// same program (see BuildConfig.body_cache): a body whose tokens and
+// resolved names are unchanged replays its diagnostics instead of being
+// checked again
+typedef struct BodyCache BodyCache;
+typedef struct BodyCacheEntry BodyCacheEntry;
+
+typedef enum {
+  BODY_DEP_UNQUALIFIED,   // A name looked up from inside the body
+  BODY_DEP_QUALIFIED,     // alias::name
+  BODY_DEP_IN_SCOPE,      // A name looked up from a module or global scope
+  BODY_DEP_IN_SCOPE_ONLY, // The same, without searching parents or imports
+} BodyDependencyKind;
+
+typedef struct {
+  BodyDependencyKind kind;
+  Atom target;    // The alias, or the scope's module name (NULL: global)
+  Atom name;
+  bool from_body; // Looked up on behalf of the body's module
+  uint64_t signature; // Of the symbol found, 0 for none
+} BodyDependency;
+
+// A reused body: its function scope doesn't exist until it is checked again
+// (typecheck_pending_bodies), which the language server does on demand
+typedef struct {
+  AstNode *node;
+  Scope *module_scope;
+  size_t child_slot;
+  size_t visible_symbols;
+  const LineTable *lines;
+  const char *file_path;
+} PendingBody;
+
+typedef struct {
+  PendingBody *bodies;
+  size_t count;
+} PendingBodies;
+
+BodyCache *body_cache_create(void);
+void body_cache_destroy(BodyCache *cache);
+
+const BodyCacheEntry *body_cache_lookup(BodyCache *cache, AstNode *node,
+                                        Scope *module_scope, bool check_mem,
+                                        ArenaAllocator *arena);
+bool body_cache_replay(const BodyCacheEntry *entry, ErrorBuffer *memory_report,
+                       ArenaAllocator *arena);
+void body_cache_store(BodyCache *cache, AstNode *node, Scope *module_scope,
+                      bool check_mem, const GrowableArray *dependencies,
+                      const ErrorBuffer *errors,
+                      const ErrorBuffer *memory_report, bool ok);
+
+void body_cache_begin_check(BodyCache *cache);
+void body_cache_add_pending(BodyCache *cache, const PendingBody *body);
+PendingBodies *body_cache_take_pending(BodyCache *cache,
+                                       ArenaAllocator *arena);
+void typecheck_pending_bodies(PendingBodies *pending, ArenaAllocator *arena);
+
+// Recording what a body resolves; lookups note themselves while a recorder
+// is active on the calling thread
+void body_dependencies_begin(GrowableArray *dependencies, Scope *module_scope,
+                             ArenaAllocator *arena);
+bool body_dependencies_end(void); // False if the record can't be trusted
+void body_dependencies_pause(void);
+void body_dependencies_resume(void);
+void body_dependencies_opaque(void);
+void body_dependency_note(BodyDependencyKind kind, const Scope *scope,
+                          const char *alias, const char *name,
+                          const Scope *requesting_module_scope,
+                          Symbol *symbol);
+bool scope_is_local(const Scope *scope);
+uint64_t module_interface_signature(AstNode *module, Scope *module_scope,
+                                    ArenaAllocator *arena);
+
+// ============================================================================
+// Precompiled Std Interfaces
+// ============================================================================
+
+// A std file to parse from its cached interface instead of its source
+typedef struct {
+  const char *interface_path; // NULL to parse the source
+  const char *source_path;
+  uint64_t token_digest; // Of the source, as the interface recorded them
+  uint64_t token_position_digest;
+} StdInterfaceChoice;
+
+// Picks, before parsing, the std files (absolute paths, NULL for the rest)
+// whose source, @use's and cached object are unchanged since their
+// interface was written; leaves the other choices untouched
+void choose_std_interfaces(const char *const *paths, size_t count,
+                           const BuildConfig *config,
+                           StdInterfaceChoice *choices, ArenaAllocator *arena);
+// Makes a module parsed from an interface stand for its source
+void adopt_std_interface(AstNode *module, const StdInterfaceChoice *choice);
+
+// Marks std modules whose cached interface and object are current for this
+// build (module.prebuilt_object); runs before typechecking. Fails when a
+// module parsed from its interface turns out not to be current.
+bool resolve_prebuilt_std_modules(AstNode *program, BuildConfig *config,
+                                  ArenaAllocator *arena);
+bool write_module_interface(AstNode *module);
+
+// ============================================================================
+// Generics
+// ============================================================================
+
+// Replaces every use of a generic function or struct with an instance made
+// for its type arguments (see generics.c); runs before typechecking
+bool instantiate_generics(AstNode *program, ArenaAllocator *arena);
+// The same for one module of the program, whose other modules were
+// instantiated already and only provide templates
+bool instantiate_module_generics(AstNode *program, AstNode *module,
+                                 ArenaAllocator *arena);
+bool module_declares_templates(const AstNode *module);
+
 // ============================================================================
 // Module Management
 // ============================================================================
@@ -206,6 +389,8 @@ const char *get_current_function_name(Scope *scope);
 bool register_module(Scope *global_scope, const char *module_name,
                      Scope *module_scope, ArenaAllocator *arena);
 Scope *find_module_scope(Scope *global_scope, const char *module_name);
+bool share_module_scope(Scope *global_scope, Scope *module_scope,
+                        ArenaAllocator *arena);
 bool add_module_import(Scope *importing_scope, const char *module_name,
                        const char *alias, Scope *module_scope,
                        ArenaAllocator *arena);
@@ -223,7 +408,7 @@ bool typecheck_use_stmt(AstNode *node, Scope *current_scope,
 // Error Management
 // ============================================================================
 
-void tc_error_init(Token *tokens, int token_count, const char *file_path,
+void tc_error_init(const LineTable *lines, const char *file_path,
                    ArenaAllocator *arena);
 void tc_error(AstNode *node, const char *error_type, const char *format, ...);
 void tc_error_help(AstNode *node, const char *error_type, const char *help,
@@ -241,6 +426,7 @@ bool is_integer_type(AstNode *type);
 bool is_pointer_type(AstNode *type);
 bool is_pointer_to_function_type(AstNode *type);
 bool is_array_type(AstNode *type);
+bool is_vector_type(AstNode *type);
 bool is_void_type(AstNode *type);
 bool is_bool_type(AstNode *type);
 bool is_struct_type_node(AstNode *type);
@@ -259,12 +445,16 @@ bool typecheck(AstNode *node, Scope *scope, ArenaAllocator *arena,
                BuildConfig *config);
 AstNode *typecheck_expression(AstNode *expr, Scope *scope,
                               ArenaAllocator *arena);
+// Stores @p type on @p expr for codegen (see expr.checked_type); returns it
+AstNode *record_checked_type(AstNode *expr, AstNode *type);
 bool typecheck_statement(AstNode *stmt, Scope *scope, ArenaAllocator *arena);
 const char *extract_variable_name(AstNode *expr);
 
 // Declarations
 bool typecheck_var_decl(AstNode *node, Scope *scope, ArenaAllocator *arena);
 bool typecheck_func_decl(AstNode *node, Scope *scope, ArenaAllocator *arena);
+bool typecheck_func_body(AstNode *node, Scope *func_scope,
+                         ArenaAllocator *arena);
 
 AstNode *create_struct_type(ArenaAllocator *arena, const char *name,
                             AstNode **member_types, const char **member_names,
@@ -320,6 +510,8 @@ AstNode *typecheck_free_expr(AstNode *expr, Scope *scope,
                              ArenaAllocator *arena);
 AstNode *typecheck_memcpy_expr(AstNode *expr, Scope *scope,
                                ArenaAllocator *arena);
+AstNode *typecheck_builtin_expr(AstNode *expr, Scope *scope,
+                                ArenaAllocator *arena);
 AstNode *typecheck_cast_expr(AstNode *expr, Scope *scope,
                              ArenaAllocator *arena);
 AstNode *typecheck_input_expr(AstNode *expr, Scope *scope,
@@ -330,6 +522,11 @@ AstNode *typecheck_sizeof_expr(AstNode *expr, Scope *scope,
                                ArenaAllocator *arena);
 AstNode *typecheck_assignment_expr(AstNode *expr, Scope *scope,
                                    ArenaAllocator *arena);
+bool check_pure_write(AstNode *expr, AstNode *target, Scope *scope);
+bool check_const_read(AstNode *expr, Symbol *symbol, Scope *scope);
+bool check_const_deref(AstNode *expr, AstNode *pointer, Scope *scope);
+bool check_pure_call(AstNode *expr, Symbol *callee, const char *callee_name,
+                     Scope *scope);
 AstNode *typecheck_array_expr(AstNode *expr, Scope *scope,
                               ArenaAllocator *arena);
 AstNode *typecheck_syscall_expr(AstNode *expr, Scope *scope,
@@ -354,6 +551,15 @@ TypeMatchResult check_array_compatibility(AstNode *type1, AstNode *type2);
 bool validate_array_initializer(AstNode *declared_type, AstNode *initializer,
                                 Scope *scope, ArenaAllocator *arena);
 
+// SIMD vectors (vector.c)
+bool is_vector_cast_valid(AstNode *from_type, AstNode *to_type);
+AstNode *typecheck_vector_binary(AstNode *expr, AstNode *left_type,
+                                 AstNode *right_type, ArenaAllocator *arena);
+AstNode *typecheck_vector_swizzle(AstNode *expr, AstNode *vector_type,
+                                  ArenaAllocator *arena);
+AstNode *typecheck_vector_method(AstNode *expr, AstNode *vector_type,
+                                 ArenaAllocator *arena);
+
 // ============================================================================
 // Error Handling
 // ============================================================================
@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "type.h"
+
+// vec<T, N> holds N lanes of a scalar T. Operators work lane by lane, and a
+// scalar operand is splatted across every lane first, so v * 2.0 scales each
+// lane. Comparisons give a vec<bool, N> of the per-lane results.
+
+static const char swizzle_letters[] = "xyzw";
+
+static AstNode *vector_element(AstNode *vector_type) {
+  return vector_type->type_data.vector.element_type;
+}
+
+static bool is_scalar_operand(AstNode *type) {
+  return is_numeric_type(type) || is_bool_type(type);
+}
+
+bool is_vector_cast_valid(AstNode *from_type, AstNode *to_type) {
+  if (is_vector_type(to_type)) {
+    AstNode *element = vector_element(to_type);
+    size_t lanes = to_type->type_data.vector.lane_count;
+
+    // Splat a scalar across every lane
+    if (is_scalar_operand(from_type))
+      return true;
+
+    // Convert every lane
+    if (is_vector_type(from_type))
+      return from_type->type_data.vector.lane_count == lanes;
+
+    // Gather the elements of an array of the same length
+    if (is_array_type(from_type)) {
+      AstNode *size = from_type->type_data.array.size;
+      return size && size->type == AST_EXPR_LITERAL &&
+             size->expr.literal.lit_type == LITERAL_INT &&
+             (size_t)size->expr.literal.value.int_val == lanes &&
+             is_scalar_operand(from_type->type_data.array.element_type);
+    }
+
+    // Load the lanes from where a pointer to the element type points
+    if (is_pointer_type(from_type)) {
+      AstNode *pointee = from_type->type_data.pointer.pointee_type;
+      return is_void_type(pointee) ||
+             types_match(pointee, element) == TYPE_MATCH_EXACT;
+    }
+    return false;
+  }
+
+  // Back to an array of the same length
+  if (is_array_type(to_type)) {
+    AstNode *size = to_type->type_data.array.size;
+    return size && size->type == AST_EXPR_LITERAL &&
+           size->expr.literal.lit_type == LITERAL_INT &&
+           (size_t)size->expr.literal.value.int_val ==
+               from_type->type_data.vector.lane_count &&
+           is_scalar_operand(to_type->type_data.array.element_type);
+  }
+
+  return is_void_type(to_type);
+}
+
+AstNode *typecheck_vector_binary(AstNode *expr, AstNode *left_type,
+                                 AstNode *right_type, ArenaAllocator *arena) {
+  BinaryOp op = expr->expr.binary.op;
+  AstNode *vector = is_vector_type(left_type) ? left_type : right_type;
+  AstNode *other = vector == left_type ? right_type : left_type;
+
+  if (is_vector_type(other)) {
+    if (types_match(left_type, right_type) != TYPE_MATCH_EXACT) {
+      tc_error_help(expr, "Type Error",
+                    "Vector operands need the same element type and lane "
+                    "count; cast one of them to convert its lanes",
+                    "Cannot combine '%s' and '%s'",
+                    type_to_string(left_type, arena),
+                    type_to_string(right_type, arena));
+      return NULL;
+    }
+  } else if (!is_scalar_operand(other)) {
+    tc_error_help(expr, "Type Error",
+                  "A vector combines with another vector or a scalar",
+                  "Cannot combine '%s' and '%s'",
+                  type_to_string(left_type, arena),
+                  type_to_string(right_type, arena));
+    return NULL;
+  }
+
+  AstNode *element = vector_element(vector);
+  bool is_bool = is_bool_type(element);
+  bool is_integer = is_integer_type(element);
+
+  if (op >= BINOP_ADD && op <= BINOP_MOD) {
+    if (is_bool) {
+      tc_error_help(expr, "Type Error",
+                    "Arithmetic on vectors needs numeric lanes",
+                    "'%s' has bool lanes", type_to_string(vector, arena));
+      return NULL;
+    }
+    if (op == BINOP_MOD && !is_integer) {
+      tc_error_help(expr, "Type Error",
+                    "Modulo requires integer operands (int, char)",
+                    "'%s' has floating point lanes",
+                    type_to_string(vector, arena));
+      return NULL;
+    }
+    return vector;
+  }
+
+  if (op >= BINOP_EQ && op <= BINOP_GE) {
+    return create_vector_type(arena,
+                              create_basic_type(arena, "bool", expr->line,
+                                                expr->column),
+                              vector->type_data.vector.lane_count, expr->line,
+                              expr->column);
+  }
+
+  if (op == BINOP_BIT_AND || op == BINOP_BIT_OR || op == BINOP_BIT_XOR) {
+    if (!is_integer && !is_bool) {
+      tc_error_help(expr, "Type Error",
+                    "Bitwise operations on vectors need integer or bool lanes",
+                    "'%s' has floating point lanes",
+                    type_to_string(vector, arena));
+      return NULL;
+    }
+    return vector;
+  }
+
+  if (op == BINOP_SHL || op == BINOP_SHR) {
+    if (!is_integer) {
+      tc_error_help(expr, "Type Error",
+                    "Shifts on vectors need integer lanes",
+                    "'%s' does not have integer lanes",
+                    type_to_string(vector, arena));
+      return NULL;
+    }
+    return vector;
+  }
+
+  if (op == BINOP_AND || op == BINOP_OR) {
+    tc_error_help(expr, "Type Error",
+                  "Use '&' and '|' to combine bool vectors lane by lane",
+                  "'&&' and '||' need bool operands, not '%s'",
+                  type_to_string(vector, arena));
+    return NULL;
+  }
+
+  tc_error(expr, "Unsupported Operation",
+           "'%s' does not support this operator",
+           type_to_string(vector, arena));
+  return NULL;
+}
+
+// v.x, v.zyx, v.xxyy: lanes 0 to 3 by letter, in any order and repeated
+AstNode *typecheck_vector_swizzle(AstNode *expr, AstNode *vector_type,
+                                  ArenaAllocator *arena) {
+  const char *swizzle = expr->expr.member.member;
+  size_t lanes = vector_type->type_data.vector.lane_count;
+  size_t count = strlen(swizzle);
+
+  for (size_t i = 0; i < count; i++) {
+    const char *lane = strchr(swizzle_letters, swizzle[i]);
+    if (!lane) {
+      tc_error_help(expr, "Runtime Access Error",
+                    "Vector lanes are selected with x, y, z and w, or with "
+                    "v[i]",
+                    "'%s' has no member '%s'",
+                    type_to_string(vector_type, arena), swizzle);
+      return NULL;
+    }
+    if ((size_t)(lane - swizzle_letters) >= lanes) {
+      tc_error(expr, "Runtime Access Error",
+               "'%s' has no lane '%c'", type_to_string(vector_type, arena),
+               swizzle[i]);
+      return NULL;
+    }
+  }
+
+  if (count == 1)
+    return vector_element(vector_type);
+
+  if (count > 16 || (count & (count - 1)) != 0) {
+    tc_error_help(expr, "Runtime Access Error",
+                  "A swizzle selects 1, 2, 4, 8 or 16 lanes",
+                  "'%s' selects %zu lanes", swizzle, count);
+    return NULL;
+  }
+  return create_vector_type(arena, vector_element(vector_type), count,
+                            expr->line, expr->column);
+}
+
+// v.sum(), v.product(), v.min(), v.max() and, on bool vectors, v.any(),
+// v.all() and v.mask() reduce the lanes to one value
+AstNode *typecheck_vector_method(AstNode *expr, AstNode *vector_type,
+                                 ArenaAllocator *arena) {
+  const char *name = expr->expr.call.callee->expr.member.member;
+  AstNode *element = vector_element(vector_type);
+  bool is_bool = is_bool_type(element);
+
+  bool numeric = strcmp(name, "sum") == 0 || strcmp(name, "product") == 0 ||
+                 strcmp(name, "min") == 0 || strcmp(name, "max") == 0;
+  bool is_mask = strcmp(name, "mask") == 0;
+  bool logical =
+      strcmp(name, "any") == 0 || strcmp(name, "all") == 0 || is_mask;
+
+  if (!numeric && !logical) {
+    tc_error_help(expr, "Runtime Access Error",
+                  "Vectors have sum, product, min, max, any, all and mask",
+                  "'%s' has no method '%s'",
+                  type_to_string(vector_type, arena), name);
+    return NULL;
+  }
+  if (expr->expr.call.arg_count != 0) {
+    tc_error(expr, "Argument Count Error", "'%s()' takes no arguments", name);
+    return NULL;
+  }
+  if (numeric == is_bool) {
+    tc_error_help(expr, "Type Error",
+                  numeric ? "sum, product, min and max need numeric lanes"
+                          : "any, all and mask need bool lanes",
+                  "Cannot call '%s()' on '%s'", name,
+                  type_to_string(vector_type, arena));
+    return NULL;
+  }
+  // One bit per lane, lane 0 the lowest
+  if (is_mask)
+    return create_basic_type(arena, "int", expr->line, expr->column);
+  return element;
+}
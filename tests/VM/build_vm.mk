@@ -13,7 +13,7 @@ STD_LIBS = ../../std/io.lx \
            ../../std/sys.lx \
            ../../std/termfx.lx \
            ../../std/vector.lx \
-           ../../std/string.lx
+           ../../std/cstring.lx
 
 ALL_SRCS = $(MAIN) $(SRCS) $(STD_LIBS)
 
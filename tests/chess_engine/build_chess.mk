@@ -5,7 +5,7 @@ NAME = chess
 MAIN = main.lx
 CHESS_SRCS = $(filter-out $(MAIN), $(wildcard *.lx))
 
-STD_LIBS = ../../std/string.lx \
+STD_LIBS = ../../std/cstring.lx \
            ../../std/terminal.lx \
            ../../std/termfx.lx \
            ../../std/memory.lx
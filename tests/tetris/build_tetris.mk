@@ -1,6 +1,6 @@
 # Makefile for Luma Tetris
 # Example:
-#   ./luma tests/tetris/tetris.lx -name tetris -l std/termfx.lx std/terminal.lx std/string.lx std/sys.lx std/time.lx std/math.lx
+#   ./luma tests/tetris/tetris.lx -name tetris -l std/termfx.lx std/terminal.lx std/cstring.lx std/sys.lx std/time.lx std/math.lx
 
 LUMA = ./../../luma
 NAME = tetris
@@ -10,7 +10,7 @@ TETRIS_SRCS = $(filter-out $(MAIN), $(wildcard *.lx))
 
 STD_LIBS = ../../std/termfx.lx \
            ../../std/terminal.lx \
-           ../../std/string.lx \
+           ../../std/cstring.lx \
            ../../std/sys.lx \
            ../../std/time.lx \
            ../../std/math.lx